@@ -0,0 +1,728 @@
+#include <string.h>
+#include <new>
+#include "asyncfile.h"
+
+#if ENABLE_IO_URING
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+// UringRing 结构体保存 io_uring 的描述符和映射到用户空间的提交、完成队列
+struct UringRing
+{
+    int             fd;         // io_uring 描述符
+    void*           pSqMap;     // 提交队列的映射
+    size_t          cbSqMap;    // 提交队列映射的大小
+    void*           pCqMap;     // 完成队列的映射，内核支持 IORING_FEAT_SINGLE_MMAP 时与 pSqMap 相同
+    size_t          cbCqMap;    // 完成队列映射的大小
+    io_uring_sqe*   pSqes;      // 提交队列项数组
+    size_t          cbSqes;     // 提交队列项数组的大小
+    UINT32*         pSqHead;    // 内核已取走的位置
+    UINT32*         pSqTail;    // 用户已放入的位置
+    UINT32*         pSqMask;    // 提交队列的掩码
+    UINT32*         pSqArray;   // 提交队列中的项索引
+    UINT32*         pCqHead;    // 用户已收取的位置
+    UINT32*         pCqTail;    // 内核已放入的位置
+    UINT32*         pCqMask;    // 完成队列的掩码
+    io_uring_cqe*   pCqes;      // 完成队列项数组
+    iovec*          pVectors;   // 每个请求 MAX_GATHER_SEGMENTS 项的 iovec 数组，IORING_OP_WRITEV 在请求写完之前使用
+};
+
+// io_uring 的系统调用，C 库没有提供包装
+static int UringSetup(UINT32 cEntries, io_uring_params* pParams)
+{
+    return (int)syscall(__NR_io_uring_setup, cEntries, pParams);
+}
+
+static int UringEnter(int fd, UINT32 cSubmit, UINT32 cMinComplete, UINT32 flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, cSubmit, cMinComplete, flags, nullptr, 0);
+}
+
+static int UringRegister(int fd, UINT32 opcode, const void* pArg, UINT32 cArgs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, pArg, cArgs);
+}
+#endif
+
+// 实现方式的名称
+const char* GetAsyncIoBackendName(AsyncIoBackend backend)
+{
+    switch (backend)
+    {
+    case AsyncIoBackend_Thread: return "thread";
+    case AsyncIoBackend_Uring:  return "io_uring";
+    default:                    return "auto";
+    }
+}
+
+CAsyncFileWriter::CAsyncFileWriter() :
+    m_pFile(nullptr),
+    m_backend(AsyncIoBackend_Auto),
+    m_cDepth(0),
+    m_pRequests(nullptr),
+    m_cInFlight(0),
+    m_bRegistered(FALSE),
+    m_pRegistered(nullptr),
+    m_cbRegistered(0),
+    m_cStalls(0),
+    m_hrIo(S_OK),
+    m_iSubmit(0),
+    m_iWrite(0),
+    m_cCompleted(0),
+    m_bStopIo(FALSE)
+#if ENABLE_IO_URING
+    , m_pRing(nullptr)
+#endif
+{
+}
+
+CAsyncFileWriter::~CAsyncFileWriter()
+{
+    Close();
+}
+
+// 分配请求数组，先尝试 io_uring，不可用且允许时启动写入线程
+HRESULT CAsyncFileWriter::Open(CDirectFile* pFile, CFramePool* pPool, UINT32 cDepth, AsyncIoBackend backend)
+{
+    if (m_pFile != nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+    if (pFile == nullptr || !pFile->IsOpen())
+    {
+        return E_INVALIDARG;
+    }
+
+    m_cDepth = cDepth ? cDepth : DEFAULT_ASYNC_IO_DEPTH;
+    m_pRequests = new (std::nothrow) Request[m_cDepth];
+
+    if (m_pRequests == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    memset(m_pRequests, 0, sizeof(Request) * m_cDepth);
+
+    m_pFile = pFile;
+    m_cInFlight = 0;
+    m_cStalls = 0;
+    m_hrIo = S_OK;
+    m_iSubmit = 0;
+    m_iWrite = 0;
+    m_cCompleted = 0;
+    m_bStopIo = FALSE;
+
+    if (backend != AsyncIoBackend_Thread)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+#if ENABLE_IO_URING
+        hr = OpenUring(pPool);
+#else
+        (void)pPool;
+#endif
+        if (SUCCEEDED(hr))
+        {
+            m_backend = AsyncIoBackend_Uring;
+            return S_OK;
+        }
+        if (backend == AsyncIoBackend_Uring)
+        {
+            delete[] m_pRequests;
+            m_pRequests = nullptr;
+            m_pFile = nullptr;
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        }
+    }
+
+    m_backend = AsyncIoBackend_Thread;
+    m_io = std::thread(&CAsyncFileWriter::IoThread, this);
+    return S_OK;
+}
+
+// 归还调用方交来的缓冲区
+static void ReleaseBuffers(CFrameBuffer* const* ppBuffers, UINT32 cBuffers)
+{
+    for (UINT32 i = 0; i < cBuffers; i++)
+    {
+        ppBuffers[i]->Release();
+    }
+}
+
+// 提交一个写请求，即只有一段的分散/聚集写入
+HRESULT CAsyncFileWriter::Submit(CFrameBuffer* pBuffer, UINT64 offset, UINT32 cbData)
+{
+    if (pBuffer == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (cbData > pBuffer->GetCapacity())
+    {
+        pBuffer->Release();
+        return m_pFile ? E_INVALIDARG : E_UNEXPECTED;
+    }
+
+    FileSegment segment = { pBuffer->GetData(), cbData };
+    return SubmitGather(&segment, 1, &pBuffer, 1, offset);
+}
+
+// 提交一个分散/聚集写请求
+HRESULT CAsyncFileWriter::SubmitGather(const FileSegment* pSegments, UINT32 cSegments, CFrameBuffer* const* ppBuffers,
+    UINT32 cBuffers, UINT64 offset)
+{
+    if (pSegments == nullptr || ppBuffers == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pFile == nullptr || cSegments == 0 || cSegments > MAX_GATHER_SEGMENTS || cBuffers > MAX_GATHER_SEGMENTS)
+    {
+        ReleaseBuffers(ppBuffers, cBuffers);
+        return m_pFile ? E_INVALIDARG : E_UNEXPECTED;
+    }
+
+    HRESULT hr = GetStatus();
+
+    if (FAILED(hr))
+    {
+        ReleaseBuffers(ppBuffers, cBuffers);
+        return hr;
+    }
+
+    UINT64 cbData = 0;
+
+    for (UINT32 i = 0; i < cSegments; i++)
+    {
+        cbData += pSegments[i].cbData;
+    }
+
+#if ENABLE_IO_URING
+    if (m_backend == AsyncIoBackend_Uring)
+    {
+        // 先顺便收取已有的完成，不等待
+        hr = ReapUring(FALSE);
+
+        if (SUCCEEDED(hr) && m_cInFlight == m_cDepth)
+        {
+            m_cStalls++;
+
+            while (SUCCEEDED(hr) && m_cInFlight == m_cDepth)
+            {
+                hr = ReapUring(TRUE);
+            }
+        }
+
+        if (FAILED(hr))
+        {
+            ReleaseBuffers(ppBuffers, cBuffers);
+            return hr;
+        }
+
+        UINT32 index = 0;
+
+        while (m_pRequests[index].bBusy)
+        {
+            index++;
+        }
+
+        Request& request = m_pRequests[index];
+        memcpy(request.segments, pSegments, sizeof(FileSegment) * cSegments);
+        memcpy(request.pBuffers, ppBuffers, sizeof(CFrameBuffer*) * cBuffers);
+        request.cSegments = cSegments;
+        request.cBuffers = cBuffers;
+        request.offset = offset;
+        request.cbData = cbData;
+        request.cbDone = 0;
+        request.bBusy = TRUE;
+        m_cInFlight++;
+
+        hr = SubmitUring(index);
+
+        if (FAILED(hr))
+        {
+            Complete(&request, hr);
+            m_cInFlight--;
+        }
+        return hr;
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_cInFlight == m_cDepth)
+    {
+        m_cStalls++;
+        m_cvCompleted.wait(lock, [this]() { return m_cInFlight < m_cDepth; });
+    }
+
+    Request& request = m_pRequests[m_iSubmit];
+    memcpy(request.segments, pSegments, sizeof(FileSegment) * cSegments);
+    memcpy(request.pBuffers, ppBuffers, sizeof(CFrameBuffer*) * cBuffers);
+    request.cSegments = cSegments;
+    request.cBuffers = cBuffers;
+    request.offset = offset;
+    request.cbData = cbData;
+    request.cbDone = 0;
+    request.bBusy = TRUE;
+
+    m_iSubmit = (m_iSubmit + 1) % m_cDepth;
+    m_cInFlight++;
+    m_cvSubmitted.notify_one();
+    return S_OK;
+}
+
+// 等待至少一个请求写完
+HRESULT CAsyncFileWriter::WaitForCompletion()
+{
+    if (m_pFile == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+#if ENABLE_IO_URING
+    if (m_backend == AsyncIoBackend_Uring)
+    {
+        return m_cInFlight ? ReapUring(TRUE) : S_FALSE;
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_cInFlight == 0)
+    {
+        return S_FALSE;
+    }
+
+    UINT64 cCompleted = m_cCompleted;
+    m_cvCompleted.wait(lock, [this, cCompleted]() { return m_cCompleted != cCompleted; });
+    return S_OK;
+}
+
+// 等待所有请求写完
+HRESULT CAsyncFileWriter::Flush()
+{
+    if (m_pFile == nullptr)
+    {
+        return S_OK;
+    }
+
+#if ENABLE_IO_URING
+    if (m_backend == AsyncIoBackend_Uring)
+    {
+        while (m_cInFlight > 0)
+        {
+            HRESULT hr = ReapUring(TRUE);
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        return GetStatus();
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvCompleted.wait(lock, [this]() { return m_cInFlight == 0; });
+    return GetStatus();
+}
+
+// 写完所有请求后释放资源；io_uring 出错无法再收取完成时，直接归还仍在写的缓冲区
+HRESULT CAsyncFileWriter::Close()
+{
+    if (m_pFile == nullptr)
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = Flush();
+
+#if ENABLE_IO_URING
+    if (m_backend == AsyncIoBackend_Uring)
+    {
+        CloseUring();
+    }
+#endif
+
+    if (m_io.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStopIo = TRUE;
+            m_cvSubmitted.notify_one();
+        }
+        m_io.join();
+    }
+
+    for (UINT32 i = 0; i < m_cDepth; i++)
+    {
+        if (m_pRequests[i].bBusy)
+        {
+            Complete(&m_pRequests[i], E_ABORT);
+        }
+    }
+
+    delete[] m_pRequests;
+    m_pRequests = nullptr;
+    m_cInFlight = 0;
+    m_pFile = nullptr;
+    m_bRegistered = FALSE;
+    m_pRegistered = nullptr;
+    m_cbRegistered = 0;
+
+    return SUCCEEDED(hr) ? GetStatus() : hr;
+}
+
+// 归还各缓冲区，只保留第一个错误
+void CAsyncFileWriter::Complete(Request* pRequest, HRESULT hr)
+{
+    if (FAILED(hr))
+    {
+        HRESULT hrExpected = S_OK;
+        m_hrIo.compare_exchange_strong(hrExpected, hr);
+    }
+
+    ReleaseBuffers(pRequest->pBuffers, pRequest->cBuffers);
+    pRequest->cBuffers = 0;
+    pRequest->bBusy = FALSE;
+}
+
+// 写入线程：按提交顺序写请求；出错后不再写入，但仍把请求标记为写完并归还缓冲区，避免提交线程一直等待
+void CAsyncFileWriter::IoThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        if (m_cInFlight == 0)
+        {
+            if (m_bStopIo)
+            {
+                break;
+            }
+
+            m_cvSubmitted.wait(lock);
+            continue;
+        }
+
+        Request& request = m_pRequests[m_iWrite];
+        lock.unlock();
+
+        HRESULT hr = GetStatus();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pFile->WriteGatherAt(request.offset, request.segments, request.cSegments);
+        }
+
+        Complete(&request, hr);
+
+        lock.lock();
+        m_iWrite = (m_iWrite + 1) % m_cDepth;
+        m_cInFlight--;
+        m_cCompleted++;
+        m_cvCompleted.notify_all();
+    }
+}
+
+#if ENABLE_IO_URING
+
+// 创建 io_uring、映射提交和完成队列，再把缓冲池的整块内存注册为固定缓冲区（注册失败时照常使用普通写入）
+HRESULT CAsyncFileWriter::OpenUring(CFramePool* pPool)
+{
+    UringRing* pRing = new (std::nothrow) UringRing();
+
+    if (pRing == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pRing->pVectors = new (std::nothrow) iovec[(size_t)m_cDepth * MAX_GATHER_SEGMENTS];
+
+    if (pRing->pVectors == nullptr)
+    {
+        delete pRing;
+        return E_OUTOFMEMORY;
+    }
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    pRing->fd = UringSetup(m_cDepth, &params);
+
+    if (pRing->fd < 0)
+    {
+        HRESULT hr = HResultFromErrno(errno);
+        delete[] pRing->pVectors;
+        delete pRing;
+        return hr;
+    }
+
+    m_pRing = pRing;
+
+    // IORING_OP_WRITE 需要 5.6 以上的内核，用同一版本加入的 IORING_FEAT_RW_CUR_POS 判断
+    if ((params.features & IORING_FEAT_RW_CUR_POS) == 0)
+    {
+        CloseUring();
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    pRing->cbSqMap = params.sq_off.array + params.sq_entries * sizeof(UINT32);
+    pRing->cbCqMap = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    pRing->cbSqes = params.sq_entries * sizeof(io_uring_sqe);
+
+    BOOL bSingleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+    if (bSingleMap && pRing->cbCqMap > pRing->cbSqMap)
+    {
+        pRing->cbSqMap = pRing->cbCqMap;
+    }
+
+    pRing->pSqMap = mmap(nullptr, pRing->cbSqMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd,
+        IORING_OFF_SQ_RING);
+    if (pRing->pSqMap == MAP_FAILED)
+    {
+        pRing->pSqMap = nullptr;
+    }
+
+    if (bSingleMap)
+    {
+        pRing->pCqMap = pRing->pSqMap;
+    }
+    else if (pRing->pSqMap)
+    {
+        pRing->pCqMap = mmap(nullptr, pRing->cbCqMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd,
+            IORING_OFF_CQ_RING);
+        if (pRing->pCqMap == MAP_FAILED)
+        {
+            pRing->pCqMap = nullptr;
+        }
+    }
+
+    if (pRing->pCqMap)
+    {
+        void* pSqes = mmap(nullptr, pRing->cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, pRing->fd,
+            IORING_OFF_SQES);
+        pRing->pSqes = (pSqes == MAP_FAILED) ? nullptr : (io_uring_sqe*)pSqes;
+    }
+
+    if (pRing->pSqes == nullptr)
+    {
+        HRESULT hr = HResultFromErrno(errno);
+        CloseUring();
+        return hr;
+    }
+
+    BYTE* pSq = (BYTE*)pRing->pSqMap;
+    BYTE* pCq = (BYTE*)pRing->pCqMap;
+
+    pRing->pSqHead = (UINT32*)(pSq + params.sq_off.head);
+    pRing->pSqTail = (UINT32*)(pSq + params.sq_off.tail);
+    pRing->pSqMask = (UINT32*)(pSq + params.sq_off.ring_mask);
+    pRing->pSqArray = (UINT32*)(pSq + params.sq_off.array);
+    pRing->pCqHead = (UINT32*)(pCq + params.cq_off.head);
+    pRing->pCqTail = (UINT32*)(pCq + params.cq_off.tail);
+    pRing->pCqMask = (UINT32*)(pCq + params.cq_off.ring_mask);
+    pRing->pCqes = (io_uring_cqe*)(pCq + params.cq_off.cqes);
+
+    if (pPool && pPool->GetSlab())
+    {
+        iovec iov;
+        iov.iov_base = pPool->GetSlab();
+        iov.iov_len = pPool->GetSlabSize();
+
+        if (UringRegister(pRing->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0)
+        {
+            m_bRegistered = TRUE;
+            m_pRegistered = pPool->GetSlab();
+            m_cbRegistered = pPool->GetSlabSize();
+        }
+    }
+
+    return S_OK;
+}
+
+// 解除映射并关闭 io_uring，注册的固定缓冲区随之注销
+void CAsyncFileWriter::CloseUring()
+{
+    UringRing* pRing = m_pRing;
+
+    if (pRing == nullptr)
+    {
+        return;
+    }
+
+    if (pRing->pSqes)
+    {
+        munmap(pRing->pSqes, pRing->cbSqes);
+    }
+    if (pRing->pCqMap && pRing->pCqMap != pRing->pSqMap)
+    {
+        munmap(pRing->pCqMap, pRing->cbCqMap);
+    }
+    if (pRing->pSqMap)
+    {
+        munmap(pRing->pSqMap, pRing->cbSqMap);
+    }
+
+    close(pRing->fd);
+    delete[] pRing->pVectors;
+    delete pRing;
+    m_pRing = nullptr;
+}
+
+// 把请求尚未写完的部分放进提交队列；每个请求同时最多占一个提交队列项，队列不会满
+// 只有一段时用 IORING_OP_WRITE（在固定缓冲区内时用 IORING_OP_WRITE_FIXED），多段时跳过已写完的部分，其余各段用 IORING_OP_WRITEV
+HRESULT CAsyncFileWriter::SubmitUring(UINT32 index)
+{
+    UringRing* pRing = m_pRing;
+    Request& request = m_pRequests[index];
+
+    UINT32 tail = *pRing->pSqTail;
+    UINT32 slot = tail & *pRing->pSqMask;
+    io_uring_sqe* pSqe = &pRing->pSqes[slot];
+
+    memset(pSqe, 0, sizeof(*pSqe));
+    pSqe->fd = m_pFile->GetDescriptor();
+    pSqe->off = request.offset + request.cbDone;
+    pSqe->user_data = index;
+
+    if (request.cSegments == 1)
+    {
+        const BYTE* pData = request.segments[0].pData + request.cbDone;
+        UINT32 cbData = (UINT32)(request.cbData - request.cbDone);
+
+        pSqe->opcode = IORING_OP_WRITE;
+        pSqe->addr = (UINT64)(uintptr_t)pData;
+        pSqe->len = cbData;
+
+        if (m_bRegistered && pData >= m_pRegistered && pData + cbData <= m_pRegistered + m_cbRegistered)
+        {
+            pSqe->opcode = IORING_OP_WRITE_FIXED;
+            pSqe->buf_index = 0;
+        }
+    }
+    else
+    {
+        iovec* pVectors = pRing->pVectors + (size_t)index * MAX_GATHER_SEGMENTS;
+        UINT32 cVectors = 0;
+        UINT64 cbSkip = request.cbDone;
+
+        for (UINT32 i = 0; i < request.cSegments; i++)
+        {
+            const FileSegment& segment = request.segments[i];
+
+            if (cbSkip >= segment.cbData)
+            {
+                cbSkip -= segment.cbData;
+                continue;
+            }
+
+            pVectors[cVectors].iov_base = const_cast<BYTE*>(segment.pData) + cbSkip;
+            pVectors[cVectors].iov_len = segment.cbData - (size_t)cbSkip;
+            cbSkip = 0;
+            cVectors++;
+        }
+
+        pSqe->opcode = IORING_OP_WRITEV;
+        pSqe->addr = (UINT64)(uintptr_t)pVectors;
+        pSqe->len = cVectors;
+    }
+
+    pRing->pSqArray[slot] = slot;
+    __atomic_store_n(pRing->pSqTail, tail + 1, __ATOMIC_RELEASE);
+
+    for (;;)
+    {
+        int cSubmitted = UringEnter(pRing->fd, 1, 0, 0);
+
+        if (cSubmitted > 0)
+        {
+            return S_OK;
+        }
+        if (cSubmitted < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        // 内核没有取走这一项，撤回后按错误返回
+        HRESULT hr = (cSubmitted < 0) ? HResultFromErrno(errno) : E_FAIL;
+        __atomic_store_n(pRing->pSqTail, tail, __ATOMIC_RELEASE);
+        return hr;
+    }
+}
+
+// 收取完成：写完的请求归还缓冲区，部分写入（或被打断）的请求续写剩余部分，仍算在写
+HRESULT CAsyncFileWriter::ReapUring(BOOL bWait)
+{
+    UringRing* pRing = m_pRing;
+    UINT32 cReaped = 0;
+
+    for (;;)
+    {
+        UINT32 head = *pRing->pCqHead;
+        UINT32 tail = __atomic_load_n(pRing->pCqTail, __ATOMIC_ACQUIRE);
+
+        if (head == tail)
+        {
+            if (!bWait || cReaped > 0 || m_cInFlight == 0)
+            {
+                return S_OK;
+            }
+
+            if (UringEnter(pRing->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                HRESULT hr = HResultFromErrno(errno);
+                HRESULT hrExpected = S_OK;
+                m_hrIo.compare_exchange_strong(hrExpected, hr);
+                return hr;
+            }
+            continue;
+        }
+
+        const io_uring_cqe* pCqe = &pRing->pCqes[head & *pRing->pCqMask];
+        UINT32 index = (UINT32)pCqe->user_data;
+        int result = pCqe->res;
+
+        __atomic_store_n(pRing->pCqHead, head + 1, __ATOMIC_RELEASE);
+
+        Request& request = m_pRequests[index];
+        HRESULT hr = S_OK;
+        BOOL bDone = TRUE;
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            bDone = FALSE;
+        }
+        else if (result < 0)
+        {
+            hr = HResultFromErrno(-result);
+        }
+        else if (result == 0)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_DISK_FULL);
+        }
+        else
+        {
+            request.cbDone += (UINT32)result;
+            bDone = request.cbDone >= request.cbData;
+        }
+
+        if (!bDone)
+        {
+            hr = SubmitUring(index);
+            bDone = FAILED(hr);
+        }
+
+        if (bDone)
+        {
+            Complete(&request, hr);
+            m_cInFlight--;
+            cReaped++;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "directfile.h"
+#include "framepool.h"
+
+// 编译开关：定义为 0 时不编译 io_uring 后端，只使用写入线程；io_uring 只在 Linux 上可用
+#ifndef ENABLE_IO_URING
+#ifdef __linux__
+#define ENABLE_IO_URING 1
+#else
+#define ENABLE_IO_URING 0
+#endif
+#endif
+
+// 默认同时在写的请求数
+const UINT32 DEFAULT_ASYNC_IO_DEPTH = 4;
+
+// 异步写入的实现方式
+enum AsyncIoBackend
+{
+    AsyncIoBackend_Auto = 0,    // 优先使用 io_uring，不可用时（其他平台、内核太旧或被禁用）使用写入线程
+    AsyncIoBackend_Thread,      // 独立的写入线程按提交顺序做定位写入（pwrite，Windows 为带偏移的 WriteFile）
+    AsyncIoBackend_Uring,       // io_uring：提交线程直接把请求交给内核，没有额外的线程
+};
+
+// 实现方式的名称，用于日志输出
+const char* GetAsyncIoBackendName(AsyncIoBackend backend);
+
+struct UringRing;
+
+// CAsyncFileWriter 类把缓冲池中的大块缓冲区异步写到 CDirectFile 的指定偏移，提交后立即返回，
+// 写完时由完成处理 Release 缓冲区，使其回到缓冲池；同时在写的请求数固定为 cDepth，达到后提交才会等待
+//
+// io_uring 后端把缓冲池的整块内存注册为固定缓冲区（IORING_OP_WRITE_FIXED），每次写入不再固定和解除固定页面；
+// 完成在提交线程的 Submit 和 WaitForCompletion 中收取，部分写入自动续写剩余部分
+// 写入线程后端用于其他平台和 io_uring 不可用时，完成在写入线程中处理
+// SubmitGather 把分散在多个缓冲区中的数据作为一个请求写出（io_uring 为 IORING_OP_WRITEV，写入线程为 WriteGatherAt）
+//
+// Submit、WaitForCompletion、Flush 和 Close 只能在同一个线程中调用；稳态下不分配堆内存
+class CAsyncFileWriter
+{
+public:
+    CAsyncFileWriter();
+    ~CAsyncFileWriter();
+
+    // 开始向 pFile 写入（pFile 必须已打开，并保持打开到 Close 之后）；pPool 为提交的缓冲区所在的缓冲池，
+    // 可以为空（不注册固定缓冲区）；指定 AsyncIoBackend_Uring 而 io_uring 不可用时返回 HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED)
+    HRESULT Open(CDirectFile* pFile, CFramePool* pPool, UINT32 cDepth = DEFAULT_ASYNC_IO_DEPTH,
+        AsyncIoBackend backend = AsyncIoBackend_Auto);
+
+    // 把 pBuffer 开头的 cbData 字节写到文件偏移 offset，接管调用方持有的一个引用；
+    // 在写的请求已达 cDepth 时等待其中一个写完；之前的写入已经出错时直接 Release 缓冲区并返回该错误
+    HRESULT Submit(CFrameBuffer* pBuffer, UINT64 offset, UINT32 cbData);
+
+    // 把 cSegments 段（不超过 MAX_GATHER_SEGMENTS）依次写到文件偏移 offset，作为一个请求一次写出；
+    // 接管调用方对 ppBuffers 中 cBuffers 个缓冲区各持有的一个引用，全部写完后 Release，各段的数据必须位于这些缓冲区中。
+    // 其余同 Submit
+    HRESULT SubmitGather(const FileSegment* pSegments, UINT32 cSegments, CFrameBuffer* const* ppBuffers,
+        UINT32 cBuffers, UINT64 offset);
+
+    // 等待至少一个请求写完（例如缓冲池已空时）；没有在写的请求时返回 S_FALSE
+    HRESULT WaitForCompletion();
+
+    // 等待所有请求写完，返回第一个写入错误
+    HRESULT Flush();
+
+    // Flush 后释放 io_uring 或停止写入线程，返回第一个写入错误
+    HRESULT Close();
+
+    // 第一个写入错误，没有错误时为 S_OK
+    HRESULT GetStatus() const { return m_hrIo.load(std::memory_order_relaxed); }
+
+    // 实际使用的实现方式
+    AsyncIoBackend GetBackend() const { return m_backend; }
+
+    // 是否注册了固定缓冲区
+    BOOL    IsRegistered() const { return m_bRegistered; }
+
+    // 同时在写的请求数上限
+    UINT32  GetDepth() const { return m_cDepth; }
+
+    // Submit 因在写的请求已达上限而等待的次数
+    UINT64  StallCount() const { return m_cStalls; }
+
+private:
+    CAsyncFileWriter(const CAsyncFileWriter&);
+    CAsyncFileWriter& operator=(const CAsyncFileWriter&);
+
+    // Request 结构体是一个写请求
+    struct Request
+    {
+        FileSegment     segments[MAX_GATHER_SEGMENTS];  // 要写的各段，依次连续写到 offset
+        CFrameBuffer*   pBuffers[MAX_GATHER_SEGMENTS];  // 各段所在的缓冲区，写完后 Release
+        UINT32          cSegments;  // 段数
+        UINT32          cBuffers;   // 缓冲区数
+        UINT64          offset;     // 文件偏移
+        UINT64          cbData;     // 要写的字节数
+        UINT64          cbDone;     // 已写完的字节数
+        BOOL            bBusy;      // 是否在写
+    };
+
+    // 写完一个请求：归还各缓冲区并记录错误
+    void    Complete(Request* pRequest, HRESULT hr);
+
+    // 写入线程：按提交顺序写请求
+    void    IoThread();
+
+#if ENABLE_IO_URING
+    // 创建 io_uring 并注册缓冲池
+    HRESULT OpenUring(CFramePool* pPool);
+
+    // 释放 io_uring
+    void    CloseUring();
+
+    // 把请求剩余的部分放进提交队列并交给内核
+    HRESULT SubmitUring(UINT32 index);
+
+    // 收取完成队列中的所有完成；bWait 为 TRUE 且一个都没有时等待至少一个
+    HRESULT ReapUring(BOOL bWait);
+#endif
+
+    CDirectFile*            m_pFile;        // 输出文件
+    AsyncIoBackend          m_backend;      // 实际使用的实现方式
+    UINT32                  m_cDepth;       // 在写的请求数上限
+    Request*                m_pRequests;    // 请求数组
+    UINT32                  m_cInFlight;    // 在写的请求数
+    BOOL                    m_bRegistered;  // 是否注册了固定缓冲区
+    BYTE*                   m_pRegistered;  // 固定缓冲区的起始地址
+    size_t                  m_cbRegistered; // 固定缓冲区的大小
+    UINT64                  m_cStalls;      // 等待次数
+    std::atomic<HRESULT>    m_hrIo;         // 第一个写入错误
+
+    // 写入线程后端：请求按提交顺序使用 m_pRequests，m_iSubmit 为下一个提交位置
+    std::thread             m_io;           // 写入线程
+    std::mutex              m_mutex;        // 保护以下成员和 m_cInFlight
+    std::condition_variable m_cvSubmitted;  // 通知写入线程有请求提交
+    std::condition_variable m_cvCompleted;  // 通知提交线程有请求写完
+    UINT32                  m_iSubmit;      // 下一个提交位置
+    UINT32                  m_iWrite;       // 写入线程下一个要写的请求
+    UINT64                  m_cCompleted;   // 已写完的请求数
+    BOOL                    m_bStopIo;      // 请求写入线程退出
+
+#if ENABLE_IO_URING
+    UringRing*              m_pRing;        // io_uring 的映射
+#endif
+};
@@ -0,0 +1,5848 @@
+// 流水线压测程序：用 CSyntheticSource 代替摄像头，测量 读取 -> 时间戳校正 -> 入队 -> 写入 的吞吐与延迟
+// 不依赖 Media Foundation，可在 Linux 构建机上运行，例如：
+//   benchmark --width 3840 --height 2160 --fps 120 --frames 1200
+//   benchmark --format yuy2 --unthrottled --frames 5000
+//   benchmark --alloc-check      预热后统计堆分配次数，稳态下出现任何分配即返回失败
+//   benchmark --format yuy2 --output nv12    写入线程把帧转换成 NV12 再交给接收器
+//   benchmark --convert [--threads N]        逐个像素格式对比较 SIMD 与标量的转换结果并测量吞吐
+//   benchmark --analyze 1 --analyze-rows 4   每帧、每 4 行统计一次亮度，输出最后一帧的统计与异常计数
+//   benchmark --stats-check                  比较各 SIMD 级别的亮度统计与标量结果并测量耗时
+//   benchmark --cameras 4 --unthrottled      同时运行 4 路流水线，与单路对比聚合吞吐的扩展性
+//   benchmark --preroll 2 --trigger-at 300   预录最近 2 秒，第 300 帧时触发，检查写出的帧连续且时间戳从 0 开始
+//   benchmark --segment 1 --retain 3 --finalize-ms 200   每秒切换一段、保留 3 段，模拟 200 毫秒的 Finalize
+//   benchmark --raw /data/test.raw --unthrottled   未压缩录制的持续写入速度，与同一磁盘直接 I/O 的裸带宽对比
+//   benchmark --raw /data/test.raw --cameras 3 --io thread   同一磁盘上同时录制 3 路，用写入线程代替 io_uring 对比
+//   benchmark --stats-file stats.json --stats-json --stats-interval 500   每 500 毫秒把统计和各阶段延迟写入文件
+//   benchmark --latency-check                检查直方图分位数的精度并测量每个埋点的开销；
+//                                            用 -DENABLE_LATENCY_STATS=0 重新编译后对比 --unthrottled 的帧率即为埋点的整体开销
+//   benchmark --policy oldest --gop 30       写出跟不上时挤掉最旧的帧；数据源模拟每 30 帧一个关键帧的压缩摄像头
+//   benchmark --drop-check                   让接收器比数据源慢，检查每种过载策略的丢帧计数、原因和帧类型
+//   benchmark --negotiate-check              用一张典型摄像头的能力表检查采集格式的协商结果
+//   benchmark --cache-check                  检查设备能力缓存的读写、校验和作废规则，并测量读取缓存的耗时
+//   benchmark --recovery-check               用模拟的热插拔事件检查设备丢失后不中断录制的恢复与时间戳连续性
+//   benchmark --motion-check                 比较各 SIMD 级别的运动检测结果，检查门控写出的帧与时间戳，以及静止画面省下的写入量
+//   benchmark --flat --motion 4 --motion-hold 2000   接收器前加运动门控，画面变化不足 4 个亮度级且超过保持时长时不写出
+//   benchmark --scale-check                  比较各 SIMD 级别的缩放结果，检查多路缩放输出的帧数、时间戳和稳态下的堆分配
+//   benchmark --format yuy2 --simulcast 480,240   转换成 NV12 一次，除原始帧之外再写出 480 行和 240 行的两路缩放输出
+//   benchmark --bus-check                    测量帧总线随订阅者增加的发布开销，检查慢订阅者只丢自己的帧、不影响其他订阅者
+//   benchmark --shm-check                    启动读取子进程，检查共享内存帧环的完整性和慢读取方的跳帧，输出跨进程延迟
+//   benchmark --stream-check                 用两个回环观看端检查网络发送的帧完整、慢观看端只丢自己的帧，输出发送延迟
+//   benchmark --jpeg-check                   比较各 SIMD 级别和线程数下的 JPEG 编码结果，检查码流和 MKV 文件的结构
+//   benchmark --jpeg-bench [--threads N]     1080p 和 4K 的软件 JPEG 编码帧率随线程数（1 到 N）的扩展
+//   benchmark --async-check                  用写入线程和 io_uring 乱序写入并读回，检查内容、块全部回到缓冲池且不分配堆内存
+//   benchmark --replay /data/field.raw --speed 0   不节流回放一段录制，输出相对实时的倍数和写出结果的哈希，用于比较两个构建
+//   benchmark --replay-check                 录制后用拉模式和推模式、不同倍速回放，检查帧、时间戳和哈希与录制时一致
+//   benchmark --state-check                  多个线程同时回调、开始和结束捕获，检查回调不会访问已释放的读取器，并测量回调进入的开销
+//   benchmark --raw /data/test.raw --buffered --batch 16 --batch-linger 2000 --gather   每批最多 16 帧、作为一个分散/聚集写请求
+//   benchmark --batch-check                  检查批量写出的文件回放后与写入内容一致、写入次数减少，以及批量上限随延迟上限调整
+//   benchmark --suite --suite-out results.jsonl   按分辨率、像素格式、帧率和接收器的所有组合逐个运行，
+//                                            每个组合输出一行 JSON（帧率、延迟分位数、每帧 CPU 时间、峰值内存）
+//   benchmark --suite --suite-baseline base.jsonl --suite-tolerance 10   与之前的结果比较，退化超过 10% 时返回 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+#include <memory>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include "pipeline.h"
+#include "prerollsink.h"
+#include "segmentsink.h"
+#include "rawsink.h"
+#include "statsreport.h"
+#include "negotiate.h"
+#include "capcache.h"
+#include "recovery.h"
+#include "motiongate.h"
+#include "simulcastsink.h"
+#include "framebus.h"
+#include "shmring.h"
+#include "netsink.h"
+#include "mjpegsink.h"
+#include "replay.h"
+#include "capstate.h"
+
+#ifdef _WIN32
+#include <psapi.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <Dbt.h>
+#include "capture.h"
+#include <winsock2.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#endif
+
+// 进程内 operator new 的调用次数，用于 --alloc-check
+static std::atomic<UINT64> g_cAllocations(0);
+
+// 替换全局的 operator new/delete，统计堆分配次数
+void* operator new(size_t cb)
+{
+    g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(cb ? cb : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t cb)
+{
+    return operator new(cb);
+}
+
+void* operator new(size_t cb, const std::nothrow_t&) noexcept
+{
+    g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(cb ? cb : 1);
+}
+
+void* operator new[](size_t cb, const std::nothrow_t& tag) noexcept
+{
+    return operator new(cb, tag);
+}
+
+void* operator new(size_t cb, std::align_val_t alignment)
+{
+    g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = AlignedAlloc(cb ? cb : 1, (size_t)alignment);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new(size_t cb, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    g_cAllocations.fetch_add(1, std::memory_order_relaxed);
+    return AlignedAlloc(cb ? cb : 1, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { AlignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { AlignedFree(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { AlignedFree(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+// 解析像素格式名称
+static UINT32 ParseSubtype(const char* pszName)
+{
+    if (strcmp(pszName, "nv12") == 0) { return FOURCC_NV12; }
+    if (strcmp(pszName, "i420") == 0) { return FOURCC_I420; }
+    if (strcmp(pszName, "iyuv") == 0) { return FOURCC_IYUV; }
+    if (strcmp(pszName, "yuy2") == 0) { return FOURCC_YUY2; }
+    if (strcmp(pszName, "uyvy") == 0) { return FOURCC_UYVY; }
+    if (strcmp(pszName, "rgb24") == 0) { return FOURCC_RGB24; }
+    if (strcmp(pszName, "rgb32") == 0) { return FOURCC_RGB32; }
+    return 0;
+}
+
+// --convert 模式下每个格式对的计时次数
+static const UINT32 c_convertIterations = 20;
+
+// 连续转换 cIterations 次，返回每秒处理的字节数（输入加输出）
+static double MeasureConversion(CFrameConverter* pConverter, const BYTE* pSrc, BYTE* pDst, UINT32 cIterations)
+{
+    LONGLONG llStart = GetClockTime();
+
+    for (UINT32 i = 0; i < cIterations; i++)
+    {
+        pConverter->Convert(pSrc, pDst);
+    }
+
+    double fSeconds = (GetClockTime() - llStart) / 1e7;
+    double cbFrame = (double)GetFrameSize(pConverter->GetInputFormat()) + GetFrameSize(pConverter->GetOutputFormat());
+
+    return fSeconds > 0 ? cbFrame * cIterations / fSeconds : 0;
+}
+
+// 对每个支持的格式对：以单线程标量结果为参考，检查各 SIMD 级别的多线程结果逐字节一致，并输出吞吐
+static int RunConversionCheck(UINT32 width, UINT32 height, UINT32 cThreads)
+{
+    static const UINT32 subtypes[] =
+    {
+        FOURCC_NV12, FOURCC_I420, FOURCC_YUY2, FOURCC_UYVY, FOURCC_RGB24, FOURCC_RGB32
+    };
+
+    CTaskPool pool;
+    CTaskPool* pPool = CTaskPool::GetDefault();
+
+    if (cThreads != 0)
+    {
+        if (FAILED(pool.Initialize(cThreads)))
+        {
+            fprintf(stderr, "Failed to start %u threads.\n", cThreads);
+            return -1;
+        }
+        pPool = &pool;
+    }
+
+    printf("convert     %ux%u, cpu %s, %u threads\n", width, height, GetCpuLevelName(GetCpuLevel()),
+        pPool ? pPool->ThreadCount() : 1);
+    printf("%-12s %12s %12s %12s\n", "", "scalar", "sse2", "avx2");
+
+    int cMismatches = 0;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    {
+        for (UINT32 j = 0; j < ARRAYSIZE(subtypes); j++)
+        {
+            if (i == j)
+            {
+                continue;
+            }
+
+            VideoFormat input = { subtypes[i], width, height, 30, 1 };
+            VideoFormat output = input;
+            output.subtype = subtypes[j];
+
+            CFrameConverter reference;
+            reference.SetBandCount(1);
+
+            if (FAILED(reference.Initialize(input, output.subtype, CpuLevel_Scalar)))
+            {
+                fprintf(stderr, "Unsupported size %ux%u.\n", width, height);
+                return -1;
+            }
+
+            std::vector<BYTE> src(GetFrameSize(input));
+            std::vector<BYTE> expected(GetFrameSize(output));
+            std::vector<BYTE> actual(GetFrameSize(output));
+
+            // 固定种子的伪随机数据，覆盖色度饱和与裁剪
+            UINT32 seed = 0x12345678 + i * 16 + j;
+            for (size_t k = 0; k < src.size(); k++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                src[k] = (BYTE)(seed >> 24);
+            }
+
+            reference.Convert(src.data(), expected.data());
+
+            char szName[32];
+            snprintf(szName, sizeof(szName), "%s>%s", GetSubtypeName(input.subtype), GetSubtypeName(output.subtype));
+            printf("%-12s", szName);
+
+            for (int level = CpuLevel_Scalar; level <= CpuLevel_AVX2; level++)
+            {
+                if (level > GetCpuLevel())
+                {
+                    printf(" %12s", "-");
+                    continue;
+                }
+
+                CFrameConverter converter;
+                converter.Initialize(input, output.subtype, (CpuLevel)level, pPool);
+
+                memset(actual.data(), 0xCD, actual.size());
+                converter.Convert(src.data(), actual.data());
+
+                if (memcmp(expected.data(), actual.data(), actual.size()) != 0)
+                {
+                    printf(" %12s", "MISMATCH");
+                    cMismatches++;
+                    continue;
+                }
+
+                double fRate = MeasureConversion(&converter, src.data(), actual.data(), c_convertIterations);
+                printf(" %9.2f GB/s", fRate / 1e9);
+            }
+            printf("\n");
+        }
+    }
+
+    if (cMismatches != 0)
+    {
+        fprintf(stderr, "FAILED: %d conversions differ from the scalar reference.\n", cMismatches);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 对每种采集格式：检查各 SIMD 级别的亮度统计与标量结果一致，并输出单帧分析耗时
+static int RunStatsCheck(UINT32 width, UINT32 height)
+{
+    static const UINT32 subtypes[] =
+    {
+        FOURCC_NV12, FOURCC_I420, FOURCC_YUY2, FOURCC_UYVY, FOURCC_RGB24, FOURCC_RGB32
+    };
+
+    printf("stats       %ux%u, cpu %s, every row\n", width, height, GetCpuLevelName(GetCpuLevel()));
+    printf("%-12s %12s %12s %12s\n", "", "scalar", "sse2", "avx2");
+
+    int cMismatches = 0;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    {
+        VideoFormat format = { subtypes[i], width, height, 30, 1 };
+        std::vector<BYTE> data(GetFrameSize(format));
+
+        UINT32 seed = 0x9E3779B9 + i;
+        for (size_t k = 0; k < data.size(); k++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            data[k] = (BYTE)(seed >> 24);
+        }
+
+        CaptureFrame frame = CaptureFrame();
+        frame.pData = data.data();
+        frame.cbData = (UINT32)data.size();
+
+        FrameStats expected;
+        CFrameAnalyzer reference;
+
+        if (FAILED(reference.Initialize(format, CpuLevel_Scalar)) || reference.Analyze(frame, &expected) != S_OK)
+        {
+            fprintf(stderr, "Unsupported size %ux%u.\n", width, height);
+            return -1;
+        }
+
+        printf("%-12s", GetSubtypeName(format.subtype));
+
+        for (int level = CpuLevel_Scalar; level <= CpuLevel_AVX2; level++)
+        {
+            if (level > GetCpuLevel())
+            {
+                printf(" %12s", "-");
+                continue;
+            }
+
+            CFrameAnalyzer analyzer;
+            FrameStats actual;
+
+            analyzer.Initialize(format, (CpuLevel)level);
+            analyzer.Analyze(frame, &actual);
+
+            if (memcmp(expected.histogram, actual.histogram, sizeof(expected.histogram)) != 0 ||
+                expected.checksum != actual.checksum || expected.fMean != actual.fMean ||
+                expected.fVariance != actual.fVariance || expected.minLuma != actual.minLuma ||
+                expected.maxLuma != actual.maxLuma)
+            {
+                printf(" %12s", "MISMATCH");
+                cMismatches++;
+                continue;
+            }
+
+            LONGLONG llStart = GetClockTime();
+            for (UINT32 k = 0; k < c_convertIterations; k++)
+            {
+                analyzer.Analyze(frame, &actual);
+            }
+            printf(" %9.3f ms", (GetClockTime() - llStart) / 1e4 / c_convertIterations);
+        }
+        printf("\n");
+    }
+
+    if (cMismatches != 0)
+    {
+        fprintf(stderr, "FAILED: %d analyses differ from the scalar reference.\n", cMismatches);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 同时运行 cCameras 路互不共享状态的流水线，返回聚合帧率；pAggregate 不为空时输出每路结果
+static double RunPipelines(UINT32 cCameras, const VideoFormat& format, UINT64 cFrames, UINT32 cQueueDepth,
+    BOOL bUnthrottled, TestPattern pattern, UINT32 outputSubtype, BOOL bVerbose)
+{
+    std::vector<CSyntheticSource> sources(cCameras, CSyntheticSource(pattern, bUnthrottled, cFrames));
+    std::vector<CNullSink> sinks(cCameras);
+    std::unique_ptr<CFramePipeline[]> pipelines(new CFramePipeline[cCameras]);
+    double fTotalFps = 0;
+
+    for (UINT32 i = 0; i < cCameras; i++)
+    {
+        INT32 readerCore, writerCore;
+
+        AssignPipelineCores(i, cCameras, &readerCore, &writerCore);
+        pipelines[i].SetCpuAffinity(readerCore, writerCore);
+        pipelines[i].SetQueueDepth(cQueueDepth);
+        pipelines[i].SetOutputSubtype(outputSubtype);
+        pipelines[i].SetConversionBands(1);
+    }
+
+    for (UINT32 i = 0; i < cCameras; i++)
+    {
+        HRESULT hr = pipelines[i].Start(&sources[i], format, &sinks[i]);
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Failed to start pipeline %u (0x%08X).\n", i, (unsigned)hr);
+        }
+    }
+
+    for (UINT32 i = 0; i < cCameras; i++)
+    {
+        PipelineStats stats;
+
+        pipelines[i].Wait();
+        pipelines[i].GetStats(&stats);
+        pipelines[i].Stop();
+        fTotalFps += stats.fFps;
+
+        if (bVerbose)
+        {
+            INT32 readerCore, writerCore;
+            AssignPipelineCores(i, cCameras, &readerCore, &writerCore);
+
+            printf("camera %-4u %.1f fps, overflows %llu, cores %d/%d\n", i, stats.fFps,
+                (unsigned long long)stats.cOverflows, readerCore, writerCore);
+        }
+    }
+
+    return fTotalFps;
+}
+
+// CSequenceCheckSink 类检查预录写出的帧：第一帧的时间戳为 0，之后的时间戳与帧序号按帧时长对应，且序号递增
+class CSequenceCheckSink : public IFrameSink
+{
+public:
+    CSequenceCheckSink() : m_llDuration(0), m_llBeginTime(0), m_cFrames(0), m_nFirst(0), m_nLast(0), m_cErrors(0) {}
+
+    HRESULT BeginWriting(const VideoFormat& format)
+    {
+        m_llDuration = GetFrameDuration(format);
+        m_llBeginTime = GetClockTime();
+        m_cFrames = 0;
+        m_cErrors = 0;
+        return S_OK;
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        if (m_cFrames == 0)
+        {
+            m_nFirst = frame.nSequence;
+            if (frame.llTimestamp != 0)
+            {
+                m_cErrors++;
+            }
+        }
+        else if (frame.nSequence <= m_nLast ||
+            frame.llTimestamp != (LONGLONG)(frame.nSequence - m_nFirst) * m_llDuration)
+        {
+            m_cErrors++;
+        }
+
+        m_nLast = frame.nSequence;
+        m_cFrames++;
+        return S_OK;
+    }
+
+    virtual HRESULT Finalize()
+    {
+        return S_OK;
+    }
+
+    LONGLONG BeginTime() const { return m_llBeginTime; }
+    UINT64  FramesWritten() const { return m_cFrames; }
+    UINT64  FirstSequence() const { return m_nFirst; }
+    UINT64  LastSequence() const { return m_nLast; }
+    UINT64  Errors() const { return m_cErrors; }
+
+private:
+    LONGLONG    m_llDuration;   // 每帧时长
+    LONGLONG    m_llBeginTime;  // BeginWriting 的时刻，0 表示尚未开始
+    UINT64      m_cFrames;      // 已写入帧数
+    UINT64      m_nFirst;       // 第一帧的序号
+    UINT64      m_nLast;        // 上一帧的序号
+    UINT64      m_cErrors;      // 时间戳或序号不符的帧数
+};
+
+// 预录最近 fSeconds 秒，流水线写出 nTriggerAt 帧后触发，检查触发前没有写出、写出的帧连续且时间戳从 0 开始
+static int RunPreRollCheck(const VideoFormat& format, UINT64 cFrames, double fSeconds, UINT64 nTriggerAt,
+    UINT32 cQueueDepth, BOOL bUnthrottled, TestPattern pattern, UINT32 outputSubtype)
+{
+    CSyntheticSource source(pattern, bUnthrottled, cFrames);
+    CSequenceCheckSink sink;
+    CPreRollSink preroll(&sink, fSeconds);
+    CFramePipeline pipeline;
+
+    pipeline.SetQueueDepth(cQueueDepth);
+    pipeline.SetOutputSubtype(outputSubtype);
+
+    HRESULT hr = pipeline.Start(&source, format, &preroll);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to start pipeline (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    PipelineStats stats;
+
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        pipeline.GetStats(&stats);
+    } while (stats.cFrames < nTriggerAt && pipeline.IsRunning());
+
+    BOOL bEarlyBegin = (sink.BeginTime() != 0);
+    LONGLONG llTrigger = GetClockTime();
+    UINT64 cBeforeTrigger = stats.cFrames;
+
+    preroll.Trigger();
+    pipeline.Wait();
+
+    // 停止后写入线程已处理完最后一帧，计数才完整
+    hr = pipeline.Stop();
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Pipeline failed (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    pipeline.GetStats(&stats);
+
+    const VideoFormat& output = pipeline.GetOutputFormat();
+    UINT64 cExpected = stats.cFrames - preroll.OverwrittenCount();
+
+    printf("format      %s %ux%u @ %u/%u%s\n", GetSubtypeName(output.subtype), output.width, output.height,
+        output.fpsNumerator, output.fpsDenominator, bUnthrottled ? " (unthrottled)" : "");
+    printf("preroll     %.2f s, %u slots, %.1f MB\n", fSeconds, preroll.Capacity(),
+        (double)preroll.Capacity() * GetFrameSize(output) / (1024 * 1024));
+    printf("trigger     after %llu frames, %llu overwritten\n", (unsigned long long)cBeforeTrigger,
+        (unsigned long long)preroll.OverwrittenCount());
+    printf("written     %llu frames (#%llu..#%llu), expected %llu, overflows %llu\n",
+        (unsigned long long)sink.FramesWritten(), (unsigned long long)sink.FirstSequence(),
+        (unsigned long long)sink.LastSequence(), (unsigned long long)cExpected, (unsigned long long)stats.cOverflows);
+
+    if (bEarlyBegin || sink.BeginTime() < llTrigger)
+    {
+        fprintf(stderr, "FAILED: the sink was opened before the trigger.\n");
+        return 1;
+    }
+    if (sink.FramesWritten() != cExpected || sink.Errors() != 0)
+    {
+        fprintf(stderr, "FAILED: %llu frames out of order or with wrong time stamps.\n",
+            (unsigned long long)sink.Errors());
+        return 1;
+    }
+
+    return 0;
+}
+
+// CSegmentCheckFactory 类为每个分段创建检查时间戳的接收器，Finalize 按指定时长阻塞以模拟写出 MP4 索引，
+// 并记录每段的帧数、首尾序号以及哪些分段被删除
+class CSegmentCheckFactory : public IFrameSinkFactory
+{
+public:
+    // 一个分段的检查结果
+    struct SegmentResult
+    {
+        std::wstring    path;       // 文件路径
+        UINT64          cFrames;    // 帧数
+        UINT64          nFirst;     // 第一帧的序号
+        UINT64          nLast;      // 最后一帧的序号
+        UINT64          cErrors;    // 时间戳或序号不符的帧数
+        BOOL            bFinalized; // 是否已结束
+        BOOL            bRemoved;   // 是否已删除
+    };
+
+    explicit CSegmentCheckFactory(UINT32 finalizeMs) : m_finalizeMs(finalizeMs) {}
+
+    HRESULT CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        SegmentResult result = { pwszPath, 0, 0, 0, 0, FALSE, FALSE };
+        m_results.push_back(result);
+        *ppSink = new CSink(this, (UINT32)m_results.size() - 1);
+        return S_OK;
+    }
+
+    HRESULT RemoveFile(const WCHAR* pwszPath)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (size_t i = 0; i < m_results.size(); i++)
+        {
+            if (m_results[i].path == pwszPath)
+            {
+                m_results[i].bRemoved = TRUE;
+                return S_OK;
+            }
+        }
+        return E_INVALIDARG;
+    }
+
+    std::vector<SegmentResult> GetResults()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_results;
+    }
+
+private:
+    // 分段接收器：检查同 CSequenceCheckSink，Finalize 时把结果交回工厂
+    class CSink : public CSequenceCheckSink
+    {
+    public:
+        CSink(CSegmentCheckFactory* pFactory, UINT32 index) : m_pFactory(pFactory), m_index(index) {}
+
+        HRESULT Finalize()
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_pFactory->m_finalizeMs));
+
+            std::lock_guard<std::mutex> lock(m_pFactory->m_mutex);
+            SegmentResult& result = m_pFactory->m_results[m_index];
+
+            result.cFrames = FramesWritten();
+            result.nFirst = FirstSequence();
+            result.nLast = LastSequence();
+            result.cErrors = Errors();
+            result.bFinalized = TRUE;
+            return S_OK;
+        }
+
+    private:
+        CSegmentCheckFactory*   m_pFactory;
+        UINT32                  m_index;
+    };
+
+    UINT32                      m_finalizeMs;   // 每次 Finalize 阻塞的时长
+    std::mutex                  m_mutex;        // 保护 m_results
+    std::vector<SegmentResult>  m_results;      // 按创建顺序排列的分段
+};
+
+// 按 fSegmentSeconds 切分录制，检查：帧全部落在某一段中且首尾相接，每段时间戳从 0 开始，
+// 只保留最近 cRetain 段，提前打开但未用到的下一段被删除；同时输出写入延迟，确认 Finalize 没有阻塞写入线程
+static int RunSegmentCheck(const VideoFormat& format, UINT64 cFrames, double fSegmentSeconds, UINT32 cRetain,
+    UINT32 finalizeMs, UINT32 cQueueDepth, BOOL bUnthrottled, TestPattern pattern, UINT32 outputSubtype)
+{
+    CSyntheticSource source(pattern, bUnthrottled, cFrames);
+    CSegmentCheckFactory factory(finalizeMs);
+    CSegmentedSink sink(&factory, L"capture.mp4", (LONGLONG)(fSegmentSeconds * HNS_PER_SECOND), 0, cRetain);
+    CFramePipeline pipeline;
+
+    pipeline.SetQueueDepth(cQueueDepth);
+    pipeline.SetOutputSubtype(outputSubtype);
+
+    HRESULT hr = pipeline.Start(&source, format, &sink);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to start pipeline (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    pipeline.Wait();
+
+    SegmentStats segmentStats;
+    sink.GetStats(&segmentStats);
+
+    hr = pipeline.Stop();
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Pipeline failed (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    PipelineStats stats;
+    pipeline.GetStats(&stats);
+
+    std::vector<CSegmentCheckFactory::SegmentResult> results = factory.GetResults();
+    UINT32 cUsed = segmentStats.nCurrent + 1;
+    UINT64 cTotal = 0;
+    int cFailures = 0;
+
+    printf("segments    %u used, %.2f s each, retain %u, finalize %u ms, %u deferred rotations\n", cUsed,
+        fSegmentSeconds, cRetain, finalizeMs, segmentStats.cDeferred);
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const CSegmentCheckFactory::SegmentResult& result = results[i];
+        BOOL bUsed = (i < cUsed);
+        BOOL bKeep = bUsed && (cRetain == 0 || i + cRetain >= cUsed);
+
+        printf("  %ls  %5llu frames #%llu..#%llu%s\n", result.path.c_str(), (unsigned long long)result.cFrames,
+            (unsigned long long)result.nFirst, (unsigned long long)result.nLast, result.bRemoved ? "  (removed)" : "");
+
+        cTotal += result.cFrames;
+
+        if (!result.bFinalized || result.cErrors != 0 || result.bRemoved == bKeep)
+        {
+            cFailures++;
+        }
+        if (bUsed && i > 0 && result.cFrames > 0 && result.nFirst <= results[i - 1].nLast)
+        {
+            cFailures++;
+        }
+    }
+
+    printf("frames      %llu written, %llu in segments, overflows %llu\n", (unsigned long long)stats.cFrames,
+        (unsigned long long)cTotal, (unsigned long long)stats.cOverflows);
+    printf("latency     avg %.3f ms, max %.3f ms\n", stats.fAvgLatencyMs, stats.fMaxLatencyMs);
+
+    if (cFailures != 0 || cTotal != stats.cFrames)
+    {
+        fprintf(stderr, "FAILED: %d segments are incomplete, out of order or wrongly retained.\n", cFailures);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 解析过载策略：newest、oldest、decimate[:N]、block[:MS]
+static BOOL ParseOverloadPolicy(const char* pszName, OverloadPolicy* pPolicy, UINT32* pValue)
+{
+    const char* pszValue = strchr(pszName, ':');
+    size_t cchName = pszValue ? (size_t)(pszValue - pszName) : strlen(pszName);
+
+    *pValue = pszValue ? (UINT32)atoi(pszValue + 1) : 0;
+
+    if (cchName == 6 && strncmp(pszName, "newest", 6) == 0) { *pPolicy = OverloadPolicy_DropNewest; return TRUE; }
+    if (cchName == 6 && strncmp(pszName, "oldest", 6) == 0) { *pPolicy = OverloadPolicy_DropOldest; return TRUE; }
+    if (cchName == 8 && strncmp(pszName, "decimate", 8) == 0) { *pPolicy = OverloadPolicy_Decimate; return TRUE; }
+    if (cchName == 5 && strncmp(pszName, "block", 5) == 0) { *pPolicy = OverloadPolicy_Block; return TRUE; }
+    return FALSE;
+}
+
+// CSlowCheckSink 类每帧固定耗时，模拟跟不上采集的编码器；同时检查写出的帧可以解码：
+// 非关键帧必须紧跟在上一个写出的帧之后，序号递增
+class CSlowCheckSink : public IFrameSink
+{
+public:
+    CSlowCheckSink(UINT32 delayUs) : m_delayUs(delayUs), m_cFrames(0), m_cKeyFrames(0), m_nLast(0), m_cErrors(0) {}
+
+    HRESULT BeginWriting(const VideoFormat&)
+    {
+        m_cFrames = 0;
+        m_cKeyFrames = 0;
+        m_cErrors = 0;
+        return S_OK;
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        BOOL bDelta = (frame.flags & FrameFlag_Delta) != 0;
+
+        if ((m_cFrames != 0 && frame.nSequence <= m_nLast) ||
+            (bDelta && (m_cFrames == 0 || frame.nSequence != m_nLast + 1)))
+        {
+            m_cErrors++;
+        }
+
+        if (!bDelta)
+        {
+            m_cKeyFrames++;
+        }
+
+        m_nLast = frame.nSequence;
+        m_cFrames++;
+
+        std::this_thread::sleep_for(std::chrono::microseconds(m_delayUs));
+        return S_OK;
+    }
+
+    HRESULT Finalize()
+    {
+        return S_OK;
+    }
+
+    UINT64  FramesWritten() const { return m_cFrames; }
+    UINT64  KeyFramesWritten() const { return m_cKeyFrames; }
+    UINT64  LastSequence() const { return m_nLast; }
+    UINT64  Errors() const { return m_cErrors; }
+
+private:
+    UINT32      m_delayUs;      // 每帧耗时（微秒）
+    UINT64      m_cFrames;      // 已写入帧数
+    UINT64      m_cKeyFrames;   // 已写入的关键帧数
+    UINT64      m_nLast;        // 上一帧的序号
+    UINT64      m_cErrors;      // 无法解码或乱序的帧数
+};
+
+// --drop-check 的数据源帧率、接收器每帧耗时（约为数据源的 1.6 倍）和帧数
+static const UINT32 c_dropCheckFps = 200;
+static const UINT32 c_dropCheckSinkDelayUs = 8000;
+static const UINT64 c_dropCheckFrames = 200;
+
+// DropCheckCase 结构体描述 --drop-check 的一个组合
+struct DropCheckCase
+{
+    OverloadPolicy  policy;     // 过载策略
+    UINT32          value;      // 策略参数
+    UINT32          cGop;       // 模拟的 GOP 长度，0 表示未压缩
+};
+
+// 让接收器比数据源慢，逐个策略检查：写出数与各原因丢帧数之和等于产生的帧数，丢帧原因与策略相符，
+// DropOldest 写出最后一帧，等待时长足够的 Block 不丢帧，模拟 GOP 时写出的非关键帧都能解码
+static int RunDropCheck(UINT32 cQueueDepth)
+{
+    static const DropCheckCase cases[] =
+    {
+        { OverloadPolicy_DropNewest, 0, 0 },
+        { OverloadPolicy_DropOldest, 0, 0 },
+        { OverloadPolicy_Decimate, 2, 0 },
+        { OverloadPolicy_Block, 50, 0 },
+        { OverloadPolicy_Block, 1, 0 },
+        { OverloadPolicy_DropNewest, 0, 8 },
+        { OverloadPolicy_DropOldest, 0, 8 },
+        { OverloadPolicy_Decimate, 2, 8 },
+    };
+
+    VideoFormat format = { FOURCC_NV12, 320, 240, c_dropCheckFps, 1 };
+    UINT32 cFailed = 0;
+
+    printf("%-12s %4s %8s %8s", "policy", "gop", "written", "dropped");
+    for (UINT32 i = 0; i < DropReason_Count; i++)
+    {
+        printf(" %11s", GetDropReasonName((DropReason)i));
+    }
+    printf(" %9s\n", "overload");
+
+    for (UINT32 iCase = 0; iCase < ARRAYSIZE(cases); iCase++)
+    {
+        const DropCheckCase& test = cases[iCase];
+        CSyntheticSource source(TestPattern_Flat, FALSE, c_dropCheckFrames);
+        CSlowCheckSink sink(c_dropCheckSinkDelayUs);
+        CFramePipeline pipeline;
+
+        source.SetGopLength(test.cGop);
+        pipeline.SetQueueDepth(cQueueDepth);
+        pipeline.SetOverloadPolicy(test.policy, test.value);
+
+        HRESULT hr = pipeline.Start(&source, format, &sink);
+
+        if (SUCCEEDED(hr))
+        {
+            pipeline.Wait();
+            hr = pipeline.Stop();
+        }
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Pipeline failed (0x%08X).\n", (unsigned)hr);
+            return -1;
+        }
+
+        DropStats drops;
+        DropEvent events[DROP_HISTORY_SIZE];
+        pipeline.GetDropStats(&drops);
+        UINT32 cEvents = pipeline.GetDropEvents(events, DROP_HISTORY_SIZE);
+
+        const char* pszError = nullptr;
+
+        if (sink.FramesWritten() + drops.cTotal != c_dropCheckFrames)
+        {
+            pszError = "written and dropped frames do not add up";
+        }
+        else if (sink.Errors() != 0)
+        {
+            pszError = "undecodable or out-of-order frames written";
+        }
+        else if (cEvents != (drops.cTotal < DROP_HISTORY_SIZE ? drops.cTotal : DROP_HISTORY_SIZE))
+        {
+            pszError = "drop history incomplete";
+        }
+        else if (drops.cTotal != 0 && drops.cOverloadSeconds == 0)
+        {
+            pszError = "overload duration not recorded";
+        }
+        else if (test.policy == OverloadPolicy_DropNewest && test.cGop == 0 &&
+            (drops.cDrops[DropReason_QueueFull] == 0 || drops.cDrops[DropReason_Evicted] != 0))
+        {
+            pszError = "drop-newest should only drop arriving frames";
+        }
+        else if (test.policy == OverloadPolicy_DropOldest &&
+            (drops.cDrops[DropReason_Evicted] == 0 || drops.cDrops[DropReason_QueueFull] != 0 ||
+            sink.LastSequence() != c_dropCheckFrames - 1))
+        {
+            pszError = "drop-oldest should evict queued frames and write the last frame";
+        }
+        else if (test.policy == OverloadPolicy_Decimate && drops.cDrops[DropReason_Decimated] == 0)
+        {
+            pszError = "decimation never started";
+        }
+        else if (test.policy == OverloadPolicy_Block && test.value * 1000 > c_dropCheckSinkDelayUs * 2 &&
+            drops.cTotal != 0)
+        {
+            pszError = "block with a long deadline dropped frames";
+        }
+        else if (test.policy == OverloadPolicy_Block && test.value * 1000 < c_dropCheckSinkDelayUs &&
+            drops.cDrops[DropReason_Timeout] == 0)
+        {
+            pszError = "block with a short deadline never timed out";
+        }
+        else if (test.cGop != 0 && sink.KeyFramesWritten() == 0)
+        {
+            pszError = "no key frames written";
+        }
+
+        for (UINT32 i = 1; i < cEvents && pszError == nullptr; i++)
+        {
+            if (events[i].llTime < events[i - 1].llTime)
+            {
+                pszError = "drop history out of order";
+            }
+        }
+
+        char szPolicy[32];
+        snprintf(szPolicy, sizeof(szPolicy), test.value ? "%s:%u" : "%s", GetOverloadPolicyName(test.policy), test.value);
+
+        printf("%-12s %4u %8llu %8llu", szPolicy, test.cGop, (unsigned long long)sink.FramesWritten(),
+            (unsigned long long)drops.cTotal);
+        for (UINT32 i = 0; i < DropReason_Count; i++)
+        {
+            printf(" %11llu", (unsigned long long)drops.cDrops[i]);
+        }
+        printf(" %7u s%s\n", drops.cOverloadSeconds, pszError ? "  FAILED" : "");
+
+        if (pszError)
+        {
+            fprintf(stderr, "FAILED: %s %s: %s.\n", szPolicy, test.cGop ? "(gop)" : "", pszError);
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// NegotiateCase 结构体描述 --negotiate-check 的一个用例：要求、预期选中的原生类型和帧率
+struct NegotiateCase
+{
+    const char*         pszName;        // 名称
+    FormatConstraints   constraints;    // 要求
+    BOOL                bDefaults;      // 是否先按设备默认类型补上下限
+    INT32               iExclude;       // 先排除的类型，-1 表示不排除
+    UINT32              cCapabilities;  // 使用能力表的前几项
+    HRESULT             hrExpected;     // 预期的返回值
+    DWORD               nExpectedType;  // 预期选中的类型
+    UINT32              expectedFps;    // 预期的帧率
+    BOOL                bExpectDecode;  // 预期需要解码
+    BOOL                bExpectConvert; // 预期需要转换
+};
+
+// 用一张典型 1080p 摄像头的能力表检查格式协商：能直接交给接收器的格式优先、帧率范围、优先格式、
+// 无法满足时放宽要求、排除被拒绝的类型，以及空表
+static int RunNegotiateCheck()
+{
+    static const MediaCapability capabilities[] =
+    {
+        { 0, { FOURCC_YUY2, 640, 480, 30, 1 }, 30, 1, 30, 1 },
+        { 1, { FOURCC_YUY2, 1920, 1080, 5, 1 }, 5, 1, 5, 1 },
+        { 2, { FOURCC_MJPG, 1920, 1080, 30, 1 }, 30, 1, 30, 1 },
+        { 3, { FOURCC_MJPG, 1920, 1080, 60, 1 }, 60, 1, 60, 1 },
+        { 4, { FOURCC_NV12, 1920, 1080, 30, 1 }, 30, 1, 30, 1 },
+        { 5, { FOURCC_NV12, 1280, 720, 30, 1 }, 15, 1, 60, 1 },
+        { 6, { FOURCC_YUY2, 1280, 720, 10, 1 }, 10, 1, 10, 1 },
+        { 7, { FOURCC_MJPG, 3840, 2160, 30, 1 }, 30, 1, 30, 1 },
+        { 8, { FOURCC_RGB24, 1280, 720, 30, 1 }, 30, 1, 30, 1 },
+    };
+    const UINT32 cAll = ARRAYSIZE(capabilities);
+    const HRESULT hrNotFound = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+
+    static const NegotiateCase cases[] =
+    {
+        { "device default, encode",     { 0, 0, 0, 0, 0, 0, 0, FOURCC_NV12, TRUE },         TRUE, -1, cAll, S_OK, 0, 30, FALSE, TRUE },
+        { ">=1080p60 prefer nv12",      { 1920, 1080, 0, 0, 60, 0, FOURCC_NV12, FOURCC_NV12, TRUE }, FALSE, -1, cAll, S_OK, 3, 60, TRUE, FALSE },
+        { ">=1080p30 zero conversion",  { 1920, 1080, 0, 0, 30, 0, 0, FOURCC_NV12, TRUE },   FALSE, -1, cAll, S_OK, 4, 30, FALSE, FALSE },
+        { ">=720p60 from fps range",    { 1280, 720, 0, 0, 60, 0, 0, FOURCC_NV12, TRUE },    FALSE, -1, cAll, S_OK, 5, 60, FALSE, FALSE },
+        { ">=60 fps, default size",     { 0, 0, 0, 0, 60, 0, 0, FOURCC_NV12, TRUE },         TRUE, -1, cAll, S_OK, 5, 60, FALSE, FALSE },
+        { "<=720p, device default",     { 0, 0, 1280, 720, 0, 0, 0, FOURCC_NV12, TRUE },     TRUE, -1, cAll, S_OK, 0, 30, FALSE, TRUE },
+        { "raw prefer yuy2",            { 1280, 720, 0, 0, 5, 0, FOURCC_YUY2, 0, FALSE },    FALSE, -1, cAll, S_OK, 6, 10, FALSE, FALSE },
+        { "raw fewest bytes",           { 1280, 720, 0, 0, 30, 0, 0, 0, FALSE },             FALSE, -1, cAll, S_OK, 5, 30, FALSE, FALSE },
+        { "y4m i420 >=1080p30",         { 1920, 1080, 0, 0, 30, 0, 0, FOURCC_I420, FALSE },  FALSE, -1, cAll, S_OK, 4, 30, FALSE, TRUE },
+        { ">=2160p60 relaxed",          { 3840, 2160, 0, 0, 60, 0, 0, FOURCC_NV12, TRUE },   FALSE, -1, cAll, S_FALSE, 7, 30, TRUE, FALSE },
+        { ">=1080p30, nv12 rejected",   { 1920, 1080, 0, 0, 30, 0, 0, FOURCC_NV12, TRUE },   FALSE, 4, cAll, S_OK, 2, 30, TRUE, FALSE },
+        { "empty table",                { 0, 0, 0, 0, 0, 0, 0, FOURCC_NV12, TRUE },         TRUE, -1, 0, hrNotFound, 0, 0, FALSE, FALSE },
+    };
+
+    UINT32 cFailed = 0;
+
+    printf("%-28s %-8s %5s %-6s %-22s %6s %7s %12s\n", "case", "hr", "type", "native", "capture", "decode", "convert",
+        "cost (MB/s)");
+
+    for (UINT32 iCase = 0; iCase < ARRAYSIZE(cases); iCase++)
+    {
+        const NegotiateCase& test = cases[iCase];
+        CFormatNegotiator negotiator;
+        FormatConstraints constraints = test.constraints;
+        NegotiatedFormat result = NegotiatedFormat();
+
+        for (UINT32 i = 0; i < test.cCapabilities; i++)
+        {
+            negotiator.AddCapability(capabilities[i]);
+        }
+        if (test.iExclude >= 0)
+        {
+            negotiator.Exclude((UINT32)test.iExclude);
+        }
+        if (test.bDefaults)
+        {
+            negotiator.ApplyDeviceDefaults(&constraints);
+        }
+
+        HRESULT hr = negotiator.Negotiate(constraints, &result);
+        BOOL bPassed = (hr == test.hrExpected);
+
+        if (bPassed && SUCCEEDED(hr))
+        {
+            bPassed = result.nTypeIndex == test.nExpectedType &&
+                result.format.fpsNumerator / result.format.fpsDenominator == test.expectedFps &&
+                result.bDecode == test.bExpectDecode && result.bConvert == test.bExpectConvert &&
+                result.bRelaxed == (hr == S_FALSE);
+        }
+
+        char szCapture[32] = "-";
+        const char* pszNative = "-";
+
+        if (SUCCEEDED(hr))
+        {
+            pszNative = GetSubtypeName(capabilities[result.iCapability].format.subtype);
+            snprintf(szCapture, sizeof(szCapture), "%s %ux%u@%u", GetSubtypeName(result.format.subtype),
+                result.format.width, result.format.height, result.format.fpsNumerator / result.format.fpsDenominator);
+        }
+
+        printf("%-28s %08X %5d %-6s %-22s %6s %7s %12.1f%s\n", test.pszName, (unsigned)hr,
+            SUCCEEDED(hr) ? (int)result.nTypeIndex : -1, pszNative, szCapture, result.bDecode ? "yes" : "no",
+            result.bConvert ? "yes" : "no", result.fCost / 1e6, bPassed ? "" : "  FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: %s: expected type %u (0x%08X).\n", test.pszName, test.nExpectedType,
+                (unsigned)test.hrExpected);
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// 把命令行中的多字节路径转换成宽字符路径
+static void ToWidePath(const char* pszPath, WCHAR* pwszPath, size_t cchPath)
+{
+    mbstowcs(pwszPath, pszPath, cchPath);
+    pwszPath[cchPath - 1] = 0;
+}
+
+// 两张能力表是否完全相同
+static BOOL IsSameCapabilities(const CFormatNegotiator& a, const CFormatNegotiator& b)
+{
+    if (a.Count() != b.Count())
+    {
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < a.Count(); i++)
+    {
+        const MediaCapability& x = a.GetCapability(i);
+        const MediaCapability& y = b.GetCapability(i);
+
+        if (x.nTypeIndex != y.nTypeIndex || x.format.subtype != y.format.subtype || x.format.width != y.format.width ||
+            x.format.height != y.format.height || x.format.fpsNumerator != y.format.fpsNumerator ||
+            x.format.fpsDenominator != y.format.fpsDenominator || x.fpsMinNumerator != y.fpsMinNumerator ||
+            x.fpsMinDenominator != y.fpsMinDenominator || x.fpsMaxNumerator != y.fpsMaxNumerator ||
+            x.fpsMaxDenominator != y.fpsMaxDenominator)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// 输出一项检查的结果，失败时计数
+static void ReportCacheCheck(const char* pszName, BOOL bPassed, UINT32* pcFailed)
+{
+    printf("%-44s %s\n", pszName, bPassed ? "ok" : "FAILED");
+
+    if (!bPassed)
+    {
+        fprintf(stderr, "FAILED: %s\n", pszName);
+        (*pcFailed)++;
+    }
+}
+
+// 在临时目录中检查能力缓存：写回后读出的设备列表和能力表不变、符号链接不区分大小写、
+// 损坏的文件按未命中处理、热插拔和重新枚举的作废规则，最后测量读取缓存的耗时
+static int RunCacheCheck()
+{
+    static const MediaCapability capabilities[] =
+    {
+        { 0, { FOURCC_YUY2, 640, 480, 30, 1 }, 30, 1, 30, 1 },
+        { 1, { FOURCC_MJPG, 1920, 1080, 60, 1 }, 60, 1, 60, 1 },
+        { 2, { FOURCC_NV12, 1920, 1080, 30, 1 }, 30, 1, 30, 1 },
+        { 3, { FOURCC_NV12, 1280, 720, 30, 1 }, 15, 1, 60, 1 },
+        { 4, { FOURCC_H264, 3840, 2160, 30000, 1001 }, 30000, 1001, 30000, 1001 },
+    };
+    const WCHAR* pwszLink0 = L"\\\\?\\usb#vid_046d&pid_085e&mi_00#7&1a2b3c4d&0&0000#{e5323777-f976-4f5b-9b55-b94699c46e44}\\global";
+    const WCHAR* pwszLink0Upper = L"\\\\?\\USB#VID_046D&PID_085E&MI_00#7&1A2B3C4D&0&0000#{E5323777-F976-4F5B-9B55-B94699C46E44}\\GLOBAL";
+    const WCHAR* pwszLink1 = L"\\\\?\\usb#vid_0c45&pid_6366&mi_00#8&2b3c4d5e&0&0000#{e5323777-f976-4f5b-9b55-b94699c46e44}\\global";
+
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "benchmark_capture_devices.cache";
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    ToWidePath(path.string().c_str(), wszPath, MAX_SEGMENT_PATH);
+    std::filesystem::remove(path, error);
+
+    UINT32 cFailed = 0;
+    CFormatNegotiator probed;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(capabilities); i++)
+    {
+        probed.AddCapability(capabilities[i]);
+    }
+
+    std::vector<CachedDevice> devices(2);
+    devices[0].symbolicLink = pwszLink0;
+    devices[0].friendlyName = L"HD Pro Webcam C920";
+    devices[0].bProbed = FALSE;
+    devices[1].symbolicLink = pwszLink1;
+    devices[1].friendlyName = L"USB Camera";
+    devices[1].bProbed = FALSE;
+
+    // 第一次启动：没有缓存文件，完整枚举并探测第一个设备后写回
+    {
+        CCapabilityCache cache;
+        std::vector<CachedDevice> cached;
+        CFormatNegotiator negotiator;
+
+        ReportCacheCheck("missing file is a miss", cache.Load(wszPath) == S_FALSE && !cache.GetDevices(&cached) &&
+            !cache.GetCapabilities(pwszLink0, &negotiator), &cFailed);
+
+        cache.SetDevices(devices);
+        cache.StoreCapabilities(pwszLink0, probed);
+
+        ReportCacheCheck("save after enumeration", cache.IsDirty() && cache.Save() == S_OK && !cache.IsDirty(),
+            &cFailed);
+        ReportCacheCheck("save without changes is skipped", cache.Save() == S_FALSE, &cFailed);
+    }
+
+    // 第二次启动：设备列表和能力表都来自缓存
+    {
+        CCapabilityCache cache;
+        std::vector<CachedDevice> cached;
+        CFormatNegotiator negotiator;
+        CFormatNegotiator unprobed;
+
+        ReportCacheCheck("reload device list", cache.Load(wszPath) == S_OK && cache.GetDevices(&cached) &&
+            cached.size() == 2 && cached[0].symbolicLink == pwszLink0 && cached[1].friendlyName == L"USB Camera" &&
+            cached[0].bProbed && !cached[1].bProbed, &cFailed);
+        ReportCacheCheck("reload capabilities, link case ignored", cache.GetCapabilities(pwszLink0Upper, &negotiator) &&
+            IsSameCapabilities(negotiator, probed), &cFailed);
+        ReportCacheCheck("unprobed device is a miss", !cache.GetCapabilities(pwszLink1, &unprobed) &&
+            unprobed.Count() == 0, &cFailed);
+
+        // 缓存的能力表协商的结果与探测得到的相同
+        FormatConstraints constraints = { 1920, 1080, 0, 0, 30, 0, 0, FOURCC_NV12, TRUE };
+        NegotiatedFormat fromCache = NegotiatedFormat();
+        NegotiatedFormat fromProbe = NegotiatedFormat();
+
+        ReportCacheCheck("same negotiated format", negotiator.Negotiate(constraints, &fromCache) == S_OK &&
+            probed.Negotiate(constraints, &fromProbe) == S_OK && fromCache.nTypeIndex == fromProbe.nTypeIndex,
+            &cFailed);
+
+        // 选中的类型与设备不符时作废，下次重新探测
+        cache.InvalidateCapabilities(pwszLink0);
+        negotiator.Clear();
+        ReportCacheCheck("invalidate capabilities", !cache.GetCapabilities(pwszLink0, &negotiator) &&
+            cache.GetDevices(&cached) && cache.IsDirty(), &cFailed);
+
+        // 重新枚举保留仍在列表中的设备已探测的能力表
+        cache.StoreCapabilities(pwszLink1, probed);
+        std::vector<CachedDevice> reordered(1, devices[1]);
+        cache.SetDevices(reordered);
+        negotiator.Clear();
+        ReportCacheCheck("enumeration keeps probed tables", cache.GetCapabilities(pwszLink1, &negotiator) &&
+            cache.GetDevices(&cached) && cached.size() == 1 && cached[0].bProbed, &cFailed);
+
+        // 接入：设备列表和该设备的能力表作废；移除：从缓存中删除
+        cache.OnDeviceChange(pwszLink1, TRUE);
+        negotiator.Clear();
+        ReportCacheCheck("arrival invalidates list and table", !cache.GetDevices(&cached) &&
+            !cache.GetCapabilities(pwszLink1, &negotiator), &cFailed);
+
+        cache.SetDevices(devices);
+        cache.StoreCapabilities(pwszLink1, probed);
+        cache.OnDeviceChange(pwszLink1, FALSE);
+        ReportCacheCheck("removal drops the device", cache.GetDevices(&cached) && cached.size() == 1 &&
+            cached[0].symbolicLink == pwszLink0 && !cache.GetCapabilities(pwszLink1, &negotiator), &cFailed);
+    }
+
+    // 测量读取缓存（含校验）的耗时
+    UINT64 cbFile = (UINT64)std::filesystem::file_size(path, error);
+    const UINT32 cLoads = 1000;
+    LONGLONG llStart = GetClockTime();
+
+    for (UINT32 i = 0; i < cLoads; i++)
+    {
+        CCapabilityCache cache;
+        cache.Load(wszPath);
+    }
+
+    double fLoadUs = (GetClockTime() - llStart) / 10.0 / cLoads;
+
+    // 损坏的文件按未命中处理，写回时覆盖
+    {
+        FILE* pFile = fopen(path.string().c_str(), "r+b");
+        BOOL bCorrupted = FALSE;
+
+        if (pFile)
+        {
+            bCorrupted = fseek(pFile, 24, SEEK_SET) == 0 && fputc(0x5A, pFile) != EOF;
+            fclose(pFile);
+        }
+
+        CCapabilityCache cache;
+        std::vector<CachedDevice> cached;
+        CFormatNegotiator negotiator;
+
+        ReportCacheCheck("corrupted file is a miss", bCorrupted && cache.Load(wszPath) == S_FALSE &&
+            !cache.GetDevices(&cached) && !cache.GetCapabilities(pwszLink0, &negotiator), &cFailed);
+
+        cache.SetDevices(devices);
+        CCapabilityCache reloaded;
+        ReportCacheCheck("rewrite after corruption", cache.Save() == S_OK && reloaded.Load(wszPath) == S_OK,
+            &cFailed);
+    }
+
+    std::filesystem::remove(path, error);
+
+    printf("load        %.1f us per load (%llu bytes)\n", fLoadUs, (unsigned long long)cbFile);
+    return cFailed ? 1 : 0;
+}
+
+// CMockDevices 类模拟已接入的设备：符号链接到可提供的分辨率，测试随时接入或移除
+class CMockDevices
+{
+public:
+    void    Plug(const WCHAR* pwszLink, UINT32 width, UINT32 height)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        MockDevice device = { pwszLink, width, height, TRUE };
+
+        for (size_t i = 0; i < m_devices.size(); i++)
+        {
+            if (m_devices[i].link == pwszLink)
+            {
+                m_devices[i] = device;
+                return;
+            }
+        }
+        m_devices.push_back(device);
+    }
+
+    void    Unplug(const WCHAR* pwszLink)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (size_t i = 0; i < m_devices.size(); i++)
+        {
+            if (m_devices[i].link == pwszLink)
+            {
+                m_devices[i].bPresent = FALSE;
+            }
+        }
+    }
+
+    // 设备接入且能提供 width x height 时返回 TRUE，pIndex 为设备序号
+    BOOL    CanDeliver(const WCHAR* pwszLink, UINT32 width, UINT32 height, UINT32* pIndex)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (size_t i = 0; i < m_devices.size(); i++)
+        {
+            const MockDevice& device = m_devices[i];
+
+            if (device.link == pwszLink)
+            {
+                *pIndex = (UINT32)i;
+                return device.bPresent && device.width == width && device.height == height;
+            }
+        }
+
+        return FALSE;
+    }
+
+private:
+    // MockDevice 结构体保存一个模拟设备
+    struct MockDevice
+    {
+        std::wstring    link;       // 符号链接
+        UINT32          width;      // 宽度
+        UINT32          height;     // 高度
+        BOOL            bPresent;   // 是否接入
+    };
+
+    std::mutex              m_mutex;    // 保护 m_devices
+    std::vector<MockDevice> m_devices;  // 设备
+};
+
+// CMockCapture 类模拟一路推模式采集：连接设备期间由送帧线程每毫秒左右向流水线送一帧，
+// 时间戳取自设备自己的时钟，每次激活设备都从一个不同的起点开始，由流水线接到丢失前的帧之后
+class CMockCapture : public IRecoverableCapture
+{
+public:
+    CMockCapture(CFramePipeline* pPipeline, CMockDevices* pDevices, const VideoFormat& format, const WCHAR* pwszLink) :
+        m_pPipeline(pPipeline), m_pDevices(pDevices), m_format(format), m_link(pwszLink), m_bConnected(TRUE),
+        m_llBase(0), m_cActivations(0), m_nFrame(0), m_bStop(FALSE), m_data(GetFrameSize(format))
+    {
+    }
+
+    ~CMockCapture()
+    {
+        Stop();
+    }
+
+    void    Start()
+    {
+        m_thread = std::thread(&CMockCapture::FeedThread, this);
+    }
+
+    void    Stop()
+    {
+        m_bStop = TRUE;
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    std::wstring GetDeviceLink()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_link;
+    }
+
+    HRESULT SuspendDevice()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bConnected = FALSE;
+        m_pPipeline->MarkDeviceLost();
+        return S_OK;
+    }
+
+    HRESULT ResumeDevice(const WCHAR* pwszLink)
+    {
+        UINT32 index = 0;
+
+        if (!m_pDevices->CanDeliver(pwszLink, m_format.width, m_format.height, &index))
+        {
+            return E_FAIL;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_link = pwszLink;
+        m_cActivations++;
+        m_llBase = (LONGLONG)(index + 1) * 1000 * HNS_PER_SECOND + (LONGLONG)m_cActivations * 77 * HNS_PER_SECOND;
+        m_nFrame = 0;
+        m_bConnected = TRUE;
+        return S_OK;
+    }
+
+private:
+    // 送帧线程：设备连接且仍接入时送一帧；设备被拔掉后不再送帧，等恢复控制器处理移除事件
+    void    FeedThread()
+    {
+        while (!m_bStop)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                UINT32 index = 0;
+
+                if (m_bConnected && m_pDevices->CanDeliver(m_link.c_str(), m_format.width, m_format.height, &index))
+                {
+                    CaptureFrame frame = {};
+                    frame.pData = m_data.data();
+                    frame.cbData = (UINT32)m_data.size();
+                    frame.llTimestamp = m_llBase + (LONGLONG)m_nFrame * GetFrameDuration(m_format);
+                    m_nFrame++;
+                    m_pPipeline->PushFrame(frame);
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    CFramePipeline*     m_pPipeline;    // 流水线
+    CMockDevices*       m_pDevices;     // 模拟设备
+    VideoFormat         m_format;       // 格式
+    std::mutex          m_mutex;        // 保护以下成员
+    std::wstring        m_link;         // 正在使用的设备
+    BOOL                m_bConnected;   // 是否连接设备
+    LONGLONG            m_llBase;       // 设备时钟的起点
+    UINT32              m_cActivations; // 激活次数
+    UINT64              m_nFrame;       // 本次激活后的帧数
+    std::atomic<bool>   m_bStop;        // 请求送帧线程停止
+    std::thread         m_thread;       // 送帧线程
+    std::vector<BYTE>   m_data;         // 帧数据
+};
+
+// CTimestampSink 类记录写出的时间戳，以及 BeginWriting 和 Finalize 的调用次数
+class CTimestampSink : public IFrameSink
+{
+public:
+    CTimestampSink() : m_cBegin(0), m_cFinalize(0), m_cFrames(0) {}
+
+    HRESULT BeginWriting(const VideoFormat&)
+    {
+        m_cBegin++;
+        return S_OK;
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        m_timestamps.push_back(frame.llTimestamp);
+        m_cFrames++;
+        return S_OK;
+    }
+
+    HRESULT Finalize()
+    {
+        m_cFinalize++;
+        return S_OK;
+    }
+
+    UINT32  BeginCount() const { return m_cBegin; }
+    UINT32  FinalizeCount() const { return m_cFinalize; }
+    UINT64  FramesWritten() const { return m_cFrames; }
+
+    // 写出的时间戳是否逐帧相差 llDuration，在流水线停止后调用
+    BOOL    IsContinuous(LONGLONG llDuration) const
+    {
+        for (size_t i = 1; i < m_timestamps.size(); i++)
+        {
+            if (m_timestamps[i] != m_timestamps[i - 1] + llDuration)
+            {
+                return FALSE;
+            }
+        }
+
+        return !m_timestamps.empty();
+    }
+
+private:
+    UINT32                  m_cBegin;       // BeginWriting 的调用次数
+    UINT32                  m_cFinalize;    // Finalize 的调用次数
+    std::atomic<UINT64>     m_cFrames;      // 已写入帧数
+    std::vector<LONGLONG>   m_timestamps;   // 写出的时间戳
+};
+
+// 等待接收器写出至少 cFrames 帧，最长 2 秒
+static BOOL WaitForFrames(const CTimestampSink& sink, UINT64 cFrames)
+{
+    for (UINT32 i = 0; i < 2000 && sink.FramesWritten() < cFrames; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return sink.FramesWritten() >= cFrames;
+}
+
+// RecoveryCase 结构体描述 --recovery-check 的一个用例
+struct RecoveryCase
+{
+    const char*     pszName;        // 名称
+    DeviceEventType event;          // 丢失设备的事件
+    BOOL            bReturns;       // 原设备是否回来
+    UINT32          spareWidth;     // 后备设备的宽度，0 表示没有后备设备
+    BOOL            bRecovers;      // 预期是否恢复
+    UINT32          cFallbacks;     // 预期改用后备设备的次数
+};
+
+// 用模拟的设备和事件检查设备丢失后的恢复：接收器只打开和结束一次，写出的时间戳跨过丢失仍然逐帧连续，
+// 原设备回来或出错后重新激活原设备，原设备不回来时在后备延迟之后改用格式相同的后备设备，格式不同的后备设备不会被使用
+static int RunRecoveryCheck()
+{
+    static const WCHAR c_wszCamera[] = L"\\\\?\\usb#vid_046d&pid_085c#camera";
+    static const WCHAR c_wszSpare[] = L"\\\\?\\usb#vid_046d&pid_0825#spare";
+    static const UINT32 c_retryMs = 20;
+    static const UINT32 c_fallbackDelayMs = 150;
+    static const RecoveryCase cases[] =
+    {
+        { "removal, same device returns", DeviceEvent_Removal, TRUE, 0, TRUE, 0 },
+        { "capture error, same device", DeviceEvent_Error, TRUE, 640, TRUE, 0 },
+        { "removal, fallback to spare", DeviceEvent_Removal, FALSE, 640, TRUE, 1 },
+        { "removal, incompatible spare", DeviceEvent_Removal, FALSE, 320, FALSE, 0 },
+        { "removal, no device", DeviceEvent_Removal, FALSE, 0, FALSE, 0 },
+    };
+
+    VideoFormat format = { FOURCC_NV12, 640, 480, 30, 1 };
+    UINT32 cFailed = 0;
+
+    for (size_t i = 0; i < ARRAYSIZE(cases); i++)
+    {
+        const RecoveryCase& test = cases[i];
+        CMockDevices devices;
+        CFramePipeline pipeline;
+        CTimestampSink sink;
+        CDeviceRecovery recovery;
+
+        devices.Plug(c_wszCamera, format.width, format.height);
+        if (test.spareWidth)
+        {
+            devices.Plug(c_wszSpare, test.spareWidth, test.spareWidth * 3 / 4);
+        }
+
+        CMockCapture capture(&pipeline, &devices, format, c_wszCamera);
+        BOOL bPassed = pipeline.Start(format, &sink) == S_OK;
+
+        recovery.SetTiming(c_retryMs, test.bReturns ? 60000 : c_fallbackDelayMs);
+        recovery.AddCapture(&capture);
+        if (test.spareWidth)
+        {
+            recovery.AddSpareDevice(c_wszSpare);
+        }
+        bPassed = bPassed && recovery.Start() == S_OK;
+        capture.Start();
+        bPassed = bPassed && WaitForFrames(sink, 30);
+
+        // 拔掉设备时先停止送帧，再收到移除事件；出错时设备仍然在
+        if (test.event == DeviceEvent_Removal)
+        {
+            devices.Unplug(c_wszCamera);
+        }
+        recovery.GetEventQueue()->Post(test.event, c_wszCamera, E_FAIL);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        RecoveryStatus status;
+        recovery.GetStatus(0, &status);
+        BOOL bLostSeen = status.bLost || test.event == DeviceEvent_Error;
+
+        if (test.bReturns && test.event == DeviceEvent_Removal)
+        {
+            devices.Plug(c_wszCamera, format.width, format.height);
+            recovery.GetEventQueue()->Post(DeviceEvent_Arrival, c_wszCamera);
+        }
+
+        // 不应恢复的用例等过后备延迟的两倍，确认没有写出新的帧
+        UINT64 cBefore = sink.FramesWritten();
+        BOOL bResumed = FALSE;
+
+        if (test.bRecovers)
+        {
+            bResumed = WaitForFrames(sink, cBefore + 30);
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(c_fallbackDelayMs * 2));
+            bResumed = sink.FramesWritten() > cBefore;
+        }
+
+        recovery.Stop();
+        capture.Stop();
+        bPassed = pipeline.Stop() == S_OK && bPassed;
+
+        PipelineStats stats;
+        pipeline.GetStats(&stats);
+        recovery.GetStatus(0, &status);
+
+        BOOL bExpectedLink = capture.GetDeviceLink() == (test.cFallbacks ? c_wszSpare : c_wszCamera);
+
+        bPassed = bPassed && bLostSeen && sink.BeginCount() == 1 && sink.FinalizeCount() == 1 &&
+            sink.IsContinuous(GetFrameDuration(format)) && stats.cDeviceLosses == 1 && bExpectedLink &&
+            status.cFallbacks == test.cFallbacks && bResumed == test.bRecovers &&
+            stats.cRecoveries == (test.bRecovers ? 1u : 0u) && stats.bDeviceLost == !test.bRecovers &&
+            status.bLost == !test.bRecovers && (!test.bRecovers || stats.fLastRecoveryMs > 0) &&
+            (test.bRecovers || status.cAttempts >= 2);
+
+        printf("%-32s %6llu frames, %u attempts, %u fallbacks, recovered in %7.1f ms  %s\n", test.pszName,
+            (unsigned long long)sink.FramesWritten(), status.cAttempts, status.cFallbacks, stats.fLastRecoveryMs,
+            bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: %s\n", test.pszName);
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// CTimestampListSink 类记录写出的每一帧的时间戳，用于检查运动门控写出了哪些帧
+class CTimestampListSink : public IFrameSink
+{
+public:
+    HRESULT BeginWriting(const VideoFormat&)
+    {
+        m_timestamps.clear();
+        return S_OK;
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        m_timestamps.push_back(frame.llTimestamp);
+        return S_OK;
+    }
+
+    HRESULT Finalize()
+    {
+        return S_OK;
+    }
+
+    const std::vector<LONGLONG>& Timestamps() const { return m_timestamps; }
+
+    // 预先留出 cFrames 个时间戳的空间，BeginWriting 清空列表时保留容量
+    void    Reserve(size_t cFrames) { m_timestamps.reserve(cFrames); }
+
+private:
+    std::vector<LONGLONG>   m_timestamps;   // 写出的时间戳
+};
+
+// 生成 --motion-check 的第 n 帧 NV12 画面：灰色背景加逐像素 ±2 的噪声，
+// 第 c_motionStart 到 c_motionEnd - 1 帧有一个 64x96 的白块每帧右移 32 像素，之后停在原处
+static const UINT32 c_motionStart = 30;
+static const UINT32 c_motionEnd = 40;
+
+static void RenderMotionFrame(const VideoFormat& format, UINT32 n, BYTE* pData)
+{
+    UINT32 seed = 0x2545F491 + n * 0x9E3779B9;
+    UINT32 blockX = (n < c_motionStart ? 0 : (n < c_motionEnd ? n : c_motionEnd - 1) - c_motionStart) * 32;
+
+    for (UINT32 y = 0; y < format.height; y++)
+    {
+        BYTE* pRow = pData + (size_t)y * format.width;
+
+        for (UINT32 x = 0; x < format.width; x++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            pRow[x] = (BYTE)(96 + (seed >> 30) - 2 + ((seed >> 29) & 1));
+        }
+
+        if (n >= c_motionStart && y >= 64 && y < 160)
+        {
+            for (UINT32 x = blockX; x < blockX + 64 && x < format.width; x++)
+            {
+                pRow[x] = 235;
+            }
+        }
+    }
+
+    memset(pData + (size_t)format.width * format.height, 128, GetFrameSize(format) - format.width * format.height);
+}
+
+// 检查运动门控：各 SIMD 级别的绝对差之和与标量结果一致（并输出单帧检测耗时）；
+// 带噪声的静止画面只写出第一帧，运动期间和之后的保持时长内逐帧写出，时间戳原样保留；
+// 最后让只有帧序号块变化的流水线经过门控，输出写出的字节数与不经过门控时的比例
+static int RunMotionCheck(UINT32 width, UINT32 height)
+{
+    static const UINT32 subtypes[] =
+    {
+        FOURCC_NV12, FOURCC_I420, FOURCC_YUY2, FOURCC_UYVY, FOURCC_RGB24, FOURCC_RGB32
+    };
+
+    printf("motion      %ux%u, cpu %s, grid step %u\n", width, height, GetCpuLevelName(GetCpuLevel()),
+        DEFAULT_MOTION_GRID_STEP);
+    printf("%-12s %12s %12s %12s\n", "", "scalar", "sse2", "avx2");
+
+    UINT32 cFailed = 0;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    {
+        VideoFormat format = { subtypes[i], width, height, 30, 1 };
+        UINT32 cbFrame = GetFrameSize(format);
+        std::vector<BYTE> data((size_t)cbFrame * 2);
+
+        UINT32 seed = 0x9E3779B9 + i;
+        for (size_t k = 0; k < data.size(); k++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            data[k] = (BYTE)(seed >> 24);
+        }
+
+        // 两帧互不相关的随机画面
+        CaptureFrame frames[2] = {};
+        for (UINT32 j = 0; j < 2; j++)
+        {
+            frames[j].pData = data.data() + (size_t)j * cbFrame;
+            frames[j].cbData = cbFrame;
+        }
+
+        CMotionDetector reference;
+        double fChange = 0;
+
+        if (FAILED(reference.Initialize(format, DEFAULT_MOTION_GRID_STEP, CpuLevel_Scalar)) ||
+            reference.Measure(frames[0], &fChange) != S_FALSE || reference.Measure(frames[1], &fChange) != S_OK)
+        {
+            fprintf(stderr, "Unsupported size %ux%u.\n", width, height);
+            return -1;
+        }
+
+        printf("%-12s", GetSubtypeName(format.subtype));
+
+        for (int level = CpuLevel_Scalar; level <= CpuLevel_AVX2; level++)
+        {
+            if (level > GetCpuLevel())
+            {
+                printf(" %12s", "-");
+                continue;
+            }
+
+            CMotionDetector detector;
+
+            detector.Initialize(format, DEFAULT_MOTION_GRID_STEP, (CpuLevel)level);
+            detector.Measure(frames[0], &fChange);
+            detector.Measure(frames[1], &fChange);
+
+            if (detector.GetLastSad() != reference.GetLastSad())
+            {
+                printf(" %12s", "MISMATCH");
+                cFailed++;
+                continue;
+            }
+
+            LONGLONG llStart = GetClockTime();
+            for (UINT32 k = 0; k < c_convertIterations; k++)
+            {
+                detector.Measure(frames[k & 1], &fChange);
+            }
+            printf(" %9.1f us", (GetClockTime() - llStart) / 10.0 / c_convertIterations);
+        }
+        printf("\n");
+    }
+
+    // 静止、运动、保持、再静止：写出第 0 帧、运动的各帧，以及最后一次运动之后保持时长内的帧
+    {
+        static const UINT32 c_holdMs = 500;
+        static const UINT32 c_cFrames = 200;
+
+        VideoFormat format = { FOURCC_NV12, 320, 240, 30, 1 };
+        std::vector<BYTE> data;
+        CTimestampListSink sink;
+        CMotionGateSink gate(&sink, DEFAULT_MOTION_THRESHOLD, c_holdMs);
+        std::vector<LONGLONG> expected;
+        LONGLONG llDuration = GetFrameDuration(format);
+        LONGLONG llBase = 12345 * HNS_PER_SECOND;
+        LONGLONG llLastMotion = llBase + (LONGLONG)(c_motionEnd - 1) * llDuration;
+        double fMaxStill = 0;
+        double fMinMoving = 1e9;
+        HRESULT hr = gate.BeginWriting(format);
+
+        data.resize(GetFrameSize(format));
+        for (UINT32 n = 0; n < c_cFrames && SUCCEEDED(hr); n++)
+        {
+            CaptureFrame frame = {};
+            MotionGateStats motion;
+
+            RenderMotionFrame(format, n, data.data());
+            frame.pData = data.data();
+            frame.cbData = (UINT32)data.size();
+            frame.llTimestamp = llBase + (LONGLONG)n * llDuration;
+            frame.nSequence = n;
+
+            if (n == 0 || (n >= c_motionStart && frame.llTimestamp - llLastMotion <= c_holdMs * (HNS_PER_SECOND / 1000)))
+            {
+                expected.push_back(frame.llTimestamp);
+            }
+
+            hr = gate.WriteFrame(frame);
+            gate.GetStats(&motion);
+
+            if (n >= c_motionStart && n < c_motionEnd)
+            {
+                fMinMoving = motion.fLastChange < fMinMoving ? motion.fLastChange : fMinMoving;
+            }
+            else if (n > 0)
+            {
+                fMaxStill = motion.fLastChange > fMaxStill ? motion.fLastChange : fMaxStill;
+            }
+        }
+
+        MotionGateStats motion;
+        gate.GetStats(&motion);
+
+        BOOL bPassed = SUCCEEDED(hr) && gate.Finalize() == S_OK && sink.Timestamps() == expected &&
+            motion.cForwarded == expected.size() && motion.cSkipped == c_cFrames - expected.size() &&
+            motion.cMotionEvents == 1 && !motion.bActive;
+
+        printf("gate        %llu of %u frames written, %u events, change still <= %.2f, moving >= %.2f  %s\n",
+            (unsigned long long)motion.cForwarded, c_cFrames, motion.cMotionEvents, fMaxStill, fMinMoving,
+            bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: gated frames or timestamps differ from the expected %u frames.\n",
+                (UINT32)expected.size());
+            cFailed++;
+        }
+    }
+
+    // 只有帧序号块变化的画面经过门控前后写出的字节数
+    {
+        VideoFormat format = { FOURCC_NV12, width, height, 30, 1 };
+        UINT64 cbWritten[2] = {};
+        double fFps[2] = {};
+        MotionGateStats motion = {};
+
+        for (UINT32 bGate = 0; bGate < 2; bGate++)
+        {
+            CSyntheticSource source(TestPattern_Flat, TRUE, 600);
+            CNullSink sink;
+            CMotionGateSink gate(&sink);
+            CFramePipeline pipeline;
+            PipelineStats stats;
+
+            pipeline.SetOverloadPolicy(OverloadPolicy_Block, 1000);
+            if (FAILED(pipeline.Start(&source, format, bGate ? (IFrameSink*)&gate : &sink)))
+            {
+                fprintf(stderr, "Failed to start pipeline.\n");
+                return -1;
+            }
+
+            pipeline.Wait();
+            pipeline.GetStats(&stats);
+            pipeline.Stop();
+
+            cbWritten[bGate] = sink.FramesWritten() * GetFrameSize(format);
+            fFps[bGate] = stats.fFps;
+            if (bGate)
+            {
+                gate.GetStats(&motion);
+            }
+        }
+
+        BOOL bPassed = motion.cForwarded >= 1 && motion.cForwarded * 100 <= motion.cForwarded + motion.cSkipped;
+
+        printf("flat        %.1f MB -> %.1f MB written (%.1f%%), %.1f us per frame, %.0f -> %.0f fps  %s\n",
+            cbWritten[0] / 1e6, cbWritten[1] / 1e6, cbWritten[0] ? cbWritten[1] * 100.0 / cbWritten[0] : 0,
+            motion.fAvgMeasureUs, fFps[0], fFps[1], bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: a static scene wrote %llu of %llu frames.\n", (unsigned long long)motion.cForwarded,
+                (unsigned long long)(motion.cForwarded + motion.cSkipped));
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// 以 cbBlock 大小的对齐块直接写 cbTotal 字节到 pwszPath，返回每秒字节数，作为该磁盘的裸带宽
+static double MeasureDiskBandwidth(const WCHAR* pwszPath, UINT64 cbTotal, size_t cbBlock, BOOL* pbDirect)
+{
+    CDirectFile file;
+    BYTE* pBlock = (BYTE*)AlignedAlloc(cbBlock, DIRECT_IO_ALIGNMENT);
+    double fRate = 0;
+
+    *pbDirect = FALSE;
+
+    if (pBlock && SUCCEEDED(file.Create(pwszPath, TRUE)))
+    {
+        memset(pBlock, 0x80, cbBlock);
+        *pbDirect = file.IsDirect();
+
+        LONGLONG llStart = GetClockTime();
+        HRESULT hr = S_OK;
+
+        for (UINT64 cb = 0; cb < cbTotal && SUCCEEDED(hr); cb += cbBlock)
+        {
+            hr = file.Write(pBlock, cbBlock);
+        }
+        file.Close();
+
+        double fSeconds = (GetClockTime() - llStart) / 1e7;
+        fRate = (SUCCEEDED(hr) && fSeconds > 0) ? cbTotal / fSeconds : 0;
+        CDirectFile::Remove(pwszPath);
+    }
+
+    AlignedFree(pBlock);
+    return fRate;
+}
+
+// 同时运行 cStreams 路流水线，把 cFrames 帧写入各自的未压缩文件（多路时在 pszPath 后加 .0、.1 ...），
+// 输出合计的持续写入速度（含 Finalize）、相当于几路 1080p60 NV12、WriteFrame 耗时的分位数，
+// 以及同一路径上直接 I/O 的裸带宽；检查每个文件的长度与写入的逻辑字节数一致，bKeep 时保留文件（可用 --replay 回放）；
+// cWriteBatch 大于 1 时按 CFramePipeline::SetWriteBatch 批量写出，bGather 时（只用于缓冲写入）每批作为一个分散/聚集写请求
+static int RunRawSinkBenchmark(const char* pszPath, BOOL bY4M, BOOL bDirect, AsyncIoBackend ioBackend, UINT32 cStreams,
+    const VideoFormat& format, UINT64 cFrames, UINT32 cQueueDepth, BOOL bUnthrottled, TestPattern pattern,
+    UINT32 outputSubtype, BOOL bKeep, UINT32 cWriteBatch, UINT32 batchLingerUs, UINT32 batchLatencyUs, BOOL bGather)
+{
+    std::vector<std::string> paths(cStreams);
+    std::vector<CSyntheticSource> sources(cStreams, CSyntheticSource(pattern, bUnthrottled, cFrames));
+    std::vector<std::unique_ptr<CRawFileSink>> sinks(cStreams);
+    std::unique_ptr<CFramePipeline[]> pipelines(new CFramePipeline[cStreams]);
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+
+    for (UINT32 i = 0; i < cStreams; i++)
+    {
+        paths[i] = (cStreams == 1) ? std::string(pszPath) : std::string(pszPath) + "." + std::to_string(i);
+        ToWidePath(paths[i].c_str(), wszPath, MAX_SEGMENT_PATH);
+
+        sinks[i].reset(new CRawFileSink(wszPath, bY4M ? RawContainer_Y4M : RawContainer_Raw, bDirect));
+        sinks[i]->SetIoBackend(ioBackend);
+
+        if (bGather)
+        {
+            HRESULT hr = sinks[i]->SetGatherWrites(cWriteBatch);
+            if (FAILED(hr))
+            {
+                fprintf(stderr, "Gather writes need --buffered (0x%08X).\n", (unsigned)hr);
+                return -1;
+            }
+        }
+
+        pipelines[i].SetSinkBuffers(sinks[i]->GetBufferDemand());
+        pipelines[i].SetQueueDepth(cQueueDepth);
+        pipelines[i].SetOutputSubtype(bY4M ? FOURCC_I420 : outputSubtype);
+        pipelines[i].SetWriteBatch(cWriteBatch, batchLingerUs, batchLatencyUs);
+    }
+
+    LONGLONG llStart = GetClockTime();
+
+    for (UINT32 i = 0; i < cStreams; i++)
+    {
+        HRESULT hr = pipelines[i].Start(&sources[i], format, sinks[i].get());
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Failed to start pipeline %u (0x%08X).\n", i, (unsigned)hr);
+            for (UINT32 j = 0; j < i; j++)
+            {
+                pipelines[j].Stop();
+            }
+            return -1;
+        }
+    }
+
+    BOOL bDirectUsed = sinks[0]->IsDirect();
+    AsyncIoBackend backendUsed = sinks[0]->GetIoBackend();
+    BOOL bRegistered = sinks[0]->IsRegistered();
+    int result = 0;
+
+    for (UINT32 i = 0; i < cStreams; i++)
+    {
+        pipelines[i].Wait();
+
+        HRESULT hr = pipelines[i].Stop();
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Pipeline %u failed (0x%08X).\n", i, (unsigned)hr);
+            result = -1;
+        }
+    }
+
+    double fSeconds = (GetClockTime() - llStart) / 1e7;
+    UINT64 cbLogical = 0;
+    UINT64 cWritten = 0;
+    UINT64 cOverflows = 0;
+    UINT64 cStalls = 0;
+    UINT64 cBatches = 0;
+    UINT64 cGathers = 0;
+    UINT32 cBatchLimit = 0;
+    double fSinkP99Us = 0;
+    double fSinkMaxUs = 0;
+
+    for (UINT32 i = 0; i < cStreams; i++)
+    {
+        PipelineStats stats;
+        LatencySnapshot latency;
+        UINT64 cbStream = 0;
+
+        pipelines[i].GetStats(&stats);
+        pipelines[i].GetLatency(&latency);
+        sinks[i]->GetBytesWritten(&cbStream);
+
+        std::error_code error;
+        UINT64 cbFile = (UINT64)std::filesystem::file_size(paths[i], error);
+        if (!bKeep)
+        {
+            std::filesystem::remove(paths[i], error);
+        }
+
+        if (cbFile != cbStream && result == 0)
+        {
+            fprintf(stderr, "FAILED: %s is %llu bytes, expected %llu.\n", paths[i].c_str(), (unsigned long long)cbFile,
+                (unsigned long long)cbStream);
+            result = 1;
+        }
+
+        const LatencySummary& sink = latency.stages[LatencyStage_Sink];
+
+        cbLogical += cbStream;
+        cWritten += stats.cFrames;
+        cOverflows += stats.cOverflows;
+        cStalls += sinks[i]->StallCount();
+        cBatches += stats.cBatches;
+        cGathers += sinks[i]->GatherCount();
+        cBatchLimit = (i == 0 || stats.cBatchLimit < cBatchLimit) ? stats.cBatchLimit : cBatchLimit;
+        fSinkP99Us = (sink.fP99Us > fSinkP99Us) ? sink.fP99Us : fSinkP99Us;
+        fSinkMaxUs = (sink.fMaxUs > fSinkMaxUs) ? sink.fMaxUs : fSinkMaxUs;
+    }
+
+    const VideoFormat& output = pipelines[0].GetOutputFormat();
+    double fRate = fSeconds > 0 ? cbLogical / fSeconds : 0;
+    double fStreamRate = 1920.0 * 1080 * 3 / 2 * 60;
+    BOOL bDiskDirect = FALSE;
+
+    // 保留录制时，测量带宽改写旁边的临时文件，不覆盖录制
+    ToWidePath(bKeep ? (paths[0] + ".disk").c_str() : paths[0].c_str(), wszPath, MAX_SEGMENT_PATH);
+    double fDisk = MeasureDiskBandwidth(wszPath, cbLogical, DEFAULT_RAW_BATCH_SIZE, &bDiskDirect);
+
+    printf("format      %s %ux%u -> %s x %u, %s I/O via %s%s%s\n", GetSubtypeName(output.subtype), output.width,
+        output.height, bY4M ? "y4m" : "raw", cStreams, bDirectUsed ? "direct" : "buffered",
+        GetAsyncIoBackendName(backendUsed), bRegistered ? " (registered buffers)" : "", bGather ? ", gather writes" : "");
+    printf("frames      %llu written, overflows %llu, %llu stalls waiting for the disk\n",
+        (unsigned long long)cWritten, (unsigned long long)cOverflows, (unsigned long long)cStalls);
+    printf("batches     %llu (%.1f frames each), %llu gather requests, final limit %u of %u\n",
+        (unsigned long long)cBatches, cBatches ? (double)cWritten / cBatches : 0, (unsigned long long)cGathers,
+        cBatchLimit, cWriteBatch);
+#if ENABLE_LATENCY_STATS
+    printf("sink        WriteFrame p99 %.1f us, max %.1f us (worst stream)\n", fSinkP99Us, fSinkMaxUs);
+#endif
+    printf("sustained   %.1f MB/s over %.3f s (%.2f x 1080p60 NV12)\n", fRate / 1e6, fSeconds, fRate / fStreamRate);
+    printf("disk        %.1f MB/s %s sequential write, sink reaches %.0f%%\n", fDisk / 1e6,
+        bDiskDirect ? "direct" : "buffered", fDisk > 0 ? fRate / fDisk * 100 : 0);
+
+    return result;
+}
+
+// 第 i 个（共 cValues 个）按对数均匀分布在 100 纳秒到 100 毫秒之间的值，随 i 单调递增
+static UINT64 GetLogUniformValue(UINT32 i, UINT32 cValues)
+{
+    return (UINT64)(100 * pow(1e6, (i + 0.5) / cValues));
+}
+
+// 把对数均匀分布的值打乱顺序记录进直方图，分位数与按序号直接得到的精确值比较（相对误差不超过 1/32）；
+// 再测量一个埋点（两次读时钟加一次 Record）和单独读时钟的耗时，并检查时钟不会倒退
+static int RunLatencyCheck()
+{
+    const UINT32 cValues = 1000000;
+    const UINT32 cIterations = 10000000;
+    static const double percentiles[] = { 0.5, 0.99, 0.999 };
+    static CLatencyHistogram s_histogram;
+    static CLatencyRecorder s_recorder;
+
+    for (UINT32 i = 0; i < cValues; i++)
+    {
+        // 7919 与 cValues 互质，乘法取模遍历所有序号且顺序打乱
+        s_histogram.Record(GetLogUniformValue((UINT32)((UINT64)i * 7919 % cValues), cValues));
+    }
+
+    LatencySummary summary;
+    s_histogram.GetSummary(&summary);
+
+    double reported[] = { summary.fP50Us, summary.fP99Us, summary.fP999Us };
+    double fExactMax = GetLogUniformValue(cValues - 1, cValues) / 1e3;
+    int cErrors = 0;
+
+    printf("histogram   %llu samples, max %.1f us (exact %.1f us)\n", (unsigned long long)summary.cSamples,
+        summary.fMaxUs, fExactMax);
+
+    for (UINT32 i = 0; i < ARRAYSIZE(percentiles); i++)
+    {
+        double fExact = GetLogUniformValue((UINT32)(percentiles[i] * cValues + 0.5) - 1, cValues) / 1e3;
+        double fError = fabs(reported[i] - fExact) / fExact;
+
+        printf("  p%-8g  %10.2f us, exact %10.2f us, error %.2f%%\n", percentiles[i] * 100, reported[i], fExact,
+            fError * 100);
+
+        if (fError > 1.0 / CLatencyHistogram::SUB_BUCKETS)
+        {
+            cErrors++;
+        }
+    }
+
+    if (summary.cSamples != cValues || summary.fMaxUs != fExactMax)
+    {
+        cErrors++;
+    }
+
+    LONGLONG llStart = GetClockTime();
+    for (UINT32 i = 0; i < cIterations; i++)
+    {
+        LONGLONG llBegin = GetLatencyClock();
+        s_recorder.Record(LatencyStage_Sink, GetLatencyClock() - llBegin);
+    }
+    double fStageNs = (GetClockTime() - llStart) * 100.0 / cIterations;
+
+    LONGLONG llPrevious = GetLatencyClock();
+    UINT64 cBackwards = 0;
+
+    llStart = GetClockTime();
+    for (UINT32 i = 0; i < cIterations; i++)
+    {
+        LONGLONG llNow = GetLatencyClock();
+        cBackwards += (llNow < llPrevious);
+        llPrevious = llNow;
+    }
+    double fClockNs = (GetClockTime() - llStart) * 100.0 / cIterations;
+
+    printf("overhead    %.1f ns per instrumented stage, %.1f ns per clock read (ENABLE_LATENCY_STATS=%d)\n", fStageNs,
+        fClockNs, ENABLE_LATENCY_STATS);
+    printf("            about %.2f us per frame for %d stages\n", fStageNs * (LatencyStage_Count - 1) / 1e3,
+        LatencyStage_Count - 1);
+
+    if (cErrors != 0)
+    {
+        fprintf(stderr, "FAILED: histogram percentiles outside the bucket precision.\n");
+        return 1;
+    }
+    if (cBackwards != 0)
+    {
+        fprintf(stderr, "FAILED: clock went backwards %llu times.\n", (unsigned long long)cBackwards);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 进程累计的 CPU 时间（所有线程的用户态加内核态，100 纳秒）
+static LONGLONG GetProcessCpuTime()
+{
+#ifdef _WIN32
+    FILETIME ftCreate, ftExit, ftKernel, ftUser;
+
+    if (!GetProcessTimes(GetCurrentProcess(), &ftCreate, &ftExit, &ftKernel, &ftUser))
+    {
+        return 0;
+    }
+
+    ULARGE_INTEGER kernel = { { ftKernel.dwLowDateTime, ftKernel.dwHighDateTime } };
+    ULARGE_INTEGER user = { { ftUser.dwLowDateTime, ftUser.dwHighDateTime } };
+    return (LONGLONG)(kernel.QuadPart + user.QuadPart);
+#else
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+    return ((LONGLONG)usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * HNS_PER_SECOND +
+        ((LONGLONG)usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 10;
+#endif
+}
+
+// 把进程的峰值常驻内存清零为当前值，使下一次 GetPeakRss 只反映之后的用量；
+// 只有 Linux 支持（/proc/self/clear_refs），其他平台返回 FALSE，峰值从进程启动开始累计
+static BOOL ResetPeakRss()
+{
+#ifdef __linux__
+    FILE* pFile = fopen("/proc/self/clear_refs", "w");
+
+    if (pFile == nullptr)
+    {
+        return FALSE;
+    }
+
+    BOOL bReset = (fputs("5", pFile) >= 0);
+    return (fclose(pFile) == 0) && bReset;
+#else
+    return FALSE;
+#endif
+}
+
+// 进程的峰值常驻内存（字节）
+static UINT64 GetPeakRss()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+#ifdef __linux__
+    FILE* pFile = fopen("/proc/self/status", "r");
+
+    if (pFile)
+    {
+        char szLine[256];
+        unsigned long long cKb = 0;
+
+        while (fgets(szLine, sizeof(szLine), pFile))
+        {
+            if (sscanf(szLine, "VmHWM: %llu kB", &cKb) == 1)
+            {
+                break;
+            }
+        }
+
+        fclose(pFile);
+
+        if (cKb != 0)
+        {
+            return cKb * 1024;
+        }
+    }
+#endif
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (UINT64)usage.ru_maxrss * 1024 : 0;
+#endif
+}
+
+// 把逗号分隔的列表拆开
+static std::vector<std::string> SplitList(const char* pszList)
+{
+    std::vector<std::string> items;
+    std::string item;
+
+    for (const char* p = pszList; ; p++)
+    {
+        if (*p == ',' || *p == 0)
+        {
+            if (!item.empty())
+            {
+                items.push_back(item);
+            }
+            item.clear();
+
+            if (*p == 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            item += *p;
+        }
+    }
+
+    return items;
+}
+
+// 解析分辨率：WxH，或者 vga/720p/1080p/4k
+static BOOL ParseResolution(const std::string& name, UINT32* pWidth, UINT32* pHeight)
+{
+    if (name == "vga") { *pWidth = 640; *pHeight = 480; return TRUE; }
+    if (name == "720p") { *pWidth = 1280; *pHeight = 720; return TRUE; }
+    if (name == "1080p") { *pWidth = 1920; *pHeight = 1080; return TRUE; }
+    if (name == "4k") { *pWidth = 3840; *pHeight = 2160; return TRUE; }
+
+    return sscanf(name.c_str(), "%ux%u", pWidth, pHeight) == 2 && *pWidth >= 2 && *pHeight >= 2;
+}
+
+// 压测套件默认扫描的分辨率、像素格式（与 ConfigureSourceReader 的列表一致）、帧率（0 表示不节流）和接收器
+static const char c_szSuiteResolutions[] = "vga,720p,1080p,4k";
+static const char c_szSuiteFormats[] = "nv12,yuy2,uyvy,rgb32,rgb24,iyuv";
+static const char c_szSuiteRates[] = "0,60";
+static const char c_szSuiteSinks[] = "null,raw";
+
+// 每个组合默认的帧数
+static const UINT64 c_suiteFrames = 120;
+
+// 分段接收器每段的时长和保留数
+static const LONGLONG c_suiteSegmentDuration = HNS_PER_SECOND;
+static const UINT32 c_suiteSegmentRetain = 2;
+
+#ifdef _WIN32
+// mp4 接收器的编码码率
+static const UINT32 c_suiteBitrate = 10000000;
+#endif
+
+// SuiteOptions 结构体保存压测套件的参数
+struct SuiteOptions
+{
+    const char* pszResolutions;     // 分辨率列表
+    const char* pszFormats;         // 像素格式列表
+    const char* pszRates;           // 帧率列表
+    const char* pszSinks;           // 接收器列表：null、raw、y4m、segment、mjpeg，Windows 上还有 mp4
+    const char* pszDirectory;       // 写文件的接收器使用的目录
+    const char* pszOutput;          // JSON Lines 结果文件，为空时输出到标准输出
+    const char* pszBaseline;        // 基准结果文件，为空时不比较
+    double      fTolerance;         // 允许的退化比例
+    UINT64      cFrames;            // 每个组合的帧数
+    UINT32      cQueueDepth;        // 队列深度
+    UINT32      outputSubtype;      // null/mp4 接收器的输出格式
+    UINT32      analysisFrameStride; // 分析的帧采样间隔
+    UINT32      analysisRowStride;  // 分析的行采样间隔
+    TestPattern pattern;            // 测试图案
+};
+
+// SuiteResult 结构体保存一个组合的结果
+struct SuiteResult
+{
+    std::string     name;           // 组合名称，<宽>x<高>_<格式>_<帧率>_<接收器>
+    VideoFormat     format;         // 协商后的格式
+    UINT32          outputSubtype;  // 交给接收器的格式
+    PipelineStats   stats;          // 流水线统计
+    LatencySnapshot latency;        // 各阶段延迟
+    double          fCpuUsPerFrame; // 每帧消耗的 CPU 时间（微秒，所有线程）
+    UINT64          cbPeakRss;      // 峰值常驻内存
+    HRESULT         hr;             // 运行结果
+};
+
+// SuiteBaseline 结构体保存基准结果中的一个组合
+struct SuiteBaseline
+{
+    std::string     name;           // 组合名称
+    double          fFps;           // 帧率
+    double          fCpuUsPerFrame; // 每帧 CPU 时间
+};
+
+// 在一行 JSON 中查找 "key": 后面的数字
+static BOOL FindJsonNumber(const std::string& line, const char* pszKey, double* pValue)
+{
+    std::string key = std::string("\"") + pszKey + "\":";
+    size_t i = line.find(key);
+
+    return i != std::string::npos && sscanf(line.c_str() + i + key.size(), "%lf", pValue) == 1;
+}
+
+// 在一行 JSON 中查找 "key":"..." 的字符串值
+static BOOL FindJsonString(const std::string& line, const char* pszKey, std::string* pValue)
+{
+    std::string key = std::string("\"") + pszKey + "\":\"";
+    size_t i = line.find(key);
+
+    if (i == std::string::npos)
+    {
+        return FALSE;
+    }
+
+    size_t iEnd = line.find('"', i + key.size());
+
+    if (iEnd == std::string::npos)
+    {
+        return FALSE;
+    }
+
+    *pValue = line.substr(i + key.size(), iEnd - i - key.size());
+    return TRUE;
+}
+
+// 读取之前一次 --suite 的 JSON Lines 输出，只保留成功的组合
+static BOOL LoadSuiteBaseline(const char* pszPath, std::vector<SuiteBaseline>* pBaseline)
+{
+    FILE* pFile = fopen(pszPath, "r");
+
+    if (pFile == nullptr)
+    {
+        return FALSE;
+    }
+
+    char szLine[4096];
+
+    while (fgets(szLine, sizeof(szLine), pFile))
+    {
+        std::string line = szLine;
+        std::string result;
+        SuiteBaseline entry;
+
+        if (FindJsonString(line, "case", &entry.name) && FindJsonString(line, "result", &result) && result == "ok" &&
+            FindJsonNumber(line, "fps", &entry.fFps) && FindJsonNumber(line, "cpu_us_per_frame", &entry.fCpuUsPerFrame))
+        {
+            pBaseline->push_back(entry);
+        }
+    }
+
+    fclose(pFile);
+    return TRUE;
+}
+
+// 把一个组合的结果写成一行 JSON
+static void WriteSuiteResult(FILE* pFile, const SuiteResult& result, const char* pszSink, UINT32 targetFps)
+{
+    const LatencySummary& total = result.latency.stages[LatencyStage_Total];
+    const PipelineStats& stats = result.stats;
+
+    fprintf(pFile, "{\"case\":\"%s\",\"width\":%u,\"height\":%u,\"format\":\"%s\",\"output\":\"%s\",\"target_fps\":%u,"
+        "\"sink\":\"%s\",\"frames\":%llu,\"dropped\":%llu,\"fps\":%.2f,\"mb_per_s\":%.1f,"
+        "\"latency_p50_us\":%.1f,\"latency_p99_us\":%.1f,\"latency_p999_us\":%.1f,\"latency_max_us\":%.1f,"
+        "\"convert_p99_us\":%.1f,\"sink_p99_us\":%.1f,\"cpu_us_per_frame\":%.1f,\"peak_rss_mb\":%.1f,"
+        "\"result\":\"%s\",\"hr\":\"0x%08X\"}\n",
+        result.name.c_str(), result.format.width, result.format.height, GetSubtypeName(result.format.subtype),
+        GetSubtypeName(result.outputSubtype), targetFps, pszSink, (unsigned long long)stats.cFrames,
+        (unsigned long long)stats.cOverflows, stats.fFps, stats.fElapsed > 0 ? stats.cbWritten / 1e6 / stats.fElapsed : 0,
+        total.fP50Us, total.fP99Us, total.fP999Us, total.fMaxUs,
+        result.latency.stages[LatencyStage_Convert].fP99Us, result.latency.stages[LatencyStage_Sink].fP99Us,
+        result.fCpuUsPerFrame, result.cbPeakRss / 1048576.0, SUCCEEDED(result.hr) ? "ok" : "failed", (unsigned)result.hr);
+    fflush(pFile);
+}
+
+// 删除分段接收器写出的所有分段
+static void RemoveSegments(CSegmentedSink* pSink, IFrameSinkFactory* pFactory)
+{
+    SegmentStats stats;
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+
+    pSink->GetStats(&stats);
+
+    for (UINT32 i = 0; i <= stats.nCurrent + 1; i++)
+    {
+        pSink->GetSegmentPath(i, wszPath, MAX_SEGMENT_PATH);
+        pFactory->RemoveFile(wszPath);
+    }
+}
+
+// 用流水线驱动一个组合；接收器与 CCapture 在对应模式下创建的一致：
+// null 按 outputSubtype 转换（默认 NV12，与编码器的输入相同），raw 和 segment 不转换（未压缩录制），y4m 转换成 I420，
+// mjpeg 转换成 NV12 后用软件 JPEG 编码写入 MKV
+static HRESULT RunSuiteCase(const SuiteOptions& options, const VideoFormat& format, BOOL bUnthrottled,
+    const char* pszSink, const WCHAR* pwszPath, SuiteResult* pResult)
+{
+    CSyntheticSource source(options.pattern, bUnthrottled, options.cFrames);
+    CFramePipeline pipeline;
+    CNullSink nullSink;
+    CRawFileSinkFactory rawFactory;
+    std::unique_ptr<IFrameSink> pFileSink;
+    CSegmentedSink* pSegmented = nullptr;
+    IFrameSink* pSink = &nullSink;
+    UINT32 outputSubtype = options.outputSubtype;
+
+    if (strcmp(pszSink, "raw") == 0)
+    {
+        pFileSink.reset(new CRawFileSink(pwszPath, RawContainer_Raw));
+        outputSubtype = 0;
+    }
+    else if (strcmp(pszSink, "y4m") == 0)
+    {
+        pFileSink.reset(new CRawFileSink(pwszPath, RawContainer_Y4M));
+        outputSubtype = FOURCC_I420;
+    }
+    else if (strcmp(pszSink, "mjpeg") == 0)
+    {
+        pFileSink.reset(new CMjpegFileSink(pwszPath));
+        outputSubtype = FOURCC_NV12;
+    }
+    else if (strcmp(pszSink, "segment") == 0)
+    {
+        pSegmented = new CSegmentedSink(&rawFactory, pwszPath, c_suiteSegmentDuration, 0, c_suiteSegmentRetain);
+        pFileSink.reset(pSegmented);
+        outputSubtype = 0;
+    }
+    else if (strcmp(pszSink, "null") != 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (pFileSink)
+    {
+        pSink = pFileSink.get();
+    }
+
+    pipeline.SetQueueDepth(options.cQueueDepth);
+    pipeline.SetOutputSubtype(outputSubtype);
+    pipeline.SetAnalysis(options.analysisFrameStride, options.analysisRowStride);
+
+    HRESULT hr = pipeline.Start(&source, format, pSink);
+
+    if (SUCCEEDED(hr))
+    {
+        pipeline.Wait();
+        pipeline.GetStats(&pResult->stats);
+        hr = pipeline.Stop();
+        pipeline.GetLatency(&pResult->latency);
+        pResult->format = pipeline.GetFormat();
+        pResult->outputSubtype = pipeline.GetOutputFormat().subtype;
+    }
+
+    if (pSegmented)
+    {
+        RemoveSegments(pSegmented, &rawFactory);
+    }
+    else if (pFileSink)
+    {
+        CDirectFile::Remove(pwszPath);
+    }
+
+    return hr;
+}
+
+#ifdef _WIN32
+// 用完整的 CCapture 驱动一个组合：合成数据源经流水线转换成 NV12 后交给 IMFSinkWriter 编码成 H.264
+static HRESULT RunCaptureCase(const SuiteOptions& options, const VideoFormat& format, BOOL bUnthrottled,
+    const WCHAR* pwszPath, SuiteResult* pResult)
+{
+    CSyntheticSource source(options.pattern, bUnthrottled, options.cFrames);
+    CCapture* pCapture = nullptr;
+    EncodingParameters param = { MFVideoFormat_H264, c_suiteBitrate };
+
+    HRESULT hr = CCapture::CreateInstance(nullptr, &pCapture);
+
+    if (SUCCEEDED(hr))
+    {
+        pCapture->SetQueueDepth(options.cQueueDepth);
+        pCapture->SetFrameAnalysis(options.analysisFrameStride, options.analysisRowStride);
+
+        hr = pCapture->StartCapture(&source, format, pwszPath, param);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pCapture->WaitForSource();
+        pCapture->GetPipelineStats(&pResult->stats);
+        hr = pCapture->EndCaptureSession();
+        pCapture->GetLatency(&pResult->latency);
+        pResult->format = pCapture->GetPipeline()->GetFormat();
+        pResult->outputSubtype = FOURCC_NV12;
+    }
+
+    if (pCapture)
+    {
+        pCapture->Release();
+    }
+    DeleteFileW(pwszPath);
+    return hr;
+}
+#endif
+
+// 按分辨率、像素格式、帧率和接收器的所有组合逐个运行，输出 JSON Lines；
+// 指定基准文件时，帧率下降或每帧 CPU 时间上升超过容差的组合记为退化，返回 1
+static int RunSuite(const SuiteOptions& options)
+{
+    std::vector<std::string> resolutions = SplitList(options.pszResolutions);
+    std::vector<std::string> formats = SplitList(options.pszFormats);
+    std::vector<std::string> rates = SplitList(options.pszRates);
+    std::vector<std::string> sinks = SplitList(options.pszSinks);
+    std::vector<SuiteBaseline> baseline;
+
+    if (options.pszBaseline && !LoadSuiteBaseline(options.pszBaseline, &baseline))
+    {
+        fprintf(stderr, "Failed to read %s.\n", options.pszBaseline);
+        return -1;
+    }
+
+#ifdef _WIN32
+    // mp4 接收器经 CCapture 使用 IMFSinkWriter
+    HRESULT hrStartup = MFStartup(MF_VERSION);
+
+    if (FAILED(hrStartup))
+    {
+        fprintf(stderr, "MFStartup failed (0x%08X).\n", (unsigned)hrStartup);
+        return -1;
+    }
+#endif
+
+    FILE* pOutput = stdout;
+
+    if (options.pszOutput)
+    {
+        pOutput = fopen(options.pszOutput, "w");
+
+        if (pOutput == nullptr)
+        {
+            fprintf(stderr, "Failed to create %s.\n", options.pszOutput);
+            return -1;
+        }
+
+        printf("%-34s %10s %8s %10s %10s %10s %10s %8s\n", "case", "fps", "dropped", "p50 (ms)", "p99 (ms)",
+            "p99.9 (ms)", "cpu/frame", "rss MB");
+    }
+
+    UINT32 cFailed = 0;
+    UINT32 cRegressions = 0;
+
+    for (size_t iRes = 0; iRes < resolutions.size(); iRes++)
+    {
+        for (size_t iFormat = 0; iFormat < formats.size(); iFormat++)
+        {
+            for (size_t iRate = 0; iRate < rates.size(); iRate++)
+            {
+                for (size_t iSink = 0; iSink < sinks.size(); iSink++)
+                {
+                    VideoFormat format = { 0, 0, 0, 0, 1 };
+                    UINT32 targetFps = (UINT32)atoi(rates[iRate].c_str());
+                    const char* pszSink = sinks[iSink].c_str();
+
+                    format.subtype = ParseSubtype(formats[iFormat].c_str());
+                    format.fpsNumerator = targetFps ? targetFps : 60;
+
+                    if (format.subtype == 0 || !ParseResolution(resolutions[iRes], &format.width, &format.height))
+                    {
+                        fprintf(stderr, "Skipping %s %s.\n", resolutions[iRes].c_str(), formats[iFormat].c_str());
+                        continue;
+                    }
+
+                    SuiteResult result = SuiteResult();
+                    char szName[128];
+                    char szPath[MAX_SEGMENT_PATH];
+                    WCHAR wszPath[MAX_SEGMENT_PATH];
+
+                    snprintf(szName, sizeof(szName), "%ux%u_%s_%u_%s", format.width, format.height,
+                        formats[iFormat].c_str(), targetFps, pszSink);
+                    snprintf(szPath, sizeof(szPath), "%s/suite_%s.%s", options.pszDirectory, szName,
+                        strcmp(pszSink, "y4m") == 0 ? "y4m" : strcmp(pszSink, "mp4") == 0 ? "mp4" :
+                        strcmp(pszSink, "mjpeg") == 0 ? "mkv" : "raw");
+                    ToWidePath(szPath, wszPath, MAX_SEGMENT_PATH);
+
+                    result.name = szName;
+                    result.format = format;
+                    ResetPeakRss();
+                    LONGLONG llCpuStart = GetProcessCpuTime();
+
+#ifdef _WIN32
+                    if (strcmp(pszSink, "mp4") == 0)
+                    {
+                        result.hr = RunCaptureCase(options, format, targetFps == 0, wszPath, &result);
+                    }
+                    else
+#endif
+                    {
+                        result.hr = RunSuiteCase(options, format, targetFps == 0, pszSink, wszPath, &result);
+                    }
+
+                    LONGLONG llCpu = GetProcessCpuTime() - llCpuStart;
+                    result.cbPeakRss = GetPeakRss();
+                    result.fCpuUsPerFrame = result.stats.cFrames ? llCpu / 10.0 / result.stats.cFrames : 0;
+
+                    WriteSuiteResult(pOutput, result, pszSink, targetFps);
+
+                    if (FAILED(result.hr))
+                    {
+                        cFailed++;
+                    }
+
+                    if (pOutput != stdout)
+                    {
+                        const LatencySummary& total = result.latency.stages[LatencyStage_Total];
+
+                        printf("%-34s %10.1f %8llu %10.3f %10.3f %10.3f %8.1fus %8.1f%s\n", szName, result.stats.fFps,
+                            (unsigned long long)result.stats.cOverflows, total.fP50Us / 1e3, total.fP99Us / 1e3,
+                            total.fP999Us / 1e3, result.fCpuUsPerFrame, result.cbPeakRss / 1048576.0,
+                            SUCCEEDED(result.hr) ? "" : "  FAILED");
+                    }
+
+                    for (size_t i = 0; i < baseline.size() && SUCCEEDED(result.hr); i++)
+                    {
+                        if (baseline[i].name != result.name)
+                        {
+                            continue;
+                        }
+
+                        double fFpsChange = baseline[i].fFps > 0 ? result.stats.fFps / baseline[i].fFps - 1 : 0;
+                        double fCpuChange = baseline[i].fCpuUsPerFrame > 0 ?
+                            result.fCpuUsPerFrame / baseline[i].fCpuUsPerFrame - 1 : 0;
+
+                        if (fFpsChange < -options.fTolerance || fCpuChange > options.fTolerance)
+                        {
+                            fprintf(stderr, "REGRESSION %s: fps %.1f -> %.1f (%+.1f%%), cpu/frame %.1f -> %.1f us (%+.1f%%)\n",
+                                szName, baseline[i].fFps, result.stats.fFps, fFpsChange * 100, baseline[i].fCpuUsPerFrame,
+                                result.fCpuUsPerFrame, fCpuChange * 100);
+                            cRegressions++;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    if (pOutput != stdout)
+    {
+        fclose(pOutput);
+    }
+
+#ifdef _WIN32
+    MFShutdown();
+#endif
+
+    if (cFailed != 0)
+    {
+        fprintf(stderr, "FAILED: %u cases failed.\n", cFailed);
+        return 1;
+    }
+    if (cRegressions != 0)
+    {
+        fprintf(stderr, "FAILED: %u cases regressed by more than %.0f%%.\n", cRegressions, options.fTolerance * 100);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 输出用法
+// ScaleCase 结构体描述 --scale-check 的一种缩放，输出大小为 0 时按输入推算，裁剪大小为 0 时取整帧
+struct ScaleCase
+{
+    const char* pszName;
+    UINT32      width;
+    UINT32      height;
+    ScaleFilter filter;
+    BOOL        bCrop;      // 裁剪出中间 1/2 x 1/2 的区域
+};
+
+// 对亮度平面按 2x2 的块直接求平均（四舍五入），检查区域平均 1/2 缩小的结果
+static BOOL IsBoxHalfCorrect(const BYTE* pSrc, UINT32 srcWidth, const BYTE* pDst, UINT32 dstWidth, UINT32 dstHeight)
+{
+    for (UINT32 y = 0; y < dstHeight; y++)
+    {
+        for (UINT32 x = 0; x < dstWidth; x++)
+        {
+            const BYTE* p = pSrc + (size_t)y * 2 * srcWidth + x * 2;
+            UINT32 sum = p[0] + p[1] + p[srcWidth] + p[srcWidth + 1];
+
+            if (pDst[(size_t)y * dstWidth + x] != (sum + 2) / 4)
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+// 比较各 SIMD 级别的缩放结果与标量结果并测量耗时，检查区域平均与直接求平均一致，
+// 再用 CSimulcastSink 在流水线上同时写出原始帧和三路缩放输出，检查帧数、时间戳和稳态下没有堆分配
+static int RunScaleCheck(UINT32 width, UINT32 height)
+{
+    static const UINT32 subtypes[] = { FOURCC_NV12, FOURCC_I420 };
+    static const ScaleCase cases[] =
+    {
+        { "bilinear 480p", 0, 480, ScaleFilter_Bilinear, FALSE },
+        { "box 480p", 0, 480, ScaleFilter_Box, FALSE },
+        { "box 1/4", 0, 0, ScaleFilter_Box, FALSE },
+        { "bilinear 3/2", 0, 0, ScaleFilter_Bilinear, FALSE },
+        { "crop 1/2", 0, 0, ScaleFilter_Bilinear, TRUE },
+        { "crop 240p", 0, 240, ScaleFilter_Box, TRUE },
+    };
+
+    printf("scale       %ux%u, cpu %s\n", width, height, GetCpuLevelName(GetCpuLevel()));
+    printf("%-22s %12s %12s %12s %12s\n", "", "output", "scalar", "sse2", "avx2");
+
+    UINT32 cFailed = 0;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    {
+        VideoFormat format = { subtypes[i], width, height, 30, 1 };
+        std::vector<BYTE> src;
+        std::vector<BYTE> reference;
+        std::vector<BYTE> dst;
+
+        src.resize(GetFrameSize(format));
+
+        UINT32 seed = 0x3C6EF372 + i;
+        for (size_t k = 0; k < src.size(); k++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            src[k] = (BYTE)(seed >> 24);
+        }
+
+        for (UINT32 j = 0; j < ARRAYSIZE(cases); j++)
+        {
+            const ScaleCase& test = cases[j];
+            ScaleParams params = ScaleParams();
+            CFrameScaler scaler;
+
+            params.width = test.width;
+            params.height = test.height;
+            params.filter = test.filter;
+
+            if (strcmp(test.pszName, "box 1/4") == 0)
+            {
+                params.width = width / 8 * 2;
+            }
+            else if (strcmp(test.pszName, "bilinear 3/2") == 0)
+            {
+                params.width = width / 4 * 6;
+            }
+
+            if (test.bCrop)
+            {
+                params.crop.width = width / 4 * 2;
+                params.crop.height = height / 4 * 2;
+                params.crop.x = (width - params.crop.width) / 4 * 2;
+                params.crop.y = (height - params.crop.height) / 4 * 2;
+            }
+
+            if (FAILED(scaler.Initialize(format, params, CpuLevel_Scalar)))
+            {
+                fprintf(stderr, "Unsupported size %ux%u for %s.\n", width, height, test.pszName);
+                return -1;
+            }
+
+            const VideoFormat& output = scaler.GetOutputFormat();
+            char szName[64];
+            char szOutput[32];
+
+            reference.resize(GetFrameSize(output));
+            dst.resize(reference.size());
+            scaler.Scale(src.data(), reference.data());
+
+            snprintf(szName, sizeof(szName), "%s %s", GetSubtypeName(format.subtype), test.pszName);
+            snprintf(szOutput, sizeof(szOutput), "%ux%u", output.width, output.height);
+            printf("%-22s %12s", szName, szOutput);
+
+            for (int level = CpuLevel_Scalar; level <= CpuLevel_AVX2; level++)
+            {
+                if (level > GetCpuLevel())
+                {
+                    printf(" %12s", "-");
+                    continue;
+                }
+
+                CFrameScaler simd;
+
+                simd.Initialize(format, params, (CpuLevel)level);
+                memset(dst.data(), 0, dst.size());
+                simd.Scale(src.data(), dst.data());
+
+                if (dst != reference)
+                {
+                    printf(" %12s", "MISMATCH");
+                    cFailed++;
+                    continue;
+                }
+
+                LONGLONG llStart = GetClockTime();
+                for (UINT32 k = 0; k < c_convertIterations; k++)
+                {
+                    simd.Scale(src.data(), dst.data());
+                }
+                printf(" %9.1f us", (GetClockTime() - llStart) / 10.0 / c_convertIterations);
+            }
+            printf("\n");
+        }
+
+        // 区域平均 1/2 缩小的亮度平面与直接对 2x2 求平均一致，裁剪到 4 的倍数使输出正好是一半
+        ScaleParams half = ScaleParams();
+        CFrameScaler scaler;
+
+        half.crop.width = width / 4 * 4;
+        half.crop.height = height / 4 * 4;
+        half.width = half.crop.width / 2;
+        half.height = half.crop.height / 2;
+        half.filter = ScaleFilter_Box;
+
+        BOOL bPassed = SUCCEEDED(scaler.Initialize(format, half));
+
+        if (bPassed)
+        {
+            dst.resize(GetFrameSize(scaler.GetOutputFormat()));
+            scaler.Scale(src.data(), dst.data());
+            bPassed = IsBoxHalfCorrect(src.data(), width, dst.data(), half.width, half.height);
+        }
+
+        printf("%-22s %12s %s\n", GetSubtypeName(format.subtype), "box 1/2", bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    // 不合法的参数：裁剪越界、奇数大小、区域平均放大
+    {
+        VideoFormat format = { FOURCC_NV12, width, height, 30, 1 };
+        VideoFormat yuy2 = { FOURCC_YUY2, width, height, 30, 1 };
+        ScaleParams params = ScaleParams();
+        VideoFormat output;
+        BOOL bPassed = GetScaledFormat(yuy2, params, &output) == HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+        params.crop.x = 2;
+        params.crop.width = width;
+        params.crop.height = height;
+        bPassed = bPassed && GetScaledFormat(format, params, &output) == E_INVALIDARG;
+
+        params = ScaleParams();
+        params.width = 641;
+        params.height = 360;
+        bPassed = bPassed && GetScaledFormat(format, params, &output) == E_INVALIDARG;
+
+        params.width = width * 2;
+        params.height = height * 2;
+        params.filter = ScaleFilter_Box;
+        bPassed = bPassed && GetScaledFormat(format, params, &output) == E_INVALIDARG;
+
+        params.width = 0;
+        params.height = 480;
+        params.filter = ScaleFilter_Bilinear;
+        bPassed = bPassed && GetScaledFormat(format, params, &output) == S_OK && output.height == 480 &&
+            output.width % 2 == 0 && output.width == (UINT32)((UINT64)480 * width / height + 1) / 2 * 2;
+
+        printf("%-22s %12s %s\n", "params", "", bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    // 流水线上同时写出原始帧和三路缩放输出，与只写原始帧的帧率对比
+    {
+        static const UINT64 c_cFrames = 600;
+        VideoFormat format = { FOURCC_YUY2, width, height, 60, 1 };
+        ScaleParams outputs[3] = {};
+        double fFps[2] = {};
+        BOOL bPassed = TRUE;
+
+        outputs[0].height = 480;
+        outputs[1].height = 480;
+        outputs[1].filter = ScaleFilter_Box;
+        outputs[2].crop.width = width / 4 * 2;
+        outputs[2].crop.height = height / 4 * 2;
+
+        for (UINT32 bSimulcast = 0; bSimulcast < 2; bSimulcast++)
+        {
+            CSyntheticSource source(TestPattern_ColorBars, TRUE, c_cFrames);
+            CTimestampListSink primary;
+            CTimestampListSink sinks[ARRAYSIZE(outputs)];
+            CSimulcastSink simulcast(&primary);
+            CFramePipeline pipeline;
+            PipelineStats stats;
+
+            primary.Reserve(c_cFrames);
+            for (UINT32 j = 0; j < ARRAYSIZE(outputs) && bSimulcast; j++)
+            {
+                sinks[j].Reserve(c_cFrames);
+                simulcast.AddOutput(outputs[j], &sinks[j]);
+            }
+
+            pipeline.SetOutputSubtype(FOURCC_NV12);
+            pipeline.SetOverloadPolicy(OverloadPolicy_Block, 1000);
+            if (FAILED(pipeline.Start(&source, format, &simulcast)))
+            {
+                fprintf(stderr, "Failed to start pipeline.\n");
+                return -1;
+            }
+
+            // 前 1/4 的帧作为预热，之后的分配都计入稳态
+            do
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                pipeline.GetStats(&stats);
+            } while (stats.cFrames < c_cFrames / 4 && pipeline.IsRunning());
+
+            UINT64 cBefore = g_cAllocations.load();
+            pipeline.Wait();
+            UINT64 cAllocations = g_cAllocations.load() - cBefore;
+
+            pipeline.GetStats(&stats);
+            HRESULT hr = pipeline.Stop();
+            fFps[bSimulcast] = stats.fFps;
+
+            if (!bSimulcast)
+            {
+                continue;
+            }
+
+            printf("%-22s %12s %12s %12s\n", "simulcast", "output", "frames", "scale");
+            printf("%-22s %12s %12llu\n", "primary", "", (unsigned long long)primary.Timestamps().size());
+
+            for (UINT32 j = 0; j < simulcast.GetOutputCount(); j++)
+            {
+                SimulcastOutputStats output;
+                char szOutput[32];
+
+                simulcast.GetOutputStats(j, &output);
+                snprintf(szOutput, sizeof(szOutput), "%ux%u", output.width, output.height);
+                printf("%-22s %12s %12llu %9.1f us\n", j == 2 ? "crop 1/2" : (outputs[j].filter == ScaleFilter_Box ?
+                    "box 480p" : "bilinear 480p"), szOutput, (unsigned long long)output.cFrames, output.fAvgScaleUs);
+
+                bPassed = bPassed && sinks[j].Timestamps() == primary.Timestamps() && output.cFrames == c_cFrames;
+            }
+
+            bPassed = bPassed && SUCCEEDED(hr) && primary.Timestamps().size() == c_cFrames && cAllocations == 0;
+
+            printf("%-22s %.0f -> %.0f fps, %llu allocations after warm-up  %s\n", "pipeline", fFps[0], fFps[1],
+                (unsigned long long)cAllocations, bPassed ? "ok" : "FAILED");
+
+            if (!bPassed)
+            {
+                fprintf(stderr, "FAILED: simulcast outputs differ from the primary frames.\n");
+                cFailed++;
+            }
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// CPublishTimerSink 类把帧原样转交给下游接收器，并累计 WriteFrame 的耗时，用于测量帧总线发布一帧的开销
+class CPublishTimerSink : public IFrameSink
+{
+public:
+    explicit CPublishTimerSink(IFrameSink* pSink) : m_pSink(pSink), m_cFrames(0), m_llTime(0) {}
+
+    HRESULT BeginWriting(const VideoFormat& format)
+    {
+        m_cFrames = 0;
+        m_llTime = 0;
+        return m_pSink->BeginWriting(format);
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        LONGLONG llStart = GetClockTime();
+        HRESULT hr = m_pSink->WriteFrame(frame);
+
+        m_llTime += GetClockTime() - llStart;
+        m_cFrames++;
+        return hr;
+    }
+
+    HRESULT Finalize()
+    {
+        return m_pSink->Finalize();
+    }
+
+    // 每帧 WriteFrame 的平均耗时（微秒）
+    double  AverageUs() const { return m_cFrames ? m_llTime / 10.0 / m_cFrames : 0; }
+
+private:
+    IFrameSink* m_pSink;        // 下游接收器
+    UINT64      m_cFrames;      // 已转交的帧数
+    LONGLONG    m_llTime;       // WriteFrame 的累计耗时（100 纳秒）
+};
+
+// --bus-check 的数据源帧率和帧数，以及慢订阅者每帧的耗时（约为数据源的 4 倍）
+static const UINT32 c_busCheckFps = 200;
+static const UINT64 c_busCheckFrames = 300;
+static const UINT32 c_busCheckSlowDelayUs = 20000;
+
+// 检查帧总线：订阅者数从 1 增加到 MAX_BUS_SUBSCRIBERS 时，发布一帧的耗时与拷贝一帧对比、每个订阅者分摊的耗时基本不变，
+// 每个订阅者都收到全部帧且时间戳相同，稳态下没有堆分配；再让一个订阅者比数据源慢，
+// 检查其余订阅者和流水线都不丢帧，慢订阅者写出与丢弃的帧数之和等于总帧数，模拟 GOP 时它写出的非关键帧都能解码
+static int RunBusCheck(UINT32 width, UINT32 height)
+{
+    VideoFormat format = { FOURCC_NV12, width, height, c_busCheckFps, 1 };
+    UINT32 cFailed = 0;
+
+    // 拷贝一帧的耗时，作为逐个订阅者拷贝时每个订阅者的代价
+    double fCopyUs = 0;
+    {
+        std::vector<BYTE> src(GetFrameSize(format), 0x80);
+        std::vector<BYTE> dst(src.size());
+        LONGLONG llStart = GetClockTime();
+
+        for (UINT32 i = 0; i < c_convertIterations; i++)
+        {
+            memcpy(dst.data(), src.data(), src.size());
+        }
+
+        fCopyUs = (GetClockTime() - llStart) / 10.0 / c_convertIterations;
+    }
+
+    printf("%-22s %12s %12s %12s %12s\n", "subscribers", "publish", "per sub", "copy/sub", "fps");
+
+    for (UINT32 cSubscribers = 1; cSubscribers <= MAX_BUS_SUBSCRIBERS; cSubscribers *= 2)
+    {
+        CSyntheticSource source(TestPattern_ColorBars, FALSE, c_busCheckFrames);
+        CTimestampListSink sinks[MAX_BUS_SUBSCRIBERS];
+        CFrameBus bus;
+        CPublishTimerSink timer(&bus);
+        CFramePipeline pipeline;
+        PipelineStats stats;
+        BOOL bPassed = TRUE;
+
+        for (UINT32 i = 0; i < cSubscribers; i++)
+        {
+            char szName[16];
+
+            snprintf(szName, sizeof(szName), "sub%u", i);
+            sinks[i].Reserve(c_busCheckFrames);
+            bus.Subscribe(szName, &sinks[i], DEFAULT_SUBSCRIBER_DEPTH * 2, OverloadPolicy_DropOldest);
+        }
+
+        pipeline.SetSinkBuffers(bus.GetBufferDemand());
+        pipeline.SetOverloadPolicy(OverloadPolicy_Block, 1000);
+        if (FAILED(pipeline.Start(&source, format, &timer)))
+        {
+            fprintf(stderr, "Failed to start pipeline.\n");
+            return -1;
+        }
+
+        // 前 1/4 的帧作为预热，之后的分配都计入稳态
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pipeline.GetStats(&stats);
+        } while (stats.cFrames < c_busCheckFrames / 4 && pipeline.IsRunning());
+
+        UINT64 cBefore = g_cAllocations.load();
+        pipeline.Wait();
+        UINT64 cAllocations = g_cAllocations.load() - cBefore;
+
+        pipeline.GetStats(&stats);
+        HRESULT hr = pipeline.Stop();
+
+        for (UINT32 i = 0; i < cSubscribers; i++)
+        {
+            SubscriberStats subscriber;
+
+            bus.GetSubscriberStats(i, &subscriber);
+            bPassed = bPassed && sinks[i].Timestamps().size() == c_busCheckFrames &&
+                sinks[i].Timestamps() == sinks[0].Timestamps() && subscriber.cDropped == 0;
+        }
+
+        bPassed = bPassed && SUCCEEDED(hr) && stats.cOverflows == 0 && cAllocations == 0;
+
+        char szSubscribers[16];
+        snprintf(szSubscribers, sizeof(szSubscribers), "%u", cSubscribers);
+        printf("%-22s %9.2f us %9.2f us %9.1f us %12.0f  %s\n", szSubscribers, timer.AverageUs(),
+            timer.AverageUs() / cSubscribers, fCopyUs, stats.fFps, bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: %u subscribers did not all receive every frame without allocations "
+                "(%llu allocations after warm-up).\n", cSubscribers, (unsigned long long)cAllocations);
+            cFailed++;
+        }
+    }
+
+    // 一个慢订阅者：文件和分析订阅者照常写出，慢订阅者只在自己深度为 2 的队列上丢帧
+    for (UINT32 cGop = 0; cGop <= 30; cGop += 30)
+    {
+        CSyntheticSource source(TestPattern_ColorBars, FALSE, c_busCheckFrames);
+        CTimestampListSink file;
+        CTimestampListSink analyzer;
+        CSlowCheckSink network(c_busCheckSlowDelayUs);
+        CFrameBus bus;
+        CFramePipeline pipeline;
+        PipelineStats stats;
+        SubscriberStats slow;
+        DropStats drops;
+
+        file.Reserve(c_busCheckFrames);
+        analyzer.Reserve(c_busCheckFrames);
+        source.SetGopLength(cGop);
+        bus.Subscribe("file", &file, DEFAULT_QUEUE_DEPTH, OverloadPolicy_DropNewest);
+        bus.Subscribe("analyzer", &analyzer, DEFAULT_QUEUE_DEPTH);
+        bus.Subscribe("network", &network, 2, OverloadPolicy_DropOldest);
+
+        pipeline.SetSinkBuffers(bus.GetBufferDemand());
+        if (FAILED(pipeline.Start(&source, format, &bus)))
+        {
+            fprintf(stderr, "Failed to start pipeline.\n");
+            return -1;
+        }
+
+        pipeline.Wait();
+        pipeline.GetStats(&stats);
+        HRESULT hr = pipeline.Stop();
+
+        bus.GetSubscriberStats(2, &slow);
+        bus.GetDropStats(2, &drops);
+
+        BOOL bPassed = SUCCEEDED(hr) && stats.cOverflows == 0 && file.Timestamps().size() == c_busCheckFrames &&
+            analyzer.Timestamps() == file.Timestamps() && slow.cDropped > 0 &&
+            slow.cFrames + slow.cDropped == c_busCheckFrames && network.FramesWritten() == slow.cFrames &&
+            network.Errors() == 0 && (cGop != 0 || drops.cDrops[DropReason_Dependent] == 0);
+
+        printf("%-22s %12s %12s %12s %12s\n", cGop ? "slow subscriber, gop" : "slow subscriber", "written",
+            "evicted", "dependent", "latency");
+
+        for (UINT32 i = 0; i < bus.GetSubscriberCount(); i++)
+        {
+            SubscriberStats subscriber;
+            DropStats subscriberDrops;
+
+            bus.GetSubscriberStats(i, &subscriber);
+            bus.GetDropStats(i, &subscriberDrops);
+            printf("%-22s %12llu %12llu %12llu %9.2f ms\n", bus.GetSubscriberName(i),
+                (unsigned long long)subscriber.cFrames, (unsigned long long)subscriberDrops.cDrops[DropReason_Evicted],
+                (unsigned long long)subscriberDrops.cDrops[DropReason_Dependent], subscriber.fAvgLatencyMs);
+        }
+
+        printf("%-22s %llu frames, %llu dropped  %s\n", "pipeline", (unsigned long long)stats.cFrames,
+            (unsigned long long)stats.cOverflows, bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: a slow subscriber affected the others or lost count of its frames.\n");
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// --shm-check 的帧数和帧率，以及慢读取方每帧的处理耗时（约为帧间隔的 3 倍）
+static const UINT64 c_shmCheckFrames = 240;
+static const UINT32 c_shmCheckFps = 120;
+static const UINT32 c_shmCheckSlowWorkUs = 25000;
+
+// --shm-read 子进程：打开帧环后输出 ready，逐帧检查数据（写入方用帧序号的低 8 位填满整帧）并记录跨进程延迟，
+// 写入方结束后输出一行：帧数 跳过数 被覆盖数 数据错误数 延迟的中位数 99 分位 最大值（微秒）
+static int RunShmReader(const char* pszName, UINT32 workUs)
+{
+    CShmRingReader reader;
+    CLatencyHistogram latency;
+    HRESULT hr = S_OK;
+    LONGLONG llDeadline = GetClockTime() + 2 * HNS_PER_SECOND;
+    UINT64 cCorrupted = 0;
+
+    do
+    {
+        hr = reader.Open(pszName);
+        if (FAILED(hr))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    } while (FAILED(hr) && GetClockTime() < llDeadline);
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to open frame ring %s (0x%08X).\n", pszName, (unsigned)hr);
+        return 1;
+    }
+
+    printf("ready\n");
+    fflush(stdout);
+
+    for (;;)
+    {
+        ShmFrame frame;
+
+        hr = reader.AcquireFrame(&frame, 2000, 50);
+
+        if (hr != S_OK)
+        {
+            break;
+        }
+
+        LONGLONG llLatency = GetClockTime() - frame.llPublish;
+        BYTE expected = (BYTE)frame.nSequence;
+        BOOL bIntact = frame.cbData > 0 && frame.pData[0] == expected && frame.pData[frame.cbData / 2] == expected &&
+            frame.pData[frame.cbData - 1] == expected;
+
+        if (workUs)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(workUs));
+        }
+
+        // 处理期间没有被覆盖的帧必须完整
+        if (reader.ReleaseFrame(frame) == S_OK)
+        {
+            cCorrupted += bIntact ? 0 : 1;
+            latency.Record((UINT64)(llLatency > 0 ? llLatency : 0) * 100);
+        }
+    }
+
+    LatencySummary summary;
+    latency.GetSummary(&summary);
+
+    printf("%llu %llu %llu %llu %.1f %.1f %.1f\n", (unsigned long long)reader.GetFrameCount(),
+        (unsigned long long)reader.GetSkippedCount(), (unsigned long long)reader.GetTornCount(),
+        (unsigned long long)cCorrupted, summary.fP50Us, summary.fP99Us, summary.fMaxUs);
+    return hr == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF) ? 0 : 1;
+}
+
+// 在本进程写共享内存帧环，由 --shm-read 子进程读取：检查读取方读到的帧完整，
+// 跟得上的读取方不跳帧，慢的读取方跳到最新的帧而写入方的耗时不受影响，并输出跨进程延迟
+static int RunShmCheck(const char* pszProgram, UINT32 width, UINT32 height)
+{
+    VideoFormat format = { FOURCC_NV12, width, height, c_shmCheckFps, 1 };
+    std::vector<BYTE> data(GetFrameSize(format));
+    UINT32 cFailed = 0;
+
+    printf("%-22s %10s %10s %10s %10s %10s %10s %10s\n", "reader", "frames", "skipped", "torn", "write", "p50",
+        "p99", "max");
+
+    for (UINT32 bSlow = 0; bSlow < 2; bSlow++)
+    {
+        char szName[32];
+        char szCommand[512];
+        char szLine[256];
+
+        snprintf(szName, sizeof(szName), "bench_%llu", (unsigned long long)GetClockTime());
+
+        CShmRingSink sink(szName);
+
+        if (FAILED(sink.BeginWriting(format)))
+        {
+            fprintf(stderr, "Failed to create frame ring %s.\n", szName);
+            return -1;
+        }
+
+        snprintf(szCommand, sizeof(szCommand), "\"%s\" --shm-read %s --shm-work-us %u", pszProgram, szName,
+            bSlow ? c_shmCheckSlowWorkUs : 0);
+
+        FILE* pReader = popen(szCommand, "r");
+
+        if (pReader == nullptr || fgets(szLine, sizeof(szLine), pReader) == nullptr || strncmp(szLine, "ready", 5) != 0)
+        {
+            fprintf(stderr, "Failed to start the reader process.\n");
+            if (pReader)
+            {
+                pclose(pReader);
+            }
+            return -1;
+        }
+
+        // 按帧率发布，记录每帧 WriteFrame 的耗时
+        LONGLONG llFrame = GetFrameDuration(format);
+        LONGLONG llNext = GetClockTime();
+        LONGLONG llWriteTime = 0;
+        LONGLONG llMaxWrite = 0;
+
+        for (UINT64 n = 0; n < c_shmCheckFrames; n++)
+        {
+            CaptureFrame frame = {};
+
+            memset(data.data(), (BYTE)n, data.size());
+            frame.pData = data.data();
+            frame.cbData = (UINT32)data.size();
+            frame.llTimestamp = (LONGLONG)n * llFrame;
+            frame.nSequence = n;
+
+            LONGLONG llStart = GetClockTime();
+            sink.WriteFrame(frame);
+            LONGLONG llWrite = GetClockTime() - llStart;
+
+            llWriteTime += llWrite;
+            llMaxWrite = llWrite > llMaxWrite ? llWrite : llMaxWrite;
+
+            llNext += llFrame;
+            LONGLONG llWait = llNext - GetClockTime();
+            if (llWait > 0)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(llWait / 10));
+            }
+        }
+
+        sink.Finalize();
+
+        unsigned long long cFrames = 0, cSkipped = 0, cTorn = 0, cCorrupted = 0;
+        double fP50 = 0, fP99 = 0, fMax = 0;
+        BOOL bParsed = fgets(szLine, sizeof(szLine), pReader) != nullptr &&
+            sscanf(szLine, "%llu %llu %llu %llu %lf %lf %lf", &cFrames, &cSkipped, &cTorn, &cCorrupted, &fP50, &fP99,
+                &fMax) == 7;
+        int exitCode = pclose(pReader);
+
+        // 子进程在发布开始前已经打开帧环，每一帧要么读到要么被跳过
+        BOOL bPassed = bParsed && exitCode == 0 && cCorrupted == 0 && cFrames + cSkipped == c_shmCheckFrames &&
+            (bSlow ? cSkipped > 0 : cSkipped == 0);
+
+        printf("%-22s %10llu %10llu %10llu %7.1f us %7.0f us %7.0f us %7.0f us  %s\n", bSlow ? "slow" : "fast",
+            cFrames, cSkipped, cTorn, llWriteTime / 10.0 / c_shmCheckFrames, fP50, fP99, fMax, bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: the %s reader lost track of frames or read a torn frame (max write %.1f us).\n",
+                bSlow ? "slow" : "fast", llMaxWrite / 10.0);
+            cFailed++;
+        }
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+// --stream-check 的帧数和帧率，发送前缩放到的高度，以及慢观看端每帧的处理耗时（约为帧间隔的 4 倍）
+static const UINT64 c_streamCheckFrames = 180;
+static const UINT32 c_streamCheckFps = 60;
+static const UINT32 c_streamCheckHeight = 480;
+static const UINT32 c_streamCheckSlowWorkUs = 66000;
+
+// CStreamTestClient 类是 --stream-check 的回环观看端：发出 GET 请求后逐部分读取，检查每帧的部分头、BMP 头和长度，
+// 记录从进入流水线到收完一帧的延迟；workUs 为每帧之后的额外处理耗时，模拟跟不上的观看端
+class CStreamTestClient
+{
+public:
+    explicit CStreamTestClient(UINT32 workUs) :
+        m_workUs(workUs), m_socket(c_invalidTestSocket), m_cFrames(0), m_cCorrupted(0), m_nFirst(0), m_nLast(0)
+    {
+    }
+
+    ~CStreamTestClient()
+    {
+        if (m_socket != c_invalidTestSocket)
+        {
+            CloseTestSocket(m_socket);
+        }
+    }
+
+    // 连接本机的 port 端口并发出请求；cbReceiveBuffer 不为 0 时限制接收缓冲区，让慢观看端尽快积压
+    BOOL    Connect(WORD port, int cbReceiveBuffer)
+    {
+        sockaddr_in address = sockaddr_in();
+
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (m_socket == c_invalidTestSocket)
+        {
+            return FALSE;
+        }
+        if (cbReceiveBuffer)
+        {
+            setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, (const char*)&cbReceiveBuffer, sizeof(cbReceiveBuffer));
+        }
+
+        static const char c_request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+        return connect(m_socket, (const sockaddr*)&address, sizeof(address)) == 0 &&
+            send(m_socket, c_request, (int)(sizeof(c_request) - 1), 0) == (int)(sizeof(c_request) - 1);
+    }
+
+    // 读取响应和所有帧，直到服务端关闭连接
+    void    Run(UINT32 width, UINT32 height)
+    {
+        std::string header;
+        std::vector<BYTE> body;
+
+        if (!ReadHeader(&header) || header.compare(0, 12, "HTTP/1.0 200") != 0 ||
+            header.find("multipart/x-mixed-replace; boundary=frame") == std::string::npos)
+        {
+            m_cCorrupted++;
+            return;
+        }
+
+        while (ReadHeader(&header))
+        {
+            size_t cbBody = (size_t)GetHeaderValue(header, "Content-Length:");
+            UINT64 nSequence = GetHeaderValue(header, "X-Sequence:");
+            LONGLONG llArrival = (LONGLONG)GetHeaderValue(header, "X-Arrival:");
+
+            if (!ReadBody(cbBody + 2, &body))
+            {
+                break;
+            }
+
+            LONGLONG llLatency = GetClockTime() - llArrival;
+
+            // 自上而下的 32 位 BMP，帧序号必须递增，部分以换行结尾
+            BOOL bIntact = header.compare(0, 9, "--frame\r\n") == 0 && cbBody == 54 + (size_t)width * height * 4 &&
+                body[0] == 'B' && body[1] == 'M' && ReadUInt32(&body[18]) == width &&
+                ReadUInt32(&body[22]) == (UINT32)(-(INT32)height) && body[28] == 32 &&
+                body[cbBody] == '\r' && body[cbBody + 1] == '\n' && (m_cFrames == 0 || nSequence > m_nLast);
+
+            m_cCorrupted += bIntact ? 0 : 1;
+            m_nFirst = m_cFrames ? m_nFirst : nSequence;
+            m_nLast = nSequence;
+            m_cFrames++;
+            m_latency.Record((UINT64)(llLatency > 0 ? llLatency : 0) * 100);
+
+            if (m_workUs)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(m_workUs));
+            }
+        }
+    }
+
+    UINT64  Frames() const { return m_cFrames; }
+    UINT64  Corrupted() const { return m_cCorrupted; }
+    UINT64  LastSequence() const { return m_nLast; }
+
+    // 第一帧到最后一帧之间没有收到的帧数
+    UINT64  Missed() const { return m_cFrames ? m_nLast - m_nFirst + 1 - m_cFrames : 0; }
+
+    void    GetLatency(LatencySummary* pSummary) const { m_latency.GetSummary(pSummary); }
+
+private:
+#ifdef _WIN32
+    typedef SOCKET TestSocket;
+    static const TestSocket c_invalidTestSocket = INVALID_SOCKET;
+    static void CloseTestSocket(TestSocket s) { closesocket(s); }
+#else
+    typedef int TestSocket;
+    static const TestSocket c_invalidTestSocket = -1;
+    static void CloseTestSocket(TestSocket s) { close(s); }
+#endif
+
+    static UINT32 ReadUInt32(const BYTE* p)
+    {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT32)p[3] << 24);
+    }
+
+    static UINT64 GetHeaderValue(const std::string& header, const char* pszName)
+    {
+        size_t pos = header.find(pszName);
+
+        return (pos == std::string::npos) ? 0 : strtoull(header.c_str() + pos + strlen(pszName), nullptr, 10);
+    }
+
+    // 再接收一块数据，连接关闭时返回 FALSE
+    BOOL    Receive()
+    {
+        char buffer[65536];
+        int cb = (int)recv(m_socket, buffer, sizeof(buffer), 0);
+
+        if (cb <= 0)
+        {
+            return FALSE;
+        }
+
+        m_pending.append(buffer, (size_t)cb);
+        return TRUE;
+    }
+
+    // 读到空行为止，返回不含空行的头部
+    BOOL    ReadHeader(std::string* pHeader)
+    {
+        size_t pos;
+
+        while ((pos = m_pending.find("\r\n\r\n")) == std::string::npos)
+        {
+            if (!Receive())
+            {
+                return FALSE;
+            }
+        }
+
+        pHeader->assign(m_pending, 0, pos + 2);
+        m_pending.erase(0, pos + 4);
+        return TRUE;
+    }
+
+    // 读取 cb 字节
+    BOOL    ReadBody(size_t cb, std::vector<BYTE>* pBody)
+    {
+        while (m_pending.size() < cb)
+        {
+            if (!Receive())
+            {
+                return FALSE;
+            }
+        }
+
+        pBody->assign(m_pending.begin(), m_pending.begin() + cb);
+        m_pending.erase(0, cb);
+        return TRUE;
+    }
+
+    UINT32              m_workUs;       // 每帧的额外处理耗时
+    TestSocket          m_socket;       // 连接
+    std::string         m_pending;      // 已接收、尚未解析的数据
+    UINT64              m_cFrames;      // 收到的帧数
+    UINT64              m_cCorrupted;   // 格式不对的帧数
+    UINT64              m_nFirst;       // 第一帧的序号
+    UINT64              m_nLast;        // 最后一帧的序号
+    CLatencyHistogram   m_latency;      // 从进入流水线到收完一帧的延迟
+};
+
+// 在本进程运行网络发送，一个跟得上和一个跟不上的观看端同时通过回环地址接收：检查每帧完整、序号递增，
+// 跟得上的观看端不丢帧，慢观看端只在自己的队列上丢弃旧帧而不影响另一个观看端和 WriteFrame 的耗时，
+// 并输出从进入流水线到交给套接字（发送端）和到收完一帧（观看端）的延迟
+static int RunStreamCheck(UINT32 width, UINT32 height)
+{
+    VideoFormat format = { FOURCC_NV12, width, height, c_streamCheckFps, 1 };
+    std::vector<BYTE> data(GetFrameSize(format), 0x80);
+    StreamParams params = StreamParams();
+
+    params.scale.height = c_streamCheckHeight;
+
+    CNetStreamSink sink(params);
+    CStreamTestClient fast(0);
+    CStreamTestClient slow(c_streamCheckSlowWorkUs);
+
+    if (FAILED(sink.BeginWriting(format)))
+    {
+        fprintf(stderr, "Failed to start the stream sink.\n");
+        return -1;
+    }
+
+    const VideoFormat& output = sink.GetOutputFormat();
+
+    if (!fast.Connect(sink.GetPort(), 0) || !slow.Connect(sink.GetPort(), 64 * 1024))
+    {
+        fprintf(stderr, "Failed to connect to port %u.\n", sink.GetPort());
+        return -1;
+    }
+
+    std::thread fastThread(&CStreamTestClient::Run, &fast, output.width, output.height);
+    std::thread slowThread(&CStreamTestClient::Run, &slow, output.width, output.height);
+
+    // 等两个观看端的请求都被事件循环处理，之后发出的每一帧都会交给它们
+    StreamStats stats;
+    LONGLONG llDeadline = GetClockTime() + 2 * HNS_PER_SECOND;
+
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        sink.GetStats(&stats);
+    } while (stats.cViewers < 2 && GetClockTime() < llDeadline);
+
+    // 按帧率写入，记录每帧 WriteFrame 的耗时
+    LONGLONG llFrame = GetFrameDuration(format);
+    LONGLONG llNext = GetClockTime();
+    LONGLONG llWriteTime = 0;
+
+    for (UINT64 n = 0; n < c_streamCheckFrames; n++)
+    {
+        CaptureFrame frame = {};
+
+        frame.pData = data.data();
+        frame.cbData = (UINT32)data.size();
+        frame.llTimestamp = (LONGLONG)n * llFrame;
+        frame.nSequence = n;
+        frame.llArrival = GetClockTime();
+
+        sink.WriteFrame(frame);
+        llWriteTime += GetClockTime() - frame.llArrival;
+
+        llNext += llFrame;
+        LONGLONG llWait = llNext - GetClockTime();
+        if (llWait > 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(llWait / 10));
+        }
+    }
+
+    // 等跟得上的观看端收完最后一帧再断开
+    llDeadline = GetClockTime() + 2 * HNS_PER_SECOND;
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        sink.GetStats(&stats);
+    } while (stats.cSent + stats.cDropped < 2 * stats.cEncoded && GetClockTime() < llDeadline);
+
+    sink.GetStats(&stats);
+    sink.Finalize();
+    fastThread.join();
+    slowThread.join();
+
+    LatencySummary fastLatency;
+    LatencySummary slowLatency;
+
+    fast.GetLatency(&fastLatency);
+    slow.GetLatency(&slowLatency);
+
+    printf("%-22s %10s %10s %10s %12s %12s\n", "viewer", "frames", "missed", "corrupted", "p50", "p99");
+    printf("%-22s %10llu %10llu %10llu %9.0f us %9.0f us\n", "fast", (unsigned long long)fast.Frames(),
+        (unsigned long long)fast.Missed(), (unsigned long long)fast.Corrupted(), fastLatency.fP50Us, fastLatency.fP99Us);
+    printf("%-22s %10llu %10llu %10llu %9.0f us %9.0f us\n", "slow", (unsigned long long)slow.Frames(),
+        (unsigned long long)slow.Missed(), (unsigned long long)slow.Corrupted(), slowLatency.fP50Us, slowLatency.fP99Us);
+    printf("%-22s %10llu %10llu %10llu %9.0f us %9.0f us\n", "sink (to socket)", (unsigned long long)stats.cSent,
+        (unsigned long long)stats.cDropped, (unsigned long long)stats.cSkipped, stats.latency.fP50Us,
+        stats.latency.fP99Us);
+    printf("%ux%u bmp, %.2f send calls per frame, write %.1f us per frame\n", output.width, output.height,
+        stats.cSent ? (double)stats.cSendCalls / stats.cSent : 0.0, llWriteTime / 10.0 / c_streamCheckFrames);
+
+    // 单核的构建机上编码线程偶尔来不及被调度，允许跟得上的观看端少收 5% 的帧
+    BOOL bFast = fast.Corrupted() == 0 && fast.Frames() >= c_streamCheckFrames * 95 / 100 &&
+        fast.LastSequence() == c_streamCheckFrames - 1;
+    BOOL bSlow = slow.Corrupted() == 0 && slow.Frames() > 0 && slow.Missed() > 0 && stats.cDropped > 0;
+
+    printf("%-22s %s\n", "fast viewer", bFast ? "ok" : "FAILED");
+    printf("%-22s %s\n", "slow viewer", bSlow ? "ok" : "FAILED");
+
+    if (!bFast || !bSlow)
+    {
+        fprintf(stderr, "FAILED: a viewer received a corrupted frame, or the slow viewer held back the fast one.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+// 软件 JPEG 编码检查的质量、MKV 检查写入的帧数和测速时每个组合编码的帧数
+static const UINT32 c_jpegCheckQuality = 85;
+static const UINT32 c_jpegCheckFrames = 10;
+static const UINT32 c_jpegBenchFrames = 60;
+
+// 用合成数据源生成第 n 帧（彩条图案随帧滚动）
+static HRESULT RenderSyntheticFrame(const VideoFormat& format, UINT64 n, std::vector<BYTE>* pFrame)
+{
+    CSyntheticSource source(TestPattern_ColorBars, TRUE, n + 1);
+    VideoFormat actual;
+    CaptureFrame frame;
+
+    pFrame->resize(GetFrameSize(format));
+
+    HRESULT hr = source.Open();
+    if (SUCCEEDED(hr))
+    {
+        hr = source.NegotiateFormat(format, &actual);
+    }
+    for (UINT64 i = 0; i <= n && SUCCEEDED(hr); i++)
+    {
+        hr = source.ReadFrameInto(pFrame->data(), (UINT32)pFrame->size(), &frame);
+    }
+
+    source.Close();
+    return hr;
+}
+
+// 检查 JPEG 码流的结构：SOI 开头、EOI 结尾，多于一个切片时有 DRI，
+// 熵编码数据中除填充的 0xFF00 外只有依次为 RST0-RST7 循环的重启标记，个数为切片数减一
+static BOOL CheckJpegStructure(const BYTE* pData, UINT32 cbData, UINT32 cSlices)
+{
+    if (cbData < 4 || pData[0] != 0xFF || pData[1] != 0xD8 || pData[cbData - 2] != 0xFF || pData[cbData - 1] != 0xD9)
+    {
+        return FALSE;
+    }
+
+    UINT32 i = 2;
+    BOOL bRestartInterval = FALSE;
+    BOOL bScan = FALSE;
+
+    while (!bScan && i + 4 <= cbData)
+    {
+        BYTE marker = pData[i + 1];
+        UINT32 cbSegment = ((UINT32)pData[i + 2] << 8) | pData[i + 3];
+
+        if (pData[i] != 0xFF)
+        {
+            return FALSE;
+        }
+
+        bRestartInterval |= (marker == 0xDD);
+        bScan = (marker == 0xDA);
+        i += 2 + cbSegment;
+    }
+
+    UINT32 cRestarts = 0;
+
+    for (; bScan && i + 2 < cbData; i++)
+    {
+        if (pData[i] != 0xFF)
+        {
+            continue;
+        }
+
+        BYTE marker = pData[++i];
+        if (marker != 0x00)
+        {
+            if (marker != 0xD0 + (cRestarts & 7))
+            {
+                return FALSE;
+            }
+            cRestarts++;
+        }
+    }
+
+    return bScan && cRestarts + 1 == cSlices && bRestartInterval == (cSlices > 1);
+}
+
+// 读取一个 EBML 变长整数（bId 为 TRUE 时保留长度标记，即元素 ID 的写法），失败返回 FALSE
+static BOOL ReadEbmlNumber(const std::vector<BYTE>& data, size_t* pOffset, BOOL bId, UINT64* pValue)
+{
+    if (*pOffset >= data.size() || data[*pOffset] == 0)
+    {
+        return FALSE;
+    }
+
+    BYTE first = data[*pOffset];
+    UINT32 cb = 1;
+
+    while (!(first & (0x80 >> (cb - 1))))
+    {
+        cb++;
+    }
+    if (*pOffset + cb > data.size())
+    {
+        return FALSE;
+    }
+
+    UINT64 value = bId ? first : (first & (0xFF >> cb));
+    for (UINT32 i = 1; i < cb; i++)
+    {
+        value = (value << 8) | data[*pOffset + i];
+    }
+
+    *pOffset += cb;
+    *pValue = value;
+    return TRUE;
+}
+
+// 检查 CMjpegFileSink 写出的文件：EBML 头之后是大小未知的 Segment，其中每帧一个 Cluster，
+// Cluster 的时间码递增，SimpleBlock 为轨道 1 的关键帧且内容是完整的 JPEG；返回 Cluster 数，结构错误时返回 -1
+static int CountMatroskaFrames(const std::vector<BYTE>& data)
+{
+    size_t offset = 0;
+    UINT64 id = 0;
+    UINT64 cbSize = 0;
+
+    if (!ReadEbmlNumber(data, &offset, TRUE, &id) || id != 0x1A45DFA3 || !ReadEbmlNumber(data, &offset, FALSE, &cbSize))
+    {
+        return -1;
+    }
+    offset += (size_t)cbSize;
+
+    if (!ReadEbmlNumber(data, &offset, TRUE, &id) || id != 0x18538067 || !ReadEbmlNumber(data, &offset, FALSE, &cbSize) ||
+        cbSize != 0xFFFFFFFFFFFFFFull)
+    {
+        return -1;
+    }
+
+    int cClusters = 0;
+    LONGLONG lastTimecode = -1;
+
+    while (offset < data.size())
+    {
+        if (!ReadEbmlNumber(data, &offset, TRUE, &id) || !ReadEbmlNumber(data, &offset, FALSE, &cbSize) ||
+            offset + cbSize > data.size())
+        {
+            return -1;
+        }
+
+        size_t end = offset + (size_t)cbSize;
+
+        if (id != 0x1F43B675)
+        {
+            offset = end;
+            continue;
+        }
+
+        BOOL bBlock = FALSE;
+
+        while (offset < end)
+        {
+            UINT64 childId = 0;
+            UINT64 cbChild = 0;
+
+            if (!ReadEbmlNumber(data, &offset, TRUE, &childId) || !ReadEbmlNumber(data, &offset, FALSE, &cbChild) ||
+                offset + cbChild > end)
+            {
+                return -1;
+            }
+
+            const BYTE* pChild = data.data() + offset;
+
+            if (childId == 0xE7)
+            {
+                LONGLONG timecode = 0;
+                for (UINT64 i = 0; i < cbChild; i++)
+                {
+                    timecode = (timecode << 8) | pChild[i];
+                }
+                if (timecode <= lastTimecode)
+                {
+                    return -1;
+                }
+                lastTimecode = timecode;
+            }
+            else if (childId == 0xA3)
+            {
+                if (cbChild < 8 || pChild[0] != 0x81 || !(pChild[3] & 0x80) || pChild[4] != 0xFF || pChild[5] != 0xD8 ||
+                    pChild[cbChild - 2] != 0xFF || pChild[cbChild - 1] != 0xD9)
+                {
+                    return -1;
+                }
+                bBlock = TRUE;
+            }
+
+            offset += (size_t)cbChild;
+        }
+
+        if (!bBlock)
+        {
+            return -1;
+        }
+        cClusters++;
+    }
+
+    return cClusters;
+}
+
+// 软件 JPEG 编码：以单线程标量结果为参考，检查各 SIMD 级别在多线程下的输出逐字节一致，码流结构正确，
+// 不是 MCU 整数倍的尺寸、随机噪声和高质量下预留空间不足时的处理，以及 MKV 文件的结构
+static int RunJpegCheck(UINT32 width, UINT32 height)
+{
+    static const UINT32 subtypes[] = { FOURCC_NV12, FOURCC_I420 };
+
+    // 单线程与 4 线程（多于核数时由系统分时）的结果必须相同，切片的划分与线程数无关
+    CTaskPool single;
+    CTaskPool multi;
+
+    if (FAILED(single.Initialize(1)) || FAILED(multi.Initialize(4)))
+    {
+        fprintf(stderr, "Failed to start threads.\n");
+        return -1;
+    }
+
+    printf("jpeg        %ux%u, cpu %s, quality %u\n", width, height, GetCpuLevelName(GetCpuLevel()), c_jpegCheckQuality);
+    printf("%-22s %12s %12s %12s %12s\n", "", "size", "scalar", "sse2", "avx2");
+
+    UINT32 cFailed = 0;
+    const UINT32 sizes[][2] =
+    {
+        { width, height },
+        { (width / 2 + 7) & ~1u, (height / 2 + 5) & ~1u },     // 右边和下边都不是 MCU 的整数倍
+    };
+
+    for (UINT32 iSize = 0; iSize < ARRAYSIZE(sizes); iSize++)
+    {
+        for (UINT32 iSubtype = 0; iSubtype < ARRAYSIZE(subtypes); iSubtype++)
+        {
+            VideoFormat format = { subtypes[iSubtype], sizes[iSize][0], sizes[iSize][1], 30, 1 };
+            std::vector<BYTE> src;
+            CJpegEncoder reference;
+
+            if (FAILED(RenderSyntheticFrame(format, 7, &src)) ||
+                FAILED(reference.Initialize(format, c_jpegCheckQuality, DEFAULT_JPEG_SLICE_ROWS, CpuLevel_Scalar, &single)))
+            {
+                fprintf(stderr, "Unsupported size %ux%u.\n", format.width, format.height);
+                return -1;
+            }
+
+            std::vector<BYTE> expected(reference.GetMaxEncodedSize());
+            std::vector<BYTE> actual(expected.size());
+            UINT32 cbExpected = 0;
+            UINT32 cbActual = 0;
+            char szName[64];
+            char szSize[32];
+
+            snprintf(szName, sizeof(szName), "%s %ux%u", GetSubtypeName(format.subtype), format.width, format.height);
+
+            if (FAILED(reference.Encode(src.data(), expected.data(), (UINT32)expected.size(), &cbExpected)) ||
+                !CheckJpegStructure(expected.data(), cbExpected, reference.GetSliceCount()))
+            {
+                printf("%-22s %12s\n", szName, "BAD STREAM");
+                cFailed++;
+                continue;
+            }
+
+            snprintf(szSize, sizeof(szSize), "%.2f bpp", cbExpected * 8.0 / (format.width * format.height));
+            printf("%-22s %12s", szName, szSize);
+
+            for (int level = CpuLevel_Scalar; level <= CpuLevel_AVX2; level++)
+            {
+                if (level > GetCpuLevel())
+                {
+                    printf(" %12s", "-");
+                    continue;
+                }
+
+                CJpegEncoder encoder;
+
+                encoder.Initialize(format, c_jpegCheckQuality, DEFAULT_JPEG_SLICE_ROWS, (CpuLevel)level, &multi);
+                memset(actual.data(), 0, actual.size());
+
+                if (FAILED(encoder.Encode(src.data(), actual.data(), (UINT32)actual.size(), &cbActual)) ||
+                    cbActual != cbExpected || memcmp(expected.data(), actual.data(), cbActual) != 0)
+                {
+                    printf(" %12s", "MISMATCH");
+                    cFailed++;
+                    continue;
+                }
+
+                LONGLONG llStart = GetClockTime();
+                for (UINT32 k = 0; k < c_convertIterations; k++)
+                {
+                    encoder.Encode(src.data(), actual.data(), (UINT32)actual.size(), &cbActual);
+                }
+                printf(" %9.2f ms", (GetClockTime() - llStart) / 1e4 / c_convertIterations);
+            }
+            printf("\n");
+        }
+    }
+
+    // 满幅随机噪声：质量 95 时仍在预留空间内；质量 100 时可能超出，只允许返回 ERROR_INSUFFICIENT_BUFFER
+    {
+        VideoFormat format = { FOURCC_NV12, width, height, 30, 1 };
+        std::vector<BYTE> src(GetFrameSize(format));
+        UINT32 seed = 0x9E3779B9;
+
+        for (size_t k = 0; k < src.size(); k++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            src[k] = (BYTE)(seed >> 24);
+        }
+
+        CJpegEncoder high;
+        CJpegEncoder maximum;
+        UINT32 cbEncoded = 0;
+
+        high.Initialize(format, 95, DEFAULT_JPEG_SLICE_ROWS, CpuLevel_AVX2, &multi);
+        maximum.Initialize(format, 100, DEFAULT_JPEG_SLICE_ROWS, CpuLevel_AVX2, &multi);
+
+        std::vector<BYTE> dst(maximum.GetMaxEncodedSize());
+        HRESULT hrHigh = high.Encode(src.data(), dst.data(), (UINT32)dst.size(), &cbEncoded);
+        BOOL bHigh = SUCCEEDED(hrHigh) && CheckJpegStructure(dst.data(), cbEncoded, high.GetSliceCount());
+        HRESULT hrMax = maximum.Encode(src.data(), dst.data(), (UINT32)dst.size(), &cbEncoded);
+        BOOL bMax = (SUCCEEDED(hrMax) && CheckJpegStructure(dst.data(), cbEncoded, maximum.GetSliceCount())) ||
+            hrMax == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+
+        printf("%-22s %s\n", "noise q95", bHigh ? "ok" : "FAILED");
+        printf("%-22s %s\n", "noise q100", bMax ? (SUCCEEDED(hrMax) ? "ok" : "ok (overflow reported)") : "FAILED");
+        cFailed += (bHigh ? 0 : 1) + (bMax ? 0 : 1);
+    }
+
+    // MKV：按 30fps 的时间戳写入若干帧，按 EBML 结构读回
+    {
+        VideoFormat format = { FOURCC_NV12, width, height, 30, 1 };
+        std::error_code error;
+        std::filesystem::path path = std::filesystem::temp_directory_path(error) / "benchmark_jpeg_check.mkv";
+        WCHAR wszPath[MAX_SEGMENT_PATH];
+        std::vector<BYTE> src;
+        HRESULT hr = RenderSyntheticFrame(format, 0, &src);
+
+        ToWidePath(path.string().c_str(), wszPath, MAX_SEGMENT_PATH);
+
+        CMjpegFileSink sink(wszPath, c_jpegCheckQuality);
+        UINT64 cbWritten = 0;
+
+        if (SUCCEEDED(hr))
+        {
+            hr = sink.BeginWriting(format);
+        }
+        for (UINT32 i = 0; i < c_jpegCheckFrames && SUCCEEDED(hr); i++)
+        {
+            CaptureFrame frame = CaptureFrame();
+
+            frame.pData = src.data();
+            frame.cbData = (UINT32)src.size();
+            frame.llTimestamp = GetFrameDuration(format) * i;
+            frame.nSequence = i;
+            hr = sink.WriteFrame(frame);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = sink.Finalize();
+            sink.GetBytesWritten(&cbWritten);
+        }
+
+        std::vector<BYTE> data;
+        FILE* pFile = SUCCEEDED(hr) ? fopen(path.string().c_str(), "rb") : nullptr;
+
+        if (pFile)
+        {
+            // 多读一个字节，文件比统计的字节数长时也能发现
+            data.resize((size_t)cbWritten + 1);
+            data.resize(fread(data.data(), 1, data.size(), pFile));
+            fclose(pFile);
+        }
+        CDirectFile::Remove(wszPath);
+
+        BOOL bPassed = SUCCEEDED(hr) && data.size() == cbWritten &&
+            CountMatroskaFrames(data) == (int)c_jpegCheckFrames;
+
+        printf("%-22s %s\n", "mkv", bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    if (cFailed != 0)
+    {
+        fprintf(stderr, "FAILED: %u JPEG checks failed.\n", cFailed);
+        return 1;
+    }
+
+    return 0;
+}
+
+// 软件 JPEG 编码的帧率随线程数的扩展：1080p 和 4K 的 NV12 彩条画面，线程数从 1 倍增到 cMaxThreads
+// （0 表示逻辑核数），另有一行单线程标量作为 SIMD 的对照；加速比以同一分辨率的单线程 SIMD 为基准
+static int RunJpegBenchmark(UINT32 cMaxThreads)
+{
+    static const UINT32 sizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+    static const UINT32 c_cDistinctFrames = 4;
+
+    if (cMaxThreads == 0)
+    {
+        cMaxThreads = std::thread::hardware_concurrency();
+        cMaxThreads = cMaxThreads ? cMaxThreads : 1;
+    }
+
+    printf("jpeg bench  cpu %s, quality %u, %u MCU rows per slice, %u logical cores\n", GetCpuLevelName(GetCpuLevel()),
+        DEFAULT_JPEG_QUALITY, DEFAULT_JPEG_SLICE_ROWS, std::thread::hardware_concurrency());
+    printf("%-22s %8s %8s %10s %10s %10s\n", "", "threads", "slices", "ms/frame", "fps", "speedup");
+
+    for (UINT32 iSize = 0; iSize < ARRAYSIZE(sizes); iSize++)
+    {
+        VideoFormat format = { FOURCC_NV12, sizes[iSize][0], sizes[iSize][1], 30, 1 };
+        std::vector<BYTE> frames[c_cDistinctFrames];
+        char szName[32];
+
+        // 几帧不同的画面轮流编码，避免只测到缓存中的同一帧
+        for (UINT32 i = 0; i < c_cDistinctFrames; i++)
+        {
+            if (FAILED(RenderSyntheticFrame(format, i * 8, &frames[i])))
+            {
+                fprintf(stderr, "Failed to render %ux%u.\n", format.width, format.height);
+                return -1;
+            }
+        }
+
+        // 0 表示单线程标量的对照行，之后为 1、2、4 ... 个线程，最后一行总是 cMaxThreads
+        std::vector<UINT32> threadCounts(1, 0);
+        for (UINT32 cThreads = 1; cThreads < cMaxThreads; cThreads *= 2)
+        {
+            threadCounts.push_back(cThreads);
+        }
+        threadCounts.push_back(cMaxThreads);
+
+        double fBaseFps = 0;
+
+        for (size_t iThreads = 0; iThreads < threadCounts.size(); iThreads++)
+        {
+            UINT32 cThreads = threadCounts[iThreads];
+            CTaskPool pool;
+            CJpegEncoder encoder;
+            CpuLevel level = (cThreads == 0) ? CpuLevel_Scalar : CpuLevel_AVX2;
+
+            if (FAILED(pool.Initialize(cThreads ? cThreads : 1)) ||
+                FAILED(encoder.Initialize(format, DEFAULT_JPEG_QUALITY, DEFAULT_JPEG_SLICE_ROWS, level, &pool)))
+            {
+                fprintf(stderr, "Failed to start the encoder with %u threads.\n", cThreads);
+                return -1;
+            }
+
+            std::vector<BYTE> dst(encoder.GetMaxEncodedSize());
+            UINT64 cbTotal = 0;
+            UINT32 cbEncoded = 0;
+
+            // 先编码一帧预热线程和缓存
+            encoder.Encode(frames[0].data(), dst.data(), (UINT32)dst.size(), &cbEncoded);
+
+            LONGLONG llStart = GetClockTime();
+            for (UINT32 i = 0; i < c_jpegBenchFrames; i++)
+            {
+                if (FAILED(encoder.Encode(frames[i % c_cDistinctFrames].data(), dst.data(), (UINT32)dst.size(), &cbEncoded)))
+                {
+                    fprintf(stderr, "FAILED: encoding %ux%u.\n", format.width, format.height);
+                    return 1;
+                }
+                cbTotal += cbEncoded;
+            }
+            double fSeconds = (GetClockTime() - llStart) / (double)HNS_PER_SECOND;
+            double fFps = c_jpegBenchFrames / fSeconds;
+
+            if (cThreads == 1)
+            {
+                fBaseFps = fFps;
+            }
+
+            snprintf(szName, sizeof(szName), "%ux%u %s", format.width, format.height,
+                GetCpuLevelName(encoder.GetCpuLevel()));
+            printf("%-22s %8u %8u %10.2f %10.1f", szName, pool.ThreadCount(), encoder.GetSliceCount(),
+                fSeconds * 1000 / c_jpegBenchFrames, fFps);
+            if (cThreads > 0)
+            {
+                printf(" %9.2fx", fFps / fBaseFps);
+            }
+            else
+            {
+                printf(" %10s", "-");
+            }
+            printf("   %.2f bpp\n", cbTotal * 8.0 / c_jpegBenchFrames / (format.width * format.height));
+        }
+    }
+
+    return 0;
+}
+
+// --async-check 的块大小、缓冲池的块数、同时在写的请求数和写入的块数
+static const UINT32 c_asyncCheckBlock = 256 * 1024;
+static const UINT32 c_asyncCheckBlocks = 6;
+static const UINT32 c_asyncCheckDepth = 4;
+static const UINT32 c_asyncCheckWrites = 64;
+
+// 在块中填入由块号决定的内容，用于读回时检查
+static void FillAsyncCheckBlock(BYTE* pData, UINT32 cbData, UINT32 index)
+{
+    for (UINT32 i = 0; i + 4 <= cbData; i += 4)
+    {
+        UINT32 value = index * 2654435761u + i;
+        memcpy(pData + i, &value, 4);
+    }
+}
+
+// 读回 --async-check 写入的文件，检查长度和每块的内容
+static BOOL VerifyAsyncCheckFile(const char* pszPath)
+{
+    FILE* pFile = fopen(pszPath, "rb");
+    std::vector<BYTE> expected(c_asyncCheckBlock);
+    std::vector<BYTE> actual(c_asyncCheckBlock);
+    BOOL bOk = (pFile != nullptr);
+
+    for (UINT32 i = 0; i < c_asyncCheckWrites && bOk; i++)
+    {
+        FillAsyncCheckBlock(expected.data(), c_asyncCheckBlock, i);
+        bOk = fread(actual.data(), 1, c_asyncCheckBlock, pFile) == c_asyncCheckBlock && actual == expected;
+    }
+
+    if (pFile)
+    {
+        bOk = bOk && fgetc(pFile) == EOF;
+        fclose(pFile);
+    }
+    return bOk;
+}
+
+// 分别用写入线程和 io_uring（可用时），以直接 I/O 和缓冲写入两种方式，从块缓冲池取块、按打乱的偏移提交
+// （在写的请求数小于块数，缓冲池和深度都会用满），读回检查每块内容；检查写完后所有块都回到了缓冲池，
+// 以及预热后提交和收取完成不分配堆内存；io_uring 是否注册了固定缓冲区只报告，不作为失败条件（取决于内存锁定限额）
+static int RunAsyncWriteCheck()
+{
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "benchmark_async_check.bin";
+    std::string narrowPath = path.string();
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    CFramePool* pPool = nullptr;
+    int cFailed = 0;
+
+    ToWidePath(narrowPath.c_str(), wszPath, MAX_SEGMENT_PATH);
+
+    HRESULT hr = CFramePool::CreateBlockPool(c_asyncCheckBlock, c_asyncCheckBlocks, &pPool);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to create the block pool (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    printf("%-9s %-9s %-11s %7s %7s %10s  %s\n", "backend", "I/O", "buffers", "stalls", "allocs", "MB/s", "result");
+
+    static const AsyncIoBackend c_backends[] = { AsyncIoBackend_Thread, AsyncIoBackend_Uring };
+
+    for (UINT32 b = 0; b < ARRAYSIZE(c_backends); b++)
+    {
+        for (int bDirect = 1; bDirect >= 0; bDirect--)
+        {
+            CDirectFile file;
+            CAsyncFileWriter writer;
+
+            hr = file.Create(wszPath, bDirect);
+            if (SUCCEEDED(hr))
+            {
+                hr = writer.Open(&file, pPool, c_asyncCheckDepth, c_backends[b]);
+            }
+            if (hr == HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED))
+            {
+                printf("%-9s %-9s not available on this system\n", GetAsyncIoBackendName(c_backends[b]),
+                    bDirect ? "direct" : "buffered");
+                file.Close();
+                CDirectFile::Remove(wszPath);
+                break;
+            }
+
+            BOOL bDirectUsed = file.IsDirect();
+            BOOL bRegistered = writer.IsRegistered();
+            UINT64 cAllocations = 0;
+            LONGLONG llStart = GetClockTime();
+
+            for (UINT32 i = 0; i < c_asyncCheckWrites && SUCCEEDED(hr); i++)
+            {
+                // 按 0、2、1、3、4、6、5、7 ... 的顺序写入，偏移不随提交顺序递增
+                UINT32 index = (i & ~3u) | ((i & 1) << 1) | ((i >> 1) & 1);
+                CFrameBuffer* pBuffer = nullptr;
+
+                while (SUCCEEDED(hr) && pPool->Acquire(&pBuffer) == S_FALSE)
+                {
+                    hr = writer.WaitForCompletion();
+                }
+                if (FAILED(hr))
+                {
+                    break;
+                }
+
+                if (i == c_asyncCheckBlocks)
+                {
+                    cAllocations = g_cAllocations.load();
+                }
+
+                FillAsyncCheckBlock(pBuffer->GetData(), c_asyncCheckBlock, index);
+                hr = writer.Submit(pBuffer, (UINT64)index * c_asyncCheckBlock, c_asyncCheckBlock);
+            }
+
+            cAllocations = g_cAllocations.load() - cAllocations;
+
+            HRESULT hrClose = writer.Close();
+            double fSeconds = (GetClockTime() - llStart) / 1e7;
+
+            if (SUCCEEDED(hr))
+            {
+                hr = hrClose;
+            }
+            file.Close();
+
+            BOOL bContent = SUCCEEDED(hr) && VerifyAsyncCheckFile(narrowPath.c_str());
+            BOOL bReturned = pPool->FreeCount() == pPool->Count();
+            BOOL bPassed = bContent && bReturned && cAllocations == 0;
+
+            printf("%-9s %-9s %-11s %7llu %7llu %10.1f  %s\n", GetAsyncIoBackendName(writer.GetBackend()),
+                bDirectUsed ? "direct" : "buffered", bRegistered ? "registered" : "-", (unsigned long long)writer.StallCount(),
+                (unsigned long long)cAllocations, fSeconds > 0 ? (double)c_asyncCheckWrites * c_asyncCheckBlock / fSeconds / 1e6 : 0,
+                bPassed ? "ok" : "FAILED");
+
+            if (!bPassed)
+            {
+                fprintf(stderr, "FAILED: hr 0x%08X, content %s, %u of %u blocks returned, %llu allocations.\n",
+                    (unsigned)hr, bContent ? "ok" : "wrong", pPool->FreeCount(), pPool->Count(),
+                    (unsigned long long)cAllocations);
+                cFailed++;
+            }
+
+            CDirectFile::Remove(wszPath);
+        }
+    }
+
+    pPool->Release();
+    return cFailed ? 1 : 0;
+}
+
+// --replay-check 录制的格式、帧数和节流回放的倍速
+static const VideoFormat c_replayCheckFormat = { FOURCC_NV12, 640, 360, 30, 1 };
+static const UINT32 c_replayCheckFrames = 90;
+static const double c_replayCheckSpeed = 4;
+
+// 回放时流水线按 OverloadPolicy_Block 最多等待写出的时长，不节流回放时不会因为写出慢而丢帧
+static const UINT32 c_replayBlockMs = 60000;
+
+// 把 pwszPath 回放到 pSink：bPush 为 TRUE 时用推模式（与 OnReadSample 相同的路径），否则用拉模式；
+// outputSubtype 不为 0 时写入线程先转换格式；返回回放的耗时（秒），失败时返回负数
+static double ReplayToSink(const WCHAR* pwszPath, double fSpeed, BOOL bPush, UINT32 outputSubtype, IFrameSink* pSink,
+    PipelineStats* pStats, HRESULT* phr)
+{
+    CReplaySource source(pwszPath, fSpeed);
+    CFramePipeline pipeline;
+    HRESULT hr = S_OK;
+
+    pipeline.SetOverloadPolicy(OverloadPolicy_Block, c_replayBlockMs);
+    pipeline.SetOutputSubtype(outputSubtype);
+
+    LONGLONG llStart = GetClockTime();
+
+    if (bPush)
+    {
+        VideoFormat format;
+
+        hr = source.Open();
+        if (SUCCEEDED(hr))
+        {
+            hr = source.NegotiateFormat(VideoFormat(), &format);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = pipeline.Start(format, pSink);
+
+            if (SUCCEEDED(hr))
+            {
+                hr = source.PushTo(&pipeline);
+
+                HRESULT hrStop = pipeline.Stop();
+                if (SUCCEEDED(hr))
+                {
+                    hr = hrStop;
+                }
+            }
+        }
+        source.Close();
+    }
+    else
+    {
+        hr = pipeline.Start(&source, VideoFormat(), pSink);
+
+        if (SUCCEEDED(hr))
+        {
+            pipeline.Wait();
+            hr = pipeline.Stop();
+        }
+    }
+
+    double fSeconds = (GetClockTime() - llStart) / 1e7;
+
+    pipeline.GetStats(pStats);
+    *phr = hr;
+    return SUCCEEDED(hr) ? fSeconds : -1;
+}
+
+// 录制一段时间戳带抖动的合成画面，再用拉模式和推模式、不节流和 4 倍速、转换与不转换分别回放，
+// 检查写出的帧数、时间戳和数据的哈希与录制时一致，节流回放的耗时符合倍速，转换后的结果在两次回放之间一致；
+// 再检查末尾不完整的录制只回放完整的帧，以及不是原始文件时 Open 报告格式错误
+static int RunReplayCheck()
+{
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "benchmark_replay_check.raw";
+    std::filesystem::path cutPath = std::filesystem::temp_directory_path(error) / "benchmark_replay_check_cut.raw";
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    WCHAR wszCutPath[MAX_SEGMENT_PATH];
+    int cFailed = 0;
+
+    ToWidePath(path.string().c_str(), wszPath, MAX_SEGMENT_PATH);
+    ToWidePath(cutPath.string().c_str(), wszCutPath, MAX_SEGMENT_PATH);
+
+    // 录制：合成图案直接写入 CRawFileSink，同时算出完整录制和少最后一帧的期望哈希
+    CSyntheticSource synthetic(TestPattern_ColorBars, TRUE, c_replayCheckFrames);
+    CRawFileSink recorder(wszPath, RawContainer_Raw);
+    CFrameHashSink expected;
+    CFrameHashSink expectedCut;
+    VideoFormat format;
+    LONGLONG llLast = 0;
+
+    HRESULT hr = synthetic.Open();
+    if (SUCCEEDED(hr))
+    {
+        hr = synthetic.NegotiateFormat(c_replayCheckFormat, &format);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = recorder.BeginWriting(format);
+    }
+    expected.BeginWriting(format);
+    expectedCut.BeginWriting(format);
+
+    for (UINT32 i = 0; i < c_replayCheckFrames && SUCCEEDED(hr); i++)
+    {
+        CaptureFrame frame;
+
+        hr = synthetic.ReadFrame(&frame);
+        if (hr != S_OK)
+        {
+            hr = FAILED(hr) ? hr : E_UNEXPECTED;
+            break;
+        }
+
+        // 帧间隔不均匀，回放必须按录制的时间戳逐帧还原
+        frame.llTimestamp = GetFrameDuration(format) * i + (i % 7) * 1111;
+        llLast = frame.llTimestamp;
+
+        hr = recorder.WriteFrame(frame);
+        expected.WriteFrame(frame);
+        if (i + 1 < c_replayCheckFrames)
+        {
+            expectedCut.WriteFrame(frame);
+        }
+    }
+
+    HRESULT hrFinalize = recorder.Finalize();
+    synthetic.Close();
+
+    if (FAILED(hr) || FAILED(hrFinalize))
+    {
+        fprintf(stderr, "Failed to record the replay input (0x%08X).\n", (unsigned)(FAILED(hr) ? hr : hrFinalize));
+        std::filesystem::remove(path, error);
+        return -1;
+    }
+
+    double fRecorded = llLast / 1e7;
+
+    printf("recorded    %s %ux%u, %u frames, %.3f s\n", GetSubtypeName(format.subtype), format.width, format.height,
+        c_replayCheckFrames, fRecorded);
+    printf("%-26s %7s %9s %10s  %-16s  %s\n", "replay", "frames", "seconds", "fps", "hash", "result");
+
+    // 各种回放方式：前四种必须与录制的哈希一致，最后两种转换成 I420，两次的哈希必须相同
+    struct ReplayCase
+    {
+        const char* pszName;
+        BOOL        bPush;
+        double      fSpeed;
+        UINT32      outputSubtype;
+    };
+
+    static const ReplayCase c_cases[] =
+    {
+        { "pull unthrottled",       FALSE, REPLAY_UNTHROTTLED, 0 },
+        { "push unthrottled",       TRUE,  REPLAY_UNTHROTTLED, 0 },
+        { "pull 4x",                FALSE, c_replayCheckSpeed, 0 },
+        { "push 4x",                TRUE,  c_replayCheckSpeed, 0 },
+        { "pull unthrottled i420",  FALSE, REPLAY_UNTHROTTLED, FOURCC_I420 },
+        { "push unthrottled i420",  TRUE,  REPLAY_UNTHROTTLED, FOURCC_I420 },
+    };
+
+    UINT64 convertedHash = 0;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(c_cases); i++)
+    {
+        const ReplayCase& test = c_cases[i];
+        CFrameHashSink sink;
+        PipelineStats stats;
+        double fSeconds = ReplayToSink(wszPath, test.fSpeed, test.bPush, test.outputSubtype, &sink, &stats, &hr);
+        BOOL bPassed = fSeconds >= 0 && sink.FramesWritten() == c_replayCheckFrames && stats.cOverflows == 0;
+
+        if (test.outputSubtype == 0)
+        {
+            bPassed = bPassed && sink.GetHash() == expected.GetHash();
+        }
+        else
+        {
+            bPassed = bPassed && sink.GetHash() != expected.GetHash() && (convertedHash == 0 || sink.GetHash() == convertedHash);
+            convertedHash = sink.GetHash();
+        }
+
+        // 节流回放的耗时应接近录制时长除以倍速，只多出启动和最后一帧写出的时间
+        if (test.fSpeed > 0)
+        {
+            double fExpected = fRecorded / test.fSpeed;
+            bPassed = bPassed && fSeconds >= fExpected * 0.95 && fSeconds <= fExpected + 0.3;
+        }
+
+        printf("%-26s %7llu %9.3f %10.1f  %016llx  %s\n", test.pszName, (unsigned long long)sink.FramesWritten(),
+            fSeconds, fSeconds > 0 ? sink.FramesWritten() / fSeconds : 0, (unsigned long long)sink.GetHash(),
+            bPassed ? "ok" : "FAILED");
+
+        if (!bPassed)
+        {
+            fprintf(stderr, "FAILED: %s (0x%08X), %llu overflows.\n", test.pszName, (unsigned)hr,
+                (unsigned long long)stats.cOverflows);
+            cFailed++;
+        }
+    }
+
+    // 末尾不完整：截掉最后一帧的一半，再补零到直接 I/O 的对齐长度，模拟没有执行 Finalize 就中断的录制
+    {
+        std::filesystem::copy_file(path, cutPath, std::filesystem::copy_options::overwrite_existing, error);
+
+        UINT64 cbCut = (UINT64)std::filesystem::file_size(cutPath, error) - GetFrameSize(format) / 2;
+        std::filesystem::resize_file(cutPath, (cbCut + DIRECT_IO_ALIGNMENT - 1) & ~(UINT64)(DIRECT_IO_ALIGNMENT - 1), error);
+
+        CFrameHashSink sink;
+        PipelineStats stats;
+        double fSeconds = ReplayToSink(wszCutPath, REPLAY_UNTHROTTLED, FALSE, 0, &sink, &stats, &hr);
+        BOOL bPassed = fSeconds >= 0 && sink.FramesWritten() == c_replayCheckFrames - 1 &&
+            sink.GetHash() == expectedCut.GetHash();
+
+        printf("%-26s %7llu %9.3f %10.1f  %016llx  %s\n", "truncated", (unsigned long long)sink.FramesWritten(),
+            fSeconds, fSeconds > 0 ? sink.FramesWritten() / fSeconds : 0, (unsigned long long)sink.GetHash(),
+            bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    // 不是原始文件：Y4M 没有逐帧的时间戳，不能回放
+    {
+        FILE* pFile = fopen(cutPath.string().c_str(), "wb");
+        if (pFile)
+        {
+            fprintf(pFile, "YUV4MPEG2 W640 H360 F30:1 Ip A1:1 C420mpeg2\nFRAME\n");
+            fclose(pFile);
+        }
+
+        CReplaySource source(wszCutPath);
+        hr = source.Open();
+        BOOL bPassed = hr == HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+
+        printf("%-26s %s\n", "y4m rejected", bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    std::filesystem::remove(path, error);
+    std::filesystem::remove(cutPath, error);
+    return cFailed ? 1 : 0;
+}
+
+// 把录制的原始文件按 fSpeed 倍速（0 为不节流）回放到 CFrameHashSink，输出回放速度相对实时的倍数和写出结果的哈希；
+// 同一文件在不同构建上哈希相同说明行为一致
+static int RunReplay(const char* pszPath, double fSpeed, BOOL bPush, UINT32 outputSubtype)
+{
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    ToWidePath(pszPath, wszPath, MAX_SEGMENT_PATH);
+
+    CReplaySource probe(wszPath);
+    HRESULT hr = probe.Open();
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to open %s (0x%08X).\n", pszPath, (unsigned)hr);
+        return -1;
+    }
+
+    VideoFormat format = probe.GetFormat();
+    UINT64 cFrames = probe.GetFrameCount();
+    double fRecorded = probe.GetDuration() / 1e7;
+    probe.Close();
+
+    CFrameHashSink sink;
+    PipelineStats stats;
+    double fSeconds = ReplayToSink(wszPath, fSpeed, bPush, outputSubtype, &sink, &stats, &hr);
+
+    if (fSeconds < 0)
+    {
+        fprintf(stderr, "Replay failed (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    printf("format      %s %ux%u %u/%u, %llu frames, %.3f s recorded\n", GetSubtypeName(format.subtype), format.width,
+        format.height, format.fpsNumerator, format.fpsDenominator, (unsigned long long)cFrames, fRecorded);
+    printf("replay      %s, %s: %llu frames in %.3f s (%.1f fps, %.1fx realtime), overflows %llu\n",
+        bPush ? "push" : "pull", fSpeed > 0 ? "throttled" : "unthrottled", (unsigned long long)sink.FramesWritten(),
+        fSeconds, fSeconds > 0 ? sink.FramesWritten() / fSeconds : 0, fSeconds > 0 ? fRecorded / fSeconds : 0,
+        (unsigned long long)stats.cOverflows);
+    printf("hash        %016llx\n", (unsigned long long)sink.GetHash());
+    return 0;
+}
+
+// --state-check 的压测时长、回调线程数、控制线程数，以及每隔几个回调模拟一次背压阻塞和阻塞的时长
+static const UINT32 c_stateCheckMs = 1000;
+static const UINT32 c_stateCallbackThreads = 4;
+static const UINT32 c_stateControlThreads = 3;
+static const UINT32 c_stateBlockEvery = 16;
+static const UINT32 c_stateBlockUs = 200;
+
+// 测量回调进入开销的次数，以及检查结束会话等待阻塞回调时回调阻塞的时长
+static const UINT32 c_stateCostIterations = 10000000;
+static const UINT32 c_stateSlowCallbackMs = 50;
+
+// 读取器有效时的标记
+static const UINT32 c_stateReaderAlive = 0x52454144;
+
+// StateCheckReader 结构体代替源读取器：释放时清除标记并放进回收列表，压测结束后才删除，
+// 回调在读取器释放之后仍访问它时能发现
+struct StateCheckReader
+{
+    std::atomic<UINT32> magic;      // c_stateReaderAlive 表示有效
+    std::atomic<UINT64> cSamples;   // 经它处理的样本数
+};
+
+// CStateCheckCapture 类按 CCapture 的方式转换状态：转换在临界区内串行执行，离开 Capturing 后等待回调退出
+// 再释放读取器；OnSample 按 OnReadSample 的方式不加锁进入
+class CStateCheckCapture
+{
+public:
+    CStateCheckCapture() : m_pReader(nullptr), m_cViolations(0), m_cDelivered(0), m_cRejected(0) {}
+
+    ~CStateCheckCapture()
+    {
+        ReleaseReader();
+        for (size_t i = 0; i < m_released.size(); i++)
+        {
+            delete m_released[i];
+        }
+    }
+
+    // 相当于 StartCapture
+    HRESULT Start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_state.Transition(CaptureState_NotReady, CaptureState_Ready))
+        {
+            return E_UNEXPECTED;
+        }
+
+        HRESULT hr = CreateReader();
+        m_state.SetState(SUCCEEDED(hr) ? CaptureState_Capturing : CaptureState_NotReady);
+        return hr;
+    }
+
+    // 相当于 EndCaptureSession
+    HRESULT Stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_state.SetState(CaptureState_Stopping) != CaptureState_NotReady)
+        {
+            m_state.WaitForCallbacks();
+            ReleaseReader();
+        }
+
+        m_state.SetState(CaptureState_NotReady);
+        return S_OK;
+    }
+
+    // 相当于 SuspendDevice
+    HRESULT Suspend()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_state.Transition(CaptureState_Capturing, CaptureState_Recovering))
+        {
+            return E_UNEXPECTED;
+        }
+
+        m_state.WaitForCallbacks();
+        ReleaseReader();
+        return S_OK;
+    }
+
+    // 相当于 ResumeDevice
+    HRESULT Resume()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_state.GetState() != CaptureState_Recovering || m_pReader)
+        {
+            return E_UNEXPECTED;
+        }
+
+        HRESULT hr = CreateReader();
+        if (SUCCEEDED(hr))
+        {
+            m_state.SetState(CaptureState_Capturing);
+        }
+        return hr;
+    }
+
+    // 相当于 OnReadSample：读取器在整个回调期间（包括阻塞）都必须有效；不在 Capturing 状态时返回 FALSE
+    BOOL    OnSample(UINT32 blockUs)
+    {
+        if (!m_state.EnterCallback())
+        {
+            m_cRejected++;
+            return FALSE;
+        }
+
+        StateCheckReader* pReader = m_pReader;
+
+        if (pReader == nullptr || pReader->magic != c_stateReaderAlive)
+        {
+            m_cViolations++;
+        }
+        else
+        {
+            if (blockUs)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(blockUs));
+            }
+
+            if (pReader->magic != c_stateReaderAlive)
+            {
+                m_cViolations++;
+            }
+
+            pReader->cSamples++;
+            m_cDelivered++;
+        }
+
+        m_state.LeaveCallback();
+        return TRUE;
+    }
+
+    CaptureState GetState() const { return m_state.GetState(); }
+    UINT32  CallbacksInFlight() const { return m_state.CallbacksInFlight(); }
+    UINT64  Violations() const { return m_cViolations; }
+    UINT64  Delivered() const { return m_cDelivered; }
+    UINT64  Rejected() const { return m_cRejected; }
+
+    // 所有读取器处理的样本数之和，在所有线程结束后调用
+    UINT64  SamplesOnReaders() const
+    {
+        UINT64 cSamples = m_pReader ? m_pReader->cSamples.load() : 0;
+
+        for (size_t i = 0; i < m_released.size(); i++)
+        {
+            cSamples += m_released[i]->cSamples;
+        }
+        return cSamples;
+    }
+
+private:
+    CStateCheckCapture(const CStateCheckCapture&);
+    CStateCheckCapture& operator=(const CStateCheckCapture&);
+
+    HRESULT CreateReader()
+    {
+        m_pReader = new (std::nothrow) StateCheckReader();
+        if (m_pReader == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        m_pReader->magic = c_stateReaderAlive;
+        m_pReader->cSamples = 0;
+        return S_OK;
+    }
+
+    void    ReleaseReader()
+    {
+        if (m_pReader)
+        {
+            m_pReader->magic = 0;
+            m_released.push_back(m_pReader);
+            m_pReader = nullptr;
+        }
+    }
+
+    std::mutex                      m_mutex;        // 相当于 m_critsec
+    CCaptureStateMachine            m_state;        // 会话状态
+    StateCheckReader*               m_pReader;      // 当前的读取器
+    std::vector<StateCheckReader*>  m_released;     // 已释放的读取器
+    std::atomic<UINT64>             m_cViolations;  // 访问到无效读取器的回调数
+    std::atomic<UINT64>             m_cDelivered;   // 处理了样本的回调数
+    std::atomic<UINT64>             m_cRejected;    // 不在 Capturing 状态、直接返回的回调数
+};
+
+// 测量回调进入和退出的开销：无锁的 EnterCallback/LeaveCallback 与原来的做法（进入临界区后在 IsCapturing 中再次进入）对比，
+// 可重入的互斥量代替 CRITICAL_SECTION；返回每次回调的纳秒数
+static void MeasureCallbackCost(double* pfLockFreeNs, double* pfLockedNs)
+{
+    CCaptureStateMachine state;
+    std::recursive_mutex mutex;
+    UINT64 cEntered = 0;
+
+    state.SetState(CaptureState_Capturing);
+
+    LONGLONG llStart = GetClockTime();
+    for (UINT32 i = 0; i < c_stateCostIterations; i++)
+    {
+        if (state.EnterCallback())
+        {
+            cEntered++;
+            state.LeaveCallback();
+        }
+    }
+    *pfLockFreeNs = (GetClockTime() - llStart) * 100.0 / c_stateCostIterations;
+
+    volatile bool bCapturing = true;
+
+    llStart = GetClockTime();
+    for (UINT32 i = 0; i < c_stateCostIterations; i++)
+    {
+        mutex.lock();
+        mutex.lock();
+        bool bEntered = bCapturing;
+        mutex.unlock();
+        if (bEntered)
+        {
+            cEntered++;
+        }
+        mutex.unlock();
+    }
+    *pfLockedNs = (GetClockTime() - llStart) * 100.0 / c_stateCostIterations;
+
+    if (cEntered != 2ull * c_stateCostIterations)
+    {
+        *pfLockFreeNs = -1;
+    }
+}
+
+// 多个线程同时不停地回调，另外几个线程随机开始、结束、模拟设备丢失和恢复，检查回调从不访问已释放的读取器、
+// 每个处理了样本的回调都记在某个读取器上、结束后没有残留的回调且回到 NotReady；
+// 再检查结束会话会等待阻塞在背压中的回调退出，并对比回调进入的无锁开销与原来两次进入临界区的开销
+static int RunStateCheck()
+{
+    CStateCheckCapture capture;
+    std::atomic<bool> bStop(false);
+    std::vector<std::thread> threads;
+    UINT64 cOps[4][2] = {};     // 开始、结束、丢失、恢复各自成功和被拒绝的次数
+    std::mutex opsMutex;
+    int cFailed = 0;
+
+    for (UINT32 i = 0; i < c_stateCallbackThreads; i++)
+    {
+        threads.push_back(std::thread([&capture, &bStop]()
+        {
+            for (UINT32 n = 1; !bStop; n++)
+            {
+                // 不在捕获时设备也不会频繁回调，让出时间片给控制线程
+                if (!capture.OnSample(n % c_stateBlockEvery == 0 ? c_stateBlockUs : 0))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }));
+    }
+
+    for (UINT32 i = 0; i < c_stateControlThreads; i++)
+    {
+        threads.push_back(std::thread([&capture, &bStop, &cOps, &opsMutex, i]()
+        {
+            UINT64 cLocal[4][2] = {};
+            UINT32 seed = 0x9E3779B9u * (i + 1);
+
+            while (!bStop)
+            {
+                seed = seed * 1664525u + 1013904223u;
+
+                UINT32 op = (seed >> 16) % 4;
+                HRESULT hr = S_OK;
+
+                switch (op)
+                {
+                case 0:  hr = capture.Start(); break;
+                case 1:  hr = capture.Stop(); break;
+                case 2:  hr = capture.Suspend(); break;
+                default: hr = capture.Resume(); break;
+                }
+
+                cLocal[op][SUCCEEDED(hr) ? 0 : 1]++;
+                std::this_thread::sleep_for(std::chrono::microseconds((seed >> 8) % 500));
+            }
+
+            std::lock_guard<std::mutex> lock(opsMutex);
+            for (UINT32 op = 0; op < 4; op++)
+            {
+                cOps[op][0] += cLocal[op][0];
+                cOps[op][1] += cLocal[op][1];
+            }
+        }));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(c_stateCheckMs));
+    bStop = true;
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    capture.Stop();
+
+    static const char* c_opNames[] = { "start", "stop", "suspend", "resume" };
+
+    printf("%-10s %10s %10s\n", "transition", "done", "rejected");
+    for (UINT32 op = 0; op < 4; op++)
+    {
+        printf("%-10s %10llu %10llu\n", c_opNames[op], (unsigned long long)cOps[op][0], (unsigned long long)cOps[op][1]);
+    }
+
+    BOOL bPassed = capture.Violations() == 0 && capture.CallbacksInFlight() == 0 &&
+        capture.GetState() == CaptureState_NotReady && capture.Delivered() > 0 &&
+        capture.SamplesOnReaders() == capture.Delivered() && cOps[2][0] > 0 && cOps[3][0] > 0;
+
+    printf("callbacks  %llu delivered, %llu rejected, %llu touched a released reader, %u in flight, state %s  %s\n",
+        (unsigned long long)capture.Delivered(), (unsigned long long)capture.Rejected(),
+        (unsigned long long)capture.Violations(), capture.CallbacksInFlight(), GetCaptureStateName(capture.GetState()),
+        bPassed ? "ok" : "FAILED");
+    cFailed += bPassed ? 0 : 1;
+
+    // 结束会话时一个回调正阻塞在背压中：EndCaptureSession 必须等它退出后才释放读取器
+    {
+        CStateCheckCapture slow;
+
+        slow.Start();
+
+        std::thread callback([&slow]() { slow.OnSample(c_stateSlowCallbackMs * 1000); });
+
+        while (slow.CallbacksInFlight() == 0)
+        {
+            std::this_thread::yield();
+        }
+
+        LONGLONG llStart = GetClockTime();
+        slow.Stop();
+        double fStopMs = (GetClockTime() - llStart) / 1e4;
+        UINT32 cInFlight = slow.CallbacksInFlight();
+
+        callback.join();
+
+        bPassed = slow.Violations() == 0 && slow.Delivered() == 1 && cInFlight == 0 &&
+            fStopMs >= c_stateSlowCallbackMs * 0.8;
+
+        printf("blocked    stop waited %.1f ms for a %u ms callback  %s\n", fStopMs, c_stateSlowCallbackMs,
+            bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    double fLockFreeNs = 0;
+    double fLockedNs = 0;
+
+    MeasureCallbackCost(&fLockFreeNs, &fLockedNs);
+    printf("cost       %.1f ns per callback lock-free, %.1f ns with the nested critical section\n", fLockFreeNs,
+        fLockedNs);
+    cFailed += fLockFreeNs >= 0 ? 0 : 1;
+
+    return cFailed ? 1 : 0;
+}
+
+// --batch-check 的格式和帧数、批量上限、凑批等待、慢接收器每帧的耗时，以及收紧的延迟上限
+// 凑批等待远长于数据源凑满一批的时间，每批都凑满（最后一批在停止时写出），批数与机器快慢无关；
+// 慢接收器每帧的耗时超过收紧的延迟上限，每批最早的帧必然超限
+static const VideoFormat c_batchCheckFormat = { FOURCC_NV12, 640, 360, 30, 1 };
+static const UINT32 c_batchCheckFrames = 300;
+static const UINT32 c_batchCheckMax = 16;
+static const UINT32 c_batchCheckLingerUs = 10000000;
+static const UINT32 c_batchSlowFrameUs = 2000;
+static const UINT32 c_batchTightLatencyUs = 1000;
+
+// 混合内存的检查中每批的帧数，以及每隔几帧有一帧在调用方自己的内存中
+static const UINT32 c_batchMixedFrames = 8;
+static const UINT32 c_batchMixedEvery = 3;
+
+// CBatchTeeSink 类把每一批先算进哈希，再原样交给 CRawFileSink，回放文件的哈希必须与之一致
+class CBatchTeeSink : public IFrameSink
+{
+public:
+    explicit CBatchTeeSink(CRawFileSink* pSink) : m_pSink(pSink) {}
+
+    HRESULT BeginWriting(const VideoFormat& format)
+    {
+        m_hash.BeginWriting(format);
+        return m_pSink->BeginWriting(format);
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        return WriteFrames(&frame, 1);
+    }
+
+    HRESULT WriteFrames(const CaptureFrame* pFrames, UINT32 cFrames)
+    {
+        for (UINT32 i = 0; i < cFrames; i++)
+        {
+            m_hash.WriteFrame(pFrames[i]);
+        }
+        return m_pSink->WriteFrames(pFrames, cFrames);
+    }
+
+    HRESULT Finalize() { return m_pSink->Finalize(); }
+
+    UINT64  GetHash() const { return m_hash.GetHash(); }
+
+private:
+    CRawFileSink*   m_pSink;    // 实际写出的接收器
+    CFrameHashSink  m_hash;     // 写出内容的哈希
+};
+
+// CSlowBatchSink 类每帧睡眠 c_batchSlowFrameUs 微秒，让写出跟不上数据源
+class CSlowBatchSink : public CNullSink
+{
+public:
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(c_batchSlowFrameUs));
+        return CNullSink::WriteFrame(frame);
+    }
+};
+
+// 打开分散/聚集写入，直接调用 WriteFrames：每批 c_batchMixedFrames 帧，每 c_batchMixedEvery 帧有一帧在调用方
+// 自己的内存中（拷贝进块），其余在缓冲池中（分散/聚集写请求）；回放的哈希必须与写入的内容一致
+static BOOL RunBatchMixedCheck(const WCHAR* pwszPath)
+{
+    CSyntheticSource source(TestPattern_ColorBars, TRUE, c_batchCheckFrames);
+    CRawFileSink recorder(pwszPath, RawContainer_Raw, FALSE);
+    CBatchTeeSink tee(&recorder);
+    CFramePool* pPool = nullptr;
+    VideoFormat format;
+    UINT32 cFrames = 0;
+    LONGLONG llBaseTime = 0;
+
+    HRESULT hr = source.Open();
+    if (SUCCEEDED(hr))
+    {
+        hr = source.NegotiateFormat(c_batchCheckFormat, &format);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = CFramePool::CreateInstance(format, (RAW_GATHER_DEPTH + 1) * c_batchMixedFrames, &pPool);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = recorder.SetGatherWrites(c_batchMixedFrames);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = tee.BeginWriting(format);
+    }
+
+    UINT32 cbFrame = SUCCEEDED(hr) ? GetFrameSize(format) : 0;
+    std::vector<BYTE> callerMemory((size_t)cbFrame * c_batchMixedFrames);
+
+    while (SUCCEEDED(hr) && cFrames < c_batchCheckFrames)
+    {
+        CaptureFrame frames[c_batchMixedFrames] = {};
+        CFrameBuffer* pBuffers[c_batchMixedFrames] = {};
+        UINT32 cBatch = 0;
+
+        for (; cBatch < c_batchMixedFrames && cFrames < c_batchCheckFrames && SUCCEEDED(hr); cBatch++, cFrames++)
+        {
+            BYTE* pData = &callerMemory[(size_t)cBatch * cbFrame];
+
+            if (cFrames % c_batchMixedEvery != 0)
+            {
+                hr = (pPool->Acquire(&pBuffers[cBatch]) == S_OK) ? S_OK : E_UNEXPECTED;
+                pData = SUCCEEDED(hr) ? pBuffers[cBatch]->GetData() : pData;
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = source.ReadFrameInto(pData, cbFrame, &frames[cBatch]);
+            }
+            if (SUCCEEDED(hr))
+            {
+                // 与流水线一样，时间戳从第一帧开始计
+                llBaseTime = (cFrames == 0) ? frames[cBatch].llTimestamp : llBaseTime;
+                frames[cBatch].llTimestamp -= llBaseTime;
+                frames[cBatch].pBuffer = pBuffers[cBatch];
+            }
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = tee.WriteFrames(frames, cBatch);
+        }
+
+        for (UINT32 i = 0; i < cBatch; i++)
+        {
+            if (pBuffers[i])
+            {
+                pBuffers[i]->Release();
+            }
+        }
+    }
+
+    HRESULT hrFinalize = tee.Finalize();
+    UINT64 cGathers = recorder.GatherCount();
+    CFrameHashSink replayed;
+    PipelineStats replayStats;
+
+    source.Close();
+    if (pPool)
+    {
+        pPool->Release();
+    }
+
+    hr = FAILED(hr) ? hr : hrFinalize;
+    if (SUCCEEDED(hr) && ReplayToSink(pwszPath, 0, FALSE, 0, &replayed, &replayStats, &hrFinalize) < 0)
+    {
+        hr = hrFinalize;
+    }
+
+    BOOL bPassed = SUCCEEDED(hr) && replayed.FramesWritten() == c_batchCheckFrames &&
+        replayed.GetHash() == tee.GetHash() && cGathers > 0 && cGathers < c_batchCheckFrames;
+
+    printf("%-20s %-8s %7u %8s %8llu %7s  %016llx  %s\n", "gather, mixed memory", "gather", cFrames, "-",
+        (unsigned long long)cGathers, "-", (unsigned long long)replayed.GetHash(), bPassed ? "ok" : "FAILED");
+    return bPassed;
+}
+
+// 用不同的批量上限和 I/O 方式把合成图案录制成原始文件：不设延迟上限、凑批等待足够长，检查批数正好是
+// 帧数除以批量上限向上取整、打开分散/聚集写入时每批正好一个请求、预热之后不分配堆内存，
+// 回放的哈希与写入接收器的内容一致；再在同一批里混合缓冲池中的帧和调用方内存中的帧，检查两条写入路径
+// 交替时文件仍然连续；最后让接收器比数据源慢，检查收紧延迟上限时批量上限降到 1，放宽时保持不变
+static int RunBatchCheck()
+{
+    std::error_code error;
+    std::filesystem::path path = std::filesystem::temp_directory_path(error) / "benchmark_batch_check.raw";
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    int cFailed = 0;
+
+    ToWidePath(path.string().c_str(), wszPath, MAX_SEGMENT_PATH);
+
+    struct BatchCase
+    {
+        const char* pszName;
+        BOOL        bDirect;
+        BOOL        bGather;
+        UINT32      cMaxBatch;
+        UINT32      lingerUs;
+    };
+
+    static const BatchCase cases[] =
+    {
+        { "buffered, batch 1",      FALSE, FALSE, 1,               0 },
+        { "buffered, batch 16",     FALSE, FALSE, c_batchCheckMax, c_batchCheckLingerUs },
+        { "gather, batch 1",        FALSE, TRUE,  1,               0 },
+        { "gather, batch 16",       FALSE, TRUE,  c_batchCheckMax, c_batchCheckLingerUs },
+        { "direct, batch 16",       TRUE,  FALSE, c_batchCheckMax, c_batchCheckLingerUs },
+    };
+
+    printf("%-20s %-8s %7s %8s %8s %7s  %-16s  %s\n", "record", "io", "frames", "batches", "gathers", "allocs",
+        "hash", "result");
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const BatchCase& c = cases[i];
+        CSyntheticSource source(TestPattern_ColorBars, TRUE, c_batchCheckFrames);
+        CRawFileSink recorder(wszPath, RawContainer_Raw, c.bDirect);
+        CBatchTeeSink tee(&recorder);
+        CFramePipeline pipeline;
+        PipelineStats stats;
+
+        if (c.bGather)
+        {
+            recorder.SetGatherWrites(c.cMaxBatch);
+        }
+
+        pipeline.SetOverloadPolicy(OverloadPolicy_Block, c_replayBlockMs);
+        pipeline.SetWriteBatch(c.cMaxBatch, c.lingerUs, 0);
+        pipeline.SetSinkBuffers(recorder.GetBufferDemand());
+
+        if (FAILED(pipeline.Start(&source, c_batchCheckFormat, &tee)))
+        {
+            fprintf(stderr, "Failed to start pipeline.\n");
+            return -1;
+        }
+
+        BOOL bDirect = recorder.IsDirect();
+
+        // 前 1/4 的帧作为预热，之后的分配都计入稳态
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pipeline.GetStats(&stats);
+        } while (stats.cFrames < c_batchCheckFrames / 4 && pipeline.IsRunning());
+
+        UINT64 cBefore = g_cAllocations.load();
+        pipeline.Wait();
+        UINT64 cAllocations = g_cAllocations.load() - cBefore;
+
+        HRESULT hr = pipeline.Stop();
+        pipeline.GetStats(&stats);
+
+        BOOL bGather = recorder.IsGather();
+        UINT64 cGathers = recorder.GatherCount();
+        CFrameHashSink replayed;
+        PipelineStats replayStats;
+        HRESULT hrReplay = S_OK;
+
+        if (SUCCEEDED(hr) && ReplayToSink(wszPath, 0, FALSE, 0, &replayed, &replayStats, &hrReplay) < 0)
+        {
+            hr = hrReplay;
+        }
+
+        BOOL bPassed = SUCCEEDED(hr) && stats.cFrames == c_batchCheckFrames && stats.cOverflows == 0 &&
+            cAllocations == 0 && replayed.FramesWritten() == c_batchCheckFrames && replayed.GetHash() == tee.GetHash();
+
+        // 每批都凑满；打开分散/聚集写入时每批正好一个请求
+        bPassed = bPassed && stats.cBatches == (c_batchCheckFrames + c.cMaxBatch - 1) / c.cMaxBatch;
+        bPassed = bPassed && cGathers == (c.bGather ? stats.cBatches : 0);
+
+        printf("%-20s %-8s %7llu %8llu %8llu %7llu  %016llx  %s\n", c.pszName,
+            bGather ? "gather" : (bDirect ? "direct" : "buffered"), (unsigned long long)stats.cFrames,
+            (unsigned long long)stats.cBatches, (unsigned long long)cGathers, (unsigned long long)cAllocations,
+            (unsigned long long)replayed.GetHash(), bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    cFailed += RunBatchMixedCheck(wszPath) ? 0 : 1;
+    std::filesystem::remove(path, error);
+
+    // 接收器每帧的耗时超过收紧的延迟上限：每批最早的帧都超限，批量上限每批减半，降到 1 之后不再增加；
+    // 放宽上限时保持 c_batchCheckMax，凑批等待（不超过延迟上限的一半）让每批都凑满
+    static const UINT32 latencies[] = { c_batchTightLatencyUs, DEFAULT_BATCH_LATENCY_US * 100 };
+
+    for (size_t i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++)
+    {
+        CSyntheticSource source(TestPattern_ColorBars, TRUE, c_batchCheckFrames);
+        CSlowBatchSink sink;
+        CFramePipeline pipeline;
+        PipelineStats stats;
+
+        pipeline.SetOverloadPolicy(OverloadPolicy_Block, c_replayBlockMs);
+        pipeline.SetWriteBatch(c_batchCheckMax, c_batchCheckLingerUs, latencies[i]);
+
+        HRESULT hr = pipeline.Start(&source, c_batchCheckFormat, &sink);
+        if (SUCCEEDED(hr))
+        {
+            pipeline.Wait();
+            hr = pipeline.Stop();
+        }
+        pipeline.GetStats(&stats);
+
+        BOOL bTight = (latencies[i] == c_batchTightLatencyUs);
+        BOOL bPassed = SUCCEEDED(hr) && stats.cFrames == c_batchCheckFrames &&
+            (bTight ? stats.cBatchLimit == 1 : stats.cBatchLimit == c_batchCheckMax &&
+            stats.cBatches == (c_batchCheckFrames + c_batchCheckMax - 1) / c_batchCheckMax);
+
+        printf("latency     bound %7.1f ms: %llu frames in %llu batches, limit %u  %s\n", latencies[i] / 1e3,
+            (unsigned long long)stats.cFrames, (unsigned long long)stats.cBatches, stats.cBatchLimit,
+            bPassed ? "ok" : "FAILED");
+        cFailed += bPassed ? 0 : 1;
+    }
+
+    return cFailed ? 1 : 0;
+}
+
+static void PrintUsage()
+{
+    printf("usage: benchmark [--width N] [--height N] [--format nv12|yuy2|rgb32]\n"
+           "                 [--output nv12|i420|yuy2|uyvy|rgb24|rgb32]\n"
+           "                 [--fps N] [--frames N] [--queue N] [--unthrottled] [--flat]\n"
+           "                 [--analyze N] [--analyze-rows N] [--alloc-check] [--cameras N]\n"
+           "                 [--preroll SECONDS [--trigger-at N]]\n"
+           "                 [--segment SECONDS [--retain N] [--finalize-ms N]]\n"
+           "                 [--raw PATH [--y4m] [--buffered] [--keep] [--io auto|thread|uring] [--cameras N]\n"
+           "                  [--batch N [--batch-linger US] [--batch-latency US] [--gather]]]\n"
+           "                 [--stats-file PATH [--stats-json] [--stats-interval MS]]\n"
+           "                 [--policy newest|oldest|decimate[:N]|block[:MS]] [--gop N]\n"
+           "                 [--motion THRESHOLD [--motion-hold MS]] [--simulcast HEIGHT,...]\n"
+           "       benchmark --convert [--width N] [--height N] [--threads N]\n"
+           "       benchmark --stats-check [--width N] [--height N]\n"
+           "       benchmark --latency-check\n"
+           "       benchmark --drop-check [--queue N]\n"
+           "       benchmark --negotiate-check\n"
+           "       benchmark --cache-check\n"
+           "       benchmark --recovery-check\n"
+           "       benchmark --motion-check [--width N] [--height N]\n"
+           "       benchmark --scale-check [--width N] [--height N]\n"
+           "       benchmark --bus-check [--width N] [--height N]\n"
+           "       benchmark --shm-check [--width N] [--height N]\n"
+           "       benchmark --stream-check [--width N] [--height N]\n"
+           "       benchmark --jpeg-check [--width N] [--height N]\n"
+           "       benchmark --jpeg-bench [--threads N]\n"
+           "       benchmark --async-check\n"
+           "       benchmark --replay PATH [--speed X] [--push] [--output FORMAT]\n"
+           "       benchmark --replay-check\n"
+           "       benchmark --state-check\n"
+           "       benchmark --batch-check\n"
+           "       benchmark --suite [--suite-res vga,720p,1080p,4k|WxH,...] [--suite-formats nv12,yuy2,...]\n"
+           "                 [--suite-fps 0,60] [--suite-sinks null,raw,y4m,segment,mjpeg,mp4] [--suite-frames N]\n"
+           "                 [--suite-dir DIR] [--suite-out FILE] [--suite-baseline FILE [--suite-tolerance PCT]]\n");
+}
+
+// 程序入口
+int main(int argc, char* argv[])
+{
+    VideoFormat format = { FOURCC_NV12, 1920, 1080, 60, 1 };
+    UINT64 cFrames = 600;
+    UINT32 cQueueDepth = DEFAULT_QUEUE_DEPTH;
+    BOOL bUnthrottled = FALSE;
+    BOOL bAllocCheck = FALSE;
+    BOOL bConvertCheck = FALSE;
+    BOOL bStatsCheck = FALSE;
+    UINT32 analysisFrameStride = 0;
+    UINT32 analysisRowStride = 1;
+    UINT32 outputSubtype = 0;
+    UINT32 cThreads = 0;
+    UINT32 cCameras = 1;
+    double fPreRollSeconds = 0;
+    UINT64 nTriggerAt = 0;
+    double fSegmentSeconds = 0;
+    UINT32 cRetainSegments = 0;
+    UINT32 finalizeMs = 0;
+    const char* pszRawPath = nullptr;
+    BOOL bY4M = FALSE;
+    BOOL bBuffered = FALSE;
+    BOOL bKeep = FALSE;
+    BOOL bLatencyCheck = FALSE;
+    const char* pszStatsFile = nullptr;
+    BOOL bStatsJson = FALSE;
+    UINT32 statsIntervalMs = DEFAULT_STATS_INTERVAL_MS;
+    BOOL bSuite = FALSE;
+    BOOL bDropCheck = FALSE;
+    BOOL bNegotiateCheck = FALSE;
+    BOOL bCacheCheck = FALSE;
+    BOOL bRecoveryCheck = FALSE;
+    BOOL bMotionCheck = FALSE;
+    BOOL bScaleCheck = FALSE;
+    BOOL bBusCheck = FALSE;
+    BOOL bShmCheck = FALSE;
+    BOOL bStreamCheck = FALSE;
+    BOOL bJpegCheck = FALSE;
+    BOOL bJpegBench = FALSE;
+    BOOL bAsyncCheck = FALSE;
+    BOOL bReplayCheck = FALSE;
+    BOOL bStateCheck = FALSE;
+    BOOL bBatchCheck = FALSE;
+    UINT32 cWriteBatch = 1;
+    UINT32 batchLingerUs = 0;
+    UINT32 batchLatencyUs = DEFAULT_BATCH_LATENCY_US;
+    BOOL bGather = FALSE;
+    BOOL bPush = FALSE;
+    const char* pszReplayPath = nullptr;
+    double fReplaySpeed = 1.0;
+    AsyncIoBackend ioBackend = AsyncIoBackend_Auto;
+    const char* pszShmRead = nullptr;
+    UINT32 shmWorkUs = 0;
+    const char* pszSimulcast = nullptr;
+    double fMotionThreshold = 0;
+    UINT32 motionHoldMs = DEFAULT_MOTION_HOLD_MS;
+    OverloadPolicy overloadPolicy = OverloadPolicy_DropNewest;
+    UINT32 overloadValue = 0;
+    UINT32 cGop = 0;
+    SuiteOptions suite = { c_szSuiteResolutions, c_szSuiteFormats, c_szSuiteRates, c_szSuiteSinks, ".", nullptr,
+        nullptr, 0.1, c_suiteFrames, 0, 0, 0, 0, TestPattern_ColorBars };
+    TestPattern pattern = TestPattern_ColorBars;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* pszArg = argv[i];
+        const char* pszValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (strcmp(pszArg, "--unthrottled") == 0)
+        {
+            bUnthrottled = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--alloc-check") == 0)
+        {
+            bAllocCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--convert") == 0)
+        {
+            bConvertCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--stats-check") == 0)
+        {
+            bStatsCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--latency-check") == 0)
+        {
+            bLatencyCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--negotiate-check") == 0)
+        {
+            bNegotiateCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--cache-check") == 0)
+        {
+            bCacheCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--recovery-check") == 0)
+        {
+            bRecoveryCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--motion-check") == 0)
+        {
+            bMotionCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--scale-check") == 0)
+        {
+            bScaleCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--bus-check") == 0)
+        {
+            bBusCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--shm-check") == 0)
+        {
+            bShmCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--stream-check") == 0)
+        {
+            bStreamCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--jpeg-check") == 0)
+        {
+            bJpegCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--jpeg-bench") == 0)
+        {
+            bJpegBench = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--async-check") == 0)
+        {
+            bAsyncCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--state-check") == 0)
+        {
+            bStateCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--batch-check") == 0)
+        {
+            bBatchCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--replay-check") == 0)
+        {
+            bReplayCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--push") == 0)
+        {
+            bPush = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--drop-check") == 0)
+        {
+            bDropCheck = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--suite") == 0)
+        {
+            bSuite = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--stats-json") == 0)
+        {
+            bStatsJson = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--y4m") == 0)
+        {
+            bY4M = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--keep") == 0)
+        {
+            bKeep = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--buffered") == 0)
+        {
+            bBuffered = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--gather") == 0)
+        {
+            bGather = TRUE;
+            continue;
+        }
+        if (strcmp(pszArg, "--flat") == 0)
+        {
+            pattern = TestPattern_Flat;
+            continue;
+        }
+        if (pszValue == nullptr)
+        {
+            PrintUsage();
+            return -1;
+        }
+
+        if (strcmp(pszArg, "--width") == 0) { format.width = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--height") == 0) { format.height = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--fps") == 0) { format.fpsNumerator = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--frames") == 0) { cFrames = (UINT64)atoll(pszValue); }
+        else if (strcmp(pszArg, "--queue") == 0) { cQueueDepth = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--format") == 0) { format.subtype = ParseSubtype(pszValue); }
+        else if (strcmp(pszArg, "--threads") == 0) { cThreads = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--cameras") == 0) { cCameras = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--preroll") == 0) { fPreRollSeconds = atof(pszValue); }
+        else if (strcmp(pszArg, "--trigger-at") == 0) { nTriggerAt = (UINT64)atoll(pszValue); }
+        else if (strcmp(pszArg, "--segment") == 0) { fSegmentSeconds = atof(pszValue); }
+        else if (strcmp(pszArg, "--retain") == 0) { cRetainSegments = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--finalize-ms") == 0) { finalizeMs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--raw") == 0) { pszRawPath = pszValue; }
+        else if (strcmp(pszArg, "--batch") == 0) { cWriteBatch = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--batch-linger") == 0) { batchLingerUs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--batch-latency") == 0) { batchLatencyUs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--replay") == 0) { pszReplayPath = pszValue; }
+        else if (strcmp(pszArg, "--speed") == 0) { fReplaySpeed = atof(pszValue); }
+        else if (strcmp(pszArg, "--stats-file") == 0) { pszStatsFile = pszValue; }
+        else if (strcmp(pszArg, "--stats-interval") == 0) { statsIntervalMs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--gop") == 0) { cGop = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--motion") == 0) { fMotionThreshold = atof(pszValue); }
+        else if (strcmp(pszArg, "--motion-hold") == 0) { motionHoldMs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--simulcast") == 0) { pszSimulcast = pszValue; }
+        else if (strcmp(pszArg, "--shm-read") == 0) { pszShmRead = pszValue; }
+        else if (strcmp(pszArg, "--shm-work-us") == 0) { shmWorkUs = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--io") == 0)
+        {
+            if (strcmp(pszValue, "auto") == 0) { ioBackend = AsyncIoBackend_Auto; }
+            else if (strcmp(pszValue, "thread") == 0) { ioBackend = AsyncIoBackend_Thread; }
+            else if (strcmp(pszValue, "uring") == 0) { ioBackend = AsyncIoBackend_Uring; }
+            else
+            {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(pszArg, "--policy") == 0)
+        {
+            if (!ParseOverloadPolicy(pszValue, &overloadPolicy, &overloadValue))
+            {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (strcmp(pszArg, "--suite-res") == 0) { suite.pszResolutions = pszValue; }
+        else if (strcmp(pszArg, "--suite-formats") == 0) { suite.pszFormats = pszValue; }
+        else if (strcmp(pszArg, "--suite-fps") == 0) { suite.pszRates = pszValue; }
+        else if (strcmp(pszArg, "--suite-sinks") == 0) { suite.pszSinks = pszValue; }
+        else if (strcmp(pszArg, "--suite-frames") == 0) { suite.cFrames = (UINT64)atoll(pszValue); }
+        else if (strcmp(pszArg, "--suite-dir") == 0) { suite.pszDirectory = pszValue; }
+        else if (strcmp(pszArg, "--suite-out") == 0) { suite.pszOutput = pszValue; }
+        else if (strcmp(pszArg, "--suite-baseline") == 0) { suite.pszBaseline = pszValue; }
+        else if (strcmp(pszArg, "--suite-tolerance") == 0) { suite.fTolerance = atof(pszValue) / 100; }
+        else if (strcmp(pszArg, "--analyze") == 0) { analysisFrameStride = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--analyze-rows") == 0) { analysisRowStride = (UINT32)atoi(pszValue); }
+        else if (strcmp(pszArg, "--output") == 0)
+        {
+            outputSubtype = ParseSubtype(pszValue);
+            if (outputSubtype == 0)
+            {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+        i++;
+    }
+
+    if (bConvertCheck)
+    {
+        return RunConversionCheck(format.width, format.height, cThreads);
+    }
+
+    if (bStatsCheck)
+    {
+        return RunStatsCheck(format.width, format.height);
+    }
+
+    if (bLatencyCheck)
+    {
+        return RunLatencyCheck();
+    }
+
+    if (bNegotiateCheck)
+    {
+        return RunNegotiateCheck();
+    }
+
+    if (bCacheCheck)
+    {
+        return RunCacheCheck();
+    }
+
+    if (bRecoveryCheck)
+    {
+        return RunRecoveryCheck();
+    }
+
+    if (bMotionCheck)
+    {
+        return RunMotionCheck(format.width, format.height);
+    }
+
+    if (bScaleCheck)
+    {
+        return RunScaleCheck(format.width, format.height);
+    }
+
+    if (bBusCheck)
+    {
+        return RunBusCheck(format.width, format.height);
+    }
+
+    if (bShmCheck)
+    {
+        return RunShmCheck(argv[0], format.width, format.height);
+    }
+
+    if (bStreamCheck)
+    {
+        return RunStreamCheck(format.width, format.height);
+    }
+
+    if (bJpegCheck)
+    {
+        return RunJpegCheck(format.width, format.height);
+    }
+
+    if (bJpegBench)
+    {
+        return RunJpegBenchmark(cThreads);
+    }
+
+    if (bAsyncCheck)
+    {
+        return RunAsyncWriteCheck();
+    }
+
+    if (bReplayCheck)
+    {
+        return RunReplayCheck();
+    }
+
+    if (bStateCheck)
+    {
+        return RunStateCheck();
+    }
+
+    if (bBatchCheck)
+    {
+        return RunBatchCheck();
+    }
+
+    if (pszReplayPath)
+    {
+        return RunReplay(pszReplayPath, fReplaySpeed, bPush, outputSubtype);
+    }
+
+    if (pszShmRead)
+    {
+        return RunShmReader(pszShmRead, shmWorkUs);
+    }
+
+    if (bDropCheck)
+    {
+        return RunDropCheck(cQueueDepth);
+    }
+
+    if (bSuite)
+    {
+        // 套件总是启用亮度统计，使结果包含写入线程上的全部工作
+        suite.cQueueDepth = cQueueDepth;
+        suite.outputSubtype = outputSubtype ? outputSubtype : FOURCC_NV12;
+        suite.analysisFrameStride = analysisFrameStride ? analysisFrameStride : 1;
+        suite.analysisRowStride = analysisRowStride;
+        suite.pattern = pattern;
+
+        if (suite.cFrames == 0)
+        {
+            PrintUsage();
+            return -1;
+        }
+        return RunSuite(suite);
+    }
+
+    if (format.subtype == 0 || cFrames == 0)
+    {
+        PrintUsage();
+        return -1;
+    }
+
+    if (fPreRollSeconds > 0)
+    {
+        return RunPreRollCheck(format, cFrames, fPreRollSeconds, nTriggerAt ? nTriggerAt : cFrames / 2, cQueueDepth,
+            bUnthrottled, pattern, outputSubtype);
+    }
+
+    if (pszRawPath)
+    {
+        return RunRawSinkBenchmark(pszRawPath, bY4M, !bBuffered, ioBackend, cCameras, format, cFrames, cQueueDepth,
+            bUnthrottled, pattern, outputSubtype, bKeep, cWriteBatch, batchLingerUs, batchLatencyUs, bGather);
+    }
+
+    if (fSegmentSeconds > 0)
+    {
+        return RunSegmentCheck(format, cFrames, fSegmentSeconds, cRetainSegments, finalizeMs, cQueueDepth,
+            bUnthrottled, pattern, outputSubtype);
+    }
+
+    if (cCameras > 1)
+    {
+        // 先单独跑一路作为基准，再同时跑 cCameras 路
+        double fSingle = RunPipelines(1, format, cFrames, cQueueDepth, bUnthrottled, pattern, outputSubtype, FALSE);
+        double fTotal = RunPipelines(cCameras, format, cFrames, cQueueDepth, bUnthrottled, pattern, outputSubtype, TRUE);
+
+        printf("format      %s %ux%u, %u cameras, %u cores\n", GetSubtypeName(format.subtype), format.width, format.height,
+            cCameras, std::thread::hardware_concurrency());
+        printf("single      %.1f fps\n", fSingle);
+        printf("aggregate   %.1f fps, scaling %.2fx (%.0f%% of linear)\n", fTotal, fSingle > 0 ? fTotal / fSingle : 0,
+            fSingle > 0 ? fTotal / (fSingle * cCameras) * 100 : 0);
+        return 0;
+    }
+
+    CSyntheticSource source(pattern, bUnthrottled, cFrames);
+    CNullSink sink;
+    CNullSink simulcastSinks[MAX_SIMULCAST_OUTPUTS];
+    CSimulcastSink simulcast(&sink);
+    std::vector<std::string> simulcastHeights = pszSimulcast ? SplitList(pszSimulcast) : std::vector<std::string>();
+
+    for (size_t i = 0; i < simulcastHeights.size(); i++)
+    {
+        ScaleParams params = ScaleParams();
+        params.height = (UINT32)atoi(simulcastHeights[i].c_str());
+
+        if (i >= MAX_SIMULCAST_OUTPUTS || FAILED(simulcast.AddOutput(params, &simulcastSinks[i])))
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+
+    // 缩放只支持 4:2:0，没有指定输出格式时先转换成 NV12
+    if (simulcast.GetOutputCount() && outputSubtype == 0 && !IsScalingSupported(format.subtype))
+    {
+        outputSubtype = FOURCC_NV12;
+    }
+
+    CMotionGateSink gate(simulcast.GetOutputCount() ? (IFrameSink*)&simulcast : &sink, fMotionThreshold, motionHoldMs);
+    CFramePipeline pipeline;
+
+    source.SetGopLength(cGop);
+    pipeline.SetQueueDepth(cQueueDepth);
+    pipeline.SetOutputSubtype(outputSubtype);
+    pipeline.SetAnalysis(analysisFrameStride, analysisRowStride);
+    pipeline.SetOverloadPolicy(overloadPolicy, overloadValue);
+
+    HRESULT hr = pipeline.Start(&source, format, fMotionThreshold > 0 ? (IFrameSink*)&gate :
+        simulcast.GetOutputCount() ? (IFrameSink*)&simulcast : &sink);
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Failed to start pipeline (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    CStatsReporter reporter;
+
+    if (pszStatsFile)
+    {
+        WCHAR wszStatsFile[MAX_SEGMENT_PATH];
+        ToWidePath(pszStatsFile, wszStatsFile, MAX_SEGMENT_PATH);
+
+        reporter.AddPipeline("camera0", &pipeline);
+        hr = reporter.Start(wszStatsFile, bStatsJson ? StatsFormat_Json : StatsFormat_Text, statsIntervalMs);
+
+        if (FAILED(hr))
+        {
+            fprintf(stderr, "Failed to open %s (0x%08X).\n", pszStatsFile, (unsigned)hr);
+        }
+    }
+
+    PipelineStats stats;
+    UINT64 cSteadyAllocations = 0;
+
+    if (bAllocCheck)
+    {
+        // 前 1/4 的帧作为预热，之后的分配都计入稳态
+        do
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pipeline.GetStats(&stats);
+        } while (stats.cFrames < cFrames / 4 && pipeline.IsRunning());
+
+        UINT64 cBefore = g_cAllocations.load();
+        pipeline.Wait();
+        cSteadyAllocations = g_cAllocations.load() - cBefore;
+    }
+    else
+    {
+        pipeline.Wait();
+    }
+
+    pipeline.GetStats(&stats);
+
+    hr = pipeline.Stop();
+    reporter.Stop();
+
+    if (FAILED(hr))
+    {
+        fprintf(stderr, "Pipeline failed (0x%08X).\n", (unsigned)hr);
+        return -1;
+    }
+
+    const VideoFormat& actual = pipeline.GetFormat();
+
+    printf("format      %s %ux%u @ %u/%u%s\n", GetSubtypeName(actual.subtype), actual.width, actual.height,
+        actual.fpsNumerator, actual.fpsDenominator, bUnthrottled ? " (unthrottled)" : "");
+    if (pipeline.GetOutputFormat().subtype != actual.subtype)
+    {
+        printf("output      %s (%s)\n", GetSubtypeName(pipeline.GetOutputFormat().subtype), GetCpuLevelName(GetCpuLevel()));
+    }
+    printf("frames      %llu\n", (unsigned long long)stats.cFrames);
+    printf("elapsed     %.3f s\n", stats.fElapsed);
+    printf("first frame %.3f ms\n", stats.fFirstFrameMs);
+    printf("throughput  %.1f fps, %.1f MB/s\n", stats.fFps, stats.fElapsed > 0 ? stats.cbWritten / 1e6 / stats.fElapsed : 0);
+    printf("latency     avg %.3f ms, max %.3f ms\n", stats.fAvgLatencyMs, stats.fMaxLatencyMs);
+    printf("queue       capacity %u, high water %u, overflows %llu\n", stats.cQueueCapacity, stats.cQueueHighWater,
+        (unsigned long long)stats.cOverflows);
+    printf("pool        %u buffers, %u free\n", stats.cPoolBuffers, stats.cPoolFree);
+
+    DropStats drops;
+    pipeline.GetDropStats(&drops);
+
+    printf("overload    %s", GetOverloadPolicyName(pipeline.GetOverloadPolicy()));
+    for (UINT32 i = 0; i < DropReason_Count; i++)
+    {
+        if (drops.cDrops[i] != 0)
+        {
+            printf(", %s %llu", GetDropReasonName((DropReason)i), (unsigned long long)drops.cDrops[i]);
+        }
+    }
+    printf(drops.cTotal ? ", overloaded %u s\n" : "\n", drops.cOverloadSeconds);
+
+#if ENABLE_LATENCY_STATS
+    LatencySnapshot latency;
+    pipeline.GetLatency(&latency);
+
+    printf("%-11s %10s %10s %10s %10s %10s (us)\n", "stage", "mean", "p50", "p99", "p99.9", "max");
+    for (UINT32 i = 0; i < LatencyStage_Count; i++)
+    {
+        const LatencySummary& stage = latency.stages[i];
+
+        if (stage.cSamples != 0)
+        {
+            printf("  %-9s %10.1f %10.1f %10.1f %10.1f %10.1f\n", GetLatencyStageName((LatencyStage)i), stage.fMeanUs,
+                stage.fP50Us, stage.fP99Us, stage.fP999Us, stage.fMaxUs);
+        }
+    }
+#endif
+
+    if (fMotionThreshold > 0)
+    {
+        MotionGateStats motion;
+        gate.GetStats(&motion);
+
+        printf("motion      %llu written, %llu skipped (%.1f%%), %u events, %.1f us per frame\n",
+            (unsigned long long)motion.cForwarded, (unsigned long long)motion.cSkipped,
+            stats.cFrames ? motion.cSkipped * 100.0 / stats.cFrames : 0, motion.cMotionEvents, motion.fAvgMeasureUs);
+    }
+
+    for (UINT32 i = 0; i < simulcast.GetOutputCount(); i++)
+    {
+        SimulcastOutputStats output;
+        simulcast.GetOutputStats(i, &output);
+
+        printf("simulcast   %ux%u, %llu frames, %.1f us per frame\n", output.width, output.height,
+            (unsigned long long)output.cFrames, output.fAvgScaleUs);
+    }
+
+    FrameStats frameStats;
+    if (pipeline.GetFrameStats(&frameStats) == S_OK)
+    {
+        printf("analysis    %llu frames, black %llu, frozen %llu, overexposed %llu\n", (unsigned long long)stats.cAnalyzed,
+            (unsigned long long)stats.cBlackFrames, (unsigned long long)stats.cFrozenFrames,
+            (unsigned long long)stats.cOverexposedFrames);
+        printf("last frame  #%llu mean %.2f, variance %.2f, min %u, max %u, checksum %016llx\n",
+            (unsigned long long)frameStats.nSequence, frameStats.fMean, frameStats.fVariance, frameStats.minLuma,
+            frameStats.maxLuma, (unsigned long long)frameStats.checksum);
+    }
+
+    if (bAllocCheck)
+    {
+        printf("allocations %llu after warm-up\n", (unsigned long long)cSteadyAllocations);
+
+        if (cSteadyAllocations != 0)
+        {
+            fprintf(stderr, "FAILED: heap allocations in steady state.\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
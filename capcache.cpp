@@ -0,0 +1,532 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wctype.h>
+#include "capcache.h"
+
+// 缓存文件以 "CAPC" 开头，之后全部为小端的 UINT32 和 UTF-16 字符串，最后是前面所有字节的 FNV-1a 校验值：
+//   文件头   magic, version, flags（bit 0：设备列表有效）, 设备数
+//   每个设备 flags（bit 0：在设备列表中，bit 1：已探测）, 符号链接, 名称, 能力数, 每项能力 10 个 UINT32
+//   字符串   字符数, 字符
+static const UINT32 c_cacheMagic = FRAME_FOURCC('C', 'A', 'P', 'C');
+static const UINT32 c_flagListValid = 0x1;
+static const UINT32 c_flagListed = 0x1;
+static const UINT32 c_flagProbed = 0x2;
+
+// 计算 FNV-1a 校验值
+static UINT32 GetChecksum(const BYTE* pData, size_t cbData)
+{
+    UINT32 hash = 2166136261u;
+
+    for (size_t i = 0; i < cbData; i++)
+    {
+        hash = (hash ^ pData[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+// 不区分大小写比较两个符号链接
+static BOOL IsSameLink(const std::wstring& link, const WCHAR* pwszLink)
+{
+    size_t i = 0;
+
+    for (; i < link.size() && pwszLink[i] != 0; i++)
+    {
+        if (towlower(link[i]) != towlower(pwszLink[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return i == link.size() && pwszLink[i] == 0;
+}
+
+static void PutUInt32(std::vector<BYTE>* pData, UINT32 value)
+{
+    for (UINT32 i = 0; i < 4; i++)
+    {
+        pData->push_back((BYTE)(value >> (i * 8)));
+    }
+}
+
+static void PutString(std::vector<BYTE>* pData, const std::wstring& value)
+{
+    PutUInt32(pData, (UINT32)value.size());
+
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        pData->push_back((BYTE)value[i]);
+        pData->push_back((BYTE)(value[i] >> 8));
+    }
+}
+
+// CCacheReader 类按顺序读取缓存文件的内容，越界后所有读取都失败
+class CCacheReader
+{
+public:
+    CCacheReader(const BYTE* pData, size_t cbData) : m_pData(pData), m_cbData(cbData), m_pos(0) {}
+
+    BOOL ReadUInt32(UINT32* pValue)
+    {
+        if (m_cbData - m_pos < 4)
+        {
+            return FALSE;
+        }
+
+        *pValue = (UINT32)m_pData[m_pos] | ((UINT32)m_pData[m_pos + 1] << 8) |
+            ((UINT32)m_pData[m_pos + 2] << 16) | ((UINT32)m_pData[m_pos + 3] << 24);
+        m_pos += 4;
+        return TRUE;
+    }
+
+    BOOL ReadString(std::wstring* pValue)
+    {
+        UINT32 cch = 0;
+
+        if (!ReadUInt32(&cch) || (m_cbData - m_pos) / 2 < cch)
+        {
+            return FALSE;
+        }
+
+        pValue->resize(cch);
+        for (UINT32 i = 0; i < cch; i++)
+        {
+            (*pValue)[i] = (WCHAR)(m_pData[m_pos] | (m_pData[m_pos + 1] << 8));
+            m_pos += 2;
+        }
+        return TRUE;
+    }
+
+    size_t Remaining() const { return m_cbData - m_pos; }
+
+private:
+    const BYTE* m_pData;    // 数据
+    size_t      m_cbData;   // 数据长度
+    size_t      m_pos;      // 读取位置
+};
+
+// 以指定方式打开宽字符路径的文件
+static FILE* OpenCacheFile(const std::wstring& path, const WCHAR* pwszMode)
+{
+#ifdef _WIN32
+    FILE* pFile = nullptr;
+    return _wfopen_s(&pFile, path.c_str(), pwszMode) == 0 ? pFile : nullptr;
+#else
+    char szPath[4096];
+    char szMode[8];
+
+    if (wcstombs(szPath, path.c_str(), sizeof(szPath)) >= sizeof(szPath) ||
+        wcstombs(szMode, pwszMode, sizeof(szMode)) >= sizeof(szMode))
+    {
+        return nullptr;
+    }
+    return fopen(szPath, szMode);
+#endif
+}
+
+// 用 source 替换 target
+static BOOL ReplaceCacheFile(const std::wstring& source, const std::wstring& target)
+{
+#ifdef _WIN32
+    return MoveFileExW(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    char szSource[4096];
+    char szTarget[4096];
+
+    if (wcstombs(szSource, source.c_str(), sizeof(szSource)) >= sizeof(szSource) ||
+        wcstombs(szTarget, target.c_str(), sizeof(szTarget)) >= sizeof(szTarget))
+    {
+        return FALSE;
+    }
+    return rename(szSource, szTarget) == 0;
+#endif
+}
+
+CCapabilityCache::CCapabilityCache() :
+    m_bListValid(FALSE),
+    m_bDirty(FALSE)
+{
+}
+
+// 读取缓存文件，读不出有效内容时按空缓存继续
+HRESULT CCapabilityCache::Load(const WCHAR* pwszPath)
+{
+    if (pwszPath == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_path = pwszPath;
+    m_entries.clear();
+    m_bListValid = FALSE;
+    m_bDirty = FALSE;
+
+    FILE* pFile = OpenCacheFile(m_path, L"rb");
+
+    if (pFile == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    std::vector<BYTE> data;
+    BYTE buffer[4096];
+    size_t cbRead = 0;
+
+    while ((cbRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0 && data.size() <= MAX_CAPABILITY_CACHE_SIZE)
+    {
+        data.insert(data.end(), buffer, buffer + cbRead);
+    }
+
+    fclose(pFile);
+
+    if (data.size() > MAX_CAPABILITY_CACHE_SIZE || !Parse(data.data(), data.size()))
+    {
+        m_entries.clear();
+        m_bListValid = FALSE;
+        return S_FALSE;
+    }
+
+    return S_OK;
+}
+
+// 写到 <路径>.tmp 再替换原文件
+HRESULT CCapabilityCache::Save()
+{
+    std::vector<BYTE> data;
+    std::wstring path;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_path.empty())
+        {
+            return E_UNEXPECTED;
+        }
+        if (!m_bDirty)
+        {
+            return S_FALSE;
+        }
+
+        Serialize(&data);
+        path = m_path;
+        m_bDirty = FALSE;
+    }
+
+    std::wstring temp = path + L".tmp";
+    FILE* pFile = OpenCacheFile(temp, L"wb");
+    BOOL bWritten = FALSE;
+
+    if (pFile)
+    {
+        bWritten = fwrite(data.data(), 1, data.size(), pFile) == data.size();
+        bWritten = (fclose(pFile) == 0) && bWritten;
+    }
+
+    if (!bWritten || !ReplaceCacheFile(temp, path))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bDirty = TRUE;
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+// 获取设备列表
+BOOL CCapabilityCache::GetDevices(std::vector<CachedDevice>* pDevices) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    pDevices->clear();
+
+    if (!m_bListValid)
+    {
+        return FALSE;
+    }
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i].bListed)
+        {
+            pDevices->push_back(m_entries[i].device);
+        }
+    }
+
+    return TRUE;
+}
+
+// 按新的设备列表重排，列表之外的设备只保留已探测的能力表；内容不变时不标记改动
+void CCapabilityCache::SetDevices(const std::vector<CachedDevice>& devices)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<Entry> entries;
+    BOOL bChanged = !m_bListValid;
+
+    for (size_t i = 0; i < devices.size(); i++)
+    {
+        Entry entry = { devices[i], TRUE };
+        const Entry* pOld = FindEntry(devices[i].symbolicLink.c_str());
+
+        entry.device.bProbed = FALSE;
+        entry.device.capabilities.clear();
+
+        if (pOld && pOld->device.bProbed)
+        {
+            entry.device.bProbed = TRUE;
+            entry.device.capabilities = pOld->device.capabilities;
+        }
+
+        // 设备列表中的设备总排在最前面，位置变化说明枚举顺序变了
+        bChanged |= (pOld == nullptr || !pOld->bListed || (size_t)(pOld - m_entries.data()) != i ||
+            pOld->device.friendlyName != devices[i].friendlyName);
+        entries.push_back(entry);
+    }
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        BOOL bListed = FALSE;
+
+        for (size_t j = 0; j < devices.size() && !bListed; j++)
+        {
+            bListed = IsSameLink(devices[j].symbolicLink, m_entries[i].device.symbolicLink.c_str());
+        }
+
+        if (!bListed && m_entries[i].bListed)
+        {
+            bChanged = TRUE;
+        }
+        if (!bListed && m_entries[i].device.bProbed)
+        {
+            Entry entry = m_entries[i];
+            entry.bListed = FALSE;
+            entries.push_back(entry);
+        }
+    }
+
+    m_entries.swap(entries);
+    m_bListValid = TRUE;
+    m_bDirty |= bChanged;
+}
+
+// 使设备列表作废
+void CCapabilityCache::InvalidateDevices()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_bDirty |= m_bListValid;
+    m_bListValid = FALSE;
+}
+
+// 获取能力表
+BOOL CCapabilityCache::GetCapabilities(const WCHAR* pwszLink, CFormatNegotiator* pNegotiator) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const Entry* pEntry = FindEntry(pwszLink);
+
+    if (pEntry == nullptr || !pEntry->device.bProbed || pEntry->device.capabilities.empty())
+    {
+        return FALSE;
+    }
+
+    pNegotiator->Clear();
+
+    for (size_t i = 0; i < pEntry->device.capabilities.size(); i++)
+    {
+        pNegotiator->AddCapability(pEntry->device.capabilities[i]);
+    }
+
+    return TRUE;
+}
+
+// 保存能力表，设备不在缓存中时新建一项（不加入设备列表）
+void CCapabilityCache::StoreCapabilities(const WCHAR* pwszLink, const CFormatNegotiator& negotiator)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Entry* pEntry = FindEntry(pwszLink);
+
+    if (pEntry == nullptr)
+    {
+        Entry entry = { CachedDevice(), FALSE };
+        entry.device.symbolicLink = pwszLink;
+        m_entries.push_back(entry);
+        pEntry = &m_entries.back();
+    }
+
+    pEntry->device.bProbed = TRUE;
+    pEntry->device.capabilities.clear();
+
+    for (UINT32 i = 0; i < negotiator.Count(); i++)
+    {
+        pEntry->device.capabilities.push_back(negotiator.GetCapability(i));
+    }
+
+    m_bDirty = TRUE;
+}
+
+// 使能力表作废
+void CCapabilityCache::InvalidateCapabilities(const WCHAR* pwszLink)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Entry* pEntry = FindEntry(pwszLink);
+
+    if (pEntry && pEntry->device.bProbed)
+    {
+        pEntry->device.bProbed = FALSE;
+        pEntry->device.capabilities.clear();
+        m_bDirty = TRUE;
+    }
+}
+
+// 热插拔：接入的设备可能是换了固件的同一设备，能力表一起作废
+void CCapabilityCache::OnDeviceChange(const WCHAR* pwszLink, BOOL bArrival)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Entry* pEntry = FindEntry(pwszLink);
+
+    if (bArrival)
+    {
+        m_bDirty |= m_bListValid;
+        m_bListValid = FALSE;
+
+        if (pEntry && pEntry->device.bProbed)
+        {
+            pEntry->device.bProbed = FALSE;
+            pEntry->device.capabilities.clear();
+            m_bDirty = TRUE;
+        }
+    }
+    else if (pEntry)
+    {
+        m_entries.erase(m_entries.begin() + (pEntry - m_entries.data()));
+        m_bDirty = TRUE;
+    }
+}
+
+BOOL CCapabilityCache::IsDirty() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bDirty;
+}
+
+CCapabilityCache::Entry* CCapabilityCache::FindEntry(const WCHAR* pwszLink)
+{
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (IsSameLink(m_entries[i].device.symbolicLink, pwszLink))
+        {
+            return &m_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+const CCapabilityCache::Entry* CCapabilityCache::FindEntry(const WCHAR* pwszLink) const
+{
+    return const_cast<CCapabilityCache*>(this)->FindEntry(pwszLink);
+}
+
+// 序列化全部设备和校验值
+void CCapabilityCache::Serialize(std::vector<BYTE>* pData) const
+{
+    pData->clear();
+    PutUInt32(pData, c_cacheMagic);
+    PutUInt32(pData, CAPABILITY_CACHE_VERSION);
+    PutUInt32(pData, m_bListValid ? c_flagListValid : 0);
+    PutUInt32(pData, (UINT32)m_entries.size());
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        const CachedDevice& device = m_entries[i].device;
+
+        PutUInt32(pData, (m_entries[i].bListed ? c_flagListed : 0) | (device.bProbed ? c_flagProbed : 0));
+        PutString(pData, device.symbolicLink);
+        PutString(pData, device.friendlyName);
+        PutUInt32(pData, (UINT32)device.capabilities.size());
+
+        for (size_t j = 0; j < device.capabilities.size(); j++)
+        {
+            const MediaCapability& capability = device.capabilities[j];
+
+            PutUInt32(pData, capability.nTypeIndex);
+            PutUInt32(pData, capability.format.subtype);
+            PutUInt32(pData, capability.format.width);
+            PutUInt32(pData, capability.format.height);
+            PutUInt32(pData, capability.format.fpsNumerator);
+            PutUInt32(pData, capability.format.fpsDenominator);
+            PutUInt32(pData, capability.fpsMinNumerator);
+            PutUInt32(pData, capability.fpsMinDenominator);
+            PutUInt32(pData, capability.fpsMaxNumerator);
+            PutUInt32(pData, capability.fpsMaxDenominator);
+        }
+    }
+
+    PutUInt32(pData, GetChecksum(pData->data(), pData->size()));
+}
+
+// 校验并解析，失败时返回 FALSE，调用方清空缓存
+BOOL CCapabilityCache::Parse(const BYTE* pData, size_t cbData)
+{
+    if (cbData < 4)
+    {
+        return FALSE;
+    }
+
+    CCacheReader checksum(pData + cbData - 4, 4);
+    CCacheReader reader(pData, cbData - 4);
+    UINT32 expected = 0, magic = 0, version = 0, flags = 0, cEntries = 0;
+
+    if (!checksum.ReadUInt32(&expected) || expected != GetChecksum(pData, cbData - 4) ||
+        !reader.ReadUInt32(&magic) || magic != c_cacheMagic ||
+        !reader.ReadUInt32(&version) || version != CAPABILITY_CACHE_VERSION ||
+        !reader.ReadUInt32(&flags) || !reader.ReadUInt32(&cEntries))
+    {
+        return FALSE;
+    }
+
+    for (UINT32 i = 0; i < cEntries; i++)
+    {
+        Entry entry = { CachedDevice(), FALSE };
+        UINT32 entryFlags = 0, cCapabilities = 0;
+
+        if (!reader.ReadUInt32(&entryFlags) || !reader.ReadString(&entry.device.symbolicLink) ||
+            !reader.ReadString(&entry.device.friendlyName) || !reader.ReadUInt32(&cCapabilities) ||
+            reader.Remaining() / (10 * 4) < cCapabilities)
+        {
+            return FALSE;
+        }
+
+        entry.bListed = (entryFlags & c_flagListed) != 0;
+        entry.device.bProbed = (entryFlags & c_flagProbed) != 0;
+        entry.device.capabilities.resize(cCapabilities);
+
+        for (UINT32 j = 0; j < cCapabilities; j++)
+        {
+            MediaCapability& capability = entry.device.capabilities[j];
+            UINT32 nTypeIndex = 0;
+
+            reader.ReadUInt32(&nTypeIndex);
+            reader.ReadUInt32(&capability.format.subtype);
+            reader.ReadUInt32(&capability.format.width);
+            reader.ReadUInt32(&capability.format.height);
+            reader.ReadUInt32(&capability.format.fpsNumerator);
+            reader.ReadUInt32(&capability.format.fpsDenominator);
+            reader.ReadUInt32(&capability.fpsMinNumerator);
+            reader.ReadUInt32(&capability.fpsMinDenominator);
+            reader.ReadUInt32(&capability.fpsMaxNumerator);
+            reader.ReadUInt32(&capability.fpsMaxDenominator);
+            capability.nTypeIndex = nTypeIndex;
+        }
+
+        m_entries.push_back(entry);
+    }
+
+    m_bListValid = (flags & c_flagListValid) != 0;
+    return reader.Remaining() == 0;
+}
@@ -0,0 +1,85 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include "negotiate.h"
+
+// 缓存文件的格式版本，MediaCapability 的字段变化时递增，旧版本的文件按未命中处理
+const UINT32 CAPABILITY_CACHE_VERSION = 1;
+
+// 缓存文件的大小上限，超过时按损坏处理
+const size_t MAX_CAPABILITY_CACHE_SIZE = 4 * 1024 * 1024;
+
+// CachedDevice 结构体保存一个设备的缓存条目，以符号链接（MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK）为键
+struct CachedDevice
+{
+    std::wstring                    symbolicLink;   // 符号链接
+    std::wstring                    friendlyName;   // 设备名称
+    BOOL                            bProbed;        // capabilities 是否有效
+    std::vector<MediaCapability>    capabilities;   // 能力表，按原生媒体类型的索引顺序
+};
+
+// CCapabilityCache 类把设备列表和各设备的能力表保存在磁盘上，重新启动时不必再枚举设备、逐个探测媒体类型
+// 缓存只在使用时验证：设备列表在激活失败或收到热插拔通知后作废，能力表在选中的类型与设备不符时作废，
+// 之后的启动再完整枚举或探测；所有方法都可以从并行启动的多路采集中同时调用
+class CCapabilityCache
+{
+public:
+    CCapabilityCache();
+
+    // 读取缓存文件并记住路径；文件不存在、版本不符或校验失败时清空缓存并返回 S_FALSE
+    HRESULT Load(const WCHAR* pwszPath);
+
+    // 有改动时写回 Load 的路径：先写临时文件再替换，写到一半中断也不会留下损坏的缓存；没有改动时返回 S_FALSE
+    HRESULT Save();
+
+    // 获取上次完整枚举得到的设备列表，列表已作废或从未枚举时返回 FALSE
+    BOOL    GetDevices(std::vector<CachedDevice>* pDevices) const;
+
+    // 用一次完整枚举的结果替换设备列表，仍在列表中的设备保留已探测的能力表
+    void    SetDevices(const std::vector<CachedDevice>& devices);
+
+    // 使设备列表作废（例如缓存中的设备激活失败），下次启动时完整枚举
+    void    InvalidateDevices();
+
+    // 把设备的能力表加入 pNegotiator，未探测过时返回 FALSE
+    BOOL    GetCapabilities(const WCHAR* pwszLink, CFormatNegotiator* pNegotiator) const;
+
+    // 保存设备探测得到的能力表
+    void    StoreCapabilities(const WCHAR* pwszLink, const CFormatNegotiator& negotiator);
+
+    // 使设备的能力表作废（例如选中的类型与设备不符），下次使用时重新探测
+    void    InvalidateCapabilities(const WCHAR* pwszLink);
+
+    // 热插拔通知：接入时设备列表和该设备的能力表作废，移除时从列表中删除该设备
+    void    OnDeviceChange(const WCHAR* pwszLink, BOOL bArrival);
+
+    // 是否有未写回的改动
+    BOOL    IsDirty() const;
+
+private:
+    CCapabilityCache(const CCapabilityCache&);
+    CCapabilityCache& operator=(const CCapabilityCache&);
+
+    // Entry 结构体保存一个设备
+    struct Entry
+    {
+        CachedDevice    device;     // 设备
+        BOOL            bListed;    // 是否在设备列表中（只探测过能力表的设备不在列表中）
+    };
+
+    // 查找设备，不区分大小写，找不到时返回 nullptr；调用方持有 m_mutex
+    Entry*  FindEntry(const WCHAR* pwszLink);
+    const Entry* FindEntry(const WCHAR* pwszLink) const;
+
+    // 序列化与解析缓存文件的内容
+    void    Serialize(std::vector<BYTE>* pData) const;
+    BOOL    Parse(const BYTE* pData, size_t cbData);
+
+    mutable std::mutex          m_mutex;        // 保护以下成员
+    std::wstring                m_path;         // 缓存文件路径
+    std::vector<Entry>          m_entries;      // 设备，设备列表中的设备按枚举顺序排列
+    BOOL                        m_bListValid;   // 设备列表是否有效
+    BOOL                        m_bDirty;       // 是否有未写回的改动
+};
@@ -0,0 +1,36 @@
+#include <chrono>
+#include <thread>
+#include "capstate.h"
+
+// 让出时间片的次数，之后改为睡眠
+static const UINT32 c_cYieldSpins = 64;
+
+// 状态名称
+const char* GetCaptureStateName(CaptureState state)
+{
+    switch (state)
+    {
+    case CaptureState_NotReady:     return "not-ready";
+    case CaptureState_Ready:        return "ready";
+    case CaptureState_Capturing:    return "capturing";
+    case CaptureState_Stopping:     return "stopping";
+    case CaptureState_Recovering:   return "recovering";
+    default:                        return "unknown";
+    }
+}
+
+// 等待已进入的回调退出：回调通常只拷贝一帧，让出几次时间片就能等到；阻塞在背压中的回调改为睡眠等待
+void CCaptureStateMachine::WaitForCallbacks() const
+{
+    for (UINT32 i = 0; m_cCallbacks.load() != 0; i++)
+    {
+        if (i < c_cYieldSpins)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include "frame.h"
+
+// 捕获会话的状态
+enum CaptureState
+{
+    CaptureState_NotReady = 0,  // 没有会话
+    CaptureState_Ready,         // 正在建立会话，或会话已建立但不再处理回调（启动失败后等待结束）
+    CaptureState_Capturing,     // 正在捕获，回调处理样本
+    CaptureState_Stopping,      // 正在结束会话，回调直接返回
+    CaptureState_Recovering,    // 设备丢失，源读取器已释放，流水线和接收器照常写出，等待 ResumeDevice
+};
+
+// 状态名称，用于日志和检查输出
+const char* GetCaptureStateName(CaptureState state);
+
+// CCaptureStateMachine 类保存捕获会话的状态，供采集回调无锁读取
+//
+// 状态转换由调用方串行执行（CCapture 在 m_critsec 内），每次转换先用 Transition 离开 Capturing，
+// 再用 WaitForCallbacks 等待已进入的回调退出，之后才释放源读取器、停止流水线；
+// 回调用 EnterCallback 登记并检查状态，只有返回 TRUE 时才能访问会话，结束时调用 LeaveCallback。
+// 登记和检查状态都是顺序一致的原子操作，所以回调要么看到新状态直接返回，要么被转换方等到退出，
+// 不会在会话的资源释放之后仍在使用它们
+class CCaptureStateMachine
+{
+public:
+    CCaptureStateMachine() : m_state(CaptureState_NotReady), m_cCallbacks(0) {}
+
+    // 当前状态，不加锁
+    CaptureState GetState() const { return (CaptureState)m_state.load(); }
+
+    // 状态为 from 时改为 to 并返回 TRUE，否则不改变并返回 FALSE
+    BOOL    Transition(CaptureState from, CaptureState to)
+    {
+        LONG expected = from;
+        return m_state.compare_exchange_strong(expected, to) ? TRUE : FALSE;
+    }
+
+    // 无条件改为 to，返回原来的状态
+    CaptureState SetState(CaptureState to) { return (CaptureState)m_state.exchange(to); }
+
+    // 回调开始：状态为 Capturing 时登记并返回 TRUE，否则返回 FALSE（不需要 LeaveCallback）
+    BOOL    EnterCallback()
+    {
+        m_cCallbacks.fetch_add(1);
+
+        if (m_state.load() != CaptureState_Capturing)
+        {
+            m_cCallbacks.fetch_sub(1);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    // 回调结束
+    void    LeaveCallback() { m_cCallbacks.fetch_sub(1); }
+
+    // 等待已进入的回调全部退出，在离开 Capturing 之后调用；回调可能阻塞在 OverloadPolicy_Block 的等待中，
+    // 先让出时间片，之后每次睡眠 1 毫秒
+    void    WaitForCallbacks() const;
+
+    // 正在执行的回调数
+    UINT32  CallbacksInFlight() const { return (UINT32)m_cCallbacks.load(); }
+
+private:
+    CCaptureStateMachine(const CCaptureStateMachine&);
+    CCaptureStateMachine& operator=(const CCaptureStateMachine&);
+
+    std::atomic<LONG>   m_state;        // CaptureState
+    std::atomic<LONG>   m_cCallbacks;   // 已登记、尚未退出的回调数
+};
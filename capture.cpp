@@ -1,19 +1,21 @@
 #define WIN32_LEAN_AND_MEAN
 #include <stdio.h>
+#include <string.h>
 #include <new>
 #include <windows.h>
-#include <mfapi.h> //Microsoft Media Foundation APIķ
+#include <mfapi.h> //对Microsoft Media Foundation API的访问
 #include <mfidl.h>
 #include <mfreadwrite.h>
-#include <Wmcodecdsp.h>
 #include <assert.h>
 #include <Dbt.h>
 #include <shlwapi.h>
+#include <ks.h>
+#include <ksmedia.h>
 #include "capture.h"
 
-HRESULT CopyAttribute(IMFAttributes* pSrc, IMFAttributes* pDest, const GUID& key); // һIMFAttributesԵһIMFAttributesGUIDkeyָҪƵԵļ
+HRESULT CopyAttribute(IMFAttributes* pSrc, IMFAttributes* pDest, const GUID& key); // 从一个IMFAttributes对象复制属性到另一个IMFAttributes对象。GUID参数key指定了要复制的属性的键。
 
-//һģ庯ڰȫͷCOMüCOMٱʹʱҪReleaseüΪ0ʱԶ١
+//这是一个模板函数，用于安全地释放COM对象的引用计数。当COM对象不再被使用时，需要调用其Release方法来减少引用计数，当计数为0时，对象会自动销毁。
 template <class T> void SafeRelease(T** ppT)
 {
     if (*ppT)
@@ -23,7 +25,7 @@ template <class T> void SafeRelease(T** ppT)
     }
 }
 
-// DeviceList;Clear豸б
+// DeviceList类声明;Clear函数用于清除设备列表，
 void DeviceList::Clear()
 {
     for (UINT32 i = 0; i < m_cDevices; i++)
@@ -33,16 +35,108 @@ void DeviceList::Clear()
     CoTaskMemFree(m_ppDevices);
     m_ppDevices = nullptr;
     m_cDevices = 0;
+    m_bFromCache = FALSE;
 }
 
-// EnumerateDevicesö豸
-HRESULT DeviceList::EnumerateDevices()
+// 按符号链接创建视频采集设备的激活对象，并把符号链接和名称（可以为空）写入激活对象，
+// 之后与枚举得到的激活对象用法相同；设备已不存在时在激活时才会失败
+static HRESULT CreateDeviceActivate(const WCHAR* pwszLink, const WCHAR* pwszName, IMFActivate** ppActivate)
+{
+    IMFAttributes* pAttributes = nullptr;
+    IMFActivate* pActivate = nullptr;
+
+    HRESULT hr = MFCreateAttributes(&pAttributes, 2);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pAttributes->SetGUID(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE, MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_GUID);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pAttributes->SetString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, pwszLink);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFCreateDeviceSourceActivate(pAttributes, &pActivate);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pActivate->SetString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, pwszLink);
+    }
+
+    if (SUCCEEDED(hr) && pwszName)
+    {
+        hr = pActivate->SetString(MF_DEVSOURCE_ATTRIBUTE_FRIENDLY_NAME, pwszName);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppActivate = pActivate;
+        pActivate = nullptr;
+    }
+
+    SafeRelease(&pActivate);
+    SafeRelease(&pAttributes);
+    return hr;
+}
+
+// 按缓存的设备列表逐个创建激活对象
+HRESULT DeviceList::CreateFromCache(CCapabilityCache* pCache)
+{
+    std::vector<CachedDevice> devices;
+
+    if (!pCache->GetDevices(&devices) || devices.empty())
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = S_OK;
+
+    m_ppDevices = (IMFActivate**)CoTaskMemAlloc(sizeof(IMFActivate*) * devices.size());
+
+    if (m_ppDevices == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (size_t i = 0; i < devices.size() && SUCCEEDED(hr); i++)
+    {
+        IMFActivate* pActivate = nullptr;
+
+        hr = CreateDeviceActivate(devices[i].symbolicLink.c_str(), devices[i].friendlyName.c_str(), &pActivate);
+
+        if (SUCCEEDED(hr))
+        {
+            m_ppDevices[m_cDevices++] = pActivate;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Clear();
+        return hr;
+    }
+
+    m_bFromCache = TRUE;
+    return S_OK;
+}
+
+// EnumerateDevices用于枚举设备；缓存的设备列表可用时直接使用，否则完整枚举并写入缓存
+HRESULT DeviceList::EnumerateDevices(CCapabilityCache* pCache)
 {
     HRESULT hr = S_OK;
     IMFAttributes* pAttributes = nullptr;
 
     Clear();
 
+    if (pCache && CreateFromCache(pCache) == S_OK)
+    {
+        return S_OK;
+    }
+
     hr = MFCreateAttributes(&pAttributes, 1);
 
     if (SUCCEEDED(hr))
@@ -58,12 +152,54 @@ HRESULT DeviceList::EnumerateDevices()
         hr = MFEnumDeviceSources(pAttributes, &m_ppDevices, &m_cDevices);
     }
 
+    if (SUCCEEDED(hr) && pCache)
+    {
+        hr = UpdateCache(pCache);
+    }
+
     SafeRelease(&pAttributes);
 
     return hr;
 }
 
-// GetDeviceGetDeviceNameڻȡ豸Ϣ
+// 读取各设备的符号链接和名称写入缓存
+HRESULT DeviceList::UpdateCache(CCapabilityCache* pCache) const
+{
+    std::vector<CachedDevice> devices(m_cDevices);
+    HRESULT hr = S_OK;
+
+    for (UINT32 i = 0; i < m_cDevices && SUCCEEDED(hr); i++)
+    {
+        WCHAR* pwszLink = nullptr;
+        WCHAR* pwszName = nullptr;
+
+        hr = m_ppDevices[i]->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, &pwszLink, nullptr);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_ppDevices[i]->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_FRIENDLY_NAME, &pwszName, nullptr);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            devices[i].symbolicLink = pwszLink;
+            devices[i].friendlyName = pwszName;
+            devices[i].bProbed = FALSE;
+        }
+
+        CoTaskMemFree(pwszLink);
+        CoTaskMemFree(pwszName);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pCache->SetDevices(devices);
+    }
+
+    return hr;
+}
+
+// GetDevice和GetDeviceName用于获取设备信息。
 HRESULT DeviceList::GetDevice(UINT32 index, IMFActivate** ppActivate)
 {
     if (index >= Count())
@@ -77,7 +213,7 @@ HRESULT DeviceList::GetDevice(UINT32 index, IMFActivate** ppActivate)
     return S_OK;
 }
 
-// GetDeviceGetDeviceNameڻȡ豸Ϣ
+// GetDevice和GetDeviceName用于获取设备信息。
 HRESULT DeviceList::GetDeviceName(UINT32 index, WCHAR** ppszName)
 {
     if (index >= Count())
@@ -96,7 +232,18 @@ HRESULT DeviceList::GetDeviceName(UINT32 index, WCHAR** ppszName)
     return hr;
 }
 
-// ̬ڴCCaptureʵһھhwndôڽ¼ϢͨppCapture´CCaptureָ롣
+// 获取指定索引的设备的符号链接。
+HRESULT DeviceList::GetSymbolicLink(UINT32 index, WCHAR** ppszLink)
+{
+    if (index >= Count())
+    {
+        return E_INVALIDARG;
+    }
+
+    return m_ppDevices[index]->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, ppszLink, nullptr);
+}
+
+// 静态方法，用于创建CCapture类的实例。它接受一个窗口句柄hwnd，该窗口将接收事件消息，并通过ppCapture输出参数返回新创建的CCapture对象的指针。
 HRESULT CCapture::CreateInstance(HWND hwnd, CCapture** ppCapture)
 {
     if (ppCapture == nullptr)
@@ -117,26 +264,71 @@ HRESULT CCapture::CreateInstance(HWND hwnd, CCapture** ppCapture)
 }
 
 
-// CCaptureĹ캯캯ʼ󣬶Դ
+// CCapture类的构造函数和析构函数。构造函数初始化对象，而析构函数负责清理资源。
 CCapture::CCapture(HWND hwnd) :
     m_pReader(nullptr),
-    m_pWriter(nullptr),
     m_hwndEvent(hwnd),
     m_nRefCount(1),
     m_bFirstSample(FALSE),
     m_llBaseTime(0),
-    m_pwszSymbolicLink(nullptr)
+    m_pwszSymbolicLink(nullptr),
+    m_pFrameSink(nullptr),
+    m_pMotionGate(nullptr),
+    m_fMotionThreshold(0),
+    m_motionHoldMs(DEFAULT_MOTION_HOLD_MS),
+    m_pSimulcast(nullptr),
+    m_cSimulcast(0),
+    m_pBus(nullptr),
+    m_cSubscribers(0),
+    m_pShmRing(nullptr),
+    m_cShmSlots(DEFAULT_SHM_RING_SLOTS),
+    m_pStream(nullptr),
+    m_streamParams(),
+    m_bStreaming(FALSE),
+    m_pSegmented(nullptr),
+    m_llSegmentDuration(0),
+    m_cbSegmentSize(0),
+    m_cRetainSegments(0),
+    m_pPreRoll(nullptr),
+    m_fPreRollSeconds(0),
+    m_cbPreRollMemory(DEFAULT_PREROLL_MEMORY),
+    m_bRawRecording(FALSE),
+    m_constraints(),
+    m_negotiated(),
+    m_pCache(nullptr),
+    m_startup(),
+    m_pEvents(nullptr)
 {
+    for (UINT32 i = 0; i < MAX_SIMULCAST_OUTPUTS; i++)
+    {
+        m_pSimulcastSinks[i] = nullptr;
+        m_simulcastParams[i] = ScaleParams();
+    }
+
+    for (UINT32 i = 0; i < MAX_BUS_SUBSCRIBERS - 1; i++)
+    {
+        m_subscribers[i].pSink = nullptr;
+        m_subscribers[i].cDepth = 0;
+        m_subscribers[i].policy = OverloadPolicy_DropOldest;
+        m_subscribers[i].value = 0;
+    }
+
     InitializeCriticalSection(&m_critsec);
 }
 CCapture::~CCapture()
 {
     assert(m_pReader == nullptr);
-    assert(m_pWriter == nullptr);
+    assert(m_pFrameSink == nullptr);
+    assert(m_pPreRoll == nullptr);
+    assert(m_pMotionGate == nullptr);
+    assert(m_pSimulcast == nullptr);
+    assert(m_pBus == nullptr);
+    assert(m_pShmRing == nullptr);
+    assert(m_pStream == nullptr);
     DeleteCriticalSection(&m_critsec);
 }
 
-// ʵCOMüĳԱAddRefüReleaseü
+// 实现COM对象引用计数管理的成员函数。AddRef增加引用计数，而Release减少引用计数。
 ULONG CCapture::AddRef()
 {
     return InterlockedIncrement(&m_nRefCount);
@@ -151,7 +343,7 @@ ULONG CCapture::Release()
     return uCount;
 }
 
-// ʵCOMӿڲѯĳԱͻضĽӿָ롣
+// 这是实现COM接口查询的成员函数。它允许客户端请求特定的接口指针。
 HRESULT CCapture::QueryInterface(REFIID riid, void** ppv)
 {
     static const QITAB qit[] =
@@ -162,22 +354,22 @@ HRESULT CCapture::QueryInterface(REFIID riid, void** ppv)
     return QISearch(this, qit, riid, ppv);
 }
 
-// IMFSourceReaderCallbackӿڵʵ֣ڴȡݡȡ״̬־ʱݡ 
+// IMFSourceReaderCallback接口的实现，用于处理读取的样本数据。函数参数包括读取状态、流索引、流标志、时间戳和样本数据。 
 HRESULT CCapture::OnReadSample(HRESULT hrStatus, DWORD, DWORD, LONGLONG llTimeStamp, IMFSample* pSample)
 {
     // DWORD /*dwStreamIndex*/
     // DWORD /*dwStreamFlags*/
     // IMFSample* pSample      // Can be nullptr
-    
-    EnterCriticalSection(&m_critsec);
 
-    if (!IsCapturing())
+    // 不进入临界区：只在 Capturing 状态下处理，结束会话和设备丢失时先离开 Capturing 并等待本回调退出，
+    // 源读取器、基准时间和流水线在回调期间不会改变；之前发出、在状态改变之后才到达的回调直接返回
+    if (!m_state.EnterCallback())
     {
-        LeaveCriticalSection(&m_critsec);
         return S_OK;
     }
 
     HRESULT hr = S_OK;
+    LONGLONG llRearm = 0;
 
     if (FAILED(hrStatus))
     {
@@ -187,6 +379,11 @@ HRESULT CCapture::OnReadSample(HRESULT hrStatus, DWORD, DWORD, LONGLONG llTimeSt
 
     if (pSample)
     {
+#if ENABLE_LATENCY_STATS
+        // 摄像头样本的时间戳与 MFGetSystemTime 同一时钟（基于 QPC），两者之差是设备到回调的延迟
+        m_pipeline.RecordLatency(LatencyStage_Device, (MFGetSystemTime() - llTimeStamp) * 100);
+#endif
+
         if (m_bFirstSample)
         {
             m_llBaseTime = llTimeStamp;
@@ -196,19 +393,14 @@ HRESULT CCapture::OnReadSample(HRESULT hrStatus, DWORD, DWORD, LONGLONG llTimeSt
         // rebase the time stamp
         llTimeStamp -= m_llBaseTime;
 
-        hr = pSample->SetSampleTime(llTimeStamp);
-
-        if (FAILED(hr)) { goto done; }
-
-        hr = m_pWriter->WriteSample(0, pSample);
+        // 只拷贝进帧队列，编码和写文件由流水线的写入线程完成
+        hr = DeliverSample(llTimeStamp, pSample);
 
         if (FAILED(hr)) { goto done; }
-
-        // Print sample data
-        PrintSampleData(pSample);
     }
 
     // Read another sample.
+    llRearm = GetLatencyClock();
     hr = m_pReader->ReadSample(
         (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
         0,
@@ -217,46 +409,80 @@ HRESULT CCapture::OnReadSample(HRESULT hrStatus, DWORD, DWORD, LONGLONG llTimeSt
         nullptr,   // timestamp
         nullptr    // sample
     );
+    m_pipeline.RecordLatency(LatencyStage_Rearm, GetLatencyClock() - llRearm);
 
 done:
+    m_state.LeaveCallback();
+
+    // NotifyError 要进入临界区，必须在 LeaveCallback 之后：SuspendDevice 和 EndCaptureSession 持有临界区等待回调退出
     if (FAILED(hr))
     {
         NotifyError(hr);
     }
+    return hr;
+}
+
+// 通知错误：OnReadSample 出错后不再发起 ReadSample，由窗口或 CDeviceRecovery 决定如何恢复。
+// 事件队列由 SetDeviceEventQueue 在其他线程替换，符号链接在 ResumeDevice 中被释放和替换，都在临界区内访问；
+// Post 把符号链接拷贝进事件，队列在 StopRecovery 清空指针之后才销毁
+void CCapture::NotifyError(HRESULT hr)
+{
+    if (m_hwndEvent)
+    {
+        PostMessage(m_hwndEvent, WM_APP_PREVIEW_ERROR, (WPARAM)hr, 0L);
+    }
+
+    EnterCriticalSection(&m_critsec);
+
+    if (m_pEvents && m_pwszSymbolicLink)
+    {
+        m_pEvents->Post(DeviceEvent_Error, m_pwszSymbolicLink, hr);
+    }
 
     LeaveCriticalSection(&m_critsec);
-    return hr;
 }
 
-//ӡͼ
-void CCapture::PrintSampleData(IMFSample* pSample)
+// 把样本数据拷贝进帧队列。放不下时按流水线的过载策略处理：默认丢弃该帧并计数，不阻塞采集；
+// OverloadPolicy_Block 下最多阻塞设定的时长，推迟下一次 ReadSample，让设备侧感受到背压。
+HRESULT CCapture::DeliverSample(LONGLONG llTimeStamp, IMFSample* pSample)
 {
     IMFMediaBuffer* pBuffer = nullptr;
     BYTE* pData = nullptr;
-    DWORD maxLen, currentLen;
+    DWORD cbData = 0;
 
-    if (SUCCEEDED(pSample->GetBufferByIndex(0, &pBuffer)) &&
-        SUCCEEDED(pBuffer->Lock(&pData, &maxLen, &currentLen)))
+    HRESULT hr = pSample->ConvertToContiguousBuffer(&pBuffer);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pBuffer->Lock(&pData, nullptr, &cbData);
+    }
+
+    if (SUCCEEDED(hr))
     {
-        char* pCharData = reinterpret_cast<char*>(pData);
-        /*
-        for (DWORD i = 0; i < currentLen; i++)
+        CaptureFrame frame = CaptureFrame();
+        UINT32 bCleanPoint = TRUE;
+
+        frame.pData = pData;
+        frame.cbData = cbData;
+        frame.llTimestamp = llTimeStamp;
+
+        // 未压缩的帧总是独立的；压缩格式（例如 H.264）只有关键帧带 MFSampleExtension_CleanPoint，流水线丢帧时据此保留关键帧
+        if (!IsSupportedSubtype(m_pipeline.GetFormat().subtype) &&
+            (FAILED(pSample->GetUINT32(MFSampleExtension_CleanPoint, &bCleanPoint)) || !bCleanPoint))
         {
-            printf("%02X ", pCharData[i]);
-            if ((i + 1) % 32 == 0)
-            {
-                printf("\n");
-            }
+            frame.flags = FrameFlag_Delta;
         }
-        printf("\n");
-        */
+
+        hr = m_pipeline.PushFrame(frame);
+
         pBuffer->Unlock();
     }
 
     SafeRelease(&pBuffer);
+    return hr;
 }
 
-//ýԴ׼ȡݡ
+//打开媒体源，并准备读取数据。
 HRESULT CCapture::OpenMediaSource(IMFMediaSource* pSource)
 {
     HRESULT hr = S_OK;
@@ -282,14 +508,23 @@ HRESULT CCapture::OpenMediaSource(IMFMediaSource* pSource)
     return hr;
 }
 
-//ʼƵһļͱ
+//开始捕获视频。它接受一个激活对象、文件名和编码参数。
 HRESULT CCapture::StartCapture(IMFActivate* pActivate, const WCHAR* pwszFileName, const EncodingParameters& param)
 {
     HRESULT hr = S_OK;
     IMFMediaSource* pSource = nullptr;
+    LONGLONG llStart = GetClockTime();
 
     EnterCriticalSection(&m_critsec);
 
+    if (!m_state.Transition(CaptureState_NotReady, CaptureState_Ready))
+    {
+        LeaveCriticalSection(&m_critsec);
+        return E_UNEXPECTED;
+    }
+
+    m_startup = StartupTimes();
+
     hr = pActivate->ActivateObject(
         __uuidof(IMFMediaSource),
         (void**)&pSource
@@ -311,17 +546,16 @@ HRESULT CCapture::StartCapture(IMFActivate* pActivate, const WCHAR* pwszFileName
 
     if (SUCCEEDED(hr))
     {
-        hr = MFCreateSinkWriterFromURL(
-            pwszFileName,
-            nullptr,
-            nullptr,
-            &m_pWriter
-        );
+        // 首帧时长从激活设备开始计算
+        m_startup.fActivateMs = (GetClockTime() - llStart) / 1e4;
+        m_pipeline.SetStartTime(llStart);
+
+        hr = ConfigureCapture(pwszFileName, param);
     }
 
     if (SUCCEEDED(hr))
     {
-        hr = ConfigureCapture(param);
+        m_startup.fConfigureMs = (GetClockTime() - llStart) / 1e4 - m_startup.fActivateMs;
     }
 
     if (SUCCEEDED(hr))
@@ -329,6 +563,9 @@ HRESULT CCapture::StartCapture(IMFActivate* pActivate, const WCHAR* pwszFileName
         m_bFirstSample = TRUE;
         m_llBaseTime = 0;
 
+        // 先进入 Capturing，第一个样本的回调才会被处理
+        m_state.SetState(CaptureState_Capturing);
+
         hr = m_pReader->ReadSample(
             (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
             0,
@@ -339,264 +576,2025 @@ HRESULT CCapture::StartCapture(IMFActivate* pActivate, const WCHAR* pwszFileName
         );
     }
 
-    SafeRelease(&pSource);
-    LeaveCriticalSection(&m_critsec);
-    return hr;
-}
-
-// Ự
-HRESULT CCapture::EndCaptureSession()
-{
-    EnterCriticalSection(&m_critsec);
-    HRESULT hr = S_OK;
-
-    if (m_pWriter)
+    // 启动失败时 ReadSample 没有发出，不会有回调进入；释放已建立的部分，可以直接再次开始
+    if (FAILED(hr))
     {
-        hr = m_pWriter->Finalize();
+        m_state.SetState(CaptureState_Stopping);
+        EndCaptureInternal();
+        m_state.SetState(CaptureState_NotReady);
     }
 
-    SafeRelease(&m_pWriter);
-    SafeRelease(&m_pReader);
-
+    SafeRelease(&pSource);
     LeaveCriticalSection(&m_critsec);
-
     return hr;
 }
 
-// ǷڲƵ
-BOOL CCapture::IsCapturing()
+// 获取启动各阶段的耗时，首帧时长来自流水线。
+void CCapture::GetStartupTimes(StartupTimes* pTimes) const
 {
-    EnterCriticalSection(&m_critsec);
-    BOOL bIsCapturing = (m_pWriter != nullptr);
-
-    LeaveCriticalSection(&m_critsec);
+    PipelineStats stats;
+    m_pipeline.GetStats(&stats);
 
-    return bIsCapturing;
+    *pTimes = m_startup;
+    pTimes->fFirstFrameMs = stats.fFirstFrameMs;
 }
 
-// 豸Ƿʧ
-HRESULT CCapture::CheckDeviceLost(DEV_BROADCAST_HDR* pHdr, BOOL* pbDeviceLost)
+// 从采集后端开始捕获：由流水线线程读取帧，经 CMFSinkWriterSink 编码写入文件。
+HRESULT CCapture::StartCapture(ICaptureSource* pSource, const VideoFormat& format, const WCHAR* pwszFileName, const EncodingParameters& param)
 {
-    if (pbDeviceLost == nullptr)
+    if (pSource == nullptr || pwszFileName == nullptr)
     {
         return E_POINTER;
     }
-    EnterCriticalSection(&m_critsec);
 
-    DEV_BROADCAST_DEVICEINTERFACE* pDi = nullptr;
+    HRESULT hr = S_OK;
+    IFrameSink* pSink = nullptr;
 
-    *pbDeviceLost = FALSE;
+    EnterCriticalSection(&m_critsec);
 
-    if (!IsCapturing())
-    {
-        goto done;
-    }
-    if (pHdr == nullptr)
-    {
-        goto done;
-    }
-    if (pHdr->dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE)
+    if (!m_state.Transition(CaptureState_NotReady, CaptureState_Ready))
     {
+        hr = E_UNEXPECTED;
         goto done;
     }
 
-    pDi = (DEV_BROADCAST_DEVICEINTERFACE*)pHdr;
+    hr = CreateFrameSink(pwszFileName, param, format, &pSink);
 
-    if (m_pwszSymbolicLink)
+    if (SUCCEEDED(hr))
     {
-        if (_wcsicmp(m_pwszSymbolicLink, pDi->dbcc_name) == 0)
+        hr = m_pipeline.Start(pSource, format, pSink);
+
+        if (FAILED(hr))
         {
-            *pbDeviceLost = TRUE;
+            DeleteFrameSink();
         }
     }
+
+    m_state.SetState(SUCCEEDED(hr) ? CaptureState_Capturing : CaptureState_NotReady);
+
 done:
     LeaveCriticalSection(&m_critsec);
-    return S_OK;
+    return hr;
 }
 
-// Դȡܰý͵ȡ
-HRESULT ConfigureSourceReader(IMFSourceReader* pReader)
+// 结束捕获会话。
+HRESULT CCapture::EndCaptureSession()
 {
-    GUID subtypes[] = {
-    MFVideoFormat_NV12, MFVideoFormat_YUY2, MFVideoFormat_UYVY,
-    MFVideoFormat_RGB32, MFVideoFormat_RGB24, MFVideoFormat_IYUV
-    };
+    EnterCriticalSection(&m_critsec);
     HRESULT hr = S_OK;
-    BOOL    bUseNativeType = FALSE;
 
-    GUID subtype = { 0 };
+    // 先进入 Stopping，之后到达的回调直接返回；等正在执行的回调退出后才停止流水线、释放源读取器
+    if (m_state.SetState(CaptureState_Stopping) != CaptureState_NotReady)
+    {
+        m_state.WaitForCallbacks();
 
-    IMFMediaType* pType = nullptr;
+        if (m_pFrameSink)
+        {
+            hr = m_pipeline.Stop();
+            DeleteFrameSink();
+        }
 
-    hr = pReader->GetNativeMediaType(
-        (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
-        0,  // Type index
-        &pType
-    );
+        SafeRelease(&m_pReader);
+    }
 
-    if (FAILED(hr)) { goto done; }
+    m_state.SetState(CaptureState_NotReady);
+    LeaveCriticalSection(&m_critsec);
 
-    hr = pType->GetGUID(MF_MT_SUBTYPE, &subtype);
+    return hr;
+}
 
-    if (FAILED(hr)) { goto done; }
+// 触发预录：把环形缓冲区中最近 N 秒的帧写入文件，之后的帧接着写入。
+HRESULT CCapture::TriggerRecording()
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
 
-    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    if (m_pFrameSink == nullptr)
     {
-        if (subtype == subtypes[i])
-        {
-            hr = pReader->SetCurrentMediaType(
-                (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
-                nullptr,
-                pType
-            );
-
-            bUseNativeType = TRUE;
-            break;
-        }
+        hr = E_UNEXPECTED; // 没有在捕获
     }
-
-    if (!bUseNativeType)
+    else if (m_pPreRoll == nullptr)
     {
-        for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
-        {
-            hr = pType->SetGUID(MF_MT_SUBTYPE, subtypes[i]);
+        hr = S_FALSE; // 未启用预录，所有帧都已在写入
+    }
+    else
+    {
+        m_pPreRoll->Trigger();
+    }
 
-            if (FAILED(hr)) { goto done; }
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
 
-            hr = pReader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr,pType);
+// 获取分段写入的统计。
+HRESULT CCapture::GetSegmentStats(SegmentStats* pStats)
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_FALSE;
 
-            if (SUCCEEDED(hr))
-            {
-                break;
-            }
-        }
+    if (m_pSegmented)
+    {
+        m_pSegmented->GetStats(pStats);
+        hr = S_OK;
     }
-done:
-    SafeRelease(&pType);
+
+    LeaveCriticalSection(&m_critsec);
     return hr;
 }
 
-// ڲԴ
-HRESULT ConfigureEncoder(const EncodingParameters& params, IMFMediaType* pType, IMFSinkWriter* pWriter, DWORD* pdwStreamIndex)
+// 获取运动门控的统计。
+HRESULT CCapture::GetMotionStats(MotionGateStats* pStats)
 {
-    HRESULT hr = S_OK;
-    IMFMediaType* pType2 = nullptr;
-
-    hr = MFCreateMediaType(&pType2);
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_FALSE;
 
-    if (SUCCEEDED(hr))
+    if (m_pMotionGate)
     {
-        hr = pType2->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+        m_pMotionGate->GetStats(pStats);
+        hr = S_OK;
     }
 
-    if (SUCCEEDED(hr))
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 添加一路缩放输出。
+HRESULT CCapture::AddSimulcastOutput(const ScaleParams& params, const WCHAR* pwszSuffix)
+{
+    if (pwszSuffix == nullptr)
     {
-        hr = pType2->SetGUID(MF_MT_SUBTYPE, params.subtype);
+        return E_POINTER;
     }
 
-    if (SUCCEEDED(hr))
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
+
+    if (m_pFrameSink)
     {
-        hr = pType2->SetUINT32(MF_MT_AVG_BITRATE, params.bitrate);
+        hr = E_UNEXPECTED; // 正在捕获
     }
-
-    if (SUCCEEDED(hr))
+    else if (m_cSimulcast >= MAX_SIMULCAST_OUTPUTS || pwszSuffix[0] == L'\0')
     {
-        hr = CopyAttribute(pType, pType2, MF_MT_FRAME_SIZE);
+        hr = E_INVALIDARG;
     }
-
-    if (SUCCEEDED(hr))
+    else
     {
-        hr = CopyAttribute(pType, pType2, MF_MT_FRAME_RATE);
+        m_simulcastParams[m_cSimulcast] = params;
+        m_simulcastSuffixes[m_cSimulcast] = pwszSuffix;
+        m_cSimulcast++;
     }
 
-    if (SUCCEEDED(hr))
-    {
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 获取一路缩放输出的统计。
+HRESULT CCapture::GetSimulcastStats(UINT32 index, SimulcastOutputStats* pStats)
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_FALSE;
+
+    if (m_pSimulcast)
+    {
+        hr = m_pSimulcast->GetOutputStats(index, pStats);
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 添加一个帧订阅者。
+HRESULT CCapture::AddSubscriber(const char* pszName, IFrameSink* pSink, UINT32 cDepth, OverloadPolicy policy, UINT32 value)
+{
+    if (pszName == nullptr || pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
+
+    if (m_pFrameSink)
+    {
+        hr = E_UNEXPECTED; // 正在捕获
+    }
+    else if (m_cSubscribers >= MAX_BUS_SUBSCRIBERS - 1 || cDepth == 0 || policy == OverloadPolicy_Block)
+    {
+        hr = E_INVALIDARG;
+    }
+    else
+    {
+        BusSubscriber& subscriber = m_subscribers[m_cSubscribers];
+
+        subscriber.name = pszName;
+        subscriber.pSink = pSink;
+        subscriber.cDepth = cDepth;
+        subscriber.policy = policy;
+        subscriber.value = value;
+        m_cSubscribers++;
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 设置共享内存帧环。
+HRESULT CCapture::SetSharedMemoryRing(const char* pszName, UINT32 cSlots)
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
+
+    if (m_pFrameSink)
+    {
+        hr = E_UNEXPECTED; // 正在捕获
+    }
+    else if (pszName && pszName[0] != '\0' && (strlen(pszName) > MAX_SHM_RING_NAME || cSlots < 2))
+    {
+        hr = E_INVALIDARG;
+    }
+    else
+    {
+        m_shmRingName = pszName ? pszName : "";
+        m_cShmSlots = cSlots;
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 设置网络发送。
+HRESULT CCapture::SetNetworkStream(const StreamParams* pParams)
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
+
+    if (m_pFrameSink)
+    {
+        hr = E_UNEXPECTED; // 正在捕获
+    }
+    else if (pParams && (pParams->cMaxClients > MAX_STREAM_CLIENTS || pParams->cClientQueue > MAX_STREAM_CLIENT_QUEUE))
+    {
+        hr = E_INVALIDARG;
+    }
+    else
+    {
+        m_bStreaming = pParams != nullptr;
+        m_streamParams = pParams ? *pParams : StreamParams();
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 获取网络发送的统计。
+HRESULT CCapture::GetStreamStats(StreamStats* pStats)
+{
+    if (pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_FALSE;
+
+    if (m_pStream)
+    {
+        m_pStream->GetStats(pStats);
+        hr = S_OK;
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 获取一个订阅者的名称和统计。
+HRESULT CCapture::GetSubscriberStats(UINT32 index, const char** ppszName, SubscriberStats* pStats)
+{
+    if (ppszName == nullptr || pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_FALSE;
+
+    if (m_pBus)
+    {
+        hr = m_pBus->GetSubscriberStats(index, pStats);
+        *ppszName = m_pBus->GetSubscriberName(index);
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 缩放输出的文件路径：在扩展名之前插入 _<后缀>，没有扩展名时加在末尾。
+static std::wstring MakeSimulcastPath(const WCHAR* pwszFileName, const std::wstring& suffix)
+{
+    std::wstring path = pwszFileName;
+    size_t iDot = path.find_last_of(L'.');
+    size_t iSlash = path.find_last_of(L"\\/");
+
+    if (iDot == std::wstring::npos || (iSlash != std::wstring::npos && iDot < iSlash))
+    {
+        iDot = path.size();
+    }
+
+    return path.insert(iDot, L"_" + suffix);
+}
+
+// 创建各路缩放输出的接收器：与存档使用同一个工厂，编码时按像素数之比缩小比特率，创建之后恢复存档的编码参数。
+HRESULT CCapture::CreateSimulcastSinks(IFrameSinkFactory* pFactory, const WCHAR* pwszFileName,
+    const EncodingParameters& param, const VideoFormat& format)
+{
+    // 缩放在流水线转换之后进行，输入为流水线的输出格式（4:2:0，见 GetRecordingConstraints）
+    VideoFormat input = format;
+    HRESULT hr = S_OK;
+
+    input.subtype = GetRecordingConstraints().outputSubtype;
+
+    for (UINT32 i = 0; i < m_cSimulcast && SUCCEEDED(hr); i++)
+    {
+        VideoFormat output;
+        EncodingParameters scaled = param;
+
+        hr = GetScaledFormat(input, m_simulcastParams[i], &output);
+
+        if (SUCCEEDED(hr))
+        {
+            UINT64 bitrate = (UINT64)param.bitrate * output.width * output.height / ((UINT64)input.width * input.height);
+
+            scaled.bitrate = bitrate ? (UINT32)bitrate : 1;
+            m_sinkFactory.SetParameters(scaled);
+            hr = pFactory->CreateSink(MakeSimulcastPath(pwszFileName, m_simulcastSuffixes[i]).c_str(),
+                &m_pSimulcastSinks[i]);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pSimulcast->AddOutput(m_simulcastParams[i], m_pSimulcastSinks[i]);
+        }
+    }
+
+    m_sinkFactory.SetParameters(param);
+    return hr;
+}
+
+// 创建写入文件的接收器：编码时为 CMFSinkWriterSink（MJPEG 为 CMjpegFileSink），未压缩录制时为 CRawFileSink；启用分段时由 CSegmentedSink
+// 按段创建，添加了缩放输出时由 CSimulcastSink 同时写给存档和各路缩放输出，启用运动门控时在外面包一层
+// CMotionGateSink，启用预录时在最外面再包一层 CPreRollSink，这样预录缓冲的帧也要经过门控；
+// 添加了订阅者时，以上整条链作为帧总线的第一个订阅者，总线的订阅者持有的缓冲区由流水线的缓冲池留出；
+// ppSink 返回交给流水线的接收器。
+HRESULT CCapture::CreateFrameSink(const WCHAR* pwszFileName, const EncodingParameters& param, const VideoFormat& format,
+    IFrameSink** ppSink)
+{
+    IFrameSinkFactory* pFactory = &m_sinkFactory;
+    HRESULT hr = S_OK;
+
+    if (m_bRawRecording)
+    {
+        // 原始文件按采集格式无损写入，Y4M 只能表示平面格式，由写入线程转换成 I420；
+        // 有缩放输出时统一转换成 NV12，缩放只支持 4:2:0
+        m_pipeline.SetOutputSubtype(GetRecordingConstraints().outputSubtype);
+        pFactory = &m_rawFactory;
+    }
+    else
+    {
+        // 编码器的输入统一为 NV12，采集格式不同时由流水线的写入线程转换，不再经过颜色转换 DMO
+        m_pipeline.SetOutputSubtype(FOURCC_NV12);
+
+        if (param.subtype == MFVideoFormat_MJPG)
+        {
+            // 没有硬件编码器时用内置的 JPEG 编码器，按切片在线程池上并行编码
+            m_mjpegFactory.SetQuality(param.quality);
+            pFactory = &m_mjpegFactory;
+        }
+        else
+        {
+            m_sinkFactory.SetParameters(param);
+        }
+    }
+
+    if (m_llSegmentDuration > 0 || m_cbSegmentSize > 0)
+    {
+        m_pSegmented = new (std::nothrow) CSegmentedSink(pFactory, pwszFileName, m_llSegmentDuration,
+            m_cbSegmentSize, m_cRetainSegments);
+        m_pFrameSink = m_pSegmented;
+        hr = m_pFrameSink ? S_OK : E_OUTOFMEMORY;
+    }
+    else
+    {
+        hr = pFactory->CreateSink(pwszFileName, &m_pFrameSink);
+    }
+
+    if (FAILED(hr))
+    {
+        m_pFrameSink = nullptr;
+        m_pSegmented = nullptr;
+        return hr;
+    }
+
+    IFrameSink* pSink = m_pFrameSink;
+
+    if (m_cSimulcast > 0)
+    {
+        m_pSimulcast = new (std::nothrow) CSimulcastSink(m_pFrameSink);
+        hr = m_pSimulcast ? CreateSimulcastSinks(pFactory, pwszFileName, param, format) : E_OUTOFMEMORY;
+
+        if (FAILED(hr))
+        {
+            DeleteFrameSink();
+            return hr;
+        }
+
+        pSink = m_pSimulcast;
+    }
+
+    if (m_fMotionThreshold > 0)
+    {
+        m_pMotionGate = new (std::nothrow) CMotionGateSink(pSink, m_fMotionThreshold, m_motionHoldMs);
+
+        if (m_pMotionGate == nullptr)
+        {
+            DeleteFrameSink();
+            return E_OUTOFMEMORY;
+        }
+
+        pSink = m_pMotionGate;
+    }
+
+    if (m_fPreRollSeconds > 0)
+    {
+        m_pPreRoll = new (std::nothrow) CPreRollSink(pSink, m_fPreRollSeconds, m_cbPreRollMemory);
+
+        if (m_pPreRoll == nullptr)
+        {
+            DeleteFrameSink();
+            return E_OUTOFMEMORY;
+        }
+
+        pSink = m_pPreRoll;
+    }
+
+    m_pipeline.SetSinkBuffers(0);
+
+    if (m_cSubscribers > 0 || !m_shmRingName.empty() || m_bStreaming)
+    {
+        // 文件接收器接替流水线队列的角色，阻塞策略会拖住其余订阅者，改为丢弃新帧
+        OverloadPolicy policy = m_pipeline.GetOverloadPolicy();
+
+        m_pBus = new (std::nothrow) CFrameBus();
+        hr = m_pBus ? m_pBus->Subscribe("file", pSink, m_pipeline.GetQueueDepth(),
+            (policy == OverloadPolicy_Block) ? OverloadPolicy_DropNewest : policy) : E_OUTOFMEMORY;
+
+        for (UINT32 i = 0; i < m_cSubscribers && SUCCEEDED(hr); i++)
+        {
+            const BusSubscriber& subscriber = m_subscribers[i];
+
+            hr = m_pBus->Subscribe(subscriber.name.c_str(), subscriber.pSink, subscriber.cDepth,
+                subscriber.policy, subscriber.value);
+        }
+
+        // 拷贝进共享内存很快，两帧的队列足以吸收偶尔的调度延迟，跟不上时丢最旧的帧，读取方总能拿到最新的画面
+        if (SUCCEEDED(hr) && !m_shmRingName.empty())
+        {
+            m_pShmRing = new (std::nothrow) CShmRingSink(m_shmRingName.c_str(), m_cShmSlots);
+            hr = m_pShmRing ? m_pBus->Subscribe("shm", m_pShmRing, 2, OverloadPolicy_DropOldest) : E_OUTOFMEMORY;
+        }
+
+        // 观看端只需要最新的画面，转换跟不上时排队的帧到发送时已经过时，队列只留一帧，丢最旧的
+        if (SUCCEEDED(hr) && m_bStreaming)
+        {
+            m_pStream = new (std::nothrow) CNetStreamSink(m_streamParams);
+            hr = m_pStream ? m_pBus->Subscribe("net", m_pStream, 1, OverloadPolicy_DropOldest) : E_OUTOFMEMORY;
+        }
+
+        if (FAILED(hr))
+        {
+            DeleteFrameSink();
+            return hr;
+        }
+
+        m_pipeline.SetSinkBuffers(m_pBus->GetBufferDemand());
+        pSink = m_pBus;
+    }
+
+    *ppSink = pSink;
+    return S_OK;
+}
+
+// 删除接收器，在流水线停止之后调用。
+void CCapture::DeleteFrameSink()
+{
+    delete m_pBus;
+    m_pBus = nullptr;
+
+    delete m_pShmRing;
+    m_pShmRing = nullptr;
+
+    delete m_pStream;
+    m_pStream = nullptr;
+
+    delete m_pPreRoll;
+    m_pPreRoll = nullptr;
+
+    delete m_pMotionGate;
+    m_pMotionGate = nullptr;
+
+    delete m_pSimulcast;
+    m_pSimulcast = nullptr;
+
+    for (UINT32 i = 0; i < MAX_SIMULCAST_OUTPUTS; i++)
+    {
+        delete m_pSimulcastSinks[i];
+        m_pSimulcastSinks[i] = nullptr;
+    }
+
+    delete m_pFrameSink;
+    m_pFrameSink = nullptr;
+    m_pSegmented = nullptr;
+}
+
+// 检查是否正在捕获视频：设备丢失后等待恢复期间接收器仍在写出，也算正在捕获。
+BOOL CCapture::IsCapturing() const
+{
+    CaptureState state = m_state.GetState();
+
+    return (state == CaptureState_Capturing || state == CaptureState_Recovering) ? TRUE : FALSE;
+}
+
+// 检查设备是否丢失。
+HRESULT CCapture::CheckDeviceLost(DEV_BROADCAST_HDR* pHdr, BOOL* pbDeviceLost)
+{
+    if (pbDeviceLost == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    *pbDeviceLost = FALSE;
+
+    // 不在捕获或不是设备接口的通知时不进入临界区
+    if (!IsCapturing() || pHdr == nullptr || pHdr->dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE)
+    {
+        return S_OK;
+    }
+
+    // 符号链接在 ResumeDevice 中可能被替换，比较时仍需临界区
+    EnterCriticalSection(&m_critsec);
+
+    DEV_BROADCAST_DEVICEINTERFACE* pDi = (DEV_BROADCAST_DEVICEINTERFACE*)pHdr;
+
+    if (m_pwszSymbolicLink)
+    {
+        if (_wcsicmp(m_pwszSymbolicLink, pDi->dbcc_name) == 0)
+        {
+            *pbDeviceLost = TRUE;
+        }
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return S_OK;
+}
+
+// 用于内部结束捕获，清理资源。
+HRESULT ConfigureEncoder(const EncodingParameters& params, IMFMediaType* pType, IMFSinkWriter* pWriter, DWORD* pdwStreamIndex)
+{
+    HRESULT hr = S_OK;
+    IMFMediaType* pType2 = nullptr;
+
+    hr = MFCreateMediaType(&pType2);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType2->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType2->SetGUID(MF_MT_SUBTYPE, params.subtype);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType2->SetUINT32(MF_MT_AVG_BITRATE, params.bitrate);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CopyAttribute(pType, pType2, MF_MT_FRAME_SIZE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CopyAttribute(pType, pType2, MF_MT_FRAME_RATE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
         hr = CopyAttribute(pType, pType2, MF_MT_PIXEL_ASPECT_RATIO);
     }
 
-    if (SUCCEEDED(hr))
+    if (SUCCEEDED(hr))
+    {
+        hr = CopyAttribute(pType, pType2, MF_MT_INTERLACE_MODE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pWriter->AddStream(pType2, pdwStreamIndex);
+    }
+
+    SafeRelease(&pType2);
+    return hr;
+}
+
+// 根据 VideoFormat 创建未压缩视频的媒体类型，子类型 GUID 由 FOURCC 替换 MFVideoFormat_Base 的 Data1 得到。
+HRESULT CreateVideoMediaType(const VideoFormat& format, IMFMediaType** ppType)
+{
+    HRESULT hr = S_OK;
+    IMFMediaType* pType = nullptr;
+    GUID subtype = MFVideoFormat_Base;
+
+    subtype.Data1 = format.subtype;
+
+    hr = MFCreateMediaType(&pType);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetGUID(MF_MT_SUBTYPE, subtype);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFSetAttributeSize(pType, MF_MT_FRAME_SIZE, format.width, format.height);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFSetAttributeRatio(pType, MF_MT_FRAME_RATE, format.fpsNumerator, format.fpsDenominator);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFSetAttributeRatio(pType, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_DEFAULT_STRIDE, GetFrameStride(format.subtype, format.width));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pType->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppType = pType;
+        (*ppType)->AddRef();
+    }
+
+    SafeRelease(&pType);
+    return hr;
+}
+
+// 从媒体类型中读取流水线使用的视频格式。
+HRESULT GetVideoFormat(IMFMediaType* pType, VideoFormat* pFormat)
+{
+    GUID subtype = { 0 };
+
+    HRESULT hr = pType->GetGUID(MF_MT_SUBTYPE, &subtype);
+
+    if (SUCCEEDED(hr))
+    {
+        pFormat->subtype = subtype.Data1;
+        hr = MFGetAttributeSize(pType, MF_MT_FRAME_SIZE, &pFormat->width, &pFormat->height);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 帧率缺失时不影响写入，时长由时间戳决定
+        if (FAILED(MFGetAttributeRatio(pType, MF_MT_FRAME_RATE, &pFormat->fpsNumerator, &pFormat->fpsDenominator)))
+        {
+            pFormat->fpsNumerator = 0;
+            pFormat->fpsDenominator = 0;
+        }
+    }
+
+    return hr;
+}
+
+// 从原生媒体类型读取能力表的一项，没有帧率范围时范围取标称帧率。
+HRESULT GetMediaCapability(IMFMediaType* pType, DWORD nTypeIndex, MediaCapability* pCapability)
+{
+    HRESULT hr = GetVideoFormat(pType, &pCapability->format);
+
+    if (SUCCEEDED(hr))
+    {
+        pCapability->nTypeIndex = nTypeIndex;
+
+        if (FAILED(MFGetAttributeRatio(pType, MF_MT_FRAME_RATE_RANGE_MIN,
+            &pCapability->fpsMinNumerator, &pCapability->fpsMinDenominator)))
+        {
+            pCapability->fpsMinNumerator = pCapability->format.fpsNumerator;
+            pCapability->fpsMinDenominator = pCapability->format.fpsDenominator;
+        }
+
+        if (FAILED(MFGetAttributeRatio(pType, MF_MT_FRAME_RATE_RANGE_MAX,
+            &pCapability->fpsMaxNumerator, &pCapability->fpsMaxDenominator)))
+        {
+            pCapability->fpsMaxNumerator = pCapability->format.fpsNumerator;
+            pCapability->fpsMaxDenominator = pCapability->format.fpsDenominator;
+        }
+    }
+
+    return hr;
+}
+
+// 枚举第一个视频流的全部原生媒体类型，建立能力表；读不出格式的类型跳过。
+HRESULT EnumerateCapabilities(IMFSourceReader* pReader, CFormatNegotiator* pNegotiator)
+{
+    HRESULT hr = S_OK;
+
+    for (DWORD i = 0; SUCCEEDED(hr); i++)
+    {
+        IMFMediaType* pType = nullptr;
+        MediaCapability capability;
+
+        hr = pReader->GetNativeMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, i, &pType);
+
+        if (hr == MF_E_NO_MORE_TYPES)
+        {
+            hr = S_OK;
+            break;
+        }
+
+        if (SUCCEEDED(hr) && SUCCEEDED(GetMediaCapability(pType, i, &capability)))
+        {
+            hr = pNegotiator->AddCapability(capability);
+
+            if (hr == E_INVALIDARG)
+            {
+                hr = S_OK;
+            }
+        }
+
+        SafeRelease(&pType);
+    }
+
+    if (SUCCEEDED(hr) && pNegotiator->Count() == 0)
+    {
+        hr = MF_E_INVALIDMEDIATYPE;
+    }
+
+    return hr;
+}
+
+// 检查设备的原生媒体类型是否仍与缓存的能力一致。
+BOOL MatchesNativeType(IMFSourceReader* pReader, const MediaCapability& capability)
+{
+    IMFMediaType* pType = nullptr;
+    MediaCapability actual;
+
+    HRESULT hr = pReader->GetNativeMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, capability.nTypeIndex, &pType);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = GetMediaCapability(pType, capability.nTypeIndex, &actual);
+    }
+
+    SafeRelease(&pType);
+
+    return SUCCEEDED(hr) &&
+        actual.format.subtype == capability.format.subtype &&
+        actual.format.width == capability.format.width &&
+        actual.format.height == capability.format.height &&
+        actual.format.fpsNumerator == capability.format.fpsNumerator &&
+        actual.format.fpsDenominator == capability.format.fpsDenominator;
+}
+
+// 配置源读取器：获取全部原生媒体类型，按要求选择代价最低的一种（能直接交给接收器的格式优先），
+// 需要时改为解码后的子类型或范围内的帧率再设置；源读取器拒绝时排除该类型，换下一个候选。
+// pCache 命中时不探测设备，只验证选中的类型，不一致时作废缓存、重新探测并协商；探测的结果写回缓存。
+HRESULT ConfigureSourceReader(IMFSourceReader* pReader, const FormatConstraints& requested,
+    CCapabilityCache* pCache, const WCHAR* pwszLink, NegotiatedFormat* pResult, BOOL* pbCacheHit)
+{
+    CFormatNegotiator negotiator;
+    FormatConstraints constraints = requested;
+    BOOL bCacheHit = pCache && pwszLink && pCache->GetCapabilities(pwszLink, &negotiator);
+    HRESULT hr = S_OK;
+
+    if (!bCacheHit)
+    {
+        hr = EnumerateCapabilities(pReader, &negotiator);
+
+        if (SUCCEEDED(hr) && pCache && pwszLink)
+        {
+            pCache->StoreCapabilities(pwszLink, negotiator);
+        }
+    }
+
+    if (FAILED(hr)) { goto done; }
+
+    negotiator.ApplyDeviceDefaults(&constraints);
+
+    for (;;)
+    {
+        IMFMediaType* pNative = nullptr;
+        IMFMediaType* pType = nullptr;
+        NegotiatedFormat result;
+
+        hr = negotiator.Negotiate(constraints, &result);
+
+        if (FAILED(hr)) { goto done; }
+
+        const MediaCapability& capability = negotiator.GetCapability(result.iCapability);
+
+        if (bCacheHit && !MatchesNativeType(pReader, capability))
+        {
+            // 设备的媒体类型变了（例如更新了固件），缓存作废，按探测的结果重新协商
+            pCache->InvalidateCapabilities(pwszLink);
+            bCacheHit = FALSE;
+            negotiator.Clear();
+            constraints = requested;
+
+            hr = EnumerateCapabilities(pReader, &negotiator);
+
+            if (FAILED(hr)) { goto done; }
+
+            pCache->StoreCapabilities(pwszLink, negotiator);
+            negotiator.ApplyDeviceDefaults(&constraints);
+            continue;
+        }
+
+        hr = pReader->GetNativeMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, result.nTypeIndex, &pNative);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = MFCreateMediaType(&pType);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pNative->CopyAllItems(pType);
+        }
+
+        if (SUCCEEDED(hr) && result.bDecode)
+        {
+            GUID subtype = MFVideoFormat_Base;
+            subtype.Data1 = result.format.subtype;
+
+            hr = pType->SetGUID(MF_MT_SUBTYPE, subtype);
+        }
+
+        if (SUCCEEDED(hr) && (result.format.fpsNumerator != capability.format.fpsNumerator ||
+            result.format.fpsDenominator != capability.format.fpsDenominator))
+        {
+            hr = MFSetAttributeRatio(pType, MF_MT_FRAME_RATE, result.format.fpsNumerator, result.format.fpsDenominator);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pReader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, nullptr, pType);
+        }
+
+        SafeRelease(&pType);
+        SafeRelease(&pNative);
+
+        if (SUCCEEDED(hr))
+        {
+            *pResult = result;
+            break;
+        }
+
+        negotiator.Exclude(result.iCapability);
+    }
+
+done:
+    *pbCacheHit = bCacheHit;
+    return hr;
+}
+
+// 配置捕获过程，包括设置源读取器，并按源读取器的输出类型启动编码写入流水线。
+// 编码时流水线输出 NV12，未压缩录制时保持采集格式（Y4M 为 I420，有缩放输出时为 NV12），见 CreateFrameSink
+FormatConstraints CCapture::GetRecordingConstraints() const
+{
+    FormatConstraints constraints = m_constraints;
+    constraints.bEncode = !m_bRawRecording;
+    constraints.outputSubtype = FOURCC_NV12;
+
+    if (m_bRawRecording)
+    {
+        constraints.outputSubtype = (m_rawFactory.GetContainer() == RawContainer_Y4M) ? FOURCC_I420 :
+            (m_cSimulcast > 0) ? FOURCC_NV12 : 0;
+    }
+
+    return constraints;
+}
+
+HRESULT CCapture::ConfigureCapture(const WCHAR* pwszFileName, const EncodingParameters& param)
+{
+    HRESULT hr = S_OK;
+    IMFMediaType* pType = nullptr;
+    IFrameSink* pSink = nullptr;
+    VideoFormat format;
+    FormatConstraints constraints = GetRecordingConstraints();
+
+    hr = ConfigureSourceReader(m_pReader, constraints, m_pCache, m_pwszSymbolicLink, &m_negotiated, &m_startup.bCacheHit);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pReader->GetCurrentMediaType(
+            (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
+            &pType
+        );
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = GetVideoFormat(pType, &format);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 写入器的输入类型按流水线转换后的格式生成
+        hr = CreateFrameSink(pwszFileName, param, format, &pSink);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pipeline.Start(format, pSink);
+
+        if (FAILED(hr))
+        {
+            DeleteFrameSink();
+        }
+    }
+
+    SafeRelease(&pType);
+    return hr;
+}
+
+// 正在使用的设备的符号链接。
+std::wstring CCapture::GetDeviceLink()
+{
+    EnterCriticalSection(&m_critsec);
+    std::wstring link = m_pwszSymbolicLink ? m_pwszSymbolicLink : L"";
+    LeaveCriticalSection(&m_critsec);
+    return link;
+}
+
+// 设备丢失：释放源读取器（同时关闭媒体源），流水线和接收器照常运行，已入队的帧继续写出。
+HRESULT CCapture::SuspendDevice()
+{
+    EnterCriticalSection(&m_critsec);
+    HRESULT hr = S_OK;
+
+    // 进入 Recovering 后新到的回调直接返回，等正在执行的回调退出后才释放源读取器
+    if (!m_state.Transition(CaptureState_Capturing, CaptureState_Recovering))
+    {
+        hr = E_UNEXPECTED;
+    }
+    else
+    {
+        m_state.WaitForCallbacks();
+        m_pipeline.MarkDeviceLost();
+        SafeRelease(&m_pReader);
+    }
+
+    LeaveCriticalSection(&m_critsec);
+    return hr;
+}
+
+// 用 pwszLink 指定的设备恢复采集：流水线的缓冲池和接收器按丢失前的格式建立，
+// 只接受能采集同样分辨率和像素格式的设备，格式协商仍按录制方式的要求并使用能力表缓存。
+// 由 CDeviceRecovery 的事件线程调用，该线程没有初始化 COM，每次调用时加入多线程单元。
+HRESULT CCapture::ResumeDevice(const WCHAR* pwszLink)
+{
+    if (pwszLink == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hrCom = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    HRESULT hr = S_OK;
+    IMFActivate* pActivate = nullptr;
+    IMFMediaSource* pSource = nullptr;
+    IMFMediaType* pType = nullptr;
+    WCHAR* pwszNewLink = nullptr;
+    NegotiatedFormat negotiated = NegotiatedFormat();
+    BOOL bCacheHit = FALSE;
+    VideoFormat format;
+    VideoFormat current = m_pipeline.GetFormat();
+    FormatConstraints constraints = GetRecordingConstraints();
+
+    constraints.minWidth = constraints.maxWidth = current.width;
+    constraints.minHeight = constraints.maxHeight = current.height;
+    constraints.preferredSubtype = current.subtype;
+
+    EnterCriticalSection(&m_critsec);
+
+    // 只有 SuspendDevice 之后才能恢复，此时没有回调访问源读取器和基准时间
+    if (m_state.GetState() != CaptureState_Recovering || m_pReader)
+    {
+        hr = E_UNEXPECTED;
+        goto done;
+    }
+
+    hr = CreateDeviceActivate(pwszLink, nullptr, &pActivate);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pActivate->ActivateObject(__uuidof(IMFMediaSource), (void**)&pSource);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pActivate->GetAllocatedString(MF_DEVSOURCE_ATTRIBUTE_SOURCE_TYPE_VIDCAP_SYMBOLIC_LINK, &pwszNewLink, nullptr);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = OpenMediaSource(pSource);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 能力表缓存以激活后读回的符号链接为键，与之后保存的 m_pwszSymbolicLink 一致
+        hr = ConfigureSourceReader(m_pReader, constraints, m_pCache, pwszNewLink, &negotiated, &bCacheHit);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pReader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, &pType);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = GetVideoFormat(pType, &format);
+    }
+
+    if (SUCCEEDED(hr) &&
+        (format.subtype != current.subtype || format.width != current.width || format.height != current.height))
+    {
+        hr = MF_E_INVALIDMEDIATYPE;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        CoTaskMemFree(m_pwszSymbolicLink);
+        m_pwszSymbolicLink = pwszNewLink;
+        pwszNewLink = nullptr;
+        m_negotiated = negotiated;
+        m_bFirstSample = TRUE;
+        m_llBaseTime = 0;
+
+        m_state.SetState(CaptureState_Capturing);
+
+        hr = m_pReader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM, 0, nullptr, nullptr, nullptr, nullptr);
+    }
+
+    // ReadSample 失败时没有回调进入，回到 Recovering 等待下一次尝试
+    if (FAILED(hr))
+    {
+        m_state.SetState(CaptureState_Recovering);
+        SafeRelease(&m_pReader);
+    }
+
+done:
+    CoTaskMemFree(pwszNewLink);
+    SafeRelease(&pType);
+    SafeRelease(&pSource);
+    SafeRelease(&pActivate);
+    LeaveCriticalSection(&m_critsec);
+
+    if (SUCCEEDED(hrCom))
+    {
+        CoUninitialize();
+    }
+    return hr;
+}
+
+// CFrameMediaBuffer 类把池化的帧缓冲区包装成 IMFMediaBuffer，写入时不再分配和拷贝整帧数据；
+// 接收器写入器释放样本后缓冲区自动回到缓冲池。
+class CFrameMediaBuffer : public IMFMediaBuffer
+{
+public:
+    static HRESULT CreateInstance(CFrameBuffer* pBuffer, DWORD cbData, IMFMediaBuffer** ppBuffer)
+    {
+        CFrameMediaBuffer* pMediaBuffer = new (std::nothrow) CFrameMediaBuffer(pBuffer, cbData);
+
+        if (pMediaBuffer == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        *ppBuffer = pMediaBuffer;
+        return S_OK;
+    }
+
+    STDMETHODIMP QueryInterface(REFIID riid, void** ppv)
+    {
+        static const QITAB qit[] =
+        {
+            QITABENT(CFrameMediaBuffer, IMFMediaBuffer),
+            { 0 },
+        };
+        return QISearch(this, qit, riid, ppv);
+    }
+
+    STDMETHODIMP_(ULONG) AddRef()
+    {
+        return InterlockedIncrement(&m_nRefCount);
+    }
+
+    STDMETHODIMP_(ULONG) Release()
+    {
+        ULONG uCount = InterlockedDecrement(&m_nRefCount);
+        if (uCount == 0)
+        {
+            delete this;
+        }
+        return uCount;
+    }
+
+    STDMETHODIMP Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength)
+    {
+        if (ppbBuffer == nullptr)
+        {
+            return E_POINTER;
+        }
+
+        *ppbBuffer = m_pBuffer->GetData();
+
+        if (pcbMaxLength)
+        {
+            *pcbMaxLength = m_pBuffer->GetCapacity();
+        }
+        if (pcbCurrentLength)
+        {
+            *pcbCurrentLength = m_cbCurrent;
+        }
+        return S_OK;
+    }
+
+    STDMETHODIMP Unlock()
+    {
+        return S_OK;
+    }
+
+    STDMETHODIMP GetCurrentLength(DWORD* pcbCurrentLength)
+    {
+        if (pcbCurrentLength == nullptr)
+        {
+            return E_POINTER;
+        }
+        *pcbCurrentLength = m_cbCurrent;
+        return S_OK;
+    }
+
+    STDMETHODIMP SetCurrentLength(DWORD cbCurrentLength)
+    {
+        if (cbCurrentLength > m_pBuffer->GetCapacity())
+        {
+            return E_INVALIDARG;
+        }
+        m_cbCurrent = cbCurrentLength;
+        return S_OK;
+    }
+
+    STDMETHODIMP GetMaxLength(DWORD* pcbMaxLength)
+    {
+        if (pcbMaxLength == nullptr)
+        {
+            return E_POINTER;
+        }
+        *pcbMaxLength = m_pBuffer->GetCapacity();
+        return S_OK;
+    }
+
+private:
+    CFrameMediaBuffer(CFrameBuffer* pBuffer, DWORD cbData) :
+        m_nRefCount(1),
+        m_pBuffer(pBuffer),
+        m_cbCurrent(cbData)
+    {
+        m_pBuffer->AddRef();
+    }
+
+    virtual ~CFrameMediaBuffer()
+    {
+        m_pBuffer->Release();
+    }
+
+    long            m_nRefCount;    // 引用计数
+    CFrameBuffer*   m_pBuffer;      // 池化的帧缓冲区
+    DWORD           m_cbCurrent;    // 有效长度
+};
+
+// CMFSinkWriterSink 的构造函数保存文件名和编码参数，写入器在 BeginWriting 中创建。
+CMFSinkWriterSink::CMFSinkWriterSink(const WCHAR* pwszFileName, const EncodingParameters& param) :
+    m_pwszFileName(_wcsdup(pwszFileName)),
+    m_param(param),
+    m_pWriter(nullptr),
+    m_dwStream(0),
+    m_llDuration(0)
+{
+}
+
+CMFSinkWriterSink::~CMFSinkWriterSink()
+{
+    SafeRelease(&m_pWriter);
+    free(m_pwszFileName);
+}
+
+// 创建接收器写入器，按输入格式配置编码器并开始写入。
+HRESULT CMFSinkWriterSink::BeginWriting(const VideoFormat& format)
+{
+    HRESULT hr = S_OK;
+    IMFMediaType* pType = nullptr;
+
+    if (m_pwszFileName == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    SafeRelease(&m_pWriter);
+    m_llDuration = GetFrameDuration(format);
+
+    hr = MFCreateSinkWriterFromURL(m_pwszFileName, nullptr, nullptr, &m_pWriter);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateVideoMediaType(format, &pType);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ConfigureEncoder(m_param, pType, m_pWriter, &m_dwStream);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pWriter->SetInputMediaType(m_dwStream, pType, nullptr);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pWriter->BeginWriting();
+    }
+
+    if (FAILED(hr))
+    {
+        SafeRelease(&m_pWriter);
+    }
+
+    SafeRelease(&pType);
+    return hr;
+}
+
+// 把一帧数据包装成样本后写入：池化的帧直接引用其缓冲区，其他帧拷贝到新的媒体缓冲区。
+HRESULT CMFSinkWriterSink::WriteFrame(const CaptureFrame& frame)
+{
+    HRESULT hr = S_OK;
+    IMFMediaBuffer* pBuffer = nullptr;
+    IMFSample* pSample = nullptr;
+    BYTE* pData = nullptr;
+
+    if (m_pWriter == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (frame.pBuffer)
+    {
+        hr = CFrameMediaBuffer::CreateInstance(frame.pBuffer, frame.cbData, &pBuffer);
+    }
+    else
+    {
+        hr = MFCreateMemoryBuffer(frame.cbData, &pBuffer);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pBuffer->Lock(&pData, nullptr, nullptr);
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            memcpy(pData, frame.pData, frame.cbData);
+            pBuffer->Unlock();
+            hr = pBuffer->SetCurrentLength(frame.cbData);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = MFCreateSample(&pSample);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->AddBuffer(pBuffer);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSample->SetSampleTime(frame.llTimestamp);
+    }
+
+    if (SUCCEEDED(hr) && m_llDuration > 0)
+    {
+        hr = pSample->SetSampleDuration(m_llDuration);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pWriter->WriteSample(m_dwStream, pSample);
+    }
+
+    SafeRelease(&pSample);
+    SafeRelease(&pBuffer);
+    return hr;
+}
+
+// 结束写入并释放写入器。
+HRESULT CMFSinkWriterSink::Finalize()
+{
+    HRESULT hr = S_OK;
+
+    if (m_pWriter)
+    {
+        hr = m_pWriter->Finalize();
+    }
+
+    SafeRelease(&m_pWriter);
+    return hr;
+}
+
+// 从接收器写入器的统计中读取已交给媒体接收器的字节数。
+HRESULT CMFSinkWriterSink::GetBytesWritten(UINT64* pcbWritten)
+{
+    MF_SINK_WRITER_STATISTICS stats = { sizeof(stats) };
+
+    if (m_pWriter == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    HRESULT hr = m_pWriter->GetStatistics(m_dwStream, &stats);
+
+    if (SUCCEEDED(hr))
+    {
+        *pcbWritten = stats.qwByteCountProcessed;
+    }
+    return hr;
+}
+
+// 为一个分段创建写入器，文件在 BeginWriting 中创建。
+HRESULT CMFSinkWriterFactory::CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink)
+{
+    *ppSink = new (std::nothrow) CMFSinkWriterSink(pwszPath, m_param);
+    return *ppSink ? S_OK : E_OUTOFMEMORY;
+}
+
+// 删除超出保留数的分段文件。
+HRESULT CMFSinkWriterFactory::RemoveFile(const WCHAR* pwszPath)
+{
+    if (!DeleteFileW(pwszPath))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+// 内部结束捕获，清理资源。
+HRESULT CCapture::EndCaptureInternal()
+{
+    HRESULT hr = S_OK;
+    if (m_pFrameSink)
+    {
+        hr = m_pipeline.Stop();
+        DeleteFrameSink();
+    }
+
+    SafeRelease(&m_pReader);
+
+    CoTaskMemFree(m_pwszSymbolicLink);
+    m_pwszSymbolicLink = nullptr;
+
+    return hr;
+}
+
+CCaptureManager::CCaptureManager() :
+    m_ppCaptures(nullptr),
+    m_cCaptures(0),
+    m_fPreRollSeconds(0),
+    m_cbPreRollMemory(DEFAULT_PREROLL_MEMORY),
+    m_fMotionThreshold(0),
+    m_motionHoldMs(DEFAULT_MOTION_HOLD_MS),
+    m_cSimulcast(0),
+    m_cShmSlots(DEFAULT_SHM_RING_SLOTS),
+    m_streamParams(),
+    m_bStreaming(FALSE),
+    m_llSegmentDuration(0),
+    m_cbSegmentSize(0),
+    m_cRetainSegments(0),
+    m_bRawRecording(FALSE),
+    m_rawContainer(RawContainer_Raw),
+    m_bRawDirect(TRUE),
+    m_overloadPolicy(OverloadPolicy_DropNewest),
+    m_overloadValue(0),
+    m_constraints(),
+    m_pCache(nullptr),
+    m_hwndNotify(nullptr),
+    m_hrNotify(S_OK)
+{
+}
+
+CCaptureManager::~CCaptureManager()
+{
+    StopAll();
+}
+
+// DeviceStart 结构体保存一路设备的启动参数和结果
+struct DeviceStart
+{
+    IMFActivate*    pActivate;          // 设备
+    CCapture*       pCapture;           // 捕获
+    WCHAR           wszFile[MAX_PATH];  // 输出文件
+    HRESULT         hr;                 // 启动结果
+};
+
+// 在独立的线程中开始一路捕获：激活设备、打开源读取器和探测媒体类型都要等设备响应，各路并行进行
+static void StartCaptureThread(DeviceStart* pStart, const EncodingParameters* pParam)
+{
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    if (SUCCEEDED(hr))
+    {
+        pStart->hr = pStart->pCapture->StartCapture(pStart->pActivate, pStart->wszFile, *pParam);
+        CoUninitialize();
+    }
+    else
+    {
+        pStart->hr = hr;
+    }
+}
+
+// 为每个设备创建一路 CCapture，再并行开始捕获
+HRESULT CCaptureManager::StartAll(DeviceList* pDevices, const WCHAR* pwszFilePrefix, const EncodingParameters& param)
+{
+    if (pDevices == nullptr || pwszFilePrefix == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_ppCaptures)
+    {
+        return E_UNEXPECTED;
+    }
+
+    UINT32 cDevices = pDevices->Count();
+
+    if (cDevices == 0)
     {
-        hr = CopyAttribute(pType, pType2, MF_MT_INTERLACE_MODE);
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
     }
 
-    if (SUCCEEDED(hr))
+    m_ppCaptures = new (std::nothrow) CCapture*[cDevices];
+
+    if (m_ppCaptures == nullptr)
     {
-        hr = pWriter->AddStream(pType2, pdwStreamIndex);
+        return E_OUTOFMEMORY;
     }
 
-    SafeRelease(&pType2);
-    return hr;
+    m_cCaptures = cDevices;
+
+    HRESULT hrFirst = S_OK;
+    UINT32 cStarted = 0;
+    const WCHAR* pwszExtension = L".mp4";
+
+    if (m_bRawRecording)
+    {
+        pwszExtension = (m_rawContainer == RawContainer_Y4M) ? L".y4m" : L".raw";
+    }
+    else if (param.subtype == MFVideoFormat_MJPG)
+    {
+        pwszExtension = L".mkv";
+    }
+
+    std::vector<DeviceStart> starts(cDevices);
+    std::vector<std::thread> threads;
+
+    threads.reserve(cDevices);
+
+    // 在当前线程创建和设置各路，再为每一路启动一个线程开始捕获
+    for (UINT32 i = 0; i < cDevices; i++)
+    {
+        DeviceStart& start = starts[i];
+        INT32 readerCore, writerCore;
+
+        m_ppCaptures[i] = nullptr;
+        start.pActivate = nullptr;
+        start.pCapture = nullptr;
+
+        start.hr = pDevices->GetDevice(i, &start.pActivate);
+
+        if (SUCCEEDED(start.hr))
+        {
+            start.hr = CCapture::CreateInstance(nullptr, &start.pCapture);
+        }
+
+        if (SUCCEEDED(start.hr))
+        {
+            CCapture* pCapture = start.pCapture;
+
+            AssignPipelineCores(i, cDevices, &readerCore, &writerCore);
+            pCapture->SetCpuAffinity(readerCore, writerCore);
+
+            // 多路时每路只在自己的写入线程上转换，不争用共享的线程池
+            if (cDevices > 1)
+            {
+                pCapture->SetConversionBands(1);
+            }
+
+            pCapture->SetPreRoll(m_fPreRollSeconds, m_cbPreRollMemory);
+            pCapture->SetMotionGate(m_fMotionThreshold, m_motionHoldMs);
+
+            for (UINT32 j = 0; j < m_cSimulcast; j++)
+            {
+                pCapture->AddSimulcastOutput(m_simulcastParams[j], m_simulcastSuffixes[j].c_str());
+            }
+
+            if (!m_shmRingPrefix.empty())
+            {
+                char szRing[MAX_SHM_RING_NAME + 1];
+
+                snprintf(szRing, sizeof(szRing), "%s_%u", m_shmRingPrefix.c_str(), i);
+                pCapture->SetSharedMemoryRing(szRing, m_cShmSlots);
+            }
+
+            if (m_bStreaming)
+            {
+                StreamParams stream = m_streamParams;
+
+                stream.port = m_streamParams.port ? (WORD)(m_streamParams.port + i) : 0;
+                pCapture->SetNetworkStream(&stream);
+            }
+
+            pCapture->SetSegmentation(m_llSegmentDuration, m_cbSegmentSize, m_cRetainSegments);
+            pCapture->SetRawRecording(m_bRawRecording, m_rawContainer, m_bRawDirect);
+            pCapture->SetOverloadPolicy(m_overloadPolicy, m_overloadValue);
+            pCapture->SetFormatConstraints(m_constraints);
+            pCapture->SetCapabilityCache(m_pCache);
+
+            swprintf_s(start.wszFile, MAX_PATH, L"%s_%u%s", pwszFilePrefix, i, pwszExtension);
+            threads.push_back(std::thread(StartCaptureThread, &start, &param));
+        }
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+
+    for (UINT32 i = 0; i < cDevices; i++)
+    {
+        DeviceStart& start = starts[i];
+
+        if (SUCCEEDED(start.hr))
+        {
+            m_ppCaptures[i] = start.pCapture;
+            cStarted++;
+        }
+        else
+        {
+            if (start.pCapture)
+            {
+                start.pCapture->EndCaptureSession();
+            }
+            SafeRelease(&start.pCapture);
+
+            // 缓存的设备激活失败说明设备列表已过期，下次完整枚举
+            if (m_pCache && pDevices->IsFromCache())
+            {
+                m_pCache->InvalidateDevices();
+            }
+
+            if (SUCCEEDED(hrFirst))
+            {
+                hrFirst = start.hr;
+            }
+        }
+
+        SafeRelease(&start.pActivate);
+    }
+
+    return cStarted > 0 ? S_OK : hrFirst;
+}
+
+// 摄像头接入时缓存的设备列表和该设备的能力表作废，移除时从缓存中删除
+void CCaptureManager::OnDeviceChange(WPARAM wParam, DEV_BROADCAST_HDR* pHdr)
+{
+    if (pHdr == nullptr || pHdr->dbch_devicetype != DBT_DEVTYP_DEVICEINTERFACE)
+    {
+        return;
+    }
+    if (wParam != DBT_DEVICEARRIVAL && wParam != DBT_DEVICEREMOVECOMPLETE)
+    {
+        return;
+    }
+
+    DEV_BROADCAST_DEVICEINTERFACE* pDi = (DEV_BROADCAST_DEVICEINTERFACE*)pHdr;
+
+    if (m_pCache)
+    {
+        m_pCache->OnDeviceChange(pDi->dbcc_name, wParam == DBT_DEVICEARRIVAL);
+    }
+
+    // 未启用恢复时事件队列是关闭的，事件被丢弃
+    m_recovery.GetEventQueue()->Post(wParam == DBT_DEVICEARRIVAL ? DeviceEvent_Arrival : DeviceEvent_Removal,
+        pDi->dbcc_name);
+}
+
+// 接收设备通知的消息窗口的类名
+static const WCHAR c_wszNotifyClass[] = L"CaptureDeviceNotify";
+
+// 消息窗口的窗口过程：WM_DEVICECHANGE 交给创建窗口的 CCaptureManager
+static LRESULT CALLBACK NotifyWindowProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+    if (message == WM_DEVICECHANGE)
+    {
+        CCaptureManager* pManager = (CCaptureManager*)GetWindowLongPtr(hwnd, GWLP_USERDATA);
+
+        if (pManager)
+        {
+            pManager->OnDeviceChange(wParam, (DEV_BROADCAST_HDR*)lParam);
+        }
+        return TRUE;
+    }
+
+    if (message == WM_DESTROY)
+    {
+        PostQuitMessage(0);
+        return 0;
+    }
+
+    return DefWindowProc(hwnd, message, wParam, lParam);
+}
+
+// 设备通知线程：控制台程序没有窗口，在这个线程上创建只接收消息的窗口（HWND_MESSAGE）并注册设备通知，
+// 创建结果写入 m_hrNotify 后设置 hReady，然后运行消息循环直到 StopRecovery 关闭窗口
+void CCaptureManager::NotifyThread(HANDLE hReady)
+{
+    HDEVNOTIFY hDevNotify = nullptr;
+    HINSTANCE hInstance = GetModuleHandle(nullptr);
+    WNDCLASSW wc = { 0 };
+
+    wc.lpfnWndProc = NotifyWindowProc;
+    wc.hInstance = hInstance;
+    wc.lpszClassName = c_wszNotifyClass;
+
+    m_hrNotify = S_OK;
+
+    if (!RegisterClassW(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS)
+    {
+        m_hrNotify = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(m_hrNotify))
+    {
+        m_hwndNotify = CreateWindowExW(0, c_wszNotifyClass, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, nullptr, hInstance, nullptr);
+
+        if (m_hwndNotify == nullptr)
+        {
+            m_hrNotify = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    if (SUCCEEDED(m_hrNotify))
+    {
+        SetWindowLongPtr(m_hwndNotify, GWLP_USERDATA, (LONG_PTR)this);
+
+        // 与 CheckDeviceLost 比较的符号链接属于同一个设备接口类
+        DEV_BROADCAST_DEVICEINTERFACE di = { 0 };
+        di.dbcc_size = sizeof(di);
+        di.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE;
+        di.dbcc_classguid = KSCATEGORY_CAPTURE;
+
+        hDevNotify = RegisterDeviceNotification(m_hwndNotify, &di, DEVICE_NOTIFY_WINDOW_HANDLE);
+
+        if (hDevNotify == nullptr)
+        {
+            m_hrNotify = HRESULT_FROM_WIN32(GetLastError());
+            DestroyWindow(m_hwndNotify);
+            m_hwndNotify = nullptr;
+        }
+    }
+
+    BOOL bRunning = SUCCEEDED(m_hrNotify);
+    SetEvent(hReady);
+
+    if (bRunning)
+    {
+        MSG msg;
+
+        while (GetMessage(&msg, nullptr, 0, 0) > 0)
+        {
+            DispatchMessage(&msg);
+        }
+
+        UnregisterDeviceNotification(hDevNotify);
+    }
 }
 
-// ọ̀Դȡͱ
-HRESULT CCapture::ConfigureCapture(const EncodingParameters& param)
+// 启用热插拔恢复：先把各路交给 CDeviceRecovery，再启动设备通知线程
+HRESULT CCaptureManager::StartRecovery(DeviceList* pDevices, UINT32 retryMs, UINT32 fallbackDelayMs)
 {
+    if (m_ppCaptures == nullptr || m_notifyThread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
     HRESULT hr = S_OK;
-    DWORD sink_stream = 0;
-    IMFMediaType* pType = nullptr;
 
-    hr = ConfigureSourceReader(m_pReader);
+    m_recovery.Clear();
+    m_recovery.SetTiming(retryMs, fallbackDelayMs);
 
-    if (SUCCEEDED(hr))
+    for (UINT32 i = 0; i < m_cCaptures && SUCCEEDED(hr); i++)
     {
-        hr = m_pReader->GetCurrentMediaType(
-            (DWORD)MF_SOURCE_READER_FIRST_VIDEO_STREAM,
-            &pType
-        );
+        if (m_ppCaptures[i])
+        {
+            m_ppCaptures[i]->SetDeviceEventQueue(m_recovery.GetEventQueue());
+            hr = m_recovery.AddCapture(m_ppCaptures[i]);
+        }
     }
 
-    if (SUCCEEDED(hr))
+    // 没有启动成功的设备可以作为后备
+    for (UINT32 i = 0; pDevices && i < pDevices->Count() && SUCCEEDED(hr); i++)
     {
-        hr = ConfigureEncoder(param, pType, m_pWriter, &sink_stream);
+        WCHAR* pwszLink = nullptr;
+
+        if (SUCCEEDED(pDevices->GetSymbolicLink(i, &pwszLink)))
+        {
+            m_recovery.AddSpareDevice(pwszLink);
+        }
+        CoTaskMemFree(pwszLink);
     }
 
     if (SUCCEEDED(hr))
     {
-        hr = MFTRegisterLocalByCLSID(
-            __uuidof(CColorConvertDMO),
-            MFT_CATEGORY_VIDEO_PROCESSOR,
-            L"",
-            MFT_ENUM_FLAG_SYNCMFT,
-            0,
-            nullptr,
-            0,
-            nullptr
-        );
+        hr = m_recovery.Start();
     }
 
+    HANDLE hReady = nullptr;
+
     if (SUCCEEDED(hr))
     {
-        hr = m_pWriter->SetInputMediaType(sink_stream, pType, nullptr);
+        hReady = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        hr = hReady ? S_OK : HRESULT_FROM_WIN32(GetLastError());
     }
 
     if (SUCCEEDED(hr))
     {
-        hr = m_pWriter->BeginWriting();
+        m_notifyThread = std::thread(&CCaptureManager::NotifyThread, this, hReady);
+        WaitForSingleObject(hReady, INFINITE);
+        hr = m_hrNotify;
+    }
+
+    if (hReady)
+    {
+        CloseHandle(hReady);
+    }
+
+    if (FAILED(hr))
+    {
+        StopRecovery();
     }
 
-    SafeRelease(&pType);
     return hr;
 }
 
-// ڲԴ
-HRESULT CCapture::EndCaptureInternal()
+// 停止设备通知线程和恢复，之后各路不再被暂停或恢复
+void CCaptureManager::StopRecovery()
+{
+    if (m_notifyThread.joinable())
+    {
+        if (m_hwndNotify)
+        {
+            PostMessage(m_hwndNotify, WM_CLOSE, 0, 0);
+        }
+        m_notifyThread.join();
+        m_hwndNotify = nullptr;
+    }
+
+    m_recovery.Stop();
+
+    for (UINT32 i = 0; i < m_cCaptures; i++)
+    {
+        if (m_ppCaptures[i])
+        {
+            m_ppCaptures[i]->SetDeviceEventQueue(nullptr);
+        }
+    }
+
+    m_recovery.Clear();
+}
+
+// 获取第 index 路的恢复状态
+HRESULT CCaptureManager::GetRecoveryStatus(UINT32 index, RecoveryStatus* pStatus) const
+{
+    if (index >= m_cCaptures || m_ppCaptures[index] == nullptr)
+    {
+        return S_FALSE;
+    }
+
+    // CDeviceRecovery 中只有启动成功的各路，按顺序对应
+    UINT32 iEntry = 0;
+
+    for (UINT32 i = 0; i < index; i++)
+    {
+        iEntry += m_ppCaptures[i] ? 1 : 0;
+    }
+
+    if (iEntry >= m_recovery.Count())
+    {
+        return S_FALSE;
+    }
+
+    m_recovery.GetStatus(iEntry, pStatus);
+    return S_OK;
+}
+
+// 结束所有设备的捕获
+HRESULT CCaptureManager::StopAll()
+{
+    HRESULT hrFirst = S_OK;
+
+    // 先停止恢复，结束会话时不会再有设备被重新激活
+    StopRecovery();
+
+    for (UINT32 i = 0; i < m_cCaptures; i++)
+    {
+        if (m_ppCaptures[i])
+        {
+            HRESULT hr = m_ppCaptures[i]->EndCaptureSession();
+
+            if (FAILED(hr) && SUCCEEDED(hrFirst))
+            {
+                hrFirst = hr;
+            }
+        }
+    }
+
+    // 各路都已停止，统计报告的最后一次输出就是最终结果；之后才能释放各路的流水线
+    m_reporter.Stop();
+
+    for (UINT32 i = 0; i < m_cCaptures; i++)
+    {
+        SafeRelease(&m_ppCaptures[i]);
+    }
+
+    delete[] m_ppCaptures;
+    m_ppCaptures = nullptr;
+    m_cCaptures = 0;
+    return hrFirst;
+}
+
+// 同时触发所有设备的预录
+HRESULT CCaptureManager::TriggerAll()
+{
+    HRESULT hrFirst = S_OK;
+
+    for (UINT32 i = 0; i < m_cCaptures; i++)
+    {
+        if (m_ppCaptures[i])
+        {
+            HRESULT hr = m_ppCaptures[i]->TriggerRecording();
+
+            if (FAILED(hr) && SUCCEEDED(hrFirst))
+            {
+                hrFirst = hr;
+            }
+        }
+    }
+
+    return hrFirst;
+}
+
+// 为之后启动的每个设备添加一路缩放输出
+HRESULT CCaptureManager::AddSimulcastOutput(const ScaleParams& params, const WCHAR* pwszSuffix)
+{
+    if (pwszSuffix == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_cSimulcast >= MAX_SIMULCAST_OUTPUTS || pwszSuffix[0] == L'\0')
+    {
+        return E_INVALIDARG;
+    }
+
+    m_simulcastParams[m_cSimulcast] = params;
+    m_simulcastSuffixes[m_cSimulcast] = pwszSuffix;
+    m_cSimulcast++;
+    return S_OK;
+}
+
+// 为每路已启动的设备添加统计，名称为 camera<序号>
+HRESULT CCaptureManager::StartStatsReport(const WCHAR* pwszPath, StatsFormat format, UINT32 intervalMs)
 {
     HRESULT hr = S_OK;
-    if (m_pWriter)
+
+    if (m_ppCaptures == nullptr || m_reporter.IsRunning())
     {
-        hr = m_pWriter->Finalize();
+        return E_UNEXPECTED;
     }
 
-    SafeRelease(&m_pWriter);
-    SafeRelease(&m_pReader);
+    for (UINT32 i = 0; i < m_cCaptures && SUCCEEDED(hr); i++)
+    {
+        if (m_ppCaptures[i])
+        {
+            char szName[32];
+            sprintf_s(szName, ARRAYSIZE(szName), "camera%u", i);
 
-    CoTaskMemFree(m_pwszSymbolicLink);
-    m_pwszSymbolicLink = nullptr;
+            hr = m_reporter.AddPipeline(szName, m_ppCaptures[i]->GetPipeline());
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_reporter.Start(pwszPath, format, intervalMs);
+    }
+
+    if (FAILED(hr))
+    {
+        m_reporter.Stop();
+    }
 
     return hr;
 }
 
-// ֮ǰĸԺʵ֣ڴһIMFAttributesԵһ
+// 获取第 index 路的 CCapture
+CCapture* CCaptureManager::GetCapture(UINT32 index) const
+{
+    return index < m_cCaptures ? m_ppCaptures[index] : nullptr;
+}
+
+// 汇总各路的流水线统计
+void CCaptureManager::GetAggregateStats(PipelineStats* pStats) const
+{
+    double fLatencySum = 0;
+
+    *pStats = PipelineStats();
+
+    for (UINT32 i = 0; i < m_cCaptures; i++)
+    {
+        if (m_ppCaptures[i] == nullptr)
+        {
+            continue;
+        }
+
+        PipelineStats stats;
+        m_ppCaptures[i]->GetPipelineStats(&stats);
+
+        pStats->cFrames += stats.cFrames;
+        pStats->cbWritten += stats.cbWritten;
+        pStats->fFps += stats.fFps;
+        pStats->fElapsed = stats.fElapsed > pStats->fElapsed ? stats.fElapsed : pStats->fElapsed;
+        pStats->fMaxLatencyMs = stats.fMaxLatencyMs > pStats->fMaxLatencyMs ? stats.fMaxLatencyMs : pStats->fMaxLatencyMs;
+        pStats->cQueueCapacity += stats.cQueueCapacity;
+        pStats->cQueueDepth += stats.cQueueDepth;
+        pStats->cQueueHighWater = stats.cQueueHighWater > pStats->cQueueHighWater ? stats.cQueueHighWater : pStats->cQueueHighWater;
+        pStats->cOverflows += stats.cOverflows;
+        pStats->cPoolBuffers += stats.cPoolBuffers;
+        pStats->cPoolFree += stats.cPoolFree;
+        pStats->cAnalyzed += stats.cAnalyzed;
+        pStats->cBlackFrames += stats.cBlackFrames;
+        pStats->cFrozenFrames += stats.cFrozenFrames;
+        pStats->cOverexposedFrames += stats.cOverexposedFrames;
+        pStats->fFirstFrameMs = stats.fFirstFrameMs > pStats->fFirstFrameMs ? stats.fFirstFrameMs : pStats->fFirstFrameMs;
+        pStats->cDeviceLosses += stats.cDeviceLosses;
+        pStats->cRecoveries += stats.cRecoveries;
+        pStats->fLastRecoveryMs = stats.fLastRecoveryMs > pStats->fLastRecoveryMs ? stats.fLastRecoveryMs : pStats->fLastRecoveryMs;
+        pStats->fMaxRecoveryMs = stats.fMaxRecoveryMs > pStats->fMaxRecoveryMs ? stats.fMaxRecoveryMs : pStats->fMaxRecoveryMs;
+        pStats->bDeviceLost |= stats.bDeviceLost;
+        fLatencySum += stats.fAvgLatencyMs * stats.cFrames;
+    }
+
+    pStats->fAvgLatencyMs = pStats->cFrames ? fLatencySum / pStats->cFrames : 0;
+}
+
+// 这是之前声明的复制属性函数的实现，用于从一个IMFAttributes对象复制属性到另一个。
 HRESULT CopyAttribute(IMFAttributes* pSrc, IMFAttributes* pDest, const GUID& key)
 {
     PROPVARIANT var;
@@ -1,66 +1,147 @@
-#pragma once // ֻһͷļֹظ
-
-// һϢӦóԤ
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include "pipeline.h"
+#include "prerollsink.h"
+#include "segmentsink.h"
+#include "rawsink.h"
+#include "statsreport.h"
+#include "negotiate.h"
+#include "capcache.h"
+#include "recovery.h"
+#include "motiongate.h"
+#include "simulcastsink.h"
+#include "framebus.h"
+#include "shmring.h"
+#include "netsink.h"
+#include "mjpegsink.h"
+#include "capstate.h"
+
+// 定义了一个消息，用于应用程序预览错误
 const UINT WM_APP_PREVIEW_ERROR = WM_APP + 1;    // wparam = HRESULT
 
-// DeviceList ڹ豸б
+// DeviceList 类用于管理设备列表
 class DeviceList
 {
 private:
-    UINT32      m_cDevices; // 豸
-    IMFActivate** m_ppDevices; // ָ豸ָ
+    UINT32      m_cDevices; // 设备数量
+    IMFActivate** m_ppDevices; // 指向设备激活对象的指针数组
+    BOOL        m_bFromCache; // 设备列表是否来自缓存
+
+    // 按缓存的设备列表直接创建激活对象，不经过 MFEnumDeviceSources；缓存中没有设备列表时返回 S_FALSE
+    HRESULT CreateFromCache(CCapabilityCache* pCache);
 
 public:
-    // 캯
-    DeviceList() : m_ppDevices(nullptr), m_cDevices(0)
+    // 构造函数
+    DeviceList() : m_ppDevices(nullptr), m_cDevices(0), m_bFromCache(FALSE)
     {
     }
 
-    // 
+    // 析构函数
     ~DeviceList()
     {
         Clear();
     }
 
-    // 豸
+    // 返回设备数量
     UINT32  Count() const { return m_cDevices; }
 
-    // 豸б
+    // 清空设备列表
     void    Clear();
 
-    // ö豸
-    HRESULT EnumerateDevices();
+    // 枚举设备；pCache 不为空时优先使用缓存的设备列表，未命中时完整枚举并把结果写入缓存
+    // 缓存的列表不包含上次枚举之后才接入的设备，见 UpdateCache
+    HRESULT EnumerateDevices(CCapabilityCache* pCache = nullptr);
+
+    // 设备列表是否来自缓存
+    BOOL    IsFromCache() const { return m_bFromCache; }
+
+    // 把设备列表（符号链接和名称）写入缓存；设备列表来自缓存时，可以在开始录制后另做一次完整枚举再调用，
+    // 让下一次启动看到新接入的设备
+    HRESULT UpdateCache(CCapabilityCache* pCache) const;
 
-    // ȡָ豸
+    // 获取指定索引的设备激活对象
     HRESULT GetDevice(UINT32 index, IMFActivate** ppActivate);
 
-    // ȡָ豸
+    // 获取指定索引的设备名称
     HRESULT GetDeviceName(UINT32 index, WCHAR** ppszName);
+
+    // 获取指定索引的设备的符号链接，调用方用 CoTaskMemFree 释放
+    HRESULT GetSymbolicLink(UINT32 index, WCHAR** ppszLink);
 };
 
-// EncodingParameters ṹڴ洢
+// EncodingParameters 结构体用于存储编码参数
 struct EncodingParameters
 {
-    GUID    subtype; // ý
-    UINT32  bitrate; // 
+    GUID    subtype; // 媒体类型子类型，MFVideoFormat_MJPG 时用内置的 CJpegEncoder 写入 .mkv，不经过 Media Foundation 编码器
+    UINT32  bitrate; // 编码比特率
+    UINT32  quality; // JPEG 质量（1-100），只用于 MFVideoFormat_MJPG，0 表示 DEFAULT_JPEG_QUALITY
 };
 
-// CCapture ʵ IMFSourceReaderCallback ӿڣƵ
-class CCapture : public IMFSourceReaderCallback
+// StartupTimes 结构体记录从设备开始捕获的各阶段耗时
+struct StartupTimes
+{
+    double  fActivateMs;    // 激活设备并创建源读取器（毫秒）
+    double  fConfigureMs;   // 获取能力表、协商格式并启动流水线（毫秒），能力表来自缓存时不探测设备
+    double  fFirstFrameMs;  // 从开始捕获到第一帧到达（毫秒），尚未收到帧时为 0
+    BOOL    bCacheHit;      // 能力表是否来自缓存
+};
+
+// CMFSinkWriterSink 类把流水线输出的帧交给 IMFSinkWriter 编码写入文件
+class CMFSinkWriterSink : public IFrameSink
 {
 public:
-    // ̬ڴ CCapture ʵ
+    // 输入媒体类型按 BeginWriting 的格式生成
+    CMFSinkWriterSink(const WCHAR* pwszFileName, const EncodingParameters& param);
+    virtual ~CMFSinkWriterSink();
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+    HRESULT Finalize();
+
+    // 已交给媒体接收器的字节数
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+private:
+    WCHAR*              m_pwszFileName; // 输出文件路径
+    EncodingParameters  m_param;        // 编码参数
+    IMFSinkWriter*      m_pWriter;      // 接收器写入器
+    DWORD               m_dwStream;     // 输出流索引
+    LONGLONG            m_llDuration;   // 每帧时长
+};
+
+// CMFSinkWriterFactory 类按编码参数为分段写入的每一段创建 CMFSinkWriterSink
+class CMFSinkWriterFactory : public IFrameSinkFactory
+{
+public:
+    CMFSinkWriterFactory() : m_param() {}
+
+    // 设置编码参数，在创建接收器之前调用
+    void    SetParameters(const EncodingParameters& param) { m_param = param; }
+
+    HRESULT CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink);
+    HRESULT RemoveFile(const WCHAR* pwszPath);
+
+private:
+    EncodingParameters  m_param;        // 编码参数
+};
+
+// CCapture 类实现了 IMFSourceReaderCallback 接口，用于视频捕获
+// 同时实现 IRecoverableCapture：设备丢失时只释放源读取器，流水线和接收器保持打开，换上设备后接着写同一个文件
+class CCapture : public IMFSourceReaderCallback, public IRecoverableCapture
+{
+public:
+    // 静态方法，用于创建 CCapture 实例
     static HRESULT CreateInstance(
         HWND     hwnd,
         CCapture** ppPlayer
     );
 
-    // IUnknown 
+    // IUnknown 方法
     STDMETHODIMP QueryInterface(REFIID iid, void** ppv);
     STDMETHODIMP_(ULONG) AddRef();
     STDMETHODIMP_(ULONG) Release();
 
-    // IMFSourceReaderCallback 
+    // IMFSourceReaderCallback 方法
     STDMETHODIMP OnReadSample(
         HRESULT hrStatus,
         DWORD dwStreamIndex,
@@ -69,71 +150,402 @@ public:
         IMFSample* pSample
     );
 
-    // ¼ĿǰΪʵ
+    // 事件处理方法，目前为空实现
     STDMETHODIMP OnEvent(DWORD, IMFMediaEvent*)
     {
         return S_OK;
     }
 
-    // ˢ´ĿǰΪʵ
+    // 刷新处理方法，目前为空实现
     STDMETHODIMP OnFlush(DWORD)
     {
         return S_OK;
     }
 
-    // ʼ
+    // 开始捕获
     HRESULT     StartCapture(IMFActivate* pActivate, const WCHAR* pwszFileName, const EncodingParameters& param);
 
-    // Ự
+    // 从指定的采集后端（例如 CSyntheticSource）开始捕获，pSource 在结束捕获前必须保持有效
+    HRESULT     StartCapture(ICaptureSource* pSource, const VideoFormat& format, const WCHAR* pwszFileName, const EncodingParameters& param);
+
+    // 结束捕获会话
     HRESULT     EndCaptureSession();
 
-    // Ƿڲ
-    BOOL        IsCapturing();
+    // 检查是否正在捕获（包括设备丢失后等待恢复期间），不加锁
+    BOOL        IsCapturing() const;
 
-    // 豸Ƿʧ
+    // 捕获会话的状态，不加锁
+    CaptureState GetState() const { return m_state.GetState(); }
+
+    // 检查设备是否丢失
     HRESULT     CheckDeviceLost(DEV_BROADCAST_HDR* pHdr, BOOL* pbDeviceLost);
 
-    // ӡ
-    void        PrintSampleData(IMFSample* pSample);
+    // IRecoverableCapture 方法：ResumeDevice 只接受能按丢失前的分辨率和像素格式采集的设备，
+    // 帧率可以不同，时间戳由流水线接着丢失前的帧
+    std::wstring GetDeviceLink();
+    HRESULT     SuspendDevice();
+    HRESULT     ResumeDevice(const WCHAR* pwszLink);
+
+    // 采集出错时除了通知窗口，还向 pQueue 放入 DeviceEvent_Error，由 CDeviceRecovery 恢复；在 StartCapture 之前或之后调用
+    void        SetDeviceEventQueue(CDeviceEventQueue* pQueue)
+    {
+        EnterCriticalSection(&m_critsec);
+        m_pEvents = pQueue;
+        LeaveCriticalSection(&m_critsec);
+    }
+
+    // 获取最近一个分析帧的亮度统计，未启用分析或尚无结果时返回 S_FALSE
+    HRESULT     GetFrameStats(FrameStats* pStats) const { return m_pipeline.GetFrameStats(pStats); }
+
+    // 启用逐帧亮度统计（每 frameStride 帧、每 rowStride 行采样一次），在 StartCapture 之前调用
+    void        SetFrameAnalysis(UINT32 frameStride, UINT32 rowStride) { m_pipeline.SetAnalysis(frameStride, rowStride); }
+
+    // 获取流水线统计，包括帧队列的深度和溢出次数
+    void        GetPipelineStats(PipelineStats* pStats) const { m_pipeline.GetStats(pStats); }
+
+    // 获取各阶段延迟的分位数（设备到回调、入队、排队、转换、写入、重新发起 ReadSample）
+    void        GetLatency(LatencySnapshot* pSnapshot) const { m_pipeline.GetLatency(pSnapshot); }
+
+    // 本路的流水线，用于 CStatsReporter
+    const CFramePipeline* GetPipeline() const { return &m_pipeline; }
+
+    // 等待从 ICaptureSource 开始的捕获读完数据源（有限帧数的数据源）且队列写空，之后调用 EndCaptureSession
+    void        WaitForSource() { m_pipeline.Wait(); }
+
+    // 设置帧队列深度，在 StartCapture 之前调用
+    void        SetQueueDepth(UINT32 cDepth) { m_pipeline.SetQueueDepth(cDepth); }
+
+    // 设置写出跟不上时的过载策略，参数同 CFramePipeline::SetOverloadPolicy，在 StartCapture 之前调用
+    void        SetOverloadPolicy(OverloadPolicy policy, UINT32 value = 0) { m_pipeline.SetOverloadPolicy(policy, value); }
+
+    // 获取分原因的丢帧统计，连续丢帧的秒数可用于发现持续过载
+    void        GetDropStats(DropStats* pStats) const { m_pipeline.GetDropStats(pStats); }
+
+    // 把流水线的读取线程和写入线程绑定到指定的逻辑核，在 StartCapture 之前调用
+    void        SetCpuAffinity(INT32 readerCore, INT32 writerCore) { m_pipeline.SetCpuAffinity(readerCore, writerCore); }
+
+    // 设置格式转换的行带数，1 表示只在写入线程上转换，在 StartCapture 之前调用
+    void        SetConversionBands(UINT32 cBands) { m_pipeline.SetConversionBands(cBands); }
+
+    // 启用预录：只在内存中保留最近 fSeconds 秒的帧（不超过 cbMaxMemory 字节），调用 TriggerRecording 后才写入文件；
+    // fSeconds 为 0 表示关闭，在 StartCapture 之前调用
+    void        SetPreRoll(double fSeconds, size_t cbMaxMemory = DEFAULT_PREROLL_MEMORY) { m_fPreRollSeconds = fSeconds; m_cbPreRollMemory = cbMaxMemory; }
+
+    // 触发预录，把缓冲的帧和之后的帧写入文件；未启用预录时返回 S_FALSE
+    HRESULT     TriggerRecording();
+
+    // 启用分段写入：每段达到 llMaxDuration（100 纳秒）或 cbMaxSize 字节时切换到下一个文件，
+    // 文件名为 <名称>_000.mp4、<名称>_001.mp4 ...；cRetain 不为 0 时只保留最近 cRetain 个已结束的分段
+    // 两个条件都为 0 表示只写一个文件，在 StartCapture 之前调用
+    void        SetSegmentation(LONGLONG llMaxDuration, UINT64 cbMaxSize, UINT32 cRetain = 0)
+    {
+        m_llSegmentDuration = llMaxDuration;
+        m_cbSegmentSize = cbMaxSize;
+        m_cRetainSegments = cRetain;
+    }
+
+    // 获取分段写入的统计，未启用分段时返回 S_FALSE
+    HRESULT     GetSegmentStats(SegmentStats* pStats);
+
+    // 启用运动门控：画面与上一帧的平均绝对差达到 fThreshold（亮度级）时写出，之后保持 holdMs 毫秒，
+    // 其余的帧不编码也不写入；fThreshold 为 0 表示关闭，在 StartCapture 之前调用
+    void        SetMotionGate(double fThreshold, UINT32 holdMs = DEFAULT_MOTION_HOLD_MS) { m_fMotionThreshold = fThreshold; m_motionHoldMs = holdMs; }
+
+    // 获取运动门控的统计，未启用时返回 S_FALSE
+    HRESULT     GetMotionStats(MotionGateStats* pStats);
+
+    // 添加一路缩放输出：从同一帧裁剪、缩放后写入 <名称>_<pwszSuffix> 加原来的扩展名，例如全分辨率存档之外的 480p 预览；
+    // 编码时比特率按输出与采集的像素数之比缩小，缩放输出不分段；最多 MAX_SIMULCAST_OUTPUTS 路，在 StartCapture 之前调用
+    HRESULT     AddSimulcastOutput(const ScaleParams& params, const WCHAR* pwszSuffix);
+
+    // 缩放输出的路数
+    UINT32      GetSimulcastCount() const { return m_cSimulcast; }
+
+    // 获取第 index 路缩放输出的统计，没有在捕获时返回 S_FALSE
+    HRESULT     GetSimulcastStats(UINT32 index, SimulcastOutputStats* pStats);
+
+    // 添加一个帧订阅者（例如分析、截图或网络发送）：与写入文件的接收器共享同一帧的缓冲区，不拷贝帧数据，
+    // 各自在自己的线程中按 cDepth 深度的队列和 policy 过载策略写出，慢的订阅者只丢自己的帧；
+    // 添加了订阅者时文件接收器作为第 0 个订阅者 "file"，队列深度和过载策略同流水线（OverloadPolicy_Block 改为丢弃新帧）；
+    // pSink 由调用方持有，必须在结束捕获之后才能释放，最多 MAX_BUS_SUBSCRIBERS - 1 个，在 StartCapture 之前调用
+    HRESULT     AddSubscriber(const char* pszName, IFrameSink* pSink, UINT32 cDepth = DEFAULT_SUBSCRIBER_DEPTH,
+        OverloadPolicy policy = OverloadPolicy_DropOldest, UINT32 value = 0);
+
+    // 帧总线上的订阅者数（包括文件接收器、共享内存帧环和网络发送），没有添加订阅者时为 0
+    UINT32      GetSubscriberCount() const
+    {
+        UINT32 cExtra = m_cSubscribers + (m_shmRingName.empty() ? 0 : 1) + (m_bStreaming ? 1 : 0);
+        return cExtra ? cExtra + 1 : 0;
+    }
+
+    // 把每帧发布到名为 pszName 的共享内存帧环（见 CShmRingSink），同一台机器上的分析进程用 CShmRingReader
+    // 直接读取，不必再从磁盘读回文件；帧环作为帧总线的订阅者 "shm"，占用一个订阅者名额；
+    // pszName 为空时关闭，在 StartCapture 之前调用
+    HRESULT     SetSharedMemoryRing(const char* pszName, UINT32 cSlots = DEFAULT_SHM_RING_SLOTS);
+
+    // 把帧实时发送给网络上的观看端（见 CNetStreamSink），浏览器打开 http://<地址>:<端口>/ 即可观看；
+    // 作为帧总线的订阅者 "net"，占用一个订阅者名额；pParams 为空时关闭，在 StartCapture 之前调用
+    HRESULT     SetNetworkStream(const StreamParams* pParams);
+
+    // 获取网络发送的统计，没有在捕获或未启用时返回 S_FALSE
+    HRESULT     GetStreamStats(StreamStats* pStats);
+
+    // 获取第 index 个订阅者的名称和统计，0 为文件接收器；没有在捕获时返回 S_FALSE
+    HRESULT     GetSubscriberStats(UINT32 index, const char** ppszName, SubscriberStats* pStats);
+
+    // 启用未压缩录制：不经过编码器，按采集格式无损写入原始文件，或转换成 I420 写入 Y4M；
+    // bDirect 为 TRUE 时使用直接 I/O，在 StartCapture 之前调用
+    void        SetRawRecording(BOOL bEnable, RawContainer container = RawContainer_Raw, BOOL bDirect = TRUE)
+    {
+        m_bRawRecording = bEnable;
+        m_rawFactory.SetContainer(container, bDirect);
+    }
+
+    // 设置对采集格式的要求（例如不低于 1920x1080、60 fps，优先 NV12），在 StartCapture 之前调用；
+    // outputSubtype 和 bEncode 由录制方式决定，这里设置的值不起作用
+    void        SetFormatConstraints(const FormatConstraints& constraints) { m_constraints = constraints; }
+
+    // 使用缓存的能力表，未命中或选中的类型与设备不符时探测设备并更新缓存；pCache 为空时每次都探测，
+    // pCache 必须在结束捕获前保持有效，在 StartCapture 之前调用
+    void        SetCapabilityCache(CCapabilityCache* pCache) { m_pCache = pCache; }
+
+    // 获取启动各阶段的耗时和首帧时长
+    void        GetStartupTimes(StartupTimes* pTimes) const;
+
+    // 获取协商选定的采集格式，尚未从设备开始捕获时返回 S_FALSE
+    HRESULT     GetNegotiatedFormat(NegotiatedFormat* pFormat) const
+    {
+        *pFormat = m_negotiated;
+        return m_negotiated.format.width ? S_OK : S_FALSE;
+    }
 
 protected:
-    // ״̬ö
-    enum State
+    // BusSubscriber 结构体保存 AddSubscriber 的参数
+    struct BusSubscriber
     {
-        State_NotReady = 0, // δ׼
-        State_Ready,         // ׼
-        State_Capturing,     // ڲ
+        std::string     name;       // 名称
+        IFrameSink*     pSink;      // 接收器
+        UINT32          cDepth;     // 队列深度
+        OverloadPolicy  policy;     // 过载策略
+        UINT32          value;      // 过载策略的参数
     };
 
-    // ˽й캯ʹ CreateInstance ʵ
+    // 私有构造函数，使用 CreateInstance 方法进行实例化
     CCapture(HWND hwnd);
 
-    // ˽ Release ͷ
+    // 私有析构函数，调用 Release 方法进行释放
     virtual ~CCapture();
 
-    // ֪ͨ
-    void    NotifyError(HRESULT hr) { PostMessage(m_hwndEvent, WM_APP_PREVIEW_ERROR, (WPARAM)hr, 0L); }
+    // 通知错误：有窗口时发送 WM_APP_PREVIEW_ERROR，设置了事件队列时放入 DeviceEvent_Error；进入临界区，
+    // 不能在 EnterCallback 和 LeaveCallback 之间调用
+    void    NotifyError(HRESULT hr);
 
-    // ýԴ
+    // 打开媒体源
     HRESULT OpenMediaSource(IMFMediaSource* pSource);
 
-    // ò
-    HRESULT ConfigureCapture(const EncodingParameters& param);
+    // 按录制方式补上 outputSubtype 和 bEncode 的格式要求
+    FormatConstraints GetRecordingConstraints() const;
+
+    // 配置捕获
+    HRESULT ConfigureCapture(const WCHAR* pwszFileName, const EncodingParameters& param);
 
-    // ڲ
+    // 把样本数据拷贝进帧队列
+    HRESULT DeliverSample(LONGLONG llTimeStamp, IMFSample* pSample);
+
+    // 内部结束捕获
     HRESULT EndCaptureInternal();
 
-    // Ա
-    long                    m_nRefCount;        // ü
-    CRITICAL_SECTION        m_critsec;         // ٽ
+    // 创建接收器，format 为采集格式（用于推算缩放输出的大小），ppSink 返回交给流水线的接收器
+    HRESULT CreateFrameSink(const WCHAR* pwszFileName, const EncodingParameters& param, const VideoFormat& format,
+        IFrameSink** ppSink);
+
+    // 创建各路缩放输出的接收器，由 CSimulcastSink 把帧分发给它们和 m_pFrameSink
+    HRESULT CreateSimulcastSinks(IFrameSinkFactory* pFactory, const WCHAR* pwszFileName, const EncodingParameters& param,
+        const VideoFormat& format);
+
+    // 删除接收器
+    void    DeleteFrameSink();
+
+    // 成员变量
+    long                    m_nRefCount;        // 引用计数
+    CRITICAL_SECTION        m_critsec;         // 临界区，串行化状态转换和配置；OnReadSample 不进入
+    CCaptureStateMachine    m_state;           // 会话状态，OnReadSample 无锁读取
+
+    HWND                    m_hwndEvent;        // 接收事件的应用程序窗口
+
+    IMFSourceReader* m_pReader; // 源读取器
+
+    BOOL                    m_bFirstSample;    // 是否是第一个样本
+    LONGLONG                m_llBaseTime;      // 基准时间
+
+    WCHAR* m_pwszSymbolicLink; // 符号链接字符串
+
+    CFramePipeline          m_pipeline;        // 帧队列与写入线程
+    IFrameSink*             m_pFrameSink;      // 编码写入文件的接收器（CMFSinkWriterSink 或 CSegmentedSink）
+    CMotionGateSink*        m_pMotionGate;     // 运动门控，未启用时为 nullptr
+    double                  m_fMotionThreshold; // 运动门控的变化阈值，0 表示关闭
+    UINT32                  m_motionHoldMs;    // 运动门控的保持时长
+    CSimulcastSink*         m_pSimulcast;      // 多路缩放输出，未添加缩放输出时为 nullptr
+    IFrameSink*             m_pSimulcastSinks[MAX_SIMULCAST_OUTPUTS];  // 各路缩放输出的接收器
+    ScaleParams             m_simulcastParams[MAX_SIMULCAST_OUTPUTS];  // 各路缩放参数
+    std::wstring            m_simulcastSuffixes[MAX_SIMULCAST_OUTPUTS]; // 各路文件名后缀
+    UINT32                  m_cSimulcast;      // 缩放输出的路数
+    CFrameBus*              m_pBus;            // 帧总线，未添加订阅者时为 nullptr
+    BusSubscriber           m_subscribers[MAX_BUS_SUBSCRIBERS - 1]; // 文件接收器之外的订阅者
+    UINT32                  m_cSubscribers;    // 文件接收器之外的订阅者数
+    CShmRingSink*           m_pShmRing;        // 共享内存帧环，未启用时为 nullptr
+    std::string             m_shmRingName;     // 共享内存帧环的名称，为空表示关闭
+    UINT32                  m_cShmSlots;       // 共享内存帧环的槽数
+    CNetStreamSink*         m_pStream;         // 网络发送，未启用时为 nullptr
+    StreamParams            m_streamParams;    // 网络发送的参数
+    BOOL                    m_bStreaming;      // 是否启用网络发送
+    CSegmentedSink*         m_pSegmented;      // 分段写入，未启用时为 nullptr
+    CMFSinkWriterFactory    m_sinkFactory;     // 创建编码写入器
+    CRawFileSinkFactory     m_rawFactory;      // 创建未压缩录制的接收器
+    CMjpegFileSinkFactory   m_mjpegFactory;    // 创建软件 MJPEG 编码的接收器
+    BOOL                    m_bRawRecording;   // 是否未压缩录制
+    LONGLONG                m_llSegmentDuration; // 每段的最大时长
+    UINT64                  m_cbSegmentSize;   // 每段的最大字节数
+    UINT32                  m_cRetainSegments; // 保留的分段数
+    CPreRollSink*           m_pPreRoll;        // 预录缓冲，未启用时为 nullptr
+    double                  m_fPreRollSeconds; // 预录时长
+    size_t                  m_cbPreRollMemory; // 预录内存上限
+    FormatConstraints       m_constraints;     // 对采集格式的要求
+    NegotiatedFormat        m_negotiated;      // 协商选定的采集格式
+    CCapabilityCache*       m_pCache;          // 能力表缓存，可以为空
+    StartupTimes            m_startup;         // 启动各阶段的耗时
+    CDeviceEventQueue*      m_pEvents;         // 采集出错时放入事件的队列，可以为空
+};
+// CCaptureManager 类为每个枚举到的摄像头启动一路独立的 CCapture，各自拥有写入线程、缓冲池和输出文件
+// 各路之间不共享队列和转换线程池，写入线程按路绑定到不同的逻辑核，吞吐随摄像头数量近似线性增长
+class CCaptureManager
+{
+public:
+    CCaptureManager();
+    ~CCaptureManager();
+
+    // 为 pDevices 中的每个设备开始捕获，输出文件为 <pwszFilePrefix>_<序号>.mp4（未压缩录制时为 .raw 或 .y4m，
+    // param.subtype 为 MFVideoFormat_MJPG 时为 .mkv）；各设备在各自的线程中并行激活和配置，部分设备启动失败时其余设备照常捕获，全部失败时返回第一个错误
+    HRESULT     StartAll(DeviceList* pDevices, const WCHAR* pwszFilePrefix, const EncodingParameters& param);
+
+    // 结束所有设备的捕获
+    HRESULT     StopAll();
 
-    HWND                    m_hwndEvent;        // ¼Ӧó򴰿
+    // 为之后启动的每个设备启用预录，参数同 CCapture::SetPreRoll，在 StartAll 之前调用
+    void        SetPreRoll(double fSeconds, size_t cbMaxMemory = DEFAULT_PREROLL_MEMORY) { m_fPreRollSeconds = fSeconds; m_cbPreRollMemory = cbMaxMemory; }
 
-    IMFSourceReader* m_pReader; // Դȡ
-    IMFSinkWriter* m_pWriter;  // д
+    // 同时触发所有设备的预录
+    HRESULT     TriggerAll();
 
-    BOOL                    m_bFirstSample;    // Ƿǵһ
-    LONGLONG                m_llBaseTime;      // ׼ʱ
+    // 为之后启动的每个设备启用运动门控，参数同 CCapture::SetMotionGate，在 StartAll 之前调用
+    void        SetMotionGate(double fThreshold, UINT32 holdMs = DEFAULT_MOTION_HOLD_MS) { m_fMotionThreshold = fThreshold; m_motionHoldMs = holdMs; }
 
-    WCHAR* m_pwszSymbolicLink; // ַ
-};
\ No newline at end of file
+    // 为之后启动的每个设备添加一路缩放输出，参数同 CCapture::AddSimulcastOutput，在 StartAll 之前调用
+    HRESULT     AddSimulcastOutput(const ScaleParams& params, const WCHAR* pwszSuffix);
+
+    // 为之后启动的每个设备启用共享内存帧环，名称为 <pszPrefix>_<序号>，参数同 CCapture::SetSharedMemoryRing，
+    // pszPrefix 为空时关闭，在 StartAll 之前调用
+    void        SetSharedMemoryRing(const char* pszPrefix, UINT32 cSlots = DEFAULT_SHM_RING_SLOTS)
+    {
+        m_shmRingPrefix = pszPrefix ? pszPrefix : "";
+        m_cShmSlots = cSlots;
+    }
+
+    // 为之后启动的每个设备启用网络发送，第 i 个设备监听 port + i（port 为 0 时都由系统分配），
+    // 其余参数同 CCapture::SetNetworkStream，pParams 为空时关闭，在 StartAll 之前调用
+    void        SetNetworkStream(const StreamParams* pParams)
+    {
+        m_bStreaming = pParams != nullptr;
+        m_streamParams = pParams ? *pParams : StreamParams();
+    }
+
+    // 为之后启动的每个设备启用未压缩录制，参数同 CCapture::SetRawRecording，输出文件扩展名相应改为 .raw 或 .y4m
+    void        SetRawRecording(BOOL bEnable, RawContainer container = RawContainer_Raw, BOOL bDirect = TRUE)
+    {
+        m_bRawRecording = bEnable;
+        m_rawContainer = container;
+        m_bRawDirect = bDirect;
+    }
+
+    // 为之后启动的每个设备启用分段写入，参数同 CCapture::SetSegmentation，在 StartAll 之前调用
+    void        SetSegmentation(LONGLONG llMaxDuration, UINT64 cbMaxSize, UINT32 cRetain = 0)
+    {
+        m_llSegmentDuration = llMaxDuration;
+        m_cbSegmentSize = cbMaxSize;
+        m_cRetainSegments = cRetain;
+    }
+
+    // 为之后启动的每个设备使用能力表缓存，参数同 CCapture::SetCapabilityCache；缓存中的设备激活失败时
+    // 使缓存的设备列表作废，在 StartAll 之前调用
+    void        SetCapabilityCache(CCapabilityCache* pCache) { m_pCache = pCache; }
+
+    // 处理 WM_DEVICECHANGE：摄像头接入或移除时更新能力表缓存，之后的启动重新枚举或探测；
+    // 启用了恢复时同时交给 CDeviceRecovery
+    void        OnDeviceChange(WPARAM wParam, DEV_BROADCAST_HDR* pHdr);
+
+    // 启用热插拔恢复，在 StartAll 之后调用：在后台线程上用隐藏的消息窗口接收设备通知（不需要应用程序的窗口），
+    // 设备移除或采集出错时保持输出文件打开，重新激活原设备，原设备超过 fallbackDelayMs 没有回来时
+    // 改用 pDevices 中或之后接入的、没有在使用的设备；retryMs 和 fallbackDelayMs 为 0 时取默认值
+    HRESULT     StartRecovery(DeviceList* pDevices, UINT32 retryMs = 0, UINT32 fallbackDelayMs = 0);
+
+    // 获取第 index 路的恢复状态，未启动的设备或未启用恢复时返回 S_FALSE
+    HRESULT     GetRecoveryStatus(UINT32 index, RecoveryStatus* pStatus) const;
+
+    // 为之后启动的每个设备设置对采集格式的要求，参数同 CCapture::SetFormatConstraints，在 StartAll 之前调用
+    void        SetFormatConstraints(const FormatConstraints& constraints) { m_constraints = constraints; }
+
+    // 为之后启动的每个设备设置过载策略，参数同 CCapture::SetOverloadPolicy，在 StartAll 之前调用
+    void        SetOverloadPolicy(OverloadPolicy policy, UINT32 value = 0) { m_overloadPolicy = policy; m_overloadValue = value; }
+
+    // 正在管理的设备数
+    UINT32      Count() const { return m_cCaptures; }
+
+    // 获取第 index 路的 CCapture，未启动的设备返回 nullptr
+    CCapture*   GetCapture(UINT32 index) const;
+
+    // 汇总各路的流水线统计：帧数、字节数、帧率与溢出次数相加，延迟取加权平均和最大值，首帧时长取最慢的一路，
+    // 设备丢失和恢复次数相加，恢复时长取最长的一次
+    void        GetAggregateStats(PipelineStats* pStats) const;
+
+    // 每 intervalMs 毫秒把各路的统计和延迟分位数写入 pwszPath，在 StartAll 之后调用，StopAll 时输出最终结果并停止
+    HRESULT     StartStatsReport(const WCHAR* pwszPath, StatsFormat format, UINT32 intervalMs = DEFAULT_STATS_INTERVAL_MS);
+
+private:
+    CCaptureManager(const CCaptureManager&);
+    CCaptureManager& operator=(const CCaptureManager&);
+
+    // 设备通知线程：创建隐藏的消息窗口、注册设备通知，把 WM_DEVICECHANGE 转给 OnDeviceChange，直到窗口关闭
+    void        NotifyThread(HANDLE hReady);
+
+    // 停止设备通知线程和恢复
+    void        StopRecovery();
+
+    CCapture**  m_ppCaptures;   // 每个设备一路，启动失败的设备为 nullptr
+    UINT32      m_cCaptures;    // 设备数
+    double      m_fPreRollSeconds;  // 预录时长，0 表示关闭
+    size_t      m_cbPreRollMemory;  // 每个设备的预录内存上限
+    double      m_fMotionThreshold; // 运动门控的变化阈值，0 表示关闭
+    UINT32      m_motionHoldMs;     // 运动门控的保持时长
+    ScaleParams m_simulcastParams[MAX_SIMULCAST_OUTPUTS];   // 各路缩放参数
+    std::wstring m_simulcastSuffixes[MAX_SIMULCAST_OUTPUTS]; // 各路文件名后缀
+    UINT32      m_cSimulcast;       // 缩放输出的路数
+    std::string m_shmRingPrefix;    // 共享内存帧环的名称前缀，为空表示关闭
+    UINT32      m_cShmSlots;        // 共享内存帧环的槽数
+    StreamParams m_streamParams;    // 网络发送的参数
+    BOOL        m_bStreaming;       // 是否启用网络发送
+    LONGLONG    m_llSegmentDuration; // 每段的最大时长
+    UINT64      m_cbSegmentSize;    // 每段的最大字节数
+    UINT32      m_cRetainSegments;  // 每个设备保留的分段数
+    BOOL        m_bRawRecording;    // 是否未压缩录制
+    RawContainer m_rawContainer;    // 未压缩录制的文件格式
+    BOOL        m_bRawDirect;       // 未压缩录制是否使用直接 I/O
+    OverloadPolicy m_overloadPolicy; // 过载策略
+    UINT32      m_overloadValue;    // 过载策略的参数
+    FormatConstraints m_constraints; // 对采集格式的要求
+    CCapabilityCache* m_pCache;     // 能力表缓存，可以为空
+    CStatsReporter m_reporter;      // 定期输出各路统计
+    CDeviceRecovery m_recovery;     // 热插拔恢复
+    std::thread m_notifyThread;     // 设备通知线程
+    HWND        m_hwndNotify;       // 接收设备通知的消息窗口
+    HRESULT     m_hrNotify;         // 设备通知线程的启动结果
+};
@@ -0,0 +1,969 @@
+#include <string.h>
+#include <vector>
+#include "convert.h"
+
+#ifdef PLATFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// 每个行带至少包含的行数，避免小图切得过碎
+static const UINT32 c_minRowsPerBand = 16;
+
+// 一帧图像的各个平面
+struct ImagePlanes
+{
+    BYTE*   pPlane[3];  // 平面首地址
+    UINT32  stride[3];  // 平面行跨度
+};
+
+// 行级内核：一次处理一对相邻行（4:2:0 色度在垂直方向上两行共用）
+struct ConvertKernels
+{
+    // YUY2/UYVY 两行 -> 两行亮度 + 一行 U、V（两行色度取平均）
+    void (*pfnPacked422ToPlanar)(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width, BOOL bUyvy);
+
+    // RGB32 两行 -> 两行亮度 + 一行 U、V（2x2 像素块取平均）
+    void (*pfnRgb32ToPlanar)(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width);
+
+    // 一行亮度 + 一行 U、V -> 一行 YUY2/UYVY
+    void (*pfnPlanarToPacked422)(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width, BOOL bUyvy);
+
+    // 一行亮度 + 一行 U、V -> 一行 RGB32
+    void (*pfnPlanarToRgb32)(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width);
+
+    // NV12 交错色度 -> 分离的 U、V
+    void (*pfnSplitUV)(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs);
+
+    // 分离的 U、V -> NV12 交错色度
+    void (*pfnMergeUV)(const BYTE* pU, const BYTE* pV, BYTE* pUV, UINT32 cPairs);
+};
+
+// 每个线程各自的中间行缓冲区，只在宽度变大时重新分配
+struct ConvertScratch
+{
+    std::vector<BYTE>   y0, y1;         // 中间亮度行
+    std::vector<BYTE>   u, v;           // 中间色度行
+    std::vector<BYTE>   rgb0, rgb1;     // RGB24 与 RGB32 之间的中转行
+};
+
+static ConvertScratch& GetScratch(UINT32 width)
+{
+    static thread_local ConvertScratch s_scratch;
+
+    if (s_scratch.y0.size() < width)
+    {
+        s_scratch.y0.resize(width);
+        s_scratch.y1.resize(width);
+        s_scratch.u.resize(width / 2);
+        s_scratch.v.resize(width / 2);
+        s_scratch.rgb0.resize(width * 4);
+        s_scratch.rgb1.resize(width * 4);
+    }
+    return s_scratch;
+}
+
+// 按 frame.h 的紧密布局求出各平面
+static void GetImagePlanes(UINT32 subtype, UINT32 width, UINT32 height, BYTE* pData, ImagePlanes* pPlanes)
+{
+    memset(pPlanes, 0, sizeof(*pPlanes));
+
+    pPlanes->pPlane[0] = pData;
+    pPlanes->stride[0] = GetFrameStride(subtype, width);
+
+    if (subtype == FOURCC_NV12)
+    {
+        pPlanes->pPlane[1] = pData + width * height;
+        pPlanes->stride[1] = width;
+    }
+    else if (subtype == FOURCC_I420 || subtype == FOURCC_IYUV)
+    {
+        pPlanes->pPlane[1] = pData + width * height;
+        pPlanes->stride[1] = width / 2;
+        pPlanes->pPlane[2] = pPlanes->pPlane[1] + (width / 2) * (height / 2);
+        pPlanes->stride[2] = width / 2;
+    }
+}
+
+// 是否是 4:2:0 平面格式
+static BOOL IsPlanar420(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_I420 || subtype == FOURCC_IYUV;
+}
+
+//---------------------------------------------------------------------------------------------
+// 标量实现，也是 SIMD 实现的参考结果
+//
+// RGB -> YUV:  Y = ((66R + 129G + 25B + 128) >> 8) + 16
+//              U = (-38R - 74G + 112B + 512 + (128 << 10)) >> 10   （R、G、B 为 2x2 块之和）
+//              V = (112R - 94G - 18B + 512 + (128 << 10)) >> 10
+// YUV -> RGB:  C = Y - 16, D = U - 128, E = V - 128
+//              R = clip((298C + 409E + 128) >> 8)
+//              G = clip((298C - 100D - 208E + 128) >> 8)
+//              B = clip((298C + 516D + 128) >> 8)
+//---------------------------------------------------------------------------------------------
+
+static inline BYTE Clip255(int value)
+{
+    return (BYTE)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+static inline BYTE RgbToY(int r, int g, int b)
+{
+    return (BYTE)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static void Packed422ToPlanar_C(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width, BOOL bUyvy)
+{
+    int iY = bUyvy ? 1 : 0;
+    int iC = bUyvy ? 0 : 1;
+
+    for (UINT32 x = 0; x < width; x += 2)
+    {
+        const BYTE* a = pSrc0 + x * 2;
+        const BYTE* b = pSrc1 + x * 2;
+
+        pY0[x] = a[iY];
+        pY0[x + 1] = a[iY + 2];
+        pY1[x] = b[iY];
+        pY1[x + 1] = b[iY + 2];
+        pU[x / 2] = (BYTE)((a[iC] + b[iC] + 1) >> 1);
+        pV[x / 2] = (BYTE)((a[iC + 2] + b[iC + 2] + 1) >> 1);
+    }
+}
+
+static void Rgb32ToPlanar_C(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width)
+{
+    for (UINT32 x = 0; x < width; x += 2)
+    {
+        const BYTE* a = pSrc0 + x * 4;
+        const BYTE* b = pSrc1 + x * 4;
+
+        pY0[x] = RgbToY(a[2], a[1], a[0]);
+        pY0[x + 1] = RgbToY(a[6], a[5], a[4]);
+        pY1[x] = RgbToY(b[2], b[1], b[0]);
+        pY1[x + 1] = RgbToY(b[6], b[5], b[4]);
+
+        int bs = a[0] + a[4] + b[0] + b[4];
+        int gs = a[1] + a[5] + b[1] + b[5];
+        int rs = a[2] + a[6] + b[2] + b[6];
+
+        pU[x / 2] = (BYTE)((-38 * rs - 74 * gs + 112 * bs + 512 + (128 << 10)) >> 10);
+        pV[x / 2] = (BYTE)((112 * rs - 94 * gs - 18 * bs + 512 + (128 << 10)) >> 10);
+    }
+}
+
+static void PlanarToPacked422_C(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width, BOOL bUyvy)
+{
+    for (UINT32 x = 0; x < width; x += 2)
+    {
+        BYTE* d = pDst + x * 2;
+
+        if (bUyvy)
+        {
+            d[0] = pU[x / 2];
+            d[1] = pY[x];
+            d[2] = pV[x / 2];
+            d[3] = pY[x + 1];
+        }
+        else
+        {
+            d[0] = pY[x];
+            d[1] = pU[x / 2];
+            d[2] = pY[x + 1];
+            d[3] = pV[x / 2];
+        }
+    }
+}
+
+static void PlanarToRgb32_C(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width)
+{
+    for (UINT32 x = 0; x < width; x++)
+    {
+        int c = pY[x] - 16;
+        int d = pU[x / 2] - 128;
+        int e = pV[x / 2] - 128;
+
+        pDst[x * 4] = Clip255((298 * c + 516 * d + 128) >> 8);
+        pDst[x * 4 + 1] = Clip255((298 * c - 100 * d - 208 * e + 128) >> 8);
+        pDst[x * 4 + 2] = Clip255((298 * c + 409 * e + 128) >> 8);
+        pDst[x * 4 + 3] = 0xFF;
+    }
+}
+
+static void SplitUV_C(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs)
+{
+    for (UINT32 i = 0; i < cPairs; i++)
+    {
+        pU[i] = pUV[i * 2];
+        pV[i] = pUV[i * 2 + 1];
+    }
+}
+
+static void MergeUV_C(const BYTE* pU, const BYTE* pV, BYTE* pUV, UINT32 cPairs)
+{
+    for (UINT32 i = 0; i < cPairs; i++)
+    {
+        pUV[i * 2] = pU[i];
+        pUV[i * 2 + 1] = pV[i];
+    }
+}
+
+// RGB24 与 RGB32 之间的行转换，SSE2 没有字节重排指令，这两步只做标量实现
+static void Rgb24ToRgb32Row(const BYTE* pSrc, BYTE* pDst, UINT32 width)
+{
+    for (UINT32 x = 0; x < width; x++)
+    {
+        pDst[x * 4] = pSrc[x * 3];
+        pDst[x * 4 + 1] = pSrc[x * 3 + 1];
+        pDst[x * 4 + 2] = pSrc[x * 3 + 2];
+        pDst[x * 4 + 3] = 0xFF;
+    }
+}
+
+static void Rgb32ToRgb24Row(const BYTE* pSrc, BYTE* pDst, UINT32 width)
+{
+    for (UINT32 x = 0; x < width; x++)
+    {
+        pDst[x * 3] = pSrc[x * 4];
+        pDst[x * 3 + 1] = pSrc[x * 4 + 1];
+        pDst[x * 3 + 2] = pSrc[x * 4 + 2];
+    }
+}
+
+static const ConvertKernels c_kernelsScalar =
+{
+    Packed422ToPlanar_C,
+    Rgb32ToPlanar_C,
+    PlanarToPacked422_C,
+    PlanarToRgb32_C,
+    SplitUV_C,
+    MergeUV_C,
+};
+
+#ifdef PLATFORM_X86
+
+// 把两个 int16 系数拼成 _mm_madd_epi16 使用的 32 位常量
+#define MADD_PAIR(lo, hi) ((int)((UINT32)(WORD)(short)(lo) | ((UINT32)(WORD)(short)(hi) << 16)))
+
+//---------------------------------------------------------------------------------------------
+// SSE2 实现
+//---------------------------------------------------------------------------------------------
+
+static void Packed422ToPlanar_SSE2(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width, BOOL bUyvy)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    UINT32 x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(pSrc0 + x * 2));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(pSrc0 + x * 2 + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(pSrc1 + x * 2));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(pSrc1 + x * 2 + 16));
+        __m128i ya, yb, ca, cb;
+
+        if (bUyvy)
+        {
+            ya = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+            yb = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+            ca = _mm_packus_epi16(_mm_and_si128(a0, mask), _mm_and_si128(a1, mask));
+            cb = _mm_packus_epi16(_mm_and_si128(b0, mask), _mm_and_si128(b1, mask));
+        }
+        else
+        {
+            ya = _mm_packus_epi16(_mm_and_si128(a0, mask), _mm_and_si128(a1, mask));
+            yb = _mm_packus_epi16(_mm_and_si128(b0, mask), _mm_and_si128(b1, mask));
+            ca = _mm_packus_epi16(_mm_srli_epi16(a0, 8), _mm_srli_epi16(a1, 8));
+            cb = _mm_packus_epi16(_mm_srli_epi16(b0, 8), _mm_srli_epi16(b1, 8));
+        }
+
+        __m128i c = _mm_avg_epu8(ca, cb);
+        __m128i uv = _mm_packus_epi16(_mm_and_si128(c, mask), _mm_srli_epi16(c, 8));
+
+        _mm_storeu_si128((__m128i*)(pY0 + x), ya);
+        _mm_storeu_si128((__m128i*)(pY1 + x), yb);
+        _mm_storel_epi64((__m128i*)(pU + x / 2), uv);
+        _mm_storel_epi64((__m128i*)(pV + x / 2), _mm_srli_si128(uv, 8));
+    }
+
+    Packed422ToPlanar_C(pSrc0 + x * 2, pSrc1 + x * 2, pY0 + x, pY1 + x, pU + x / 2, pV + x / 2, width - x, bUyvy);
+}
+
+// 从 8 个 RGB32 像素中取出 B、G、R 三个通道，各为 8 个 16 位值
+static inline void LoadRgb32_SSE2(const BYTE* pSrc, __m128i* pB, __m128i* pG, __m128i* pR)
+{
+    const __m128i mask = _mm_set1_epi32(0xFF);
+    __m128i p0 = _mm_loadu_si128((const __m128i*)pSrc);
+    __m128i p1 = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+
+    *pB = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+    *pG = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+    *pR = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+// 8 个像素的亮度：中间结果按无符号 16 位计算，最大 56228 不会溢出
+static inline __m128i RgbToY_SSE2(__m128i b, __m128i g, __m128i r)
+{
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)), _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    y = _mm_add_epi16(y, _mm_set1_epi16(128));
+    return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+static void Rgb32ToPlanar_SSE2(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i bias = _mm_set1_epi32(512 + (128 << 10));
+    UINT32 x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i b0, g0, r0, b1, g1, r1;
+
+        LoadRgb32_SSE2(pSrc0 + x * 4, &b0, &g0, &r0);
+        LoadRgb32_SSE2(pSrc1 + x * 4, &b1, &g1, &r1);
+
+        __m128i y0 = RgbToY_SSE2(b0, g0, r0);
+        __m128i y1 = RgbToY_SSE2(b1, g1, r1);
+        _mm_storel_epi64((__m128i*)(pY0 + x), _mm_packus_epi16(y0, y0));
+        _mm_storel_epi64((__m128i*)(pY1 + x), _mm_packus_epi16(y1, y1));
+
+        // 2x2 块之和：先垂直相加，再用 madd 把水平相邻的两个像素加成 32 位
+        __m128i bs = _mm_madd_epi16(_mm_add_epi16(b0, b1), ones);
+        __m128i gs = _mm_madd_epi16(_mm_add_epi16(g0, g1), ones);
+        __m128i rs = _mm_madd_epi16(_mm_add_epi16(r0, r1), ones);
+
+        // 块之和不超过 1020，32 位通道的高 16 位为 0，可以直接与 int16 系数做 madd
+        __m128i u = _mm_add_epi32(_mm_madd_epi16(bs, _mm_set1_epi32(MADD_PAIR(112, 0))),
+            _mm_madd_epi16(gs, _mm_set1_epi32(MADD_PAIR(-74, 0))));
+        u = _mm_add_epi32(u, _mm_madd_epi16(rs, _mm_set1_epi32(MADD_PAIR(-38, 0))));
+        u = _mm_srai_epi32(_mm_add_epi32(u, bias), 10);
+
+        __m128i v = _mm_add_epi32(_mm_madd_epi16(rs, _mm_set1_epi32(MADD_PAIR(112, 0))),
+            _mm_madd_epi16(gs, _mm_set1_epi32(MADD_PAIR(-94, 0))));
+        v = _mm_add_epi32(v, _mm_madd_epi16(bs, _mm_set1_epi32(MADD_PAIR(-18, 0))));
+        v = _mm_srai_epi32(_mm_add_epi32(v, bias), 10);
+
+        __m128i u8 = _mm_packs_epi32(u, u);
+        __m128i v8 = _mm_packs_epi32(v, v);
+        int u32 = _mm_cvtsi128_si32(_mm_packus_epi16(u8, u8));
+        int v32 = _mm_cvtsi128_si32(_mm_packus_epi16(v8, v8));
+        memcpy(pU + x / 2, &u32, 4);
+        memcpy(pV + x / 2, &v32, 4);
+    }
+
+    Rgb32ToPlanar_C(pSrc0 + x * 4, pSrc1 + x * 4, pY0 + x, pY1 + x, pU + x / 2, pV + x / 2, width - x);
+}
+
+static void PlanarToPacked422_SSE2(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width, BOOL bUyvy)
+{
+    UINT32 x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i y = _mm_loadu_si128((const __m128i*)(pY + x));
+        __m128i uv = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pU + x / 2)), _mm_loadl_epi64((const __m128i*)(pV + x / 2)));
+        __m128i lo, hi;
+
+        if (bUyvy)
+        {
+            lo = _mm_unpacklo_epi8(uv, y);
+            hi = _mm_unpackhi_epi8(uv, y);
+        }
+        else
+        {
+            lo = _mm_unpacklo_epi8(y, uv);
+            hi = _mm_unpackhi_epi8(y, uv);
+        }
+
+        _mm_storeu_si128((__m128i*)(pDst + x * 2), lo);
+        _mm_storeu_si128((__m128i*)(pDst + x * 2 + 16), hi);
+    }
+
+    PlanarToPacked422_C(pY + x, pU + x / 2, pV + x / 2, pDst + x * 2, width - x, bUyvy);
+}
+
+// 4 个像素的 (C, D/E) 交错对与系数做 madd，加上舍入后右移 8 位
+static inline __m128i YuvTerm_SSE2(__m128i pair0, int coeff0, __m128i pair1, int coeff1)
+{
+    __m128i t = _mm_add_epi32(_mm_madd_epi16(pair0, _mm_set1_epi32(coeff0)), _mm_madd_epi16(pair1, _mm_set1_epi32(coeff1)));
+    return _mm_srai_epi32(_mm_add_epi32(t, _mm_set1_epi32(128)), 8);
+}
+
+static void PlanarToRgb32_SSE2(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi8((char)0xFF);
+    UINT32 x = 0;
+
+    for (; x + 8 <= width; x += 8)
+    {
+        int u32, v32;
+        memcpy(&u32, pU + x / 2, 4);
+        memcpy(&v32, pV + x / 2, 4);
+
+        __m128i u = _mm_cvtsi32_si128(u32);
+        __m128i v = _mm_cvtsi32_si128(v32);
+
+        __m128i c = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pY + x)), zero), _mm_set1_epi16(16));
+        __m128i d = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(u, u), zero), _mm_set1_epi16(128));
+        __m128i e = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_unpacklo_epi8(v, v), zero), _mm_set1_epi16(128));
+
+        __m128i cdLo = _mm_unpacklo_epi16(c, d), cdHi = _mm_unpackhi_epi16(c, d);
+        __m128i ceLo = _mm_unpacklo_epi16(c, e), ceHi = _mm_unpackhi_epi16(c, e);
+        __m128i e0Lo = _mm_unpacklo_epi16(e, zero), e0Hi = _mm_unpackhi_epi16(e, zero);
+
+        __m128i b = _mm_packs_epi32(YuvTerm_SSE2(cdLo, MADD_PAIR(298, 516), zero, 0), YuvTerm_SSE2(cdHi, MADD_PAIR(298, 516), zero, 0));
+        __m128i g = _mm_packs_epi32(YuvTerm_SSE2(cdLo, MADD_PAIR(298, -100), e0Lo, MADD_PAIR(-208, 0)),
+            YuvTerm_SSE2(cdHi, MADD_PAIR(298, -100), e0Hi, MADD_PAIR(-208, 0)));
+        __m128i r = _mm_packs_epi32(YuvTerm_SSE2(ceLo, MADD_PAIR(298, 409), zero, 0), YuvTerm_SSE2(ceHi, MADD_PAIR(298, 409), zero, 0));
+
+        b = _mm_packus_epi16(b, b);
+        g = _mm_packus_epi16(g, g);
+        r = _mm_packus_epi16(r, r);
+
+        __m128i bg = _mm_unpacklo_epi8(b, g);
+        __m128i ra = _mm_unpacklo_epi8(r, alpha);
+
+        _mm_storeu_si128((__m128i*)(pDst + x * 4), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(pDst + x * 4 + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+
+    PlanarToRgb32_C(pY + x, pU + x / 2, pV + x / 2, pDst + x * 4, width - x);
+}
+
+static void SplitUV_SSE2(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    UINT32 i = 0;
+
+    for (; i + 16 <= cPairs; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pUV + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pUV + i * 2 + 16));
+
+        _mm_storeu_si128((__m128i*)(pU + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i*)(pV + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    SplitUV_C(pUV + i * 2, pU + i, pV + i, cPairs - i);
+}
+
+static void MergeUV_SSE2(const BYTE* pU, const BYTE* pV, BYTE* pUV, UINT32 cPairs)
+{
+    UINT32 i = 0;
+
+    for (; i + 16 <= cPairs; i += 16)
+    {
+        __m128i u = _mm_loadu_si128((const __m128i*)(pU + i));
+        __m128i v = _mm_loadu_si128((const __m128i*)(pV + i));
+
+        _mm_storeu_si128((__m128i*)(pUV + i * 2), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i*)(pUV + i * 2 + 16), _mm_unpackhi_epi8(u, v));
+    }
+
+    MergeUV_C(pU + i, pV + i, pUV + i * 2, cPairs - i);
+}
+
+static const ConvertKernels c_kernelsSSE2 =
+{
+    Packed422ToPlanar_SSE2,
+    Rgb32ToPlanar_SSE2,
+    PlanarToPacked422_SSE2,
+    PlanarToRgb32_SSE2,
+    SplitUV_SSE2,
+    MergeUV_SSE2,
+};
+
+//---------------------------------------------------------------------------------------------
+// AVX2 实现：256 位的 pack/unpack 只在 128 位通道内进行，需要用 permute 恢复顺序
+//---------------------------------------------------------------------------------------------
+
+// 把两个 128 位通道内各自 pack 的结果恢复成连续顺序
+#define PERMUTE_PACKED 0xD8
+
+TARGET_AVX2 static void Packed422ToPlanar_AVX2(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width, BOOL bUyvy)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    UINT32 x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(pSrc0 + x * 2));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(pSrc0 + x * 2 + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(pSrc1 + x * 2));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(pSrc1 + x * 2 + 32));
+        __m256i ya, yb, ca, cb;
+
+        if (bUyvy)
+        {
+            ya = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8));
+            yb = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+            ca = _mm256_packus_epi16(_mm256_and_si256(a0, mask), _mm256_and_si256(a1, mask));
+            cb = _mm256_packus_epi16(_mm256_and_si256(b0, mask), _mm256_and_si256(b1, mask));
+        }
+        else
+        {
+            ya = _mm256_packus_epi16(_mm256_and_si256(a0, mask), _mm256_and_si256(a1, mask));
+            yb = _mm256_packus_epi16(_mm256_and_si256(b0, mask), _mm256_and_si256(b1, mask));
+            ca = _mm256_packus_epi16(_mm256_srli_epi16(a0, 8), _mm256_srli_epi16(a1, 8));
+            cb = _mm256_packus_epi16(_mm256_srli_epi16(b0, 8), _mm256_srli_epi16(b1, 8));
+        }
+
+        __m256i c = _mm256_avg_epu8(ca, cb);
+        __m256i uv = _mm256_packus_epi16(_mm256_and_si256(c, mask), _mm256_srli_epi16(c, 8));
+
+        // ca/cb 的通道顺序一致，平均后再统一重排；uv 的 32 位块依次为
+        // U0-3 U8-11 V0-3 V8-11 | U4-7 U12-15 V4-7 V12-15，重排后低 128 位为 U，高 128 位为 V
+        uv = _mm256_permutevar8x32_epi32(uv, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+
+        _mm256_storeu_si256((__m256i*)(pY0 + x), _mm256_permute4x64_epi64(ya, PERMUTE_PACKED));
+        _mm256_storeu_si256((__m256i*)(pY1 + x), _mm256_permute4x64_epi64(yb, PERMUTE_PACKED));
+        _mm_storeu_si128((__m128i*)(pU + x / 2), _mm256_castsi256_si128(uv));
+        _mm_storeu_si128((__m128i*)(pV + x / 2), _mm256_extracti128_si256(uv, 1));
+    }
+
+    Packed422ToPlanar_SSE2(pSrc0 + x * 2, pSrc1 + x * 2, pY0 + x, pY1 + x, pU + x / 2, pV + x / 2, width - x, bUyvy);
+}
+
+TARGET_AVX2 static inline void LoadRgb32_AVX2(const BYTE* pSrc, __m256i* pB, __m256i* pG, __m256i* pR)
+{
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    __m256i p0 = _mm256_loadu_si256((const __m256i*)pSrc);
+    __m256i p1 = _mm256_loadu_si256((const __m256i*)(pSrc + 32));
+
+    *pB = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(p0, mask), _mm256_and_si256(p1, mask)), PERMUTE_PACKED);
+    *pG = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 8), mask),
+        _mm256_and_si256(_mm256_srli_epi32(p1, 8), mask)), PERMUTE_PACKED);
+    *pR = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(p0, 16), mask),
+        _mm256_and_si256(_mm256_srli_epi32(p1, 16), mask)), PERMUTE_PACKED);
+}
+
+TARGET_AVX2 static inline __m256i RgbToY_AVX2(__m256i b, __m256i g, __m256i r)
+{
+    __m256i y = _mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)), _mm256_mullo_epi16(g, _mm256_set1_epi16(129)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+    return _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(16));
+}
+
+// 16 个 16 位值压成字节，返回连续的 16 字节
+TARGET_AVX2 static inline __m128i PackBytes_AVX2(__m256i value)
+{
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(value, value), PERMUTE_PACKED);
+    return _mm256_castsi256_si128(packed);
+}
+
+TARGET_AVX2 static void Rgb32ToPlanar_AVX2(const BYTE* pSrc0, const BYTE* pSrc1, BYTE* pY0, BYTE* pY1, BYTE* pU, BYTE* pV, UINT32 width)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i bias = _mm256_set1_epi32(512 + (128 << 10));
+    UINT32 x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i b0, g0, r0, b1, g1, r1;
+
+        LoadRgb32_AVX2(pSrc0 + x * 4, &b0, &g0, &r0);
+        LoadRgb32_AVX2(pSrc1 + x * 4, &b1, &g1, &r1);
+
+        _mm_storeu_si128((__m128i*)(pY0 + x), PackBytes_AVX2(RgbToY_AVX2(b0, g0, r0)));
+        _mm_storeu_si128((__m128i*)(pY1 + x), PackBytes_AVX2(RgbToY_AVX2(b1, g1, r1)));
+
+        __m256i bs = _mm256_madd_epi16(_mm256_add_epi16(b0, b1), ones);
+        __m256i gs = _mm256_madd_epi16(_mm256_add_epi16(g0, g1), ones);
+        __m256i rs = _mm256_madd_epi16(_mm256_add_epi16(r0, r1), ones);
+
+        __m256i u = _mm256_add_epi32(_mm256_madd_epi16(bs, _mm256_set1_epi32(MADD_PAIR(112, 0))),
+            _mm256_madd_epi16(gs, _mm256_set1_epi32(MADD_PAIR(-74, 0))));
+        u = _mm256_add_epi32(u, _mm256_madd_epi16(rs, _mm256_set1_epi32(MADD_PAIR(-38, 0))));
+        u = _mm256_srai_epi32(_mm256_add_epi32(u, bias), 10);
+
+        __m256i v = _mm256_add_epi32(_mm256_madd_epi16(rs, _mm256_set1_epi32(MADD_PAIR(112, 0))),
+            _mm256_madd_epi16(gs, _mm256_set1_epi32(MADD_PAIR(-94, 0))));
+        v = _mm256_add_epi32(v, _mm256_madd_epi16(bs, _mm256_set1_epi32(MADD_PAIR(-18, 0))));
+        v = _mm256_srai_epi32(_mm256_add_epi32(v, bias), 10);
+
+        // 8 个 32 位结果：低通道为块 0-3，高通道为块 4-7
+        __m256i u8 = _mm256_packus_epi16(_mm256_packs_epi32(u, u), _mm256_setzero_si256());
+        __m256i v8 = _mm256_packus_epi16(_mm256_packs_epi32(v, v), _mm256_setzero_si256());
+        int u32[2] = { _mm_cvtsi128_si32(_mm256_castsi256_si128(u8)), _mm_cvtsi128_si32(_mm256_extracti128_si256(u8, 1)) };
+        int v32[2] = { _mm_cvtsi128_si32(_mm256_castsi256_si128(v8)), _mm_cvtsi128_si32(_mm256_extracti128_si256(v8, 1)) };
+        memcpy(pU + x / 2, u32, 8);
+        memcpy(pV + x / 2, v32, 8);
+    }
+
+    Rgb32ToPlanar_SSE2(pSrc0 + x * 4, pSrc1 + x * 4, pY0 + x, pY1 + x, pU + x / 2, pV + x / 2, width - x);
+}
+
+TARGET_AVX2 static void PlanarToPacked422_AVX2(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width, BOOL bUyvy)
+{
+    UINT32 x = 0;
+
+    for (; x + 32 <= width; x += 32)
+    {
+        __m128i u = _mm_loadu_si128((const __m128i*)(pU + x / 2));
+        __m128i v = _mm_loadu_si128((const __m128i*)(pV + x / 2));
+        __m256i uv = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi8(u, v)), _mm_unpackhi_epi8(u, v), 1);
+
+        // 预先交换中间两个 64 位块，使通道内的 unpack 按连续顺序输出
+        __m256i y = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(pY + x)), PERMUTE_PACKED);
+        uv = _mm256_permute4x64_epi64(uv, PERMUTE_PACKED);
+
+        __m256i lo, hi;
+
+        if (bUyvy)
+        {
+            lo = _mm256_unpacklo_epi8(uv, y);
+            hi = _mm256_unpackhi_epi8(uv, y);
+        }
+        else
+        {
+            lo = _mm256_unpacklo_epi8(y, uv);
+            hi = _mm256_unpackhi_epi8(y, uv);
+        }
+
+        _mm256_storeu_si256((__m256i*)(pDst + x * 2), lo);
+        _mm256_storeu_si256((__m256i*)(pDst + x * 2 + 32), hi);
+    }
+
+    PlanarToPacked422_SSE2(pY + x, pU + x / 2, pV + x / 2, pDst + x * 2, width - x, bUyvy);
+}
+
+TARGET_AVX2 static inline __m256i YuvTerm_AVX2(__m256i pair0, int coeff0, __m256i pair1, int coeff1)
+{
+    __m256i t = _mm256_add_epi32(_mm256_madd_epi16(pair0, _mm256_set1_epi32(coeff0)), _mm256_madd_epi16(pair1, _mm256_set1_epi32(coeff1)));
+    return _mm256_srai_epi32(_mm256_add_epi32(t, _mm256_set1_epi32(128)), 8);
+}
+
+TARGET_AVX2 static void PlanarToRgb32_AVX2(const BYTE* pY, const BYTE* pU, const BYTE* pV, BYTE* pDst, UINT32 width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha = _mm256_set1_epi8((char)0xFF);
+    UINT32 x = 0;
+
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i u = _mm_loadl_epi64((const __m128i*)(pU + x / 2));
+        __m128i v = _mm_loadl_epi64((const __m128i*)(pV + x / 2));
+
+        __m256i c = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pY + x))), _mm256_set1_epi16(16));
+        __m256i d = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u, u)), _mm256_set1_epi16(128));
+        __m256i e = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v, v)), _mm256_set1_epi16(128));
+
+        // unpack 与随后的 packs 都在通道内进行，两次的顺序变化互相抵消
+        __m256i cdLo = _mm256_unpacklo_epi16(c, d), cdHi = _mm256_unpackhi_epi16(c, d);
+        __m256i ceLo = _mm256_unpacklo_epi16(c, e), ceHi = _mm256_unpackhi_epi16(c, e);
+        __m256i e0Lo = _mm256_unpacklo_epi16(e, zero), e0Hi = _mm256_unpackhi_epi16(e, zero);
+
+        __m256i b = _mm256_packs_epi32(YuvTerm_AVX2(cdLo, MADD_PAIR(298, 516), zero, 0), YuvTerm_AVX2(cdHi, MADD_PAIR(298, 516), zero, 0));
+        __m256i g = _mm256_packs_epi32(YuvTerm_AVX2(cdLo, MADD_PAIR(298, -100), e0Lo, MADD_PAIR(-208, 0)),
+            YuvTerm_AVX2(cdHi, MADD_PAIR(298, -100), e0Hi, MADD_PAIR(-208, 0)));
+        __m256i r = _mm256_packs_epi32(YuvTerm_AVX2(ceLo, MADD_PAIR(298, 409), zero, 0), YuvTerm_AVX2(ceHi, MADD_PAIR(298, 409), zero, 0));
+
+        b = _mm256_packus_epi16(b, b);
+        g = _mm256_packus_epi16(g, g);
+        r = _mm256_packus_epi16(r, r);
+
+        __m256i bg = _mm256_unpacklo_epi8(b, g);
+        __m256i ra = _mm256_unpacklo_epi8(r, alpha);
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+
+        _mm256_storeu_si256((__m256i*)(pDst + x * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(pDst + x * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    PlanarToRgb32_SSE2(pY + x, pU + x / 2, pV + x / 2, pDst + x * 4, width - x);
+}
+
+TARGET_AVX2 static void SplitUV_AVX2(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    UINT32 i = 0;
+
+    for (; i + 32 <= cPairs; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(pUV + i * 2));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(pUV + i * 2 + 32));
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+        _mm256_storeu_si256((__m256i*)(pU + i), _mm256_permute4x64_epi64(u, PERMUTE_PACKED));
+        _mm256_storeu_si256((__m256i*)(pV + i), _mm256_permute4x64_epi64(v, PERMUTE_PACKED));
+    }
+
+    SplitUV_SSE2(pUV + i * 2, pU + i, pV + i, cPairs - i);
+}
+
+TARGET_AVX2 static void MergeUV_AVX2(const BYTE* pU, const BYTE* pV, BYTE* pUV, UINT32 cPairs)
+{
+    UINT32 i = 0;
+
+    for (; i + 32 <= cPairs; i += 32)
+    {
+        __m256i u = _mm256_loadu_si256((const __m256i*)(pU + i));
+        __m256i v = _mm256_loadu_si256((const __m256i*)(pV + i));
+        __m256i lo = _mm256_unpacklo_epi8(u, v);
+        __m256i hi = _mm256_unpackhi_epi8(u, v);
+
+        _mm256_storeu_si256((__m256i*)(pUV + i * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*)(pUV + i * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    MergeUV_SSE2(pU + i, pV + i, pUV + i * 2, cPairs - i);
+}
+
+static const ConvertKernels c_kernelsAVX2 =
+{
+    Packed422ToPlanar_AVX2,
+    Rgb32ToPlanar_AVX2,
+    PlanarToPacked422_AVX2,
+    PlanarToRgb32_AVX2,
+    SplitUV_AVX2,
+    MergeUV_AVX2,
+};
+
+#endif // PLATFORM_X86
+
+// 按 SIMD 级别选择内核表
+static const ConvertKernels* GetKernels(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return &c_kernelsAVX2; }
+    if (level >= CpuLevel_SSE2) { return &c_kernelsSSE2; }
+#else
+    (void)level;
+#endif
+    return &c_kernelsScalar;
+}
+
+// 把一行 NV12 交错色度拆成 U、V 两行
+void SplitChromaRow(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs, CpuLevel level)
+{
+    GetKernels((level > GetCpuLevel()) ? GetCpuLevel() : level)->pfnSplitUV(pUV, pU, pV, cPairs);
+}
+
+// 判断是否支持该转换
+BOOL IsConversionSupported(UINT32 inputSubtype, UINT32 outputSubtype)
+{
+    static const UINT32 subtypes[] =
+    {
+        FOURCC_NV12, FOURCC_I420, FOURCC_IYUV, FOURCC_YUY2, FOURCC_UYVY, FOURCC_RGB24, FOURCC_RGB32
+    };
+
+    BOOL bInput = FALSE;
+    BOOL bOutput = FALSE;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(subtypes); i++)
+    {
+        bInput |= (subtypes[i] == inputSubtype);
+        bOutput |= (subtypes[i] == outputSubtype);
+    }
+
+    return bInput && bOutput;
+}
+
+CFrameConverter::CFrameConverter() :
+    m_level(CpuLevel_Scalar),
+    m_pPool(nullptr),
+    m_cBandsRequested(0),
+    m_cBands(1),
+    m_cRowsPerBand(0),
+    m_pSrc(nullptr),
+    m_pDst(nullptr)
+{
+    m_input = VideoFormat();
+    m_output = VideoFormat();
+}
+
+// 设置输入格式和输出像素格式，并按线程数划分行带
+HRESULT CFrameConverter::Initialize(const VideoFormat& input, UINT32 outputSubtype, CpuLevel level, CTaskPool* pPool)
+{
+    if (!IsConversionSupported(input.subtype, outputSubtype))
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+    if (input.width < 2 || input.height < 2 || (input.width & 1) || (input.height & 1))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_input = input;
+    m_output = input;
+    m_output.subtype = outputSubtype;
+    m_level = (level > ::GetCpuLevel()) ? ::GetCpuLevel() : level;
+    m_pPool = pPool ? pPool : CTaskPool::GetDefault();
+
+    UINT32 cBands = m_cBandsRequested;
+    if (cBands == 0)
+    {
+        cBands = m_pPool ? m_pPool->ThreadCount() : 1;
+    }
+
+    UINT32 cRows = (input.height + cBands - 1) / cBands;
+    if (cRows < c_minRowsPerBand)
+    {
+        cRows = c_minRowsPerBand;
+    }
+
+    m_cRowsPerBand = (cRows + 1) & ~1u;
+    m_cBands = (input.height + m_cRowsPerBand - 1) / m_cRowsPerBand;
+    return S_OK;
+}
+
+// 转换一帧，相同格式直接拷贝
+HRESULT CFrameConverter::Convert(const BYTE* pSrc, BYTE* pDst)
+{
+    if (pSrc == nullptr || pDst == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_cRowsPerBand == 0)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (m_input.subtype == m_output.subtype)
+    {
+        memcpy(pDst, pSrc, GetFrameSize(m_input));
+        return S_OK;
+    }
+
+    m_pSrc = pSrc;
+    m_pDst = pDst;
+
+    if (m_pPool && m_cBands > 1)
+    {
+        m_pPool->ParallelFor(m_cBands, ConvertBandTask, this);
+    }
+    else
+    {
+        ConvertRows(0, m_input.height);
+    }
+
+    return S_OK;
+}
+
+// 行带任务
+void CFrameConverter::ConvertBandTask(void* pContext, UINT32 index)
+{
+    CFrameConverter* pThis = (CFrameConverter*)pContext;
+    UINT32 yStart = index * pThis->m_cRowsPerBand;
+    UINT32 yEnd = yStart + pThis->m_cRowsPerBand;
+
+    if (yEnd > pThis->m_input.height)
+    {
+        yEnd = pThis->m_input.height;
+    }
+
+    pThis->ConvertRows(yStart, yEnd);
+}
+
+// 转换 [yStart, yEnd) 行：每次两行，先把输入拆成亮度行和 4:2:0 色度行，再按输出格式组装
+void CFrameConverter::ConvertRows(UINT32 yStart, UINT32 yEnd)
+{
+    const ConvertKernels* pKernels = GetKernels(m_level);
+    UINT32 width = m_input.width;
+    UINT32 height = m_input.height;
+    UINT32 inSubtype = m_input.subtype;
+    UINT32 outSubtype = m_output.subtype;
+    BOOL bOutPlanar = IsPlanar420(outSubtype);
+
+    ImagePlanes src, dst;
+    GetImagePlanes(inSubtype, width, height, (BYTE*)m_pSrc, &src);
+    GetImagePlanes(outSubtype, width, height, m_pDst, &dst);
+
+    ConvertScratch& scratch = GetScratch(width);
+
+    for (UINT32 y = yStart; y < yEnd; y += 2)
+    {
+        const BYTE* pS0 = src.pPlane[0] + y * src.stride[0];
+        const BYTE* pS1 = pS0 + src.stride[0];
+        BYTE* pD0 = dst.pPlane[0] + y * dst.stride[0];
+        BYTE* pD1 = pD0 + dst.stride[0];
+
+        // 输出是平面格式时亮度直接写到目标行，省去一次拷贝
+        BYTE* pYOut0 = bOutPlanar ? pD0 : scratch.y0.data();
+        BYTE* pYOut1 = bOutPlanar ? pD1 : scratch.y1.data();
+
+        const BYTE* pY0 = pYOut0;
+        const BYTE* pY1 = pYOut1;
+        const BYTE* pU = scratch.u.data();
+        const BYTE* pV = scratch.v.data();
+
+        switch (inSubtype)
+        {
+        case FOURCC_NV12:
+            pY0 = pS0;
+            pY1 = pS1;
+            pKernels->pfnSplitUV(src.pPlane[1] + (y / 2) * src.stride[1], scratch.u.data(), scratch.v.data(), width / 2);
+            break;
+
+        case FOURCC_I420:
+        case FOURCC_IYUV:
+            pY0 = pS0;
+            pY1 = pS1;
+            pU = src.pPlane[1] + (y / 2) * src.stride[1];
+            pV = src.pPlane[2] + (y / 2) * src.stride[2];
+            break;
+
+        case FOURCC_YUY2:
+        case FOURCC_UYVY:
+            pKernels->pfnPacked422ToPlanar(pS0, pS1, pYOut0, pYOut1, scratch.u.data(), scratch.v.data(), width, inSubtype == FOURCC_UYVY);
+            break;
+
+        case FOURCC_RGB32:
+            pKernels->pfnRgb32ToPlanar(pS0, pS1, pYOut0, pYOut1, scratch.u.data(), scratch.v.data(), width);
+            break;
+
+        case FOURCC_RGB24:
+            Rgb24ToRgb32Row(pS0, scratch.rgb0.data(), width);
+            Rgb24ToRgb32Row(pS1, scratch.rgb1.data(), width);
+            pKernels->pfnRgb32ToPlanar(scratch.rgb0.data(), scratch.rgb1.data(), pYOut0, pYOut1, scratch.u.data(), scratch.v.data(), width);
+            break;
+        }
+
+        switch (outSubtype)
+        {
+        case FOURCC_NV12:
+        case FOURCC_I420:
+        case FOURCC_IYUV:
+            if (pY0 != pD0)
+            {
+                memcpy(pD0, pY0, width);
+                memcpy(pD1, pY1, width);
+            }
+
+            if (outSubtype == FOURCC_NV12)
+            {
+                pKernels->pfnMergeUV(pU, pV, dst.pPlane[1] + (y / 2) * dst.stride[1], width / 2);
+            }
+            else
+            {
+                memcpy(dst.pPlane[1] + (y / 2) * dst.stride[1], pU, width / 2);
+                memcpy(dst.pPlane[2] + (y / 2) * dst.stride[2], pV, width / 2);
+            }
+            break;
+
+        case FOURCC_YUY2:
+        case FOURCC_UYVY:
+            pKernels->pfnPlanarToPacked422(pY0, pU, pV, pD0, width, outSubtype == FOURCC_UYVY);
+            pKernels->pfnPlanarToPacked422(pY1, pU, pV, pD1, width, outSubtype == FOURCC_UYVY);
+            break;
+
+        case FOURCC_RGB32:
+            pKernels->pfnPlanarToRgb32(pY0, pU, pV, pD0, width);
+            pKernels->pfnPlanarToRgb32(pY1, pU, pV, pD1, width);
+            break;
+
+        case FOURCC_RGB24:
+            pKernels->pfnPlanarToRgb32(pY0, pU, pV, scratch.rgb0.data(), width);
+            Rgb32ToRgb24Row(scratch.rgb0.data(), pD0, width);
+            pKernels->pfnPlanarToRgb32(pY1, pU, pV, scratch.rgb0.data(), width);
+            Rgb32ToRgb24Row(scratch.rgb0.data(), pD1, width);
+            break;
+        }
+    }
+}
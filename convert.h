@@ -0,0 +1,58 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include "frame.h"
+#include "taskpool.h"
+
+// 判断是否支持从 inputSubtype 转换到 outputSubtype
+// 支持 NV12、I420/IYUV、YUY2、UYVY、RGB24、RGB32 之间的转换，中间统一经过 4:2:0 色度
+BOOL    IsConversionSupported(UINT32 inputSubtype, UINT32 outputSubtype);
+
+// 把一行 NV12 交错色度拆成 U、V 两行，cPairs 为 U、V 的对数；level 超过 CPU 支持的级别时自动降级
+// 供需要平面色度、但不必整帧转换的模块（例如 JPEG 编码）逐行调用
+void    SplitChromaRow(const BYTE* pUV, BYTE* pU, BYTE* pV, UINT32 cPairs, CpuLevel level);
+
+// CFrameConverter 类按 BT.601 有限范围在像素格式之间转换整帧图像
+// 内核有标量、SSE2、AVX2 三种实现，按 CPU 支持的最高级别选择，输出逐位一致；
+// 帧按行带切分后在 CTaskPool 上并行转换
+class CFrameConverter
+{
+public:
+    CFrameConverter();
+
+    // 设置输入格式和输出像素格式；level 超过 CPU 支持的级别时自动降级，pPool 为空时使用默认线程池
+    HRESULT Initialize(const VideoFormat& input, UINT32 outputSubtype,
+        CpuLevel level = CpuLevel_AVX2, CTaskPool* pPool = nullptr);
+
+    // 转换一帧，输入输出都按 frame.h 中的紧密布局排列
+    HRESULT Convert(const BYTE* pSrc, BYTE* pDst);
+
+    // 输入格式
+    const VideoFormat& GetInputFormat() const { return m_input; }
+
+    // 输出格式
+    const VideoFormat& GetOutputFormat() const { return m_output; }
+
+    // 实际使用的 SIMD 级别
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+    // 设置并行转换的行带数，0 表示按线程数自动选择
+    void    SetBandCount(UINT32 cBands) { m_cBandsRequested = cBands; }
+
+private:
+    // 转换 [yStart, yEnd) 行，行号均为偶数
+    void    ConvertRows(UINT32 yStart, UINT32 yEnd);
+
+    // 行带任务
+    static void ConvertBandTask(void* pContext, UINT32 index);
+
+    VideoFormat         m_input;            // 输入格式
+    VideoFormat         m_output;           // 输出格式
+    CpuLevel            m_level;            // SIMD 级别
+    CTaskPool*          m_pPool;            // 线程池
+    UINT32              m_cBandsRequested;  // 请求的行带数
+    UINT32              m_cBands;           // 本次转换的行带数
+    UINT32              m_cRowsPerBand;     // 每个行带的行数（偶数）
+
+    const BYTE*         m_pSrc;             // 本次转换的输入
+    BYTE*               m_pDst;             // 本次转换的输出
+};
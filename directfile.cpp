@@ -0,0 +1,374 @@
+#include "directfile.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <vector>
+
+// 把宽字符路径转换成多字节路径
+static BOOL ToNativePath(const WCHAR* pwszPath, std::vector<char>* pPath)
+{
+    size_t cch = wcstombs(nullptr, pwszPath, 0);
+
+    if (cch == (size_t)-1)
+    {
+        return FALSE;
+    }
+
+    pPath->resize(cch + 1);
+    wcstombs(pPath->data(), pwszPath, cch + 1);
+    return TRUE;
+}
+#endif
+
+#ifdef _WIN32
+
+CDirectFile::CDirectFile() :
+    m_hFile(INVALID_HANDLE_VALUE),
+    m_bDirect(FALSE)
+{
+}
+
+// 创建文件：直接 I/O 时先尝试 FILE_FLAG_NO_BUFFERING，失败再按缓冲方式打开
+HRESULT CDirectFile::Create(const WCHAR* pwszPath, BOOL bDirect)
+{
+    if (pwszPath == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    Close();
+
+    DWORD dwFlags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+
+    if (bDirect)
+    {
+        m_hFile = CreateFileW(pwszPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+            dwFlags | FILE_FLAG_NO_BUFFERING, nullptr);
+        m_bDirect = (m_hFile != INVALID_HANDLE_VALUE);
+    }
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        m_hFile = CreateFileW(pwszPath, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, dwFlags, nullptr);
+    }
+
+    if (m_hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+// 写入一块数据，WriteFile 一次最多写 4GB，按块循环
+HRESULT CDirectFile::Write(const BYTE* pData, size_t cbData)
+{
+    while (cbData > 0)
+    {
+        DWORD cbChunk = cbData > 0x40000000 ? 0x40000000 : (DWORD)cbData;
+        DWORD cbWritten = 0;
+
+        if (!WriteFile(m_hFile, pData, cbChunk, &cbWritten, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        pData += cbWritten;
+        cbData -= cbWritten;
+    }
+
+    return S_OK;
+}
+
+// 在指定偏移写入：同步句柄上带 OVERLAPPED 的 WriteFile 从其中的偏移开始写，写完才返回
+HRESULT CDirectFile::WriteAt(UINT64 offset, const BYTE* pData, size_t cbData)
+{
+    while (cbData > 0)
+    {
+        DWORD cbChunk = cbData > 0x40000000 ? 0x40000000 : (DWORD)cbData;
+        DWORD cbWritten = 0;
+        OVERLAPPED overlapped = {};
+
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+        if (!WriteFile(m_hFile, pData, cbChunk, &cbWritten, &overlapped))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        pData += cbWritten;
+        cbData -= cbWritten;
+        offset += cbWritten;
+    }
+
+    return S_OK;
+}
+
+// 逐段在指定偏移写入，见头文件中的说明
+HRESULT CDirectFile::WriteGatherAt(UINT64 offset, const FileSegment* pSegments, UINT32 cSegments)
+{
+    if (cSegments > MAX_GATHER_SEGMENTS)
+    {
+        return E_INVALIDARG;
+    }
+
+    for (UINT32 i = 0; i < cSegments; i++)
+    {
+        HRESULT hr = WriteAt(offset, pSegments[i].pData, pSegments[i].cbData);
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        offset += pSegments[i].cbData;
+    }
+
+    return S_OK;
+}
+
+// 设置文件长度，对没有缓冲的句柄同样有效
+HRESULT CDirectFile::SetSize(UINT64 cbSize)
+{
+    FILE_END_OF_FILE_INFO info;
+    info.EndOfFile.QuadPart = (LONGLONG)cbSize;
+
+    if (!SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &info, sizeof(info)))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+void CDirectFile::Close()
+{
+    if (m_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hFile);
+        m_hFile = INVALID_HANDLE_VALUE;
+    }
+    m_bDirect = FALSE;
+}
+
+BOOL CDirectFile::IsOpen() const
+{
+    return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+HRESULT CDirectFile::Remove(const WCHAR* pwszPath)
+{
+    if (!DeleteFileW(pwszPath))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+#else
+
+CDirectFile::CDirectFile() :
+    m_fd(-1),
+    m_bDirect(FALSE)
+{
+}
+
+// 创建文件：直接 I/O 时先尝试 O_DIRECT，文件系统不支持（例如 tmpfs）时再按缓冲方式打开
+HRESULT CDirectFile::Create(const WCHAR* pwszPath, BOOL bDirect)
+{
+    std::vector<char> path;
+
+    if (pwszPath == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (!ToNativePath(pwszPath, &path))
+    {
+        return E_INVALIDARG;
+    }
+
+    Close();
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+#ifdef O_DIRECT
+    if (bDirect)
+    {
+        m_fd = open(path.data(), flags | O_DIRECT, 0644);
+        m_bDirect = (m_fd >= 0);
+    }
+#else
+    (void)bDirect;
+#endif
+
+    if (m_fd < 0)
+    {
+        m_fd = open(path.data(), flags, 0644);
+    }
+
+    if (m_fd < 0)
+    {
+        return HResultFromErrno(errno);
+    }
+
+    return S_OK;
+}
+
+// 写入一块数据，处理部分写入和被信号打断的情况
+HRESULT CDirectFile::Write(const BYTE* pData, size_t cbData)
+{
+    while (cbData > 0)
+    {
+        ssize_t cbWritten = write(m_fd, pData, cbData);
+
+        if (cbWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return HResultFromErrno(errno);
+        }
+
+        pData += cbWritten;
+        cbData -= (size_t)cbWritten;
+    }
+
+    return S_OK;
+}
+
+// 在指定偏移写入，处理部分写入和被信号打断的情况
+HRESULT CDirectFile::WriteAt(UINT64 offset, const BYTE* pData, size_t cbData)
+{
+    while (cbData > 0)
+    {
+        ssize_t cbWritten = pwrite(m_fd, pData, cbData, (off_t)offset);
+
+        if (cbWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return HResultFromErrno(errno);
+        }
+        if (cbWritten == 0)
+        {
+            return HRESULT_FROM_WIN32(ERROR_DISK_FULL);
+        }
+
+        pData += cbWritten;
+        cbData -= (size_t)cbWritten;
+        offset += (UINT64)cbWritten;
+    }
+
+    return S_OK;
+}
+
+// 一次 pwritev 写入所有段；部分写入时跳过已写完的段，从写了一半的段的剩余部分继续
+HRESULT CDirectFile::WriteGatherAt(UINT64 offset, const FileSegment* pSegments, UINT32 cSegments)
+{
+    if (cSegments > MAX_GATHER_SEGMENTS)
+    {
+        return E_INVALIDARG;
+    }
+
+    struct iovec vectors[MAX_GATHER_SEGMENTS];
+    UINT32 cVectors = 0;
+
+    for (UINT32 i = 0; i < cSegments; i++)
+    {
+        if (pSegments[i].cbData > 0)
+        {
+            vectors[cVectors].iov_base = const_cast<BYTE*>(pSegments[i].pData);
+            vectors[cVectors].iov_len = pSegments[i].cbData;
+            cVectors++;
+        }
+    }
+
+    struct iovec* pVector = vectors;
+
+    while (cVectors > 0)
+    {
+        ssize_t cbWritten = pwritev(m_fd, pVector, (int)cVectors, (off_t)offset);
+
+        if (cbWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return HResultFromErrno(errno);
+        }
+        if (cbWritten == 0)
+        {
+            return HRESULT_FROM_WIN32(ERROR_DISK_FULL);
+        }
+
+        offset += (UINT64)cbWritten;
+
+        while (cVectors > 0 && (size_t)cbWritten >= pVector->iov_len)
+        {
+            cbWritten -= (ssize_t)pVector->iov_len;
+            pVector++;
+            cVectors--;
+        }
+        if (cVectors > 0)
+        {
+            pVector->iov_base = (BYTE*)pVector->iov_base + cbWritten;
+            pVector->iov_len -= (size_t)cbWritten;
+        }
+    }
+
+    return S_OK;
+}
+
+// 设置文件长度
+HRESULT CDirectFile::SetSize(UINT64 cbSize)
+{
+    if (ftruncate(m_fd, (off_t)cbSize) != 0)
+    {
+        return HResultFromErrno(errno);
+    }
+    return S_OK;
+}
+
+void CDirectFile::Close()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+    m_bDirect = FALSE;
+}
+
+BOOL CDirectFile::IsOpen() const
+{
+    return m_fd >= 0;
+}
+
+HRESULT CDirectFile::Remove(const WCHAR* pwszPath)
+{
+    std::vector<char> path;
+
+    if (!ToNativePath(pwszPath, &path))
+    {
+        return E_INVALIDARG;
+    }
+    if (unlink(path.data()) != 0)
+    {
+        return HResultFromErrno(errno);
+    }
+    return S_OK;
+}
+
+#endif
+
+CDirectFile::~CDirectFile()
+{
+    Close();
+}
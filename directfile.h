@@ -0,0 +1,71 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include "platform.h"
+
+// 直接 I/O 要求的对齐（字节）：缓冲区地址、写入长度和文件偏移都必须是它的整数倍
+const size_t DIRECT_IO_ALIGNMENT = PAGE_SIZE_BYTES;
+
+// 一次分散/聚集写入最多的段数
+const UINT32 MAX_GATHER_SEGMENTS = 128;
+
+// FileSegment 结构体描述分散/聚集写入中的一段数据
+struct FileSegment
+{
+    const BYTE* pData;      // 数据
+    size_t      cbData;     // 长度
+};
+
+// CDirectFile 类是顺序写入的输出文件，尽量绕过系统文件缓存（Windows 的 FILE_FLAG_NO_BUFFERING、
+// Linux 的 O_DIRECT）：大块数据直接从调用方的对齐缓冲区写到磁盘，不在页缓存里再拷贝一次，
+// 也不会因为脏页回写占满内存；文件系统不支持时自动退回普通的缓冲写入
+class CDirectFile
+{
+public:
+    CDirectFile();
+    ~CDirectFile();
+
+    // 创建（覆盖）文件；bDirect 为 FALSE 或文件系统不支持直接 I/O 时使用缓冲写入
+    HRESULT Create(const WCHAR* pwszPath, BOOL bDirect);
+
+    // 在当前位置写入；直接 I/O 时 pData 和 cbData 必须按 DIRECT_IO_ALIGNMENT 对齐
+    HRESULT Write(const BYTE* pData, size_t cbData);
+
+    // 在文件偏移 offset 处写入，不使用也不改变当前位置；直接 I/O 时 offset 同样必须按 DIRECT_IO_ALIGNMENT 对齐
+    HRESULT WriteAt(UINT64 offset, const BYTE* pData, size_t cbData);
+
+    // 从文件偏移 offset 起依次写入 cSegments（不超过 MAX_GATHER_SEGMENTS）段数据，数据不必先拼接到一块缓冲区；
+    // POSIX 上是一次 pwritev，Windows 的 WriteFileGather 只接受整页的段和无缓冲的句柄，改为逐段 WriteAt；
+    // 只用于缓冲写入（各段长度和地址不满足直接 I/O 的对齐）
+    HRESULT WriteGatherAt(UINT64 offset, const FileSegment* pSegments, UINT32 cSegments);
+
+    // 把文件截断或扩展到 cbSize 字节（用于去掉最后一块对齐写入时补的零）
+    HRESULT SetSize(UINT64 cbSize);
+
+    // 关闭文件
+    void    Close();
+
+    // 是否已打开
+    BOOL    IsOpen() const;
+
+    // 是否在使用直接 I/O
+    BOOL    IsDirect() const { return m_bDirect; }
+
+#ifndef _WIN32
+    // 文件描述符，供 io_uring 等直接提交请求的接口使用
+    int     GetDescriptor() const { return m_fd; }
+#endif
+
+    // 删除文件
+    static HRESULT Remove(const WCHAR* pwszPath);
+
+private:
+    CDirectFile(const CDirectFile&);
+    CDirectFile& operator=(const CDirectFile&);
+
+#ifdef _WIN32
+    HANDLE  m_hFile;    // 文件句柄
+#else
+    int     m_fd;       // 文件描述符
+#endif
+    BOOL    m_bDirect;  // 是否使用直接 I/O
+};
@@ -0,0 +1,131 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <chrono>
+#include "platform.h"
+
+// 像素格式用 FOURCC 表示，数值与 Media Foundation 视频子类型 GUID 的 Data1 字段一致，
+// 因此 MFVideoFormat_XXX.Data1 可以直接和下面的常量比较
+#define FRAME_FOURCC(a, b, c, d) \
+    ((UINT32)(BYTE)(a) | ((UINT32)(BYTE)(b) << 8) | ((UINT32)(BYTE)(c) << 16) | ((UINT32)(BYTE)(d) << 24))
+
+const UINT32 FOURCC_NV12  = FRAME_FOURCC('N', 'V', '1', '2');
+const UINT32 FOURCC_YUY2  = FRAME_FOURCC('Y', 'U', 'Y', '2');
+const UINT32 FOURCC_UYVY  = FRAME_FOURCC('U', 'Y', 'V', 'Y');
+const UINT32 FOURCC_IYUV  = FRAME_FOURCC('I', 'Y', 'U', 'V');
+const UINT32 FOURCC_I420  = FRAME_FOURCC('I', '4', '2', '0');
+const UINT32 FOURCC_RGB24 = 20;     // D3DFMT_R8G8B8，即 MFVideoFormat_RGB24
+const UINT32 FOURCC_RGB32 = 22;     // D3DFMT_X8R8G8B8，即 MFVideoFormat_RGB32
+
+// 采集设备常见的压缩原生格式，需要源读取器解码成上面的格式后才能进入流水线
+const UINT32 FOURCC_MJPG  = FRAME_FOURCC('M', 'J', 'P', 'G');
+const UINT32 FOURCC_H264  = FRAME_FOURCC('H', '2', '6', '4');
+
+// 时间戳单位与 Media Foundation 一致，均为 100 纳秒
+const LONGLONG HNS_PER_SECOND = 10000000;
+
+// VideoFormat 结构体描述一路未压缩视频的格式
+struct VideoFormat
+{
+    UINT32  subtype;        // 像素格式 (FOURCC)
+    UINT32  width;          // 宽度（像素）
+    UINT32  height;         // 高度（像素）
+    UINT32  fpsNumerator;   // 帧率分子
+    UINT32  fpsDenominator; // 帧率分母
+};
+
+class CFrameBuffer;
+
+// 帧标志
+enum FrameFlags
+{
+    FrameFlag_Delta = 0x1,  // 依赖之前的帧才能解码（压缩输入的非关键帧）；未压缩的帧总是独立的，不设置此标志
+};
+
+// CaptureFrame 结构体描述一帧数据
+// pBuffer 不为空时数据位于帧缓冲池中，需要在回调之外继续持有数据的一方应调用 pBuffer->AddRef()；
+// pBuffer 为空时 pData 的生命周期由产生它的一方管理，只在当次调用内有效
+struct CaptureFrame
+{
+    BYTE*           pData;          // 帧数据
+    UINT32          cbData;         // 帧数据长度
+    UINT32          flags;          // FrameFlags 的组合
+    LONGLONG        llTimestamp;    // 时间戳（100 纳秒）
+    UINT64          nSequence;      // 帧序号
+    LONGLONG        llArrival;      // 进入流水线的时刻（GetClockTime，100 纳秒）
+    CFrameBuffer*   pBuffer;        // 所属的池化缓冲区，可以为空
+};
+
+// 读取单调时钟，单位 100 纳秒
+inline LONGLONG GetClockTime()
+{
+    using namespace std::chrono;
+    return duration_cast<duration<LONGLONG, std::ratio<1, HNS_PER_SECOND>>>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+// 判断是否是流水线支持的未压缩格式
+inline BOOL IsSupportedSubtype(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_YUY2 || subtype == FOURCC_UYVY ||
+        subtype == FOURCC_IYUV || subtype == FOURCC_I420 ||
+        subtype == FOURCC_RGB24 || subtype == FOURCC_RGB32;
+}
+
+// 获取第一个平面的行跨度（字节），各格式均按紧密排列计算
+inline UINT32 GetFrameStride(UINT32 subtype, UINT32 width)
+{
+    if (subtype == FOURCC_YUY2 || subtype == FOURCC_UYVY) { return width * 2; }
+    if (subtype == FOURCC_RGB24) { return width * 3; }
+    if (subtype == FOURCC_RGB32) { return width * 4; }
+    return width; // NV12 / IYUV / I420 的亮度平面
+}
+
+// 获取一帧图像的字节数，不支持的格式返回 0
+inline UINT32 GetFrameSize(const VideoFormat& format)
+{
+    UINT32 cPixels = format.width * format.height;
+
+    switch (format.subtype)
+    {
+    case FOURCC_NV12:
+    case FOURCC_IYUV:
+    case FOURCC_I420:
+        return cPixels + 2 * ((format.width / 2) * (format.height / 2));
+    case FOURCC_YUY2:
+    case FOURCC_UYVY:
+        return cPixels * 2;
+    case FOURCC_RGB24:
+        return cPixels * 3;
+    case FOURCC_RGB32:
+        return cPixels * 4;
+    }
+    return 0;
+}
+
+// 获取每帧的时长（100 纳秒），未设置帧率时返回 0
+inline LONGLONG GetFrameDuration(const VideoFormat& format)
+{
+    if (format.fpsNumerator == 0 || format.fpsDenominator == 0)
+    {
+        return 0;
+    }
+    return HNS_PER_SECOND * format.fpsDenominator / format.fpsNumerator;
+}
+
+// 获取像素格式的名称，用于日志输出
+inline const char* GetSubtypeName(UINT32 subtype)
+{
+    switch (subtype)
+    {
+    case FOURCC_NV12:  return "NV12";
+    case FOURCC_YUY2:  return "YUY2";
+    case FOURCC_UYVY:  return "UYVY";
+    case FOURCC_IYUV:  return "IYUV";
+    case FOURCC_I420:  return "I420";
+    case FOURCC_RGB24: return "RGB24";
+    case FOURCC_RGB32: return "RGB32";
+    case FOURCC_MJPG:  return "MJPG";
+    case FOURCC_H264:  return "H264";
+    }
+    return "unknown";
+}
@@ -0,0 +1,513 @@
+#include <string.h>
+#include "framebus.h"
+
+// 订阅者的写入线程在队列为空时的最长等待时间，用于兜底检查停止请求
+static const std::chrono::milliseconds c_subscriberIdleWait(10);
+
+// 队列深度向上取整为 2 的幂，与 CSpscRing 的容量一致
+static UINT32 RoundUpQueueDepth(UINT32 cDepth)
+{
+    UINT32 cSlots = 1;
+    while (cSlots < cDepth)
+    {
+        cSlots <<= 1;
+    }
+    return cSlots;
+}
+
+// 交来的帧是否就是缓冲区记录的那一帧：数据、大小、标志、时间戳、序号和到达时刻都相同
+static BOOL IsBufferedFrame(const CaptureFrame& frame)
+{
+    if (frame.pBuffer == nullptr)
+    {
+        return FALSE;
+    }
+
+    const CaptureFrame& buffered = frame.pBuffer->Frame();
+
+    return frame.pData == buffered.pData && frame.cbData == buffered.cbData && frame.flags == buffered.flags &&
+        frame.llTimestamp == buffered.llTimestamp && frame.nSequence == buffered.nSequence &&
+        frame.llArrival == buffered.llArrival;
+}
+
+CFrameBus::CFrameBus() :
+    m_cSubscribers(0),
+    m_pPool(nullptr),
+    m_bSeenDelta(FALSE),
+    m_bStarted(FALSE)
+{
+    m_format = VideoFormat();
+
+    for (UINT32 i = 0; i < MAX_BUS_SUBSCRIBERS; i++)
+    {
+        m_pSubscribers[i] = nullptr;
+    }
+}
+
+CFrameBus::~CFrameBus()
+{
+    StopThreads();
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        delete m_pSubscribers[i];
+    }
+
+    if (m_pPool)
+    {
+        m_pPool->Release();
+    }
+}
+
+// 添加订阅者
+HRESULT CFrameBus::Subscribe(const char* pszName, IFrameSink* pSink, UINT32 cDepth, OverloadPolicy policy, UINT32 value)
+{
+    if (pszName == nullptr || pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_bStarted)
+    {
+        return E_UNEXPECTED;
+    }
+    if (m_cSubscribers >= MAX_BUS_SUBSCRIBERS || cDepth == 0 || policy == OverloadPolicy_Block)
+    {
+        return E_INVALIDARG;
+    }
+
+    Subscriber* pSubscriber = new (std::nothrow) Subscriber();
+
+    if (pSubscriber == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pSubscriber->name = pszName;
+    pSubscriber->pSink = pSink;
+    pSubscriber->cDepth = cDepth;
+    pSubscriber->policy = policy;
+    pSubscriber->decimation = (policy == OverloadPolicy_Decimate && value) ? value : DEFAULT_DECIMATION;
+
+    m_pSubscribers[m_cSubscribers++] = pSubscriber;
+    return S_OK;
+}
+
+// 订阅者的名称
+const char* CFrameBus::GetSubscriberName(UINT32 index) const
+{
+    return index < m_cSubscribers ? m_pSubscribers[index]->name.c_str() : "";
+}
+
+// 所有订阅者最多同时持有的缓冲区数
+UINT32 CFrameBus::GetBufferDemand() const
+{
+    UINT32 cBuffers = 0;
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        cBuffers += RoundUpQueueDepth(m_pSubscribers[i]->cDepth) + 1;
+    }
+
+    return cBuffers;
+}
+
+// 分配各订阅者的队列、打开订阅者，全部成功后再启动写入线程
+HRESULT CFrameBus::BeginWriting(const VideoFormat& format)
+{
+    if (m_bStarted)
+    {
+        return E_UNEXPECTED;
+    }
+    if (m_cSubscribers == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_pPool && !m_pPool->Matches(format))
+    {
+        m_pPool->Release();
+        m_pPool = nullptr;
+    }
+
+    HRESULT hr = S_OK;
+
+    for (UINT32 i = 0; i < m_cSubscribers && SUCCEEDED(hr); i++)
+    {
+        Subscriber* pSubscriber = m_pSubscribers[i];
+
+        hr = pSubscriber->queue.Initialize(pSubscriber->cDepth);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = pSubscriber->pSink->BeginWriting(format);
+        }
+
+        pSubscriber->bWaiting = false;
+        pSubscriber->bStop = false;
+        pSubscriber->hr = S_OK;
+        pSubscriber->drops.Reset();
+        pSubscriber->bDecimating = FALSE;
+        pSubscriber->cDecimated = 0;
+        pSubscriber->nNext = 0;
+        pSubscriber->bAwaitKey = TRUE;
+        pSubscriber->cFrames = 0;
+        pSubscriber->cbWritten = 0;
+        pSubscriber->llWriteTime = 0;
+        pSubscriber->llLatencySum = 0;
+        pSubscriber->cHighWater = 0;
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_format = format;
+    m_bSeenDelta = FALSE;
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        m_pSubscribers[i]->thread = std::thread(&CFrameBus::SubscriberThread, this, m_pSubscribers[i]);
+    }
+
+    m_bStarted = TRUE;
+    return S_OK;
+}
+
+// 发布一帧：池化的帧只增加引用计数，其余的帧先拷贝进总线自己的缓冲池
+HRESULT CFrameBus::WriteFrame(const CaptureFrame& frame)
+{
+    if (!m_bStarted)
+    {
+        return E_UNEXPECTED;
+    }
+
+    CFrameBuffer* pBuffer = frame.pBuffer;
+
+    m_bSeenDelta = m_bSeenDelta || (frame.flags & FrameFlag_Delta);
+
+    if (IsBufferedFrame(frame))
+    {
+        pBuffer->AddRef();
+    }
+    else
+    {
+        HRESULT hr = S_OK;
+
+        if (m_pPool == nullptr)
+        {
+            hr = CFramePool::CreateInstance(m_format, GetBufferDemand() + 1, &m_pPool);
+        }
+
+        pBuffer = nullptr;
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pPool->Acquire(&pBuffer);
+        }
+
+        if (hr != S_OK || pBuffer->GetCapacity() < frame.cbData)
+        {
+            if (pBuffer)
+            {
+                pBuffer->Release();
+            }
+
+            for (UINT32 i = 0; i < m_cSubscribers; i++)
+            {
+                m_pSubscribers[i]->drops.Record(DropReason_PoolEmpty, frame);
+            }
+
+            return FAILED(hr) ? hr : S_OK;
+        }
+
+        memcpy(pBuffer->GetData(), frame.pData, frame.cbData);
+
+        CaptureFrame& copied = pBuffer->Frame();
+        copied.cbData = frame.cbData;
+        copied.flags = frame.flags;
+        copied.llTimestamp = frame.llTimestamp;
+        copied.nSequence = frame.nSequence;
+        copied.llArrival = frame.llArrival;
+    }
+
+    HRESULT hrFirst = S_OK;
+    UINT32 cFailed = 0;
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        HRESULT hr = m_pSubscribers[i]->hr.load(std::memory_order_relaxed);
+
+        if (FAILED(hr))
+        {
+            hrFirst = (cFailed++ == 0) ? hr : hrFirst;
+            continue;
+        }
+
+        Publish(m_pSubscribers[i], pBuffer);
+    }
+
+    pBuffer->Release();
+    return cFailed == m_cSubscribers ? hrFirst : S_OK;
+}
+
+// 把一帧的引用放入订阅者的队列，放不下时按策略挤掉最旧的帧或丢弃新帧，之后唤醒该订阅者的写入线程
+void CFrameBus::Publish(Subscriber* pSubscriber, CFrameBuffer* pBuffer)
+{
+    const CaptureFrame& frame = pBuffer->Frame();
+
+    if (pSubscriber->policy == OverloadPolicy_Decimate)
+    {
+        UINT32 cDepth = pSubscriber->queue.Size();
+        UINT32 cCapacity = pSubscriber->queue.Capacity();
+
+        if (!pSubscriber->bDecimating && cDepth * 4 >= cCapacity * 3)
+        {
+            pSubscriber->bDecimating = TRUE;
+            pSubscriber->cDecimated = 0;
+        }
+        else if (pSubscriber->bDecimating && cDepth * 4 <= cCapacity)
+        {
+            pSubscriber->bDecimating = FALSE;
+        }
+
+        // 压缩输入只能丢非关键帧，未压缩的帧每 decimation 帧保留一帧
+        if (pSubscriber->bDecimating && (m_bSeenDelta ? (frame.flags & FrameFlag_Delta) != 0 :
+            (++pSubscriber->cDecimated % pSubscriber->decimation) != 0))
+        {
+            pSubscriber->drops.Record(DropReason_Decimated, frame);
+            return;
+        }
+    }
+
+    pBuffer->AddRef();
+
+    BOOL bQueued = pSubscriber->queue.TryPush(pBuffer);
+
+    if (!bQueued && pSubscriber->policy == OverloadPolicy_DropOldest)
+    {
+        CFrameBuffer* pOldest = nullptr;
+
+        if (pSubscriber->queue.TryEvict(&pOldest))
+        {
+            pSubscriber->drops.Record(DropReason_Evicted, pOldest->Frame());
+            pOldest->Release();
+        }
+
+        bQueued = pSubscriber->queue.TryPush(pBuffer);
+    }
+
+    if (!bQueued)
+    {
+        pSubscriber->drops.Record(DropReason_QueueFull, frame);
+        pBuffer->Release();
+        return;
+    }
+
+    UINT32 cDepth = pSubscriber->queue.Size();
+    if (cDepth > pSubscriber->cHighWater.load(std::memory_order_relaxed))
+    {
+        pSubscriber->cHighWater.store(cDepth, std::memory_order_relaxed);
+    }
+
+    // 与 SubscriberThread 中先置等待标志再检查队列的顺序配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pSubscriber->bWaiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(pSubscriber->mutex);
+        pSubscriber->cvFrame.notify_one();
+    }
+}
+
+// 订阅者的写入线程：依次写出队列中的帧，序号不连续（在该订阅者的队列上丢过帧）时压缩输入丢到下一个关键帧；
+// 订阅者失败后仍然取出并释放队列中的帧，不占用流水线的缓冲区
+void CFrameBus::SubscriberThread(Subscriber* pSubscriber)
+{
+    for (;;)
+    {
+        CFrameBuffer* pBuffer = nullptr;
+
+        if (!pSubscriber->queue.TryPop(&pBuffer))
+        {
+            if (pSubscriber->bStop.load())
+            {
+                if (pSubscriber->queue.IsEmpty())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(pSubscriber->mutex);
+
+            pSubscriber->bWaiting.store(true, std::memory_order_seq_cst);
+
+            if (pSubscriber->queue.Size() == 0 && !pSubscriber->bStop.load())
+            {
+                pSubscriber->cvFrame.wait_for(lock, c_subscriberIdleWait);
+            }
+
+            pSubscriber->bWaiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        const CaptureFrame& frame = pBuffer->Frame();
+
+        if (frame.nSequence != pSubscriber->nNext)
+        {
+            pSubscriber->bAwaitKey = TRUE;
+        }
+        pSubscriber->nNext = frame.nSequence + 1;
+
+        if (!(frame.flags & FrameFlag_Delta))
+        {
+            pSubscriber->bAwaitKey = FALSE;
+        }
+        else if (pSubscriber->bAwaitKey)
+        {
+            pSubscriber->drops.Record(DropReason_Dependent, frame);
+            pBuffer->Release();
+            continue;
+        }
+
+        if (SUCCEEDED(pSubscriber->hr.load(std::memory_order_relaxed)))
+        {
+            LONGLONG llStart = GetClockTime();
+            HRESULT hr = pSubscriber->pSink->WriteFrame(frame);
+            LONGLONG llEnd = GetClockTime();
+
+            if (FAILED(hr))
+            {
+                pSubscriber->hr = hr;
+            }
+            else
+            {
+                pSubscriber->cFrames.fetch_add(1, std::memory_order_relaxed);
+                pSubscriber->cbWritten.fetch_add(frame.cbData, std::memory_order_relaxed);
+                pSubscriber->llWriteTime.fetch_add(llEnd - llStart, std::memory_order_relaxed);
+                pSubscriber->llLatencySum.fetch_add(llEnd - frame.llArrival, std::memory_order_relaxed);
+            }
+        }
+
+        pBuffer->Release();
+    }
+}
+
+// 请求所有写入线程写空队列后停止，并等待它们退出
+void CFrameBus::StopThreads()
+{
+    if (!m_bStarted)
+    {
+        return;
+    }
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        Subscriber* pSubscriber = m_pSubscribers[i];
+
+        {
+            std::lock_guard<std::mutex> lock(pSubscriber->mutex);
+            pSubscriber->bStop = true;
+            pSubscriber->cvFrame.notify_one();
+        }
+    }
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        m_pSubscribers[i]->thread.join();
+    }
+
+    m_bStarted = FALSE;
+}
+
+// 写完所有队列后结束所有订阅者，某个订阅者失败时其余的仍然结束
+HRESULT CFrameBus::Finalize()
+{
+    StopThreads();
+
+    HRESULT hrFirst = S_OK;
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        HRESULT hr = m_pSubscribers[i]->hr.load();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pSubscribers[i]->pSink->Finalize();
+        }
+
+        if (FAILED(hr) && SUCCEEDED(hrFirst))
+        {
+            hrFirst = hr;
+        }
+    }
+
+    return hrFirst;
+}
+
+// 所有订阅者写出的字节数之和
+HRESULT CFrameBus::GetBytesWritten(UINT64* pcbWritten)
+{
+    if (pcbWritten == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    UINT64 cbTotal = 0;
+    UINT64 cbWritten = 0;
+
+    for (UINT32 i = 0; i < m_cSubscribers; i++)
+    {
+        if (SUCCEEDED(m_pSubscribers[i]->pSink->GetBytesWritten(&cbWritten)))
+        {
+            cbTotal += cbWritten;
+        }
+    }
+
+    *pcbWritten = cbTotal;
+    return S_OK;
+}
+
+// 获取一个订阅者的统计
+HRESULT CFrameBus::GetSubscriberStats(UINT32 index, SubscriberStats* pStats) const
+{
+    if (pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (index >= m_cSubscribers)
+    {
+        return E_INVALIDARG;
+    }
+
+    const Subscriber* pSubscriber = m_pSubscribers[index];
+    DropStats drops;
+
+    pSubscriber->drops.GetStats(&drops);
+
+    pStats->cFrames = pSubscriber->cFrames.load();
+    pStats->cbWritten = pSubscriber->cbWritten.load();
+    pStats->cDropped = drops.cTotal;
+    pStats->cQueueCapacity = pSubscriber->queue.Capacity();
+    pStats->cQueueHighWater = pSubscriber->cHighWater.load();
+    pStats->fAvgWriteUs = pStats->cFrames ? pSubscriber->llWriteTime.load() / 10.0 / pStats->cFrames : 0;
+    pStats->fAvgLatencyMs = pStats->cFrames ? pSubscriber->llLatencySum.load() / 1e4 / pStats->cFrames : 0;
+    pStats->hrStatus = pSubscriber->hr.load();
+    return S_OK;
+}
+
+// 获取一个订阅者分原因的丢帧统计
+HRESULT CFrameBus::GetDropStats(UINT32 index, DropStats* pStats) const
+{
+    if (pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (index >= m_cSubscribers)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_pSubscribers[index]->drops.GetStats(pStats);
+    return S_OK;
+}
@@ -0,0 +1,128 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include "sink.h"
+#include "framequeue.h"
+#include "framepool.h"
+#include "overload.h"
+
+// 一条帧总线最多的订阅者数
+const UINT32 MAX_BUS_SUBSCRIBERS = 8;
+
+// 订阅者默认的队列深度
+const UINT32 DEFAULT_SUBSCRIBER_DEPTH = 4;
+
+// SubscriberStats 结构体保存一个订阅者的统计
+struct SubscriberStats
+{
+    UINT64  cFrames;            // 已写出的帧数
+    UINT64  cbWritten;          // 已写出的字节数（帧数据的大小）
+    UINT64  cDropped;           // 在该订阅者的队列上丢弃的帧数（各原因之和，分原因的统计见 GetDropStats）
+    UINT32  cQueueCapacity;     // 队列容量
+    UINT32  cQueueHighWater;    // 队列深度的峰值
+    double  fAvgWriteUs;        // 每帧 WriteFrame 的平均耗时（微秒）
+    double  fAvgLatencyMs;      // 从进入流水线到该订阅者写完的平均延迟（毫秒）
+    HRESULT hrStatus;           // 订阅者的状态，WriteFrame 失败后为错误码，之后不再给它送帧
+};
+
+// CFrameBus 类把同一帧分发给多个订阅者（例如文件接收器、分析、截图和网络发送），本身作为流水线的接收器：
+// 帧所在的池化缓冲区按引用计数共享，不拷贝帧数据；每个订阅者有自己的无锁队列、写入线程和过载策略，
+// 慢的订阅者只在自己的队列上丢帧，不会拖慢其他订阅者，也不会阻塞流水线的写入线程和采集线程
+//
+// 过载策略支持 OverloadPolicy_DropNewest、OverloadPolicy_DropOldest 和 OverloadPolicy_Decimate，
+// OverloadPolicy_Block 会让一个订阅者阻塞所有订阅者，不支持；压缩输入丢帧后，该订阅者一直丢到下一个关键帧
+//
+// 订阅者持有的缓冲区来自流水线的缓冲池，流水线需要用 CFramePipeline::SetSinkBuffers 留出 GetBufferDemand 块余量；
+// 交来的帧不在缓冲池中（pBuffer 为空，或帧信息与缓冲区记录的不同，例如预录校正过时间戳）时，
+// 先拷贝进总线自己的缓冲池，第一次遇到这种帧时才创建
+//
+// 订阅者由调用方持有，必须在 Finalize 之后才能释放
+class CFrameBus : public IFrameSink
+{
+public:
+    CFrameBus();
+    virtual ~CFrameBus();
+
+    // 添加订阅者，必须在 BeginWriting 之前调用；pszName 用于统计输出，cDepth 为队列深度，
+    // value 对 OverloadPolicy_Decimate 为抽帧间隔，为 0 时取默认值
+    HRESULT Subscribe(const char* pszName, IFrameSink* pSink, UINT32 cDepth = DEFAULT_SUBSCRIBER_DEPTH,
+        OverloadPolicy policy = OverloadPolicy_DropOldest, UINT32 value = 0);
+
+    // 订阅者数
+    UINT32  GetSubscriberCount() const { return m_cSubscribers; }
+
+    // 订阅者的名称
+    const char* GetSubscriberName(UINT32 index) const;
+
+    // 所有订阅者最多同时持有的缓冲区数：各队列的容量加上正在写出的一帧
+    UINT32  GetBufferDemand() const;
+
+    // 依次打开所有订阅者并启动它们的写入线程
+    HRESULT BeginWriting(const VideoFormat& format);
+
+    // 把一帧放入每个订阅者的队列后立即返回；只有所有订阅者都已失败时才返回错误
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 等各订阅者写完队列中的帧，停止写入线程并结束所有订阅者，返回第一个失败
+    HRESULT Finalize();
+
+    // 所有订阅者写出的字节数之和，不支持统计的订阅者不计入
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+    // 获取第 index 个订阅者的统计，可以在任意线程调用
+    HRESULT GetSubscriberStats(UINT32 index, SubscriberStats* pStats) const;
+
+    // 获取第 index 个订阅者分原因的丢帧统计
+    HRESULT GetDropStats(UINT32 index, DropStats* pStats) const;
+
+private:
+    CFrameBus(const CFrameBus&);
+    CFrameBus& operator=(const CFrameBus&);
+
+    // Subscriber 结构体保存一个订阅者的队列、写入线程和统计
+    struct Subscriber
+    {
+        std::string                 name;           // 名称
+        IFrameSink*                 pSink;          // 接收器
+        UINT32                      cDepth;         // 请求的队列深度
+        OverloadPolicy              policy;         // 过载策略
+        UINT32                      decimation;     // 抽帧间隔
+        CSpscRing<CFrameBuffer*>    queue;          // 总线到该订阅者的帧队列
+        std::thread                 thread;         // 写入线程
+        std::mutex                  mutex;          // 与 cvFrame 配合使用
+        std::condition_variable     cvFrame;        // 通知写入线程有新帧
+        std::atomic<bool>           bWaiting;       // 写入线程是否在等待新帧
+        std::atomic<bool>           bStop;          // 请求写入线程在写空队列后停止
+        std::atomic<HRESULT>        hr;             // 写入线程的状态
+        CDropRecorder               drops;          // 丢帧统计
+        BOOL                        bDecimating;    // 发布方：是否正在抽帧
+        UINT32                      cDecimated;     // 发布方：开始抽帧以来到达的帧数
+        UINT64                      nNext;          // 写入线程：预期的下一个帧序号
+        BOOL                        bAwaitKey;      // 写入线程：丢帧后等待下一个关键帧
+        std::atomic<UINT64>         cFrames;        // 已写出帧数
+        std::atomic<UINT64>         cbWritten;      // 已写出字节数
+        std::atomic<LONGLONG>       llWriteTime;    // WriteFrame 的累计耗时（100 纳秒）
+        std::atomic<LONGLONG>       llLatencySum;   // 延迟总和（100 纳秒）
+        std::atomic<UINT32>         cHighWater;     // 队列深度峰值
+    };
+
+    // 发布方：把一帧的引用放入订阅者的队列，放不下时按策略处理
+    void    Publish(Subscriber* pSubscriber, CFrameBuffer* pBuffer);
+
+    // 订阅者的写入线程
+    void    SubscriberThread(Subscriber* pSubscriber);
+
+    // 停止所有写入线程
+    void    StopThreads();
+
+    Subscriber*             m_pSubscribers[MAX_BUS_SUBSCRIBERS];    // 订阅者
+    UINT32                  m_cSubscribers;     // 订阅者数
+    VideoFormat             m_format;           // 输入格式
+    CFramePool*             m_pPool;            // 拷贝不在缓冲池中的帧，需要时才创建
+    BOOL                    m_bSeenDelta;       // 发布方：是否出现过非关键帧（输入为压缩格式）
+    BOOL                    m_bStarted;         // 写入线程是否在运行
+};
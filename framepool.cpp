@@ -0,0 +1,216 @@
+#include <new>
+#include "framepool.h"
+
+// CFrameBuffer 的引用计数，归零时回到缓冲池
+ULONG CFrameBuffer::AddRef()
+{
+    return (ULONG)m_nRefCount.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+ULONG CFrameBuffer::Release()
+{
+    LONG uCount = m_nRefCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (uCount == 0)
+    {
+        m_pPool->Recycle(this);
+    }
+    return (ULONG)uCount;
+}
+
+// 静态方法，用于创建 CFramePool 实例
+HRESULT CFramePool::CreateInstance(const VideoFormat& format, UINT32 cBuffers, CFramePool** ppPool)
+{
+    if (ppPool == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (cBuffers == 0 || GetFrameSize(format) == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    CFramePool* pPool = new (std::nothrow) CFramePool(format);
+
+    if (pPool == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = pPool->Initialize(GetFrameSize(format), cBuffers);
+
+    if (FAILED(hr))
+    {
+        pPool->Release();
+        return hr;
+    }
+
+    *ppPool = pPool;
+    return S_OK;
+}
+
+// 静态方法，创建不对应视频格式的缓冲池
+HRESULT CFramePool::CreateBlockPool(UINT32 cbBuffer, UINT32 cBuffers, CFramePool** ppPool)
+{
+    if (ppPool == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (cBuffers == 0 || cbBuffer == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    CFramePool* pPool = new (std::nothrow) CFramePool(VideoFormat());
+
+    if (pPool == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = pPool->Initialize(cbBuffer, cBuffers);
+
+    if (FAILED(hr))
+    {
+        pPool->Release();
+        return hr;
+    }
+
+    *ppPool = pPool;
+    return S_OK;
+}
+
+CFramePool::CFramePool(const VideoFormat& format) :
+    m_nRefCount(1),
+    m_format(format),
+    m_cbBuffer(0),
+    m_pSlab(nullptr),
+    m_pBuffers(nullptr),
+    m_cBuffers(0),
+    m_cExhausted(0)
+{
+}
+
+CFramePool::~CFramePool()
+{
+    delete[] m_pBuffers;
+    AlignedFree(m_pSlab);
+}
+
+ULONG CFramePool::AddRef()
+{
+    return (ULONG)m_nRefCount.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+ULONG CFramePool::Release()
+{
+    LONG uCount = m_nRefCount.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    if (uCount == 0)
+    {
+        delete this;
+    }
+    return (ULONG)uCount;
+}
+
+// 分配 slab 并切分缓冲区，每块缓冲区起始于页边界
+HRESULT CFramePool::Initialize(size_t cbFrame, UINT32 cBuffers)
+{
+    size_t cbBuffer = (cbFrame + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1);
+
+    m_pSlab = (BYTE*)AlignedAlloc(cbBuffer * cBuffers, PAGE_SIZE_BYTES);
+    m_pBuffers = new (std::nothrow) CFrameBuffer[cBuffers];
+
+    if (m_pSlab == nullptr || m_pBuffers == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    try
+    {
+        m_free.reserve(cBuffers);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_cBuffers = cBuffers;
+    m_cbBuffer = (UINT32)cbBuffer;
+
+    for (UINT32 i = 0; i < cBuffers; i++)
+    {
+        CFrameBuffer* pBuffer = &m_pBuffers[i];
+
+        pBuffer->m_pPool = this;
+        pBuffer->m_pData = m_pSlab + cbBuffer * i;
+        pBuffer->m_cbCapacity = (UINT32)cbBuffer;
+
+        m_free.push_back(pBuffer);
+    }
+
+    return S_OK;
+}
+
+// 获取一块空闲缓冲区
+HRESULT CFramePool::Acquire(CFrameBuffer** ppBuffer)
+{
+    if (ppBuffer == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    CFrameBuffer* pBuffer = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_free.empty())
+        {
+            pBuffer = m_free.back();
+            m_free.pop_back();
+        }
+    }
+
+    if (pBuffer == nullptr)
+    {
+        m_cExhausted.fetch_add(1, std::memory_order_relaxed);
+        *ppBuffer = nullptr;
+        return S_FALSE;
+    }
+
+    AddRef();
+
+    CaptureFrame& frame = pBuffer->m_frame;
+    frame = CaptureFrame();
+    frame.pData = pBuffer->m_pData;
+    frame.pBuffer = pBuffer;
+
+    pBuffer->m_nRefCount.store(1, std::memory_order_relaxed);
+    *ppBuffer = pBuffer;
+    return S_OK;
+}
+
+// 缓冲池是否适用于该格式
+BOOL CFramePool::Matches(const VideoFormat& format) const
+{
+    return format.subtype == m_format.subtype &&
+        format.width == m_format.width &&
+        format.height == m_format.height;
+}
+
+// 空闲缓冲区数
+UINT32 CFramePool::FreeCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (UINT32)m_free.size();
+}
+
+// 缓冲区引用计数归零时放回空闲栈；空闲栈的容量已预留，这里不会分配内存
+void CFramePool::Recycle(CFrameBuffer* pBuffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(pBuffer);
+    }
+
+    Release();
+}
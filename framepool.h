@@ -0,0 +1,101 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "frame.h"
+
+class CFramePool;
+
+// CFrameBuffer 类是帧缓冲池中的一块缓冲区，附带当前所装帧的信息
+// 采用引用计数，最后一个使用者 Release 后自动回到所属的缓冲池，不会真正释放内存
+class CFrameBuffer
+{
+public:
+    // 引用计数
+    ULONG   AddRef();
+    ULONG   Release();
+
+    // 缓冲区首地址（按页对齐）
+    BYTE*   GetData() const { return m_pData; }
+
+    // 缓冲区容量
+    UINT32  GetCapacity() const { return m_cbCapacity; }
+
+    // 当前所装帧的信息，frame.pData 与 frame.pBuffer 始终指向本缓冲区
+    CaptureFrame& Frame() { return m_frame; }
+
+private:
+    friend class CFramePool;
+
+    CFrameBuffer() : m_pPool(nullptr), m_nRefCount(0), m_pData(nullptr), m_cbCapacity(0)
+    {
+        m_frame = CaptureFrame();
+    }
+
+    CFramePool*         m_pPool;        // 所属缓冲池
+    std::atomic<LONG>   m_nRefCount;    // 引用计数
+    BYTE*               m_pData;        // 数据
+    UINT32              m_cbCapacity;   // 容量
+    CaptureFrame        m_frame;        // 帧信息
+};
+
+// CFramePool 类按协商后的帧大小和像素格式一次性分配一整块按页对齐的内存（slab），
+// 切分成固定数量的缓冲区循环使用；稳态下获取和归还缓冲区都不分配堆内存
+class CFramePool
+{
+public:
+    // 创建缓冲池，cBuffers 为缓冲区数量，每块按 format 的帧大小向上取整到页大小
+    static HRESULT CreateInstance(const VideoFormat& format, UINT32 cBuffers, CFramePool** ppPool);
+
+    // 创建不对应视频格式的缓冲池，每块 cbBuffer 字节（向上取整到页大小），用作写盘的大块缓冲区
+    static HRESULT CreateBlockPool(UINT32 cbBuffer, UINT32 cBuffers, CFramePool** ppPool);
+
+    // 引用计数，每个借出的缓冲区也持有一个引用
+    ULONG   AddRef();
+    ULONG   Release();
+
+    // 获取一块空闲缓冲区，引用计数为 1；没有空闲缓冲区时返回 S_FALSE 且 *ppBuffer 为 nullptr
+    HRESULT Acquire(CFrameBuffer** ppBuffer);
+
+    // 缓冲池是否适用于该格式（帧大小和像素格式相同）
+    BOOL    Matches(const VideoFormat& format) const;
+
+    // 缓冲池对应的格式
+    const VideoFormat& GetFormat() const { return m_format; }
+
+    // 缓冲区总数
+    UINT32  Count() const { return m_cBuffers; }
+
+    // 所有缓冲区所在的整块内存及其大小，用于一次性注册给 io_uring 等需要固定内存的接口
+    BYTE*   GetSlab() const { return m_pSlab; }
+    size_t  GetSlabSize() const { return (size_t)m_cbBuffer * m_cBuffers; }
+
+    // 空闲缓冲区数
+    UINT32  FreeCount();
+
+    // 获取缓冲区失败（池已空）的次数
+    UINT64  ExhaustedCount() const { return m_cExhausted.load(); }
+
+private:
+    friend class CFrameBuffer;
+
+    CFramePool(const VideoFormat& format);
+    ~CFramePool();
+
+    // 分配 slab 并切分缓冲区，cbFrame 为每块缓冲区至少要容纳的字节数
+    HRESULT Initialize(size_t cbFrame, UINT32 cBuffers);
+
+    // 缓冲区引用计数归零时放回空闲栈
+    void    Recycle(CFrameBuffer* pBuffer);
+
+    std::atomic<LONG>           m_nRefCount;    // 引用计数
+    VideoFormat                 m_format;       // 格式
+    UINT32                      m_cbBuffer;     // 每块缓冲区的大小（页对齐）
+    BYTE*                       m_pSlab;        // 整块内存
+    CFrameBuffer*               m_pBuffers;     // 缓冲区数组
+    UINT32                      m_cBuffers;     // 缓冲区数量
+    std::vector<CFrameBuffer*>  m_free;         // 空闲栈，容量预留为缓冲区总数
+    std::mutex                  m_mutex;        // 保护空闲栈
+    std::atomic<UINT64>         m_cExhausted;   // 池空次数
+};
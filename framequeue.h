@@ -0,0 +1,155 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include "platform.h"
+
+// 缓存行大小，用于隔离生产者与消费者各自修改的变量，避免伪共享
+const size_t CACHE_LINE_SIZE = 64;
+
+// CSpscRing 是有界的单生产者/单消费者无锁环形队列，T 为可平凡复制的小类型（例如指针）
+// 槽位在 Initialize 时一次性分配并反复使用，入队出队都不分配内存也不加锁
+// 除了消费者出队，生产者在队列已满时还可以用 TryEvict 挤掉队首的元素（丢弃最旧的帧）；
+// 因此队首位置由双方用 CAS 推进，槽位为原子变量，失败的一方只丢弃读到的值
+template <class T>
+class CSpscRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "CSpscRing requires a trivially copyable type");
+
+public:
+    CSpscRing() : m_nHead(0), m_nTail(0), m_nHeadCache(0), m_nTailCache(0), m_nMask(0)
+    {
+    }
+
+    // 分配槽位，容量向上取整为 2 的幂；只能在没有生产者和消费者访问时调用
+    HRESULT Initialize(UINT32 cCapacity)
+    {
+        if (cCapacity == 0 || cCapacity > 0x80000000u)
+        {
+            return E_INVALIDARG;
+        }
+
+        UINT32 cSlots = 1;
+        while (cSlots < cCapacity)
+        {
+            cSlots <<= 1;
+        }
+
+        if (cSlots != Capacity() || !m_slots)
+        {
+            m_slots.reset(new (std::nothrow) std::atomic<T>[cSlots]);
+
+            if (!m_slots)
+            {
+                m_nMask = 0;
+                return E_OUTOFMEMORY;
+            }
+        }
+
+        m_nMask = cSlots - 1;
+        m_nHead.store(0, std::memory_order_relaxed);
+        m_nTail.store(0, std::memory_order_relaxed);
+        m_nHeadCache = 0;
+        m_nTailCache = 0;
+        return S_OK;
+    }
+
+    // 队列容量
+    UINT32  Capacity() const { return m_nMask + 1; }
+
+    // 当前深度（近似值，可由任意线程读取）
+    UINT32  Size() const
+    {
+        UINT64 nTail = m_nTail.load(std::memory_order_acquire);
+        UINT64 nHead = m_nHead.load(std::memory_order_acquire);
+        return nTail > nHead ? (UINT32)(nTail - nHead) : 0;
+    }
+
+    // 生产者：入队，队列已满时返回 FALSE
+    BOOL TryPush(T value)
+    {
+        UINT64 nTail = m_nTail.load(std::memory_order_relaxed);
+
+        if (nTail - m_nHeadCache > m_nMask)
+        {
+            m_nHeadCache = m_nHead.load(std::memory_order_acquire);
+
+            if (nTail - m_nHeadCache > m_nMask)
+            {
+                return FALSE;
+            }
+        }
+
+        m_slots[(size_t)(nTail & m_nMask)].store(value, std::memory_order_relaxed);
+        m_nTail.store(nTail + 1, std::memory_order_release);
+        return TRUE;
+    }
+
+    // 生产者：取出队首的元素（挤掉最旧的一个），队列为空时返回 FALSE
+    BOOL TryEvict(T* pValue)
+    {
+        UINT64 nTail = m_nTail.load(std::memory_order_relaxed);
+        UINT64 nHead = m_nHead.load(std::memory_order_acquire);
+
+        while (nHead != nTail)
+        {
+            T value = m_slots[(size_t)(nHead & m_nMask)].load(std::memory_order_relaxed);
+
+            if (m_nHead.compare_exchange_weak(nHead, nHead + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                m_nHeadCache = nHead + 1;
+                *pValue = value;
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    // 消费者：出队，队列为空时返回 FALSE
+    BOOL TryPop(T* pValue)
+    {
+        UINT64 nHead = m_nHead.load(std::memory_order_acquire);
+
+        for (;;)
+        {
+            if (nHead >= m_nTailCache)
+            {
+                m_nTailCache = m_nTail.load(std::memory_order_acquire);
+
+                if (nHead >= m_nTailCache)
+                {
+                    return FALSE;
+                }
+            }
+
+            // 生产者只有在队首越过 nHead 之后才会覆盖这个槽位，此时下面的 CAS 必然失败
+            T value = m_slots[(size_t)(nHead & m_nMask)].load(std::memory_order_relaxed);
+
+            if (m_nHead.compare_exchange_weak(nHead, nHead + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                *pValue = value;
+                return TRUE;
+            }
+        }
+    }
+
+    // 消费者：队列是否为空
+    BOOL IsEmpty() const
+    {
+        return m_nHead.load(std::memory_order_acquire) >= m_nTail.load(std::memory_order_acquire);
+    }
+
+private:
+    CSpscRing(const CSpscRing&);
+    CSpscRing& operator=(const CSpscRing&);
+
+    alignas(CACHE_LINE_SIZE) std::atomic<UINT64> m_nHead;  // 队首位置，消费者出队和生产者挤掉队首时推进
+    alignas(CACHE_LINE_SIZE) std::atomic<UINT64> m_nTail;  // 生产者位置
+    alignas(CACHE_LINE_SIZE) UINT64 m_nHeadCache;          // 生产者缓存的队首位置
+    alignas(CACHE_LINE_SIZE) UINT64 m_nTailCache;          // 消费者缓存的生产者位置
+    alignas(CACHE_LINE_SIZE) UINT32 m_nMask;               // 容量掩码
+    std::unique_ptr<std::atomic<T>[]> m_slots;              // 槽位
+};
@@ -0,0 +1,439 @@
+#include <string.h>
+#include "framestats.h"
+
+#ifdef PLATFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// 一帧亮度样本的累加值
+//   校验和：A = Σb，B = Σ(pos + 1) * b，均按 2^32 取模，pos 为样本在本帧采样序列中的位置
+struct LumaSums
+{
+    UINT64  sum;        // 亮度之和
+    UINT64  sumSq;      // 亮度平方和
+    UINT32  checkA;     // 校验和低 32 位
+    UINT32  checkB;     // 校验和高 32 位
+    UINT32  position;   // 下一个样本的位置
+    BYTE    minLuma;    // 最小亮度
+    BYTE    maxLuma;    // 最大亮度
+};
+
+// 累加一行亮度
+typedef void (*PFN_ACCUMULATE_ROW)(const BYTE* pRow, UINT32 count, LumaSums* pSums);
+
+static void AccumulateRow_C(const BYTE* pRow, UINT32 count, LumaSums* pSums)
+{
+    UINT64 sum = 0;
+    UINT64 sumSq = 0;
+    UINT32 checkB = pSums->checkB;
+    UINT32 position = pSums->position;
+    BYTE minLuma = pSums->minLuma;
+    BYTE maxLuma = pSums->maxLuma;
+
+    for (UINT32 i = 0; i < count; i++)
+    {
+        BYTE b = pRow[i];
+
+        sum += b;
+        sumSq += (UINT32)b * b;
+        checkB += (position + i + 1) * (UINT32)b;
+        minLuma = b < minLuma ? b : minLuma;
+        maxLuma = b > maxLuma ? b : maxLuma;
+    }
+
+    pSums->sum += sum;
+    pSums->sumSq += sumSq;
+    pSums->checkA += (UINT32)sum;
+    pSums->checkB = checkB;
+    pSums->position = position + count;
+    pSums->minLuma = minLuma;
+    pSums->maxLuma = maxLuma;
+}
+
+// 把一行的向量累加结果并入 pSums：weighted 为 Σ idx * b（idx 为行内下标）
+static void MergeRowSums(UINT64 sum, UINT64 sumSq, UINT64 weighted, BYTE minLuma, BYTE maxLuma, UINT32 count, LumaSums* pSums)
+{
+    pSums->sum += sum;
+    pSums->sumSq += sumSq;
+    pSums->checkA += (UINT32)sum;
+    pSums->checkB += (UINT32)((pSums->position + 1) * sum + weighted);
+    pSums->position += count;
+    pSums->minLuma = minLuma < pSums->minLuma ? minLuma : pSums->minLuma;
+    pSums->maxLuma = maxLuma > pSums->maxLuma ? maxLuma : pSums->maxLuma;
+}
+
+#ifdef PLATFORM_X86
+
+// 16 字节内的最值
+static inline BYTE HorizontalMin(__m128i v)
+{
+    v = _mm_min_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_min_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_min_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_min_epu8(v, _mm_srli_si128(v, 1));
+    return (BYTE)_mm_cvtsi128_si32(v);
+}
+
+static inline BYTE HorizontalMax(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    return (BYTE)_mm_cvtsi128_si32(v);
+}
+
+static inline UINT64 HorizontalSum64(__m128i v)
+{
+    UINT64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+static inline UINT64 HorizontalSum32(__m128i v)
+{
+    UINT32 lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return (UINT64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// 每块 16 字节：sad 求和，madd 求平方和与块内加权和，mul_epu32 把块和乘以块起始下标
+// 平方和的 32 位通道在一行内最多累加 width / 16 * 260100，8K 宽度下不会溢出
+static void AccumulateRow_SSE2(const BYTE* pRow, UINT32 count, LumaSums* pSums)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsLo = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i weightsHi = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+
+    __m128i vMin = _mm_set1_epi8((char)0xFF);
+    __m128i vMax = zero;
+    __m128i vSum = zero;
+    __m128i vSumSq = zero;
+    __m128i vWeightedIn = zero;     // Σ j * b，j 为块内下标
+    __m128i vWeightedBase = zero;   // Σ 块起始下标 * 块和
+    __m128i vBase = zero;
+    const __m128i vStep = _mm_set1_epi32(16);
+    UINT32 i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(pRow + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i sad = _mm_sad_epu8(v, zero);
+
+        vMin = _mm_min_epu8(vMin, v);
+        vMax = _mm_max_epu8(vMax, v);
+        vSum = _mm_add_epi64(vSum, sad);
+        vSumSq = _mm_add_epi32(vSumSq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+        vWeightedIn = _mm_add_epi32(vWeightedIn, _mm_add_epi32(_mm_madd_epi16(lo, weightsLo), _mm_madd_epi16(hi, weightsHi)));
+        vWeightedBase = _mm_add_epi64(vWeightedBase, _mm_mul_epu32(sad, vBase));
+        vBase = _mm_add_epi32(vBase, vStep);
+    }
+
+    if (i > 0)
+    {
+        MergeRowSums(HorizontalSum64(vSum), HorizontalSum32(vSumSq), HorizontalSum64(vWeightedBase) + HorizontalSum32(vWeightedIn),
+            HorizontalMin(vMin), HorizontalMax(vMax), i, pSums);
+    }
+
+    AccumulateRow_C(pRow + i, count - i, pSums);
+}
+
+TARGET_AVX2 static void AccumulateRow_AVX2(const BYTE* pRow, UINT32 count, LumaSums* pSums)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    // unpack 在 128 位通道内进行：lo 为字节 0-7 与 16-23，hi 为字节 8-15 与 24-31
+    const __m256i weightsLo = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 16, 17, 18, 19, 20, 21, 22, 23);
+    const __m256i weightsHi = _mm256_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15, 24, 25, 26, 27, 28, 29, 30, 31);
+
+    __m256i vMin = _mm256_set1_epi8((char)0xFF);
+    __m256i vMax = zero;
+    __m256i vSum = zero;
+    __m256i vSumSq = zero;
+    __m256i vWeightedIn = zero;
+    __m256i vWeightedBase = zero;
+    __m256i vBase = zero;
+    const __m256i vStep = _mm256_set1_epi32(32);
+    UINT32 i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(pRow + i));
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        __m256i sad = _mm256_sad_epu8(v, zero);
+
+        vMin = _mm256_min_epu8(vMin, v);
+        vMax = _mm256_max_epu8(vMax, v);
+        vSum = _mm256_add_epi64(vSum, sad);
+        vSumSq = _mm256_add_epi32(vSumSq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+        vWeightedIn = _mm256_add_epi32(vWeightedIn, _mm256_add_epi32(_mm256_madd_epi16(lo, weightsLo), _mm256_madd_epi16(hi, weightsHi)));
+        vWeightedBase = _mm256_add_epi64(vWeightedBase, _mm256_mul_epu32(sad, vBase));
+        vBase = _mm256_add_epi32(vBase, vStep);
+    }
+
+    if (i > 0)
+    {
+        __m128i vMin128 = _mm_min_epu8(_mm256_castsi256_si128(vMin), _mm256_extracti128_si256(vMin, 1));
+        __m128i vMax128 = _mm_max_epu8(_mm256_castsi256_si128(vMax), _mm256_extracti128_si256(vMax, 1));
+        __m128i vSum128 = _mm_add_epi64(_mm256_castsi256_si128(vSum), _mm256_extracti128_si256(vSum, 1));
+        __m128i vWeightedBase128 = _mm_add_epi64(_mm256_castsi256_si128(vWeightedBase), _mm256_extracti128_si256(vWeightedBase, 1));
+
+        MergeRowSums(HorizontalSum64(vSum128),
+            HorizontalSum32(_mm256_castsi256_si128(vSumSq)) + HorizontalSum32(_mm256_extracti128_si256(vSumSq, 1)),
+            HorizontalSum64(vWeightedBase128) + HorizontalSum32(_mm256_castsi256_si128(vWeightedIn)) +
+                HorizontalSum32(_mm256_extracti128_si256(vWeightedIn, 1)),
+            HorizontalMin(vMin128), HorizontalMax(vMax128), i, pSums);
+    }
+
+    AccumulateRow_SSE2(pRow + i, count - i, pSums);
+}
+
+#endif // PLATFORM_X86
+
+// 按 SIMD 级别选择累加函数
+static PFN_ACCUMULATE_ROW GetAccumulateRow(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return AccumulateRow_AVX2; }
+    if (level >= CpuLevel_SSE2) { return AccumulateRow_SSE2; }
+#else
+    (void)level;
+#endif
+    return AccumulateRow_C;
+}
+
+// 直方图没有合适的向量化方法，相邻样本轮流写入 4 份子直方图
+static void HistogramRow(const BYTE* pRow, UINT32 count, UINT32* pHistograms)
+{
+    UINT32* h0 = pHistograms;
+    UINT32* h1 = pHistograms + 256;
+    UINT32* h2 = pHistograms + 512;
+    UINT32* h3 = pHistograms + 768;
+    UINT32 i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        h0[pRow[i]]++;
+        h1[pRow[i + 1]]++;
+        h2[pRow[i + 2]]++;
+        h3[pRow[i + 3]]++;
+    }
+
+    for (; i < count; i++)
+    {
+        h0[pRow[i]]++;
+    }
+}
+
+// 打包 4:2:2 格式的亮度：YUY2 在偶数字节，UYVY 在奇数字节
+static void ExtractPackedLuma(const BYTE* pSrc, BYTE* pDst, UINT32 width, BOOL bUyvy, CpuLevel level)
+{
+    UINT32 x = 0;
+
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_SSE2)
+    {
+        const __m128i mask = _mm_set1_epi16(0x00FF);
+
+        for (; x + 16 <= width; x += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*)(pSrc + x * 2));
+            __m128i b = _mm_loadu_si128((const __m128i*)(pSrc + x * 2 + 16));
+
+            if (bUyvy)
+            {
+                a = _mm_srli_epi16(a, 8);
+                b = _mm_srli_epi16(b, 8);
+            }
+            else
+            {
+                a = _mm_and_si128(a, mask);
+                b = _mm_and_si128(b, mask);
+            }
+
+            _mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(a, b));
+        }
+    }
+#else
+    (void)level;
+#endif
+
+    for (UINT32 i = bUyvy ? 1 : 0; x < width; x++)
+    {
+        pDst[x] = pSrc[x * 2 + i];
+    }
+}
+
+// RGB 的亮度，公式与 convert.cpp 的 RGB -> YUV 一致
+static void ExtractRgbLuma(const BYTE* pSrc, BYTE* pDst, UINT32 width, UINT32 cbPixel)
+{
+    for (UINT32 x = 0; x < width; x++)
+    {
+        const BYTE* p = pSrc + x * cbPixel;
+        pDst[x] = (BYTE)(((66 * p[2] + 129 * p[1] + 25 * p[0] + 128) >> 8) + 16);
+    }
+}
+
+CFrameAnalyzer::CFrameAnalyzer() :
+    m_level(CpuLevel_Scalar),
+    m_frameStride(1),
+    m_rowStride(1),
+    m_cFramesSeen(0),
+    m_bHasPrevious(FALSE),
+    m_prevChecksum(0)
+{
+    m_format = VideoFormat();
+    m_thresholds = GetDefaultThresholds();
+}
+
+// 默认阈值：有限范围下黑色为 16、白色为 235
+FrameHealthThresholds CFrameAnalyzer::GetDefaultThresholds()
+{
+    FrameHealthThresholds thresholds;
+
+    thresholds.fBlackMean = 24.0;
+    thresholds.blackMax = 40;
+    thresholds.overexposedLuma = 235;
+    thresholds.fOverexposedRatio = 0.75;
+    return thresholds;
+}
+
+// 设置输入格式并分配亮度行与直方图
+HRESULT CFrameAnalyzer::Initialize(const VideoFormat& format, CpuLevel level)
+{
+    if (!IsSupportedSubtype(format.subtype) || format.width == 0 || format.height == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    try
+    {
+        m_lumaRow.resize(format.width);
+        m_histograms.resize(256 * 4);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_format = format;
+    m_level = (level > ::GetCpuLevel()) ? ::GetCpuLevel() : level;
+    m_cFramesSeen = 0;
+    m_bHasPrevious = FALSE;
+    m_prevChecksum = 0;
+    return S_OK;
+}
+
+// 设置采样间隔
+void CFrameAnalyzer::SetSampling(UINT32 frameStride, UINT32 rowStride)
+{
+    m_frameStride = frameStride ? frameStride : 1;
+    m_rowStride = rowStride ? rowStride : 1;
+}
+
+// 取出第 y 行的亮度：平面格式直接返回亮度平面的行，其他格式抽取到 pScratch
+const BYTE* GetLumaRow(const VideoFormat& format, const BYTE* pData, UINT32 y, BYTE* pScratch, CpuLevel level)
+{
+    UINT32 subtype = format.subtype;
+    const BYTE* pRow = pData + (size_t)y * GetFrameStride(subtype, format.width);
+
+    switch (subtype)
+    {
+    case FOURCC_YUY2:
+    case FOURCC_UYVY:
+        ExtractPackedLuma(pRow, pScratch, format.width, subtype == FOURCC_UYVY, level);
+        return pScratch;
+
+    case FOURCC_RGB24:
+        ExtractRgbLuma(pRow, pScratch, format.width, 3);
+        return pScratch;
+
+    case FOURCC_RGB32:
+        ExtractRgbLuma(pRow, pScratch, format.width, 4);
+        return pScratch;
+
+    default:
+        return pRow;
+    }
+}
+
+// 分析一帧
+HRESULT CFrameAnalyzer::Analyze(const CaptureFrame& frame, FrameStats* pStats)
+{
+    if (pStats == nullptr || frame.pData == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_lumaRow.empty())
+    {
+        return E_UNEXPECTED;
+    }
+    if (frame.cbData < GetFrameSize(m_format))
+    {
+        return E_INVALIDARG;
+    }
+
+    if (m_cFramesSeen++ % m_frameStride != 0)
+    {
+        return S_FALSE;
+    }
+
+    PFN_ACCUMULATE_ROW pfnAccumulate = GetAccumulateRow(m_level);
+    LumaSums sums = { 0, 0, 0, 0, 0, 0xFF, 0 };
+    UINT32* pHistograms = m_histograms.data();
+
+    memset(pHistograms, 0, m_histograms.size() * sizeof(UINT32));
+
+    for (UINT32 y = 0; y < m_format.height; y += m_rowStride)
+    {
+        const BYTE* pRow = GetLumaRow(m_format, frame.pData, y, m_lumaRow.data(), m_level);
+
+        pfnAccumulate(pRow, m_format.width, &sums);
+        HistogramRow(pRow, m_format.width, pHistograms);
+    }
+
+    UINT32 cSaturated = 0;
+
+    for (UINT32 i = 0; i < 256; i++)
+    {
+        pStats->histogram[i] = pHistograms[i] + pHistograms[256 + i] + pHistograms[512 + i] + pHistograms[768 + i];
+
+        if (i >= m_thresholds.overexposedLuma)
+        {
+            cSaturated += pStats->histogram[i];
+        }
+    }
+
+    double fCount = (double)sums.position;
+
+    pStats->nSequence = frame.nSequence;
+    pStats->llTimestamp = frame.llTimestamp;
+    pStats->cSamples = sums.position;
+    pStats->fMean = sums.sum / fCount;
+    pStats->fVariance = sums.sumSq / fCount - pStats->fMean * pStats->fMean;
+    pStats->minLuma = sums.minLuma;
+    pStats->maxLuma = sums.maxLuma;
+    pStats->checksum = ((UINT64)sums.checkB << 32) | sums.checkA;
+    pStats->flags = FrameHealth_Ok;
+
+    if (pStats->fMean < m_thresholds.fBlackMean && pStats->maxLuma < m_thresholds.blackMax)
+    {
+        pStats->flags |= FrameHealth_Black;
+    }
+    if (cSaturated > m_thresholds.fOverexposedRatio * fCount)
+    {
+        pStats->flags |= FrameHealth_Overexposed;
+    }
+    if (m_bHasPrevious && pStats->checksum == m_prevChecksum)
+    {
+        pStats->flags |= FrameHealth_Frozen;
+    }
+
+    m_bHasPrevious = TRUE;
+    m_prevChecksum = pStats->checksum;
+    return S_OK;
+}
@@ -0,0 +1,80 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <vector>
+#include "frame.h"
+
+// 画面异常标志
+enum FrameHealth
+{
+    FrameHealth_Ok          = 0,
+    FrameHealth_Black       = 0x1,  // 画面全黑（镜头被遮挡或设备未出图）
+    FrameHealth_Frozen      = 0x2,  // 与上一个分析帧完全相同（画面冻结）
+    FrameHealth_Overexposed = 0x4,  // 大部分像素饱和（过曝）
+};
+
+// FrameStats 结构体保存一帧的亮度统计
+struct FrameStats
+{
+    UINT64      nSequence;          // 帧序号
+    LONGLONG    llTimestamp;        // 时间戳（100 纳秒）
+    UINT32      cSamples;           // 参与统计的亮度样本数
+    UINT32      histogram[256];     // 亮度直方图
+    double      fMean;              // 亮度均值
+    double      fVariance;          // 亮度方差
+    BYTE        minLuma;            // 最小亮度
+    BYTE        maxLuma;            // 最大亮度
+    UINT64      checksum;           // 采样亮度的校验和，用于判断画面冻结
+    UINT32      flags;              // FrameHealth 标志
+};
+
+// 异常判定阈值
+struct FrameHealthThresholds
+{
+    double      fBlackMean;         // 均值低于该值且最大值低于 blackMax 视为全黑
+    BYTE        blackMax;
+    BYTE        overexposedLuma;    // 不低于该亮度的像素视为饱和
+    double      fOverexposedRatio;  // 饱和像素比例超过该值视为过曝
+};
+
+// 取出第 y 行的亮度：平面格式直接返回亮度平面中的行，打包格式与 RGB 抽取到 pScratch（至少 format.width 字节）后返回 pScratch
+const BYTE* GetLumaRow(const VideoFormat& format, const BYTE* pData, UINT32 y, BYTE* pScratch, CpuLevel level);
+
+// CFrameAnalyzer 类从帧中抽取亮度并计算直方图、均值/方差、最值和校验和
+// 只分析每 frameStride 帧中的一帧、每 rowStride 行中的一行，开销按部署需要调节；
+// 累加部分有 SSE2、AVX2 实现，结果与标量实现一致
+class CFrameAnalyzer
+{
+public:
+    CFrameAnalyzer();
+
+    // 设置输入格式，level 超过 CPU 支持的级别时自动降级
+    HRESULT Initialize(const VideoFormat& format, CpuLevel level = CpuLevel_AVX2);
+
+    // 设置采样间隔，0 按 1 处理
+    void    SetSampling(UINT32 frameStride, UINT32 rowStride);
+
+    // 设置异常判定阈值
+    void    SetThresholds(const FrameHealthThresholds& thresholds) { m_thresholds = thresholds; }
+
+    // 分析一帧；按采样间隔跳过的帧返回 S_FALSE
+    HRESULT Analyze(const CaptureFrame& frame, FrameStats* pStats);
+
+    // 实际使用的 SIMD 级别
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+    // 默认阈值
+    static FrameHealthThresholds GetDefaultThresholds();
+
+private:
+    VideoFormat             m_format;       // 输入格式
+    CpuLevel                m_level;        // SIMD 级别
+    UINT32                  m_frameStride;  // 帧采样间隔
+    UINT32                  m_rowStride;    // 行采样间隔
+    UINT64                  m_cFramesSeen;  // 已收到的帧数
+    FrameHealthThresholds   m_thresholds;   // 异常判定阈值
+
+    BOOL                    m_bHasPrevious; // 是否已有上一个分析帧
+    UINT64                  m_prevChecksum; // 上一个分析帧的校验和
+    std::vector<BYTE>       m_lumaRow;      // 打包格式与 RGB 的亮度行
+    std::vector<UINT32>     m_histograms;   // 4 份子直方图，减少相邻样本落在同一桶时的写后读依赖
+};
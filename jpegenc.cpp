@@ -0,0 +1,978 @@
+#include <math.h>
+#include <string.h>
+#include "jpegenc.h"
+#include "convert.h"
+
+#ifdef PLATFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// 每个切片为每个 MCU 预留的输出字节数：4:2:0 原始数据的 1.5 倍，满幅随机噪声在质量 95 以下也不会超出，正常画面远小于此
+static const UINT32 c_bytesPerMcu = 576;
+
+// 一个 MCU 最坏情况下的输出字节数：6 个块，每块 64 个符号，每个符号最多 26 位，再算上 0xFF 后的填充字节
+static const UINT32 c_maxMcuBytes = 2560;
+
+// 量化后系数的范围（基线 JPEG 的 AC 系数最多 10 位）
+static const int c_maxCoefficient = 1023;
+
+// 有限范围 (BT.601) 扩展到 JFIF 全范围：亮度 (y - 16) * 255 / 219，色度 (c - 128) * 255 / 224
+// 扩展的比例并入量化倒数，偏移并入电平偏移：亮度减去 16 + 128 * 219 / 255 后乘以比例即为减去 128 后的全范围值
+static const double c_lumaScale = 255.0 / 219.0;
+static const double c_chromaScale = 255.0 / 224.0;
+static const float c_lumaOffset = (float)(16.0 + 128.0 * 219.0 / 255.0);
+static const float c_chromaOffset = 128.0f;
+
+// AAN 浮点 DCT 的常数
+static const float c_fdct0_382 = 0.382683433f;
+static const float c_fdct0_541 = 0.541196100f;
+static const float c_fdct0_707 = 0.707106781f;
+static const float c_fdct1_306 = 1.306562965f;
+
+// AAN DCT 输出的缩放系数，第 k 个为 cos(k * pi / 16) * sqrt(2)（k = 0 时为 1）
+static const double c_aanScale[8] =
+{
+    1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+// 标准亮度、色度量化表（ITU-T T.81 附录 K，自然顺序）
+static const BYTE c_lumaQuant[64] =
+{
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+static const BYTE c_chromaQuant[64] =
+{
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// 之字形顺序中第 k 个系数在自然顺序（行 * 8 + 列）中的位置，用于写 DQT
+static const BYTE c_naturalOrder[64] =
+{
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// 之字形顺序中第 k 个系数在 DCT 内核输出（水平频率 * 8 + 垂直频率，即自然顺序的转置）中的位置
+static const BYTE c_scanOrder[64] =
+{
+    0, 8, 1, 2, 9, 16, 24, 17, 10, 3, 4, 11, 18, 25, 32, 40,
+    33, 26, 19, 12, 5, 6, 13, 20, 27, 34, 41, 48, 56, 49, 42, 35,
+    28, 21, 14, 7, 15, 22, 29, 36, 43, 50, 57, 58, 51, 44, 37, 30,
+    23, 31, 38, 45, 52, 59, 60, 53, 46, 39, 47, 54, 61, 62, 55, 63,
+};
+
+// 标准 Huffman 表（ITU-T T.81 附录 K.3）：各码长的码字数和按码字顺序排列的符号
+static const BYTE c_dcLumaBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const BYTE c_dcLumaValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const BYTE c_dcChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const BYTE c_dcChromaValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const BYTE c_acLumaBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const BYTE c_acLumaValues[162] =
+{
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const BYTE c_acChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const BYTE c_acChromaValues[162] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+// 判断 CJpegEncoder 是否支持该输入格式
+BOOL IsJpegInputSupported(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_I420 || subtype == FOURCC_IYUV;
+}
+
+// 块级内核：ppRows 为 8 行像素（每行 8 个），减去 offset 后做二维 DCT、乘以量化倒数并取整，
+// 输出按水平频率 * 8 + 垂直频率排列；各级别的运算顺序相同，结果逐位一致
+typedef void (*PFN_FORWARD_DCT)(const BYTE* const* ppRows, float offset, const float* pRecip, INT16* pCoef);
+
+// 一维 8 点 AAN DCT（与 IJG 的 jfdctflt 相同），p[0], p[stride], ... p[7 * stride] 原地变换
+static inline void Fdct8_C(float* p, UINT32 stride)
+{
+    float tmp0 = p[0] + p[7 * stride];
+    float tmp7 = p[0] - p[7 * stride];
+    float tmp1 = p[stride] + p[6 * stride];
+    float tmp6 = p[stride] - p[6 * stride];
+    float tmp2 = p[2 * stride] + p[5 * stride];
+    float tmp5 = p[2 * stride] - p[5 * stride];
+    float tmp3 = p[3 * stride] + p[4 * stride];
+    float tmp4 = p[3 * stride] - p[4 * stride];
+
+    // 偶数部分
+    float tmp10 = tmp0 + tmp3;
+    float tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2;
+    float tmp12 = tmp1 - tmp2;
+
+    p[0] = tmp10 + tmp11;
+    p[4 * stride] = tmp10 - tmp11;
+
+    float z1 = (tmp12 + tmp13) * c_fdct0_707;
+    p[2 * stride] = tmp13 + z1;
+    p[6 * stride] = tmp13 - z1;
+
+    // 奇数部分
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    float z5 = (tmp10 - tmp12) * c_fdct0_382;
+    float z2 = tmp10 * c_fdct0_541 + z5;
+    float z4 = tmp12 * c_fdct1_306 + z5;
+    float z3 = tmp11 * c_fdct0_707;
+    float z11 = tmp7 + z3;
+    float z13 = tmp7 - z3;
+
+    p[5 * stride] = z13 + z2;
+    p[3 * stride] = z13 - z2;
+    p[stride] = z11 + z4;
+    p[7 * stride] = z11 - z4;
+}
+
+static void ForwardDct_C(const BYTE* const* ppRows, float offset, const float* pRecip, INT16* pCoef)
+{
+    float block[64];
+
+    for (UINT32 y = 0; y < 8; y++)
+    {
+        for (UINT32 x = 0; x < 8; x++)
+        {
+            block[y * 8 + x] = (float)ppRows[y][x] - offset;
+        }
+    }
+
+    // 先对每列做垂直变换，再对每行做水平变换，与 SIMD 内核的顺序相同
+    for (UINT32 x = 0; x < 8; x++)
+    {
+        Fdct8_C(block + x, 8);
+    }
+    for (UINT32 v = 0; v < 8; v++)
+    {
+        Fdct8_C(block + v * 8, 1);
+    }
+
+    for (UINT32 u = 0; u < 8; u++)
+    {
+        for (UINT32 v = 0; v < 8; v++)
+        {
+            long value = lrintf(block[v * 8 + u] * pRecip[u * 8 + v]);
+
+            if (value > c_maxCoefficient) { value = c_maxCoefficient; }
+            if (value < -c_maxCoefficient) { value = -c_maxCoefficient; }
+            pCoef[u * 8 + v] = (INT16)value;
+        }
+    }
+}
+
+#ifdef PLATFORM_X86
+
+// 一维 8 点 AAN DCT，在 8 个向量之间进行，每个通道独立
+static inline void Fdct8_SSE2(__m128* p)
+{
+    const __m128 c0_382 = _mm_set1_ps(c_fdct0_382);
+    const __m128 c0_541 = _mm_set1_ps(c_fdct0_541);
+    const __m128 c0_707 = _mm_set1_ps(c_fdct0_707);
+    const __m128 c1_306 = _mm_set1_ps(c_fdct1_306);
+
+    __m128 tmp0 = _mm_add_ps(p[0], p[7]);
+    __m128 tmp7 = _mm_sub_ps(p[0], p[7]);
+    __m128 tmp1 = _mm_add_ps(p[1], p[6]);
+    __m128 tmp6 = _mm_sub_ps(p[1], p[6]);
+    __m128 tmp2 = _mm_add_ps(p[2], p[5]);
+    __m128 tmp5 = _mm_sub_ps(p[2], p[5]);
+    __m128 tmp3 = _mm_add_ps(p[3], p[4]);
+    __m128 tmp4 = _mm_sub_ps(p[3], p[4]);
+
+    __m128 tmp10 = _mm_add_ps(tmp0, tmp3);
+    __m128 tmp13 = _mm_sub_ps(tmp0, tmp3);
+    __m128 tmp11 = _mm_add_ps(tmp1, tmp2);
+    __m128 tmp12 = _mm_sub_ps(tmp1, tmp2);
+
+    p[0] = _mm_add_ps(tmp10, tmp11);
+    p[4] = _mm_sub_ps(tmp10, tmp11);
+
+    __m128 z1 = _mm_mul_ps(_mm_add_ps(tmp12, tmp13), c0_707);
+    p[2] = _mm_add_ps(tmp13, z1);
+    p[6] = _mm_sub_ps(tmp13, z1);
+
+    tmp10 = _mm_add_ps(tmp4, tmp5);
+    tmp11 = _mm_add_ps(tmp5, tmp6);
+    tmp12 = _mm_add_ps(tmp6, tmp7);
+
+    __m128 z5 = _mm_mul_ps(_mm_sub_ps(tmp10, tmp12), c0_382);
+    __m128 z2 = _mm_add_ps(_mm_mul_ps(tmp10, c0_541), z5);
+    __m128 z4 = _mm_add_ps(_mm_mul_ps(tmp12, c1_306), z5);
+    __m128 z3 = _mm_mul_ps(tmp11, c0_707);
+    __m128 z11 = _mm_add_ps(tmp7, z3);
+    __m128 z13 = _mm_sub_ps(tmp7, z3);
+
+    p[5] = _mm_add_ps(z13, z2);
+    p[3] = _mm_sub_ps(z13, z2);
+    p[1] = _mm_add_ps(z11, z4);
+    p[7] = _mm_sub_ps(z11, z4);
+}
+
+// 每行分成左右两半（各 4 列），垂直变换后按 4x4 子块转置，再做水平变换
+static void ForwardDct_SSE2(const BYTE* const* ppRows, float offset, const float* pRecip, INT16* pCoef)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 vOffset = _mm_set1_ps(offset);
+    __m128 left[8];
+    __m128 right[8];
+
+    for (UINT32 y = 0; y < 8; y++)
+    {
+        __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)ppRows[y]), zero);
+
+        left[y] = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(pixels, zero)), vOffset);
+        right[y] = _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(pixels, zero)), vOffset);
+    }
+
+    Fdct8_SSE2(left);
+    Fdct8_SSE2(right);
+
+    // 转置后 left[x] 为第 x 列的垂直频率 0-3，left[4 + x] 为 4-7；right 对应第 4 + x 列
+    _MM_TRANSPOSE4_PS(left[0], left[1], left[2], left[3]);
+    _MM_TRANSPOSE4_PS(left[4], left[5], left[6], left[7]);
+    _MM_TRANSPOSE4_PS(right[0], right[1], right[2], right[3]);
+    _MM_TRANSPOSE4_PS(right[4], right[5], right[6], right[7]);
+
+    __m128 low[8];      // 第 x 列的垂直频率 0-3
+    __m128 high[8];     // 第 x 列的垂直频率 4-7
+
+    for (UINT32 x = 0; x < 4; x++)
+    {
+        low[x] = left[x];
+        high[x] = left[4 + x];
+        low[4 + x] = right[x];
+        high[4 + x] = right[4 + x];
+    }
+
+    Fdct8_SSE2(low);
+    Fdct8_SSE2(high);
+
+    const __m128i vMax = _mm_set1_epi16(c_maxCoefficient);
+    const __m128i vMin = _mm_set1_epi16(-c_maxCoefficient);
+
+    for (UINT32 u = 0; u < 8; u++)
+    {
+        __m128i q0 = _mm_cvtps_epi32(_mm_mul_ps(low[u], _mm_loadu_ps(pRecip + u * 8)));
+        __m128i q1 = _mm_cvtps_epi32(_mm_mul_ps(high[u], _mm_loadu_ps(pRecip + u * 8 + 4)));
+        __m128i q = _mm_min_epi16(_mm_max_epi16(_mm_packs_epi32(q0, q1), vMin), vMax);
+
+        _mm_storeu_si128((__m128i*)(pCoef + u * 8), q);
+    }
+}
+
+TARGET_AVX2 static inline void Fdct8_AVX2(__m256* p)
+{
+    const __m256 c0_382 = _mm256_set1_ps(c_fdct0_382);
+    const __m256 c0_541 = _mm256_set1_ps(c_fdct0_541);
+    const __m256 c0_707 = _mm256_set1_ps(c_fdct0_707);
+    const __m256 c1_306 = _mm256_set1_ps(c_fdct1_306);
+
+    __m256 tmp0 = _mm256_add_ps(p[0], p[7]);
+    __m256 tmp7 = _mm256_sub_ps(p[0], p[7]);
+    __m256 tmp1 = _mm256_add_ps(p[1], p[6]);
+    __m256 tmp6 = _mm256_sub_ps(p[1], p[6]);
+    __m256 tmp2 = _mm256_add_ps(p[2], p[5]);
+    __m256 tmp5 = _mm256_sub_ps(p[2], p[5]);
+    __m256 tmp3 = _mm256_add_ps(p[3], p[4]);
+    __m256 tmp4 = _mm256_sub_ps(p[3], p[4]);
+
+    __m256 tmp10 = _mm256_add_ps(tmp0, tmp3);
+    __m256 tmp13 = _mm256_sub_ps(tmp0, tmp3);
+    __m256 tmp11 = _mm256_add_ps(tmp1, tmp2);
+    __m256 tmp12 = _mm256_sub_ps(tmp1, tmp2);
+
+    p[0] = _mm256_add_ps(tmp10, tmp11);
+    p[4] = _mm256_sub_ps(tmp10, tmp11);
+
+    __m256 z1 = _mm256_mul_ps(_mm256_add_ps(tmp12, tmp13), c0_707);
+    p[2] = _mm256_add_ps(tmp13, z1);
+    p[6] = _mm256_sub_ps(tmp13, z1);
+
+    tmp10 = _mm256_add_ps(tmp4, tmp5);
+    tmp11 = _mm256_add_ps(tmp5, tmp6);
+    tmp12 = _mm256_add_ps(tmp6, tmp7);
+
+    __m256 z5 = _mm256_mul_ps(_mm256_sub_ps(tmp10, tmp12), c0_382);
+    __m256 z2 = _mm256_add_ps(_mm256_mul_ps(tmp10, c0_541), z5);
+    __m256 z4 = _mm256_add_ps(_mm256_mul_ps(tmp12, c1_306), z5);
+    __m256 z3 = _mm256_mul_ps(tmp11, c0_707);
+    __m256 z11 = _mm256_add_ps(tmp7, z3);
+    __m256 z13 = _mm256_sub_ps(tmp7, z3);
+
+    p[5] = _mm256_add_ps(z13, z2);
+    p[3] = _mm256_sub_ps(z13, z2);
+    p[1] = _mm256_add_ps(z11, z4);
+    p[7] = _mm256_sub_ps(z11, z4);
+}
+
+// 8x8 浮点矩阵转置
+TARGET_AVX2 static inline void Transpose8x8_AVX2(__m256* p)
+{
+    __m256 t0 = _mm256_unpacklo_ps(p[0], p[1]);
+    __m256 t1 = _mm256_unpackhi_ps(p[0], p[1]);
+    __m256 t2 = _mm256_unpacklo_ps(p[2], p[3]);
+    __m256 t3 = _mm256_unpackhi_ps(p[2], p[3]);
+    __m256 t4 = _mm256_unpacklo_ps(p[4], p[5]);
+    __m256 t5 = _mm256_unpackhi_ps(p[4], p[5]);
+    __m256 t6 = _mm256_unpacklo_ps(p[6], p[7]);
+    __m256 t7 = _mm256_unpackhi_ps(p[6], p[7]);
+
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, 0x44);
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, 0x44);
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, 0x44);
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, 0x44);
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+
+    p[0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+    p[1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+    p[2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+    p[3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+    p[4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+    p[5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+    p[6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+    p[7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+// 每行一个向量，垂直变换、转置、水平变换，输出的第 u 个向量即水平频率 u 的 8 个垂直频率
+TARGET_AVX2 static void ForwardDct_AVX2(const BYTE* const* ppRows, float offset, const float* pRecip, INT16* pCoef)
+{
+    const __m256 vOffset = _mm256_set1_ps(offset);
+    __m256 rows[8];
+
+    for (UINT32 y = 0; y < 8; y++)
+    {
+        __m256i pixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)ppRows[y]));
+        rows[y] = _mm256_sub_ps(_mm256_cvtepi32_ps(pixels), vOffset);
+    }
+
+    Fdct8_AVX2(rows);
+    Transpose8x8_AVX2(rows);
+    Fdct8_AVX2(rows);
+
+    const __m256i vMax = _mm256_set1_epi16(c_maxCoefficient);
+    const __m256i vMin = _mm256_set1_epi16(-c_maxCoefficient);
+
+    for (UINT32 u = 0; u < 8; u += 2)
+    {
+        __m256i q0 = _mm256_cvtps_epi32(_mm256_mul_ps(rows[u], _mm256_loadu_ps(pRecip + u * 8)));
+        __m256i q1 = _mm256_cvtps_epi32(_mm256_mul_ps(rows[u + 1], _mm256_loadu_ps(pRecip + u * 8 + 8)));
+
+        // packs 在每个 128 位通道内交错，重排 64 位块后恢复顺序
+        __m256i q = _mm256_permute4x64_epi64(_mm256_packs_epi32(q0, q1), 0xD8);
+        q = _mm256_min_epi16(_mm256_max_epi16(q, vMin), vMax);
+
+        _mm256_storeu_si256((__m256i*)(pCoef + u * 8), q);
+    }
+}
+
+#endif // PLATFORM_X86
+
+// 按 SIMD 级别选择 DCT 内核
+static PFN_FORWARD_DCT GetDctKernel(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return ForwardDct_AVX2; }
+    if (level >= CpuLevel_SSE2) { return ForwardDct_SSE2; }
+#else
+    (void)level;
+#endif
+    return ForwardDct_C;
+}
+
+// 0-2047 的二进制位数，即 JPEG 的幅值类别
+static const BYTE* GetBitLengths()
+{
+    static struct BitLengthTable
+    {
+        BYTE    length[2048];
+
+        BitLengthTable()
+        {
+            length[0] = 0;
+            for (UINT32 i = 1; i < 2048; i++)
+            {
+                length[i] = (BYTE)(length[i / 2] + 1);
+            }
+        }
+    } s_table;
+
+    return s_table.length;
+}
+
+// 按各码长的码字数生成 Huffman 码表（ITU-T T.81 附录 C）
+static void BuildHuffmanTable(const BYTE* pBits, const BYTE* pValues, JpegHuffmanTable* pTable)
+{
+    memset(pTable, 0, sizeof(*pTable));
+
+    UINT32 code = 0;
+    UINT32 k = 0;
+
+    for (UINT32 length = 1; length <= 16; length++)
+    {
+        for (UINT32 i = 0; i < pBits[length - 1]; i++)
+        {
+            BYTE symbol = pValues[k++];
+            pTable->code[symbol] = (WORD)code;
+            pTable->size[symbol] = (BYTE)length;
+            code++;
+        }
+        code <<= 1;
+    }
+}
+
+// BitWriter 结构体把熵编码的位流写入切片缓冲区，输出 0xFF 后补一个 0x00
+struct BitWriter
+{
+    UINT64  acc;        // 未输出的位（低 cBits 位有效）
+    UINT32  cBits;      // 未输出的位数
+    BYTE*   p;          // 输出位置
+
+    // 写入 size 位（不超过 32），积累到 32 位以上再输出整字节
+    void Put(UINT32 bits, UINT32 size)
+    {
+        acc = (acc << size) | bits;
+        cBits += size;
+        if (cBits >= 32)
+        {
+            Drain();
+        }
+    }
+
+    // 输出所有整字节
+    void Drain()
+    {
+        while (cBits >= 8)
+        {
+            cBits -= 8;
+            BYTE b = (BYTE)(acc >> cBits);
+            *p++ = b;
+            if (b == 0xFF)
+            {
+                *p++ = 0;
+            }
+        }
+    }
+
+    // 用 1 补齐到字节边界并输出
+    void Finish()
+    {
+        UINT32 cPad = (8 - (cBits & 7)) & 7;
+        acc = (acc << cPad) | ((1u << cPad) - 1);
+        cBits += cPad;
+        Drain();
+    }
+};
+
+// 熵编码一个块：DC 差值和按之字形顺序的 AC 游程
+static inline void EncodeBlock(BitWriter* pWriter, const INT16* pCoef, int* pPrediction,
+    const JpegHuffmanTable& dc, const JpegHuffmanTable& ac, const BYTE* pBitLengths)
+{
+    int diff = pCoef[0] - *pPrediction;
+    *pPrediction = pCoef[0];
+
+    UINT32 magnitude = (diff < 0) ? (UINT32)-diff : (UINT32)diff;
+    UINT32 cBits = pBitLengths[magnitude];
+    UINT32 bits = (UINT32)((diff < 0) ? diff - 1 : diff) & ((1u << cBits) - 1);
+
+    pWriter->Put(((UINT32)dc.code[cBits] << cBits) | bits, dc.size[cBits] + cBits);
+
+    UINT32 run = 0;
+
+    for (UINT32 k = 1; k < 64; k++)
+    {
+        int value = pCoef[c_scanOrder[k]];
+
+        if (value == 0)
+        {
+            run++;
+            continue;
+        }
+
+        while (run >= 16)
+        {
+            pWriter->Put(ac.code[0xF0], ac.size[0xF0]);
+            run -= 16;
+        }
+
+        magnitude = (value < 0) ? (UINT32)-value : (UINT32)value;
+        cBits = pBitLengths[magnitude];
+        bits = (UINT32)((value < 0) ? value - 1 : value) & ((1u << cBits) - 1);
+
+        UINT32 symbol = (run << 4) | cBits;
+        pWriter->Put(((UINT32)ac.code[symbol] << cBits) | bits, ac.size[symbol] + cBits);
+        run = 0;
+    }
+
+    if (run > 0)
+    {
+        pWriter->Put(ac.code[0x00], ac.size[0x00]);
+    }
+}
+
+// 取得从第 x 列开始的 8x8 块的行指针；超出右边缘的列用该行最后一个像素补齐，复制到 pEdge 中
+static inline void GetBlockRows(const BYTE* const* ppRows, UINT32 x, UINT32 width, BYTE* pEdge, const BYTE** ppBlock)
+{
+    if (x + 8 <= width)
+    {
+        for (UINT32 i = 0; i < 8; i++)
+        {
+            ppBlock[i] = ppRows[i] + x;
+        }
+        return;
+    }
+
+    UINT32 cValid = (x < width) ? width - x : 0;
+
+    for (UINT32 i = 0; i < 8; i++)
+    {
+        BYTE* pRow = pEdge + i * 8;
+
+        if (cValid > 0)
+        {
+            memcpy(pRow, ppRows[i] + x, cValid);
+        }
+        memset(pRow + cValid, ppRows[i][width - 1], 8 - cValid);
+        ppBlock[i] = pRow;
+    }
+}
+
+// 写入大端 16 位整数
+static void AppendWord(std::vector<BYTE>* pData, UINT32 value)
+{
+    pData->push_back((BYTE)(value >> 8));
+    pData->push_back((BYTE)value);
+}
+
+// 写入 DHT 中的一个表
+static void AppendHuffmanTable(std::vector<BYTE>* pData, BYTE tableClass, const BYTE* pBits, const BYTE* pValues)
+{
+    UINT32 cValues = 0;
+
+    pData->push_back(tableClass);
+    for (UINT32 i = 0; i < 16; i++)
+    {
+        pData->push_back(pBits[i]);
+        cValues += pBits[i];
+    }
+    pData->insert(pData->end(), pValues, pValues + cValues);
+}
+
+CJpegEncoder::CJpegEncoder() :
+    m_level(CpuLevel_Scalar),
+    m_pPool(nullptr),
+    m_mcuColumns(0),
+    m_mcuRows(0),
+    m_chromaPadded(0),
+    m_pScratch(nullptr),
+    m_cbMaxEncoded(0),
+    m_pSrc(nullptr)
+{
+    m_input = VideoFormat();
+    memset(m_recip, 0, sizeof(m_recip));
+    memset(m_huffman, 0, sizeof(m_huffman));
+}
+
+CJpegEncoder::~CJpegEncoder()
+{
+    Release();
+}
+
+// 释放缓冲区
+void CJpegEncoder::Release()
+{
+    if (m_pScratch)
+    {
+        AlignedFree(m_pScratch);
+        m_pScratch = nullptr;
+    }
+    m_slices.clear();
+    m_header.clear();
+    m_cbMaxEncoded = 0;
+}
+
+// 设置输入格式和参数，生成帧头并分配各切片的缓冲区
+HRESULT CJpegEncoder::Initialize(const VideoFormat& input, UINT32 quality, UINT32 cSliceRows, CpuLevel level, CTaskPool* pPool)
+{
+    if (!IsJpegInputSupported(input.subtype))
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+    if (input.width < 2 || input.height < 2 || (input.width & 1) || (input.height & 1) ||
+        input.width > 0xFFFF || input.height > 0xFFFF)
+    {
+        return E_INVALIDARG;
+    }
+    if (quality == 0 || quality > 100 || cSliceRows == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Release();
+
+    m_input = input;
+    m_level = (level > ::GetCpuLevel()) ? ::GetCpuLevel() : level;
+    m_pPool = pPool ? pPool : CTaskPool::GetDefault();
+    m_mcuColumns = (input.width + 15) / 16;
+    m_mcuRows = (input.height + 15) / 16;
+    m_chromaPadded = (input.subtype == FOURCC_NV12) ? m_mcuColumns * 8 : 0;
+
+    if (cSliceRows > m_mcuRows)
+    {
+        cSliceRows = m_mcuRows;
+    }
+
+    UINT32 cSlices = (m_mcuRows + cSliceRows - 1) / cSliceRows;
+    UINT32 restartInterval = (cSlices > 1) ? m_mcuColumns * cSliceRows : 0;
+
+    if (restartInterval > 0xFFFF)
+    {
+        return E_INVALIDARG;
+    }
+
+    BuildHeader(quality, restartInterval);
+
+    BuildHuffmanTable(c_dcLumaBits, c_dcLumaValues, &m_huffman[0]);
+    BuildHuffmanTable(c_acLumaBits, c_acLumaValues, &m_huffman[1]);
+    BuildHuffmanTable(c_dcChromaBits, c_dcChromaValues, &m_huffman[2]);
+    BuildHuffmanTable(c_acChromaBits, c_acChromaValues, &m_huffman[3]);
+
+    // 所有切片的输出和中间行放在一块内存中，各自按缓存行对齐，避免并行写入时伪共享
+    UINT32 cbChroma = (16 * m_chromaPadded + 63) & ~63u;
+    size_t cbTotal = 0;
+
+    m_slices.resize(cSlices);
+    for (UINT32 i = 0; i < cSlices; i++)
+    {
+        Slice& slice = m_slices[i];
+        UINT32 mcuRowEnd = (i + 1) * cSliceRows;
+
+        slice.mcuRowStart = i * cSliceRows;
+        slice.mcuRowEnd = (mcuRowEnd < m_mcuRows) ? mcuRowEnd : m_mcuRows;
+        slice.cbCapacity = (((slice.mcuRowEnd - slice.mcuRowStart) * m_mcuColumns * c_bytesPerMcu + c_maxMcuBytes) + 63) & ~63u;
+        slice.cbData = 0;
+        slice.hr = S_OK;
+        cbTotal += slice.cbCapacity + cbChroma;
+    }
+
+    m_pScratch = (BYTE*)AlignedAlloc(cbTotal, 64);
+    if (m_pScratch == nullptr)
+    {
+        m_slices.clear();
+        return E_OUTOFMEMORY;
+    }
+
+    BYTE* p = m_pScratch;
+    size_t cbEncoded = m_header.size() + 2;
+
+    for (UINT32 i = 0; i < cSlices; i++)
+    {
+        m_slices[i].pData = p;
+        m_slices[i].pChroma = (cbChroma > 0) ? p + m_slices[i].cbCapacity : nullptr;
+        p += m_slices[i].cbCapacity + cbChroma;
+        cbEncoded += m_slices[i].cbCapacity + 2;
+    }
+
+    m_cbMaxEncoded = (UINT32)cbEncoded;
+    return S_OK;
+}
+
+// 生成帧头：SOI、APP0 (JFIF)、DQT、SOF0、DHT、DRI（多于一个切片时）、SOS，同时计算量化倒数
+void CJpegEncoder::BuildHeader(UINT32 quality, UINT32 restartInterval)
+{
+    // 按 IJG 的方法缩放标准量化表，限制在 1-255 以符合基线
+    UINT32 scale = (quality < 50) ? 5000 / quality : 200 - quality * 2;
+    BYTE quant[2][64];
+
+    for (UINT32 i = 0; i < 64; i++)
+    {
+        UINT32 luma = (c_lumaQuant[i] * scale + 50) / 100;
+        UINT32 chroma = (c_chromaQuant[i] * scale + 50) / 100;
+
+        quant[0][i] = (BYTE)((luma < 1) ? 1 : (luma > 255) ? 255 : luma);
+        quant[1][i] = (BYTE)((chroma < 1) ? 1 : (chroma > 255) ? 255 : chroma);
+    }
+
+    // 量化倒数按 DCT 内核的输出顺序排列，含 AAN 的缩放和范围扩展的比例
+    for (UINT32 u = 0; u < 8; u++)
+    {
+        for (UINT32 v = 0; v < 8; v++)
+        {
+            double aan = c_aanScale[u] * c_aanScale[v] * 8.0;
+
+            m_recip[0][u * 8 + v] = (float)(c_lumaScale / (quant[0][v * 8 + u] * aan));
+            m_recip[1][u * 8 + v] = (float)(c_chromaScale / (quant[1][v * 8 + u] * aan));
+        }
+    }
+
+    std::vector<BYTE>& header = m_header;
+    header.clear();
+
+    // SOI
+    AppendWord(&header, 0xFFD8);
+
+    // APP0：JFIF 1.01，无单位，像素宽高比 1:1，无缩略图
+    static const BYTE jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    AppendWord(&header, 0xFFE0);
+    AppendWord(&header, 2 + sizeof(jfif));
+    header.insert(header.end(), jfif, jfif + sizeof(jfif));
+
+    // DQT：两个 8 位量化表，按之字形顺序
+    AppendWord(&header, 0xFFDB);
+    AppendWord(&header, 2 + 2 * 65);
+    for (UINT32 t = 0; t < 2; t++)
+    {
+        header.push_back((BYTE)t);
+        for (UINT32 k = 0; k < 64; k++)
+        {
+            header.push_back(quant[t][c_naturalOrder[k]]);
+        }
+    }
+
+    // SOF0：8 位精度，亮度 2x2 采样，两个色度 1x1 采样
+    AppendWord(&header, 0xFFC0);
+    AppendWord(&header, 8 + 3 * 3);
+    header.push_back(8);
+    AppendWord(&header, m_input.height);
+    AppendWord(&header, m_input.width);
+    header.push_back(3);
+    static const BYTE components[] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    header.insert(header.end(), components, components + sizeof(components));
+
+    // DHT：标准的亮度、色度 DC 和 AC 表
+    AppendWord(&header, 0xFFC4);
+    AppendWord(&header, 2 + 4 * 17 + 12 + 162 + 12 + 162);
+    AppendHuffmanTable(&header, 0x00, c_dcLumaBits, c_dcLumaValues);
+    AppendHuffmanTable(&header, 0x10, c_acLumaBits, c_acLumaValues);
+    AppendHuffmanTable(&header, 0x01, c_dcChromaBits, c_dcChromaValues);
+    AppendHuffmanTable(&header, 0x11, c_acChromaBits, c_acChromaValues);
+
+    // DRI：每个切片一个重启间隔
+    if (restartInterval > 0)
+    {
+        AppendWord(&header, 0xFFDD);
+        AppendWord(&header, 4);
+        AppendWord(&header, restartInterval);
+    }
+
+    // SOS：三个分量交织，完整频谱
+    AppendWord(&header, 0xFFDA);
+    AppendWord(&header, 6 + 2 * 3);
+    header.push_back(3);
+    static const BYTE scan[] = { 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    header.insert(header.end(), scan, scan + sizeof(scan));
+}
+
+// 编码一帧：各切片并行编码后，在切片之间插入 RSTn 拼接
+HRESULT CJpegEncoder::Encode(const BYTE* pSrc, BYTE* pDst, UINT32 cbDst, UINT32* pcbEncoded)
+{
+    if (pSrc == nullptr || pDst == nullptr || pcbEncoded == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pScratch == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pcbEncoded = 0;
+    m_pSrc = pSrc;
+
+    UINT32 cSlices = (UINT32)m_slices.size();
+
+    if (m_pPool && cSlices > 1)
+    {
+        m_pPool->ParallelFor(cSlices, EncodeSliceTask, this);
+    }
+    else
+    {
+        for (UINT32 i = 0; i < cSlices; i++)
+        {
+            m_slices[i].hr = EncodeSlice(&m_slices[i]);
+        }
+    }
+
+    m_pSrc = nullptr;
+
+    size_t cbTotal = m_header.size() + 2;
+    for (UINT32 i = 0; i < cSlices; i++)
+    {
+        if (FAILED(m_slices[i].hr))
+        {
+            return m_slices[i].hr;
+        }
+        cbTotal += m_slices[i].cbData + ((i > 0) ? 2 : 0);
+    }
+    if (cbTotal > cbDst)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    BYTE* p = pDst;
+    memcpy(p, m_header.data(), m_header.size());
+    p += m_header.size();
+
+    for (UINT32 i = 0; i < cSlices; i++)
+    {
+        if (i > 0)
+        {
+            *p++ = 0xFF;
+            *p++ = (BYTE)(0xD0 + ((i - 1) & 7));
+        }
+        memcpy(p, m_slices[i].pData, m_slices[i].cbData);
+        p += m_slices[i].cbData;
+    }
+
+    *p++ = 0xFF;
+    *p++ = 0xD9;
+
+    *pcbEncoded = (UINT32)(p - pDst);
+    return S_OK;
+}
+
+// 切片任务
+void CJpegEncoder::EncodeSliceTask(void* pContext, UINT32 index)
+{
+    CJpegEncoder* pThis = (CJpegEncoder*)pContext;
+    Slice* pSlice = &pThis->m_slices[index];
+
+    pSlice->hr = pThis->EncodeSlice(pSlice);
+}
+
+// 编码一个切片：逐 MCU 行取得 16 行亮度和 8 行 U、V（超出下边缘的行重复最后一行），
+// 每个 MCU 依次编码 4 个亮度块、1 个 U 块和 1 个 V 块；DC 预测在切片开始时清零
+HRESULT CJpegEncoder::EncodeSlice(Slice* pSlice)
+{
+    PFN_FORWARD_DCT pfnDct = GetDctKernel(m_level);
+    const BYTE* pBitLengths = GetBitLengths();
+    UINT32 width = m_input.width;
+    UINT32 height = m_input.height;
+    UINT32 chromaWidth = width / 2;
+    UINT32 chromaHeight = height / 2;
+    BOOL bNv12 = (m_input.subtype == FOURCC_NV12);
+    const BYTE* pLuma = m_pSrc;
+    const BYTE* pChroma = m_pSrc + width * height;
+
+    // NV12 的色度拆开后已按 MCU 补齐，不再需要处理右边缘
+    UINT32 chromaRowWidth = bNv12 ? m_chromaPadded : chromaWidth;
+
+    BitWriter writer = { 0, 0, pSlice->pData };
+    const BYTE* pLimit = pSlice->pData + pSlice->cbCapacity - c_maxMcuBytes;
+    int prediction[3] = { 0, 0, 0 };
+
+    alignas(32) INT16 coef[64];
+    BYTE edge[64];
+    const BYTE* lumaRows[16];
+    const BYTE* uRows[8];
+    const BYTE* vRows[8];
+    const BYTE* block[8];
+
+    for (UINT32 mcuRow = pSlice->mcuRowStart; mcuRow < pSlice->mcuRowEnd; mcuRow++)
+    {
+        for (UINT32 i = 0; i < 16; i++)
+        {
+            UINT32 y = mcuRow * 16 + i;
+            lumaRows[i] = pLuma + ((y < height) ? y : height - 1) * width;
+        }
+
+        for (UINT32 i = 0; i < 8; i++)
+        {
+            UINT32 y = mcuRow * 8 + i;
+            y = (y < chromaHeight) ? y : chromaHeight - 1;
+
+            if (bNv12)
+            {
+                BYTE* pU = pSlice->pChroma + i * m_chromaPadded;
+                BYTE* pV = pU + 8 * m_chromaPadded;
+
+                SplitChromaRow(pChroma + y * width, pU, pV, chromaWidth, m_level);
+                memset(pU + chromaWidth, pU[chromaWidth - 1], m_chromaPadded - chromaWidth);
+                memset(pV + chromaWidth, pV[chromaWidth - 1], m_chromaPadded - chromaWidth);
+                uRows[i] = pU;
+                vRows[i] = pV;
+            }
+            else
+            {
+                uRows[i] = pChroma + y * chromaWidth;
+                vRows[i] = pChroma + chromaWidth * chromaHeight + y * chromaWidth;
+            }
+        }
+
+        for (UINT32 mcuX = 0; mcuX < m_mcuColumns; mcuX++)
+        {
+            if (writer.p > pLimit)
+            {
+                return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+            }
+
+            UINT32 x = mcuX * 16;
+
+            for (UINT32 i = 0; i < 4; i++)
+            {
+                GetBlockRows(lumaRows + (i / 2) * 8, x + (i & 1) * 8, width, edge, block);
+                pfnDct(block, c_lumaOffset, m_recip[0], coef);
+                EncodeBlock(&writer, coef, &prediction[0], m_huffman[0], m_huffman[1], pBitLengths);
+            }
+
+            GetBlockRows(uRows, x / 2, chromaRowWidth, edge, block);
+            pfnDct(block, c_chromaOffset, m_recip[1], coef);
+            EncodeBlock(&writer, coef, &prediction[1], m_huffman[2], m_huffman[3], pBitLengths);
+
+            GetBlockRows(vRows, x / 2, chromaRowWidth, edge, block);
+            pfnDct(block, c_chromaOffset, m_recip[1], coef);
+            EncodeBlock(&writer, coef, &prediction[2], m_huffman[2], m_huffman[3], pBitLengths);
+        }
+    }
+
+    writer.Finish();
+    pSlice->cbData = (UINT32)(writer.p - pSlice->pData);
+    return S_OK;
+}
@@ -0,0 +1,104 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <vector>
+#include "frame.h"
+#include "taskpool.h"
+
+// 默认的 JPEG 质量（1-100，与 IJG 的 quality 相同）
+const UINT32 DEFAULT_JPEG_QUALITY = 85;
+
+// 每个切片（重启间隔）默认包含的 MCU 行数，一个 MCU 行为 16 行像素
+const UINT32 DEFAULT_JPEG_SLICE_ROWS = 4;
+
+// 判断 CJpegEncoder 是否支持该输入格式（4:2:0 的 NV12、I420/IYUV）
+BOOL    IsJpegInputSupported(UINT32 subtype);
+
+// JpegHuffmanTable 结构体是按符号查的 Huffman 码表
+struct JpegHuffmanTable
+{
+    WORD    code[256];      // 码字
+    BYTE    size[256];      // 码长，0 表示符号不在表中
+};
+
+// CJpegEncoder 类把一帧 4:2:0 图像编码成基线 JPEG（JFIF，4:2:0 采样，标准 Huffman 表），每帧独立，可以逐帧组成 MJPEG
+//
+// 帧按若干 MCU 行切成切片，每个切片是一个重启间隔（DRI/RSTn），DC 预测在切片之间互不依赖，
+// 各切片在 CTaskPool 上并行编码到各自的缓冲区，最后按顺序拼接；切片高度固定，输出与线程数无关
+//
+// 输入按 BT.601 有限范围处理，扩展到 JFIF 的全范围不单独做一遍，而是并入电平偏移和量化系数；
+// 浮点 AAN DCT 与量化有标量、SSE2、AVX2 三种实现，按 CPU 支持的最高级别选择，输出逐位一致
+// （要求编译器不把乘加合并成 FMA，MSVC 和 ISO 模式的 GCC 默认如此）；NV12 的交错色度按行用 SplitChromaRow 拆开
+//
+// 所有缓冲区在 Initialize 中一次性分配，Encode 不分配堆内存
+class CJpegEncoder
+{
+public:
+    CJpegEncoder();
+    ~CJpegEncoder();
+
+    // 设置输入格式和参数；cSliceRows 为每个切片的 MCU 行数，level 超过 CPU 支持的级别时自动降级，
+    // pPool 为空时使用默认线程池
+    HRESULT Initialize(const VideoFormat& input, UINT32 quality = DEFAULT_JPEG_QUALITY,
+        UINT32 cSliceRows = DEFAULT_JPEG_SLICE_ROWS, CpuLevel level = CpuLevel_AVX2, CTaskPool* pPool = nullptr);
+
+    // 编码一帧：输入按 frame.h 中的紧密布局排列，pDst 为 GetMaxEncodedSize 字节时总能容纳编码结果；
+    // 极端画面（例如高质量下的随机噪声）超出切片预留的空间，或者 pDst 太小时返回 HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER)
+    HRESULT Encode(const BYTE* pSrc, BYTE* pDst, UINT32 cbDst, UINT32* pcbEncoded);
+
+    // 一帧编码结果的最大长度
+    UINT32  GetMaxEncodedSize() const { return m_cbMaxEncoded; }
+
+    // 输入格式
+    const VideoFormat& GetInputFormat() const { return m_input; }
+
+    // 实际使用的 SIMD 级别
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+    // 每帧的切片数
+    UINT32  GetSliceCount() const { return (UINT32)m_slices.size(); }
+
+    // 线程池
+    CTaskPool* GetTaskPool() const { return m_pPool; }
+
+private:
+    CJpegEncoder(const CJpegEncoder&);
+    CJpegEncoder& operator=(const CJpegEncoder&);
+
+    // Slice 结构体保存一个切片的范围、输出和中间行
+    struct Slice
+    {
+        UINT32  mcuRowStart;    // 第一个 MCU 行
+        UINT32  mcuRowEnd;      // 最后一个 MCU 行之后
+        BYTE*   pData;          // 切片的熵编码数据
+        UINT32  cbCapacity;     // pData 的容量
+        UINT32  cbData;         // 本帧编码后的长度
+        BYTE*   pChroma;        // NV12 输入拆开的 8 行 U 和 8 行 V
+        HRESULT hr;             // 本帧的结果
+    };
+
+    // 切片任务
+    static void EncodeSliceTask(void* pContext, UINT32 index);
+
+    // 编码一个切片
+    HRESULT EncodeSlice(Slice* pSlice);
+
+    // 生成帧头（SOI 到 SOS），同时计算量化倒数
+    void    BuildHeader(UINT32 quality, UINT32 restartInterval);
+
+    // 释放缓冲区
+    void    Release();
+
+    VideoFormat         m_input;            // 输入格式
+    CpuLevel            m_level;            // SIMD 级别
+    CTaskPool*          m_pPool;            // 线程池
+    UINT32              m_mcuColumns;       // 每行的 MCU 数
+    UINT32              m_mcuRows;          // MCU 行数
+    UINT32              m_chromaPadded;     // 拆开的色度行按 MCU 补齐后的宽度
+    float               m_recip[2][64];     // 亮度、色度的量化倒数（自然顺序，含 AAN 缩放和范围扩展）
+    JpegHuffmanTable    m_huffman[4];       // 亮度 DC、亮度 AC、色度 DC、色度 AC
+    std::vector<BYTE>   m_header;           // 帧头
+    std::vector<Slice>  m_slices;           // 切片
+    BYTE*               m_pScratch;         // 所有切片的输出和中间行
+    UINT32              m_cbMaxEncoded;     // 一帧编码结果的最大长度
+    const BYTE*         m_pSrc;             // 本次编码的输入
+};
@@ -0,0 +1,109 @@
+#include "latency.h"
+
+// 阶段名称
+const char* GetLatencyStageName(LatencyStage stage)
+{
+    switch (stage)
+    {
+    case LatencyStage_Device:   return "device";
+    case LatencyStage_Enqueue:  return "enqueue";
+    case LatencyStage_Queue:    return "queue";
+    case LatencyStage_Convert:  return "convert";
+    case LatencyStage_Sink:     return "sink";
+    case LatencyStage_Rearm:    return "rearm";
+    case LatencyStage_Total:    return "total";
+    default:                    return "unknown";
+    }
+}
+
+// 桶的下界
+UINT64 CLatencyHistogram::BucketLow(UINT32 index)
+{
+    if (index < 2 * SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    UINT32 shift = index / SUB_BUCKETS - 1;
+    return (UINT64)(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+}
+
+// 桶的宽度
+UINT64 CLatencyHistogram::BucketWidth(UINT32 index)
+{
+    if (index < 2 * SUB_BUCKETS)
+    {
+        return 1;
+    }
+    return 1ull << (index / SUB_BUCKETS - 1);
+}
+
+void CLatencyHistogram::Reset()
+{
+    for (UINT32 i = 0; i < BUCKET_COUNT; i++)
+    {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+// 先读出所有桶再按累计计数找分位数；分位数取所在桶的中点，不超过记录到的最大值
+void CLatencyHistogram::GetSummary(LatencySummary* pSummary) const
+{
+    static const double percentiles[] = { 0.5, 0.99, 0.999 };
+    double values[ARRAYSIZE(percentiles)] = { 0 };
+    UINT64 counts[BUCKET_COUNT];
+    UINT64 cSamples = 0;
+
+    for (UINT32 i = 0; i < BUCKET_COUNT; i++)
+    {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        cSamples += counts[i];
+    }
+
+    UINT64 nsMax = m_max.load(std::memory_order_relaxed);
+    UINT64 cSeen = 0;
+    UINT32 iPercentile = 0;
+
+    for (UINT32 i = 0; i < BUCKET_COUNT && iPercentile < ARRAYSIZE(percentiles) && cSamples > 0; i++)
+    {
+        cSeen += counts[i];
+
+        while (iPercentile < ARRAYSIZE(percentiles) && cSeen >= (UINT64)(percentiles[iPercentile] * cSamples + 0.5) &&
+            cSeen > 0)
+        {
+            double fValue = BucketLow(i) + (BucketWidth(i) - 1) / 2.0;
+            values[iPercentile++] = fValue < (double)nsMax ? fValue : (double)nsMax;
+        }
+    }
+
+    pSummary->cSamples = cSamples;
+    pSummary->fMeanUs = cSamples ? m_sum.load(std::memory_order_relaxed) / 1e3 / cSamples : 0;
+    pSummary->fP50Us = values[0] / 1e3;
+    pSummary->fP99Us = values[1] / 1e3;
+    pSummary->fP999Us = values[2] / 1e3;
+    pSummary->fMaxUs = nsMax / 1e3;
+}
+
+void CLatencyRecorder::Reset()
+{
+#if ENABLE_LATENCY_STATS
+    for (UINT32 i = 0; i < LatencyStage_Count; i++)
+    {
+        m_histograms[i].Reset();
+    }
+#endif
+}
+
+void CLatencyRecorder::GetSnapshot(LatencySnapshot* pSnapshot) const
+{
+    *pSnapshot = LatencySnapshot();
+
+#if ENABLE_LATENCY_STATS
+    for (UINT32 i = 0; i < LatencyStage_Count; i++)
+    {
+        m_histograms[i].GetSummary(&pSnapshot->stages[i]);
+    }
+#endif
+}
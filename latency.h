@@ -0,0 +1,161 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <chrono>
+#include "frame.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 编译开关：定义为 0 时去掉所有延迟埋点，GetLatencyClock 返回 0、Record 为空操作，流水线中不保留直方图
+#ifndef ENABLE_LATENCY_STATS
+#define ENABLE_LATENCY_STATS 1
+#endif
+
+// 一帧经过的各个阶段
+enum LatencyStage
+{
+    LatencyStage_Device = 0,    // 设备时间戳到采集侧拿到样本
+    LatencyStage_Enqueue,       // 拿到样本到拷贝进缓冲池并入队
+    LatencyStage_Queue,         // 入队到写入线程取出
+    LatencyStage_Convert,       // 像素格式转换
+    LatencyStage_Sink,          // IFrameSink::WriteFrame（例如 IMFSinkWriter::WriteSample）
+    LatencyStage_Rearm,         // 重新发起 ReadSample
+    LatencyStage_Total,         // 入队到写完
+    LatencyStage_Count
+};
+
+// 阶段名称，用于报告输出
+const char* GetLatencyStageName(LatencyStage stage);
+
+// LatencySummary 结构体保存一个阶段的延迟分布（微秒）
+struct LatencySummary
+{
+    UINT64  cSamples;   // 样本数
+    double  fMeanUs;    // 均值
+    double  fP50Us;     // 中位数
+    double  fP99Us;     // 99 分位
+    double  fP999Us;    // 99.9 分位
+    double  fMaxUs;     // 最大值
+};
+
+// LatencySnapshot 结构体保存所有阶段的延迟分布
+struct LatencySnapshot
+{
+    LatencySummary stages[LatencyStage_Count];
+};
+
+// 读取埋点用的单调时钟，单位纳秒；与 GetClockTime 同一时钟源（Windows 上为 QPC）
+inline LONGLONG GetLatencyClock()
+{
+#if ENABLE_LATENCY_STATS
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+#else
+    return 0;
+#endif
+}
+
+// CLatencyHistogram 类是 HDR 风格的对数-线性直方图：每个 2 的幂区间再等分成 32 个子桶，
+// 相对误差不超过 1/32，覆盖 1 纳秒到约 2200 秒，内存固定，不需要预先知道取值范围
+// 只允许一个线程调用 Record（计数用 relaxed 的读取加写回，既不加锁也不需要原子 RMW 指令），
+// 其他线程可随时调用 GetSummary，读到的是近似一致的快照
+class CLatencyHistogram
+{
+public:
+    static const UINT32 SUB_BUCKET_BITS = 5;
+    static const UINT32 SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static const UINT32 MAX_MSB = 40;
+    static const UINT32 BUCKET_COUNT = (MAX_MSB - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    CLatencyHistogram() { Reset(); }
+
+    // 记录一个值（纳秒），超出范围的值计入最后一个桶
+    void    Record(UINT64 ns)
+    {
+        const UINT64 nsLimit = (2ull << MAX_MSB) - 1;
+        UINT32 index = BucketIndex(ns < nsLimit ? ns : nsLimit);
+
+        m_counts[index].store(m_counts[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+
+        if (ns > m_max.load(std::memory_order_relaxed))
+        {
+            m_max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    // 清空，不能与 Record 并发调用
+    void    Reset();
+
+    // 计算样本数、均值和分位数
+    void    GetSummary(LatencySummary* pSummary) const;
+
+    // 值所在的桶：小于 2*SUB_BUCKETS 的值每个值一个桶；更大的值按最高位分组，每组保留最高的 SUB_BUCKET_BITS+1 位
+    static UINT32 BucketIndex(UINT64 ns)
+    {
+        if (ns < SUB_BUCKETS)
+        {
+            return (UINT32)ns;
+        }
+
+        UINT32 shift = HighestBit(ns) - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + (UINT32)(ns >> shift) - SUB_BUCKETS;
+    }
+
+    // 桶的下界和宽度
+    static UINT64 BucketLow(UINT32 index);
+    static UINT64 BucketWidth(UINT32 index);
+
+private:
+    // 最高有效位的位置，ns 不为 0
+    static UINT32 HighestBit(UINT64 ns)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, ns);
+        return (UINT32)index;
+#else
+        return 63 - (UINT32)__builtin_clzll(ns);
+#endif
+    }
+
+    CLatencyHistogram(const CLatencyHistogram&);
+    CLatencyHistogram& operator=(const CLatencyHistogram&);
+
+    std::atomic<UINT64> m_counts[BUCKET_COUNT];    // 每个桶的计数
+    std::atomic<UINT64> m_sum;                      // 总和（纳秒）
+    std::atomic<UINT64> m_max;                      // 最大值（纳秒）
+};
+
+// CLatencyRecorder 类为每个阶段保存一个直方图；每个阶段只能由一个线程记录
+// （采集侧阶段由采集线程或回调记录，其余阶段由写入线程记录），所以整个记录过程无锁
+class CLatencyRecorder
+{
+public:
+    // 记录一个阶段的耗时（纳秒），负值（时钟不一致或未启用时）忽略
+    void    Record(LatencyStage stage, LONGLONG ns)
+    {
+#if ENABLE_LATENCY_STATS
+        if (ns >= 0)
+        {
+            m_histograms[stage].Record((UINT64)ns);
+        }
+#else
+        (void)stage;
+        (void)ns;
+#endif
+    }
+
+    // 清空所有阶段，不能与 Record 并发调用
+    void    Reset();
+
+    // 获取所有阶段的延迟分布，未启用时全部为 0
+    void    GetSnapshot(LatencySnapshot* pSnapshot) const;
+
+private:
+#if ENABLE_LATENCY_STATS
+    CLatencyHistogram   m_histograms[LatencyStage_Count];   // 各阶段的直方图
+#endif
+};
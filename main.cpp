@@ -6,6 +6,8 @@
 #include <mfidl.h>
 #include <mfreadwrite.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <strsafe.h>
 #include <shlwapi.h>
 #include <Dbt.h>
@@ -28,16 +30,59 @@ template <class T> void SafeRelease(T** ppT)
 
 const UINT32 TARGET_BIT_RATE = 1920 * 1080 * 3;// 定义目标比特率，用于视频编码
 DeviceList  g_devices;// DeviceList可能是一个用于存储设备列表的类
-CCapture* g_pCapture = nullptr;// CCapture可能是一个用于视频捕获的类
-HDEVNOTIFY  g_hdevnotify = nullptr;// HDEVNOTIFY用于注册设备通知
+CCaptureManager g_captures;// 每个摄像头一路 CCapture
+CCapabilityCache g_cache;// 设备列表和各设备能力表的磁盘缓存，重新启动时不必再枚举和探测
+
+// 输出命令行用法；不带参数时每路只录制全分辨率的 capture_0.mp4、capture_1.mp4 ...
+static void PrintUsage()
+{
+    std::cerr << "usage: capture [--preview HEIGHT] [--shm NAME] [--stream PORT]" << std::endl;
+    std::cerr << "  --preview HEIGHT   also write a HEIGHT-line preview per camera (capture_0_<HEIGHT>p.mp4 ...)" << std::endl;
+    std::cerr << "  --shm NAME         publish frames to shared-memory rings NAME_0, NAME_1 ..." << std::endl;
+    std::cerr << "  --stream PORT      serve a 480p live view per camera on 127.0.0.1:PORT, PORT+1 ..." << std::endl;
+}
 
 // 应用程序的入口点
-int main()
+int main(int argc, char* argv[])
 {
     // 启用堆损坏时的终止，这是一个安全特性，用于检测堆损坏
     (void)HeapSetInformation(nullptr, HeapEnableTerminationOnCorruption, nullptr, 0);
 
     HRESULT hr = S_OK; // HRESULT用于表示函数调用的成功或失败
+    UINT32 previewHeight = 0; // 预览文件的行数，0 表示不写预览
+    const char* pszShmName = nullptr; // 共享内存帧环的名称前缀，为空时不发布
+    BOOL bStream = FALSE; // 是否提供实时画面
+    WORD streamPort = 0; // 第一路监听的端口
+
+    // 解析命令行，每个选项都带一个值
+    for (int i = 1; i < argc; i += 2)
+    {
+        const char* pszValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (pszValue != nullptr && strcmp(argv[i], "--preview") == 0)
+        {
+            previewHeight = (UINT32)atoi(pszValue);
+            if (previewHeight == 0)
+            {
+                PrintUsage();
+                return -1;
+            }
+        }
+        else if (pszValue != nullptr && strcmp(argv[i], "--shm") == 0)
+        {
+            pszShmName = pszValue;
+        }
+        else if (pszValue != nullptr && strcmp(argv[i], "--stream") == 0 && atoi(pszValue) > 0 && atoi(pszValue) <= 0xFFFF)
+        {
+            bStream = TRUE;
+            streamPort = (WORD)atoi(pszValue);
+        }
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
 
     // 初始化COM库，COINIT_APARTMENTTHREADED表示线程单元模型，COINIT_DISABLE_OLE1DDE禁用OLE1 DDE
     hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED | COINIT_DISABLE_OLE1DDE);
@@ -60,32 +105,17 @@ int main()
         }
     }
 
-    // 注册设备通知，用于捕获设备连接或断开事件
-    DEV_BROADCAST_DEVICEINTERFACE di = { 0 }; // 初始化设备广播结构
-    di.dbcc_size = sizeof(di); // 设置结构大小
-    di.dbcc_devicetype = DBT_DEVTYP_DEVICEINTERFACE; // 设备接口类型
-    di.dbcc_classguid = KSCATEGORY_CAPTURE; // 使用的设备类别GUID
-
-    g_hdevnotify = RegisterDeviceNotification(nullptr, &di, DEVICE_NOTIFY_WINDOW_HANDLE); // 注册设备通知
+    // 读取缓存，文件不存在或已损坏时按未命中处理
+    g_cache.Load(L"capture_devices.cache");
+    LONGLONG llEnumerate = GetClockTime();
 
-    if (g_hdevnotify == nullptr) // 如果注册失败
+    // 枚举视频捕获设备，缓存的设备列表有效时直接使用
+    if (SUCCEEDED(hr)) // 如果Media Foundation初始化成功
     {
-        hr = HRESULT_FROM_WIN32(GetLastError()); // 获取错误代码
-        std::cerr << "Failed to register device notification." << std::endl; // 输出错误信息
-        MFShutdown(); // 关闭Media Foundation
-        CoUninitialize(); // 反初始化COM库
-        return -1; // 返回错误代码
-    }
-
-
-    // 枚举视频捕获设备
-    if (SUCCEEDED(hr)) // 如果设备通知注册成功
-    {
-        hr = g_devices.EnumerateDevices(); // 枚举设备
+        hr = g_devices.EnumerateDevices(&g_cache); // 枚举设备
         if (FAILED(hr)) // 如果枚举失败
         {
             std::cerr << "Failed to enumerate devices." << std::endl; // 输出错误信息
-            UnregisterDeviceNotification(g_hdevnotify); // 注销设备通知
             MFShutdown(); // 关闭Media Foundation
             CoUninitialize(); // 反初始化COM库
             return -1; // 返回错误代码
@@ -93,64 +123,163 @@ int main()
     }
     
     // 没有枚举到设备 直接返回错误码
-    if (FAILED(hr) && g_devices.Count() < 1) {
+    if (g_devices.Count() < 1) {
         std::cerr << "No capture devices found." << std::endl; // 输出没有找到捕获设备信息
+        MFShutdown(); // 关闭Media Foundation
+        CoUninitialize(); // 反初始化COM库
         return -1;// 返回错误代码
     }
-    // 选择第一个设备并开始捕获
-    IMFActivate* pActivate = nullptr; // 定义一个激活对象指针
-    hr = g_devices.GetDevice(0, &pActivate); // 获取第一个设备
-    if (FAILED(hr)) {
-        std::cerr << "Failed to get device." << std::endl; // 输出获取设备失败信息
-        pActivate = nullptr
-        return -1;
-    }
-
-    hr = CCapture::CreateInstance(nullptr, &g_pCapture); // 创建捕获实例
-    if (FAILED(hr)) {
-        std::cerr << "Failed to create capture instance." << std::endl; // 输出创建捕获实例失败信息
-        SafeRelease(&pActivate); // 释放激活对象
-        return -1;
-    }
 
     // ------------------------------------------------------------------------------------//
-    WCHAR pszFile[MAX_PATH] = L"capture.mp4"; // 定义输出文件路径
     EncodingParameters params; // 定义编码参数
     params.subtype = MFVideoFormat_H264; // 视频编码格式
     params.bitrate = TARGET_BIT_RATE; // 目标比特率
+    params.quality = 0; // JPEG 质量，0 为默认值；没有硬件 H.264 编码器时可把 subtype 改为 MFVideoFormat_MJPG，用内置的软件编码器写入 .mkv
+
+    std::cout << "Enumerated " << g_devices.Count() << " devices in " << (GetClockTime() - llEnumerate) / 1e4
+        << " ms" << (g_devices.IsFromCache() ? " (cached)" : "") << std::endl;
+
+    // 每个摄像头一路流水线，输出文件为 capture_0.mp4、capture_1.mp4 ...，各路并行启动
+    g_captures.SetCapabilityCache(&g_cache);
+
+    // 指定 --preview 时每路同时写一个预览文件，例如 capture_0_480p.mp4 ...，宽度按采集的宽高比推算，与存档共用一次格式转换；
+    // 用双线性，采集分辨率低于预览时也能工作（区域平均只能缩小）
+    if (previewHeight != 0)
+    {
+        ScaleParams preview = ScaleParams();
+        WCHAR wszSuffix[16];
+
+        preview.height = previewHeight;
+        swprintf_s(wszSuffix, ARRAYSIZE(wszSuffix), L"%up", previewHeight);
+        g_captures.AddSimulcastOutput(preview, wszSuffix);
+    }
+
+    // 指定 --shm 时每路同时把帧发布到共享内存帧环 <NAME>_0、<NAME>_1 ...，分析进程（例如 shmreader <NAME>_0）直接读取，不必读回 MP4
+    if (pszShmName != nullptr)
+    {
+        g_captures.SetSharedMemoryRing(pszShmName);
+    }
 
-    hr = g_pCapture->StartCapture(pActivate, pszFile, params); // 开始捕获
-    if (FAILED(hr)) // 如果开始捕获失败
+    // 指定 --stream 时每路同时在本机的 PORT、PORT+1 ... 端口提供 480p 的实时画面，浏览器打开 http://127.0.0.1:PORT/ 即可观看；
+    // 只监听回环地址，需要在局域网内观看时设置 bListenAll
+    if (bStream)
+    {
+        StreamParams stream = StreamParams();
+        stream.port = streamPort;
+        stream.scale.height = 480;
+        g_captures.SetNetworkStream(&stream);
+    }
+
+    hr = g_captures.StartAll(&g_devices, L"capture", params); // 开始捕获
+    if (FAILED(hr)) // 如果所有设备都启动失败
     {
         std::cerr << "Failed to start capture." << std::endl; // 输出错误信息
-        SafeRelease(&pActivate); // 释放激活对象
-        SafeRelease(&g_pCapture); // 释放捕获实例
-        UnregisterDeviceNotification(g_hdevnotify); // 注销设备通知
+        g_devices.Clear(); // 清除设备列表
         MFShutdown(); // 关闭Media Foundation
         CoUninitialize(); // 反初始化COM库
         return -1; // 返回错误代码
     }
+
+    // 摄像头被拔下时保持输出文件打开，重新插上（或插上其他同格式的摄像头）后接着录制；设备通知由后台线程的消息窗口接收
+    hr = g_captures.StartRecovery(&g_devices);
+    if (FAILED(hr))
+    {
+        std::cerr << "Failed to start device recovery." << std::endl; // 不影响录制，只是设备丢失后无法恢复
+    }
+
+    // 设备列表来自缓存时，录制开始后再完整枚举一次，使之后接入的设备在下次启动时出现
+    if (g_devices.IsFromCache())
+    {
+        DeviceList devices;
+
+        if (SUCCEEDED(devices.EnumerateDevices()))
+        {
+            devices.UpdateCache(&g_cache);
+        }
+    }
+
+    if (FAILED(g_cache.Save()))
+    {
+        std::cerr << "Failed to save the device cache." << std::endl; // 只影响下次启动的速度
+    }
+
+    // 每秒把各路的帧率、丢帧数和各阶段延迟分位数写入 capture_stats.json
+    hr = g_captures.StartStatsReport(L"capture_stats.json", StatsFormat_Json, 1000);
+    if (FAILED(hr))
+    {
+        std::cerr << "Failed to start the stats report." << std::endl; // 统计失败不影响录制
+    }
+
     // 等待10秒
     Sleep(10000);
+
+    // 输出每路和汇总的吞吐
+    for (UINT32 i = 0; i < g_captures.Count(); i++)
+    {
+        CCapture* pCapture = g_captures.GetCapture(i);
+        PipelineStats stats;
+
+        if (pCapture == nullptr)
+        {
+            std::cerr << "Device " << i << " failed to start." << std::endl;
+            continue;
+        }
+
+        StartupTimes startup;
+
+        pCapture->GetPipelineStats(&stats);
+        pCapture->GetStartupTimes(&startup);
+        std::cout << "Device " << i << ": " << stats.cFrames << " frames, " << stats.fFps << " fps, "
+            << stats.cOverflows << " overflows" << std::endl;
+        std::cout << "    startup: activate " << startup.fActivateMs << " ms, configure " << startup.fConfigureMs
+            << " ms, first frame " << startup.fFirstFrameMs << " ms" << (startup.bCacheHit ? " (cached)" : "")
+            << std::endl;
+
+        RecoveryStatus recovery;
+
+        if (stats.cDeviceLosses != 0 && g_captures.GetRecoveryStatus(i, &recovery) == S_OK)
+        {
+            std::cout << "    device lost " << stats.cDeviceLosses << " times, recovered " << stats.cRecoveries
+                << " times (" << recovery.cFallbacks << " on another device), last " << stats.fLastRecoveryMs
+                << " ms, max " << stats.fMaxRecoveryMs << " ms" << (recovery.bLost ? ", still lost" : "") << std::endl;
+        }
+
+        MotionGateStats motion;
+
+        if (pCapture->GetMotionStats(&motion) == S_OK)
+        {
+            std::cout << "    motion: " << motion.cForwarded << " frames written, " << motion.cSkipped
+                << " skipped, " << motion.cMotionEvents << " events, " << motion.fAvgMeasureUs << " us per frame"
+                << std::endl;
+        }
+
+        for (UINT32 j = 0; j < pCapture->GetSimulcastCount(); j++)
+        {
+            SimulcastOutputStats output;
+
+            if (pCapture->GetSimulcastStats(j, &output) == S_OK)
+            {
+                std::cout << "    output " << output.width << "x" << output.height << ": " << output.cFrames
+                    << " frames, " << output.fAvgScaleUs << " us per frame" << std::endl;
+            }
+        }
+    }
+
+    PipelineStats total;
+    g_captures.GetAggregateStats(&total);
+    std::cout << "Total: " << total.cFrames << " frames, " << total.fFps << " fps" << std::endl;
+
     // 停止捕获
-    hr = g_pCapture->EndCaptureSession(); // 结束捕获会话
+    hr = g_captures.StopAll(); // 结束所有捕获会话
     if (FAILED(hr)) // 如果停止捕获失败
     {
         std::cerr << "Failed to stop capture." << std::endl; // 输出错误信息
     }
-    SafeRelease(&pActivate); // 释放激活对象
-    SafeRelease(&g_pCapture); // 释放捕获实例
     // ------------------------------------------------------------------------------------//
 
     // 清除设备列表
     g_devices.Clear(); // 清除设备列表
 
-    // 注销设备通知
-    if (g_hdevnotify) // 如果有注册设备通知
-    {
-        UnregisterDeviceNotification(g_hdevnotify); // 注销设备通知
-    }
-
     // 关闭Media Foundation
     MFShutdown(); // 关闭Media Foundation
     CoUninitialize(); // 反初始化COM库
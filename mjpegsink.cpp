@@ -0,0 +1,279 @@
+#include <string.h>
+#include <vector>
+#include "mjpegsink.h"
+
+// Matroska (EBML) 元素 ID
+static const UINT32 c_idEbml            = 0x1A45DFA3;
+static const UINT32 c_idEbmlVersion     = 0x4286;
+static const UINT32 c_idEbmlReadVersion = 0x42F7;
+static const UINT32 c_idEbmlMaxIdLength = 0x42F2;
+static const UINT32 c_idEbmlMaxSizeLength = 0x42F3;
+static const UINT32 c_idDocType         = 0x4282;
+static const UINT32 c_idDocTypeVersion  = 0x4287;
+static const UINT32 c_idDocTypeReadVersion = 0x4285;
+static const UINT32 c_idSegment         = 0x18538067;
+static const UINT32 c_idInfo            = 0x1549A966;
+static const UINT32 c_idTimecodeScale   = 0x2AD7B1;
+static const UINT32 c_idMuxingApp       = 0x4D80;
+static const UINT32 c_idWritingApp      = 0x5741;
+static const UINT32 c_idTracks          = 0x1654AE6B;
+static const UINT32 c_idTrackEntry      = 0xAE;
+static const UINT32 c_idTrackNumber     = 0xD7;
+static const UINT32 c_idTrackUid        = 0x73C5;
+static const UINT32 c_idTrackType       = 0x83;
+static const UINT32 c_idFlagLacing      = 0x9C;
+static const UINT32 c_idCodecId         = 0x86;
+static const UINT32 c_idDefaultDuration = 0x23E383;
+static const UINT32 c_idVideo           = 0xE0;
+static const UINT32 c_idPixelWidth      = 0xB0;
+static const UINT32 c_idPixelHeight     = 0xBA;
+static const UINT32 c_idCluster         = 0x1F43B675;
+static const UINT32 c_idTimecode        = 0xE7;
+static const UINT32 c_idSimpleBlock     = 0xA3;
+
+// 写入文件的应用名称
+static const char c_szMuxingApp[] = "usb-capture";
+
+// 时间码单位：1 毫秒（纳秒数）
+static const UINT32 c_timecodeScale = 1000000;
+
+// 写入元素 ID（ID 本身已含长度标记）
+static void AppendId(std::vector<BYTE>* pData, UINT32 id)
+{
+    UINT32 cb = (id > 0xFFFFFF) ? 4 : (id > 0xFFFF) ? 3 : (id > 0xFF) ? 2 : 1;
+
+    for (UINT32 i = cb; i > 0; i--)
+    {
+        pData->push_back((BYTE)(id >> ((i - 1) * 8)));
+    }
+}
+
+// 写入元素大小（变长整数，取最短的编码）
+static void AppendSize(std::vector<BYTE>* pData, UINT64 cbSize)
+{
+    UINT32 cb = 1;
+
+    while (cb < 8 && cbSize >= ((UINT64)1 << (7 * cb)) - 1)
+    {
+        cb++;
+    }
+
+    UINT64 value = cbSize | ((UINT64)1 << (7 * cb));
+    for (UINT32 i = cb; i > 0; i--)
+    {
+        pData->push_back((BYTE)(value >> ((i - 1) * 8)));
+    }
+}
+
+// 写入无符号整数元素
+static void AppendUInt(std::vector<BYTE>* pData, UINT32 id, UINT64 value)
+{
+    UINT32 cb = 1;
+
+    while (cb < 8 && (value >> (cb * 8)) != 0)
+    {
+        cb++;
+    }
+
+    AppendId(pData, id);
+    AppendSize(pData, cb);
+    for (UINT32 i = cb; i > 0; i--)
+    {
+        pData->push_back((BYTE)(value >> ((i - 1) * 8)));
+    }
+}
+
+// 写入字符串元素
+static void AppendString(std::vector<BYTE>* pData, UINT32 id, const char* psz)
+{
+    size_t cch = strlen(psz);
+
+    AppendId(pData, id);
+    AppendSize(pData, cch);
+    pData->insert(pData->end(), psz, psz + cch);
+}
+
+// 写入主元素：ID、大小和已经编码好的子元素
+static void AppendMaster(std::vector<BYTE>* pData, UINT32 id, const std::vector<BYTE>& children)
+{
+    AppendId(pData, id);
+    AppendSize(pData, children.size());
+    pData->insert(pData->end(), children.begin(), children.end());
+}
+
+CMjpegFileSink::CMjpegFileSink(const WCHAR* pwszFileName, UINT32 quality) :
+    m_fileName(pwszFileName ? pwszFileName : L""),
+    m_quality(quality ? quality : DEFAULT_JPEG_QUALITY),
+    m_pBuffer(nullptr),
+    m_cbBuffer(0),
+    m_llFirst(0),
+    m_cFrames(0),
+    m_cbWritten(0)
+{
+}
+
+CMjpegFileSink::~CMjpegFileSink()
+{
+    Finalize();
+    delete[] m_pBuffer;
+}
+
+// 初始化编码器、创建文件并写入文件头
+HRESULT CMjpegFileSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_file.IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+
+    HRESULT hr = m_encoder.Initialize(format, m_quality);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    UINT32 cbBuffer = MJPEG_CLUSTER_HEADER_RESERVE + m_encoder.GetMaxEncodedSize();
+    if (m_cbBuffer < cbBuffer)
+    {
+        delete[] m_pBuffer;
+        m_pBuffer = new (std::nothrow) BYTE[cbBuffer];
+        m_cbBuffer = m_pBuffer ? cbBuffer : 0;
+
+        if (m_pBuffer == nullptr)
+        {
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    // EBML 头
+    std::vector<BYTE> header;
+    std::vector<BYTE> children;
+
+    AppendUInt(&children, c_idEbmlVersion, 1);
+    AppendUInt(&children, c_idEbmlReadVersion, 1);
+    AppendUInt(&children, c_idEbmlMaxIdLength, 4);
+    AppendUInt(&children, c_idEbmlMaxSizeLength, 8);
+    AppendString(&children, c_idDocType, "matroska");
+    AppendUInt(&children, c_idDocTypeVersion, 2);
+    AppendUInt(&children, c_idDocTypeReadVersion, 2);
+    AppendMaster(&header, c_idEbml, children);
+
+    // Segment：大小未知（全 1），之后的 Cluster 直接追加
+    AppendId(&header, c_idSegment);
+    static const BYTE unknownSize[] = { 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    header.insert(header.end(), unknownSize, unknownSize + sizeof(unknownSize));
+
+    // Info：时间码单位为毫秒
+    children.clear();
+    AppendUInt(&children, c_idTimecodeScale, c_timecodeScale);
+    AppendString(&children, c_idMuxingApp, c_szMuxingApp);
+    AppendString(&children, c_idWritingApp, c_szMuxingApp);
+    AppendMaster(&header, c_idInfo, children);
+
+    // Tracks：一路 MJPEG 视频，帧率已知时写入每帧的时长
+    std::vector<BYTE> video;
+    AppendUInt(&video, c_idPixelWidth, format.width);
+    AppendUInt(&video, c_idPixelHeight, format.height);
+
+    std::vector<BYTE> track;
+    AppendUInt(&track, c_idTrackNumber, 1);
+    AppendUInt(&track, c_idTrackUid, 1);
+    AppendUInt(&track, c_idTrackType, 1);
+    AppendUInt(&track, c_idFlagLacing, 0);
+    AppendString(&track, c_idCodecId, "V_MJPEG");
+    if (format.fpsNumerator > 0 && format.fpsDenominator > 0)
+    {
+        AppendUInt(&track, c_idDefaultDuration, (UINT64)1000000000 * format.fpsDenominator / format.fpsNumerator);
+    }
+    AppendMaster(&track, c_idVideo, video);
+
+    children.clear();
+    AppendMaster(&children, c_idTrackEntry, track);
+    AppendMaster(&header, c_idTracks, children);
+
+    hr = m_file.Create(m_fileName.c_str(), FALSE);
+    if (SUCCEEDED(hr))
+    {
+        hr = m_file.Write(header.data(), header.size());
+    }
+
+    if (FAILED(hr))
+    {
+        m_file.Close();
+        return hr;
+    }
+
+    m_cFrames = 0;
+    m_cbWritten = header.size();
+    return S_OK;
+}
+
+// 编码一帧，在编码结果前补上 Cluster 头，一次写入
+HRESULT CMjpegFileSink::WriteFrame(const CaptureFrame& frame)
+{
+    if (!m_file.IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+    if (frame.cbData < GetFrameSize(m_encoder.GetInputFormat()))
+    {
+        return E_INVALIDARG;
+    }
+
+    UINT32 cbJpeg = 0;
+    HRESULT hr = m_encoder.Encode(frame.pData, m_pBuffer + MJPEG_CLUSTER_HEADER_RESERVE,
+        m_cbBuffer - MJPEG_CLUSTER_HEADER_RESERVE, &cbJpeg);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (m_cFrames == 0)
+    {
+        m_llFirst = frame.llTimestamp;
+    }
+
+    LONGLONG llTime = frame.llTimestamp - m_llFirst;
+    UINT64 timecode = (llTime > 0) ? (UINT64)llTime / (c_timecodeScale / 100) : 0;
+
+    // SimpleBlock 的内容：轨道号 1、相对时间码 0、关键帧标志，之后是 JPEG 数据
+    static const BYTE block[] = { 0x81, 0x00, 0x00, 0x80 };
+
+    m_block.clear();
+    AppendUInt(&m_block, c_idTimecode, timecode);
+    AppendId(&m_block, c_idSimpleBlock);
+    AppendSize(&m_block, sizeof(block) + (UINT64)cbJpeg);
+    m_block.insert(m_block.end(), block, block + sizeof(block));
+
+    m_cluster.clear();
+    AppendId(&m_cluster, c_idCluster);
+    AppendSize(&m_cluster, m_block.size() + cbJpeg);
+    m_cluster.insert(m_cluster.end(), m_block.begin(), m_block.end());
+
+    BYTE* pStart = m_pBuffer + MJPEG_CLUSTER_HEADER_RESERVE - m_cluster.size();
+    memcpy(pStart, m_cluster.data(), m_cluster.size());
+
+    size_t cbWrite = m_cluster.size() + cbJpeg;
+    hr = m_file.Write(pStart, cbWrite);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_cFrames++;
+    m_cbWritten += cbWrite;
+    return S_OK;
+}
+
+// 关闭文件；Segment 和 Cluster 的大小都已写好，不需要回写
+HRESULT CMjpegFileSink::Finalize()
+{
+    m_file.Close();
+    return S_OK;
+}
+
+HRESULT CMjpegFileSink::GetBytesWritten(UINT64* pcbWritten)
+{
+    *pcbWritten = m_cbWritten;
+    return S_OK;
+}
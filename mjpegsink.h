@@ -0,0 +1,81 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <new>
+#include <string>
+#include <vector>
+#include "sink.h"
+#include "directfile.h"
+#include "jpegenc.h"
+
+// 每帧 Cluster 头预留的字节数，编码结果写在它之后，Cluster 头补在前面，一帧一次写入
+const UINT32 MJPEG_CLUSTER_HEADER_RESERVE = 64;
+
+// CMjpegFileSink 类用 CJpegEncoder 把每帧编码成 JPEG，写入 Matroska 文件（V_MJPEG，.mkv），
+// 不依赖硬件编码器或 Media Foundation 的编码器
+//
+// 每帧是一个已知大小的 Cluster（Timecode + 一个关键帧 SimpleBlock），Segment 的大小记为未知，
+// 文件只顺序追加、不回写：异常中断时已写完的帧仍然可以播放；时间码以文件中第一帧为 0，单位毫秒
+//
+// 编码在 WriteFrame 中进行，各切片在线程池上并行，输入应为 NV12 或 I420（流水线输出设为 NV12）；稳态下不分配堆内存
+class CMjpegFileSink : public IFrameSink
+{
+public:
+    // quality 为 JPEG 质量（1-100），0 表示 DEFAULT_JPEG_QUALITY
+    CMjpegFileSink(const WCHAR* pwszFileName, UINT32 quality = DEFAULT_JPEG_QUALITY);
+    virtual ~CMjpegFileSink();
+
+    // 初始化编码器、创建文件并写入 EBML 头、Segment、Info 和 Tracks
+    HRESULT BeginWriting(const VideoFormat& format);
+
+    // 编码一帧并写入一个 Cluster
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 关闭文件
+    HRESULT Finalize();
+
+    // 已写入文件的字节数
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+    // 已写入的帧数
+    UINT64  FramesWritten() const { return m_cFrames; }
+
+private:
+    CMjpegFileSink(const CMjpegFileSink&);
+    CMjpegFileSink& operator=(const CMjpegFileSink&);
+
+    std::wstring    m_fileName;     // 输出文件路径
+    UINT32          m_quality;      // JPEG 质量
+    CJpegEncoder    m_encoder;      // 编码器
+    CDirectFile     m_file;         // 输出文件（缓冲写入）
+    BYTE*           m_pBuffer;      // Cluster 头预留区 + 编码结果
+    UINT32          m_cbBuffer;     // m_pBuffer 的大小
+    std::vector<BYTE> m_cluster;    // 组装 Cluster 头的缓冲区，重复使用
+    std::vector<BYTE> m_block;      // 组装 Cluster 内容（Timecode 和 SimpleBlock 头）的缓冲区，重复使用
+    LONGLONG        m_llFirst;      // 文件中第一帧的时间戳
+    UINT64          m_cFrames;      // 已写入的帧数
+    UINT64          m_cbWritten;    // 已写入的字节数
+};
+
+// CMjpegFileSinkFactory 类为分段写入的每一段创建 CMjpegFileSink
+class CMjpegFileSinkFactory : public IFrameSinkFactory
+{
+public:
+    CMjpegFileSinkFactory() : m_quality(DEFAULT_JPEG_QUALITY) {}
+
+    // 设置 JPEG 质量，0 表示 DEFAULT_JPEG_QUALITY，在创建接收器之前调用
+    void    SetQuality(UINT32 quality) { m_quality = quality; }
+
+    HRESULT CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink)
+    {
+        *ppSink = new (std::nothrow) CMjpegFileSink(pwszPath, m_quality);
+        return *ppSink ? S_OK : E_OUTOFMEMORY;
+    }
+
+    HRESULT RemoveFile(const WCHAR* pwszPath)
+    {
+        return CDirectFile::Remove(pwszPath);
+    }
+
+private:
+    UINT32  m_quality;      // JPEG 质量
+};
@@ -0,0 +1,316 @@
+#include "motiongate.h"
+#include "framestats.h"
+
+#ifdef PLATFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// 把一行亮度缩小成网格的一行：每 MOTION_CELL_WIDTH 个像素取平均（四舍五入），不足一格的余数忽略
+typedef void (*PFN_DOWNSAMPLE_ROW)(const BYTE* pRow, UINT32 cCells, BYTE* pCells);
+
+// 两块网格的绝对差之和
+typedef UINT64 (*PFN_SUM_ABS_DIFF)(const BYTE* pA, const BYTE* pB, UINT32 count);
+
+static void DownsampleRow_C(const BYTE* pRow, UINT32 cCells, BYTE* pCells)
+{
+    for (UINT32 i = 0; i < cCells; i++)
+    {
+        const BYTE* p = pRow + i * MOTION_CELL_WIDTH;
+        UINT32 sum = p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7];
+
+        pCells[i] = (BYTE)((sum + MOTION_CELL_WIDTH / 2) / MOTION_CELL_WIDTH);
+    }
+}
+
+static UINT64 SumAbsDiff_C(const BYTE* pA, const BYTE* pB, UINT32 count)
+{
+    UINT64 sad = 0;
+
+    for (UINT32 i = 0; i < count; i++)
+    {
+        sad += pA[i] > pB[i] ? pA[i] - pB[i] : pB[i] - pA[i];
+    }
+
+    return sad;
+}
+
+#ifdef PLATFORM_X86
+
+// 每次 16 字节：sad 对零求和得到两格的 8 像素之和，分别位于两个 64 位通道的低 16 位
+static void DownsampleRow_SSE2(const BYTE* pRow, UINT32 cCells, BYTE* pCells)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi64x(MOTION_CELL_WIDTH / 2);
+    UINT32 i = 0;
+
+    for (; i + 2 <= cCells; i += 2)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(pRow + i * MOTION_CELL_WIDTH));
+        __m128i sums = _mm_srli_epi64(_mm_add_epi64(_mm_sad_epu8(v, zero), round), 3);
+
+        pCells[i] = (BYTE)_mm_cvtsi128_si32(sums);
+        pCells[i + 1] = (BYTE)_mm_extract_epi16(sums, 4);
+    }
+
+    DownsampleRow_C(pRow + i * MOTION_CELL_WIDTH, cCells - i, pCells + i);
+}
+
+static inline UINT64 HorizontalSum64(__m128i v)
+{
+    UINT64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, v);
+    return lanes[0] + lanes[1];
+}
+
+static UINT64 SumAbsDiff_SSE2(const BYTE* pA, const BYTE* pB, UINT32 count)
+{
+    __m128i vSad = _mm_setzero_si128();
+    UINT32 i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pA + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pB + i));
+
+        vSad = _mm_add_epi64(vSad, _mm_sad_epu8(a, b));
+    }
+
+    return HorizontalSum64(vSad) + SumAbsDiff_C(pA + i, pB + i, count - i);
+}
+
+TARGET_AVX2 static UINT64 SumAbsDiff_AVX2(const BYTE* pA, const BYTE* pB, UINT32 count)
+{
+    __m256i vSad = _mm256_setzero_si256();
+    UINT32 i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(pA + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(pB + i));
+
+        vSad = _mm256_add_epi64(vSad, _mm256_sad_epu8(a, b));
+    }
+
+    __m128i vSad128 = _mm_add_epi64(_mm256_castsi256_si128(vSad), _mm256_extracti128_si256(vSad, 1));
+
+    return HorizontalSum64(vSad128) + SumAbsDiff_SSE2(pA + i, pB + i, count - i);
+}
+
+#endif // PLATFORM_X86
+
+// 按 SIMD 级别选择缩小函数
+static PFN_DOWNSAMPLE_ROW GetDownsampleRow(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_SSE2) { return DownsampleRow_SSE2; }
+#else
+    (void)level;
+#endif
+    return DownsampleRow_C;
+}
+
+// 按 SIMD 级别选择求和函数
+static PFN_SUM_ABS_DIFF GetSumAbsDiff(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return SumAbsDiff_AVX2; }
+    if (level >= CpuLevel_SSE2) { return SumAbsDiff_SSE2; }
+#else
+    (void)level;
+#endif
+    return SumAbsDiff_C;
+}
+
+CMotionDetector::CMotionDetector() :
+    m_level(CpuLevel_Scalar),
+    m_gridStep(DEFAULT_MOTION_GRID_STEP),
+    m_gridWidth(0),
+    m_gridHeight(0),
+    m_bHasReference(FALSE),
+    m_lastSad(0)
+{
+    m_format = VideoFormat();
+}
+
+// 设置输入格式并分配网格
+HRESULT CMotionDetector::Initialize(const VideoFormat& format, UINT32 gridStep, CpuLevel level)
+{
+    if (!IsSupportedSubtype(format.subtype) || format.width < MOTION_CELL_WIDTH || format.height == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    gridStep = gridStep ? gridStep : DEFAULT_MOTION_GRID_STEP;
+    gridStep = gridStep < format.height ? gridStep : format.height;
+
+    UINT32 gridWidth = format.width / MOTION_CELL_WIDTH;
+    UINT32 gridHeight = format.height / gridStep;
+
+    try
+    {
+        m_grid.resize((size_t)gridWidth * gridHeight);
+        m_reference.resize(m_grid.size());
+        m_lumaRow.resize(format.width);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    m_format = format;
+    m_level = (level > ::GetCpuLevel()) ? ::GetCpuLevel() : level;
+    m_gridStep = gridStep;
+    m_gridWidth = gridWidth;
+    m_gridHeight = gridHeight;
+    m_bHasReference = FALSE;
+    m_lastSad = 0;
+    return S_OK;
+}
+
+// 缩小当前帧并与参考帧比较，取每格中间的一行，避免总是落在隔行的同一场上
+HRESULT CMotionDetector::Measure(const CaptureFrame& frame, double* pfChange)
+{
+    if (pfChange == nullptr || frame.pData == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_grid.empty())
+    {
+        return E_UNEXPECTED;
+    }
+    if (frame.cbData < GetFrameSize(m_format))
+    {
+        return E_INVALIDARG;
+    }
+
+    PFN_DOWNSAMPLE_ROW pfnDownsample = GetDownsampleRow(m_level);
+
+    for (UINT32 gy = 0; gy < m_gridHeight; gy++)
+    {
+        const BYTE* pRow = GetLumaRow(m_format, frame.pData, gy * m_gridStep + m_gridStep / 2, m_lumaRow.data(), m_level);
+
+        pfnDownsample(pRow, m_gridWidth, m_grid.data() + (size_t)gy * m_gridWidth);
+    }
+
+    HRESULT hr = S_FALSE;
+
+    m_lastSad = 0;
+    *pfChange = 0;
+
+    if (m_bHasReference)
+    {
+        m_lastSad = GetSumAbsDiff(m_level)(m_grid.data(), m_reference.data(), (UINT32)m_grid.size());
+        *pfChange = (double)m_lastSad / m_grid.size();
+        hr = S_OK;
+    }
+
+    m_grid.swap(m_reference);
+    m_bHasReference = TRUE;
+    return hr;
+}
+
+CMotionGateSink::CMotionGateSink(IFrameSink* pSink, double fThreshold, UINT32 holdMs, UINT32 gridStep) :
+    m_pSink(pSink),
+    m_fThreshold(fThreshold),
+    m_llHold((LONGLONG)holdMs * (HNS_PER_SECOND / 1000)),
+    m_gridStep(gridStep),
+    m_llLastMotion(0),
+    m_cForwarded(0),
+    m_cSkipped(0),
+    m_cMotionEvents(0),
+    m_bActive(false),
+    m_fLastChange(0),
+    m_llMeasureTime(0)
+{
+}
+
+// 初始化运动检测并打开下游接收器
+HRESULT CMotionGateSink::BeginWriting(const VideoFormat& format)
+{
+    HRESULT hr = m_detector.Initialize(format, m_gridStep);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_llLastMotion = 0;
+    m_cForwarded = 0;
+    m_cSkipped = 0;
+    m_cMotionEvents = 0;
+    m_bActive = false;
+    m_fLastChange = 0;
+    m_llMeasureTime = 0;
+
+    return m_pSink->BeginWriting(format);
+}
+
+// 检测变化，有变化或仍在保持时长内时交给下游接收器
+HRESULT CMotionGateSink::WriteFrame(const CaptureFrame& frame)
+{
+    LONGLONG llStart = GetClockTime();
+    double fChange = 0;
+    HRESULT hr = m_detector.Measure(frame, &fChange);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    BOOL bForward = FALSE;
+
+    if (hr == S_FALSE)
+    {
+        bForward = TRUE; // 第一帧
+    }
+    else if (fChange >= m_fThreshold)
+    {
+        if (!m_bActive.load(std::memory_order_relaxed))
+        {
+            m_cMotionEvents++;
+        }
+        m_bActive = true;
+        m_llLastMotion = frame.llTimestamp;
+        bForward = TRUE;
+    }
+    else if (m_bActive.load(std::memory_order_relaxed) && frame.llTimestamp - m_llLastMotion <= m_llHold)
+    {
+        bForward = TRUE;
+    }
+    else
+    {
+        m_bActive = false;
+    }
+
+    m_fLastChange.store(fChange, std::memory_order_relaxed);
+    m_llMeasureTime.fetch_add(GetClockTime() - llStart, std::memory_order_relaxed);
+
+    if (!bForward)
+    {
+        m_cSkipped++;
+        return S_OK;
+    }
+
+    m_cForwarded++;
+    return m_pSink->WriteFrame(frame);
+}
+
+// 结束下游接收器
+HRESULT CMotionGateSink::Finalize()
+{
+    return m_pSink->Finalize();
+}
+
+// 获取统计
+void CMotionGateSink::GetStats(MotionGateStats* pStats) const
+{
+    pStats->cForwarded = m_cForwarded.load();
+    pStats->cSkipped = m_cSkipped.load();
+    pStats->cMotionEvents = m_cMotionEvents.load();
+    pStats->bActive = m_bActive.load() ? TRUE : FALSE;
+    pStats->fLastChange = m_fLastChange.load();
+
+    UINT64 cFrames = pStats->cForwarded + pStats->cSkipped;
+    pStats->fAvgMeasureUs = cFrames ? m_llMeasureTime.load() / 10.0 / cFrames : 0;
+}
@@ -0,0 +1,109 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <vector>
+#include "sink.h"
+
+// 运动检测网格每格的宽度（像素），与 SAD 指令一次求和的 8 字节对应
+const UINT32 MOTION_CELL_WIDTH = 8;
+
+// 默认的网格行间隔（像素）：每隔 8 行取一行亮度
+const UINT32 DEFAULT_MOTION_GRID_STEP = 8;
+
+// 默认的变化阈值：网格上与上一帧的平均绝对差（亮度级），摄像头的噪声一般在 1 到 2 之间
+const double DEFAULT_MOTION_THRESHOLD = 4.0;
+
+// 默认的保持时长（毫秒）：最后一次检测到变化之后继续写出的时长
+const UINT32 DEFAULT_MOTION_HOLD_MS = 2000;
+
+// CMotionDetector 类在缩小的亮度网格上比较当前帧与上一帧：每隔 gridStep 行取一行亮度，
+// 每 MOTION_CELL_WIDTH 个像素求平均得到一格，再对两帧的网格求绝对差之和（SAD）
+// 缩小和求和都有 SSE2 实现，求和另有 AVX2 实现，结果与标量实现一致；网格在 Initialize 中一次性分配
+class CMotionDetector
+{
+public:
+    CMotionDetector();
+
+    // 设置输入格式和网格行间隔（0 取默认值），level 超过 CPU 支持的级别时自动降级
+    HRESULT Initialize(const VideoFormat& format, UINT32 gridStep = DEFAULT_MOTION_GRID_STEP,
+        CpuLevel level = CpuLevel_AVX2);
+
+    // 计算当前帧与上一帧在网格上的平均绝对差，之后当前帧成为下一次比较的参考；
+    // 第一帧没有参考，返回 S_FALSE 且 *pfChange 为 0
+    HRESULT Measure(const CaptureFrame& frame, double* pfChange);
+
+    // 上一次 Measure 的绝对差之和
+    UINT64  GetLastSad() const { return m_lastSad; }
+
+    // 网格的格数
+    UINT32  GetCellCount() const { return (UINT32)m_grid.size(); }
+
+    // 实际使用的 SIMD 级别
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+    // 丢弃参考帧，下一帧按第一帧处理
+    void    Reset() { m_bHasReference = FALSE; }
+
+private:
+    VideoFormat         m_format;           // 输入格式
+    CpuLevel            m_level;            // SIMD 级别
+    UINT32              m_gridStep;         // 网格行间隔
+    UINT32              m_gridWidth;        // 每行的格数
+    UINT32              m_gridHeight;       // 网格行数
+    BOOL                m_bHasReference;    // 是否已有参考帧
+    UINT64              m_lastSad;          // 上一次的绝对差之和
+    std::vector<BYTE>   m_grid;             // 当前帧的网格
+    std::vector<BYTE>   m_reference;        // 参考帧（上一帧）的网格
+    std::vector<BYTE>   m_lumaRow;          // 打包格式与 RGB 的亮度行
+};
+
+// MotionGateStats 结构体保存运动门控的统计
+struct MotionGateStats
+{
+    UINT64  cForwarded;     // 交给下游接收器的帧数
+    UINT64  cSkipped;       // 画面没有变化而跳过的帧数
+    UINT32  cMotionEvents;  // 从静止转为有变化的次数
+    BOOL    bActive;        // 当前是否在写出（有变化或仍在保持时长内）
+    double  fLastChange;    // 最近一帧的平均绝对差
+    double  fAvgMeasureUs;  // 每帧检测的平均耗时（微秒）
+};
+
+// CMotionGateSink 类是接收器前的门控：画面变化超过阈值时，以及最后一次变化之后的保持时长内，
+// 把帧交给下游接收器，其余的帧直接丢弃，省掉这些帧的编码和磁盘写入
+//
+// 写出的帧保留原来的时间戳，跳过的时段在文件中表现为时间轴上的空档，回放时画面停在最后一帧，
+// 之后的帧仍在真实的时刻出现（Y4M 没有时间戳，跳过的时段会被压缩掉）；第一帧总是写出，
+// 使文件至少有一帧画面，下游接收器在没有帧时 Finalize 会失败
+//
+// 保持时长按帧的时间戳计算，与写入线程的处理速度无关；下游接收器由调用方持有，必须在 Finalize 之后才能释放
+class CMotionGateSink : public IFrameSink
+{
+public:
+    // fThreshold 为变化阈值，holdMs 为保持时长，gridStep 为网格行间隔
+    CMotionGateSink(IFrameSink* pSink, double fThreshold = DEFAULT_MOTION_THRESHOLD,
+        UINT32 holdMs = DEFAULT_MOTION_HOLD_MS, UINT32 gridStep = DEFAULT_MOTION_GRID_STEP);
+    virtual ~CMotionGateSink() {}
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+    HRESULT Finalize();
+    HRESULT GetBytesWritten(UINT64* pcbWritten) { return m_pSink->GetBytesWritten(pcbWritten); }
+
+    // 获取统计，可以在任意线程调用
+    void    GetStats(MotionGateStats* pStats) const;
+
+private:
+    IFrameSink*             m_pSink;            // 下游接收器
+    double                  m_fThreshold;       // 变化阈值
+    LONGLONG                m_llHold;           // 保持时长（100 纳秒）
+    UINT32                  m_gridStep;         // 网格行间隔
+    CMotionDetector         m_detector;         // 运动检测
+    LONGLONG                m_llLastMotion;     // 最后一次检测到变化的帧的时间戳
+
+    std::atomic<UINT64>     m_cForwarded;       // 写出的帧数
+    std::atomic<UINT64>     m_cSkipped;         // 跳过的帧数
+    std::atomic<UINT32>     m_cMotionEvents;    // 从静止转为有变化的次数
+    std::atomic<bool>       m_bActive;          // 是否在写出
+    std::atomic<double>     m_fLastChange;      // 最近一帧的平均绝对差
+    std::atomic<LONGLONG>   m_llMeasureTime;    // 检测的累计耗时（100 纳秒）
+};
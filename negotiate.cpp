@@ -0,0 +1,232 @@
+#include "negotiate.h"
+#include "convert.h"
+
+// 代价模型中各步骤每像素的相对代价；拷贝和写出按实际字节数计，以下为额外的计算量，按经验取值
+static const double c_decodeCostPerPixel = 8.0;    // 源读取器解码压缩格式
+static const double c_convertCostPerPixel = 2.0;   // 流水线转换像素格式（在读写的字节数之外）
+static const double c_encodeCostPerPixel = 12.0;   // 编码器
+
+// 源读取器解码压缩格式时能直接输出的格式
+static BOOL IsDecoderOutput(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_YUY2 || subtype == FOURCC_I420 || subtype == FOURCC_IYUV;
+}
+
+// 每像素的字节数
+static double GetBytesPerPixel(UINT32 subtype)
+{
+    VideoFormat format = { subtype, 2, 2, 0, 0 };
+    return GetFrameSize(format) / 4.0;
+}
+
+// 帧率转换为浮点数，分母为 0 时返回 0
+static double GetFps(UINT32 numerator, UINT32 denominator)
+{
+    return denominator ? (double)numerator / denominator : 0;
+}
+
+// 实际值低于下限或高于上限的相对偏离，满足时为 0
+static double GetShortfall(double fValue, double fMin, double fMax)
+{
+    if (fMin > 0 && fValue < fMin)
+    {
+        return (fMin - fValue) / fMin;
+    }
+    if (fMax > 0 && fValue > fMax)
+    {
+        return (fValue - fMax) / fMax;
+    }
+    return 0;
+}
+
+// 添加一种原生媒体类型
+HRESULT CFormatNegotiator::AddCapability(const MediaCapability& capability)
+{
+    if (capability.format.width == 0 || capability.format.height == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    Entry entry = { capability, FALSE };
+    m_entries.push_back(entry);
+    return S_OK;
+}
+
+// 按设备默认类型补上为 0 的下限
+void CFormatNegotiator::ApplyDeviceDefaults(FormatConstraints* pConstraints) const
+{
+    if (m_entries.empty())
+    {
+        return;
+    }
+
+    const VideoFormat& format = m_entries[0].capability.format;
+
+    if (pConstraints->minWidth == 0 && pConstraints->minHeight == 0 &&
+        (pConstraints->maxWidth == 0 || format.width <= pConstraints->maxWidth) &&
+        (pConstraints->maxHeight == 0 || format.height <= pConstraints->maxHeight))
+    {
+        pConstraints->minWidth = format.width;
+        pConstraints->minHeight = format.height;
+    }
+
+    if (pConstraints->fMinFps <= 0)
+    {
+        double fFps = GetFps(format.fpsNumerator, format.fpsDenominator);
+
+        if (fFps < DEFAULT_MIN_FPS)
+        {
+            fFps = DEFAULT_MIN_FPS;
+        }
+        if (pConstraints->fMaxFps <= 0 || fFps <= pConstraints->fMaxFps)
+        {
+            pConstraints->fMinFps = fFps;
+        }
+    }
+}
+
+// 帧率依次尝试标称值、范围上限和范围下限，取第一个满足要求的，都不满足时取标称值；
+// 代价为每秒像素数乘以每像素的解码、拷贝进缓冲池、转换和编码（或写出）的代价之和
+BOOL CFormatNegotiator::Evaluate(const MediaCapability& capability, const FormatConstraints& constraints,
+    NegotiatedFormat* pResult, double* pfViolation)
+{
+    const VideoFormat& native = capability.format;
+    const UINT32 rates[3][2] =
+    {
+        { native.fpsNumerator, native.fpsDenominator },
+        { capability.fpsMaxNumerator, capability.fpsMaxDenominator },
+        { capability.fpsMinNumerator, capability.fpsMinDenominator },
+    };
+
+    NegotiatedFormat result = NegotiatedFormat();
+    result.nTypeIndex = capability.nTypeIndex;
+    result.format = native;
+
+    for (UINT32 i = 0; i < ARRAYSIZE(rates); i++)
+    {
+        if (GetShortfall(GetFps(rates[i][0], rates[i][1]), constraints.fMinFps, constraints.fMaxFps) == 0 &&
+            rates[i][1] != 0)
+        {
+            result.format.fpsNumerator = rates[i][0];
+            result.format.fpsDenominator = rates[i][1];
+            break;
+        }
+    }
+
+    // 压缩格式由源读取器解码，优先直接解码成接收器要的格式
+    double fCostPerPixel = 0;
+
+    if (!IsSupportedSubtype(native.subtype))
+    {
+        result.bDecode = TRUE;
+        result.format.subtype = IsDecoderOutput(constraints.outputSubtype) ? constraints.outputSubtype : FOURCC_NV12;
+        fCostPerPixel += c_decodeCostPerPixel;
+    }
+
+    UINT32 captured = result.format.subtype;
+    UINT32 output = constraints.outputSubtype ? constraints.outputSubtype : captured;
+
+    fCostPerPixel += GetBytesPerPixel(captured);
+
+    if (output != captured)
+    {
+        if (!IsConversionSupported(captured, output) || (native.width & 1) || (native.height & 1))
+        {
+            return FALSE;
+        }
+
+        result.bConvert = TRUE;
+        fCostPerPixel += GetBytesPerPixel(captured) + GetBytesPerPixel(output) + c_convertCostPerPixel;
+    }
+
+    fCostPerPixel += constraints.bEncode ? c_encodeCostPerPixel : GetBytesPerPixel(output);
+
+    double fFps = GetFps(result.format.fpsNumerator, result.format.fpsDenominator);
+
+    // 帧率未知时按下限（没有下限时按 1 帧/秒）计算，使它不会因此显得更便宜
+    if (fFps <= 0)
+    {
+        fFps = constraints.fMinFps > 0 ? constraints.fMinFps : 1;
+    }
+
+    result.fCost = (double)native.width * native.height * fFps * fCostPerPixel;
+
+    *pfViolation =
+        GetShortfall(native.width, constraints.minWidth, constraints.maxWidth) +
+        GetShortfall(native.height, constraints.minHeight, constraints.maxHeight) +
+        GetShortfall(GetFps(result.format.fpsNumerator, result.format.fpsDenominator),
+            constraints.fMinFps, constraints.fMaxFps);
+    *pResult = result;
+    return TRUE;
+}
+
+// 依次比较偏离程度、是否为优先格式、代价和原生类型的索引
+HRESULT CFormatNegotiator::Negotiate(const FormatConstraints& constraints, NegotiatedFormat* pResult) const
+{
+    if (pResult == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    BOOL bFound = FALSE;
+    BOOL bBestPreferred = FALSE;
+    double fBestViolation = 0;
+    NegotiatedFormat best = NegotiatedFormat();
+
+    for (UINT32 i = 0; i < m_entries.size(); i++)
+    {
+        if (m_entries[i].bExcluded)
+        {
+            continue;
+        }
+
+        const MediaCapability& capability = m_entries[i].capability;
+        NegotiatedFormat candidate;
+        double fViolation = 0;
+
+        if (!Evaluate(capability, constraints, &candidate, &fViolation))
+        {
+            continue;
+        }
+
+        candidate.iCapability = i;
+
+        BOOL bPreferred = constraints.preferredSubtype != 0 &&
+            capability.format.subtype == constraints.preferredSubtype;
+        BOOL bBetter = !bFound;
+
+        if (!bBetter && fViolation != fBestViolation)
+        {
+            bBetter = fViolation < fBestViolation;
+        }
+        else if (!bBetter && bPreferred != bBestPreferred)
+        {
+            bBetter = bPreferred;
+        }
+        else if (!bBetter && candidate.fCost != best.fCost)
+        {
+            bBetter = candidate.fCost < best.fCost;
+        }
+        else if (!bBetter)
+        {
+            bBetter = candidate.nTypeIndex < best.nTypeIndex;
+        }
+
+        if (bBetter)
+        {
+            best = candidate;
+            bBestPreferred = bPreferred;
+            fBestViolation = fViolation;
+            bFound = TRUE;
+        }
+    }
+
+    if (!bFound)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    best.bRelaxed = (fBestViolation > 0);
+    *pResult = best;
+    return best.bRelaxed ? S_FALSE : S_OK;
+}
@@ -0,0 +1,91 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <vector>
+#include "frame.h"
+
+// 未设置帧率下限时，采集帧率至少为设备默认类型的帧率和这个值中较大的一个
+const double DEFAULT_MIN_FPS = 30.0;
+
+// MediaCapability 结构体描述设备的一种原生媒体类型
+struct MediaCapability
+{
+    DWORD       nTypeIndex;         // GetNativeMediaType 的索引
+    VideoFormat format;             // 原生格式，帧率为 MF_MT_FRAME_RATE
+    UINT32      fpsMinNumerator;    // 帧率范围下限（MF_MT_FRAME_RATE_RANGE_MIN），没有范围时与 format 相同
+    UINT32      fpsMinDenominator;
+    UINT32      fpsMaxNumerator;    // 帧率范围上限（MF_MT_FRAME_RATE_RANGE_MAX），没有范围时与 format 相同
+    UINT32      fpsMaxDenominator;
+};
+
+// FormatConstraints 结构体描述对采集格式的要求
+// 分辨率和帧率的下限为 0 时由 ApplyDeviceDefaults 按设备默认类型补上，上限为 0 表示不限制
+struct FormatConstraints
+{
+    UINT32      minWidth;           // 最小宽度
+    UINT32      minHeight;          // 最小高度
+    UINT32      maxWidth;           // 最大宽度
+    UINT32      maxHeight;          // 最大高度
+    double      fMinFps;            // 最低帧率
+    double      fMaxFps;            // 最高帧率
+    UINT32      preferredSubtype;   // 优先的采集格式（例如 FOURCC_NV12），满足要求的候选中先于代价比较，0 表示不指定
+    UINT32      outputSubtype;      // 流水线交给接收器的格式，0 表示保持采集格式
+    BOOL        bEncode;            // 接收器是否编码
+};
+
+// NegotiatedFormat 结构体保存协商结果
+struct NegotiatedFormat
+{
+    UINT32      iCapability;        // 选中的能力在表中的位置
+    DWORD       nTypeIndex;         // 对应的原生媒体类型索引
+    VideoFormat format;             // 设置给源读取器的格式：帧率为选定的帧率，原生格式是压缩格式时子类型为解码后的格式
+    BOOL        bDecode;            // 源读取器需要解码原生的压缩格式
+    BOOL        bConvert;           // 流水线需要转换到 outputSubtype
+    BOOL        bRelaxed;           // 没有候选满足全部要求，选了最接近的一个
+    double      fCost;              // 估计的代价，约为每秒经手的字节数（编码按每像素固定的代价折算）
+};
+
+// CFormatNegotiator 类按设备的能力表选择采集格式
+// 候选先按是否满足 FormatConstraints 排序（都不满足时按偏离程度），再按是否为优先的格式，
+// 然后按解码、拷贝、转换和编码的估计代价从低到高，最后按原生类型的索引；因此能直接交给接收器的格式总是先于需要转换的格式
+// 不依赖 Media Foundation，能力表可以由 CCapture 从源读取器枚举，也可以直接构造
+class CFormatNegotiator
+{
+public:
+    CFormatNegotiator() {}
+
+    // 添加一种原生媒体类型，通常按 GetNativeMediaType 的索引顺序添加
+    HRESULT AddCapability(const MediaCapability& capability);
+
+    // 清空能力表
+    void    Clear() { m_entries.clear(); }
+
+    // 能力数
+    UINT32  Count() const { return (UINT32)m_entries.size(); }
+
+    // 获取表中第 index 项
+    const MediaCapability& GetCapability(UINT32 index) const { return m_entries[index].capability; }
+
+    // 排除一项（例如源读取器拒绝了该类型），之后的 Negotiate 不再选择它
+    void    Exclude(UINT32 index) { m_entries[index].bExcluded = TRUE; }
+
+    // 下限为 0 的分辨率和帧率按表中第一项（设备默认类型）补上，帧率至少为 DEFAULT_MIN_FPS；补上的值超过上限时不补
+    void    ApplyDeviceDefaults(FormatConstraints* pConstraints) const;
+
+    // 选择代价最低的候选：满足全部要求时返回 S_OK，只能放宽要求时返回 S_FALSE，
+    // 没有可用的候选（表为空、全部被排除或无法转换到 outputSubtype）时返回 HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+    HRESULT Negotiate(const FormatConstraints& constraints, NegotiatedFormat* pResult) const;
+
+    // 估计一项能力按 constraints 采集的格式和代价，无法转换到 outputSubtype 时返回 FALSE
+    static BOOL Evaluate(const MediaCapability& capability, const FormatConstraints& constraints,
+        NegotiatedFormat* pResult, double* pfViolation);
+
+private:
+    // Entry 结构体保存一项能力
+    struct Entry
+    {
+        MediaCapability capability;     // 能力
+        BOOL            bExcluded;      // 是否已排除
+    };
+
+    std::vector<Entry>  m_entries;      // 能力表
+};
@@ -0,0 +1,895 @@
+#include <stdio.h>
+#include <string.h>
+#include "netsink.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// poll 的描述项和分散聚集发送的缓冲区描述：Windows 为 WSAPOLLFD 和 WSABUF，其他平台为 pollfd 和 iovec
+#ifdef _WIN32
+typedef WSAPOLLFD   PollItem;
+typedef WSABUF      SendBuffer;
+static const StreamSocket c_invalidSocket = INVALID_SOCKET;
+#else
+typedef pollfd      PollItem;
+typedef iovec       SendBuffer;
+static const StreamSocket c_invalidSocket = -1;
+#endif
+
+// 一次发送最多的分散聚集缓冲区数，每帧占三个
+static const UINT32 c_maxSendBuffers = 15;
+
+// 事件循环没有事件时的最长等待（毫秒），只用于检查退出请求
+static const int c_idleWaitMs = 100;
+
+// BMP 文件头（BITMAPFILEHEADER 和 BITMAPINFOHEADER）的大小
+static const UINT32 c_bmpHeaderSize = 54;
+
+// 响应头：之后是一连串以 --frame 分隔的部分，每部分一帧
+static const char c_response[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+    "Cache-Control: no-cache, no-store\r\n"
+    "Pragma: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+// 每部分的帧数据之后的换行
+static const char c_partTrailer[] = "\r\n";
+
+// 最近一次套接字调用的错误
+static HRESULT GetSocketError()
+{
+#ifdef _WIN32
+    return HRESULT_FROM_WIN32(WSAGetLastError());
+#else
+    return HResultFromErrno(errno);
+#endif
+}
+
+// 最近一次套接字调用是否因为非阻塞套接字暂时不能完成而失败
+static BOOL IsWouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// 关闭套接字
+static void CloseSocket(StreamSocket s)
+{
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+// 把套接字设为非阻塞
+static HRESULT SetNonBlocking(StreamSocket s)
+{
+#ifdef _WIN32
+    u_long bNonBlocking = 1;
+
+    return ioctlsocket(s, FIONBIO, &bNonBlocking) == 0 ? S_OK : GetSocketError();
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+
+    return (flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0) ? S_OK : GetSocketError();
+#endif
+}
+
+// 等待套接字事件，返回有事件的套接字数，失败返回 -1
+static int PollSockets(PollItem* pItems, UINT32 cItems, int timeoutMs)
+{
+#ifdef _WIN32
+    return WSAPoll(pItems, cItems, timeoutMs);
+#else
+    return poll(pItems, (nfds_t)cItems, timeoutMs);
+#endif
+}
+
+// 填写一个分散聚集缓冲区
+static void SetSendBuffer(SendBuffer* pBuffer, const void* pv, size_t cb)
+{
+#ifdef _WIN32
+    pBuffer->buf = (CHAR*)pv;
+    pBuffer->len = (ULONG)cb;
+#else
+    pBuffer->iov_base = (void*)pv;
+    pBuffer->iov_len = cb;
+#endif
+}
+
+// 用一次系统调用发送所有缓冲区，返回发送的字节数，失败返回 -1
+static LONGLONG SendBuffers(StreamSocket s, SendBuffer* pBuffers, UINT32 cBuffers)
+{
+#ifdef _WIN32
+    DWORD cbSent = 0;
+
+    return WSASend(s, pBuffers, cBuffers, &cbSent, 0, nullptr, nullptr) == 0 ? (LONGLONG)cbSent : -1;
+#else
+    msghdr msg = msghdr();
+    int flags = 0;
+
+    msg.msg_iov = pBuffers;
+    msg.msg_iovlen = cBuffers;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL; // 对方已关闭时返回 EPIPE 而不是产生 SIGPIPE
+#endif
+    return (LONGLONG)sendmsg(s, &msg, flags);
+#endif
+}
+
+// 接收数据，返回接收的字节数，对方已关闭时返回 0，失败返回 -1
+static LONGLONG ReceiveBytes(StreamSocket s, char* pBuffer, size_t cb)
+{
+#ifdef _WIN32
+    return recv(s, pBuffer, (int)cb, 0);
+#else
+    return (LONGLONG)recv(s, pBuffer, cb, 0);
+#endif
+}
+
+// 按小端序写入 32 位整数
+static void PutUInt32(BYTE* p, UINT32 value)
+{
+    p[0] = (BYTE)value;
+    p[1] = (BYTE)(value >> 8);
+    p[2] = (BYTE)(value >> 16);
+    p[3] = (BYTE)(value >> 24);
+}
+
+// 写入 32 位自上而下的 BMP 文件头，像素为 BI_RGB 的 BGRX，与 RGB32 的内存布局相同
+static void WriteBmpHeader(BYTE* p, UINT32 width, UINT32 height, UINT32 cbPixels)
+{
+    memset(p, 0, c_bmpHeaderSize);
+    p[0] = 'B';
+    p[1] = 'M';
+    PutUInt32(p + 2, c_bmpHeaderSize + cbPixels);   // 文件大小
+    PutUInt32(p + 10, c_bmpHeaderSize);             // 像素数据的偏移
+    PutUInt32(p + 14, 40);                          // BITMAPINFOHEADER 的大小
+    PutUInt32(p + 18, width);
+    PutUInt32(p + 22, (UINT32)(-(INT32)height));    // 高度为负表示第一行在最上面
+    p[26] = 1;                                      // 平面数
+    p[28] = 32;                                     // 每像素位数
+    PutUInt32(p + 34, cbPixels);
+    PutUInt32(p + 38, 2835);                        // 水平分辨率，72 DPI
+    PutUInt32(p + 42, 2835);                        // 垂直分辨率
+}
+
+CNetStreamSink::CNetStreamSink(const StreamParams& params) :
+    m_params(params),
+    m_port(0),
+    m_bScale(FALSE),
+    m_pFrames(nullptr),
+    m_cFrames(0),
+    m_pSlab(nullptr),
+    m_cbPixels(0),
+    m_pPending(nullptr),
+    m_listen(c_invalidSocket),
+    m_wake(c_invalidSocket),
+    m_cClients(0),
+    m_bStop(false),
+    m_bStarted(FALSE),
+    m_cConnected(0),
+    m_cViewers(0),
+    m_cAccepted(0),
+    m_cEncoded(0),
+    m_cSkipped(0),
+    m_cSent(0),
+    m_cDropped(0),
+    m_cbSent(0),
+    m_cSendCalls(0)
+{
+    if (m_params.cMaxClients == 0)
+    {
+        m_params.cMaxClients = DEFAULT_STREAM_CLIENTS;
+    }
+    if (m_params.cClientQueue == 0)
+    {
+        m_params.cClientQueue = DEFAULT_STREAM_CLIENT_QUEUE;
+    }
+}
+
+CNetStreamSink::~CNetStreamSink()
+{
+    Close();
+}
+
+// 分配编码缓冲区，开始监听并启动事件循环
+HRESULT CNetStreamSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_bStarted)
+    {
+        return E_UNEXPECTED;
+    }
+    if (m_params.cMaxClients > MAX_STREAM_CLIENTS || m_params.cClientQueue > MAX_STREAM_CLIENT_QUEUE)
+    {
+        return E_INVALIDARG;
+    }
+
+    const ScaleParams& scale = m_params.scale;
+    VideoFormat input = format;
+    HRESULT hr = S_OK;
+
+    m_bScale = scale.width || scale.height || scale.crop.width || scale.crop.height;
+
+    if (m_bScale)
+    {
+        hr = m_scaler.Initialize(format, scale);
+
+        if (SUCCEEDED(hr))
+        {
+            input = m_scaler.GetOutputFormat();
+            m_scaled.resize(GetFrameSize(input));
+        }
+    }
+
+    if (SUCCEEDED(hr) && !IsConversionSupported(input.subtype, FOURCC_RGB32))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED); // 压缩格式
+    }
+
+    // 在调用线程中整帧转换，不与流水线的格式转换争用默认线程池
+    if (SUCCEEDED(hr))
+    {
+        m_converter.SetBandCount(1);
+        hr = m_converter.Initialize(input, FOURCC_RGB32);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // 同时存在的编码帧最多为：每个客户端正在发送的一帧、共享的排队帧、等待取走的一帧和正在编码的一帧
+    size_t cbStride = ((size_t)GetFrameSize(m_converter.GetOutputFormat()) + PAGE_SIZE_BYTES - 1) & ~(size_t)(PAGE_SIZE_BYTES - 1);
+
+    m_cbPixels = GetFrameSize(m_converter.GetOutputFormat());
+    m_cFrames = m_params.cMaxClients + m_params.cClientQueue + 2;
+    m_pSlab = (BYTE*)AlignedAlloc(cbStride * m_cFrames, PAGE_SIZE_BYTES);
+    m_pFrames = new (std::nothrow) StreamFrame[m_cFrames];
+
+    if (m_pSlab == nullptr || m_pFrames == nullptr)
+    {
+        Close();
+        return E_OUTOFMEMORY;
+    }
+
+    m_free.clear();
+    m_free.reserve(m_cFrames);
+
+    for (UINT32 i = 0; i < m_cFrames; i++)
+    {
+        m_pFrames[i].nRefCount = 0;
+        m_pFrames[i].cbHeader = 0;
+        m_pFrames[i].pPixels = m_pSlab + cbStride * i;
+        m_pFrames[i].llArrival = 0;
+        m_free.push_back(&m_pFrames[i]);
+    }
+
+#ifdef _WIN32
+    WSADATA data;
+    int error = WSAStartup(MAKEWORD(2, 2), &data);
+
+    if (error != 0)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(error);
+    }
+#endif
+    m_bStarted = TRUE;
+
+    // 监听套接字
+    sockaddr_in address = sockaddr_in();
+    socklen_t cbAddress = sizeof(address);
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(m_params.port);
+    address.sin_addr.s_addr = htonl(m_params.bListenAll ? INADDR_ANY : INADDR_LOOPBACK);
+
+    m_listen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    hr = (m_listen != c_invalidSocket) ? S_OK : GetSocketError();
+
+#ifndef _WIN32
+    // 允许在上次的连接处于 TIME_WAIT 时立即重新监听同一端口；Windows 上这个选项会允许端口被抢占，不使用
+    if (SUCCEEDED(hr))
+    {
+        int reuse = 1;
+
+        setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+#endif
+
+    if (SUCCEEDED(hr) && (bind(m_listen, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(m_listen, SOMAXCONN) != 0 || getsockname(m_listen, (sockaddr*)&address, &cbAddress) != 0))
+    {
+        hr = GetSocketError();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        m_port = ntohs(address.sin_port);
+        hr = SetNonBlocking(m_listen);
+    }
+
+    // 唤醒用的 UDP 套接字绑定在回环地址上并连接到自身，WriteFrame 向它发一个字节即可让 poll 返回
+    if (SUCCEEDED(hr))
+    {
+        sockaddr_in wake = sockaddr_in();
+        socklen_t cbWake = sizeof(wake);
+
+        wake.sin_family = AF_INET;
+        wake.sin_port = 0;
+        wake.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        m_wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+        if (m_wake == c_invalidSocket || bind(m_wake, (const sockaddr*)&wake, sizeof(wake)) != 0 ||
+            getsockname(m_wake, (sockaddr*)&wake, &cbWake) != 0 || connect(m_wake, (const sockaddr*)&wake, cbWake) != 0)
+        {
+            hr = GetSocketError();
+        }
+        else
+        {
+            hr = SetNonBlocking(m_wake);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+        return hr;
+    }
+
+    m_cConnected = 0;
+    m_cViewers = 0;
+    m_cAccepted = 0;
+    m_cEncoded = 0;
+    m_cSkipped = 0;
+    m_cSent = 0;
+    m_cDropped = 0;
+    m_cbSent = 0;
+    m_cSendCalls = 0;
+    m_latency.Reset();
+
+    m_bStop = false;
+    m_thread = std::thread(&CNetStreamSink::EventLoop, this);
+    return S_OK;
+}
+
+// 把一帧编码后交给事件循环
+HRESULT CNetStreamSink::WriteFrame(const CaptureFrame& frame)
+{
+    if (!m_bStarted)
+    {
+        return E_UNEXPECTED;
+    }
+    if (frame.cbData < GetFrameSize(m_bScale ? m_scaler.GetInputFormat() : m_converter.GetInputFormat()))
+    {
+        return E_INVALIDARG;
+    }
+
+    // 没有观看端时不编码
+    if (m_cViewers.load() == 0)
+    {
+        return S_OK;
+    }
+
+    StreamFrame* pFrame = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_free.empty())
+        {
+            pFrame = m_free.back();
+            m_free.pop_back();
+        }
+    }
+
+    if (pFrame == nullptr)
+    {
+        m_cSkipped++;
+        return S_OK;
+    }
+
+    pFrame->nRefCount = 1;
+
+    const BYTE* pSrc = frame.pData;
+    HRESULT hr = S_OK;
+
+    if (m_bScale)
+    {
+        hr = m_scaler.Scale(pSrc, m_scaled.data());
+        pSrc = m_scaled.data();
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = m_converter.Convert(pSrc, pFrame->pPixels);
+    }
+    if (FAILED(hr))
+    {
+        ReleaseFrame(pFrame);
+        return hr;
+    }
+
+    // 部分头带上帧序号、时间戳和进入流水线的时刻，同一台机器上的客户端可以据此计算端到端延迟
+    const VideoFormat& output = m_converter.GetOutputFormat();
+    int cch = snprintf(pFrame->header, sizeof(pFrame->header) - c_bmpHeaderSize,
+        "--frame\r\nContent-Type: image/bmp\r\nContent-Length: %u\r\n"
+        "X-Sequence: %llu\r\nX-Timestamp: %lld\r\nX-Arrival: %lld\r\n\r\n",
+        c_bmpHeaderSize + m_cbPixels, (unsigned long long)frame.nSequence,
+        (long long)frame.llTimestamp, (long long)frame.llArrival);
+
+    WriteBmpHeader((BYTE*)pFrame->header + cch, output.width, output.height, m_cbPixels);
+    pFrame->cbHeader = (UINT32)cch + c_bmpHeaderSize;
+    pFrame->llArrival = frame.llArrival;
+    m_cEncoded++;
+
+    // 事件循环还没取走的上一帧已经过时，直接替换
+    StreamFrame* pStale = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        pStale = m_pPending;
+        m_pPending = pFrame;
+    }
+
+    if (pStale)
+    {
+        m_cSkipped++;
+        ReleaseFrame(pStale);
+    }
+
+    Wake();
+    return S_OK;
+}
+
+// 停止事件循环并断开所有客户端
+HRESULT CNetStreamSink::Finalize()
+{
+    Close();
+    return S_OK;
+}
+
+// 获取统计
+void CNetStreamSink::GetStats(StreamStats* pStats) const
+{
+    pStats->cClients = m_cConnected.load();
+    pStats->cViewers = m_cViewers.load();
+    pStats->cAccepted = m_cAccepted.load();
+    pStats->cEncoded = m_cEncoded.load();
+    pStats->cSkipped = m_cSkipped.load();
+    pStats->cSent = m_cSent.load();
+    pStats->cDropped = m_cDropped.load();
+    pStats->cbSent = m_cbSent.load();
+    pStats->cSendCalls = m_cSendCalls.load();
+    m_latency.GetSummary(&pStats->latency);
+}
+
+// 释放编码缓冲区的一个引用
+void CNetStreamSink::ReleaseFrame(StreamFrame* pFrame)
+{
+    if (--pFrame->nRefCount == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_free.push_back(pFrame);
+    }
+}
+
+// 一帧需要发送的总字节数
+size_t CNetStreamSink::GetFrameBytes(const StreamFrame* pFrame) const
+{
+    return (size_t)pFrame->cbHeader + m_cbPixels + sizeof(c_partTrailer) - 1;
+}
+
+// 事件循环
+void CNetStreamSink::EventLoop()
+{
+    PollItem items[2 + MAX_STREAM_CLIENTS];
+
+    while (!m_bStop.load())
+    {
+        // 第 0 项为唤醒套接字，连接数未满时第 1 项为监听套接字，之后是各客户端
+        UINT32 cItems = 0;
+        BOOL bListen = m_cClients < m_params.cMaxClients;
+
+        items[cItems].fd = m_wake;
+        items[cItems].events = POLLIN;
+        items[cItems++].revents = 0;
+
+        if (bListen)
+        {
+            items[cItems].fd = m_listen;
+            items[cItems].events = POLLIN;
+            items[cItems++].revents = 0;
+        }
+
+        UINT32 iFirstClient = cItems;
+        UINT32 cPolled = m_cClients;
+
+        for (UINT32 i = 0; i < cPolled; i++)
+        {
+            const Client& client = m_clients[i];
+            BOOL bOutput = client.bStreaming && (client.cbResponseSent < sizeof(c_response) - 1 || client.cFrames > 0);
+
+            items[cItems].fd = client.socket;
+            items[cItems].events = bOutput ? (POLLIN | POLLOUT) : POLLIN;
+            items[cItems++].revents = 0;
+        }
+
+        if (PollSockets(items, cItems, c_idleWaitMs) < 0)
+        {
+            continue; // 被信号中断
+        }
+
+        if (items[0].revents & POLLIN)
+        {
+            char buffer[64];
+
+            while (ReceiveBytes(m_wake, buffer, sizeof(buffer)) > 0)
+            {
+            }
+        }
+
+        // 把最新的一帧交给所有观看端，之后逐个发送
+        StreamFrame* pFrame = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            pFrame = m_pPending;
+            m_pPending = nullptr;
+        }
+
+        if (pFrame)
+        {
+            for (UINT32 i = 0; i < m_cClients; i++)
+            {
+                if (m_clients[i].bStreaming)
+                {
+                    QueueFrame(&m_clients[i], pFrame);
+                }
+            }
+
+            ReleaseFrame(pFrame);
+        }
+
+        if (bListen && (items[1].revents & POLLIN))
+        {
+            AcceptClients();
+        }
+
+        // 从后往前处理，关闭的客户端由最后一个填补，不影响尚未处理的客户端；新接受的客户端下一轮再处理
+        for (UINT32 i = cPolled; i-- > 0; )
+        {
+            short revents = items[iFirstClient + i].revents;
+            HRESULT hr = S_OK;
+
+            if (revents & (POLLERR | POLLHUP | POLLNVAL))
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+            }
+            else if (revents & POLLIN)
+            {
+                hr = ReadRequest(&m_clients[i]);
+            }
+
+            if (SUCCEEDED(hr))
+            {
+                hr = FlushClient(&m_clients[i]);
+            }
+
+            if (FAILED(hr))
+            {
+                CloseClient(i);
+            }
+        }
+    }
+}
+
+// 接受所有等待中的连接
+void CNetStreamSink::AcceptClients()
+{
+    while (m_cClients < m_params.cMaxClients)
+    {
+        StreamSocket s = accept(m_listen, nullptr, nullptr);
+
+        if (s == c_invalidSocket)
+        {
+            break; // 没有更多等待中的连接
+        }
+
+        if (FAILED(SetNonBlocking(s)))
+        {
+            CloseSocket(s);
+            continue;
+        }
+
+        // 每部分末尾的换行很短，不能让 Nagle 算法把它留到下一帧
+        int noDelay = 1;
+
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &noDelay, sizeof(noDelay));
+#endif
+
+        Client& client = m_clients[m_cClients++];
+
+        client.socket = s;
+        client.bStreaming = FALSE;
+        client.cbRequest = 0;
+        client.cbResponseSent = 0;
+        client.cFrames = 0;
+        client.cbFrameSent = 0;
+
+        m_cAccepted++;
+        m_cConnected = m_cClients;
+    }
+}
+
+// 读取客户端的请求；开始发送之后客户端发来的数据直接丢弃
+HRESULT CNetStreamSink::ReadRequest(Client* pClient)
+{
+    char discard[256];
+    char* pBuffer = pClient->bStreaming ? discard : pClient->request + pClient->cbRequest;
+    size_t cbBuffer = pClient->bStreaming ? sizeof(discard) : MAX_STREAM_REQUEST - 1 - pClient->cbRequest;
+    LONGLONG cbReceived = ReceiveBytes(pClient->socket, pBuffer, cbBuffer);
+
+    if (cbReceived == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF); // 对方已关闭
+    }
+    if (cbReceived < 0)
+    {
+        return IsWouldBlock() ? S_OK : GetSocketError();
+    }
+    if (pClient->bStreaming)
+    {
+        return S_OK;
+    }
+
+    pClient->cbRequest += (UINT32)cbReceived;
+    pClient->request[pClient->cbRequest] = '\0';
+
+    if (strstr(pClient->request, "\r\n\r\n") == nullptr)
+    {
+        return (pClient->cbRequest < MAX_STREAM_REQUEST - 1) ? S_OK : E_INVALIDARG; // 请求头过长
+    }
+
+    // 任何路径的 GET 请求都得到同一路流
+    if (strncmp(pClient->request, "GET ", 4) != 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    pClient->bStreaming = TRUE;
+    m_cViewers++;
+    return S_OK;
+}
+
+// 把一帧放入客户端的发送队列
+void CNetStreamSink::QueueFrame(Client* pClient, StreamFrame* pFrame)
+{
+    UINT32 cInFlight = (pClient->cFrames > 0 && pClient->cbFrameSent > 0) ? 1 : 0;
+
+    // 队列已满时丢弃排队的旧帧，只保留正在发送的一帧，客户端下一帧总是最新的画面
+    if (pClient->cFrames - cInFlight >= m_params.cClientQueue)
+    {
+        for (UINT32 i = cInFlight; i < pClient->cFrames; i++)
+        {
+            ReleaseFrame(pClient->frames[i]);
+        }
+
+        m_cDropped += pClient->cFrames - cInFlight;
+        pClient->cFrames = cInFlight;
+    }
+
+    pFrame->nRefCount++;
+    pClient->frames[pClient->cFrames++] = pFrame;
+}
+
+// 发送客户端的响应头和排队的帧
+HRESULT CNetStreamSink::FlushClient(Client* pClient)
+{
+    const size_t cbResponse = sizeof(c_response) - 1;
+
+    if (!pClient->bStreaming)
+    {
+        return S_OK;
+    }
+
+    for (;;)
+    {
+        SendBuffer buffers[c_maxSendBuffers];
+        UINT32 cBuffers = 0;
+        size_t cbTotal = 0;
+
+        if (pClient->cbResponseSent < cbResponse)
+        {
+            SetSendBuffer(&buffers[cBuffers++], c_response + pClient->cbResponseSent, cbResponse - pClient->cbResponseSent);
+            cbTotal += cbResponse - pClient->cbResponseSent;
+        }
+
+        // 每帧依次为部分头（含 BMP 文件头）、像素和换行，第一帧跳过已发送的部分
+        size_t cbSkip = pClient->cbFrameSent;
+
+        for (UINT32 i = 0; i < pClient->cFrames && cBuffers + 3 <= c_maxSendBuffers; i++)
+        {
+            const StreamFrame* pFrame = pClient->frames[i];
+            const void* pSegments[3] = { pFrame->header, pFrame->pPixels, c_partTrailer };
+            size_t cbSegments[3] = { pFrame->cbHeader, m_cbPixels, sizeof(c_partTrailer) - 1 };
+
+            for (UINT32 j = 0; j < 3; j++)
+            {
+                if (cbSkip >= cbSegments[j])
+                {
+                    cbSkip -= cbSegments[j];
+                    continue;
+                }
+
+                SetSendBuffer(&buffers[cBuffers++], (const BYTE*)pSegments[j] + cbSkip, cbSegments[j] - cbSkip);
+                cbTotal += cbSegments[j] - cbSkip;
+                cbSkip = 0;
+            }
+        }
+
+        if (cBuffers == 0)
+        {
+            return S_OK;
+        }
+
+        LONGLONG cbSent = SendBuffers(pClient->socket, buffers, cBuffers);
+
+        if (cbSent < 0)
+        {
+            return IsWouldBlock() ? S_OK : GetSocketError();
+        }
+
+        m_cSendCalls++;
+        m_cbSent += (UINT64)cbSent;
+
+        // 按发送的字节数推进响应头和发送队列
+        size_t cbLeft = (size_t)cbSent;
+
+        if (pClient->cbResponseSent < cbResponse)
+        {
+            size_t cb = cbResponse - pClient->cbResponseSent;
+
+            cb = (cbLeft < cb) ? cbLeft : cb;
+            pClient->cbResponseSent += (UINT32)cb;
+            cbLeft -= cb;
+        }
+
+        while (cbLeft > 0 && pClient->cFrames > 0)
+        {
+            size_t cbRemaining = GetFrameBytes(pClient->frames[0]) - pClient->cbFrameSent;
+
+            if (cbLeft < cbRemaining)
+            {
+                pClient->cbFrameSent += cbLeft;
+                break;
+            }
+
+            // 一帧的最后一个字节已交给套接字
+            LONGLONG llLatency = GetClockTime() - pClient->frames[0]->llArrival;
+
+            m_latency.Record((UINT64)(llLatency > 0 ? llLatency : 0) * 100);
+            m_cSent++;
+
+            cbLeft -= cbRemaining;
+            ReleaseFrame(pClient->frames[0]);
+            memmove(&pClient->frames[0], &pClient->frames[1], (pClient->cFrames - 1) * sizeof(StreamFrame*));
+            pClient->cFrames--;
+            pClient->cbFrameSent = 0;
+        }
+
+        if ((size_t)cbSent < cbTotal)
+        {
+            return S_OK; // 套接字缓冲区已满，等待可写
+        }
+    }
+}
+
+// 关闭第 index 个客户端
+void CNetStreamSink::CloseClient(UINT32 index)
+{
+    Client& client = m_clients[index];
+
+    CloseSocket(client.socket);
+
+    for (UINT32 i = 0; i < client.cFrames; i++)
+    {
+        ReleaseFrame(client.frames[i]);
+    }
+
+    if (client.bStreaming)
+    {
+        m_cViewers--;
+    }
+
+    m_cClients--;
+
+    if (index != m_cClients)
+    {
+        m_clients[index] = m_clients[m_cClients];
+    }
+
+    m_cConnected = m_cClients;
+}
+
+// 唤醒事件循环，唤醒套接字的缓冲区已满时说明已有未处理的唤醒，忽略失败
+void CNetStreamSink::Wake()
+{
+    char signal = 0;
+
+    send(m_wake, &signal, 1, 0);
+}
+
+// 停止事件循环，关闭所有套接字并释放编码缓冲区
+void CNetStreamSink::Close()
+{
+    if (m_thread.joinable())
+    {
+        m_bStop = true;
+        Wake();
+        m_thread.join();
+    }
+
+    while (m_cClients > 0)
+    {
+        CloseClient(m_cClients - 1);
+    }
+
+    if (m_pPending)
+    {
+        ReleaseFrame(m_pPending);
+        m_pPending = nullptr;
+    }
+
+    if (m_listen != c_invalidSocket)
+    {
+        CloseSocket(m_listen);
+        m_listen = c_invalidSocket;
+    }
+
+    if (m_wake != c_invalidSocket)
+    {
+        CloseSocket(m_wake);
+        m_wake = c_invalidSocket;
+    }
+
+#ifdef _WIN32
+    if (m_bStarted)
+    {
+        WSACleanup();
+    }
+#endif
+    m_bStarted = FALSE;
+
+    delete[] m_pFrames;
+    m_pFrames = nullptr;
+    m_cFrames = 0;
+
+    AlignedFree(m_pSlab);
+    m_pSlab = nullptr;
+    m_free.clear();
+}
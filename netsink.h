@@ -0,0 +1,183 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include "sink.h"
+#include "scale.h"
+#include "convert.h"
+#include "latency.h"
+
+// 最多同时连接的客户端数
+const UINT32 MAX_STREAM_CLIENTS = 16;
+
+// 默认最多同时连接的客户端数
+const UINT32 DEFAULT_STREAM_CLIENTS = 4;
+
+// 每个客户端排队等待发送的最大帧数（不含正在发送的一帧）
+const UINT32 MAX_STREAM_CLIENT_QUEUE = 8;
+
+// 每个客户端默认排队等待发送的帧数
+const UINT32 DEFAULT_STREAM_CLIENT_QUEUE = 1;
+
+// 客户端请求头的最大长度
+const UINT32 MAX_STREAM_REQUEST = 2048;
+
+// 套接字句柄：Windows 为 SOCKET，其他平台为文件描述符
+#ifdef _WIN32
+typedef UINT_PTR StreamSocket;
+#else
+typedef int StreamSocket;
+#endif
+
+// StreamParams 结构体描述网络发送的参数，各字段为 0 时取默认值
+struct StreamParams
+{
+    WORD        port;           // 监听的 TCP 端口，0 表示由系统分配（用 GetPort 取得实际端口）
+    BOOL        bListenAll;     // 在所有网卡上监听，供局域网内的客户端观看；为 FALSE 时只监听本机回环地址
+    UINT32      cMaxClients;    // 最多同时连接的客户端数，不超过 MAX_STREAM_CLIENTS
+    UINT32      cClientQueue;   // 每个客户端排队等待发送的帧数，不超过 MAX_STREAM_CLIENT_QUEUE
+    ScaleParams scale;          // 发送前的缩放（只支持 4:2:0 输入），width 和 height 都为 0 时按原始大小发送
+};
+
+// StreamStats 结构体保存网络发送的统计
+struct StreamStats
+{
+    UINT32          cClients;       // 当前连接的客户端数
+    UINT32          cViewers;       // 其中已发出请求、正在接收帧的客户端数
+    UINT64          cAccepted;      // 累计接受的连接数
+    UINT64          cEncoded;       // 编码的帧数（没有客户端时不编码）
+    UINT64          cSkipped;       // 没有空闲的编码缓冲区，或者事件循环还没取走上一帧就被新帧替换而跳过的帧数
+    UINT64          cSent;          // 发送完的帧数（各客户端之和）
+    UINT64          cDropped;       // 客户端跟不上、排队的帧被最新的一帧替换而丢弃的帧数（各客户端之和）
+    UINT64          cbSent;         // 发送的字节数
+    UINT64          cSendCalls;     // 发送的系统调用次数，与 cSent 相比可以看出分散聚集合并了多少次写入
+    LatencySummary  latency;        // 从进入流水线到一帧的最后一个字节交给套接字的延迟
+};
+
+// CNetStreamSink 类把帧实时发送给网络上的观看端：内置一个 HTTP 服务器，每个 GET 请求得到一路
+// multipart/x-mixed-replace 流（即 MJPEG over HTTP 的格式），每一部分是一帧 32 位 BMP 图像，
+// 浏览器或 ffplay 可以直接打开 http://<地址>:<端口>/ 观看
+//
+// 每帧在 WriteFrame 中只缩放、转换一次，放进引用计数的编码缓冲区，所有客户端共享；网络 I/O 全部在一个
+// 事件循环线程中用非阻塞套接字和 poll 完成，WriteFrame 从不等待网络，没有客户端时直接返回
+//
+// 每个客户端有自己的有界发送队列：客户端跟不上时丢弃排队的旧帧，只保留最新的一帧，正在发送的一帧总是发完，
+// 慢的客户端只是帧率降低，不会拖慢其他客户端；一帧的部分头、BMP 数据和分隔符以及排队的多帧
+// 用分散聚集的一次系统调用发出（Windows 为 WSASend，其他平台为 sendmsg）
+//
+// 建议作为 CFrameBus 的订阅者使用，缩放和转换的耗时不影响文件接收器
+class CNetStreamSink : public IFrameSink
+{
+public:
+    explicit CNetStreamSink(const StreamParams& params);
+    virtual ~CNetStreamSink();
+
+    // 按格式分配编码缓冲区，开始监听并启动事件循环；端口被占用时返回对应的错误
+    HRESULT BeginWriting(const VideoFormat& format);
+
+    // 把一帧编码后交给事件循环发送
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 停止事件循环并断开所有客户端
+    HRESULT Finalize();
+
+    // 实际监听的端口，BeginWriting 之后有效
+    WORD    GetPort() const { return m_port; }
+
+    // 发送的图像格式（RGB32，缩放后的大小），BeginWriting 之后有效
+    const VideoFormat& GetOutputFormat() const { return m_converter.GetOutputFormat(); }
+
+    // 获取统计，可以在任意线程调用
+    void    GetStats(StreamStats* pStats) const;
+
+private:
+    CNetStreamSink(const CNetStreamSink&);
+    CNetStreamSink& operator=(const CNetStreamSink&);
+
+    // StreamFrame 结构体是一个编码缓冲区：部分头和 BMP 文件头在 header 中，像素在 pPixels 中
+    // 引用计数由待取走的一帧和各客户端的发送队列持有，归零时放回空闲栈
+    struct StreamFrame
+    {
+        std::atomic<LONG>   nRefCount;      // 引用计数
+        char                header[256];    // multipart 部分头和 BMP 文件头
+        UINT32              cbHeader;       // header 的有效长度
+        BYTE*               pPixels;        // BGRX 像素，自上而下
+        LONGLONG            llArrival;      // 进入流水线的时刻（GetClockTime）
+    };
+
+    // Client 结构体保存一个连接，只在事件循环线程中访问
+    struct Client
+    {
+        StreamSocket    socket;             // 套接字
+        BOOL            bStreaming;         // 已收到请求，开始发送响应和帧
+        char            request[MAX_STREAM_REQUEST];    // 已收到的请求
+        UINT32          cbRequest;          // 已收到的请求长度
+        UINT32          cbResponseSent;     // 响应头已发送的字节数
+        StreamFrame*    frames[MAX_STREAM_CLIENT_QUEUE + 1];    // 发送队列，frames[0] 可能已发送了一部分
+        UINT32          cFrames;            // 发送队列中的帧数
+        size_t          cbFrameSent;        // frames[0] 已发送的字节数
+    };
+
+    // 释放编码缓冲区的一个引用
+    void    ReleaseFrame(StreamFrame* pFrame);
+
+    // 一帧需要发送的总字节数
+    size_t  GetFrameBytes(const StreamFrame* pFrame) const;
+
+    // 事件循环
+    void    EventLoop();
+
+    // 接受所有等待中的连接
+    void    AcceptClients();
+
+    // 读取客户端的请求，收到完整的请求头后开始发送；连接已关闭或请求无效时返回失败
+    HRESULT ReadRequest(Client* pClient);
+
+    // 把一帧放入客户端的发送队列，队列已满时丢弃排队的旧帧
+    void    QueueFrame(Client* pClient, StreamFrame* pFrame);
+
+    // 尽量发送客户端的响应头和排队的帧，套接字缓冲区满时返回 S_OK 等待下次可写；连接出错时返回失败
+    HRESULT FlushClient(Client* pClient);
+
+    // 关闭第 index 个客户端，释放它排队的帧
+    void    CloseClient(UINT32 index);
+
+    // 唤醒事件循环
+    void    Wake();
+
+    // 停止事件循环，关闭所有套接字并释放编码缓冲区
+    void    Close();
+
+    StreamParams            m_params;           // 参数（已补上默认值）
+    WORD                    m_port;             // 实际监听的端口
+    CFrameScaler            m_scaler;           // 缩放，m_bScale 为 FALSE 时不使用
+    CFrameConverter         m_converter;        // 转换到 RGB32
+    BOOL                    m_bScale;           // 是否缩放
+    std::vector<BYTE>       m_scaled;           // 缩放后的帧
+    StreamFrame*            m_pFrames;          // 编码缓冲区
+    UINT32                  m_cFrames;          // 编码缓冲区数
+    BYTE*                   m_pSlab;            // 所有编码缓冲区的像素
+    UINT32                  m_cbPixels;         // 每帧像素的字节数
+    std::mutex              m_mutex;            // 保护 m_free 和 m_pPending
+    std::vector<StreamFrame*> m_free;           // 空闲的编码缓冲区
+    StreamFrame*            m_pPending;         // 已编码、等待事件循环取走的最新一帧
+    StreamSocket            m_listen;           // 监听套接字
+    StreamSocket            m_wake;             // 连接到自身的 UDP 套接字，用于唤醒事件循环
+    Client                  m_clients[MAX_STREAM_CLIENTS];  // 连接，事件循环线程使用
+    UINT32                  m_cClients;         // 连接数，事件循环线程使用
+    std::thread             m_thread;           // 事件循环线程
+    std::atomic<bool>       m_bStop;            // 请求事件循环退出
+    BOOL                    m_bStarted;         // 是否已开始（Windows 上同时表示已初始化 Winsock）
+    CLatencyHistogram       m_latency;          // 发送延迟，只由事件循环线程记录
+    std::atomic<UINT32>     m_cConnected;       // 当前连接数
+    std::atomic<UINT32>     m_cViewers;         // 正在接收帧的客户端数
+    std::atomic<UINT64>     m_cAccepted;        // 累计接受的连接数
+    std::atomic<UINT64>     m_cEncoded;         // 编码的帧数
+    std::atomic<UINT64>     m_cSkipped;         // 跳过的帧数
+    std::atomic<UINT64>     m_cSent;            // 发送完的帧数
+    std::atomic<UINT64>     m_cDropped;         // 丢弃的帧数
+    std::atomic<UINT64>     m_cbSent;           // 发送的字节数
+    std::atomic<UINT64>     m_cSendCalls;       // 发送的系统调用次数
+};
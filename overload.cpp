@@ -0,0 +1,95 @@
+#include "overload.h"
+
+// 策略名称
+const char* GetOverloadPolicyName(OverloadPolicy policy)
+{
+    switch (policy)
+    {
+    case OverloadPolicy_DropNewest: return "drop-newest";
+    case OverloadPolicy_DropOldest: return "drop-oldest";
+    case OverloadPolicy_Decimate:   return "decimate";
+    case OverloadPolicy_Block:      return "block";
+    default:                        return "unknown";
+    }
+}
+
+// 丢帧原因名称
+const char* GetDropReasonName(DropReason reason)
+{
+    switch (reason)
+    {
+    case DropReason_QueueFull:  return "queue_full";
+    case DropReason_PoolEmpty:  return "pool_empty";
+    case DropReason_Evicted:    return "evicted";
+    case DropReason_Decimated:  return "decimated";
+    case DropReason_Timeout:    return "timeout";
+    case DropReason_Dependent:  return "dependent";
+    case DropReason_OutputFull: return "output_full";
+    default:                    return "unknown";
+    }
+}
+
+// 记录一次丢帧；按秒划分时间，相邻两秒都有丢帧时连续区间延长，否则重新开始
+void CDropRecorder::Record(DropReason reason, const CaptureFrame& frame)
+{
+    LONGLONG llNow = GetClockTime();
+    LONGLONG llSecond = llNow / HNS_PER_SECOND;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats.cDrops[reason]++;
+    m_stats.cTotal++;
+
+    if (m_stats.llFirstDrop == 0)
+    {
+        m_stats.llFirstDrop = llNow;
+        m_llRunStart = llSecond;
+    }
+    else if (llSecond > m_llRunEnd + 1)
+    {
+        m_llRunStart = llSecond;
+    }
+
+    m_llRunEnd = llSecond;
+    m_stats.llLastDrop = llNow;
+    m_stats.cOverloadSeconds = (UINT32)(m_llRunEnd - m_llRunStart + 1);
+
+    DropEvent& event = m_events[m_cEvents % DROP_HISTORY_SIZE];
+    event.llTime = llNow;
+    event.llTimestamp = frame.llTimestamp;
+    event.nSequence = frame.nSequence;
+    event.reason = reason;
+    m_cEvents++;
+}
+
+void CDropRecorder::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_stats = DropStats();
+    m_llRunStart = 0;
+    m_llRunEnd = 0;
+    m_cEvents = 0;
+}
+
+void CDropRecorder::GetStats(DropStats* pStats) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *pStats = m_stats;
+}
+
+// 最近的记录在环形数组中从 m_cEvents - cCopy 开始
+UINT32 CDropRecorder::GetEvents(DropEvent* pEvents, UINT32 cMax) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    UINT64 cAvailable = m_cEvents < DROP_HISTORY_SIZE ? m_cEvents : DROP_HISTORY_SIZE;
+    UINT32 cCopy = (UINT32)(cAvailable < cMax ? cAvailable : cMax);
+
+    for (UINT32 i = 0; i < cCopy; i++)
+    {
+        pEvents[i] = m_events[(m_cEvents - cCopy + i) % DROP_HISTORY_SIZE];
+    }
+
+    return cCopy;
+}
@@ -0,0 +1,88 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <mutex>
+#include "frame.h"
+
+// 写出跟不上采集（队列已满或缓冲池已空）时的处理策略
+enum OverloadPolicy
+{
+    OverloadPolicy_DropNewest = 0,  // 丢弃新到的帧，已排队的帧照常写出
+    OverloadPolicy_DropOldest,      // 挤掉队列中最旧的帧，保证写出的总是最新的画面
+    OverloadPolicy_Decimate,        // 队列深度超过 3/4 后只保留每 N 帧中的一帧，回落到 1/4 以下后恢复；仍放不下时丢弃新帧
+    OverloadPolicy_Block,           // 等待写入线程腾出空间，最多等待设定的时长，超时后丢弃新帧
+};
+
+// 默认的抽帧间隔和阻塞等待时长
+const UINT32 DEFAULT_DECIMATION = 2;
+const UINT32 DEFAULT_BLOCK_TIMEOUT_MS = 100;
+
+// 丢帧原因
+enum DropReason
+{
+    DropReason_QueueFull = 0,   // 队列已满，丢弃新帧
+    DropReason_PoolEmpty,       // 缓冲池已空（接收器仍持有缓冲区），丢弃新帧
+    DropReason_Evicted,         // 被新帧挤出队列
+    DropReason_Decimated,       // 过载时抽帧
+    DropReason_Timeout,         // 阻塞等待超时
+    DropReason_Dependent,       // 所依赖的帧已丢弃（压缩输入的非关键帧），等待下一个关键帧
+    DropReason_OutputFull,      // 转换后的输出缓冲池已空
+    DropReason_Count
+};
+
+// 策略和原因的名称，用于日志和报告输出
+const char* GetOverloadPolicyName(OverloadPolicy policy);
+const char* GetDropReasonName(DropReason reason);
+
+// DropEvent 结构体记录一次丢帧
+struct DropEvent
+{
+    LONGLONG    llTime;         // 丢帧时刻（GetClockTime，100 纳秒）
+    LONGLONG    llTimestamp;    // 被丢弃帧的时间戳
+    UINT64      nSequence;      // 被丢弃帧的序号
+    DropReason  reason;         // 原因
+};
+
+// DropStats 结构体保存丢帧统计
+struct DropStats
+{
+    UINT64      cDrops[DropReason_Count];   // 各原因的丢帧数
+    UINT64      cTotal;                     // 总丢帧数
+    LONGLONG    llFirstDrop;                // 第一次丢帧的时刻（GetClockTime），没有丢帧时为 0
+    LONGLONG    llLastDrop;                 // 最近一次丢帧的时刻
+    UINT32      cOverloadSeconds;           // 截至最近一次丢帧，连续有丢帧的秒数，用于发现持续过载
+};
+
+// 保留的最近丢帧记录数
+const UINT32 DROP_HISTORY_SIZE = 64;
+
+// CDropRecorder 类统计丢帧数并保留最近的丢帧记录
+// 采集侧和写入线程都可能丢帧，Record 在锁内更新；只在丢帧时调用，不影响正常帧的路径
+class CDropRecorder
+{
+public:
+    CDropRecorder() { Reset(); }
+
+    // 记录一次丢帧
+    void    Record(DropReason reason, const CaptureFrame& frame);
+
+    // 清空，在流水线启动时调用
+    void    Reset();
+
+    // 获取统计
+    void    GetStats(DropStats* pStats) const;
+
+    // 按时间顺序拷贝最近的最多 cMax 条丢帧记录，返回拷贝的条数
+    UINT32  GetEvents(DropEvent* pEvents, UINT32 cMax) const;
+
+private:
+    CDropRecorder(const CDropRecorder&);
+    CDropRecorder& operator=(const CDropRecorder&);
+
+    mutable std::mutex  m_mutex;                        // 保护以下成员
+    DropStats           m_stats;                        // 统计
+    LONGLONG            m_llRunStart;                   // 当前连续丢帧区间的起始秒
+    LONGLONG            m_llRunEnd;                     // 当前连续丢帧区间的最后一秒
+    DropEvent           m_events[DROP_HISTORY_SIZE];    // 最近的丢帧记录，环形使用
+    UINT64              m_cEvents;                      // 记录过的总条数
+};
@@ -0,0 +1,1102 @@
+#include <string.h>
+#include "pipeline.h"
+
+using std::chrono::steady_clock;
+
+// 写入线程在队列为空时的最长等待时间，用于兜底检查停止请求
+static const std::chrono::milliseconds c_writerIdleWait(10);
+
+// 生产者等待空间时每次的最长等待时间：接收器在其他线程释放缓冲区时不会唤醒生产者，靠它兜底
+static const LONGLONG c_producerWaitSlice = HNS_PER_SECOND / 1000;
+
+CFramePipeline::CFramePipeline() :
+    m_pSource(nullptr),
+    m_pSink(nullptr),
+    m_cQueueDepth(DEFAULT_QUEUE_DEPTH),
+    m_readerCore(NO_CPU_AFFINITY),
+    m_writerCore(NO_CPU_AFFINITY),
+    m_pPool(nullptr),
+    m_outputSubtype(0),
+    m_bConvert(FALSE),
+    m_pOutputPool(nullptr),
+    m_cSinkBuffers(0),
+    m_cMaxBatch(1),
+    m_llBatchLinger(0),
+    m_llBatchLatency((LONGLONG)DEFAULT_BATCH_LATENCY_US * 10),
+    m_analysisFrameStride(0),
+    m_analysisRowStride(1),
+    m_overloadPolicy(OverloadPolicy_DropNewest),
+    m_decimation(DEFAULT_DECIMATION),
+    m_llBlockTimeout(DEFAULT_BLOCK_TIMEOUT_MS * (HNS_PER_SECOND / 1000)),
+    m_bHasStats(FALSE),
+    m_bStopReader(false),
+    m_bStopWriter(false),
+    m_bRunning(false),
+    m_bWriterWaiting(false),
+    m_bProducerWaiting(false),
+    m_hrWriter(S_OK),
+    m_hrReader(S_OK),
+    m_bFirstSample(FALSE),
+    m_llBaseTime(0),
+    m_nSequence(0),
+    m_bSeenDelta(FALSE),
+    m_bAwaitKeyFrame(TRUE),
+    m_bDecimating(FALSE),
+    m_cDecimated(0),
+    m_nWriterNext(0),
+    m_bWriterAwaitKey(TRUE),
+    m_cFrames(0),
+    m_cbWritten(0),
+    m_llLatencySum(0),
+    m_llLatencyMax(0),
+    m_cHighWater(0),
+    m_cOverflows(0),
+    m_cBatches(0),
+    m_cBatchLimit(1),
+    m_cAnalyzed(0),
+    m_cBlackFrames(0),
+    m_cFrozenFrames(0),
+    m_cOverexposedFrames(0),
+    m_llStartRequested(0),
+    m_llStartup(0),
+    m_llFirstFrame(0),
+    m_llDeviceLost(0),
+    m_llTimeOffset(0),
+    m_llLastTimestamp(0),
+    m_bHasTimestamp(FALSE),
+    m_cDeviceLosses(0),
+    m_cRecoveries(0),
+    m_llLastRecovery(0),
+    m_llMaxRecovery(0)
+{
+    m_format = VideoFormat();
+    m_outputFormat = VideoFormat();
+    m_workStats = FrameStats();
+    m_lastStats = FrameStats();
+
+    for (UINT32 i = 0; i < MAX_WRITE_BATCH; i++)
+    {
+        m_pBatch[i] = nullptr;
+        m_batchFrames[i] = CaptureFrame();
+    }
+}
+
+CFramePipeline::~CFramePipeline()
+{
+    Stop();
+
+    if (m_pPool)
+    {
+        m_pPool->Release();
+        m_pPool = nullptr;
+    }
+
+    if (m_pOutputPool)
+    {
+        m_pOutputPool->Release();
+        m_pOutputPool = nullptr;
+    }
+}
+
+// 拉模式：协商格式、打开接收器并启动读取线程和写入线程
+HRESULT CFramePipeline::Start(ICaptureSource* pSource, const VideoFormat& requested, IFrameSink* pSink)
+{
+    if (pSource == nullptr || pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_writer.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    VideoFormat format;
+    HRESULT hr = pSource->Open();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSource->NegotiateFormat(requested, &format);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = StartWriter(format, pSink);
+    }
+
+    if (FAILED(hr))
+    {
+        pSource->Close();
+        return hr;
+    }
+
+    m_pSource = pSource;
+    m_bFirstSample = TRUE;
+    m_llBaseTime = 0;
+    m_hrReader = S_OK;
+    m_bStopReader = false;
+
+    m_reader = std::thread(&CFramePipeline::ReaderThread, this);
+    return S_OK;
+}
+
+// 推模式：打开接收器并启动写入线程
+HRESULT CFramePipeline::Start(const VideoFormat& format, IFrameSink* pSink)
+{
+    if (pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_writer.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    return StartWriter(format, pSink);
+}
+
+// 分配队列和缓冲池、打开接收器并启动写入线程
+// 缓冲池按帧大小和像素格式区分，与上一次启动的格式相同时直接复用
+// 需要转换时另建一个输出缓冲池，写入线程每次只转换一帧，余量留给接收器暂时持有的帧
+// 接收器在 WriteFrame 返回之后还持有的缓冲区（SetSinkBuffers）和写入线程攒批持有的缓冲区加在交给接收器的那个缓冲池上
+HRESULT CFramePipeline::StartWriter(const VideoFormat& format, IFrameSink* pSink)
+{
+    HRESULT hr = m_queue.Initialize(m_cQueueDepth);
+    UINT32 cBuffers = m_queue.Capacity() + DEFAULT_POOL_SLACK;
+    UINT32 cOutputBuffers = DEFAULT_POOL_SLACK + m_cSinkBuffers + m_cMaxBatch - 1;
+    VideoFormat output = format;
+    BOOL bConvert = (m_outputSubtype != 0 && m_outputSubtype != format.subtype);
+
+    if (bConvert)
+    {
+        output.subtype = m_outputSubtype;
+    }
+    else
+    {
+        cBuffers += m_cSinkBuffers + m_cMaxBatch - 1;
+    }
+
+    if (SUCCEEDED(hr) && m_pPool && (!m_pPool->Matches(format) || m_pPool->Count() < cBuffers))
+    {
+        m_pPool->Release();
+        m_pPool = nullptr;
+    }
+
+    if (SUCCEEDED(hr) && m_pPool == nullptr)
+    {
+        hr = CFramePool::CreateInstance(format, cBuffers, &m_pPool);
+    }
+
+    if (SUCCEEDED(hr) && bConvert)
+    {
+        hr = m_converter.Initialize(format, m_outputSubtype);
+    }
+
+    if (SUCCEEDED(hr) && m_analysisFrameStride != 0)
+    {
+        hr = m_analyzer.Initialize(format);
+        m_analyzer.SetSampling(m_analysisFrameStride, m_analysisRowStride);
+    }
+
+    if (SUCCEEDED(hr) && m_pOutputPool && (!bConvert || !m_pOutputPool->Matches(output) ||
+        m_pOutputPool->Count() < cOutputBuffers))
+    {
+        m_pOutputPool->Release();
+        m_pOutputPool = nullptr;
+    }
+
+    if (SUCCEEDED(hr) && bConvert && m_pOutputPool == nullptr)
+    {
+        hr = CFramePool::CreateInstance(output, cOutputBuffers, &m_pOutputPool);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSink->BeginWriting(output);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_format = format;
+    m_outputFormat = output;
+    m_bConvert = bConvert;
+
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_bHasStats = FALSE;
+    }
+    m_latency.Reset();
+    m_drops.Reset();
+    m_pSink = pSink;
+    m_nSequence = 0;
+    m_bSeenDelta = FALSE;
+    m_bAwaitKeyFrame = TRUE;
+    m_bDecimating = FALSE;
+    m_cDecimated = 0;
+    m_nWriterNext = 0;
+    m_bWriterAwaitKey = TRUE;
+    m_hrWriter = S_OK;
+    m_cFrames = 0;
+    m_cbWritten = 0;
+    m_llLatencySum = 0;
+    m_llLatencyMax = 0;
+    m_cHighWater = 0;
+    m_cOverflows = 0;
+    m_cBatches = 0;
+    m_cBatchLimit = m_cMaxBatch;
+    m_cAnalyzed = 0;
+    m_cBlackFrames = 0;
+    m_cFrozenFrames = 0;
+    m_cOverexposedFrames = 0;
+    m_bStopWriter = false;
+    m_bRunning = true;
+    m_tStart = steady_clock::now();
+    m_tEnd = m_tStart;
+    m_llStartup = m_llStartRequested ? m_llStartRequested : GetClockTime();
+    m_llStartRequested = 0;
+    m_llFirstFrame = 0;
+    m_llDeviceLost = 0;
+    m_llTimeOffset = 0;
+    m_llLastTimestamp = 0;
+    m_bHasTimestamp = FALSE;
+    m_cDeviceLosses = 0;
+    m_cRecoveries = 0;
+    m_llLastRecovery = 0;
+    m_llMaxRecovery = 0;
+
+    m_writer = std::thread(&CFramePipeline::WriterThread, this);
+    return S_OK;
+}
+
+// 停止读取线程，等写入线程写完队列中剩余的帧，再关闭数据源并结束接收器
+HRESULT CFramePipeline::Stop()
+{
+    if (!m_writer.joinable())
+    {
+        return S_OK;
+    }
+
+    if (m_reader.joinable())
+    {
+        m_bStopReader = true;
+        m_reader.join();
+    }
+
+    m_bRunning = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopWriter = true;
+        m_cvFrame.notify_one();
+    }
+    m_writer.join();
+
+    if (m_pSource)
+    {
+        m_pSource->Close();
+    }
+
+    HRESULT hr = m_pSink->Finalize();
+
+    m_pSource = nullptr;
+    m_pSink = nullptr;
+    m_tEnd = steady_clock::now();
+
+    if (FAILED(m_hrReader))
+    {
+        return m_hrReader;
+    }
+    if (FAILED(m_hrWriter.load()))
+    {
+        return m_hrWriter.load();
+    }
+    return hr;
+}
+
+// 等待数据源结束且队列写空
+void CFramePipeline::Wait()
+{
+    while (m_bRunning.load() || (m_queue.Size() > 0 && SUCCEEDED(m_hrWriter.load())))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// 获取统计信息
+void CFramePipeline::GetStats(PipelineStats* pStats) const
+{
+    steady_clock::time_point tEnd = m_writer.joinable() ? steady_clock::now() : m_tEnd;
+
+    pStats->cFrames = m_cFrames.load();
+    pStats->cbWritten = m_cbWritten.load();
+    pStats->fElapsed = std::chrono::duration<double>(tEnd - m_tStart).count();
+    pStats->fFps = pStats->fElapsed > 0 ? pStats->cFrames / pStats->fElapsed : 0;
+    pStats->fAvgLatencyMs = pStats->cFrames ? m_llLatencySum.load() / 1e6 / pStats->cFrames : 0;
+    pStats->fMaxLatencyMs = m_llLatencyMax.load() / 1e6;
+    pStats->cQueueCapacity = m_queue.Capacity();
+    pStats->cQueueDepth = m_queue.Size();
+    pStats->cQueueHighWater = m_cHighWater.load();
+    pStats->cOverflows = m_cOverflows.load();
+    pStats->cPoolBuffers = m_pPool ? m_pPool->Count() : 0;
+    pStats->cPoolFree = m_pPool ? m_pPool->FreeCount() : 0;
+    pStats->cAnalyzed = m_cAnalyzed.load();
+    pStats->cBlackFrames = m_cBlackFrames.load();
+    pStats->cFrozenFrames = m_cFrozenFrames.load();
+    pStats->cOverexposedFrames = m_cOverexposedFrames.load();
+
+    LONGLONG llFirstFrame = m_llFirstFrame.load(std::memory_order_relaxed);
+    pStats->fFirstFrameMs = llFirstFrame ? (llFirstFrame - m_llStartup) / 1e4 : 0;
+    pStats->cDeviceLosses = m_cDeviceLosses.load();
+    pStats->cRecoveries = m_cRecoveries.load();
+    pStats->fLastRecoveryMs = m_llLastRecovery.load() / 1e4;
+    pStats->fMaxRecoveryMs = m_llMaxRecovery.load() / 1e4;
+    pStats->bDeviceLost = m_llDeviceLost.load() != 0;
+    pStats->cBatches = m_cBatches.load();
+    pStats->cBatchLimit = m_cBatchLimit.load();
+}
+
+// 启用逐帧亮度统计
+void CFramePipeline::SetAnalysis(UINT32 frameStride, UINT32 rowStride)
+{
+    m_analysisFrameStride = frameStride;
+    m_analysisRowStride = rowStride ? rowStride : 1;
+}
+
+// 设置过载策略
+void CFramePipeline::SetOverloadPolicy(OverloadPolicy policy, UINT32 value)
+{
+    m_overloadPolicy = policy;
+
+    if (policy == OverloadPolicy_Decimate)
+    {
+        m_decimation = value ? value : DEFAULT_DECIMATION;
+    }
+    else if (policy == OverloadPolicy_Block)
+    {
+        m_llBlockTimeout = (LONGLONG)(value ? value : DEFAULT_BLOCK_TIMEOUT_MS) * (HNS_PER_SECOND / 1000);
+    }
+}
+
+// 设置批量写出
+void CFramePipeline::SetWriteBatch(UINT32 cMaxFrames, UINT32 lingerUs, UINT32 maxLatencyUs)
+{
+    m_cMaxBatch = cMaxFrames == 0 ? 1 : (cMaxFrames > MAX_WRITE_BATCH ? MAX_WRITE_BATCH : cMaxFrames);
+    m_llBatchLinger = (LONGLONG)lingerUs * 10;
+    m_llBatchLatency = (LONGLONG)maxLatencyUs * 10;
+}
+
+// 获取最近一个分析帧的统计
+HRESULT CFramePipeline::GetFrameStats(FrameStats* pStats) const
+{
+    if (pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+
+    if (!m_bHasStats)
+    {
+        return S_FALSE;
+    }
+
+    *pStats = m_lastStats;
+    return S_OK;
+}
+
+// 从缓冲池获取一块空闲缓冲区
+HRESULT CFramePipeline::AcquireBuffer(CFrameBuffer** ppBuffer)
+{
+    if (m_pPool == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+    return m_pPool->Acquire(ppBuffer);
+}
+
+// 记下设备丢失的时刻，已处于丢失状态时保留第一次的时刻
+void CFramePipeline::MarkDeviceLost()
+{
+    LONGLONG llExpected = 0;
+
+    if (m_llDeviceLost.compare_exchange_strong(llExpected, GetClockTime()))
+    {
+        m_cDeviceLosses++;
+    }
+}
+
+// 新设备的时间戳从任意值开始，恢复后的第一帧按丢失前最后一帧重新计算偏移；
+// 压缩输入要等到关键帧才能接着写，否则解码器会引用丢失前的帧
+LONGLONG CFramePipeline::RebaseTimestamp(LONGLONG llTimestamp)
+{
+    if (m_llDeviceLost.load(std::memory_order_relaxed) != 0)
+    {
+        LONGLONG llLost = m_llDeviceLost.exchange(0);
+        LONGLONG llRecovery = GetClockTime() - llLost;
+        LONGLONG llDuration = GetFrameDuration(m_format);
+
+        if (m_bHasTimestamp)
+        {
+            m_llTimeOffset = m_llLastTimestamp + (llDuration ? llDuration : 1) - llTimestamp;
+        }
+        if (m_bSeenDelta)
+        {
+            m_bAwaitKeyFrame = TRUE;
+        }
+
+        m_llLastRecovery = llRecovery;
+        if (llRecovery > m_llMaxRecovery.load())
+        {
+            m_llMaxRecovery = llRecovery;
+        }
+        m_cRecoveries++;
+    }
+
+    m_llLastTimestamp = llTimestamp + m_llTimeOffset;
+    m_bHasTimestamp = TRUE;
+    return m_llLastTimestamp;
+}
+
+// 把一帧放入队列：池中的缓冲区直接入队，其他内存先拷贝到池中的缓冲区
+HRESULT CFramePipeline::PushFrame(const CaptureFrame& frame)
+{
+    LONGLONG llStart = GetLatencyClock();
+    LONGLONG llDeadline = GetBlockDeadline();
+    HRESULT hr = m_hrWriter.load(std::memory_order_relaxed);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (m_pPool == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    CaptureFrame arrived = frame;
+    arrived.llTimestamp = RebaseTimestamp(frame.llTimestamp);
+    arrived.nSequence = NextSequence();
+
+    if (!AdmitFrame(arrived))
+    {
+        return S_FALSE;
+    }
+
+    CFrameBuffer* pBuffer = frame.pBuffer;
+
+    if (pBuffer && pBuffer->GetData() == frame.pData && pBuffer->GetCapacity() >= frame.cbData)
+    {
+        pBuffer->AddRef();
+    }
+    else
+    {
+        pBuffer = nullptr;
+    }
+
+    hr = SubmitFrame(arrived, pBuffer, llDeadline);
+
+    if (hr == S_OK)
+    {
+        m_latency.Record(LatencyStage_Enqueue, GetLatencyClock() - llStart);
+    }
+
+    return hr;
+}
+
+// 压缩输入丢帧后，之后的非关键帧都无法解码，直接丢弃到下一个关键帧
+// 抽帧在队列深度超过 3/4 时开始、回落到 1/4 以下时结束，避免在阈值附近来回切换；
+// 压缩输入只能丢非关键帧，未压缩输入每 m_decimation 帧保留一帧
+BOOL CFramePipeline::AdmitFrame(const CaptureFrame& frame)
+{
+    BOOL bDelta = (frame.flags & FrameFlag_Delta) != 0;
+
+    if (!bDelta)
+    {
+        m_bAwaitKeyFrame = FALSE;
+    }
+    else
+    {
+        m_bSeenDelta = TRUE;
+
+        if (m_bAwaitKeyFrame)
+        {
+            DropNewFrame(DropReason_Dependent, frame);
+            return FALSE;
+        }
+    }
+
+    if (m_overloadPolicy == OverloadPolicy_Decimate)
+    {
+        UINT32 cDepth = m_queue.Size();
+        UINT32 cCapacity = m_queue.Capacity();
+
+        if (!m_bDecimating && cDepth * 4 >= cCapacity * 3)
+        {
+            m_bDecimating = TRUE;
+            m_cDecimated = 0;
+        }
+        else if (m_bDecimating && cDepth * 4 <= cCapacity)
+        {
+            m_bDecimating = FALSE;
+        }
+
+        if (m_bDecimating && (m_bSeenDelta ? bDelta : (++m_cDecimated % m_decimation) != 0))
+        {
+            DropNewFrame(DropReason_Decimated, frame);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// 给缓冲区写入帧信息和到达时刻后入队并唤醒写入线程；pBuffer 不为空时已装有该帧数据，其引用转交给本函数
+HRESULT CFramePipeline::SubmitFrame(const CaptureFrame& frame, CFrameBuffer* pBuffer, LONGLONG llDeadline)
+{
+    BOOL bKeyFrame = m_bSeenDelta && !(frame.flags & FrameFlag_Delta);
+
+    if (pBuffer == nullptr)
+    {
+        HRESULT hr = m_pPool->Acquire(&pBuffer);
+
+        while (hr == S_FALSE && MakeRoom(TRUE, bKeyFrame, llDeadline))
+        {
+            hr = m_pPool->Acquire(&pBuffer);
+        }
+
+        if (hr != S_OK || pBuffer->GetCapacity() < frame.cbData)
+        {
+            if (pBuffer)
+            {
+                pBuffer->Release();
+            }
+            DropNewFrame(llDeadline != 0 ? DropReason_Timeout : DropReason_PoolEmpty, frame);
+            return S_FALSE;
+        }
+
+        memcpy(pBuffer->GetData(), frame.pData, frame.cbData);
+    }
+
+    CaptureFrame& queued = pBuffer->Frame();
+    queued.cbData = frame.cbData;
+    queued.flags = frame.flags;
+    queued.llTimestamp = frame.llTimestamp;
+    queued.nSequence = frame.nSequence;
+    queued.llArrival = GetClockTime();
+
+    BOOL bQueued = m_queue.TryPush(pBuffer);
+
+    while (!bQueued && MakeRoom(FALSE, bKeyFrame, llDeadline))
+    {
+        bQueued = m_queue.TryPush(pBuffer);
+    }
+
+    if (!bQueued)
+    {
+        DropNewFrame(llDeadline != 0 ? DropReason_Timeout : DropReason_QueueFull, queued);
+        pBuffer->Release();
+        return S_FALSE;
+    }
+
+    UINT32 cDepth = m_queue.Size();
+    if (cDepth > m_cHighWater.load(std::memory_order_relaxed))
+    {
+        m_cHighWater.store(cDepth, std::memory_order_relaxed);
+    }
+
+    // 与 WaitForFrame 中先置等待标志再检查队列的顺序配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_bWriterWaiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cvFrame.notify_one();
+    }
+
+    return S_OK;
+}
+
+// DropOldest 挤掉最旧的帧，Block 等待到 llDeadline；压缩输入的关键帧在等不到空间时也挤掉最旧的帧，
+// 因为丢弃关键帧会连带丢掉整个 GOP
+BOOL CFramePipeline::MakeRoom(BOOL bBuffer, BOOL bKeyFrame, LONGLONG llDeadline)
+{
+    if (m_overloadPolicy == OverloadPolicy_DropOldest)
+    {
+        return EvictOldest();
+    }
+    if (llDeadline != 0 && WaitForSpace(bBuffer, llDeadline))
+    {
+        return TRUE;
+    }
+    return bKeyFrame && EvictOldest();
+}
+
+// 挤掉队首的帧，释放后其缓冲区回到缓冲池；写入线程会从序号的缺口发现丢帧
+BOOL CFramePipeline::EvictOldest()
+{
+    CFrameBuffer* pOldest = nullptr;
+
+    if (!m_queue.TryEvict(&pOldest))
+    {
+        return FALSE;
+    }
+
+    DropFrame(DropReason_Evicted, pOldest->Frame());
+    pOldest->Release();
+    return TRUE;
+}
+
+// 先置等待标志再检查空间，与 NotifyProducer 配对；每次最多等 c_producerWaitSlice 后重新检查
+BOOL CFramePipeline::WaitForSpace(BOOL bBuffer, LONGLONG llDeadline)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    BOOL bSpace = FALSE;
+
+    m_bProducerWaiting.store(true, std::memory_order_seq_cst);
+
+    for (;;)
+    {
+        bSpace = bBuffer ? (m_pPool->FreeCount() > 0) : (m_queue.Size() < m_queue.Capacity());
+
+        LONGLONG llRemaining = llDeadline - GetClockTime();
+
+        if (bSpace || llRemaining <= 0 || m_bStopReader.load() || m_bStopWriter.load() || FAILED(m_hrWriter.load()))
+        {
+            break;
+        }
+
+        m_cvSpace.wait_for(lock, std::chrono::duration<LONGLONG, std::ratio<1, HNS_PER_SECOND>>(
+            llRemaining < c_producerWaitSlice ? llRemaining : c_producerWaitSlice));
+    }
+
+    m_bProducerWaiting.store(false, std::memory_order_relaxed);
+    return bSpace;
+}
+
+// 只有 OverloadPolicy_Block 下生产者会等待
+void CFramePipeline::NotifyProducer()
+{
+    if (m_overloadPolicy != OverloadPolicy_Block)
+    {
+        return;
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_bProducerWaiting.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cvSpace.notify_one();
+    }
+}
+
+// 丢弃新到的帧
+void CFramePipeline::DropNewFrame(DropReason reason, const CaptureFrame& frame)
+{
+    if (m_bSeenDelta)
+    {
+        m_bAwaitKeyFrame = TRUE;
+    }
+
+    DropFrame(reason, frame);
+}
+
+// 计数并记录一次丢帧
+void CFramePipeline::DropFrame(DropReason reason, const CaptureFrame& frame)
+{
+    m_cOverflows.fetch_add(1, std::memory_order_relaxed);
+    m_drops.Record(reason, frame);
+}
+
+// 读取线程：逐帧读取、校正时间戳后入队，直到停止或数据源结束
+void CFramePipeline::ReaderThread()
+{
+    HRESULT hr = S_OK;
+
+    if (m_readerCore != NO_CPU_AFFINITY)
+    {
+        PinCurrentThread((UINT32)m_readerCore);
+    }
+
+    while (!m_bStopReader.load())
+    {
+        CFrameBuffer* pBuffer = nullptr;
+        CaptureFrame frame = CaptureFrame();
+        LONGLONG llDeadline = GetBlockDeadline();
+
+        // 直接读入池中的缓冲区；池空（写出跟不上）时先按策略腾出空间，仍然没有时读到数据源自己的内存，再按策略处理
+        hr = m_pPool->Acquire(&pBuffer);
+
+        while (hr == S_FALSE && MakeRoom(TRUE, FALSE, llDeadline))
+        {
+            hr = m_pPool->Acquire(&pBuffer);
+        }
+
+        if (pBuffer)
+        {
+            hr = m_pSource->ReadFrameInto(pBuffer->GetData(), pBuffer->GetCapacity(), &frame);
+        }
+        else
+        {
+            hr = m_pSource->ReadFrame(&frame);
+        }
+
+        if (hr == S_FALSE || FAILED(hr))
+        {
+            if (pBuffer)
+            {
+                pBuffer->Release();
+            }
+            break;
+        }
+
+        // 数据源的时间戳与 GetClockTime 同一时钟时，两者之差就是设备到读取线程的延迟
+        LONGLONG llReady = GetLatencyClock();
+        m_latency.Record(LatencyStage_Device, llReady - frame.llTimestamp * 100);
+
+        if (m_bFirstSample)
+        {
+            m_llBaseTime = frame.llTimestamp;
+            m_bFirstSample = FALSE;
+        }
+
+        // rebase the time stamp
+        frame.llTimestamp -= m_llBaseTime;
+        frame.nSequence = NextSequence();
+
+        if (AdmitFrame(frame))
+        {
+            hr = SubmitFrame(frame, pBuffer, llDeadline);
+
+            if (hr == S_OK)
+            {
+                m_latency.Record(LatencyStage_Enqueue, GetLatencyClock() - llReady);
+            }
+        }
+        else if (pBuffer)
+        {
+            pBuffer->Release();
+        }
+
+        if (FAILED(hr = m_hrWriter.load()))
+        {
+            break;
+        }
+    }
+
+    m_hrReader = FAILED(hr) ? hr : S_OK;
+    m_bRunning = false;
+}
+
+// 写入线程：从队列中取帧，攒成一批（逐帧写出时每批一帧）交给接收器，收到停止请求后先把队列和攒下的帧写完再退出
+void CFramePipeline::WriterThread()
+{
+    if (m_writerCore != NO_CPU_AFFINITY)
+    {
+        PinCurrentThread((UINT32)m_writerCore);
+    }
+
+    UINT32 cBatch = 0;
+    LONGLONG llLinger = 0;
+
+    for (;;)
+    {
+        CFrameBuffer* pBuffer = nullptr;
+
+        if (!m_queue.TryPop(&pBuffer))
+        {
+            // 队列已空：凑批的时间到了或要停止时写出攒下的帧，否则等新帧到来
+            if (cBatch > 0 && (m_bStopWriter.load() || GetClockTime() >= llLinger))
+            {
+                HRESULT hr = WriteBatch(cBatch);
+
+                cBatch = 0;
+                if (FAILED(hr))
+                {
+                    break;
+                }
+                continue;
+            }
+
+            if (m_bStopWriter.load())
+            {
+                if (m_queue.IsEmpty())
+                {
+                    break;
+                }
+                continue;
+            }
+
+            WaitForFrame(cBatch > 0 ? llLinger : 0);
+            continue;
+        }
+
+        NotifyProducer();
+
+        LONGLONG llDequeued = GetLatencyClock();
+        const CaptureFrame& input = pBuffer->Frame();
+        m_latency.Record(LatencyStage_Queue, llDequeued - input.llArrival * 100);
+
+        // 序号不连续说明之前有帧被丢弃或挤出队列，压缩输入之后的非关键帧要丢到下一个关键帧
+        if (input.nSequence != m_nWriterNext)
+        {
+            m_bWriterAwaitKey = TRUE;
+        }
+        m_nWriterNext = input.nSequence + 1;
+
+        if (!(input.flags & FrameFlag_Delta))
+        {
+            m_bWriterAwaitKey = FALSE;
+        }
+        else if (m_bWriterAwaitKey)
+        {
+            DropFrame(DropReason_Dependent, input);
+            pBuffer->Release();
+            NotifyProducer();
+            continue;
+        }
+
+        if (m_analysisFrameStride != 0)
+        {
+            AnalyzeFrame(pBuffer->Frame());
+        }
+
+        if (m_bConvert)
+        {
+            CFrameBuffer* pOutput = nullptr;
+            LONGLONG llConvert = GetLatencyClock();
+            HRESULT hrConvert = ConvertFrame(pBuffer, &pOutput);
+
+            m_latency.Record(LatencyStage_Convert, GetLatencyClock() - llConvert);
+
+            if (hrConvert == S_FALSE)
+            {
+                // 接收器仍持有全部输出缓冲区，丢弃这一帧
+                m_bWriterAwaitKey = TRUE;
+                DropFrame(DropReason_OutputFull, input);
+            }
+
+            pBuffer->Release();
+            NotifyProducer();
+
+            if (FAILED(hrConvert))
+            {
+                m_hrWriter = hrConvert;
+                break;
+            }
+            if (hrConvert == S_FALSE)
+            {
+                continue;
+            }
+
+            pBuffer = pOutput;
+        }
+
+        m_pBatch[cBatch] = pBuffer;
+        m_batchFrames[cBatch] = pBuffer->Frame();
+        cBatch++;
+
+        // 凑批最多等 m_llBatchLinger，也不让最早入队的帧因凑批等待超过延迟上限的一半
+        if (cBatch == 1)
+        {
+            llLinger = GetClockTime() + m_llBatchLinger;
+
+            if (m_llBatchLatency > 0 && llLinger > m_batchFrames[0].llArrival + m_llBatchLatency / 2)
+            {
+                llLinger = m_batchFrames[0].llArrival + m_llBatchLatency / 2;
+            }
+        }
+
+        if (cBatch >= m_cBatchLimit.load(std::memory_order_relaxed))
+        {
+            HRESULT hr = WriteBatch(cBatch);
+
+            cBatch = 0;
+            if (FAILED(hr))
+            {
+                break;
+            }
+        }
+    }
+
+    // 转换出错退出时攒下的帧不再写出
+    for (UINT32 i = 0; i < cBatch; i++)
+    {
+        m_pBatch[i]->Release();
+        m_pBatch[i] = nullptr;
+    }
+    NotifyProducer();
+}
+
+// 一批只有一帧时直接调用 WriteFrame，与不攒批时完全相同；写出阶段的耗时按帧平摊，每帧记录一次
+HRESULT CFramePipeline::WriteBatch(UINT32 cFrames)
+{
+    LONGLONG llWrite = GetLatencyClock();
+
+    HRESULT hr = (cFrames == 1) ? m_pSink->WriteFrame(m_batchFrames[0]) : m_pSink->WriteFrames(m_batchFrames, cFrames);
+
+    LONGLONG llNow = GetClockTime();
+    LONGLONG llSink = (GetLatencyClock() - llWrite) / cFrames;
+    LONGLONG llOldest = 0;
+
+    for (UINT32 i = 0; i < cFrames; i++)
+    {
+        const CaptureFrame& frame = m_batchFrames[i];
+        LONGLONG llLatency = (llNow - frame.llArrival) * 100;
+
+        m_latency.Record(LatencyStage_Sink, llSink);
+        m_latency.Record(LatencyStage_Total, llLatency);
+
+        if (SUCCEEDED(hr))
+        {
+            m_cFrames.fetch_add(1, std::memory_order_relaxed);
+            m_cbWritten.fetch_add(frame.cbData, std::memory_order_relaxed);
+            m_llLatencySum.fetch_add(llLatency, std::memory_order_relaxed);
+
+            if (llLatency > m_llLatencyMax.load(std::memory_order_relaxed))
+            {
+                m_llLatencyMax.store(llLatency, std::memory_order_relaxed);
+            }
+        }
+
+        llOldest = llLatency > llOldest ? llLatency : llOldest;
+        m_pBatch[i]->Release();
+        m_pBatch[i] = nullptr;
+    }
+
+    NotifyProducer();
+
+    if (FAILED(hr))
+    {
+        m_hrWriter = hr;
+        return hr;
+    }
+
+    m_cBatches.fetch_add(1, std::memory_order_relaxed);
+
+    // 加性增、乘性减：超过延迟上限时批量减半，凑满一批且延迟不到上限的一半时加一
+    UINT32 cLimit = m_cBatchLimit.load(std::memory_order_relaxed);
+    LONGLONG llBound = m_llBatchLatency * 100;
+
+    if (llBound > 0 && llOldest > llBound && cLimit > 1)
+    {
+        m_cBatchLimit.store(cLimit / 2, std::memory_order_relaxed);
+    }
+    else if (cFrames >= cLimit && cLimit < m_cMaxBatch && (llBound == 0 || llOldest * 2 < llBound))
+    {
+        m_cBatchLimit.store(cLimit + 1, std::memory_order_relaxed);
+    }
+
+    return S_OK;
+}
+
+// 把一帧转换到输出缓冲池中的缓冲区，时间戳、序号和到达时刻随帧带过去
+HRESULT CFramePipeline::ConvertFrame(CFrameBuffer* pInput, CFrameBuffer** ppOutput)
+{
+    CFrameBuffer* pOutput = nullptr;
+    HRESULT hr = m_pOutputPool->Acquire(&pOutput);
+
+    if (hr != S_OK)
+    {
+        *ppOutput = nullptr;
+        return hr;
+    }
+
+    hr = m_converter.Convert(pInput->GetData(), pOutput->GetData());
+
+    if (FAILED(hr))
+    {
+        pOutput->Release();
+        *ppOutput = nullptr;
+        return hr;
+    }
+
+    const CaptureFrame& input = pInput->Frame();
+    CaptureFrame& output = pOutput->Frame();
+
+    output.cbData = GetFrameSize(m_outputFormat);
+    output.flags = input.flags;
+    output.llTimestamp = input.llTimestamp;
+    output.nSequence = input.nSequence;
+    output.llArrival = input.llArrival;
+
+    *ppOutput = pOutput;
+    return S_OK;
+}
+
+// 按采样间隔分析一帧：统计在写入线程自己的 m_workStats 中计算，完成后在锁内拷贝给读取方
+void CFramePipeline::AnalyzeFrame(const CaptureFrame& frame)
+{
+    if (m_analyzer.Analyze(frame, &m_workStats) != S_OK)
+    {
+        return;
+    }
+
+    m_cAnalyzed.fetch_add(1, std::memory_order_relaxed);
+
+    if (m_workStats.flags & FrameHealth_Black)
+    {
+        m_cBlackFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (m_workStats.flags & FrameHealth_Frozen)
+    {
+        m_cFrozenFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (m_workStats.flags & FrameHealth_Overexposed)
+    {
+        m_cOverexposedFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_lastStats = m_workStats;
+    m_bHasStats = TRUE;
+}
+
+// 队列为空时等待生产者唤醒；凑批时最多等到凑批的截止时刻
+void CFramePipeline::WaitForFrame(LONGLONG llDeadline)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_bWriterWaiting.store(true, std::memory_order_seq_cst);
+
+    if (m_queue.Size() == 0 && !m_bStopWriter.load())
+    {
+        std::chrono::microseconds wait = c_writerIdleWait;
+
+        if (llDeadline != 0)
+        {
+            LONGLONG llRemaining = llDeadline - GetClockTime();
+            wait = std::chrono::microseconds(llRemaining > 0 ? llRemaining / 10 : 0);
+            wait = wait < c_writerIdleWait ? wait : std::chrono::microseconds(c_writerIdleWait);
+        }
+
+        m_cvFrame.wait_for(lock, wait);
+    }
+
+    m_bWriterWaiting.store(false, std::memory_order_relaxed);
+}
+
+// 为 count 路流水线中的第 index 路分配逻辑核
+void AssignPipelineCores(UINT32 index, UINT32 count, INT32* pReaderCore, INT32* pWriterCore)
+{
+    UINT32 cCores = std::thread::hardware_concurrency();
+
+    *pReaderCore = NO_CPU_AFFINITY;
+    *pWriterCore = NO_CPU_AFFINITY;
+
+    if (cCores < 2 || count == 0)
+    {
+        return;
+    }
+
+    if (cCores >= count * 2)
+    {
+        *pReaderCore = (INT32)(index * 2);
+        *pWriterCore = (INT32)(index * 2 + 1);
+    }
+    else
+    {
+        *pWriterCore = (INT32)(index % cCores);
+    }
+}
@@ -0,0 +1,321 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "source.h"
+#include "sink.h"
+#include "framequeue.h"
+#include "framepool.h"
+#include "convert.h"
+#include "framestats.h"
+#include "latency.h"
+#include "overload.h"
+
+// 默认的帧队列深度
+const UINT32 DEFAULT_QUEUE_DEPTH = 8;
+
+// 缓冲池中队列容量之外的余量：正在采集的帧、正在写出的帧以及接收器暂时持有的帧
+const UINT32 DEFAULT_POOL_SLACK = 4;
+
+// 不绑定逻辑核
+const INT32 NO_CPU_AFFINITY = -1;
+
+// 批量写出的帧数上限，以及默认的批量写出延迟上限（微秒）
+const UINT32 MAX_WRITE_BATCH = 64;
+const UINT32 DEFAULT_BATCH_LATENCY_US = 50000;
+
+// PipelineStats 结构体保存流水线的运行统计
+struct PipelineStats
+{
+    UINT64  cFrames;            // 已写出的帧数
+    UINT64  cbWritten;          // 已写出的字节数
+    double  fElapsed;           // 运行时长（秒）
+    double  fFps;               // 平均帧率
+    double  fAvgLatencyMs;      // 从入队到写完的平均延迟（毫秒）
+    double  fMaxLatencyMs;      // 最大延迟（毫秒）
+    UINT32  cQueueCapacity;     // 队列容量
+    UINT32  cQueueDepth;        // 当前队列深度
+    UINT32  cQueueHighWater;    // 队列深度的峰值
+    UINT64  cOverflows;         // 丢弃的总帧数（各原因之和，分原因的统计见 GetDropStats）
+    UINT32  cPoolBuffers;       // 缓冲池中的缓冲区数
+    UINT32  cPoolFree;          // 缓冲池中空闲的缓冲区数
+    UINT64  cAnalyzed;          // 已分析的帧数
+    UINT64  cBlackFrames;       // 判定为全黑的帧数
+    UINT64  cFrozenFrames;      // 判定为冻结的帧数
+    UINT64  cOverexposedFrames; // 判定为过曝的帧数
+    double  fFirstFrameMs;      // 从启动（或 SetStartTime 设定的时刻）到第一帧到达的时长（毫秒），尚未收到帧时为 0
+    UINT32  cDeviceLosses;      // 设备丢失的次数（MarkDeviceLost）
+    UINT32  cRecoveries;        // 设备丢失后恢复送帧的次数
+    double  fLastRecoveryMs;    // 最近一次从设备丢失到恢复后第一帧到达的时长（毫秒）
+    double  fMaxRecoveryMs;     // 最长的一次恢复时长（毫秒）
+    BOOL    bDeviceLost;        // 设备是否仍处于丢失状态
+    UINT64  cBatches;           // 交给接收器的批数（逐帧写出时等于写出的帧数）
+    UINT32  cBatchLimit;        // 当前的批量上限，按写出延迟自动调整
+};
+
+// CFramePipeline 类把采集与写出解耦：采集侧只给帧打时间戳并放入无锁环形队列，
+// 独立的写入线程从队列中取帧交给 IFrameSink，编码或磁盘的停顿不会拖慢下一次采集
+// 帧数据存放在按协商格式创建的 CFramePool 中，稳态运行时不分配堆内存
+//
+// 两种使用方式：
+//   拉模式 Start(pSource, ...)：流水线自己的读取线程从 ICaptureSource 读帧
+//   推模式 Start(format, ...)：调用方（例如 CCapture::OnReadSample）调用 PushFrame 送帧
+// 设置了输出像素格式时，写入线程在交给接收器之前用 CFrameConverter 把帧转换到输出缓冲池中
+// 启用分析时，写入线程按采样间隔用 CFrameAnalyzer 统计采集到的帧，用于发现全黑、冻结或过曝的摄像头
+// 各阶段的耗时记录在 CLatencyRecorder 的直方图中（ENABLE_LATENCY_STATS 为 0 时不记录）
+// 写出跟不上时按 OverloadPolicy 丢帧或等待，每次丢帧都按原因计数并记录时刻；压缩输入（带 FrameFlag_Delta 的帧）
+// 丢帧后一直丢到下一个关键帧，关键帧本身不会因队列已满被丢弃，而是挤掉最旧的帧
+// 数据源和接收器由调用方持有，必须在 Stop 之后才能释放
+class CFramePipeline
+{
+public:
+    CFramePipeline();
+    ~CFramePipeline();
+
+    // 设置队列深度，在 Start 之前调用
+    void    SetQueueDepth(UINT32 cDepth) { m_cQueueDepth = cDepth; }
+
+    // 请求的队列深度
+    UINT32  GetQueueDepth() const { return m_cQueueDepth; }
+
+    // 设置交给接收器的像素格式，0 表示不转换，在 Start 之前调用
+    void    SetOutputSubtype(UINT32 subtype) { m_outputSubtype = subtype; }
+
+    // 把读取线程和写入线程绑定到指定的逻辑核，NO_CPU_AFFINITY 表示不绑定；在 Start 之前调用
+    void    SetCpuAffinity(INT32 readerCore, INT32 writerCore) { m_readerCore = readerCore; m_writerCore = writerCore; }
+
+    // 设置格式转换的行带数，0 表示按默认线程池的线程数，1 表示只在写入线程上转换；在 Start 之前调用
+    // 多路采集时各路设为 1，避免所有流水线争用同一个线程池
+    void    SetConversionBands(UINT32 cBands) { m_converter.SetBandCount(cBands); }
+
+    // 启用逐帧亮度统计：每 frameStride 帧分析一帧、每 rowStride 行取一行，frameStride 为 0 时关闭；在 Start 之前调用
+    void    SetAnalysis(UINT32 frameStride, UINT32 rowStride);
+
+    // 设置过载策略：value 对 OverloadPolicy_Decimate 为抽帧间隔 N，对 OverloadPolicy_Block 为最长等待毫秒数，
+    // 为 0 时取默认值，其他策略忽略；在 Start 之前调用
+    void    SetOverloadPolicy(OverloadPolicy policy, UINT32 value = 0);
+
+    // 当前的过载策略
+    OverloadPolicy GetOverloadPolicy() const { return m_overloadPolicy; }
+
+    // 设置接收器在 WriteFrame 返回之后继续持有（AddRef）的缓冲区数，例如 CFrameBus 的订阅者队列，
+    // 缓冲池按这个数目留出余量，避免采集线程因接收器持有缓冲区而取不到空闲缓冲区；在 Start 之前调用
+    void    SetSinkBuffers(UINT32 cBuffers) { m_cSinkBuffers = cBuffers; }
+
+    // 批量写出：写入线程每次从队列取最多 cMaxFrames 帧（不超过 MAX_WRITE_BATCH），用一次 IFrameSink::WriteFrames
+    // 交给接收器；队列里的帧不够一批时，第一帧取出后最多再等 lingerUs 微秒，0 表示只合并已经在排队的帧。
+    // 实际的批量上限从 cMaxFrames 开始按写出延迟调整：一批中最早入队的帧写完时超过 maxLatencyUs 则减半，
+    // 凑满一批且不到一半时加一，凑批等待也不会超过 maxLatencyUs 的一半；cMaxFrames 为 1（默认）时逐帧写出。
+    // 写入线程持有的整批帧不在队列中，缓冲池相应留出余量；在 Start 之前调用
+    void    SetWriteBatch(UINT32 cMaxFrames, UINT32 lingerUs = 0, UINT32 maxLatencyUs = DEFAULT_BATCH_LATENCY_US);
+
+    // 设置计算首帧时长的起点（GetClockTime），例如开始激活设备的时刻；只对下一次 Start 有效，
+    // 不设置时从 Start 开始计算
+    void    SetStartTime(LONGLONG llStart) { m_llStartRequested = llStart; }
+
+    // 拉模式：协商格式、打开接收器并启动读取线程和写入线程
+    HRESULT Start(ICaptureSource* pSource, const VideoFormat& requested, IFrameSink* pSink);
+
+    // 推模式：打开接收器并启动写入线程
+    HRESULT Start(const VideoFormat& format, IFrameSink* pSink);
+
+    // 把一帧放入队列，frame.llTimestamp 应已校正；放不下时按过载策略处理，该帧被丢弃时返回 S_FALSE
+    // （OverloadPolicy_Block 下会阻塞调用方，最长为设定的等待时长）
+    // frame.pBuffer 不为空时直接引用该缓冲区入队，否则先拷贝到池中的缓冲区
+    // 只能由一个线程调用（推模式下由调用方保证串行）
+    HRESULT PushFrame(const CaptureFrame& frame);
+
+    // 推模式：设备丢失，接收器和写入线程照常运行；之后 PushFrame 送来的第一帧视为恢复后的第一帧，
+    // 它的时间戳接在丢失前最后一帧之后一个帧间隔，之后的帧保持同样的偏移，写出的时间戳连续递增，
+    // 同时记录从丢失到这一帧的恢复时长；可以从任意线程调用，仍处于丢失状态时再次调用不重新计时
+    void    MarkDeviceLost();
+
+    // 从缓冲池获取一块空闲缓冲区，供推模式的调用方直接填充后用 PushFrame 入队；池空时返回 S_FALSE
+    HRESULT AcquireBuffer(CFrameBuffer** ppBuffer);
+
+    // 停止读取线程，等写入线程写完队列中剩余的帧，再关闭数据源并结束接收器
+    HRESULT Stop();
+
+    // 等待数据源结束且队列写空（拉模式下有限帧数的数据源）
+    void    Wait();
+
+    // 是否正在运行
+    BOOL    IsRunning() const { return m_bRunning.load(); }
+
+    // 写入线程的状态，写入失败后返回错误码
+    HRESULT GetStatus() const { return m_hrWriter.load(); }
+
+    // 协商后的格式
+    const VideoFormat& GetFormat() const { return m_format; }
+
+    // 交给接收器的格式，不转换时与协商后的格式相同
+    const VideoFormat& GetOutputFormat() const { return m_outputFormat; }
+
+    // 获取统计信息
+    void    GetStats(PipelineStats* pStats) const;
+
+    // 获取最近一个分析帧的统计，尚未分析任何帧时返回 S_FALSE
+    HRESULT GetFrameStats(FrameStats* pStats) const;
+
+    // 获取分原因的丢帧数、第一次和最近一次丢帧的时刻以及连续丢帧的秒数
+    void    GetDropStats(DropStats* pStats) const { m_drops.GetStats(pStats); }
+
+    // 按时间顺序拷贝最近的最多 cMax 条丢帧记录（最多 DROP_HISTORY_SIZE 条），返回条数
+    UINT32  GetDropEvents(DropEvent* pEvents, UINT32 cMax) const { return m_drops.GetEvents(pEvents, cMax); }
+
+    // 获取各阶段延迟的分位数，与 GetStats 配合得到帧率、丢帧数和写出字节数
+    void    GetLatency(LatencySnapshot* pSnapshot) const { m_latency.GetSnapshot(pSnapshot); }
+
+    // 记录流水线之外测量的阶段（推模式下调用方测量的 LatencyStage_Device、LatencyStage_Rearm），
+    // 同一阶段只能由一个线程记录
+    void    RecordLatency(LatencyStage stage, LONGLONG ns) { m_latency.Record(stage, ns); }
+
+private:
+    // 分配队列和缓冲池并启动写入线程
+    HRESULT StartWriter(const VideoFormat& format, IFrameSink* pSink);
+
+    // 生产者：按帧类型和抽帧状态决定是否接收一帧，不接收时计为丢帧
+    BOOL    AdmitFrame(const CaptureFrame& frame);
+
+    // 生产者：把已接收的帧放入队列，pBuffer 为空时先获取缓冲区并拷贝；放不下时按策略处理，丢弃时返回 S_FALSE
+    HRESULT SubmitFrame(const CaptureFrame& frame, CFrameBuffer* pBuffer, LONGLONG llDeadline);
+
+    // 生产者：缓冲区或队列槽位不够时按策略腾出空间，返回 FALSE 表示只能丢弃新帧
+    BOOL    MakeRoom(BOOL bBuffer, BOOL bKeyFrame, LONGLONG llDeadline);
+
+    // 生产者：挤掉队列中最旧的帧
+    BOOL    EvictOldest();
+
+    // 生产者：等待写入线程腾出缓冲区（bBuffer）或队列槽位，直到 llDeadline
+    BOOL    WaitForSpace(BOOL bBuffer, LONGLONG llDeadline);
+
+    // 写入线程：取走帧或释放缓冲区后唤醒等待空间的生产者
+    void    NotifyProducer();
+
+    // 生产者：OverloadPolicy_Block 下本帧最多等待到的时刻，其他策略为 0
+    LONGLONG GetBlockDeadline() const { return m_overloadPolicy == OverloadPolicy_Block ? GetClockTime() + m_llBlockTimeout : 0; }
+
+    // 生产者：分配到达帧的序号，第一帧同时记下到达时刻
+    UINT64  NextSequence()
+    {
+        if (m_nSequence == 0)
+        {
+            m_llFirstFrame.store(GetClockTime(), std::memory_order_relaxed);
+        }
+        return m_nSequence++;
+    }
+
+    // 生产者：设备恢复后的第一帧重新计算时间戳的偏移并记录恢复时长，返回校正后的时间戳
+    LONGLONG RebaseTimestamp(LONGLONG llTimestamp);
+
+    // 生产者：丢弃新到的帧；压缩输入之后的非关键帧也要丢弃，直到下一个关键帧
+    void    DropNewFrame(DropReason reason, const CaptureFrame& frame);
+
+    // 计数并记录一次丢帧
+    void    DropFrame(DropReason reason, const CaptureFrame& frame);
+
+    // 读取线程
+    void    ReaderThread();
+
+    // 写入线程
+    void    WriterThread();
+
+    // 写入线程在队列为空时等待，llDeadline（GetClockTime）不为 0 时最多等到该时刻
+    void    WaitForFrame(LONGLONG llDeadline = 0);
+
+    // 写入线程：把攒下的 cFrames 帧交给接收器，释放缓冲区，更新统计并按延迟调整批量上限
+    HRESULT WriteBatch(UINT32 cFrames);
+
+    // 把一帧转换到输出缓冲池中的缓冲区，输出池已空时返回 S_FALSE
+    HRESULT ConvertFrame(CFrameBuffer* pInput, CFrameBuffer** ppOutput);
+
+    // 按采样间隔分析一帧并发布结果
+    void    AnalyzeFrame(const CaptureFrame& frame);
+
+    ICaptureSource*         m_pSource;          // 数据源（推模式下为 nullptr）
+    IFrameSink*             m_pSink;            // 接收器
+    VideoFormat             m_format;           // 协商后的格式
+    UINT32                  m_cQueueDepth;      // 队列深度
+    INT32                   m_readerCore;       // 读取线程绑定的逻辑核
+    INT32                   m_writerCore;       // 写入线程绑定的逻辑核
+
+    CSpscRing<CFrameBuffer*> m_queue;           // 采集到写入之间的帧队列
+    CFramePool*             m_pPool;            // 帧缓冲池，格式不变时在多次启动之间复用
+    UINT32                  m_outputSubtype;    // 请求的输出像素格式
+    VideoFormat             m_outputFormat;     // 交给接收器的格式
+    BOOL                    m_bConvert;         // 写入线程是否需要转换
+    CFrameConverter         m_converter;        // 像素格式转换器
+    CFramePool*             m_pOutputPool;      // 转换结果的缓冲池
+    UINT32                  m_cSinkBuffers;     // 接收器在 WriteFrame 返回之后继续持有的缓冲区数
+    UINT32                  m_cMaxBatch;        // 批量写出的帧数上限
+    LONGLONG                m_llBatchLinger;    // 凑批的最长等待（100 纳秒）
+    LONGLONG                m_llBatchLatency;   // 批量写出的延迟上限（100 纳秒），0 表示不限制
+    CFrameBuffer*           m_pBatch[MAX_WRITE_BATCH];      // 写入线程：攒下的帧的缓冲区
+    CaptureFrame            m_batchFrames[MAX_WRITE_BATCH]; // 写入线程：攒下的帧，交给 WriteFrames
+    UINT32                  m_analysisFrameStride; // 分析的帧采样间隔，0 表示关闭
+    UINT32                  m_analysisRowStride;   // 分析的行采样间隔
+    CFrameAnalyzer          m_analyzer;         // 亮度统计
+    FrameStats              m_workStats;        // 写入线程计算中的统计
+    CLatencyRecorder        m_latency;          // 各阶段的延迟直方图
+    CDropRecorder           m_drops;            // 丢帧统计与记录
+    OverloadPolicy          m_overloadPolicy;   // 过载策略
+    UINT32                  m_decimation;       // 抽帧间隔
+    LONGLONG                m_llBlockTimeout;   // 阻塞的最长等待时长（100 纳秒）
+    FrameStats              m_lastStats;        // 最近一个分析帧的统计
+    BOOL                    m_bHasStats;        // m_lastStats 是否有效
+    mutable std::mutex      m_statsMutex;       // 保护 m_lastStats
+    std::thread             m_reader;           // 读取线程
+    std::thread             m_writer;           // 写入线程
+    std::atomic<bool>       m_bStopReader;      // 请求读取线程停止
+    std::atomic<bool>       m_bStopWriter;      // 请求写入线程在写空队列后停止
+    std::atomic<bool>       m_bRunning;         // 是否在接收帧
+    std::atomic<bool>       m_bWriterWaiting;   // 写入线程是否在等待新帧
+    std::mutex              m_mutex;            // 与 m_cvFrame 配合使用
+    std::condition_variable m_cvFrame;          // 通知写入线程有新帧
+    std::condition_variable m_cvSpace;          // 通知生产者有空闲的缓冲区或槽位
+    std::atomic<bool>       m_bProducerWaiting; // 生产者是否在等待空间
+    std::atomic<HRESULT>    m_hrWriter;         // 写入线程的状态
+    HRESULT                 m_hrReader;         // 读取线程的结束状态
+
+    BOOL                    m_bFirstSample;     // 是否是第一个样本
+    LONGLONG                m_llBaseTime;       // 基准时间
+    UINT64                  m_nSequence;        // 下一个到达帧的序号
+    BOOL                    m_bSeenDelta;       // 生产者：是否出现过非关键帧（输入为压缩格式）
+    BOOL                    m_bAwaitKeyFrame;   // 生产者：丢帧后等待下一个关键帧
+    BOOL                    m_bDecimating;      // 生产者：是否正在抽帧
+    UINT32                  m_cDecimated;       // 生产者：开始抽帧以来到达的帧数
+    UINT64                  m_nWriterNext;      // 写入线程：预期的下一个帧序号，不连续说明中间有帧被丢弃
+    BOOL                    m_bWriterAwaitKey;  // 写入线程：丢帧后等待下一个关键帧
+
+    std::atomic<UINT64>     m_cFrames;          // 已写出帧数
+    std::atomic<UINT64>     m_cbWritten;        // 已写出字节数
+    std::atomic<LONGLONG>   m_llLatencySum;     // 延迟总和（纳秒）
+    std::atomic<LONGLONG>   m_llLatencyMax;     // 最大延迟（纳秒）
+    std::atomic<UINT32>     m_cHighWater;       // 队列深度峰值
+    std::atomic<UINT64>     m_cOverflows;       // 溢出丢帧数
+    std::atomic<UINT64>     m_cBatches;         // 交给接收器的批数
+    std::atomic<UINT32>     m_cBatchLimit;      // 当前的批量上限
+    std::atomic<UINT64>     m_cAnalyzed;        // 已分析帧数
+    std::atomic<UINT64>     m_cBlackFrames;     // 全黑帧数
+    std::atomic<UINT64>     m_cFrozenFrames;    // 冻结帧数
+    std::atomic<UINT64>     m_cOverexposedFrames; // 过曝帧数
+    std::chrono::steady_clock::time_point m_tStart; // 启动时刻
+    LONGLONG                m_llStartRequested; // SetStartTime 设定的首帧时长起点
+    LONGLONG                m_llStartup;        // 本次启动的首帧时长起点（GetClockTime）
+    std::atomic<LONGLONG>   m_llFirstFrame;     // 第一帧到达的时刻，尚未收到帧时为 0
+    std::atomic<LONGLONG>   m_llDeviceLost;     // 设备丢失的时刻，未丢失时为 0
+    LONGLONG                m_llTimeOffset;     // 生产者：加到推入帧时间戳上的偏移
+    LONGLONG                m_llLastTimestamp;  // 生产者：上一帧校正后的时间戳
+    BOOL                    m_bHasTimestamp;    // 生产者：m_llLastTimestamp 是否有效
+    std::atomic<UINT32>     m_cDeviceLosses;    // 设备丢失次数
+    std::atomic<UINT32>     m_cRecoveries;      // 恢复次数
+    std::atomic<LONGLONG>   m_llLastRecovery;   // 最近一次恢复时长（100 纳秒）
+    std::atomic<LONGLONG>   m_llMaxRecovery;    // 最长恢复时长（100 纳秒）
+    std::chrono::steady_clock::time_point m_tEnd;   // 结束时刻
+};
+
+// 为 count 路流水线中的第 index 路分配逻辑核：核数足够时读取线程和写入线程各占一个核，
+// 否则只把写入线程轮流绑定到各个核；单核机器上不绑定
+void AssignPipelineCores(UINT32 index, UINT32 count, INT32* pReaderCore, INT32* pWriterCore);
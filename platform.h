@@ -0,0 +1,248 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+// 跨平台基础定义：Windows 上直接使用 Win32 头文件，其他平台上提供同名的最小替代，
+// 使采集流水线中与平台无关的部分（数据源、队列、接收器等）可以沿用 HRESULT 的错误处理方式
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t     HRESULT;
+typedef int         BOOL;
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef int16_t     INT16;
+typedef uint32_t    DWORD;
+typedef uint32_t    UINT;
+typedef int32_t     INT32;
+typedef uint32_t    UINT32;
+typedef uint64_t    UINT64;
+typedef int32_t     LONG;
+typedef uint32_t    ULONG;
+typedef int64_t     LONGLONG;
+typedef wchar_t     WCHAR;
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define S_OK            ((HRESULT)0x00000000L)
+#define S_FALSE         ((HRESULT)0x00000001L)
+#define E_NOTIMPL       ((HRESULT)0x80004001L)
+#define E_ABORT         ((HRESULT)0x80004004L)
+#define E_POINTER       ((HRESULT)0x80004003L)
+#define E_FAIL          ((HRESULT)0x80004005L)
+#define E_UNEXPECTED    ((HRESULT)0x8000FFFFL)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000EL)
+#define E_INVALIDARG    ((HRESULT)0x80070057L)
+
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+#define HRESULT_FROM_WIN32(x) ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | 0x80070000)))
+
+#define ERROR_FILE_NOT_FOUND    2L
+#define ERROR_ACCESS_DENIED     5L
+#define ERROR_BAD_FORMAT        11L
+#define ERROR_HANDLE_EOF        38L
+#define ERROR_NOT_SUPPORTED     50L
+#define ERROR_DISK_FULL         112L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_ALREADY_EXISTS    183L
+#define ERROR_NOT_FOUND         1168L
+#define ERROR_INVALID_STATE     5023L
+
+#define INFINITE        0xFFFFFFFF
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#endif // _WIN32
+
+// 按指定对齐（2 的幂）分配内存，失败时返回 nullptr，用 AlignedFree 释放
+#ifdef _WIN32
+#include <malloc.h>
+
+inline void* AlignedAlloc(size_t cb, size_t alignment)
+{
+    return _aligned_malloc(cb, alignment);
+}
+
+inline void AlignedFree(void* p)
+{
+    _aligned_free(p);
+}
+#else
+#include <stdlib.h>
+
+inline void* AlignedAlloc(size_t cb, size_t alignment)
+{
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, cb) == 0 ? p : nullptr;
+}
+
+inline void AlignedFree(void* p)
+{
+    free(p);
+}
+#endif
+
+#ifndef _WIN32
+#include <errno.h>
+
+// errno 转换成 HRESULT
+inline HRESULT HResultFromErrno(int error)
+{
+    switch (error)
+    {
+    case ENOENT:    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    case EACCES:    return HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED);
+    case EEXIST:    return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+    case ENOSPC:    return HRESULT_FROM_WIN32(ERROR_DISK_FULL);
+    case ENOMEM:    return E_OUTOFMEMORY;
+    case EINVAL:    return E_INVALIDARG;
+    }
+    return E_FAIL;
+}
+#endif
+
+// 内存页大小，池化缓冲区按页对齐以便直接 I/O
+const size_t PAGE_SIZE_BYTES = 4096;
+
+// 是否编译 x86 的 SIMD 代码路径
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PLATFORM_X86 1
+#endif
+
+// GCC/Clang 需要逐个函数开启 AVX2 指令集，MSVC 不需要
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+#ifdef PLATFORM_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// 运行时可用的 SIMD 指令级别
+enum CpuLevel
+{
+    CpuLevel_Scalar = 0,    // 纯 C++ 实现
+    CpuLevel_SSE2,          // SSE2
+    CpuLevel_AVX2,          // AVX2
+};
+
+// 检测当前 CPU 和操作系统支持的最高 SIMD 级别，结果在首次调用后缓存
+inline CpuLevel GetCpuLevel()
+{
+    static CpuLevel s_level = []()
+    {
+        CpuLevel level = CpuLevel_Scalar;
+#ifdef PLATFORM_X86
+        int info[4] = { 0 };
+#ifdef _MSC_VER
+        __cpuid(info, 1);
+#else
+        __cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+        if (info[3] & (1 << 26))
+        {
+            level = CpuLevel_SSE2;
+        }
+
+        // AVX2 还要求操作系统通过 XSAVE 保存 YMM 寄存器
+        BOOL bOsYmm = FALSE;
+        if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)))
+        {
+#ifdef _MSC_VER
+            bOsYmm = (_xgetbv(0) & 6) == 6;
+#else
+            unsigned int eax, edx;
+            __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            bOsYmm = (eax & 6) == 6;
+#endif
+        }
+
+        if (bOsYmm)
+        {
+#ifdef _MSC_VER
+            __cpuidex(info, 7, 0);
+#else
+            __cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+            if (info[1] & (1 << 5))
+            {
+                level = CpuLevel_AVX2;
+            }
+        }
+#endif
+        return level;
+    }();
+
+    return s_level;
+}
+
+// SIMD 级别的名称，用于日志输出
+inline const char* GetCpuLevelName(CpuLevel level)
+{
+    switch (level)
+    {
+    case CpuLevel_SSE2: return "sse2";
+    case CpuLevel_AVX2: return "avx2";
+    default:            return "scalar";
+    }
+}
+
+// 把调用线程绑定到指定的逻辑核；核号超出范围或绑定失败时返回错误，不支持的平台返回 E_NOTIMPL
+#ifdef _WIN32
+inline HRESULT PinCurrentThread(UINT32 core)
+{
+    if (core >= sizeof(DWORD_PTR) * 8)
+    {
+        return E_INVALIDARG;
+    }
+    if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) == 0)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+
+inline HRESULT PinCurrentThread(UINT32 core)
+{
+    if (core >= CPU_SETSIZE)
+    {
+        return E_INVALIDARG;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? S_OK : E_FAIL;
+}
+#else
+inline HRESULT PinCurrentThread(UINT32)
+{
+    return E_NOTIMPL;
+}
+#endif
@@ -0,0 +1,250 @@
+#include <string.h>
+#include "prerollsink.h"
+
+// 帧率未知时按该帧率估算 N 秒的帧数
+static const UINT32 c_defaultFps = 30;
+
+CPreRollSink::CPreRollSink(IFrameSink* pSink, double fSeconds, size_t cbMaxMemory) :
+    m_pSink(pSink),
+    m_fSeconds(fSeconds),
+    m_cbMaxMemory(cbMaxMemory),
+    m_pPool(nullptr),
+    m_cSlots(0),
+    m_iOldest(0),
+    m_cBuffered(0),
+    m_cOverwritten(0),
+    m_bTriggered(false),
+    m_bFlushed(FALSE),
+    m_bFirstSample(TRUE),
+    m_llBaseTime(0)
+{
+    m_format = VideoFormat();
+}
+
+CPreRollSink::~CPreRollSink()
+{
+    ReleaseBuffered();
+
+    if (m_pPool)
+    {
+        m_pPool->Release();
+        m_pPool = nullptr;
+    }
+}
+
+// 按时长和内存上限计算槽数并分配环形缓冲区；下游接收器推迟到触发后才打开
+HRESULT CPreRollSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    UINT32 cbFrame = GetFrameSize(format);
+
+    if (cbFrame == 0 || m_fSeconds <= 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 池中每块缓冲区按页对齐，内存上限按对齐后的大小计算
+    size_t cbSlot = ((size_t)cbFrame + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1);
+    size_t cMaxSlots = m_cbMaxMemory / cbSlot;
+    LONGLONG llDuration = GetFrameDuration(format);
+    double fFrames = llDuration > 0 ? m_fSeconds * HNS_PER_SECOND / llDuration : m_fSeconds * c_defaultFps;
+    size_t cSlots = (size_t)(fFrames + 0.999);
+
+    if (cSlots > cMaxSlots)
+    {
+        cSlots = cMaxSlots;
+    }
+    if (cSlots == 0)
+    {
+        // 内存上限连一帧都放不下
+        return E_OUTOFMEMORY;
+    }
+
+    ReleaseBuffered();
+
+    HRESULT hr = S_OK;
+
+    if (m_pPool && (!m_pPool->Matches(format) || m_pPool->Count() != cSlots))
+    {
+        m_pPool->Release();
+        m_pPool = nullptr;
+    }
+
+    if (m_pPool == nullptr)
+    {
+        hr = CFramePool::CreateInstance(format, (UINT32)cSlots, &m_pPool);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_ring.assign(cSlots, nullptr);
+    m_format = format;
+    m_cSlots = (UINT32)cSlots;
+    m_iOldest = 0;
+    m_cOverwritten = 0;
+    m_bTriggered = false;
+    m_bFlushed = FALSE;
+    m_bFirstSample = TRUE;
+    m_llBaseTime = 0;
+    return S_OK;
+}
+
+// 触发之前缓冲帧；触发后的第一帧先写出缓冲区，之后直接交给下游接收器
+HRESULT CPreRollSink::WriteFrame(const CaptureFrame& frame)
+{
+    HRESULT hr = S_OK;
+
+    if (!m_bFlushed)
+    {
+        if (!m_bTriggered.load())
+        {
+            return BufferFrame(frame);
+        }
+
+        hr = Flush();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = WriteThrough(frame);
+    }
+
+    return hr;
+}
+
+// 已触发时写出剩余的缓冲帧并结束下游接收器，从未触发时只丢弃缓冲帧
+HRESULT CPreRollSink::Finalize()
+{
+    HRESULT hr = S_OK;
+
+    if (!m_bFlushed && m_bTriggered.load())
+    {
+        hr = Flush();
+    }
+
+    if (m_bFlushed)
+    {
+        HRESULT hrFinalize = m_pSink->Finalize();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = hrFinalize;
+        }
+    }
+
+    ReleaseBuffered();
+    m_bFlushed = FALSE;
+    return hr;
+}
+
+// 把一帧拷贝进池中的缓冲区放到环形缓冲区末尾，已满时先释放最旧的帧腾出缓冲区
+HRESULT CPreRollSink::BufferFrame(const CaptureFrame& frame)
+{
+    if (m_cSlots == 0)
+    {
+        return E_UNEXPECTED;
+    }
+
+    UINT32 cBuffered = m_cBuffered.load(std::memory_order_relaxed);
+
+    if (cBuffered == m_cSlots)
+    {
+        m_ring[m_iOldest]->Release();
+        m_ring[m_iOldest] = nullptr;
+        m_iOldest = (m_iOldest + 1) % m_cSlots;
+        cBuffered--;
+        m_cOverwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    CFrameBuffer* pBuffer = nullptr;
+    HRESULT hr = m_pPool->Acquire(&pBuffer);
+
+    if (hr != S_OK || pBuffer->GetCapacity() < frame.cbData)
+    {
+        if (pBuffer)
+        {
+            pBuffer->Release();
+        }
+        m_cBuffered.store(cBuffered, std::memory_order_relaxed);
+        return FAILED(hr) ? hr : E_UNEXPECTED;
+    }
+
+    memcpy(pBuffer->GetData(), frame.pData, frame.cbData);
+
+    CaptureFrame& buffered = pBuffer->Frame();
+    buffered.cbData = frame.cbData;
+    buffered.llTimestamp = frame.llTimestamp;
+    buffered.nSequence = frame.nSequence;
+    buffered.llArrival = frame.llArrival;
+
+    m_ring[(m_iOldest + cBuffered) % m_cSlots] = pBuffer;
+    m_cBuffered.store(cBuffered + 1, std::memory_order_relaxed);
+    return S_OK;
+}
+
+// 打开下游接收器，从最旧的帧开始按顺序写出；写出后的缓冲区由下游接收器按需继续持有
+HRESULT CPreRollSink::Flush()
+{
+    HRESULT hr = m_pSink->BeginWriting(m_format);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_bFlushed = TRUE;
+
+    while (SUCCEEDED(hr) && m_cBuffered.load(std::memory_order_relaxed) > 0)
+    {
+        CFrameBuffer* pBuffer = m_ring[m_iOldest];
+
+        m_ring[m_iOldest] = nullptr;
+        m_iOldest = (m_iOldest + 1) % m_cSlots;
+        m_cBuffered.fetch_sub(1, std::memory_order_relaxed);
+
+        hr = WriteThrough(pBuffer->Frame());
+        pBuffer->Release();
+    }
+
+    return hr;
+}
+
+// 以写出的第一帧为基准校正时间戳后交给下游接收器
+HRESULT CPreRollSink::WriteThrough(const CaptureFrame& frame)
+{
+    CaptureFrame rebased = frame;
+
+    if (m_bFirstSample)
+    {
+        m_llBaseTime = frame.llTimestamp;
+        m_bFirstSample = FALSE;
+    }
+
+    // rebase the time stamp
+    rebased.llTimestamp -= m_llBaseTime;
+
+    return m_pSink->WriteFrame(rebased);
+}
+
+// 释放缓冲区中的所有帧，缓冲区回到池中
+void CPreRollSink::ReleaseBuffered()
+{
+    for (size_t i = 0; i < m_ring.size(); i++)
+    {
+        if (m_ring[i])
+        {
+            m_ring[i]->Release();
+            m_ring[i] = nullptr;
+        }
+    }
+
+    m_iOldest = 0;
+    m_cBuffered = 0;
+}
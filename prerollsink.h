@@ -0,0 +1,76 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <vector>
+#include "sink.h"
+#include "framepool.h"
+
+// 预录默认的内存上限（字节）
+const size_t DEFAULT_PREROLL_MEMORY = 256 * 1024 * 1024;
+
+// CPreRollSink 类实现“只保留最近 N 秒”的预录：触发之前把收到的帧拷贝进固定大小的环形缓冲区，
+// 最旧的帧被新帧覆盖，不打开下游接收器、不产生任何磁盘 I/O；调用 Trigger 之后，写入线程在下一帧到来时
+// 先打开下游接收器并按时间顺序写出缓冲区中的帧，再接着写出这一帧及之后的实时帧，中间没有缺口
+//
+// 流水线交给接收器的都是未压缩的完整帧，每一帧都可以作为起点，因此从缓冲区中最旧的帧开始写出，
+// 编码器会把第一帧编成关键帧；写出的时间戳以第一帧为基准重新从 0 开始，与 CCapture 的 m_llBaseTime 做法相同
+//
+// 环形缓冲区的槽数取 N 秒的帧数与内存上限能容纳的帧数中较小的一个，在 BeginWriting 中一次性分配，
+// 之后不再分配堆内存；下游接收器由调用方持有，必须在 Finalize 之后才能释放
+class CPreRollSink : public IFrameSink
+{
+public:
+    // fSeconds 为保留的时长，cbMaxMemory 为环形缓冲区的内存上限
+    CPreRollSink(IFrameSink* pSink, double fSeconds, size_t cbMaxMemory = DEFAULT_PREROLL_MEMORY);
+    virtual ~CPreRollSink();
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 已触发时写出剩余的缓冲帧并结束下游接收器；从未触发时丢弃缓冲帧，不会创建输出文件
+    HRESULT Finalize();
+
+    // 触发录制，可以在任意线程调用；重复调用没有影响
+    void    Trigger() { m_bTriggered.store(true); }
+
+    // 是否已触发
+    BOOL    IsTriggered() const { return m_bTriggered.load(); }
+
+    // 环形缓冲区的槽数
+    UINT32  Capacity() const { return m_cSlots; }
+
+    // 当前缓冲的帧数
+    UINT32  BufferedCount() const { return m_cBuffered.load(); }
+
+    // 因缓冲区已满被覆盖的帧数
+    UINT64  OverwrittenCount() const { return m_cOverwritten.load(); }
+
+private:
+    // 把一帧拷贝进环形缓冲区，缓冲区已满时覆盖最旧的帧
+    HRESULT BufferFrame(const CaptureFrame& frame);
+
+    // 打开下游接收器，按时间顺序写出缓冲区中的帧
+    HRESULT Flush();
+
+    // 校正时间戳后交给下游接收器
+    HRESULT WriteThrough(const CaptureFrame& frame);
+
+    // 释放缓冲区中的所有帧
+    void    ReleaseBuffered();
+
+    IFrameSink*                 m_pSink;        // 下游接收器
+    double                      m_fSeconds;     // 保留的时长
+    size_t                      m_cbMaxMemory;  // 内存上限
+    VideoFormat                 m_format;       // 输入格式
+    CFramePool*                 m_pPool;        // 环形缓冲区的存储，格式不变时在多次启动之间复用
+    std::vector<CFrameBuffer*>  m_ring;         // 环形缓冲区，m_iOldest 处是最旧的帧
+    UINT32                      m_cSlots;       // 槽数
+    UINT32                      m_iOldest;      // 最旧的帧所在的槽
+    std::atomic<UINT32>         m_cBuffered;    // 缓冲的帧数
+    std::atomic<UINT64>         m_cOverwritten; // 被覆盖的帧数
+    std::atomic<bool>           m_bTriggered;   // 是否已触发
+    BOOL                        m_bFlushed;     // 下游接收器是否已打开
+
+    BOOL                        m_bFirstSample; // 是否是第一个写出的样本
+    LONGLONG                    m_llBaseTime;   // 基准时间
+};
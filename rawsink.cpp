@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "rawsink.h"
+
+// 原始文件头占用的字节数，第一帧从该偏移开始
+static const UINT32 c_cbRawHeader = (UINT32)DIRECT_IO_ALIGNMENT;
+
+// Y4M 每帧之前的标记
+static const char c_szY4mFrame[] = "FRAME\n";
+
+// 帧头块的大小，放得下一个分散/聚集写请求中所有帧的帧头
+static const UINT32 c_cbGatherHeaders = MAX_GATHER_SEGMENTS / 2 * sizeof(RawFrameHeader);
+
+CRawFileSink::CRawFileSink(const WCHAR* pwszFileName, RawContainer container, BOOL bDirect, UINT32 cbBatch,
+    UINT32 cBatches) :
+    m_fileName(pwszFileName ? pwszFileName : L""),
+    m_container(container),
+    m_bDirect(bDirect),
+    m_ioBackend(AsyncIoBackend_Auto),
+    m_cbBatch(((size_t)cbBatch + DIRECT_IO_ALIGNMENT - 1) & ~(DIRECT_IO_ALIGNMENT - 1)),
+    m_cBatches(cBatches < 2 ? 2 : cBatches),
+    m_cbFrame(0),
+    m_pPool(nullptr),
+    m_pFill(nullptr),
+    m_cbFill(0),
+    m_cbSubmitted(0),
+    m_cbLogical(0),
+    m_cStalls(0),
+    m_cGatherFrames(0),
+    m_pHeaderPool(nullptr),
+    m_cGathers(0)
+{
+    m_format = VideoFormat();
+
+    if (m_cbBatch == 0)
+    {
+        m_cbBatch = DEFAULT_RAW_BATCH_SIZE;
+    }
+}
+
+CRawFileSink::~CRawFileSink()
+{
+    Finalize();
+
+    if (m_pPool)
+    {
+        m_pPool->Release();
+    }
+    if (m_pHeaderPool)
+    {
+        m_pHeaderPool->Release();
+    }
+}
+
+// 打开或关闭分散/聚集写入
+HRESULT CRawFileSink::SetGatherWrites(UINT32 cMaxFrames)
+{
+    if (m_file.IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+    if (cMaxFrames != 0 && m_bDirect)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    m_cGatherFrames = (cMaxFrames > MAX_GATHER_SEGMENTS / 2) ? MAX_GATHER_SEGMENTS / 2 : cMaxFrames;
+    return S_OK;
+}
+
+// 创建块的缓冲池（分散/聚集写入时还有帧头块的缓冲池）和文件，开始异步写入，再写入文件头
+HRESULT CRawFileSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_file.IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+
+    UINT32 cbFrame = GetFrameSize(format);
+
+    if (cbFrame == 0)
+    {
+        return E_INVALIDARG;
+    }
+    if (m_container == RawContainer_Y4M && format.subtype != FOURCC_I420 && format.subtype != FOURCC_IYUV)
+    {
+        // Y4M 只能表示平面格式
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    HRESULT hr = S_OK;
+
+    if (m_pPool == nullptr)
+    {
+        hr = CFramePool::CreateBlockPool((UINT32)m_cbBatch, m_cBatches, &m_pPool);
+    }
+
+    if (SUCCEEDED(hr) && m_cGatherFrames != 0 && m_pHeaderPool == nullptr)
+    {
+        hr = CFramePool::CreateBlockPool(c_cbGatherHeaders, RAW_GATHER_DEPTH, &m_pHeaderPool);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_file.Create(m_fileName.c_str(), m_bDirect);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 每块和每个帧头块各占一个请求，提交时不必等待请求名额
+        hr = m_writer.Open(&m_file, m_pPool, m_cBatches + (m_cGatherFrames ? RAW_GATHER_DEPTH : 0), m_ioBackend);
+
+        if (FAILED(hr))
+        {
+            m_file.Close();
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_format = format;
+    m_cbFrame = cbFrame;
+    m_cbFill = 0;
+    m_cbSubmitted = 0;
+    m_cbLogical = 0;
+    m_cStalls = 0;
+    m_cGathers = 0;
+
+    if (m_container == RawContainer_Y4M)
+    {
+        char szHeader[128];
+        int cch = snprintf(szHeader, sizeof(szHeader), "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C420mpeg2 XCOLORRANGE=LIMITED\n",
+            format.width, format.height, format.fpsNumerator ? format.fpsNumerator : 30,
+            format.fpsDenominator ? format.fpsDenominator : 1);
+
+        hr = Append(szHeader, (size_t)cch);
+    }
+    else
+    {
+        BYTE header[c_cbRawHeader] = { 0 };
+        RawFileHeader* pHeader = (RawFileHeader*)header;
+
+        pHeader->magic = RAW_FILE_MAGIC;
+        pHeader->version = 1;
+        pHeader->cbHeader = c_cbRawHeader;
+        pHeader->cbFrameHeader = sizeof(RawFrameHeader);
+        pHeader->subtype = format.subtype;
+        pHeader->width = format.width;
+        pHeader->height = format.height;
+        pHeader->fpsNumerator = format.fpsNumerator;
+        pHeader->fpsDenominator = format.fpsDenominator;
+        pHeader->cbFrame = cbFrame;
+
+        hr = Append(header, sizeof(header));
+    }
+
+    if (FAILED(hr))
+    {
+        Finalize();
+    }
+
+    return hr;
+}
+
+// 数据是否就是所在缓冲池缓冲区的内容，只有这样的帧才能在写完之前持有而不拷贝
+static BOOL IsPooledFrame(const CaptureFrame& frame)
+{
+    return frame.pBuffer != nullptr && frame.pData == frame.pBuffer->GetData();
+}
+
+// 写入一帧，与只有一帧的一批相同
+HRESULT CRawFileSink::WriteFrame(const CaptureFrame& frame)
+{
+    return WriteFrames(&frame, 1);
+}
+
+// 写入一批帧：先检查整批的长度；打开分散/聚集写入时，连续的缓冲池中的帧每 m_cGatherFrames 帧提交一个请求，
+// 其余的帧逐帧拷贝进块
+HRESULT CRawFileSink::WriteFrames(const CaptureFrame* pFrames, UINT32 cFrames)
+{
+    if (!m_file.IsOpen())
+    {
+        return E_UNEXPECTED;
+    }
+
+    HRESULT hr = m_writer.GetStatus();
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    for (UINT32 i = 0; i < cFrames; i++)
+    {
+        if (pFrames[i].cbData != m_cbFrame)
+        {
+            return E_INVALIDARG;
+        }
+    }
+
+    UINT32 i = 0;
+
+    while (i < cFrames && SUCCEEDED(hr))
+    {
+        UINT32 cPooled = 0;
+
+        while (i + cPooled < cFrames && cPooled < m_cGatherFrames && IsPooledFrame(pFrames[i + cPooled]))
+        {
+            cPooled++;
+        }
+
+        if (cPooled > 0)
+        {
+            hr = GatherFrames(pFrames + i, cPooled);
+            i += cPooled;
+        }
+        else
+        {
+            hr = AppendFrame(pFrames[i]);
+            i++;
+        }
+    }
+
+    return hr;
+}
+
+// 提交最后一块，等所有块写完，再把文件截到逻辑长度（去掉直接 I/O 补齐的零）
+HRESULT CRawFileSink::Finalize()
+{
+    if (!m_file.IsOpen())
+    {
+        return S_OK;
+    }
+
+    HRESULT hr = S_OK;
+
+    if (m_pFill)
+    {
+        hr = SubmitBatch();
+    }
+
+    HRESULT hrWriter = m_writer.Close();
+
+    if (SUCCEEDED(hr))
+    {
+        hr = hrWriter;
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = m_file.SetSize(m_cbLogical);
+    }
+
+    m_file.Close();
+    return hr;
+}
+
+// 已追加的逻辑字节数
+HRESULT CRawFileSink::GetBytesWritten(UINT64* pcbWritten)
+{
+    *pcbWritten = m_cbLogical;
+    return S_OK;
+}
+
+// 把数据拷贝进当前块，一帧可以跨越多个块
+HRESULT CRawFileSink::Append(const void* pData, size_t cbData)
+{
+    const BYTE* pSrc = (const BYTE*)pData;
+
+    while (cbData > 0)
+    {
+        if (m_pFill == nullptr)
+        {
+            HRESULT hr = AcquireBatch();
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+
+        size_t cbCopy = m_cbBatch - m_cbFill;
+
+        if (cbCopy > cbData)
+        {
+            cbCopy = cbData;
+        }
+
+        memcpy(m_pFill->GetData() + m_cbFill, pSrc, cbCopy);
+        m_cbFill += cbCopy;
+        pSrc += cbCopy;
+        cbData -= cbCopy;
+        m_cbLogical += cbCopy;
+
+        if (m_cbFill == m_cbBatch)
+        {
+            HRESULT hr = SubmitBatch();
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+// 追加帧头和帧数据
+HRESULT CRawFileSink::AppendFrame(const CaptureFrame& frame)
+{
+    HRESULT hr = S_OK;
+
+    if (m_container == RawContainer_Y4M)
+    {
+        hr = Append(c_szY4mFrame, sizeof(c_szY4mFrame) - 1);
+    }
+    else
+    {
+        RawFrameHeader header = { RAW_FRAME_MAGIC, frame.cbData, frame.nSequence, frame.llTimestamp, 0 };
+        hr = Append(&header, sizeof(header));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = Append(frame.pData, frame.cbData);
+    }
+
+    return hr;
+}
+
+// 各帧的帧头（或 FRAME 标记）写进一个帧头块，与各帧的数据交替排成一组段，作为一个请求从当前块之后写出；
+// 帧数据不拷贝，请求持有帧头块和各帧的缓冲区直到写完。当前块里还有数据时先提交，使文件偏移连续
+HRESULT CRawFileSink::GatherFrames(const CaptureFrame* pFrames, UINT32 cFrames)
+{
+    HRESULT hr = S_OK;
+
+    if (m_pFill)
+    {
+        hr = SubmitBatch();
+    }
+
+    CFrameBuffer* pHeaders = nullptr;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = AcquireBlock(m_pHeaderPool, &pHeaders);
+    }
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    BYTE* pHeader = pHeaders->GetData();
+    UINT32 cSegments = 0;
+    UINT64 cbRequest = 0;
+
+    m_pHeld[0] = pHeaders;
+
+    for (UINT32 i = 0; i < cFrames; i++)
+    {
+        const CaptureFrame& frame = pFrames[i];
+        size_t cbHeader = sizeof(RawFrameHeader);
+
+        if (m_container == RawContainer_Y4M)
+        {
+            cbHeader = sizeof(c_szY4mFrame) - 1;
+            memcpy(pHeader, c_szY4mFrame, cbHeader);
+        }
+        else
+        {
+            RawFrameHeader header = { RAW_FRAME_MAGIC, frame.cbData, frame.nSequence, frame.llTimestamp, 0 };
+            memcpy(pHeader, &header, cbHeader);
+        }
+
+        m_segments[cSegments].pData = pHeader;
+        m_segments[cSegments].cbData = cbHeader;
+        m_segments[cSegments + 1].pData = frame.pData;
+        m_segments[cSegments + 1].cbData = frame.cbData;
+        cSegments += 2;
+        cbRequest += cbHeader + frame.cbData;
+        pHeader += cbHeader;
+
+        frame.pBuffer->AddRef();
+        m_pHeld[i + 1] = frame.pBuffer;
+    }
+
+    hr = m_writer.SubmitGather(m_segments, cSegments, m_pHeld, cFrames + 1, m_cbSubmitted);
+
+    m_cbLogical += cbRequest;
+    m_cbSubmitted = m_cbLogical;
+    m_cGathers.fetch_add(1, std::memory_order_relaxed);
+    return hr;
+}
+
+// 从 pPool 取一个空闲块；所有块都在写盘时等其中一个请求写完
+HRESULT CRawFileSink::AcquireBlock(CFramePool* pPool, CFrameBuffer** ppBuffer)
+{
+    while (pPool->Acquire(ppBuffer) == S_FALSE)
+    {
+        m_cStalls.fetch_add(1, std::memory_order_relaxed);
+
+        HRESULT hr = m_writer.WaitForCompletion();
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        if (hr == S_FALSE && pPool->FreeCount() == 0)
+        {
+            // 没有在写的请求，缓冲池却是空的
+            return E_UNEXPECTED;
+        }
+    }
+
+    return S_OK;
+}
+
+// 取一个空闲块作为当前块
+HRESULT CRawFileSink::AcquireBatch()
+{
+    HRESULT hr = AcquireBlock(m_pPool, &m_pFill);
+
+    m_cbFill = 0;
+    return hr;
+}
+
+// 把当前块交给 CAsyncFileWriter；直接 I/O 时最后一块不满，补零到对齐长度后写入，由 Finalize 截掉多余部分；
+// 缓冲写入时块可以不满（分散/聚集写请求之前），下一块从它的末尾开始
+// 写入出错时块已经归还，错误由这一次或下一次 WriteFrame 返回
+HRESULT CRawFileSink::SubmitBatch()
+{
+    size_t cbWrite = m_cbFill;
+
+    if (m_file.IsDirect() && (cbWrite & (DIRECT_IO_ALIGNMENT - 1)) != 0)
+    {
+        size_t cbAligned = (cbWrite + DIRECT_IO_ALIGNMENT - 1) & ~(DIRECT_IO_ALIGNMENT - 1);
+        memset(m_pFill->GetData() + cbWrite, 0, cbAligned - cbWrite);
+        cbWrite = cbAligned;
+    }
+
+    HRESULT hr = m_writer.Submit(m_pFill, m_cbSubmitted, (UINT32)cbWrite);
+
+    m_pFill = nullptr;
+    m_cbFill = 0;
+    m_cbSubmitted += cbWrite;
+    return hr;
+}
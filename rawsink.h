@@ -0,0 +1,180 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <new>
+#include <atomic>
+#include <string>
+#include "sink.h"
+#include "directfile.h"
+#include "asyncfile.h"
+
+// 未压缩录制的文件格式
+enum RawContainer
+{
+    RawContainer_Raw = 0,   // 4KB 文件头 + 每帧 32 字节帧头和帧数据，支持流水线的所有像素格式
+    RawContainer_Y4M,       // YUV4MPEG2，只支持 I420/IYUV（流水线输出设为 I420）
+};
+
+// 原始文件与帧头的标识
+const UINT32 RAW_FILE_MAGIC  = FRAME_FOURCC('C', 'R', 'A', 'W');
+const UINT32 RAW_FRAME_MAGIC = FRAME_FOURCC('F', 'R', 'A', 'M');
+
+// 原始文件头，写在文件开头并补零到 cbHeader 字节，使第一帧从对齐的偏移开始
+struct RawFileHeader
+{
+    UINT32  magic;          // RAW_FILE_MAGIC
+    UINT32  version;        // 格式版本，目前为 1
+    UINT32  cbHeader;       // 文件头占用的字节数
+    UINT32  cbFrameHeader;  // 每个帧头的字节数
+    UINT32  subtype;        // 像素格式 (FOURCC)
+    UINT32  width;          // 宽度
+    UINT32  height;         // 高度
+    UINT32  fpsNumerator;   // 帧率分子
+    UINT32  fpsDenominator; // 帧率分母
+    UINT32  cbFrame;        // 每帧数据的字节数
+};
+
+// 原始文件中每帧数据之前的帧头
+struct RawFrameHeader
+{
+    UINT32      magic;          // RAW_FRAME_MAGIC
+    UINT32      cbData;         // 帧数据长度
+    UINT64      nSequence;      // 帧序号
+    LONGLONG    llTimestamp;    // 时间戳（100 纳秒）
+    UINT64      reserved;       // 保留，为 0
+};
+
+// 批量写入的默认块大小和块数
+const UINT32 DEFAULT_RAW_BATCH_SIZE = 8 * 1024 * 1024;
+const UINT32 DEFAULT_RAW_BATCH_COUNT = 4;
+
+// 分散/聚集写入时同时在写的请求数上限：一个在写，一个等着提交
+const UINT32 RAW_GATHER_DEPTH = 2;
+
+// CRawFileSink 类把未压缩的帧无损写入 Y4M 或带文件头的原始文件
+//
+// 写入线程只把帧拷贝进按页对齐的大块缓冲区（取自专用的 CFramePool），写满一块就交给 CAsyncFileWriter，
+// 以直接 I/O（CDirectFile）整块异步写到磁盘，写完后块自动回到缓冲池；Linux 上用 io_uring 提交，
+// 块所在的整块内存注册为固定缓冲区，其他平台或 io_uring 不可用时由独立的写入线程写盘
+// 拷贝和磁盘写入重叠进行，块数决定能吸收多长的磁盘停顿，所有块都在写盘时写入线程才会等待；稳态下不分配堆内存
+//
+// 缓冲写入（bDirect 为 FALSE）时可以用 SetGatherWrites 打开分散/聚集写入：WriteFrames 把一批帧的帧头和帧数据
+// 作为一个 CAsyncFileWriter::SubmitGather 请求提交，帧数据不拷贝进块，帧缓冲区持有到写完为止，流水线需要用
+// SetSinkBuffers 留出 GetBufferDemand 块余量；不在缓冲池中的帧仍然拷贝进块。直接 I/O 要求每段都对齐，
+// 32 字节的帧头做不到，所以只用于缓冲写入。Windows 上 WriteFileGather 同样只接受不经缓存的句柄和整页的段，
+// 写入线程逐段调用 WriteFile，系统调用次数不减少，只省掉拷贝
+class CRawFileSink : public IFrameSink
+{
+public:
+    // bDirect 为 FALSE 时使用系统文件缓存；cbBatch 向上取整到 DIRECT_IO_ALIGNMENT
+    CRawFileSink(const WCHAR* pwszFileName, RawContainer container, BOOL bDirect = TRUE,
+        UINT32 cbBatch = DEFAULT_RAW_BATCH_SIZE, UINT32 cBatches = DEFAULT_RAW_BATCH_COUNT);
+    virtual ~CRawFileSink();
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+    HRESULT WriteFrames(const CaptureFrame* pFrames, UINT32 cFrames);
+    HRESULT Finalize();
+
+    // 已写入文件的逻辑字节数（含文件头与帧头）
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+    // 设置异步写入的实现方式，在 BeginWriting 之前调用
+    void    SetIoBackend(AsyncIoBackend backend) { m_ioBackend = backend; }
+
+    // 打开分散/聚集写入，每个请求最多 cMaxFrames 帧（不超过 MAX_GATHER_SEGMENTS / 2），0 表示关闭（默认）；
+    // 只支持缓冲写入，直接 I/O 时返回 HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED)；在 BeginWriting 之前调用
+    HRESULT SetGatherWrites(UINT32 cMaxFrames);
+
+    // WriteFrames 返回之后最多继续持有的帧缓冲区数，未打开分散/聚集写入时为 0
+    UINT32  GetBufferDemand() const { return m_cGatherFrames * RAW_GATHER_DEPTH; }
+
+    // 实际使用的异步写入方式
+    AsyncIoBackend GetIoBackend() const { return m_writer.GetBackend(); }
+
+    // 写盘的块是否注册为 io_uring 的固定缓冲区
+    BOOL    IsRegistered() const { return m_writer.IsRegistered(); }
+
+    // 是否实际使用了直接 I/O
+    BOOL    IsDirect() const { return m_file.IsDirect(); }
+
+    // 写入线程等待空闲块的次数（磁盘跟不上）
+    UINT64  StallCount() const { return m_cStalls.load(); }
+
+    // 是否打开了分散/聚集写入
+    BOOL    IsGather() const { return m_cGatherFrames != 0; }
+
+    // 分散/聚集写请求数，与写出的帧数之比即每次 I/O 合并的帧数
+    UINT64  GatherCount() const { return m_cGathers.load(); }
+
+private:
+    CRawFileSink(const CRawFileSink&);
+    CRawFileSink& operator=(const CRawFileSink&);
+
+    // 把数据追加到当前块，块满时提交
+    HRESULT Append(const void* pData, size_t cbData);
+
+    // 把一帧的帧头（或 Y4M 的 FRAME 标记）和数据追加到当前块
+    HRESULT AppendFrame(const CaptureFrame& frame);
+
+    // 把最多 m_cGatherFrames 个缓冲池中的帧作为一个分散/聚集写请求提交，帧头写在帧头块中
+    HRESULT GatherFrames(const CaptureFrame* pFrames, UINT32 cFrames);
+
+    // 从 pPool 取一个空闲块，没有空闲块时等待写完
+    HRESULT AcquireBlock(CFramePool* pPool, CFrameBuffer** ppBuffer);
+
+    // 从缓冲池取一个空闲块作为当前块，没有空闲块时等待写完
+    HRESULT AcquireBatch();
+
+    // 把当前块提交给 CAsyncFileWriter
+    HRESULT SubmitBatch();
+
+    std::wstring            m_fileName;     // 输出文件路径
+    RawContainer            m_container;    // 文件格式
+    BOOL                    m_bDirect;      // 是否请求直接 I/O
+    AsyncIoBackend          m_ioBackend;    // 请求的异步写入方式
+    size_t                  m_cbBatch;      // 块大小
+    UINT32                  m_cBatches;     // 块数
+    VideoFormat             m_format;       // 输入格式
+    UINT32                  m_cbFrame;      // 每帧数据的字节数
+    CDirectFile             m_file;         // 输出文件
+    CAsyncFileWriter        m_writer;       // 异步写入
+    CFramePool*             m_pPool;        // 块的缓冲池，在多次 BeginWriting 之间复用
+    CFrameBuffer*           m_pFill;        // 正在填充的块，为空时下次追加再取
+    size_t                  m_cbFill;       // 当前块已填充的字节数
+    UINT64                  m_cbSubmitted;  // 已提交的数据在文件中占用的字节数，即当前块的文件偏移
+    UINT64                  m_cbLogical;    // 已追加的逻辑字节数
+    std::atomic<UINT64>     m_cStalls;      // 等待空闲块的次数
+    UINT32                  m_cGatherFrames;    // 每个分散/聚集写请求最多的帧数，0 表示关闭
+    CFramePool*             m_pHeaderPool;      // 帧头块的缓冲池，块数即同时在写的分散/聚集写请求数上限
+    std::atomic<UINT64>     m_cGathers;         // 分散/聚集写请求数
+    FileSegment             m_segments[MAX_GATHER_SEGMENTS];        // 一个请求的各段
+    CFrameBuffer*           m_pHeld[MAX_GATHER_SEGMENTS / 2 + 1];   // 一个请求持有的帧头块和帧缓冲区
+};
+
+// CRawFileSinkFactory 类为分段写入的每一段创建 CRawFileSink
+class CRawFileSinkFactory : public IFrameSinkFactory
+{
+public:
+    CRawFileSinkFactory() : m_container(RawContainer_Raw), m_bDirect(TRUE) {}
+
+    // 设置文件格式和是否使用直接 I/O，在创建接收器之前调用
+    void    SetContainer(RawContainer container, BOOL bDirect) { m_container = container; m_bDirect = bDirect; }
+
+    // 文件格式
+    RawContainer GetContainer() const { return m_container; }
+
+    HRESULT CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink)
+    {
+        *ppSink = new (std::nothrow) CRawFileSink(pwszPath, m_container, m_bDirect);
+        return *ppSink ? S_OK : E_OUTOFMEMORY;
+    }
+
+    HRESULT RemoveFile(const WCHAR* pwszPath)
+    {
+        return CDirectFile::Remove(pwszPath);
+    }
+
+private:
+    RawContainer    m_container;    // 文件格式
+    BOOL            m_bDirect;      // 是否使用直接 I/O
+};
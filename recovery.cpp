@@ -0,0 +1,344 @@
+#include <wctype.h>
+#include "recovery.h"
+
+// 不区分大小写比较两个符号链接
+static BOOL IsSameLink(const std::wstring& a, const std::wstring& b)
+{
+    if (a.size() != b.size())
+    {
+        return FALSE;
+    }
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (towlower(a[i]) != towlower(b[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// 放入一个事件
+void CDeviceEventQueue::Post(DeviceEventType type, const WCHAR* pwszLink, HRESULT hr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_bClosed || pwszLink == nullptr)
+    {
+        return;
+    }
+
+    DeviceEvent event = { type, pwszLink, hr };
+    m_events.push_back(event);
+    m_cvEvent.notify_one();
+}
+
+// 取出下一个事件
+HRESULT CDeviceEventQueue::Wait(DWORD timeoutMs, DeviceEvent* pEvent)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto ready = [this]() { return m_bClosed || !m_events.empty(); };
+
+    if (timeoutMs == INFINITE)
+    {
+        m_cvEvent.wait(lock, ready);
+    }
+    else if (!m_cvEvent.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready))
+    {
+        return S_FALSE;
+    }
+
+    if (m_bClosed)
+    {
+        return E_ABORT;
+    }
+
+    *pEvent = m_events.front();
+    m_events.pop_front();
+    return S_OK;
+}
+
+// 打开队列
+void CDeviceEventQueue::Open()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_bClosed = FALSE;
+}
+
+// 关闭队列
+void CDeviceEventQueue::Close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bClosed = TRUE;
+    m_cvEvent.notify_all();
+}
+
+CDeviceRecovery::CDeviceRecovery() :
+    m_llRetry(DEFAULT_RECOVERY_RETRY_MS * (HNS_PER_SECOND / 1000)),
+    m_llFallbackDelay(DEFAULT_FALLBACK_DELAY_MS * (HNS_PER_SECOND / 1000))
+{
+    m_queue.Close();
+}
+
+CDeviceRecovery::~CDeviceRecovery()
+{
+    Stop();
+}
+
+// 添加一路采集
+HRESULT CDeviceRecovery::AddCapture(IRecoverableCapture* pCapture)
+{
+    if (pCapture == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    Entry entry = { pCapture, pCapture->GetDeviceLink(), 0, 0, RecoveryStatus() };
+    m_entries.push_back(entry);
+    return S_OK;
+}
+
+// 添加一个后备设备
+void CDeviceRecovery::AddSpareDevice(const WCHAR* pwszLink)
+{
+    if (pwszLink && !IsInUse(pwszLink))
+    {
+        RemoveSpare(pwszLink);
+        m_spares.push_back(pwszLink);
+    }
+}
+
+// 设置重试间隔和改用后备设备的延迟
+void CDeviceRecovery::SetTiming(UINT32 retryMs, UINT32 fallbackDelayMs)
+{
+    m_llRetry = (LONGLONG)(retryMs ? retryMs : DEFAULT_RECOVERY_RETRY_MS) * (HNS_PER_SECOND / 1000);
+    m_llFallbackDelay = (LONGLONG)(fallbackDelayMs ? fallbackDelayMs : DEFAULT_FALLBACK_DELAY_MS) * (HNS_PER_SECOND / 1000);
+}
+
+// 启动事件线程
+HRESULT CDeviceRecovery::Start()
+{
+    if (m_thread.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_queue.Open();
+    m_thread = std::thread(&CDeviceRecovery::EventThread, this);
+    return S_OK;
+}
+
+// 停止事件线程
+void CDeviceRecovery::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_queue.Close();
+        m_thread.join();
+    }
+}
+
+// 移除所有采集和后备设备
+void CDeviceRecovery::Clear()
+{
+    if (!m_thread.joinable())
+    {
+        m_entries.clear();
+        m_spares.clear();
+    }
+}
+
+// 获取第 index 路的恢复状态
+void CDeviceRecovery::GetStatus(UINT32 index, RecoveryStatus* pStatus) const
+{
+    std::lock_guard<std::mutex> lock(m_statusMutex);
+    *pStatus = m_entries[index].status;
+}
+
+// 事件线程：有丢失的路时每隔重试间隔醒来一次，否则只等事件
+void CDeviceRecovery::EventThread()
+{
+    UINT32 cLost = 0;
+
+    for (;;)
+    {
+        DeviceEvent event;
+        DWORD timeoutMs = cLost ? (DWORD)(m_llRetry / (HNS_PER_SECOND / 1000)) : INFINITE;
+        HRESULT hr = m_queue.Wait(timeoutMs, &event);
+
+        if (hr == E_ABORT)
+        {
+            break;
+        }
+        if (hr == S_OK)
+        {
+            HandleEvent(event);
+        }
+
+        cLost = RetryLost();
+    }
+}
+
+// 处理一个事件
+void CDeviceRecovery::HandleEvent(const DeviceEvent& event)
+{
+    switch (event.type)
+    {
+    case DeviceEvent_Arrival:
+        if (!IsInUse(event.symbolicLink))
+        {
+            RemoveSpare(event.symbolicLink);
+            m_spares.push_back(event.symbolicLink);
+        }
+
+        // 可能是丢失的设备回来了，也可能是新的后备设备，丢失的各路都立即重试
+        for (size_t i = 0; i < m_entries.size(); i++)
+        {
+            m_entries[i].llLastAttempt = 0;
+        }
+        break;
+
+    case DeviceEvent_Removal:
+        RemoveSpare(event.symbolicLink);
+        SuspendCapture(event.symbolicLink.c_str());
+        break;
+
+    case DeviceEvent_Error:
+        // 出错的设备可能仍然在，下一次 RetryLost 立即重新激活它
+        SuspendCapture(event.symbolicLink.c_str());
+        break;
+    }
+}
+
+// 暂停使用 pwszLink 的那一路，已处于丢失状态时不重新计时
+void CDeviceRecovery::SuspendCapture(const WCHAR* pwszLink)
+{
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        Entry& entry = m_entries[i];
+
+        if (entry.status.bLost || !IsSameLink(entry.link, pwszLink))
+        {
+            continue;
+        }
+
+        entry.pCapture->SuspendDevice();
+        entry.llLost = GetClockTime();
+        entry.llLastAttempt = 0;
+
+        std::lock_guard<std::mutex> lock(m_statusMutex);
+        entry.status.bLost = TRUE;
+    }
+}
+
+// 先尝试原设备，丢失超过后备延迟后再依次尝试后备设备
+UINT32 CDeviceRecovery::RetryLost()
+{
+    LONGLONG llNow = GetClockTime();
+    UINT32 cLost = 0;
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        Entry& entry = m_entries[i];
+
+        if (!entry.status.bLost)
+        {
+            continue;
+        }
+
+        if (llNow - entry.llLastAttempt < m_llRetry)
+        {
+            cLost++;
+            continue;
+        }
+
+        entry.llLastAttempt = llNow;
+
+        if (TryResume(&entry, entry.link))
+        {
+            continue;
+        }
+
+        if (llNow - entry.llLost >= m_llFallbackDelay)
+        {
+            std::vector<std::wstring> spares = m_spares;
+            BOOL bResumed = FALSE;
+
+            for (size_t j = 0; j < spares.size() && !bResumed; j++)
+            {
+                if (!IsInUse(spares[j]) && TryResume(&entry, spares[j]))
+                {
+                    RemoveSpare(spares[j]);
+                    bResumed = TRUE;
+                }
+            }
+
+            if (bResumed)
+            {
+                continue;
+            }
+        }
+
+        cLost++;
+    }
+
+    return cLost;
+}
+
+// 用 link 指定的设备恢复一路，换了设备时原设备不再属于这一路，回来后作为后备设备
+BOOL CDeviceRecovery::TryResume(Entry* pEntry, const std::wstring& link)
+{
+    HRESULT hr = pEntry->pCapture->ResumeDevice(link.c_str());
+    BOOL bFallback = !IsSameLink(pEntry->link, link);
+
+    std::lock_guard<std::mutex> lock(m_statusMutex);
+
+    pEntry->status.cAttempts++;
+
+    if (FAILED(hr))
+    {
+        return FALSE;
+    }
+
+    if (bFallback)
+    {
+        pEntry->status.cFallbacks++;
+        pEntry->link = link;
+    }
+    pEntry->status.bLost = FALSE;
+    return TRUE;
+}
+
+// 设备是否被某一路使用
+BOOL CDeviceRecovery::IsInUse(const std::wstring& link) const
+{
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        if (IsSameLink(m_entries[i].link, link))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+// 从后备设备中删除
+void CDeviceRecovery::RemoveSpare(const std::wstring& link)
+{
+    for (size_t i = 0; i < m_spares.size(); i++)
+    {
+        if (IsSameLink(m_spares[i], link))
+        {
+            m_spares.erase(m_spares.begin() + i);
+            return;
+        }
+    }
+}
@@ -0,0 +1,166 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "frame.h"
+
+// 设备丢失后重新尝试恢复的间隔（毫秒）
+const UINT32 DEFAULT_RECOVERY_RETRY_MS = 500;
+
+// 原设备丢失多久之后改用后备设备（毫秒）
+const UINT32 DEFAULT_FALLBACK_DELAY_MS = 3000;
+
+// DeviceEventType 枚举设备事件的类型
+enum DeviceEventType
+{
+    DeviceEvent_Arrival = 0,    // 设备接入
+    DeviceEvent_Removal,        // 设备移除
+    DeviceEvent_Error,          // 采集出错，例如源读取器报告设备已失效
+};
+
+// DeviceEvent 结构体描述一个设备事件
+struct DeviceEvent
+{
+    DeviceEventType type;           // 类型
+    std::wstring    symbolicLink;   // 设备的符号链接
+    HRESULT         hr;             // DeviceEvent_Error 的错误码
+};
+
+// CDeviceEventQueue 类是设备事件的队列，可以从任意线程放入
+// Windows 上 CCaptureManager 把 WM_DEVICECHANGE 转成事件放入，CCapture 在采集出错时放入 DeviceEvent_Error；
+// 测试时直接放入模拟的事件，不需要真实的设备
+class CDeviceEventQueue
+{
+public:
+    CDeviceEventQueue() : m_bClosed(FALSE) {}
+
+    // 放入一个事件，队列已关闭时丢弃
+    void    Post(DeviceEventType type, const WCHAR* pwszLink, HRESULT hr = S_OK);
+
+    // 取出下一个事件，队列为空时最多等待 timeoutMs 毫秒（INFINITE 表示一直等待）；
+    // 超时返回 S_FALSE，队列已关闭时返回 E_ABORT
+    HRESULT Wait(DWORD timeoutMs, DeviceEvent* pEvent);
+
+    // 打开队列并清空其中的事件
+    void    Open();
+
+    // 关闭队列，唤醒等待的线程
+    void    Close();
+
+private:
+    std::mutex              m_mutex;    // 保护以下成员
+    std::condition_variable m_cvEvent;  // 通知有新事件或队列已关闭
+    std::deque<DeviceEvent> m_events;   // 事件
+    BOOL                    m_bClosed;  // 是否已关闭
+};
+
+// IRecoverableCapture 接口：设备丢失后可以换一个设备接着录制的一路采集，由 CCapture 实现
+// 两个方法都只由 CDeviceRecovery 的事件线程调用
+class IRecoverableCapture
+{
+public:
+    virtual ~IRecoverableCapture() {}
+
+    // 正在使用（丢失时为最后使用）的设备的符号链接
+    virtual std::wstring GetDeviceLink() = 0;
+
+    // 释放设备并停止送帧，接收器保持打开，之后的帧时间戳接着丢失前的帧
+    virtual HRESULT SuspendDevice() = 0;
+
+    // 打开 pwszLink 指定的设备，按丢失前的格式接着送帧；设备不可用或不支持该格式时返回错误，保持丢失状态
+    virtual HRESULT ResumeDevice(const WCHAR* pwszLink) = 0;
+};
+
+// RecoveryStatus 结构体保存一路采集的恢复状态，恢复时长见 PipelineStats
+struct RecoveryStatus
+{
+    BOOL    bLost;          // 是否处于丢失状态
+    UINT32  cAttempts;      // 尝试恢复的次数
+    UINT32  cFallbacks;     // 改用其他设备恢复的次数
+};
+
+// CDeviceRecovery 类在后台线程中处理设备事件，设备丢失时保持接收器打开并恢复采集：
+//   移除或采集出错：暂停该路（SuspendDevice），流水线记下丢失时刻
+//   之后每隔重试间隔（或有设备接入时立即）先尝试原设备，原设备丢失超过后备延迟后依次尝试没有在使用的后备设备
+//   接入的设备没有被任何一路使用时加入后备设备；移除时从后备设备中删除
+// 每路只会使用自己的设备或后备设备，一路丢失期间它的设备不会被其他路拿走
+class CDeviceRecovery
+{
+public:
+    CDeviceRecovery();
+    ~CDeviceRecovery();
+
+    // 添加一路采集，在 Start 之前调用；pCapture 必须在 Stop 之后才能释放
+    HRESULT AddCapture(IRecoverableCapture* pCapture);
+
+    // 添加一个后备设备（已接入但没有在使用），在 Start 之前调用；之后接入的设备由事件自动加入
+    void    AddSpareDevice(const WCHAR* pwszLink);
+
+    // 设置重试间隔和改用后备设备的延迟（毫秒），0 表示取默认值，在 Start 之前调用
+    void    SetTiming(UINT32 retryMs, UINT32 fallbackDelayMs);
+
+    // 事件队列，供 CCaptureManager、CCapture 和测试放入事件
+    CDeviceEventQueue* GetEventQueue() { return &m_queue; }
+
+    // 启动事件线程
+    HRESULT Start();
+
+    // 停止事件线程，处于丢失状态的各路保持暂停
+    void    Stop();
+
+    // 移除所有采集和后备设备，在 Stop 之后调用
+    void    Clear();
+
+    // 采集路数
+    UINT32  Count() const { return (UINT32)m_entries.size(); }
+
+    // 获取第 index 路的恢复状态
+    void    GetStatus(UINT32 index, RecoveryStatus* pStatus) const;
+
+private:
+    CDeviceRecovery(const CDeviceRecovery&);
+    CDeviceRecovery& operator=(const CDeviceRecovery&);
+
+    // Entry 结构体保存一路采集
+    struct Entry
+    {
+        IRecoverableCapture*    pCapture;       // 采集
+        std::wstring            link;           // 正在使用（丢失时为最后使用）的设备
+        LONGLONG                llLost;         // 丢失的时刻
+        LONGLONG                llLastAttempt;  // 上一次尝试恢复的时刻，0 表示立即尝试
+        RecoveryStatus          status;         // 状态
+    };
+
+    // 事件线程
+    void    EventThread();
+
+    // 处理一个事件
+    void    HandleEvent(const DeviceEvent& event);
+
+    // 暂停使用 pwszLink 的那一路
+    void    SuspendCapture(const WCHAR* pwszLink);
+
+    // 尝试恢复到期的各路，返回仍处于丢失状态的路数
+    UINT32  RetryLost();
+
+    // 用 link 指定的设备恢复一路
+    BOOL    TryResume(Entry* pEntry, const std::wstring& link);
+
+    // 设备是否被某一路使用（包括丢失中的路）
+    BOOL    IsInUse(const std::wstring& link) const;
+
+    // 从后备设备中删除
+    void    RemoveSpare(const std::wstring& link);
+
+    std::vector<Entry>          m_entries;      // 各路
+    std::vector<std::wstring>   m_spares;       // 后备设备，按加入顺序
+    CDeviceEventQueue           m_queue;        // 事件队列
+    std::thread                 m_thread;       // 事件线程
+    mutable std::mutex          m_statusMutex;  // 保护各路的 status
+    LONGLONG                    m_llRetry;      // 重试间隔（100 纳秒）
+    LONGLONG                    m_llFallbackDelay; // 改用后备设备的延迟（100 纳秒）
+};
@@ -0,0 +1,384 @@
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "replay.h"
+#include "pipeline.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 哈希的初值和乘数
+static const UINT64 c_hashSeed = 0xCBF29CE484222325ull;
+static const UINT64 c_hashMultiplier = 0x9E3779B97F4A7C15ull;
+
+// 把数据并入哈希：按 8 字节（小端）一组乘法混合，余下的字节逐个混合；只用于比较结果是否一致，不抗碰撞
+static UINT64 HashBytes(UINT64 hash, const void* pData, size_t cbData)
+{
+    const BYTE* p = (const BYTE*)pData;
+
+    for (; cbData >= 8; p += 8, cbData -= 8)
+    {
+        UINT64 word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * c_hashMultiplier;
+        hash ^= hash >> 32;
+    }
+
+    for (; cbData > 0; p++, cbData--)
+    {
+        hash = (hash ^ *p) * c_hashMultiplier;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+CReplaySource::CReplaySource(const WCHAR* pwszFileName, double fSpeed) :
+    m_fileName(pwszFileName ? pwszFileName : L""),
+    m_fSpeed(fSpeed > 0 ? fSpeed : REPLAY_UNTHROTTLED),
+    m_pView(nullptr),
+    m_cbView(0),
+    m_cbHeader(0),
+    m_cbFrame(0),
+    m_cFrames(0),
+    m_llFirst(0),
+    m_llDuration(0),
+    m_nFrame(0),
+    m_llStartTime(0)
+{
+    m_format = VideoFormat();
+}
+
+CReplaySource::~CReplaySource()
+{
+    Close();
+}
+
+// 只读映射整个文件，检查文件头，由文件长度算出帧数，再去掉末尾帧头无效的帧（直接 I/O 补齐的零）
+HRESULT CReplaySource::Open()
+{
+    if (m_pView)
+    {
+        return E_UNEXPECTED;
+    }
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileW(m_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    LARGE_INTEGER size;
+    HRESULT hr = S_OK;
+
+    if (!GetFileSizeEx(hFile, &size))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if ((UINT64)size.QuadPart < sizeof(RawFileHeader))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 映射建立后文件句柄和映射句柄都可以关闭，视图仍然有效
+        HANDLE hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+        if (hMapping == nullptr)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else
+        {
+            m_pView = (const BYTE*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            if (m_pView == nullptr)
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+            CloseHandle(hMapping);
+        }
+    }
+
+    CloseHandle(hFile);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_cbView = (UINT64)size.QuadPart;
+#else
+    size_t cch = wcstombs(nullptr, m_fileName.c_str(), 0);
+
+    if (cch == (size_t)-1)
+    {
+        return E_INVALIDARG;
+    }
+
+    std::vector<char> path(cch + 1);
+    wcstombs(path.data(), m_fileName.c_str(), cch + 1);
+
+    int fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+    {
+        return HResultFromErrno(errno);
+    }
+
+    struct stat st;
+    HRESULT hr = S_OK;
+
+    if (fstat(fd, &st) != 0)
+    {
+        hr = HResultFromErrno(errno);
+    }
+    else if ((UINT64)st.st_size < sizeof(RawFileHeader))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // 映射建立后即可关闭文件描述符
+        void* pView = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (pView == MAP_FAILED)
+        {
+            hr = HResultFromErrno(errno);
+        }
+        else
+        {
+            madvise(pView, (size_t)st.st_size, MADV_SEQUENTIAL);
+            m_pView = (const BYTE*)pView;
+            m_cbView = (UINT64)st.st_size;
+        }
+    }
+
+    close(fd);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+#endif
+
+    RawFileHeader header;
+    memcpy(&header, m_pView, sizeof(header));
+
+    m_format.subtype = header.subtype;
+    m_format.width = header.width;
+    m_format.height = header.height;
+    m_format.fpsNumerator = header.fpsNumerator;
+    m_format.fpsDenominator = header.fpsDenominator;
+
+    if (header.magic != RAW_FILE_MAGIC || header.version != 1 || header.cbFrameHeader != sizeof(RawFrameHeader) ||
+        header.cbHeader < sizeof(RawFileHeader) || header.cbHeader > m_cbView ||
+        header.cbFrame == 0 || header.cbFrame != GetFrameSize(m_format))
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    m_cbHeader = header.cbHeader;
+    m_cbFrame = header.cbFrame;
+    m_cFrames = (m_cbView - m_cbHeader) / (sizeof(RawFrameHeader) + m_cbFrame);
+
+    RawFrameHeader frame;
+
+    while (m_cFrames > 0)
+    {
+        GetFrameHeader(m_cFrames - 1, &frame);
+
+        if (frame.magic == RAW_FRAME_MAGIC && frame.cbData == m_cbFrame)
+        {
+            break;
+        }
+        m_cFrames--;
+    }
+
+    m_llFirst = 0;
+    m_llDuration = 0;
+
+    if (m_cFrames > 0)
+    {
+        LONGLONG llLast = frame.llTimestamp;
+
+        GetFrameHeader(0, &frame);
+        m_llFirst = frame.llTimestamp;
+        m_llDuration = llLast - m_llFirst;
+    }
+
+    m_nFrame = 0;
+    m_llStartTime = 0;
+    return S_OK;
+}
+
+// 录制时的格式不能改变，直接返回
+HRESULT CReplaySource::NegotiateFormat(const VideoFormat& requested, VideoFormat* pActual)
+{
+    (void)requested;
+
+    if (pActual == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pView == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pActual = m_format;
+    return S_OK;
+}
+
+// 读取下一帧，节流时等到它相对第一帧的时刻（按倍速缩短）
+HRESULT CReplaySource::ReadFrame(CaptureFrame* pFrame)
+{
+    if (pFrame == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pView == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pFrame = CaptureFrame();
+
+    if (m_nFrame >= m_cFrames)
+    {
+        return S_FALSE;
+    }
+
+    RawFrameHeader header;
+    GetFrameHeader(m_nFrame, &header);
+
+    // 中间的帧头无效说明文件已损坏
+    if (header.magic != RAW_FRAME_MAGIC || header.cbData != m_cbFrame)
+    {
+        return HRESULT_FROM_WIN32(ERROR_BAD_FORMAT);
+    }
+
+    if (m_nFrame == 0)
+    {
+        m_llStartTime = GetClockTime();
+        m_tStart = std::chrono::steady_clock::now();
+    }
+
+    LONGLONG llOffset = header.llTimestamp - m_llFirst;
+
+    if (m_fSpeed > 0 && llOffset > 0)
+    {
+        std::chrono::duration<double, std::ratio<1, HNS_PER_SECOND>> delay(llOffset / m_fSpeed);
+        std::this_thread::sleep_until(m_tStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+    }
+
+    // 映射是只读的，流水线只会从 pData 拷贝，不会写入
+    UINT64 offset = m_cbHeader + m_nFrame * (sizeof(RawFrameHeader) + m_cbFrame) + sizeof(RawFrameHeader);
+
+    pFrame->pData = const_cast<BYTE*>(m_pView + offset);
+    pFrame->cbData = header.cbData;
+    pFrame->llTimestamp = m_llStartTime + header.llTimestamp;
+    pFrame->nSequence = header.nSequence;
+
+    m_nFrame++;
+    return S_OK;
+}
+
+// 解除映射
+void CReplaySource::Close()
+{
+    if (m_pView)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pView);
+#else
+        munmap(const_cast<BYTE*>(m_pView), (size_t)m_cbView);
+#endif
+        m_pView = nullptr;
+        m_cbView = 0;
+    }
+}
+
+// 推模式：与 CCapture::OnReadSample 相同，记录设备延迟，时间戳减去第一帧的时间戳后 PushFrame（拷贝进缓冲池）
+HRESULT CReplaySource::PushTo(CFramePipeline* pPipeline)
+{
+    if (pPipeline == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    LONGLONG llBaseTime = 0;
+    BOOL bFirstSample = TRUE;
+    HRESULT hr = S_OK;
+
+    for (;;)
+    {
+        CaptureFrame frame;
+
+        hr = ReadFrame(&frame);
+        if (hr != S_OK)
+        {
+            break;
+        }
+
+#if ENABLE_LATENCY_STATS
+        pPipeline->RecordLatency(LatencyStage_Device, GetLatencyClock() - frame.llTimestamp * 100);
+#endif
+
+        if (bFirstSample)
+        {
+            llBaseTime = frame.llTimestamp;
+            bFirstSample = FALSE;
+        }
+
+        frame.llTimestamp -= llBaseTime;
+
+        hr = pPipeline->PushFrame(frame);
+        if (FAILED(hr))
+        {
+            break;
+        }
+    }
+
+    return FAILED(hr) ? hr : S_OK;
+}
+
+// 读取第 n 帧的帧头
+void CReplaySource::GetFrameHeader(UINT64 n, RawFrameHeader* pHeader) const
+{
+    memcpy(pHeader, m_pView + m_cbHeader + n * (sizeof(RawFrameHeader) + m_cbFrame), sizeof(RawFrameHeader));
+}
+
+// 哈希从格式开始
+HRESULT CFrameHashSink::BeginWriting(const VideoFormat& format)
+{
+    UINT32 fields[] = { format.subtype, format.width, format.height, format.fpsNumerator, format.fpsDenominator };
+
+    m_hash = HashBytes(c_hashSeed, fields, sizeof(fields));
+    m_cFrames = 0;
+    m_cbWritten = 0;
+    return S_OK;
+}
+
+// 依次并入时间戳、标志、长度和数据；帧序号由流水线分配，不计入
+HRESULT CFrameHashSink::WriteFrame(const CaptureFrame& frame)
+{
+    UINT64 fields[] = { (UINT64)frame.llTimestamp, frame.flags, frame.cbData };
+
+    m_hash = HashBytes(m_hash, fields, sizeof(fields));
+    m_hash = HashBytes(m_hash, frame.pData, frame.cbData);
+    m_cFrames++;
+    m_cbWritten += frame.cbData;
+    return S_OK;
+}
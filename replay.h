@@ -0,0 +1,108 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <string>
+#include <chrono>
+#include "source.h"
+#include "sink.h"
+#include "rawsink.h"
+
+// 回放速度取此值时不节流，尽可能快地送帧
+const double REPLAY_UNTHROTTLED = 0;
+
+class CFramePipeline;
+
+// CReplaySource 类把 CRawFileSink 录制的原始文件（RawContainer_Raw）按原来的帧数据和时间戳重新送进流水线，
+// 用于复现现场问题，以及把长时间的录制当作可重复的吞吐测试
+//
+// 文件只读映射到内存，ReadFrame 返回的数据直接指向映射，不经过读缓冲；帧数由文件长度算出，
+// 末尾不完整的帧和直接 I/O 补齐的零（例如录制中断，没有执行 Finalize）被忽略
+// 送出的时间戳是录制的时间戳加上开始回放时的时钟（GetClockTime），流水线减去第一帧的时间戳后与录制时完全相同；
+// 按 fSpeed 倍速节流（帧间隔取录制的时间戳之差），REPLAY_UNTHROTTLED 时不节流
+//
+// 拉模式直接作为 ICaptureSource 交给 CFramePipeline::Start；推模式用 PushTo，像 CCapture::OnReadSample 那样逐帧 PushFrame
+// 不节流时应把流水线的过载策略设为 OverloadPolicy_Block 并给足等待时长，否则写出跟不上时会丢帧，结果随机器快慢变化
+class CReplaySource : public ICaptureSource
+{
+public:
+    // fSpeed 为回放倍速，REPLAY_UNTHROTTLED 表示不节流
+    CReplaySource(const WCHAR* pwszFileName, double fSpeed = 1.0);
+    virtual ~CReplaySource();
+
+    // 映射文件并检查文件头；不是原始文件（例如 Y4M）时返回 HRESULT_FROM_WIN32(ERROR_BAD_FORMAT)
+    HRESULT Open();
+
+    // 返回录制时的格式，与请求的格式无关
+    HRESULT NegotiateFormat(const VideoFormat& requested, VideoFormat* pActual);
+
+    // 读取下一帧，pFrame->pData 指向只读的映射，不能写入；文件结束时返回 S_FALSE
+    HRESULT ReadFrame(CaptureFrame* pFrame);
+
+    // 解除映射
+    void    Close();
+
+    // 推模式：在调用线程上把剩余的帧逐帧交给已用 Start(format, pSink) 启动的流水线，时间戳的校正和
+    // 延迟记录与 CCapture::OnReadSample 相同；流水线丢弃的帧不算错误，写入失败时返回该错误
+    HRESULT PushTo(CFramePipeline* pPipeline);
+
+    // 录制时的格式
+    const VideoFormat& GetFormat() const { return m_format; }
+
+    // 文件中完整的帧数
+    UINT64  GetFrameCount() const { return m_cFrames; }
+
+    // 最后一帧与第一帧的时间戳之差（100 纳秒）
+    LONGLONG GetDuration() const { return m_llDuration; }
+
+    // 已读取的帧数
+    UINT64  FramesRead() const { return m_nFrame; }
+
+private:
+    CReplaySource(const CReplaySource&);
+    CReplaySource& operator=(const CReplaySource&);
+
+    // 读取第 n 帧的帧头，帧头不一定按 8 字节对齐
+    void    GetFrameHeader(UINT64 n, RawFrameHeader* pHeader) const;
+
+    std::wstring    m_fileName;     // 录制文件路径
+    double          m_fSpeed;       // 回放倍速
+    VideoFormat     m_format;       // 录制时的格式
+    const BYTE*     m_pView;        // 文件的只读映射
+    UINT64          m_cbView;       // 映射的大小
+    UINT32          m_cbHeader;     // 文件头占用的字节数
+    UINT32          m_cbFrame;      // 每帧数据的字节数
+    UINT64          m_cFrames;      // 完整的帧数
+    LONGLONG        m_llFirst;      // 第一帧录制的时间戳
+    LONGLONG        m_llDuration;   // 最后一帧与第一帧的时间戳之差
+    UINT64          m_nFrame;       // 下一帧的序号
+    LONGLONG        m_llStartTime;  // 开始回放时的时钟（100 纳秒）
+    std::chrono::steady_clock::time_point m_tStart; // 节流的起始时刻
+};
+
+// CFrameHashSink 类不写文件，只对写出的帧计算 64 位哈希（格式，以及每帧的时间戳、标志、长度和数据）；
+// 同一段录制在两个构建上回放得到相同的哈希，说明写出的帧和时间戳逐位一致
+class CFrameHashSink : public IFrameSink
+{
+public:
+    CFrameHashSink() : m_hash(0), m_cFrames(0), m_cbWritten(0) {}
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+    HRESULT Finalize() { return S_OK; }
+
+    HRESULT GetBytesWritten(UINT64* pcbWritten)
+    {
+        *pcbWritten = m_cbWritten;
+        return S_OK;
+    }
+
+    // 到目前为止的哈希
+    UINT64  GetHash() const { return m_hash; }
+
+    // 已写入的帧数
+    UINT64  FramesWritten() const { return m_cFrames; }
+
+private:
+    UINT64  m_hash;         // 哈希
+    UINT64  m_cFrames;      // 已写入帧数
+    UINT64  m_cbWritten;    // 已写入字节数
+};
@@ -0,0 +1,549 @@
+#include <string.h>
+#include "scale.h"
+
+#ifdef PLATFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+// 纵向混合两行：dst = (r0 * (256 - w) + r1 * w + 128) >> 8，w 为 0-255
+typedef void (*PFN_BLEND_ROWS)(const BYTE* pRow0, const BYTE* pRow1, UINT32 weight, BYTE* pDst, UINT32 count);
+
+// 纵向累加一行：bFirst 为 TRUE 时覆盖 pSums，否则加到 pSums 上
+typedef void (*PFN_ACCUMULATE_ROW)(const BYTE* pRow, WORD* pSums, UINT32 count, BOOL bFirst);
+
+static void BlendRows_C(const BYTE* pRow0, const BYTE* pRow1, UINT32 weight, BYTE* pDst, UINT32 count)
+{
+    for (UINT32 i = 0; i < count; i++)
+    {
+        pDst[i] = (BYTE)((pRow0[i] * (256 - weight) + pRow1[i] * weight + 128) >> 8);
+    }
+}
+
+static void AccumulateRow_C(const BYTE* pRow, WORD* pSums, UINT32 count, BOOL bFirst)
+{
+    for (UINT32 i = 0; i < count; i++)
+    {
+        pSums[i] = (WORD)((bFirst ? 0 : pSums[i]) + pRow[i]);
+    }
+}
+
+#ifdef PLATFORM_X86
+
+// 16 位乘加：最大值 255 * 256 + 128 不超过 65535，按无符号解释后逻辑右移即可
+static void BlendRows_SSE2(const BYTE* pRow0, const BYTE* pRow1, UINT32 weight, BYTE* pDst, UINT32 count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w0 = _mm_set1_epi16((short)(256 - weight));
+    const __m128i w1 = _mm_set1_epi16((short)weight);
+    const __m128i round = _mm_set1_epi16(128);
+    UINT32 i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pRow0 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pRow1 + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128((__m128i*)(pDst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    BlendRows_C(pRow0 + i, pRow1 + i, weight, pDst + i, count - i);
+}
+
+static void AccumulateRow_SSE2(const BYTE* pRow, WORD* pSums, UINT32 count, BOOL bFirst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    UINT32 i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(pRow + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        if (!bFirst)
+        {
+            lo = _mm_add_epi16(lo, _mm_loadu_si128((const __m128i*)(pSums + i)));
+            hi = _mm_add_epi16(hi, _mm_loadu_si128((const __m128i*)(pSums + i + 8)));
+        }
+
+        _mm_storeu_si128((__m128i*)(pSums + i), lo);
+        _mm_storeu_si128((__m128i*)(pSums + i + 8), hi);
+    }
+
+    AccumulateRow_C(pRow + i, pSums + i, count - i, bFirst);
+}
+
+// unpack 在 128 位通道内进行，packus 按同样的通道拼回，输出顺序与输入一致
+TARGET_AVX2 static void BlendRows_AVX2(const BYTE* pRow0, const BYTE* pRow1, UINT32 weight, BYTE* pDst, UINT32 count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i w0 = _mm256_set1_epi16((short)(256 - weight));
+    const __m256i w1 = _mm256_set1_epi16((short)weight);
+    const __m256i round = _mm256_set1_epi16(128);
+    UINT32 i = 0;
+
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(pRow0 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(pRow1 + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), w0),
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), w1));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), w0),
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), w1));
+
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+        _mm256_storeu_si256((__m256i*)(pDst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    BlendRows_SSE2(pRow0 + i, pRow1 + i, weight, pDst + i, count - i);
+}
+
+TARGET_AVX2 static void AccumulateRow_AVX2(const BYTE* pRow, WORD* pSums, UINT32 count, BOOL bFirst)
+{
+    UINT32 i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pRow + i)));
+
+        if (!bFirst)
+        {
+            v = _mm256_add_epi16(v, _mm256_loadu_si256((const __m256i*)(pSums + i)));
+        }
+
+        _mm256_storeu_si256((__m256i*)(pSums + i), v);
+    }
+
+    AccumulateRow_C(pRow + i, pSums + i, count - i, bFirst);
+}
+
+#endif // PLATFORM_X86
+
+// 横向插值一行：第 i 个输出像素由源行的第 pX0[i]、pX1[i] 个像素按 pWeight[i] 混合，channels 为 1 或 2
+static void InterpolateRow(const BYTE* pRow, const UINT32* pX0, const UINT32* pX1, const UINT32* pWeight,
+    UINT32 channels, BYTE* pDst, UINT32 count)
+{
+    if (channels == 1)
+    {
+        for (UINT32 i = 0; i < count; i++)
+        {
+            UINT32 w = pWeight[i];
+            pDst[i] = (BYTE)((pRow[pX0[i]] * (256 - w) + pRow[pX1[i]] * w + 128) >> 8);
+        }
+        return;
+    }
+
+    for (UINT32 i = 0; i < count; i++)
+    {
+        const BYTE* pLeft = pRow + pX0[i] * 2;
+        const BYTE* pRight = pRow + pX1[i] * 2;
+        UINT32 w = pWeight[i];
+
+        pDst[i * 2] = (BYTE)((pLeft[0] * (256 - w) + pRight[0] * w + 128) >> 8);
+        pDst[i * 2 + 1] = (BYTE)((pLeft[1] * (256 - w) + pRight[1] * w + 128) >> 8);
+    }
+}
+
+// 横向求平均一行：第 i 个输出像素为纵向累加和中 [pX0[i], pX1[i]) 列之和乘以定点倒数，
+// 列数为 minCols 时用 reciprocals[0]，为 minCols + 1 时用 reciprocals[1]；channels 为 1 或 2
+static void AverageRow(const WORD* pSums, const UINT32* pX0, const UINT32* pX1, UINT32 minCols,
+    const UINT64* reciprocals, UINT32 channels, BYTE* pDst, UINT32 count)
+{
+    for (UINT32 i = 0; i < count; i++)
+    {
+        UINT32 x0 = pX0[i];
+        UINT32 x1 = pX1[i];
+        UINT64 reciprocal = reciprocals[x1 - x0 - minCols];
+
+        if (channels == 1)
+        {
+            UINT32 sum = 0;
+
+            for (UINT32 x = x0; x < x1; x++)
+            {
+                sum += pSums[x];
+            }
+
+            pDst[i] = (BYTE)((sum * reciprocal + (1ULL << 23)) >> 24);
+            continue;
+        }
+
+        UINT32 sum0 = 0;
+        UINT32 sum1 = 0;
+
+        for (UINT32 x = x0; x < x1; x++)
+        {
+            sum0 += pSums[x * 2];
+            sum1 += pSums[x * 2 + 1];
+        }
+
+        pDst[i * 2] = (BYTE)((sum0 * reciprocal + (1ULL << 23)) >> 24);
+        pDst[i * 2 + 1] = (BYTE)((sum1 * reciprocal + (1ULL << 23)) >> 24);
+    }
+}
+
+// 按 SIMD 级别选择纵向混合函数
+static PFN_BLEND_ROWS GetBlendRows(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return BlendRows_AVX2; }
+    if (level >= CpuLevel_SSE2) { return BlendRows_SSE2; }
+#else
+    (void)level;
+#endif
+    return BlendRows_C;
+}
+
+// 按 SIMD 级别选择纵向累加函数
+static PFN_ACCUMULATE_ROW GetAccumulateRow(CpuLevel level)
+{
+#ifdef PLATFORM_X86
+    if (level >= CpuLevel_AVX2) { return AccumulateRow_AVX2; }
+    if (level >= CpuLevel_SSE2) { return AccumulateRow_SSE2; }
+#else
+    (void)level;
+#endif
+    return AccumulateRow_C;
+}
+
+// 双线性的采样位置：目标第 d 个像素的中心对应源中的位置，返回左（上）侧的源像素与右（下）侧的权重
+static void GetBilinearPosition(UINT32 d, UINT32 cSrc, UINT32 cDst, UINT32* pIndex0, UINT32* pIndex1, UINT32* pWeight)
+{
+    LONGLONG pos = (LONGLONG)(2 * d + 1) * cSrc * 65536 / (2 * (LONGLONG)cDst) - 32768;
+    UINT32 index = pos > 0 ? (UINT32)(pos >> 16) : 0;
+
+    if (pos <= 0 || index >= cSrc - 1)
+    {
+        *pIndex0 = pos <= 0 ? 0 : cSrc - 1;
+        *pIndex1 = *pIndex0;
+        *pWeight = 0;
+        return;
+    }
+
+    *pIndex0 = index;
+    *pIndex1 = index + 1;
+    *pWeight = (UINT32)(pos >> 8) & 0xFF;
+}
+
+// 区域平均的范围：目标第 d 个像素覆盖的源像素 [*pStart, *pEnd)
+static void GetBoxRange(UINT32 d, UINT32 cSrc, UINT32 cDst, UINT32* pStart, UINT32* pEnd)
+{
+    *pStart = (UINT32)((UINT64)d * cSrc / cDst);
+    *pEnd = (UINT32)((UINT64)(d + 1) * cSrc / cDst);
+}
+
+// 判断是否支持缩放该像素格式
+BOOL IsScalingSupported(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_I420 || subtype == FOURCC_IYUV;
+}
+
+CFrameScaler::CFrameScaler() :
+    m_filter(ScaleFilter_Bilinear),
+    m_level(CpuLevel_Scalar),
+    m_cPlanes(0)
+{
+    m_input = VideoFormat();
+    m_output = VideoFormat();
+}
+
+// 检查参数，推算裁剪区域和输出大小
+static HRESULT ResolveScaleParams(const VideoFormat& input, const ScaleParams& params, CropRect* pCrop,
+    UINT32* pWidth, UINT32* pHeight)
+{
+    if (!IsScalingSupported(input.subtype) || input.width == 0 || input.height == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    CropRect crop = params.crop;
+
+    if (crop.width == 0 || crop.height == 0)
+    {
+        crop.x = 0;
+        crop.y = 0;
+        crop.width = input.width;
+        crop.height = input.height;
+    }
+
+    UINT32 width = params.width;
+    UINT32 height = params.height;
+
+    if (width == 0 && height == 0)
+    {
+        width = crop.width;
+        height = crop.height;
+    }
+    else if (width == 0)
+    {
+        width = (UINT32)(((UINT64)height * crop.width / crop.height + 1) & ~1ULL);
+    }
+    else if (height == 0)
+    {
+        height = (UINT32)(((UINT64)width * crop.height / crop.width + 1) & ~1ULL);
+    }
+
+    // 4:2:0 的色度按 2x2 共用，裁剪和输出都必须落在偶数边界上
+    if ((crop.x | crop.y | crop.width | crop.height | width | height) & 1 || width == 0 || height == 0 ||
+        crop.x + crop.width > input.width || crop.y + crop.height > input.height)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 区域平均只能缩小，每格最多 256 行，纵向累加的 16 位和不会溢出
+    if (params.filter == ScaleFilter_Box &&
+        (width > crop.width || height > crop.height || crop.height > 256 * height))
+    {
+        return E_INVALIDARG;
+    }
+
+    *pCrop = crop;
+    *pWidth = width;
+    *pHeight = height;
+    return S_OK;
+}
+
+// 推算输出格式
+HRESULT GetScaledFormat(const VideoFormat& input, const ScaleParams& params, VideoFormat* pOutput)
+{
+    CropRect crop;
+    UINT32 width = 0;
+    UINT32 height = 0;
+    HRESULT hr = ResolveScaleParams(input, params, &crop, &width, &height);
+
+    if (SUCCEEDED(hr))
+    {
+        *pOutput = input;
+        pOutput->width = width;
+        pOutput->height = height;
+    }
+
+    return hr;
+}
+
+// 计算各平面的位置和横向列表
+HRESULT CFrameScaler::Initialize(const VideoFormat& input, const ScaleParams& params, CpuLevel level)
+{
+    CropRect crop;
+    UINT32 width = 0;
+    UINT32 height = 0;
+    HRESULT hr = ResolveScaleParams(input, params, &crop, &width, &height);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    size_t cbLuma = (size_t)input.width * input.height;
+    size_t cbLumaOut = (size_t)width * height;
+    Plane* pLuma = &m_planes[0];
+    Plane* pChroma = &m_planes[1];
+
+    pLuma->srcOffset = (size_t)crop.y * input.width + crop.x;
+    pLuma->srcStride = input.width;
+    pLuma->srcWidth = crop.width;
+    pLuma->srcHeight = crop.height;
+    pLuma->dstOffset = 0;
+    pLuma->dstWidth = width;
+    pLuma->dstHeight = height;
+    pLuma->channels = 1;
+
+    pChroma->srcWidth = crop.width / 2;
+    pChroma->srcHeight = crop.height / 2;
+    pChroma->dstOffset = cbLumaOut;
+    pChroma->dstWidth = width / 2;
+    pChroma->dstHeight = height / 2;
+
+    if (input.subtype == FOURCC_NV12)
+    {
+        // 交错的 UV 平面按每像素 2 字节缩放
+        pChroma->srcOffset = cbLuma + (size_t)(crop.y / 2) * input.width + crop.x;
+        pChroma->srcStride = input.width;
+        pChroma->channels = 2;
+        m_cPlanes = 2;
+    }
+    else
+    {
+        Plane* pV = &m_planes[2];
+
+        pChroma->srcOffset = cbLuma + (size_t)(crop.y / 2) * (input.width / 2) + crop.x / 2;
+        pChroma->srcStride = input.width / 2;
+        pChroma->channels = 1;
+
+        pV->srcOffset = pChroma->srcOffset + cbLuma / 4;
+        pV->srcStride = pChroma->srcStride;
+        pV->srcWidth = pChroma->srcWidth;
+        pV->srcHeight = pChroma->srcHeight;
+        pV->dstOffset = cbLumaOut + cbLumaOut / 4;
+        pV->dstWidth = pChroma->dstWidth;
+        pV->dstHeight = pChroma->dstHeight;
+        pV->channels = 1;
+        m_cPlanes = 3;
+    }
+
+    m_filter = params.filter;
+
+    for (UINT32 i = 0; i < m_cPlanes; i++)
+    {
+        hr = InitializePlane(&m_planes[i]);
+
+        if (FAILED(hr))
+        {
+            m_cPlanes = 0;
+            return hr;
+        }
+    }
+
+    try
+    {
+        m_row.resize(crop.width);
+        m_sums.resize(crop.width);
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_cPlanes = 0;
+        return E_OUTOFMEMORY;
+    }
+
+    m_input = input;
+    m_output = input;
+    m_output.width = width;
+    m_output.height = height;
+    m_level = (level > ::GetCpuLevel()) ? ::GetCpuLevel() : level;
+    return S_OK;
+}
+
+// 计算平面的横向列表
+HRESULT CFrameScaler::InitializePlane(Plane* pPlane)
+{
+    try
+    {
+        pPlane->x0.resize(pPlane->dstWidth);
+        pPlane->x1.resize(pPlane->dstWidth);
+        pPlane->weight.resize(pPlane->dstWidth);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    for (UINT32 dx = 0; dx < pPlane->dstWidth; dx++)
+    {
+        if (m_filter == ScaleFilter_Box)
+        {
+            GetBoxRange(dx, pPlane->srcWidth, pPlane->dstWidth, &pPlane->x0[dx], &pPlane->x1[dx]);
+            pPlane->weight[dx] = 0;
+        }
+        else
+        {
+            GetBilinearPosition(dx, pPlane->srcWidth, pPlane->dstWidth, &pPlane->x0[dx], &pPlane->x1[dx],
+                &pPlane->weight[dx]);
+        }
+    }
+
+    return S_OK;
+}
+
+// 缩放一帧
+HRESULT CFrameScaler::Scale(const BYTE* pSrc, BYTE* pDst)
+{
+    if (pSrc == nullptr || pDst == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_cPlanes == 0)
+    {
+        return E_UNEXPECTED;
+    }
+
+    for (UINT32 i = 0; i < m_cPlanes; i++)
+    {
+        ScalePlane(m_planes[i], pSrc, pDst);
+    }
+
+    return S_OK;
+}
+
+// 缩放一个平面：逐个目标行先在纵向得到一行中间结果，再按列表横向取值
+void CFrameScaler::ScalePlane(const Plane& plane, const BYTE* pSrc, BYTE* pDst)
+{
+    const BYTE* pSrcPlane = pSrc + plane.srcOffset;
+    BYTE* pDstRow = pDst + plane.dstOffset;
+    UINT32 channels = plane.channels;
+    UINT32 cbRow = plane.srcWidth * channels;
+    UINT32 cbDstRow = plane.dstWidth * channels;
+
+    if (m_filter == ScaleFilter_Box)
+    {
+        PFN_ACCUMULATE_ROW pfnAccumulate = GetAccumulateRow(m_level);
+        WORD* pSums = m_sums.data();
+        UINT32 minCols = plane.srcWidth / plane.dstWidth;
+
+        for (UINT32 dy = 0; dy < plane.dstHeight; dy++, pDstRow += cbDstRow)
+        {
+            UINT32 y0 = 0;
+            UINT32 y1 = 0;
+
+            GetBoxRange(dy, plane.srcHeight, plane.dstHeight, &y0, &y1);
+
+            for (UINT32 y = y0; y < y1; y++)
+            {
+                pfnAccumulate(pSrcPlane + (size_t)y * plane.srcStride, pSums, cbRow, y == y0);
+            }
+
+            // 每格的列数只有 minCols 和 minCols + 1 两种，按行预先算好两个定点倒数，四舍五入
+            UINT32 rows = y1 - y0;
+            UINT64 reciprocals[2] =
+            {
+                ((1ULL << 24) + minCols * rows / 2) / (minCols * rows),
+                ((1ULL << 24) + (minCols + 1) * rows / 2) / ((minCols + 1) * rows),
+            };
+
+            AverageRow(pSums, plane.x0.data(), plane.x1.data(), minCols, reciprocals, channels, pDstRow, plane.dstWidth);
+        }
+
+        return;
+    }
+
+    PFN_BLEND_ROWS pfnBlend = GetBlendRows(m_level);
+    BYTE* pBlended = m_row.data();
+
+    for (UINT32 dy = 0; dy < plane.dstHeight; dy++, pDstRow += cbDstRow)
+    {
+        UINT32 y0 = 0;
+        UINT32 y1 = 0;
+        UINT32 wy = 0;
+
+        GetBilinearPosition(dy, plane.srcHeight, plane.dstHeight, &y0, &y1, &wy);
+
+        const BYTE* pRow = pSrcPlane + (size_t)y0 * plane.srcStride;
+
+        // 宽度不变时横向的位置正好落在源像素上，纵向结果直接写到目标行
+        if (plane.srcWidth == plane.dstWidth)
+        {
+            if (wy != 0)
+            {
+                pfnBlend(pRow, pRow + plane.srcStride, wy, pDstRow, cbRow);
+            }
+            else
+            {
+                memcpy(pDstRow, pRow, cbRow);
+            }
+            continue;
+        }
+
+        if (wy != 0)
+        {
+            pfnBlend(pRow, pRow + plane.srcStride, wy, pBlended, cbRow);
+            pRow = pBlended;
+        }
+
+        InterpolateRow(pRow, plane.x0.data(), plane.x1.data(), plane.weight.data(), channels, pDstRow, plane.dstWidth);
+    }
+}
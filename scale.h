@@ -0,0 +1,92 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <vector>
+#include "frame.h"
+
+// 缩放滤波器
+enum ScaleFilter
+{
+    ScaleFilter_Bilinear = 0,   // 双线性插值，可放大也可缩小
+    ScaleFilter_Box,            // 区域平均，只能缩小，缩小倍数大时比双线性少混叠
+};
+
+// CropRect 结构体描述输入帧中的一块区域（像素），width 或 height 为 0 表示整帧
+struct CropRect
+{
+    UINT32  x;
+    UINT32  y;
+    UINT32  width;
+    UINT32  height;
+};
+
+// ScaleParams 结构体描述一路缩放输出
+// width 和 height 都为 0 时输出裁剪区域的原始大小；只有一个为 0 时按裁剪区域的宽高比推算，取偶数
+struct ScaleParams
+{
+    UINT32      width;      // 输出宽度
+    UINT32      height;     // 输出高度
+    CropRect    crop;       // 裁剪区域，4:2:0 格式下起点和大小必须为偶数
+    ScaleFilter filter;     // 滤波器
+};
+
+// 判断 CFrameScaler 是否支持该像素格式（4:2:0 的 NV12、I420/IYUV）
+BOOL    IsScalingSupported(UINT32 subtype);
+
+// 按缩放参数推算输出格式（像素格式和帧率与输入相同），参数不合法时返回错误，与 CFrameScaler::Initialize 的检查一致
+HRESULT GetScaledFormat(const VideoFormat& input, const ScaleParams& params, VideoFormat* pOutput);
+
+// CFrameScaler 类从一帧中裁剪出一块区域并缩放到指定大小，输出与输入的像素格式相同
+// 双线性先纵向混合两行再横向插值，区域平均先纵向累加若干行再横向求平均；纵向部分有 SSE2、AVX2 实现，
+// 横向部分按预先计算的列表查表，所有级别的输出逐位一致；表和中间行在 Initialize 中一次性分配
+class CFrameScaler
+{
+public:
+    CFrameScaler();
+
+    // 设置输入格式和输出参数；level 超过 CPU 支持的级别时自动降级
+    HRESULT Initialize(const VideoFormat& input, const ScaleParams& params, CpuLevel level = CpuLevel_AVX2);
+
+    // 缩放一帧，输入输出都按 frame.h 中的紧密布局排列
+    HRESULT Scale(const BYTE* pSrc, BYTE* pDst);
+
+    // 输入格式
+    const VideoFormat& GetInputFormat() const { return m_input; }
+
+    // 输出格式，帧率与输入相同
+    const VideoFormat& GetOutputFormat() const { return m_output; }
+
+    // 实际使用的 SIMD 级别
+    CpuLevel GetCpuLevel() const { return m_level; }
+
+private:
+    // Plane 结构体描述一个平面的缩放：源区域与目标的位置、大小，以及横向的列表
+    struct Plane
+    {
+        size_t              srcOffset;  // 源区域左上角在帧中的偏移
+        UINT32              srcStride;  // 源行距
+        UINT32              srcWidth;   // 源区域宽度（像素）
+        UINT32              srcHeight;  // 源区域高度
+        size_t              dstOffset;  // 目标平面在帧中的偏移
+        UINT32              dstWidth;   // 目标宽度（像素）
+        UINT32              dstHeight;  // 目标高度
+        UINT32              channels;   // 每像素字节数（NV12 的色度平面为 2）
+        std::vector<UINT32> x0;         // 每个目标列的第一个源列
+        std::vector<UINT32> x1;         // 双线性为右侧的源列，区域平均为结束的源列（不含）
+        std::vector<UINT32> weight;     // 双线性为右侧源列的权重（0-255），区域平均不使用
+    };
+
+    // 计算平面的横向列表
+    HRESULT InitializePlane(Plane* pPlane);
+
+    // 缩放一个平面
+    void    ScalePlane(const Plane& plane, const BYTE* pSrc, BYTE* pDst);
+
+    VideoFormat             m_input;        // 输入格式
+    VideoFormat             m_output;       // 输出格式
+    ScaleFilter             m_filter;       // 滤波器
+    CpuLevel                m_level;        // SIMD 级别
+    Plane                   m_planes[3];    // 各平面
+    UINT32                  m_cPlanes;      // 平面数
+    std::vector<BYTE>       m_row;          // 双线性纵向混合后的行
+    std::vector<WORD>       m_sums;         // 区域平均纵向累加的行
+};
@@ -0,0 +1,379 @@
+#include <wchar.h>
+#include "segmentsink.h"
+
+// 等待结束的分段数的预留容量，后台线程正常时最多只有一两个
+static const size_t c_closingReserve = 4;
+
+// 拆分文件名：最后一个路径分隔符之后的最后一个 . 及其后面的部分作为扩展名
+CSegmentedSink::CSegmentedSink(IFrameSinkFactory* pFactory, const WCHAR* pwszFileName, LONGLONG llMaxDuration,
+    UINT64 cbMaxSize, UINT32 cRetain) :
+    m_pFactory(pFactory),
+    m_llMaxDuration(llMaxDuration),
+    m_cbMaxSize(cbMaxSize),
+    m_cRetain(cRetain),
+    m_pCurrent(nullptr),
+    m_nCurrent(0),
+    m_cFramesInSegment(0),
+    m_cbInSegment(0),
+    m_cbCompleted(0),
+    m_bFirstSample(TRUE),
+    m_llBaseTime(0),
+    m_pNext(nullptr),
+    m_nNext(0),
+    m_bWantNext(FALSE),
+    m_bStopWorker(FALSE),
+    m_hrWorker(S_OK),
+    m_cCompleted(0),
+    m_cRemoved(0),
+    m_cDeferred(0)
+{
+    m_format = VideoFormat();
+
+    std::wstring fileName = pwszFileName ? pwszFileName : L"";
+    size_t iSeparator = fileName.find_last_of(L"/\\");
+    size_t iDot = fileName.find_last_of(L'.');
+
+    if (iDot != std::wstring::npos && (iSeparator == std::wstring::npos || iDot > iSeparator))
+    {
+        m_baseName = fileName.substr(0, iDot);
+        m_extension = fileName.substr(iDot);
+    }
+    else
+    {
+        m_baseName = fileName;
+    }
+}
+
+CSegmentedSink::~CSegmentedSink()
+{
+    Finalize();
+}
+
+// 同步打开第一段，再让后台线程提前打开下一段；不切分时不需要下一段
+HRESULT CSegmentedSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_pFactory == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pCurrent || m_worker.joinable())
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_format = format;
+
+    HRESULT hr = OpenSegment(0, &m_pCurrent);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    m_nCurrent = 0;
+    m_cFramesInSegment = 0;
+    m_cbInSegment = 0;
+    m_cbCompleted = 0;
+    m_bFirstSample = TRUE;
+    m_llBaseTime = 0;
+
+    m_closing.clear();
+    m_closing.reserve(c_closingReserve);
+    m_pNext = nullptr;
+    m_nNext = 1;
+    m_bWantNext = (m_llMaxDuration > 0 || m_cbMaxSize > 0);
+    m_bStopWorker = FALSE;
+    m_hrWorker = S_OK;
+    m_cCompleted = 0;
+    m_cRemoved = 0;
+    m_cDeferred = 0;
+
+    m_worker = std::thread(&CSegmentedSink::WorkerThread, this);
+    return S_OK;
+}
+
+// 当前分段已到切换条件时先切换（至少写入一帧之后），再以分段的第一帧为基准校正时间戳后写入
+HRESULT CSegmentedSink::WriteFrame(const CaptureFrame& frame)
+{
+    HRESULT hr = S_OK;
+
+    if (m_pCurrent == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (m_cFramesInSegment.load(std::memory_order_relaxed) > 0 && IsSegmentFull(frame))
+    {
+        hr = RotateSegment();
+
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    if (m_bFirstSample)
+    {
+        m_llBaseTime = frame.llTimestamp;
+        m_bFirstSample = FALSE;
+    }
+
+    CaptureFrame rebased = frame;
+
+    // rebase the time stamp
+    rebased.llTimestamp -= m_llBaseTime;
+
+    hr = m_pCurrent->WriteFrame(rebased);
+
+    if (SUCCEEDED(hr))
+    {
+        m_cFramesInSegment.fetch_add(1, std::memory_order_relaxed);
+        m_cbInSegment += frame.cbData;
+    }
+
+    return hr;
+}
+
+// 停止后台线程（它会先结束所有待结束的分段），再同步结束最后一段并删除没有用到的下一段
+HRESULT CSegmentedSink::Finalize()
+{
+    if (m_pCurrent == nullptr)
+    {
+        return S_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopWorker = TRUE;
+        m_cvWork.notify_one();
+    }
+    m_worker.join();
+
+    UINT64 cbSegment = 0;
+    if (FAILED(m_pCurrent->GetBytesWritten(&cbSegment)))
+    {
+        cbSegment = m_cbInSegment;
+    }
+    m_cbCompleted += cbSegment;
+
+    Segment last = { m_pCurrent, m_nCurrent.load() };
+    m_pCurrent = nullptr;
+
+    HRESULT hr = CloseSegment(last);
+
+    if (m_pNext)
+    {
+        WCHAR wszPath[MAX_SEGMENT_PATH];
+
+        m_pNext->Finalize();
+        delete m_pNext;
+        m_pNext = nullptr;
+
+        GetSegmentPath(m_nNext, wszPath, MAX_SEGMENT_PATH);
+        m_pFactory->RemoveFile(wszPath);
+    }
+
+    if (SUCCEEDED(hr) && FAILED(m_hrWorker))
+    {
+        hr = m_hrWorker;
+    }
+
+    return hr;
+}
+
+// 已结束分段的字节数加上当前分段的字节数
+HRESULT CSegmentedSink::GetBytesWritten(UINT64* pcbWritten)
+{
+    UINT64 cbSegment = 0;
+
+    if (m_pCurrent && FAILED(m_pCurrent->GetBytesWritten(&cbSegment)))
+    {
+        cbSegment = m_cbInSegment;
+    }
+
+    *pcbWritten = m_cbCompleted + cbSegment;
+    return S_OK;
+}
+
+// 获取统计信息
+void CSegmentedSink::GetStats(SegmentStats* pStats)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    pStats->nCurrent = m_nCurrent.load();
+    pStats->cCompleted = m_cCompleted;
+    pStats->cRemoved = m_cRemoved;
+    pStats->cDeferred = m_cDeferred;
+    pStats->cFramesInSegment = m_cFramesInSegment.load();
+}
+
+// 第 index 段的文件路径：<名称>_<三位序号><扩展名>
+void CSegmentedSink::GetSegmentPath(UINT32 index, WCHAR* pwszPath, size_t cchPath) const
+{
+    swprintf(pwszPath, cchPath, L"%ls_%03u%ls", m_baseName.c_str(), index, m_extension.c_str());
+}
+
+// 创建并打开第 index 段的接收器
+HRESULT CSegmentedSink::OpenSegment(UINT32 index, IFrameSink** ppSink)
+{
+    WCHAR wszPath[MAX_SEGMENT_PATH];
+    IFrameSink* pSink = nullptr;
+
+    GetSegmentPath(index, wszPath, MAX_SEGMENT_PATH);
+
+    HRESULT hr = m_pFactory->CreateSink(wszPath, &pSink);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = pSink->BeginWriting(m_format);
+
+        if (FAILED(hr))
+        {
+            delete pSink;
+            pSink = nullptr;
+        }
+    }
+
+    *ppSink = pSink;
+    return hr;
+}
+
+// 结束并释放一个分段；保留数之外最旧的分段随之删除
+HRESULT CSegmentedSink::CloseSegment(const Segment& segment)
+{
+    HRESULT hr = segment.pSink->Finalize();
+    HRESULT hrRemove = S_OK;
+    delete segment.pSink;
+
+    if (m_cRetain != 0 && segment.index >= m_cRetain)
+    {
+        WCHAR wszPath[MAX_SEGMENT_PATH];
+
+        GetSegmentPath(segment.index - m_cRetain, wszPath, MAX_SEGMENT_PATH);
+        hrRemove = m_pFactory->RemoveFile(wszPath);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_cCompleted++;
+    if (m_cRetain != 0 && segment.index >= m_cRetain && SUCCEEDED(hrRemove))
+    {
+        m_cRemoved++;
+    }
+
+    return hr;
+}
+
+// 按当前分段的时长（时间戳之差）或大小判断是否需要切换；时长留半帧余量，避免帧时长取整后多出一帧
+BOOL CSegmentedSink::IsSegmentFull(const CaptureFrame& frame)
+{
+    if (m_llMaxDuration > 0 && frame.llTimestamp - m_llBaseTime + GetFrameDuration(m_format) / 2 >= m_llMaxDuration)
+    {
+        return TRUE;
+    }
+
+    if (m_cbMaxSize > 0)
+    {
+        UINT64 cbSegment = 0;
+
+        if (FAILED(m_pCurrent->GetBytesWritten(&cbSegment)))
+        {
+            cbSegment = m_cbInSegment;
+        }
+
+        return cbSegment >= m_cbMaxSize;
+    }
+
+    return FALSE;
+}
+
+// 在锁内交换当前分段与已就绪的下一段，旧分段交给后台线程结束；写入线程不等待任何 I/O
+HRESULT CSegmentedSink::RotateSegment()
+{
+    UINT64 cbSegment = 0;
+
+    if (FAILED(m_pCurrent->GetBytesWritten(&cbSegment)))
+    {
+        cbSegment = m_cbInSegment;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (FAILED(m_hrWorker))
+    {
+        return m_hrWorker;
+    }
+
+    if (m_pNext == nullptr)
+    {
+        // 下一段还没打开好，继续写当前分段
+        m_cDeferred++;
+        return S_FALSE;
+    }
+
+    Segment old = { m_pCurrent, m_nCurrent.load() };
+    m_closing.push_back(old);
+
+    m_pCurrent = m_pNext;
+    m_nCurrent = m_nNext;
+    m_pNext = nullptr;
+    m_nNext++;
+    m_bWantNext = TRUE;
+
+    m_cbCompleted += cbSegment;
+    m_cFramesInSegment = 0;
+    m_cbInSegment = 0;
+    m_bFirstSample = TRUE;
+
+    m_cvWork.notify_one();
+    return S_OK;
+}
+
+// 后台线程：先打开下一段（切换随时可能需要它），再结束旧分段；收到停止请求后结束剩余的旧分段再退出
+void CSegmentedSink::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;)
+    {
+        HRESULT hr = S_OK;
+
+        if (m_bWantNext && !m_bStopWorker)
+        {
+            UINT32 index = m_nNext;
+            IFrameSink* pSink = nullptr;
+
+            m_bWantNext = FALSE;
+            lock.unlock();
+            hr = OpenSegment(index, &pSink);
+            lock.lock();
+
+            if (SUCCEEDED(hr))
+            {
+                m_pNext = pSink;
+            }
+        }
+        else if (!m_closing.empty())
+        {
+            Segment segment = m_closing.front();
+            m_closing.erase(m_closing.begin());
+
+            lock.unlock();
+            hr = CloseSegment(segment);
+            lock.lock();
+        }
+        else if (m_bStopWorker)
+        {
+            break;
+        }
+        else
+        {
+            m_cvWork.wait(lock);
+        }
+
+        if (FAILED(hr) && SUCCEEDED(m_hrWorker))
+        {
+            m_hrWorker = hr;
+        }
+    }
+}
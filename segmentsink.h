@@ -0,0 +1,107 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "sink.h"
+
+// 分段文件路径的最大长度（字符）
+const size_t MAX_SEGMENT_PATH = 260;
+
+// SegmentStats 结构体保存分段写入的统计
+struct SegmentStats
+{
+    UINT32  nCurrent;           // 正在写入的分段序号
+    UINT32  cCompleted;         // 已结束的分段数
+    UINT32  cRemoved;           // 按保留数删除的分段数
+    UINT32  cDeferred;          // 下一段尚未就绪、推迟切换的次数
+    UINT64  cFramesInSegment;   // 当前分段已写入的帧数
+};
+
+// CSegmentedSink 类把一路录制按时长或大小切分成多个文件：<名称>_000.<扩展名>、<名称>_001.<扩展名> ...
+//
+// 切换分段不阻塞写入线程：后台线程提前创建并打开下一段的接收器，到达切换条件时写入线程只交换指针，
+// 旧分段交给后台线程 Finalize；下一段尚未就绪时继续写入当前分段，下一帧再尝试切换，不丢帧
+// 每段都从一帧完整的未压缩帧开始（编码器会把它编成关键帧），时间戳以该帧为基准从 0 开始
+// 设置了保留数时，每结束一段就删除超出保留数的最旧分段，用于环形的连续录制
+class CSegmentedSink : public IFrameSink
+{
+public:
+    // pwszFileName 为不带分段序号的文件名，例如 capture.mp4；pFactory 由调用方持有
+    // llMaxDuration（100 纳秒）和 cbMaxSize 为 0 表示不按该条件切分，cRetain 为 0 表示保留全部分段
+    CSegmentedSink(IFrameSinkFactory* pFactory, const WCHAR* pwszFileName, LONGLONG llMaxDuration,
+        UINT64 cbMaxSize, UINT32 cRetain = 0);
+    virtual ~CSegmentedSink();
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 结束当前分段，等后台线程结束之前的分段，删除提前打开但没有用到的下一段
+    HRESULT Finalize();
+
+    // 所有分段已写出的字节数之和，只能在写入线程上调用
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+    // 获取统计信息
+    void    GetStats(SegmentStats* pStats);
+
+    // 第 index 段的文件路径
+    void    GetSegmentPath(UINT32 index, WCHAR* pwszPath, size_t cchPath) const;
+
+private:
+    // 已写完、等待后台线程结束的分段
+    struct Segment
+    {
+        IFrameSink* pSink;
+        UINT32      index;
+    };
+
+    // 创建并打开第 index 段的接收器
+    HRESULT OpenSegment(UINT32 index, IFrameSink** ppSink);
+
+    // 结束并释放一个分段，再按保留数删除最旧的分段
+    HRESULT CloseSegment(const Segment& segment);
+
+    // 当前分段是否已到切换条件
+    BOOL    IsSegmentFull(const CaptureFrame& frame);
+
+    // 取走已就绪的下一段，把当前分段交给后台线程；下一段未就绪时返回 S_FALSE
+    HRESULT RotateSegment();
+
+    // 后台线程：提前打开下一段、结束旧分段
+    void    WorkerThread();
+
+    IFrameSinkFactory*      m_pFactory;         // 接收器工厂
+    std::wstring            m_baseName;         // 文件名中分段序号之前的部分
+    std::wstring            m_extension;        // 扩展名（含 .）
+    LONGLONG                m_llMaxDuration;    // 每段的最大时长
+    UINT64                  m_cbMaxSize;        // 每段的最大字节数
+    UINT32                  m_cRetain;          // 保留的已结束分段数
+    VideoFormat             m_format;           // 输入格式
+
+    // 以下由写入线程使用
+    IFrameSink*             m_pCurrent;         // 当前分段
+    std::atomic<UINT32>     m_nCurrent;         // 当前分段的序号
+    std::atomic<UINT64>     m_cFramesInSegment; // 当前分段的帧数
+    UINT64                  m_cbInSegment;      // 当前分段收到的未压缩字节数，接收器不报告大小时使用
+    UINT64                  m_cbCompleted;      // 已结束分段的字节数
+    BOOL                    m_bFirstSample;     // 是否是当前分段的第一个样本
+    LONGLONG                m_llBaseTime;       // 当前分段的基准时间
+
+    // 以下由 m_mutex 保护
+    std::thread             m_worker;           // 后台线程
+    std::mutex              m_mutex;
+    std::condition_variable m_cvWork;           // 通知后台线程有新任务
+    IFrameSink*             m_pNext;            // 提前打开的下一段
+    UINT32                  m_nNext;            // 下一段的序号
+    BOOL                    m_bWantNext;        // 是否需要打开下一段
+    BOOL                    m_bStopWorker;      // 请求后台线程退出
+    std::vector<Segment>    m_closing;          // 等待结束的分段，容量预留
+    HRESULT                 m_hrWorker;         // 后台任务的第一个错误
+    UINT32                  m_cCompleted;       // 已结束的分段数
+    UINT32                  m_cRemoved;         // 已删除的分段数
+    UINT32                  m_cDeferred;        // 推迟切换的次数
+};
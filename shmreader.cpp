@@ -0,0 +1,171 @@
+// 共享内存帧环的示例读取程序：打开采集进程发布的帧环（例如 CCaptureManager::SetSharedMemoryRing("capture")
+// 发布的 capture_0），就地读取每一帧并计算亮度平面的平均值，每秒输出帧率、跳过和被覆盖的帧数以及跨进程延迟，例如：
+//   shmreader capture_0
+//   shmreader capture_0 --seconds 10 --work-us 20000   每帧额外处理 20 毫秒，模拟跟不上的分析进程
+// 写入方结束或重新开始录制时自动重新打开帧环
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include "shmring.h"
+#include "latency.h"
+
+// 帧环尚未创建或写入方已结束时，重新打开的间隔
+static const std::chrono::milliseconds c_reopenInterval(100);
+
+// 每 16 个像素取一个，计算第一个平面的平均值（对 YUV 格式为亮度）
+static double SampleMean(const ShmFrame& frame)
+{
+    UINT64 sum = 0;
+    UINT64 cSamples = 0;
+    UINT32 cbRow = frame.stride < frame.cbData ? frame.stride : frame.cbData;
+
+    for (UINT32 y = 0; y < frame.format.height && (UINT64)(y + 1) * frame.stride <= frame.cbData; y += 16)
+    {
+        const BYTE* pRow = frame.pData + (size_t)y * frame.stride;
+
+        for (UINT32 x = 0; x < cbRow; x += 16)
+        {
+            sum += pRow[x];
+            cSamples++;
+        }
+    }
+
+    return cSamples ? (double)sum / cSamples : 0;
+}
+
+static void PrintUsage()
+{
+    printf("usage: shmreader NAME [--seconds N] [--work-us N] [--poll-us N]\n");
+}
+
+// 程序入口
+int main(int argc, char* argv[])
+{
+    const char* pszName = nullptr;
+    UINT32 cSeconds = 0;
+    UINT32 workUs = 0;
+    UINT32 pollUs = DEFAULT_SHM_POLL_US;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* pszArg = argv[i];
+        const char* pszValue = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (strcmp(pszArg, "--seconds") == 0 && pszValue)
+        {
+            cSeconds = (UINT32)strtoul(pszValue, nullptr, 10);
+            i++;
+        }
+        else if (strcmp(pszArg, "--work-us") == 0 && pszValue)
+        {
+            workUs = (UINT32)strtoul(pszValue, nullptr, 10);
+            i++;
+        }
+        else if (strcmp(pszArg, "--poll-us") == 0 && pszValue)
+        {
+            pollUs = (UINT32)strtoul(pszValue, nullptr, 10);
+            i++;
+        }
+        else if (pszArg[0] != '-' && pszName == nullptr)
+        {
+            pszName = pszArg;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (pszName == nullptr)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    CShmRingReader reader;
+    CLatencyHistogram latency;
+    LONGLONG llStart = GetClockTime();
+    LONGLONG llReport = llStart + HNS_PER_SECOND;
+    UINT64 cFrames = 0;
+    UINT64 cSkipped = 0;
+    UINT64 cTorn = 0;
+    double fMean = 0;
+    BOOL bOpen = FALSE;
+
+    while (cSeconds == 0 || GetClockTime() - llStart < (LONGLONG)cSeconds * HNS_PER_SECOND)
+    {
+        if (!bOpen)
+        {
+            HRESULT hr = reader.Open(pszName);
+
+            if (FAILED(hr))
+            {
+                if (hr != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+                {
+                    fprintf(stderr, "Failed to open frame ring %s (0x%08X).\n", pszName, (unsigned)hr);
+                    return 1;
+                }
+
+                std::this_thread::sleep_for(c_reopenInterval);
+                continue;
+            }
+
+            printf("opened %s\n", pszName);
+            bOpen = TRUE;
+        }
+
+        ShmFrame frame;
+        HRESULT hr = reader.AcquireFrame(&frame, 100, pollUs);
+
+        if (hr == S_OK)
+        {
+            LONGLONG llLatency = GetClockTime() - frame.llPublish;
+            double fFrameMean = SampleMean(frame);
+
+            if (workUs)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(workUs));
+            }
+
+            // 只采用处理期间没有被覆盖的帧的结果
+            if (reader.ReleaseFrame(frame) == S_OK)
+            {
+                fMean = fFrameMean;
+                latency.Record((UINT64)(llLatency > 0 ? llLatency : 0) * 100);
+            }
+        }
+        else if (hr == HRESULT_FROM_WIN32(ERROR_HANDLE_EOF))
+        {
+            printf("%s closed by the writer\n", pszName);
+            cFrames += reader.GetFrameCount();
+            cSkipped += reader.GetSkippedCount();
+            cTorn += reader.GetTornCount();
+            reader.Close();
+            bOpen = FALSE;
+        }
+        else if (FAILED(hr))
+        {
+            fprintf(stderr, "Failed to read frame ring %s (0x%08X).\n", pszName, (unsigned)hr);
+            return 1;
+        }
+
+        if (GetClockTime() >= llReport)
+        {
+            LatencySummary summary;
+
+            latency.GetSummary(&summary);
+            printf("frames %llu  skipped %llu  torn %llu  latency p50 %.0f us  p99 %.0f us  mean %.1f\n",
+                (unsigned long long)(cFrames + reader.GetFrameCount()),
+                (unsigned long long)(cSkipped + reader.GetSkippedCount()),
+                (unsigned long long)(cTorn + reader.GetTornCount()), summary.fP50Us, summary.fP99Us, fMean);
+            fflush(stdout);
+
+            latency.Reset();
+            llReport += HNS_PER_SECOND;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,526 @@
+#include <string.h>
+#include <thread>
+#include "shmring.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 帧环名称是否合法：不为空、不超过 MAX_SHM_RING_NAME，只含字母、数字、下划线和连字符
+static BOOL IsValidRingName(const char* pszName)
+{
+    size_t cch = pszName ? strlen(pszName) : 0;
+
+    if (cch == 0 || cch > MAX_SHM_RING_NAME)
+    {
+        return FALSE;
+    }
+
+    for (size_t i = 0; i < cch; i++)
+    {
+        char ch = pszName[i];
+
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '-'))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// 帧环在系统中的对象名：Windows 为当前会话的命名文件映射，其他平台为 POSIX 共享内存对象
+static std::string GetSystemName(const std::string& name)
+{
+#ifdef _WIN32
+    return "Local\\captureusb_" + name;
+#else
+    return "/captureusb_" + name;
+#endif
+}
+
+// 当前进程号
+static UINT32 GetProcessIdentifier()
+{
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return (UINT32)getpid();
+#endif
+}
+
+CShmRingSink::CShmRingSink(const char* pszName, UINT32 cSlots) :
+    m_name(pszName ? pszName : ""),
+    m_cSlots(cSlots),
+    m_stride(0),
+    m_pView(nullptr),
+    m_cbView(0),
+    m_nPublished(0),
+#ifdef _WIN32
+    m_hMapping(nullptr)
+#else
+    m_bLinked(FALSE)
+#endif
+{
+    m_format = VideoFormat();
+}
+
+CShmRingSink::~CShmRingSink()
+{
+    Close();
+}
+
+// 创建共享内存并写好帧环头；标识最后写入，读取方看到正确的标识时其余字段已经就绪
+HRESULT CShmRingSink::BeginWriting(const VideoFormat& format)
+{
+    if (!IsValidRingName(m_name.c_str()) || m_cSlots < 2)
+    {
+        return E_INVALIDARG;
+    }
+
+    UINT32 cbFrame = GetFrameSize(format);
+
+    if (cbFrame == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    Close();
+
+    size_t cbSlot = (SHM_SLOT_DATA_OFFSET + (size_t)cbFrame + PAGE_SIZE_BYTES - 1) & ~(PAGE_SIZE_BYTES - 1);
+    size_t cbView = PAGE_SIZE_BYTES + cbSlot * m_cSlots;
+    std::string systemName = GetSystemName(m_name);
+
+#ifdef _WIN32
+    m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((UINT64)cbView >> 32),
+        (DWORD)cbView, systemName.c_str());
+
+    if (m_hMapping == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // 同名的映射仍被其他进程打开时，大小不一定是这次请求的大小：
+    // 是已经结束的旧帧环（还没有关闭它的读取方）且足够大时原地重新初始化，否则说明另有写入方在使用，不能覆盖
+    BOOL bExisting = (GetLastError() == ERROR_ALREADY_EXISTS);
+
+    m_pView = (BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, bExisting ? 0 : cbView);
+
+    if (m_pView == nullptr)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    if (bExisting)
+    {
+        ShmRingHeader* pOld = (ShmRingHeader*)m_pView;
+        MEMORY_BASIC_INFORMATION info;
+
+        if (VirtualQuery(m_pView, &info, sizeof(info)) == 0 || info.RegionSize < cbView ||
+            (pOld->magic == SHM_RING_MAGIC && pOld->bClosed.load(std::memory_order_acquire) == 0))
+        {
+            Close();
+            return HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS);
+        }
+
+        // 先撤掉标识，再清除上一次留下的版本号，否则旧数据可能被当成新的帧读出
+        pOld->magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        pOld->nPublished.store(0, std::memory_order_relaxed);
+        pOld->bClosed.store(0, std::memory_order_relaxed);
+
+        for (UINT32 i = 0; i < m_cSlots; i++)
+        {
+            ((ShmSlotHeader*)(m_pView + PAGE_SIZE_BYTES + cbSlot * i))->nVersion.store(0, std::memory_order_relaxed);
+        }
+    }
+#else
+    // 去掉上次异常退出留下的同名对象，已经映射它的读取方不受影响
+    shm_unlink(systemName.c_str());
+
+    int fd = shm_open(systemName.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+        return HResultFromErrno(errno);
+    }
+
+    m_bLinked = TRUE;
+
+    if (ftruncate(fd, (off_t)cbView) != 0)
+    {
+        HRESULT hr = HResultFromErrno(errno);
+        close(fd);
+        Close();
+        return hr;
+    }
+
+    void* pView = mmap(nullptr, cbView, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (pView == MAP_FAILED)
+    {
+        HRESULT hr = HResultFromErrno(errno);
+        Close();
+        return hr;
+    }
+
+    m_pView = (BYTE*)pView;
+#endif
+
+    m_cbView = cbView;
+    m_format = format;
+    m_stride = GetFrameStride(format.subtype, format.width);
+    m_nPublished = 0;
+
+    // 新建的共享内存内容为零，原子变量的初始值即为 0（重新使用的旧帧环已在上面清零）
+    ShmRingHeader* pHeader = (ShmRingHeader*)m_pView;
+
+    pHeader->version = SHM_RING_VERSION;
+    pHeader->cSlots = m_cSlots;
+    pHeader->cbSlot = (UINT32)cbSlot;
+    pHeader->cbSlotData = (UINT32)(cbSlot - SHM_SLOT_DATA_OFFSET);
+    pHeader->writerPid = GetProcessIdentifier();
+
+    std::atomic_thread_fence(std::memory_order_release);
+    pHeader->magic = SHM_RING_MAGIC;
+    return S_OK;
+}
+
+// 顺序锁写入：先把槽的版本号置为奇数，写完帧信息和数据后置为偶数，最后更新已发布的帧数
+HRESULT CShmRingSink::WriteFrame(const CaptureFrame& frame)
+{
+    if (m_pView == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    ShmRingHeader* pHeader = (ShmRingHeader*)m_pView;
+
+    if (frame.cbData > pHeader->cbSlotData)
+    {
+        return E_INVALIDARG;
+    }
+
+    UINT64 nIndex = m_nPublished;
+    BYTE* pSlotBase = m_pView + PAGE_SIZE_BYTES + (size_t)(nIndex % m_cSlots) * pHeader->cbSlot;
+    ShmSlotHeader* pSlot = (ShmSlotHeader*)pSlotBase;
+
+    pSlot->nVersion.store(2 * nIndex + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    pSlot->nSequence = frame.nSequence;
+    pSlot->llTimestamp = frame.llTimestamp;
+    pSlot->subtype = m_format.subtype;
+    pSlot->width = m_format.width;
+    pSlot->height = m_format.height;
+    pSlot->stride = m_stride;
+    pSlot->cbData = frame.cbData;
+    pSlot->flags = frame.flags;
+    memcpy(pSlotBase + SHM_SLOT_DATA_OFFSET, frame.pData, frame.cbData);
+    pSlot->llPublish = GetClockTime();
+
+    pSlot->nVersion.store(2 * nIndex + 2, std::memory_order_release);
+
+    m_nPublished = nIndex + 1;
+    pHeader->nPublished.store(m_nPublished, std::memory_order_release);
+    return S_OK;
+}
+
+// 先去掉名称再标记帧环已结束，读取方看到结束标志后重新打开时不会再打开这个帧环
+HRESULT CShmRingSink::Finalize()
+{
+#ifndef _WIN32
+    if (m_bLinked)
+    {
+        shm_unlink(GetSystemName(m_name).c_str());
+        m_bLinked = FALSE;
+    }
+#endif
+
+    if (m_pView)
+    {
+        ((ShmRingHeader*)m_pView)->bClosed.store(1, std::memory_order_release);
+    }
+
+    Close();
+    return S_OK;
+}
+
+// 解除映射；POSIX 共享内存同时去掉名称，已映射的读取方仍可读完
+void CShmRingSink::Close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+#else
+    if (m_pView)
+    {
+        munmap(m_pView, m_cbView);
+    }
+
+    if (m_bLinked)
+    {
+        shm_unlink(GetSystemName(m_name).c_str());
+        m_bLinked = FALSE;
+    }
+#endif
+
+    m_pView = nullptr;
+    m_cbView = 0;
+}
+
+CShmRingReader::CShmRingReader() :
+    m_pView(nullptr),
+    m_cbView(0),
+    m_pHeader(nullptr),
+    m_nNext(0),
+    m_cFrames(0),
+    m_cSkipped(0),
+    m_cTorn(0)
+#ifdef _WIN32
+    , m_hMapping(nullptr)
+#endif
+{
+}
+
+CShmRingReader::~CShmRingReader()
+{
+    Close();
+}
+
+// 只读映射帧环并检查帧环头；写入方还在初始化（标识尚未写入）或已经结束时按未找到处理，调用方稍后重试
+HRESULT CShmRingReader::Open(const char* pszName)
+{
+    if (!IsValidRingName(pszName))
+    {
+        return E_INVALIDARG;
+    }
+
+    Close();
+
+    std::string systemName = GetSystemName(pszName);
+    size_t cbView = 0;
+
+#ifdef _WIN32
+    MEMORY_BASIC_INFORMATION info;
+
+    m_hMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, systemName.c_str());
+
+    if (m_hMapping == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_pView = (const BYTE*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (m_pView == nullptr)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        Close();
+        return hr;
+    }
+
+    if (VirtualQuery(m_pView, &info, sizeof(info)) != 0)
+    {
+        cbView = info.RegionSize;
+    }
+#else
+    struct stat st;
+    int fd = shm_open(systemName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        return HResultFromErrno(errno);
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)PAGE_SIZE_BYTES)
+    {
+        close(fd);
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    cbView = (size_t)st.st_size;
+
+    void* pView = mmap(nullptr, cbView, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (pView == MAP_FAILED)
+    {
+        return HResultFromErrno(errno);
+    }
+
+    m_pView = (const BYTE*)pView;
+#endif
+
+    m_cbView = cbView;
+
+    const ShmRingHeader* pHeader = (const ShmRingHeader*)m_pView;
+
+    // 已结束的帧环（Windows 上写入方关闭之前名称仍然有效）同样按未找到处理
+    if (cbView < PAGE_SIZE_BYTES || pHeader->magic != SHM_RING_MAGIC ||
+        pHeader->bClosed.load(std::memory_order_acquire) != 0)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (pHeader->version != SHM_RING_VERSION || pHeader->cSlots < 2 ||
+        pHeader->cbSlotData + SHM_SLOT_DATA_OFFSET != pHeader->cbSlot ||
+        PAGE_SIZE_BYTES + (size_t)pHeader->cbSlot * pHeader->cSlots > cbView)
+    {
+        Close();
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    m_pHeader = pHeader;
+    m_nNext = pHeader->nPublished.load(std::memory_order_acquire);
+    m_cFrames = 0;
+    m_cSkipped = 0;
+    m_cTorn = 0;
+    return S_OK;
+}
+
+// 解除映射
+void CShmRingReader::Close()
+{
+#ifdef _WIN32
+    if (m_pView)
+    {
+        UnmapViewOfFile(m_pView);
+    }
+
+    if (m_hMapping)
+    {
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+    }
+#else
+    if (m_pView)
+    {
+        munmap((void*)m_pView, m_cbView);
+    }
+#endif
+
+    m_pView = nullptr;
+    m_cbView = 0;
+    m_pHeader = nullptr;
+}
+
+// 第 index 帧所在的槽
+const ShmSlotHeader* CShmRingReader::GetSlot(UINT64 nIndex) const
+{
+    return (const ShmSlotHeader*)(m_pView + PAGE_SIZE_BYTES + (size_t)(nIndex % m_pHeader->cSlots) * m_pHeader->cbSlot);
+}
+
+// 取得下一帧：落后一整圈时跳到最新的一帧；读帧信息的过程中该槽被覆盖时，跳过这一帧再试
+HRESULT CShmRingReader::AcquireFrame(ShmFrame* pFrame, UINT32 timeoutMs, UINT32 pollUs)
+{
+    if (pFrame == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pHeader == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    LONGLONG llDeadline = GetClockTime() + (LONGLONG)timeoutMs * (HNS_PER_SECOND / 1000);
+
+    for (;;)
+    {
+        // 写入方先更新已发布的帧数再标记结束，先读结束标志可以保证之后读到的帧数是最终的
+        BOOL bClosed = m_pHeader->bClosed.load(std::memory_order_acquire) != 0;
+        UINT64 nPublished = m_pHeader->nPublished.load(std::memory_order_acquire);
+
+        if (m_nNext < nPublished)
+        {
+            // 写入方正在写的槽可能就是下一帧所在的槽，落后一整圈时直接跳到最新的一帧
+            if (nPublished - m_nNext >= m_pHeader->cSlots)
+            {
+                m_cSkipped += nPublished - 1 - m_nNext;
+                m_nNext = nPublished - 1;
+            }
+
+            const ShmSlotHeader* pSlot = GetSlot(m_nNext);
+            const UINT64 nVersion = pSlot->nVersion.load(std::memory_order_acquire);
+
+            if (nVersion == 2 * m_nNext + 2)
+            {
+                pFrame->pData = (const BYTE*)pSlot + SHM_SLOT_DATA_OFFSET;
+                pFrame->cbData = pSlot->cbData;
+                pFrame->flags = pSlot->flags;
+                pFrame->format.subtype = pSlot->subtype;
+                pFrame->format.width = pSlot->width;
+                pFrame->format.height = pSlot->height;
+                pFrame->format.fpsNumerator = 0;
+                pFrame->format.fpsDenominator = 0;
+                pFrame->stride = pSlot->stride;
+                pFrame->llTimestamp = pSlot->llTimestamp;
+                pFrame->llPublish = pSlot->llPublish;
+                pFrame->nSequence = pSlot->nSequence;
+                pFrame->nIndex = m_nNext;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (pSlot->nVersion.load(std::memory_order_relaxed) == nVersion &&
+                    pFrame->cbData <= m_pHeader->cbSlotData)
+                {
+                    m_nNext++;
+                    m_cFrames++;
+                    return S_OK;
+                }
+            }
+
+            m_cSkipped++;
+            m_nNext++;
+            continue;
+        }
+
+        if (bClosed)
+        {
+            return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+        }
+
+        if (GetClockTime() >= llDeadline)
+        {
+            return S_FALSE;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(pollUs));
+    }
+}
+
+// 检查帧在使用期间没有被覆盖
+HRESULT CShmRingReader::ReleaseFrame(const ShmFrame& frame)
+{
+    if (m_pHeader == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (GetSlot(frame.nIndex)->nVersion.load(std::memory_order_relaxed) != 2 * frame.nIndex + 2)
+    {
+        m_cTorn++;
+        return S_FALSE;
+    }
+
+    return S_OK;
+}
@@ -0,0 +1,170 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <string>
+#include "sink.h"
+
+// 共享内存帧环默认的槽数
+const UINT32 DEFAULT_SHM_RING_SLOTS = 4;
+
+// 共享内存帧环名称的最大长度（不含系统前缀）
+const UINT32 MAX_SHM_RING_NAME = 64;
+
+// 读取方等待新帧时的轮询间隔（微秒）
+const UINT32 DEFAULT_SHM_POLL_US = 200;
+
+// 共享内存的标识和布局版本，布局变化时增加版本号
+const UINT32 SHM_RING_MAGIC = FRAME_FOURCC('F', 'R', 'N', 'G');
+const UINT32 SHM_RING_VERSION = 1;
+
+// 共享内存的布局：开头一页是 ShmRingHeader，之后是 cSlots 个大小为 cbSlot 的槽（按页对齐），
+// 每个槽开头是 ShmSlotHeader，帧数据从槽内 SHM_SLOT_DATA_OFFSET 处开始
+// 第 n 帧（从 0 开始计数）写在第 n % cSlots 个槽中；两个进程的结构体布局必须一致，只使用定长类型
+const UINT32 SHM_SLOT_DATA_OFFSET = 64;
+
+// ShmRingHeader 结构体位于共享内存的开头
+struct ShmRingHeader
+{
+    UINT32              magic;          // SHM_RING_MAGIC
+    UINT32              version;        // SHM_RING_VERSION
+    UINT32              cSlots;         // 槽数
+    UINT32              cbSlot;         // 每个槽的大小（含槽头）
+    UINT32              cbSlotData;     // 每个槽能容纳的帧数据字节数
+    UINT32              writerPid;      // 写入进程的进程号，用于诊断
+    std::atomic<UINT64> nPublished;     // 已发布的帧数，读取方据此找到最新的一帧
+    std::atomic<UINT32> bClosed;        // 写入方已结束，不会再发布新帧
+};
+
+// ShmSlotHeader 结构体是一个槽的帧信息，用 nVersion 实现顺序锁（seqlock）：
+// 写入第 n 帧前置为奇数 2n + 1，写完后置为 2n + 2；读取方在读帧信息和数据前后各读一次 nVersion，
+// 两次相同且等于 2n + 2 才说明读到的是完整的第 n 帧，写入方从不等待读取方
+struct ShmSlotHeader
+{
+    std::atomic<UINT64> nVersion;       // 顺序锁版本号
+    UINT64              nSequence;      // 流水线的帧序号
+    LONGLONG            llTimestamp;    // 时间戳（100 纳秒）
+    LONGLONG            llPublish;      // 发布时刻（GetClockTime，同一台机器上各进程共用同一个单调时钟）
+    UINT32              subtype;        // 像素格式 (FOURCC)
+    UINT32              width;          // 宽度
+    UINT32              height;         // 高度
+    UINT32              stride;         // 第一个平面的行跨度（字节）
+    UINT32              cbData;         // 帧数据长度
+    UINT32              flags;          // FrameFlags 的组合
+};
+
+static_assert(sizeof(ShmSlotHeader) <= SHM_SLOT_DATA_OFFSET, "slot header must fit before the frame data");
+static_assert(std::atomic<UINT64>::is_always_lock_free, "shared memory atomics must be lock-free");
+
+// CShmRingSink 类把帧发布到同一台机器上其他进程可以映射的共享内存帧环（Windows 为命名的文件映射，
+// 其他平台为 POSIX 共享内存），供分析等进程直接读取，不必再从磁盘读回 MP4
+//
+// 写入方把每帧拷贝进下一个槽后立即返回，从不等待读取方；读取方（CShmRingReader）只读映射，
+// 就地读取槽中的数据，跟不上时直接跳到最新的一帧
+// 建议作为 CFrameBus 的订阅者使用，拷贝进共享内存的耗时不影响文件接收器
+class CShmRingSink : public IFrameSink
+{
+public:
+    // pszName 为帧环名称（只含字母、数字、下划线和连字符），读取方用同一名称打开
+    CShmRingSink(const char* pszName, UINT32 cSlots = DEFAULT_SHM_RING_SLOTS);
+    virtual ~CShmRingSink();
+
+    // 按格式创建共享内存，同名的旧帧环（例如上次异常退出留下的，或者已经结束但仍被读取方打开的）会被替换；
+    // 同名的帧环仍有写入方在使用时返回 HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS)
+    HRESULT BeginWriting(const VideoFormat& format);
+
+    // 把帧写入下一个槽
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 标记帧环已结束并释放共享内存，已打开的读取方读完后得到 ERROR_HANDLE_EOF
+    HRESULT Finalize();
+
+    // 已发布的帧数
+    UINT64  GetPublishedCount() const { return m_nPublished; }
+
+private:
+    CShmRingSink(const CShmRingSink&);
+    CShmRingSink& operator=(const CShmRingSink&);
+
+    // 关闭映射
+    void    Close();
+
+    std::string             m_name;         // 帧环名称
+    UINT32                  m_cSlots;       // 槽数
+    VideoFormat             m_format;       // 帧格式
+    UINT32                  m_stride;       // 第一个平面的行跨度
+    BYTE*                   m_pView;        // 映射的起始地址
+    size_t                  m_cbView;       // 映射的大小
+    UINT64                  m_nPublished;   // 已发布的帧数
+#ifdef _WIN32
+    HANDLE                  m_hMapping;     // 文件映射句柄
+#else
+    BOOL                    m_bLinked;      // 共享内存对象是否仍有名称
+#endif
+};
+
+// ShmFrame 结构体描述读取方取得的一帧，pData 直接指向共享内存，在 ReleaseFrame 之前有效
+struct ShmFrame
+{
+    const BYTE*     pData;          // 帧数据
+    UINT32          cbData;         // 帧数据长度
+    UINT32          flags;          // FrameFlags 的组合
+    VideoFormat     format;         // 帧格式（不含帧率）
+    UINT32          stride;         // 第一个平面的行跨度
+    LONGLONG        llTimestamp;    // 时间戳（100 纳秒）
+    LONGLONG        llPublish;      // 写入方发布的时刻（GetClockTime）
+    UINT64          nSequence;      // 流水线的帧序号
+    UINT64          nIndex;         // 在帧环中的序号，ReleaseFrame 用它检查该槽是否被覆盖
+};
+
+// CShmRingReader 类在其他进程中只读映射 CShmRingSink 发布的帧环，按顺序取得帧而不拷贝数据；
+// 落后写入方一整圈时跳到最新的一帧，跳过的帧计入 GetSkippedCount
+//
+// 取得的帧在使用期间仍可能被写入方覆盖（读取方落后接近一整圈时），用完后调用 ReleaseFrame 检查，
+// 返回 S_FALSE 时应丢弃基于这一帧的结果；槽数越多，留给读取方处理一帧的时间越长
+class CShmRingReader
+{
+public:
+    CShmRingReader();
+    ~CShmRingReader();
+
+    // 打开名为 pszName 的帧环，写入方尚未创建或已经结束时返回 HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)；
+    // 从打开时最新的一帧开始读取
+    HRESULT Open(const char* pszName);
+
+    // 关闭映射
+    void    Close();
+
+    // 取得下一帧：最多等待 timeoutMs 毫秒（按 pollUs 微秒的间隔轮询），超时返回 S_FALSE，
+    // 写入方已结束且没有新帧时返回 HRESULT_FROM_WIN32(ERROR_HANDLE_EOF)
+    HRESULT AcquireFrame(ShmFrame* pFrame, UINT32 timeoutMs, UINT32 pollUs = DEFAULT_SHM_POLL_US);
+
+    // 检查取得之后该槽没有被覆盖：S_OK 表示读到的数据完整，S_FALSE 表示已被覆盖，计入 GetTornCount
+    HRESULT ReleaseFrame(const ShmFrame& frame);
+
+    // 已取得的帧数
+    UINT64  GetFrameCount() const { return m_cFrames; }
+
+    // 因为落后而跳过的帧数
+    UINT64  GetSkippedCount() const { return m_cSkipped; }
+
+    // 使用期间被覆盖的帧数
+    UINT64  GetTornCount() const { return m_cTorn; }
+
+private:
+    CShmRingReader(const CShmRingReader&);
+    CShmRingReader& operator=(const CShmRingReader&);
+
+    // 第 index 个槽的帧信息
+    const ShmSlotHeader* GetSlot(UINT64 nIndex) const;
+
+    const BYTE*             m_pView;        // 映射的起始地址
+    size_t                  m_cbView;       // 映射的大小
+    const ShmRingHeader*    m_pHeader;      // 帧环头
+    UINT64                  m_nNext;        // 下一个要读取的帧在帧环中的序号
+    UINT64                  m_cFrames;      // 已取得的帧数
+    UINT64                  m_cSkipped;     // 跳过的帧数
+    UINT64                  m_cTorn;        // 被覆盖的帧数
+#ifdef _WIN32
+    HANDLE                  m_hMapping;     // 文件映射句柄
+#endif
+};
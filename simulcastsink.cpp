@@ -0,0 +1,249 @@
+#include "simulcastsink.h"
+
+CSimulcastSink::CSimulcastSink(IFrameSink* pPrimary) :
+    m_pPrimary(pPrimary),
+    m_hrPrimary(S_OK),
+    m_cOutputs(0),
+    m_pPool(nullptr),
+    m_pFrame(nullptr)
+{
+    for (UINT32 i = 0; i < MAX_SIMULCAST_OUTPUTS; i++)
+    {
+        m_outputs[i].params = ScaleParams();
+        m_outputs[i].pSink = nullptr;
+        m_outputs[i].hr = S_OK;
+        m_outputs[i].cFrames = 0;
+        m_outputs[i].llScaleTime = 0;
+    }
+}
+
+CSimulcastSink::~CSimulcastSink()
+{
+    delete m_pPool;
+}
+
+// 添加一路缩放输出
+HRESULT CSimulcastSink::AddOutput(const ScaleParams& params, IFrameSink* pSink)
+{
+    if (pSink == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pPool)
+    {
+        return E_UNEXPECTED; // 线程池按路数创建，开始写入之后不能再添加
+    }
+    if (m_cOutputs >= MAX_SIMULCAST_OUTPUTS)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_outputs[m_cOutputs].params = params;
+    m_outputs[m_cOutputs].pSink = pSink;
+    m_cOutputs++;
+    return S_OK;
+}
+
+// 初始化各路缩放并分配缓冲区，再依次打开所有接收器
+HRESULT CSimulcastSink::BeginWriting(const VideoFormat& format)
+{
+    if (m_pPrimary == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hr = S_OK;
+
+    for (UINT32 i = 0; i < m_cOutputs && SUCCEEDED(hr); i++)
+    {
+        Output& output = m_outputs[i];
+
+        hr = output.scaler.Initialize(format, output.params);
+
+        if (SUCCEEDED(hr))
+        {
+            try
+            {
+                output.buffer.resize(GetFrameSize(output.scaler.GetOutputFormat()));
+            }
+            catch (const std::bad_alloc&)
+            {
+                hr = E_OUTOFMEMORY;
+            }
+        }
+
+        output.cFrames = 0;
+        output.llScaleTime = 0;
+    }
+
+    if (SUCCEEDED(hr) && m_pPool == nullptr && m_cOutputs > 0)
+    {
+        m_pPool = new (std::nothrow) CTaskPool();
+
+        if (m_pPool == nullptr)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        else
+        {
+            hr = m_pPool->Initialize(m_cOutputs + 1);
+        }
+
+        if (FAILED(hr))
+        {
+            delete m_pPool;
+            m_pPool = nullptr;
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_pPrimary->BeginWriting(format);
+    }
+
+    for (UINT32 i = 0; i < m_cOutputs && SUCCEEDED(hr); i++)
+    {
+        hr = m_outputs[i].pSink->BeginWriting(m_outputs[i].scaler.GetOutputFormat());
+    }
+
+    return hr;
+}
+
+// 并行写出主接收器和各路缩放输出，返回第一个失败
+HRESULT CSimulcastSink::WriteFrame(const CaptureFrame& frame)
+{
+    if (m_cOutputs == 0)
+    {
+        return m_pPrimary->WriteFrame(frame);
+    }
+    if (m_pPool == nullptr)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pFrame = &frame;
+    m_pPool->ParallelFor(m_cOutputs + 1, WriteTask, this);
+    m_pFrame = nullptr;
+
+    HRESULT hr = m_hrPrimary;
+
+    for (UINT32 i = 0; i < m_cOutputs && SUCCEEDED(hr); i++)
+    {
+        hr = m_outputs[i].hr;
+    }
+
+    return hr;
+}
+
+// 写出任务
+void CSimulcastSink::WriteTask(void* pContext, UINT32 index)
+{
+    CSimulcastSink* pThis = (CSimulcastSink*)pContext;
+    const CaptureFrame& frame = *pThis->m_pFrame;
+
+    if (index == 0)
+    {
+        pThis->m_hrPrimary = pThis->m_pPrimary->WriteFrame(frame);
+        return;
+    }
+
+    Output& output = pThis->m_outputs[index - 1];
+
+    if (frame.cbData < GetFrameSize(output.scaler.GetInputFormat()))
+    {
+        output.hr = E_INVALIDARG;
+        return;
+    }
+
+    LONGLONG llStart = GetClockTime();
+
+    output.hr = output.scaler.Scale(frame.pData, output.buffer.data());
+    output.llScaleTime.fetch_add(GetClockTime() - llStart, std::memory_order_relaxed);
+
+    if (FAILED(output.hr))
+    {
+        return;
+    }
+
+    // 缩放后的帧不属于帧缓冲池，只在本次调用内有效
+    CaptureFrame scaled = frame;
+
+    scaled.pData = output.buffer.data();
+    scaled.cbData = (UINT32)output.buffer.size();
+    scaled.pBuffer = nullptr;
+
+    output.hr = output.pSink->WriteFrame(scaled);
+
+    if (SUCCEEDED(output.hr))
+    {
+        output.cFrames.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// 结束所有接收器，某一路失败时其余的仍然结束
+HRESULT CSimulcastSink::Finalize()
+{
+    HRESULT hr = m_pPrimary->Finalize();
+
+    for (UINT32 i = 0; i < m_cOutputs; i++)
+    {
+        HRESULT hrOutput = m_outputs[i].pSink->Finalize();
+
+        if (SUCCEEDED(hr))
+        {
+            hr = hrOutput;
+        }
+    }
+
+    return hr;
+}
+
+// 所有接收器写出的字节数之和，不支持统计的接收器不计入
+HRESULT CSimulcastSink::GetBytesWritten(UINT64* pcbWritten)
+{
+    if (pcbWritten == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    UINT64 cbTotal = 0;
+    UINT64 cbWritten = 0;
+    HRESULT hr = m_pPrimary->GetBytesWritten(&cbTotal);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    for (UINT32 i = 0; i < m_cOutputs; i++)
+    {
+        if (SUCCEEDED(m_outputs[i].pSink->GetBytesWritten(&cbWritten)))
+        {
+            cbTotal += cbWritten;
+        }
+    }
+
+    *pcbWritten = cbTotal;
+    return S_OK;
+}
+
+// 获取一路输出的统计
+HRESULT CSimulcastSink::GetOutputStats(UINT32 index, SimulcastOutputStats* pStats) const
+{
+    if (pStats == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (index >= m_cOutputs)
+    {
+        return E_INVALIDARG;
+    }
+
+    const Output& output = m_outputs[index];
+
+    pStats->width = output.scaler.GetOutputFormat().width;
+    pStats->height = output.scaler.GetOutputFormat().height;
+    pStats->cFrames = output.cFrames.load();
+    pStats->fAvgScaleUs = pStats->cFrames ? output.llScaleTime.load() / 10.0 / pStats->cFrames : 0;
+    return S_OK;
+}
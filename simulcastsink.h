@@ -0,0 +1,78 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <vector>
+#include "sink.h"
+#include "scale.h"
+#include "taskpool.h"
+
+// 一路采集最多附加的缩放输出数
+const UINT32 MAX_SIMULCAST_OUTPUTS = 4;
+
+// SimulcastOutputStats 结构体保存一路缩放输出的统计
+struct SimulcastOutputStats
+{
+    UINT32  width;          // 输出宽度
+    UINT32  height;         // 输出高度
+    UINT64  cFrames;        // 写出的帧数
+    double  fAvgScaleUs;    // 每帧缩放的平均耗时（微秒）
+};
+
+// CSimulcastSink 类把同一帧同时写给主接收器和若干路缩放输出：主接收器收到原始帧（例如全分辨率存档），
+// 每路缩放输出从同一帧裁剪、缩放后写给自己的接收器（例如 480p 预览或分析用的局部画面）
+//
+// 解码和格式转换在流水线中只做一次，所有输出共用转换后的帧；主接收器的写入和各路的缩放、写入
+// 在自带的线程池中并行执行，不与格式转换共用默认线程池，写入线程的耗时取决于最慢的一路而不是各路之和
+//
+// 各路输出的缓冲区在 BeginWriting 中一次性分配，之后不再分配堆内存；写出的帧保留原来的时间戳、序号和标志
+// 所有下游接收器由调用方持有，必须在 Finalize 之后才能释放
+class CSimulcastSink : public IFrameSink
+{
+public:
+    explicit CSimulcastSink(IFrameSink* pPrimary);
+    virtual ~CSimulcastSink();
+
+    // 添加一路缩放输出，必须在 BeginWriting 之前调用
+    HRESULT AddOutput(const ScaleParams& params, IFrameSink* pSink);
+
+    // 缩放输出的路数
+    UINT32  GetOutputCount() const { return m_cOutputs; }
+
+    HRESULT BeginWriting(const VideoFormat& format);
+    HRESULT WriteFrame(const CaptureFrame& frame);
+
+    // 结束所有接收器，返回第一个失败
+    HRESULT Finalize();
+
+    // 所有接收器写出的字节数之和
+    HRESULT GetBytesWritten(UINT64* pcbWritten);
+
+    // 获取第 index 路输出的统计，可以在任意线程调用
+    HRESULT GetOutputStats(UINT32 index, SimulcastOutputStats* pStats) const;
+
+private:
+    CSimulcastSink(const CSimulcastSink&);
+    CSimulcastSink& operator=(const CSimulcastSink&);
+
+    // Output 结构体保存一路缩放输出
+    struct Output
+    {
+        ScaleParams             params;         // 缩放参数
+        IFrameSink*             pSink;          // 接收器
+        CFrameScaler            scaler;         // 缩放
+        std::vector<BYTE>       buffer;         // 缩放后的帧
+        HRESULT                 hr;             // 本帧的结果
+        std::atomic<UINT64>     cFrames;        // 写出的帧数
+        std::atomic<LONGLONG>   llScaleTime;    // 缩放的累计耗时（100 纳秒）
+    };
+
+    // 任务：0 写主接收器，其余为第 index - 1 路的缩放和写入
+    static void WriteTask(void* pContext, UINT32 index);
+
+    IFrameSink*             m_pPrimary;     // 主接收器
+    HRESULT                 m_hrPrimary;    // 主接收器本帧的结果
+    Output                  m_outputs[MAX_SIMULCAST_OUTPUTS];   // 缩放输出
+    UINT32                  m_cOutputs;     // 缩放输出的路数
+    CTaskPool*              m_pPool;        // 线程池，第一次 BeginWriting 时创建
+    const CaptureFrame*     m_pFrame;       // 当前帧
+};
@@ -0,0 +1,94 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include "frame.h"
+
+// IFrameSink 是帧接收器接口，流水线把处理好的帧依次交给它写出
+class IFrameSink
+{
+public:
+    virtual ~IFrameSink() {}
+
+    // 开始写入，format 为协商后的输入格式
+    virtual HRESULT BeginWriting(const VideoFormat& format) = 0;
+
+    // 写入一帧，frame.llTimestamp 已经过基准时间校正
+    virtual HRESULT WriteFrame(const CaptureFrame& frame) = 0;
+
+    // 按顺序写入一批帧（见 CFramePipeline::SetWriteBatch），各帧的数据在调用期间都有效；
+    // 能把整批合并成一次 I/O 的接收器（例如 CRawFileSink）重写此方法，默认逐帧调用 WriteFrame，遇到错误即返回
+    virtual HRESULT WriteFrames(const CaptureFrame* pFrames, UINT32 cFrames)
+    {
+        for (UINT32 i = 0; i < cFrames; i++)
+        {
+            HRESULT hr = WriteFrame(pFrames[i]);
+
+            if (FAILED(hr))
+            {
+                return hr;
+            }
+        }
+        return S_OK;
+    }
+
+    // 结束写入
+    virtual HRESULT Finalize() = 0;
+
+    // 获取已写出的字节数（编码后的大小），不支持时返回 E_NOTIMPL
+    virtual HRESULT GetBytesWritten(UINT64* pcbWritten)
+    {
+        (void)pcbWritten;
+        return E_NOTIMPL;
+    }
+};
+
+// IFrameSinkFactory 是接收器工厂接口，用于按文件路径创建接收器（例如分段写入时每段一个文件）
+class IFrameSinkFactory
+{
+public:
+    virtual ~IFrameSinkFactory() {}
+
+    // 创建写入 pwszPath 的接收器，返回的接收器由调用方用 delete 释放
+    virtual HRESULT CreateSink(const WCHAR* pwszPath, IFrameSink** ppSink) = 0;
+
+    // 删除已写完的文件
+    virtual HRESULT RemoveFile(const WCHAR* pwszPath) = 0;
+};
+
+// CNullSink 类丢弃所有帧，只做计数，用于测量流水线本身的开销
+class CNullSink : public IFrameSink
+{
+public:
+    CNullSink() : m_cFrames(0), m_cbWritten(0) {}
+
+    HRESULT BeginWriting(const VideoFormat&)
+    {
+        m_cFrames = 0;
+        m_cbWritten = 0;
+        return S_OK;
+    }
+
+    HRESULT WriteFrame(const CaptureFrame& frame)
+    {
+        m_cFrames++;
+        m_cbWritten += frame.cbData;
+        return S_OK;
+    }
+
+    HRESULT Finalize()
+    {
+        return S_OK;
+    }
+
+    HRESULT GetBytesWritten(UINT64* pcbWritten)
+    {
+        *pcbWritten = m_cbWritten;
+        return S_OK;
+    }
+
+    UINT64  FramesWritten() const { return m_cFrames; }
+    UINT64  BytesWritten() const { return m_cbWritten; }
+
+private:
+    UINT64  m_cFrames;      // 已写入帧数
+    UINT64  m_cbWritten;    // 已写入字节数
+};
@@ -0,0 +1,372 @@
+#include <string.h>
+#include <thread>
+#include "source.h"
+
+// 默认格式：640x480 NV12 30fps
+static const VideoFormat c_defaultFormat = { FOURCC_NV12, 640, 480, 30, 1 };
+
+// 滚动速度（像素/帧），必须是偶数，保证 YUY2/NV12 的色度成对
+static const UINT32 c_scrollStep = 4;
+
+// 帧序号块的边长（像素）
+static const UINT32 c_stampBlock = 8;
+
+// BT.601 有限范围 RGB 转 YUV
+static void RgbToYuv(BYTE r, BYTE g, BYTE b, BYTE* pY, BYTE* pU, BYTE* pV)
+{
+    *pY = (BYTE)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    *pU = (BYTE)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    *pV = (BYTE)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+// 是否是 4:2:0 平面格式，这些格式的色度单独成行
+static BOOL IsPlanar420(UINT32 subtype)
+{
+    return subtype == FOURCC_NV12 || subtype == FOURCC_I420 || subtype == FOURCC_IYUV;
+}
+
+// 默认实现：读取后拷贝到调用方的缓冲区
+HRESULT ICaptureSource::ReadFrameInto(BYTE* pBuffer, UINT32 cbBuffer, CaptureFrame* pFrame)
+{
+    if (pBuffer == nullptr || pFrame == nullptr)
+    {
+        return E_POINTER;
+    }
+
+    HRESULT hr = ReadFrame(pFrame);
+
+    if (hr != S_OK)
+    {
+        return hr;
+    }
+    if (pFrame->cbData > cbBuffer)
+    {
+        return E_INVALIDARG;
+    }
+
+    memcpy(pBuffer, pFrame->pData, pFrame->cbData);
+    pFrame->pData = pBuffer;
+    return S_OK;
+}
+
+CSyntheticSource::CSyntheticSource(TestPattern pattern, BOOL bUnthrottled, UINT64 cFrameLimit) :
+    m_pattern(pattern),
+    m_bUnthrottled(bUnthrottled),
+    m_cFrameLimit(cFrameLimit),
+    m_cGop(0),
+    m_bOpen(FALSE),
+    m_format(c_defaultFormat),
+    m_nFrame(0),
+    m_llStartTime(0)
+{
+}
+
+CSyntheticSource::~CSyntheticSource()
+{
+    Close();
+}
+
+// 打开数据源，记录时钟起点
+HRESULT CSyntheticSource::Open()
+{
+    if (m_frame.empty())
+    {
+        BuildStrips();
+    }
+
+    m_nFrame = 0;
+    m_llStartTime = GetClockTime();
+    m_tStart = std::chrono::steady_clock::now();
+    m_bOpen = TRUE;
+    return S_OK;
+}
+
+// 协商格式：支持 ConfigureSourceReader 列表中的所有格式（NV12/YUY2/UYVY/RGB32/RGB24/IYUV，以及与 IYUV 布局相同的 I420），
+// 其余格式退回 NV12；宽高向下取偶数
+HRESULT CSyntheticSource::NegotiateFormat(const VideoFormat& requested, VideoFormat* pActual)
+{
+    if (pActual == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (requested.width < 2 || requested.height < 2)
+    {
+        return E_INVALIDARG;
+    }
+
+    VideoFormat format = requested;
+
+    if (!IsSupportedSubtype(format.subtype))
+    {
+        format.subtype = FOURCC_NV12;
+    }
+
+    format.width &= ~1u;
+    format.height &= ~1u;
+
+    if (format.fpsNumerator == 0 || format.fpsDenominator == 0)
+    {
+        format.fpsNumerator = c_defaultFormat.fpsNumerator;
+        format.fpsDenominator = c_defaultFormat.fpsDenominator;
+    }
+
+    m_format = format;
+    BuildStrips();
+
+    *pActual = m_format;
+    return S_OK;
+}
+
+// 读取一帧，节流模式下按帧率等待到该帧的时刻
+HRESULT CSyntheticSource::ReadFrame(CaptureFrame* pFrame)
+{
+    return ReadFrameInto(nullptr, 0, pFrame);
+}
+
+// 直接把图案生成到调用方的缓冲区；pBuffer 为 nullptr 时生成到内部缓冲区
+HRESULT CSyntheticSource::ReadFrameInto(BYTE* pBuffer, UINT32 cbBuffer, CaptureFrame* pFrame)
+{
+    if (pFrame == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (!m_bOpen)
+    {
+        return E_UNEXPECTED;
+    }
+
+    *pFrame = CaptureFrame();
+
+    if (m_cFrameLimit != 0 && m_nFrame >= m_cFrameLimit)
+    {
+        return S_FALSE;
+    }
+
+    if (pBuffer == nullptr)
+    {
+        pBuffer = m_frame.data();
+    }
+    else if (cbBuffer < m_frame.size())
+    {
+        return E_INVALIDARG;
+    }
+
+    LONGLONG llTimestamp = WaitForFrameTime(m_nFrame);
+
+    RenderFrame(m_nFrame, pBuffer);
+
+    pFrame->pData = pBuffer;
+    pFrame->cbData = (UINT32)m_frame.size();
+    pFrame->llTimestamp = llTimestamp;
+    pFrame->nSequence = m_nFrame;
+
+    if (m_cGop > 1 && m_nFrame % m_cGop != 0)
+    {
+        pFrame->flags = FrameFlag_Delta;
+    }
+
+    m_nFrame++;
+    return S_OK;
+}
+
+// 节流模式下等待到第 n 帧的时刻；时间戳始终按标称帧率计算，保证可重复
+LONGLONG CSyntheticSource::WaitForFrameTime(UINT64 n)
+{
+    LONGLONG llDuration = GetFrameDuration(m_format);
+
+    if (!m_bUnthrottled)
+    {
+        std::this_thread::sleep_until(m_tStart +
+            std::chrono::duration<LONGLONG, std::ratio<1, HNS_PER_SECOND>>(llDuration * (LONGLONG)n));
+    }
+
+    return m_llStartTime + llDuration * (LONGLONG)n;
+}
+
+// 关闭数据源
+void CSyntheticSource::Close()
+{
+    m_bOpen = FALSE;
+}
+
+// 向条带写入一个像素；条带宽度是帧宽的两倍，滚动时从中截取一帧宽度
+void CSyntheticSource::PutPixel(std::vector<BYTE>& strip, std::vector<BYTE>& chroma, UINT32 x, BYTE r, BYTE g, BYTE b)
+{
+    BYTE y, u, v;
+
+    switch (m_format.subtype)
+    {
+    case FOURCC_NV12:
+        RgbToYuv(r, g, b, &y, &u, &v);
+        strip[x] = y;
+        if ((x & 1) == 0)
+        {
+            chroma[x] = u;
+            chroma[x + 1] = v;
+        }
+        break;
+
+    case FOURCC_IYUV:
+    case FOURCC_I420:
+        // 色度行的前一半是 U，后一半是 V，各自按一半宽度排列
+        RgbToYuv(r, g, b, &y, &u, &v);
+        strip[x] = y;
+        if ((x & 1) == 0)
+        {
+            chroma[x / 2] = u;
+            chroma[chroma.size() / 2 + x / 2] = v;
+        }
+        break;
+
+    case FOURCC_YUY2:
+        RgbToYuv(r, g, b, &y, &u, &v);
+        strip[x * 2] = y;
+        strip[x * 2 + 1] = (x & 1) ? v : u;
+        break;
+
+    case FOURCC_UYVY:
+        RgbToYuv(r, g, b, &y, &u, &v);
+        strip[x * 2] = (x & 1) ? v : u;
+        strip[x * 2 + 1] = y;
+        break;
+
+    case FOURCC_RGB24:
+        strip[x * 3] = b;
+        strip[x * 3 + 1] = g;
+        strip[x * 3 + 2] = r;
+        break;
+
+    case FOURCC_RGB32:
+        strip[x * 4] = b;
+        strip[x * 4 + 1] = g;
+        strip[x * 4 + 2] = r;
+        strip[x * 4 + 3] = 0xFF;
+        break;
+    }
+}
+
+// 生成图案条带：上部 3/4 为 8 条标准彩条，下部为灰阶渐变
+void CSyntheticSource::BuildStrips()
+{
+    static const BYTE bars[8][3] =
+    {
+        { 235, 235, 235 }, { 235, 235, 16 }, { 16, 235, 235 }, { 16, 235, 16 },
+        { 235, 16, 235 }, { 235, 16, 16 }, { 16, 16, 235 }, { 16, 16, 16 },
+    };
+
+    UINT32 cxStrip = m_format.width * 2;
+    UINT32 cbStrip = GetFrameStride(m_format.subtype, cxStrip);
+    UINT32 cbChroma = IsPlanar420(m_format.subtype) ? cxStrip : 0;
+
+    m_frame.assign(GetFrameSize(m_format), 0);
+    m_barStrip.assign(cbStrip, 0);
+    m_rampStrip.assign(cbStrip, 0);
+    m_barChroma.assign(cbChroma, 0);
+    m_rampChroma.assign(cbChroma, 0);
+
+    for (UINT32 x = 0; x < cxStrip; x++)
+    {
+        UINT32 xFrame = x % m_format.width;
+        BYTE gray = (BYTE)(16 + xFrame * 219 / m_format.width);
+
+        if (m_pattern == TestPattern_Flat)
+        {
+            PutPixel(m_barStrip, m_barChroma, x, 128, 128, 128);
+            PutPixel(m_rampStrip, m_rampChroma, x, 128, 128, 128);
+        }
+        else
+        {
+            const BYTE* bar = bars[xFrame * 8 / m_format.width];
+            PutPixel(m_barStrip, m_barChroma, x, bar[0], bar[1], bar[2]);
+            PutPixel(m_rampStrip, m_rampChroma, x, gray, gray, gray);
+        }
+    }
+}
+
+// 生成第 n 帧：从条带中按滚动偏移逐行拷贝，每帧只做内存拷贝，便于产生 4K 高帧率的数据
+void CSyntheticSource::RenderFrame(UINT64 n, BYTE* pDst)
+{
+    UINT32 width = m_format.width;
+    UINT32 height = m_format.height;
+    UINT32 xOffset = (UINT32)((n * c_scrollStep) % width) & ~1u;
+    UINT32 cbRow = GetFrameStride(m_format.subtype, width);
+    UINT32 cbOffset = GetFrameStride(m_format.subtype, xOffset);
+    UINT32 yRamp = height * 3 / 4;
+    BYTE* pFrame = pDst;
+
+    for (UINT32 y = 0; y < height; y++)
+    {
+        const std::vector<BYTE>& strip = (y < yRamp) ? m_barStrip : m_rampStrip;
+        memcpy(pDst, strip.data() + cbOffset, cbRow);
+        pDst += cbRow;
+    }
+
+    if (m_format.subtype == FOURCC_NV12)
+    {
+        for (UINT32 y = 0; y < height / 2; y++)
+        {
+            const std::vector<BYTE>& chroma = (y * 2 < yRamp) ? m_barChroma : m_rampChroma;
+            memcpy(pDst, chroma.data() + xOffset, width);
+            pDst += width;
+        }
+    }
+    else if (IsPlanar420(m_format.subtype))
+    {
+        // 先写全部 U 行，再写全部 V 行
+        for (UINT32 plane = 0; plane < 2; plane++)
+        {
+            for (UINT32 y = 0; y < height / 2; y++)
+            {
+                const std::vector<BYTE>& chroma = (y * 2 < yRamp) ? m_barChroma : m_rampChroma;
+                memcpy(pDst, chroma.data() + plane * width + xOffset / 2, width / 2);
+                pDst += width / 2;
+            }
+        }
+    }
+
+    StampSequence(n, pFrame);
+}
+
+// 帧序号的低位写成一排黑白方块（白为 1），放在画面左上角
+void CSyntheticSource::StampSequence(UINT64 n, BYTE* pDst)
+{
+    UINT32 cBits = m_format.width / c_stampBlock;
+    if (cBits > 32) { cBits = 32; }
+    if (m_format.height < c_stampBlock) { return; }
+
+    UINT32 cbRow = GetFrameStride(m_format.subtype, m_format.width);
+
+    for (UINT32 bit = 0; bit < cBits; bit++)
+    {
+        BYTE level = ((n >> bit) & 1) ? 235 : 16;
+
+        for (UINT32 y = 0; y < c_stampBlock; y++)
+        {
+            BYTE* pRow = pDst + y * cbRow;
+
+            for (UINT32 x = bit * c_stampBlock; x < (bit + 1) * c_stampBlock; x++)
+            {
+                switch (m_format.subtype)
+                {
+                case FOURCC_NV12:
+                case FOURCC_IYUV:
+                case FOURCC_I420:
+                    pRow[x] = level;
+                    break;
+                case FOURCC_YUY2:
+                    pRow[x * 2] = level;
+                    break;
+                case FOURCC_UYVY:
+                    pRow[x * 2 + 1] = level;
+                    break;
+                case FOURCC_RGB24:
+                    pRow[x * 3] = pRow[x * 3 + 1] = pRow[x * 3 + 2] = level;
+                    break;
+                case FOURCC_RGB32:
+                    pRow[x * 4] = pRow[x * 4 + 1] = pRow[x * 4 + 2] = level;
+                    break;
+                }
+            }
+        }
+    }
+}
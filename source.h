@@ -0,0 +1,88 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <vector>
+#include <chrono>
+#include "frame.h"
+
+// ICaptureSource 是采集后端接口：打开设备、协商格式、逐帧读取、关闭
+class ICaptureSource
+{
+public:
+    virtual ~ICaptureSource() {}
+
+    // 打开数据源
+    virtual HRESULT Open() = 0;
+
+    // 按请求的格式协商，pActual 返回实际使用的格式
+    virtual HRESULT NegotiateFormat(const VideoFormat& requested, VideoFormat* pActual) = 0;
+
+    // 读取一帧，阻塞直到有数据；数据源结束时返回 S_FALSE 且 pFrame->pData 为 nullptr
+    // 返回的数据在下一次 ReadFrame 或 Close 之前有效；时间戳最好与 GetClockTime 同一时钟，流水线据此统计设备延迟
+    virtual HRESULT ReadFrame(CaptureFrame* pFrame) = 0;
+
+    // 把一帧读入调用方提供的缓冲区（例如帧缓冲池中的缓冲区），pFrame->pData 指向 pBuffer
+    // 默认实现调用 ReadFrame 后拷贝；能直接写入目标内存的数据源应重写以省去这次拷贝
+    virtual HRESULT ReadFrameInto(BYTE* pBuffer, UINT32 cbBuffer, CaptureFrame* pFrame);
+
+    // 关闭数据源
+    virtual void Close() = 0;
+};
+
+// 测试图案类型
+enum TestPattern
+{
+    TestPattern_ColorBars = 0,  // 滚动的彩条，下方为灰阶渐变
+    TestPattern_Flat,           // 纯灰画面，只有帧序号块变化
+};
+
+// CSyntheticSource 类生成测试图案，用于在没有摄像头的机器上压测流水线
+class CSyntheticSource : public ICaptureSource
+{
+public:
+    // bUnthrottled 为 TRUE 时不按帧率节流，尽可能快地产生帧；cFrameLimit 为 0 表示不限帧数
+    CSyntheticSource(TestPattern pattern = TestPattern_ColorBars, BOOL bUnthrottled = FALSE, UINT64 cFrameLimit = 0);
+    virtual ~CSyntheticSource();
+
+    HRESULT Open();
+    HRESULT NegotiateFormat(const VideoFormat& requested, VideoFormat* pActual);
+    HRESULT ReadFrame(CaptureFrame* pFrame);
+    HRESULT ReadFrameInto(BYTE* pBuffer, UINT32 cbBuffer, CaptureFrame* pFrame);
+    void    Close();
+
+    // 模拟压缩摄像头的帧类型：每 cGop 帧一个关键帧，其余帧标记 FrameFlag_Delta（数据仍是未压缩图案），
+    // 用于检查按帧类型丢帧；0 表示所有帧都是独立的
+    void    SetGopLength(UINT32 cGop) { m_cGop = cGop; }
+
+private:
+    // 等待到第 n 帧的时刻（节流模式），返回该帧的时间戳
+    LONGLONG WaitForFrameTime(UINT64 n);
+
+    // 按当前格式生成图案条带
+    void    BuildStrips();
+
+    // 把一种颜色写入条带中的某个像素
+    void    PutPixel(std::vector<BYTE>& strip, std::vector<BYTE>& chroma, UINT32 x, BYTE r, BYTE g, BYTE b);
+
+    // 把第 n 帧图像生成到 pDst
+    void    RenderFrame(UINT64 n, BYTE* pDst);
+
+    // 在左上角写入帧序号块，便于检查丢帧与乱序
+    void    StampSequence(UINT64 n, BYTE* pDst);
+
+    TestPattern             m_pattern;          // 图案类型
+    BOOL                    m_bUnthrottled;     // 是否不节流
+    UINT64                  m_cFrameLimit;      // 帧数上限
+    UINT32                  m_cGop;             // 模拟的 GOP 长度，0 表示不标记帧类型
+    BOOL                    m_bOpen;            // 是否已打开
+    VideoFormat             m_format;           // 协商后的格式
+
+    std::vector<BYTE>       m_frame;            // 当前帧
+    std::vector<BYTE>       m_barStrip;         // 彩条行（双倍宽度，用于滚动）
+    std::vector<BYTE>       m_barChroma;        // 彩条的色度行（NV12 为 UV 交错，IYUV 为 U 半行后接 V 半行）
+    std::vector<BYTE>       m_rampStrip;        // 灰阶行
+    std::vector<BYTE>       m_rampChroma;       // 灰阶的色度行
+
+    UINT64                  m_nFrame;           // 已产生的帧数
+    LONGLONG                m_llStartTime;      // 打开时的时钟（100 纳秒），模拟设备时间戳的起点
+    std::chrono::steady_clock::time_point m_tStart; // 节流的起始时刻
+};
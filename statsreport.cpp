@@ -0,0 +1,222 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "statsreport.h"
+
+// 以写方式打开宽字符路径的文件
+static FILE* OpenReportFile(const WCHAR* pwszPath)
+{
+#ifdef _WIN32
+    FILE* pFile = nullptr;
+    return _wfopen_s(&pFile, pwszPath, L"w") == 0 ? pFile : nullptr;
+#else
+    size_t cch = wcstombs(nullptr, pwszPath, 0);
+
+    if (cch == (size_t)-1)
+    {
+        return nullptr;
+    }
+
+    std::vector<char> path(cch + 1);
+    wcstombs(path.data(), pwszPath, cch + 1);
+    return fopen(path.data(), "w");
+#endif
+}
+
+CStatsReporter::CStatsReporter() :
+    m_pFile(nullptr),
+    m_format(StatsFormat_Text),
+    m_intervalMs(DEFAULT_STATS_INTERVAL_MS),
+    m_llStart(0),
+    m_bStop(FALSE)
+{
+}
+
+CStatsReporter::~CStatsReporter()
+{
+    Stop();
+}
+
+// 添加一路流水线
+HRESULT CStatsReporter::AddPipeline(const char* pszName, const CFramePipeline* pPipeline)
+{
+    if (pszName == nullptr || pPipeline == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    Entry entry = { pszName, pPipeline };
+    m_entries.push_back(entry);
+    return S_OK;
+}
+
+// 创建输出文件并启动后台线程
+HRESULT CStatsReporter::Start(const WCHAR* pwszPath, StatsFormat format, UINT32 intervalMs)
+{
+    if (pwszPath == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (m_pFile)
+    {
+        return E_UNEXPECTED;
+    }
+
+    m_pFile = OpenReportFile(pwszPath);
+
+    if (m_pFile == nullptr)
+    {
+        return errno == EACCES ? HRESULT_FROM_WIN32(ERROR_ACCESS_DENIED) : E_FAIL;
+    }
+
+    m_format = format;
+    m_intervalMs = intervalMs ? intervalMs : DEFAULT_STATS_INTERVAL_MS;
+    m_llStart = GetClockTime();
+    m_bStop = FALSE;
+
+    m_thread = std::thread(&CStatsReporter::ReportThread, this);
+    return S_OK;
+}
+
+// 停止后台线程，再输出最后一次统计（此时流水线可能已停止，统计为最终结果）
+HRESULT CStatsReporter::Stop()
+{
+    if (m_pFile == nullptr)
+    {
+        m_entries.clear();
+        return S_OK;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = TRUE;
+        m_cvStop.notify_one();
+    }
+    m_thread.join();
+
+    WriteReport();
+
+    HRESULT hr = (fclose(m_pFile) == 0) ? S_OK : E_FAIL;
+    m_pFile = nullptr;
+    m_entries.clear();
+    return hr;
+}
+
+// 输出所有流水线的一次统计并刷新文件，文件中途被截断时也只丢最后一次
+void CStatsReporter::WriteReport()
+{
+    double fTime = (GetClockTime() - m_llStart) / 1e7;
+
+    for (size_t i = 0; i < m_entries.size(); i++)
+    {
+        PipelineStats stats;
+        DropStats drops;
+        LatencySnapshot latency;
+
+        m_entries[i].pPipeline->GetStats(&stats);
+        m_entries[i].pPipeline->GetDropStats(&drops);
+        m_entries[i].pPipeline->GetLatency(&latency);
+
+        WriteEntry(m_pFile, m_format, fTime, m_entries[i].name.c_str(), stats, drops, latency);
+    }
+
+    fflush(m_pFile);
+}
+
+// 后台线程：每隔 m_intervalMs 输出一次，直到收到停止请求
+void CStatsReporter::ReportThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_cvStop.wait_for(lock, std::chrono::milliseconds(m_intervalMs), [this]() { return m_bStop != FALSE; }))
+    {
+        lock.unlock();
+        WriteReport();
+        lock.lock();
+    }
+}
+
+// 文本格式为一行汇总、有丢帧时一行分原因的丢帧数，再加每个有样本的阶段一行；
+// JSON 格式为一行对象，所有原因和阶段都输出，便于脚本按固定字段解析
+// first_frame_ms 为从开始捕获（激活设备）到第一帧到达的毫秒数，用于衡量重启后恢复录制的时间；
+// recoveries 和 *_recovery_ms 为设备丢失后不重启、换上设备接着录制的次数和从丢失到恢复后第一帧的毫秒数；
+// last_drop_age 为最近一次丢帧距今的秒数（没有丢帧时为 -1），与 overload_seconds 一起用于发现持续过载
+void CStatsReporter::WriteEntry(FILE* pFile, StatsFormat format, double fTime, const char* pszName,
+    const PipelineStats& stats, const DropStats& drops, const LatencySnapshot& latency)
+{
+    double fLastDropAge = drops.cTotal ? (GetClockTime() - drops.llLastDrop) / 1e7 : -1;
+
+    if (format == StatsFormat_Json)
+    {
+        fprintf(pFile, "{\"time\":%.3f,\"pipeline\":\"%s\",\"frames\":%llu,\"fps\":%.2f,\"dropped\":%llu,\"bytes\":%llu,"
+            "\"queue_high_water\":%u,\"first_frame_ms\":%.1f,\"drops\":{", fTime, pszName, (unsigned long long)stats.cFrames,
+            stats.fFps, (unsigned long long)stats.cOverflows, (unsigned long long)stats.cbWritten, stats.cQueueHighWater,
+            stats.fFirstFrameMs);
+
+        for (UINT32 i = 0; i < DropReason_Count; i++)
+        {
+            fprintf(pFile, "%s\"%s\":%llu", i ? "," : "", GetDropReasonName((DropReason)i),
+                (unsigned long long)drops.cDrops[i]);
+        }
+
+        fprintf(pFile, "},\"overload_seconds\":%u,\"last_drop_age\":%.3f,\"device_losses\":%u,\"recoveries\":%u,"
+            "\"last_recovery_ms\":%.1f,\"max_recovery_ms\":%.1f,\"device_lost\":%s,\"stages\":{", drops.cOverloadSeconds,
+            fLastDropAge, stats.cDeviceLosses, stats.cRecoveries, stats.fLastRecoveryMs, stats.fMaxRecoveryMs,
+            stats.bDeviceLost ? "true" : "false");
+
+        for (UINT32 i = 0; i < LatencyStage_Count; i++)
+        {
+            const LatencySummary& stage = latency.stages[i];
+
+            fprintf(pFile, "%s\"%s\":{\"count\":%llu,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p99_us\":%.2f,\"p999_us\":%.2f,"
+                "\"max_us\":%.2f}", i ? "," : "", GetLatencyStageName((LatencyStage)i),
+                (unsigned long long)stage.cSamples, stage.fMeanUs, stage.fP50Us, stage.fP99Us, stage.fP999Us,
+                stage.fMaxUs);
+        }
+
+        fprintf(pFile, "}}\n");
+        return;
+    }
+
+    fprintf(pFile, "[%9.3f s] %s: %llu frames, %.1f fps, %llu dropped, %.1f MB written, first frame %.1f ms\n", fTime,
+        pszName, (unsigned long long)stats.cFrames, stats.fFps, (unsigned long long)stats.cOverflows, stats.cbWritten / 1e6,
+        stats.fFirstFrameMs);
+    if (drops.cTotal != 0)
+    {
+        fprintf(pFile, "    drops   ");
+
+        for (UINT32 i = 0; i < DropReason_Count; i++)
+        {
+            if (drops.cDrops[i] != 0)
+            {
+                fprintf(pFile, " %s %llu", GetDropReasonName((DropReason)i), (unsigned long long)drops.cDrops[i]);
+            }
+        }
+
+        fprintf(pFile, ", overloaded %u s, last %.1f s ago\n", drops.cOverloadSeconds, fLastDropAge);
+    }
+    if (stats.cDeviceLosses != 0)
+    {
+        fprintf(pFile, "    device   lost %u, recovered %u, last %.1f ms, max %.1f ms%s\n", stats.cDeviceLosses,
+            stats.cRecoveries, stats.fLastRecoveryMs, stats.fMaxRecoveryMs, stats.bDeviceLost ? ", lost now" : "");
+    }
+
+    fprintf(pFile, "    %-8s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "mean", "p50", "p99", "p99.9",
+        "max (us)");
+
+    for (UINT32 i = 0; i < LatencyStage_Count; i++)
+    {
+        const LatencySummary& stage = latency.stages[i];
+
+        if (stage.cSamples == 0)
+        {
+            continue;
+        }
+
+        fprintf(pFile, "    %-8s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", GetLatencyStageName((LatencyStage)i),
+            (unsigned long long)stage.cSamples, stage.fMeanUs, stage.fP50Us, stage.fP99Us, stage.fP999Us, stage.fMaxUs);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "pipeline.h"
+
+// 统计报告的文件格式
+enum StatsFormat
+{
+    StatsFormat_Text = 0,   // 便于阅读的表格，每次输出一段
+    StatsFormat_Json,       // JSON Lines：每次输出、每路流水线一行 JSON 对象
+};
+
+// 默认的输出间隔（毫秒）
+const UINT32 DEFAULT_STATS_INTERVAL_MS = 1000;
+
+// CStatsReporter 类在后台线程中按固定间隔把各路流水线的帧率、分原因的丢帧数、写出字节数和各阶段延迟分位数
+// 追加到文件中；读取统计不加锁（丢帧统计只在丢帧时加锁），不影响采集和写入线程
+// 流水线由调用方持有，必须在 Stop 之后才能释放
+class CStatsReporter
+{
+public:
+    CStatsReporter();
+    ~CStatsReporter();
+
+    // 添加一路流水线，pszName 用于区分各路（例如 "camera0"），在 Start 之前调用
+    HRESULT AddPipeline(const char* pszName, const CFramePipeline* pPipeline);
+
+    // 创建（覆盖）输出文件并启动后台线程，每 intervalMs 毫秒输出一次
+    HRESULT Start(const WCHAR* pwszPath, StatsFormat format, UINT32 intervalMs = DEFAULT_STATS_INTERVAL_MS);
+
+    // 输出最后一次统计，停止后台线程并关闭文件，再清空流水线列表
+    HRESULT Stop();
+
+    // 是否正在输出
+    BOOL    IsRunning() const { return m_pFile != nullptr; }
+
+    // 把一路流水线的统计按指定格式写到 pFile，fTime 为启动报告后的秒数
+    static void WriteEntry(FILE* pFile, StatsFormat format, double fTime, const char* pszName,
+        const PipelineStats& stats, const DropStats& drops, const LatencySnapshot& latency);
+
+private:
+    CStatsReporter(const CStatsReporter&);
+    CStatsReporter& operator=(const CStatsReporter&);
+
+    // 输出所有流水线的一次统计
+    void    WriteReport();
+
+    // 后台线程
+    void    ReportThread();
+
+    // Entry 结构体保存一路流水线
+    struct Entry
+    {
+        std::string             name;       // 名称
+        const CFramePipeline*   pPipeline;  // 流水线
+    };
+
+    std::vector<Entry>      m_entries;      // 各路流水线
+    FILE*                   m_pFile;        // 输出文件
+    StatsFormat             m_format;       // 文件格式
+    UINT32                  m_intervalMs;   // 输出间隔
+    LONGLONG                m_llStart;      // 启动时刻（GetClockTime）
+    std::thread             m_thread;       // 后台线程
+    std::mutex              m_mutex;        // 与 m_cvStop 配合使用
+    std::condition_variable m_cvStop;       // 通知后台线程停止
+    BOOL                    m_bStop;        // 请求后台线程停止
+};
@@ -0,0 +1,166 @@
+#include <new>
+#include "taskpool.h"
+
+CTaskPool::CTaskPool() :
+    m_pfnTask(nullptr),
+    m_pContext(nullptr),
+    m_cTasks(0),
+    m_nGeneration(0),
+    m_cBusy(0),
+    m_bShutdown(false),
+    m_nNext(0),
+    m_cCompleted(0)
+{
+}
+
+CTaskPool::~CTaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bShutdown = true;
+    }
+    m_cvWork.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+    {
+        m_threads[i].join();
+    }
+}
+
+// 启动工作线程
+HRESULT CTaskPool::Initialize(UINT32 cThreads)
+{
+    if (!m_threads.empty())
+    {
+        return E_UNEXPECTED;
+    }
+
+    if (cThreads == 0)
+    {
+        cThreads = std::thread::hardware_concurrency();
+    }
+
+    try
+    {
+        for (UINT32 i = 1; i < cThreads; i++)
+        {
+            m_threads.push_back(std::thread(&CTaskPool::WorkerThread, this));
+        }
+    }
+    catch (const std::exception&)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    return S_OK;
+}
+
+// 进程内共享的默认线程池
+CTaskPool* CTaskPool::GetDefault()
+{
+    static CTaskPool* s_pPool = nullptr;
+    static std::once_flag s_once;
+
+    std::call_once(s_once, []()
+    {
+        s_pPool = new (std::nothrow) CTaskPool();
+
+        if (s_pPool && FAILED(s_pPool->Initialize(0)))
+        {
+            delete s_pPool;
+            s_pPool = nullptr;
+        }
+    });
+
+    return s_pPool;
+}
+
+// 并行执行 cTasks 个任务
+void CTaskPool::ParallelFor(UINT32 cTasks, PFN_TASK pfnTask, void* pContext)
+{
+    if (cTasks == 0)
+    {
+        return;
+    }
+
+    if (cTasks == 1 || m_threads.empty())
+    {
+        for (UINT32 i = 0; i < cTasks; i++)
+        {
+            pfnTask(pContext, i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> callLock(m_callMutex);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        // 上一批中醒得晚的工作线程退出之后才能改写任务描述
+        m_cvDone.wait(lock, [this]() { return m_cBusy == 0; });
+
+        m_pfnTask = pfnTask;
+        m_pContext = pContext;
+        m_cTasks = cTasks;
+        m_nNext.store(0);
+        m_cCompleted.store(0);
+        m_nGeneration++;
+    }
+    m_cvWork.notify_all();
+
+    RunTasks(pfnTask, pContext, cTasks);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [this, cTasks]() { return m_cCompleted.load() == cTasks && m_cBusy == 0; });
+}
+
+// 工作线程：等待新的任务批次，领取任务直到领完
+void CTaskPool::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    UINT64 nSeen = 0;
+
+    for (;;)
+    {
+        m_cvWork.wait(lock, [this, &nSeen]() { return m_bShutdown || m_nGeneration != nSeen; });
+
+        if (m_bShutdown)
+        {
+            break;
+        }
+
+        nSeen = m_nGeneration;
+        m_cBusy++;
+
+        PFN_TASK pfnTask = m_pfnTask;
+        void* pContext = m_pContext;
+        UINT32 cTasks = m_cTasks;
+
+        lock.unlock();
+        RunTasks(pfnTask, pContext, cTasks);
+        lock.lock();
+
+        if (--m_cBusy == 0)
+        {
+            m_cvDone.notify_all();
+        }
+    }
+}
+
+// 领取并执行任务
+void CTaskPool::RunTasks(PFN_TASK pfnTask, void* pContext, UINT32 cTasks)
+{
+    for (;;)
+    {
+        UINT32 index = m_nNext.fetch_add(1);
+
+        if (index >= cTasks)
+        {
+            break;
+        }
+
+        pfnTask(pContext, index);
+        m_cCompleted.fetch_add(1);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once // 只包含一次头文件，防止重复包含
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "platform.h"
+
+// 任务函数：index 为任务序号 [0, cTasks)
+typedef void (*PFN_TASK)(void* pContext, UINT32 index);
+
+// CTaskPool 类是一组常驻的工作线程，用于把一帧的处理按行带等切分后并行执行
+// ParallelFor 期间调用线程也参与执行，返回时所有任务都已完成；每次调用不分配堆内存
+class CTaskPool
+{
+public:
+    CTaskPool();
+    ~CTaskPool();
+
+    // 启动工作线程，cThreads 为参与计算的线程总数（含调用线程），0 表示使用全部逻辑核
+    HRESULT Initialize(UINT32 cThreads);
+
+    // 参与计算的线程总数（含调用线程）
+    UINT32  ThreadCount() const { return (UINT32)m_threads.size() + 1; }
+
+    // 并行执行 cTasks 个任务，阻塞直到全部完成；多个线程同时调用时依次执行
+    void    ParallelFor(UINT32 cTasks, PFN_TASK pfnTask, void* pContext);
+
+    // 进程内共享的默认线程池，首次调用时创建
+    static CTaskPool* GetDefault();
+
+private:
+    CTaskPool(const CTaskPool&);
+    CTaskPool& operator=(const CTaskPool&);
+
+    // 工作线程
+    void    WorkerThread();
+
+    // 领取并执行任务，直到任务领完
+    void    RunTasks(PFN_TASK pfnTask, void* pContext, UINT32 cTasks);
+
+    std::vector<std::thread>    m_threads;      // 工作线程
+    std::mutex                  m_callMutex;    // 串行化 ParallelFor 调用
+    std::mutex                  m_mutex;        // 保护下面的任务描述
+    std::condition_variable     m_cvWork;       // 通知工作线程有新任务
+    std::condition_variable     m_cvDone;       // 通知调用线程任务完成
+
+    PFN_TASK                    m_pfnTask;      // 当前任务函数
+    void*                       m_pContext;     // 当前任务上下文
+    UINT32                      m_cTasks;       // 当前任务数
+    UINT64                      m_nGeneration;  // 任务批次号
+    UINT32                      m_cBusy;        // 正在执行当前批次的工作线程数
+    bool                        m_bShutdown;    // 请求退出
+
+    std::atomic<UINT32>         m_nNext;        // 下一个待领取的任务序号
+    std::atomic<UINT32>         m_cCompleted;   // 已完成的任务数
+};